@@ -20,78 +20,114 @@
 
 namespace Assets
 {
-    static Utility::Threading::RecursiveMutex ResourceDependenciesLock;
-    static std::vector<std::pair<const OnChangeCallback*, std::weak_ptr<DependencyValidation>>> ResourceDependencies;
-    static unsigned ResourceDepsChangeId = 0;
+        //  Each DependencyValidation stores the list of objects that depend on it.
+        //  Registering a dependency only locks the list that is being modified. Rather
+        //  than a mutex per object, objects share a small set of mutexes, selected by
+        //  address
+    static Utility::Threading::Mutex DependentListLocks[64];
+    static Interlocked::Value NextPropagationId = 0;
+
+    static Utility::Threading::Mutex& GetDependentListLock(const DependencyValidation* obj)
+    {
+        return DependentListLocks[(size_t(obj) / sizeof(void*)) % dimof(DependentListLocks)];
+    }
+
+        //  A single change propagates through the graph as one breadth first traversal.
+        //  Every object reached is stamped with the id of the traversal as it is queued,
+        //  so an object that is reachable through many paths is only invalidated once.
+        //  (Two traversals running at the same time on different threads may both
+        //  invalidate the same object, but that is harmless)
+    class DependencyPropagation
+    {
+    public:
+        unsigned _id;
+        std::vector<std::shared_ptr<DependencyValidation>> _queue;
+
+        void QueueDependents(DependencyValidation& obj)
+        {
+            ScopedLock(GetDependentListLock(&obj));
+            auto& dependents = obj._dependents;
+            auto dst = dependents.begin();
+            for (auto i=dependents.begin(); i!=dependents.end(); ++i) {
+                auto l = i->lock();
+                if (!l) continue;       // (expired dependents are removed here)
+
+                if (unsigned(Interlocked::Exchange((Interlocked::Value volatile*)&l->_propagationId, _id)) != _id)
+                    _queue.push_back(std::move(l));
+                if (dst != i) *dst = std::move(*i);
+                ++dst;
+            }
+            dependents.erase(dst, dependents.end());
+        }
+
+        static unsigned BeginPropagation(DependencyValidation& root)
+        {
+            auto id = unsigned(Interlocked::Increment(&NextPropagationId)+1);
+            Interlocked::Exchange((Interlocked::Value volatile*)&root._propagationId, id);
+            return id;
+        }
+    };
+
+        //  Set while a change is being propagated on this thread
+    static thread_local DependencyPropagation* ActivePropagation = nullptr;
 
     void Dependencies_Shutdown()
     {
-        decltype(ResourceDependencies) temp;
-        temp.swap(ResourceDependencies);
+            //  Dependency links are stored in the DependencyValidation objects themselves, 
+            //  so there is no global state to release here any more
     }
 
     void    DependencyValidation::OnChange()
     { 
         ++_validationIndex;
-        ResourceDependenciesLock.lock();
-
-        auto range = std::equal_range(
-            ResourceDependencies.begin(), ResourceDependencies.end(), 
-            this, CompareFirst<const OnChangeCallback*, std::weak_ptr<DependencyValidation>>());
-
-        unsigned changeIdStart = ResourceDepsChangeId;
-
-        bool foundExpired = false;
-        for (auto i=range.first; i!=range.second; ++i) {
-            auto l = i->second.lock();
-            if (l) { 
-                l->OnChange();
-
-                if (ResourceDepsChangeId != changeIdStart) {
-                    // another object may have changed the list of objects 
-                    // during the OnChange() call. If this happens,
-                    // we need to search through and find the range again.
-                    // then we need to set 'i' to the position of the 
-                    // same element in the new range (it's guaranteed to
-                    // be there, because we have a lock on it!
-                    // Oh, it's a wierd hack... But it should work well.
-
-                    range = std::equal_range(
-                        ResourceDependencies.begin(), ResourceDependencies.end(), 
-                        this, CompareFirst<const OnChangeCallback*, std::weak_ptr<DependencyValidation>>());
-
-                    for (i=range.first;; ++i) {
-                        assert(i!=range.second);
-                        if (Equivalent(i->second, l)) break;
-                    }
 
-                    changeIdStart = ResourceDepsChangeId;
-                }
-            }
-            else foundExpired = true;
+            //  If we're already propagating a change on this thread, we've been reached
+            //  as part of that traversal. Just add our dependents to the same traversal
+            //  (rather than recursing)
+        if (ActivePropagation) {
+            ActivePropagation->QueueDependents(*this);
+            return;
         }
 
-        if (foundExpired) {
-                // Remove any pointers that have expired
-                // (note that we only check matching pointers. Non-matching pointers
-                // that have expired are untouched)
-            ResourceDependencies.erase(
-                std::remove_if(range.first, range.second, 
-                    [](std::pair<const OnChangeCallback*, std::weak_ptr<DependencyValidation>>& i)
-                    { return i.second.expired(); }),
-                range.second);
-            ++ResourceDepsChangeId; // signal to callers that this has changed
-        }
+        DependencyPropagation propagation;
+        propagation._id = DependencyPropagation::BeginPropagation(*this);
 
-        ResourceDependenciesLock.unlock();
+        class AutoClear
+        {
+        public:
+            ~AutoClear() { ActivePropagation = nullptr; }
+        } autoClear;
+        ActivePropagation = &propagation;
+
+        propagation.QueueDependents(*this);
+        for (size_t c=0; c<propagation._queue.size(); ++c) {
+                //  OnChange() is virtual; derived types should call back into
+                //  DependencyValidation::OnChange(), which will queue their dependents.
+                //  Note that _queue can grow during this call.
+            auto next = propagation._queue[c];
+            next->OnChange();
+        }
     }
 
     void    DependencyValidation::RegisterDependency(const std::shared_ptr<Utility::OnChangeCallback>& dependency)
     {
-        ResourceDependenciesLock.lock();
-        auto i = LowerBound(ResourceDependencies, (const OnChangeCallback*)dependency.get());
-        ResourceDependencies.insert(i, std::make_pair(dependency.get(), shared_from_this()));
-        ResourceDependenciesLock.unlock();
+            //  Only DependencyValidation objects propagate changes to their dependents. For
+            //  other callback types there's no link to record (we still hold a reference, below)
+        auto* upstream = dynamic_cast<DependencyValidation*>(dependency.get());
+        if (upstream) {
+            ScopedLock(GetDependentListLock(upstream));
+            auto& dependents = upstream->_dependents;
+            if (dependents.size() == dependents.capacity()) {
+                    //  Before we grow the list, remove any expired dependents. Long lived
+                    //  objects (such as shared include files) can otherwise accumulate 
+                    //  many dead links between changes
+                dependents.erase(
+                    std::remove_if(dependents.begin(), dependents.end(),
+                        [](const std::weak_ptr<DependencyValidation>& i) { return i.expired(); }),
+                    dependents.end());
+            }
+            dependents.push_back(shared_from_this());
+        }
 
             // We must hold a reference to the dependency -- otherwise it can be destroyed,
             // and links to downstream assets/files might be lost
@@ -104,12 +140,21 @@ namespace Assets
         _dependenciesOverflow.push_back(dependency);
     }
 
+    unsigned    DependencyValidation::GetDependentCount() const
+    {
+        ScopedLock(GetDependentListLock(this));
+        return unsigned(_dependents.size());
+    }
+
+        //  Note that the list of dependents is not moved. Dependents are registered 
+        //  against a particular object, and stay with that object.
     DependencyValidation::DependencyValidation(DependencyValidation&& moveFrom) never_throws
     {
         _validationIndex = moveFrom._validationIndex;
         for (unsigned c=0; c<dimof(_dependencies); ++c)
             _dependencies[c] = std::move(moveFrom._dependencies[c]);
         _dependenciesOverflow = std::move(moveFrom._dependenciesOverflow);
+        _propagationId = 0;
     }
 
     DependencyValidation& DependencyValidation::operator=(DependencyValidation&& moveFrom) never_throws
@@ -317,6 +362,16 @@ namespace Assets
 
     const ResChar* DirectorySearchRules::GetFirstSearchDir() const { return _buffer; }
 
+    uint64 DirectorySearchRules::CalculateHash() const
+    {
+            // (note that this is sensitive to the order and the exact spelling of the
+            // directories -- rules that resolve the same way might still have different hashes)
+        const ResChar* b = _buffer;
+        if (!_bufferOverflow.empty())
+            b = AsPointer(_bufferOverflow.begin());
+        return Hash64(b, &b[_bufferUsed]);
+    }
+
     DirectorySearchRules::DirectorySearchRules()
     {
         _buffer[0] = '\0';
@@ -377,9 +432,18 @@ namespace Assets
 
         auto InvalidAsset::State() const -> AssetState { return AssetState::Invalid; }
 
+        static Interlocked::Value s_pendingAssetCreationCount = 0;
+
         PendingAsset::PendingAsset(const char initializer[], const char what[]) 
         : AssetException(initializer, what) 
-        {}
+        {
+            Interlocked::Increment(&s_pendingAssetCreationCount);
+        }
+
+        unsigned PendingAsset::GetCreationCount()
+        {
+            return (unsigned)Interlocked::Load(&s_pendingAssetCreationCount);
+        }
 
         bool PendingAsset::CustomReport() const
         {
@@ -411,18 +475,75 @@ namespace Assets
     }
 
 
-    PendingOperationMarker::PendingOperationMarker() : _state(AssetState::Pending)
+        //  Threads waiting on markers, and continuations registered with markers are
+        //  kept in a small fixed table of slots, selected by hashing the marker's address
+        //  (in the same way that a futex maps addresses onto wait queues). This way the
+        //  markers themselves don't need to own a mutex or condition variable -- and
+        //  there can be very many markers alive at the same time.
+        //  Markers that share a slot may wake each other spuriously; but waiters always
+        //  recheck the state of their own marker.
+    namespace Internal
+    {
+        class MarkerWaitSlot
+        {
+        public:
+            Threading::Mutex        _lock;
+            Threading::Conditional  _stateChanged;
+            std::vector<std::pair<const PendingOperationMarker*, PendingOperationMarker::Continuation>> _continuations;
+        };
+
+        static const unsigned MarkerWaitSlotCount = 64;
+        static MarkerWaitSlot s_markerWaitSlots[MarkerWaitSlotCount];
+
+        static MarkerWaitSlot& GetWaitSlot(const PendingOperationMarker* marker)
+        {
+            return s_markerWaitSlots[IntegerHash64(uint64(size_t(marker))) % MarkerWaitSlotCount];
+        }
+
+        static std::vector<PendingOperationMarker::Continuation> ExtractContinuations(
+            MarkerWaitSlot& slot, const PendingOperationMarker* marker)
+        {
+            std::vector<PendingOperationMarker::Continuation> result;
+            auto dst = slot._continuations.begin();
+            for (auto i=slot._continuations.begin(); i!=slot._continuations.end(); ++i) {
+                if (i->first == marker) {
+                    result.push_back(std::move(i->second));
+                } else {
+                    if (dst != i) *dst = std::move(*i);
+                    ++dst;
+                }
+            }
+            slot._continuations.erase(dst, slot._continuations.end());
+            return std::move(result);
+        }
+    }
+
+    PendingOperationMarker::PendingOperationMarker() : _state(AssetState::Pending), _hasContinuations(false)
     {
         DEBUG_ONLY(_initializer[0] = '\0');
     }
 
     PendingOperationMarker::PendingOperationMarker(AssetState state) 
-    : _state(state)
+    : _state(state), _hasContinuations(false)
     {
         DEBUG_ONLY(_initializer[0] = '\0');
     }
 
-    PendingOperationMarker::~PendingOperationMarker() {}
+    PendingOperationMarker::~PendingOperationMarker() 
+    {
+            //  Anyone still waiting for this operation will never get a result
+            //  (but note that there can't be any threads stalling on a marker
+            //  that is being destroyed)
+        if (_hasContinuations) {
+            auto& slot = Internal::GetWaitSlot(this);
+            std::vector<Continuation> continuations;
+            {
+                ScopedLock(slot._lock);
+                continuations = Internal::ExtractContinuations(slot, this);
+            }
+            for (auto& c:continuations) c(AssetState::Invalid);
+        }
+    }
 
     const char* PendingOperationMarker::Initializer() const
     {
@@ -440,20 +561,54 @@ namespace Assets
 
     void PendingOperationMarker::SetState(AssetState newState)
     {
-        _state = newState;
+        auto& slot = Internal::GetWaitSlot(this);
+        std::vector<Continuation> continuations;
+        {
+            ScopedLock(slot._lock);
+            _state = newState;
+            if (newState == AssetState::Pending) return;
+
+            if (_hasContinuations) {
+                continuations = Internal::ExtractContinuations(slot, this);
+                _hasContinuations = false;
+            }
+            slot._stateChanged.notify_all();
+        }
+
+            //  Continuations are called outside of the lock, so they can 
+            //  query (or wait on) other markers
+        for (auto& c:continuations) c(newState);
     }
 
     AssetState PendingOperationMarker::StallWhilePending() const
     {
-            // Stall until the _state variable changes
-            // in another thread.
-            // there is no semaphore, so we must poll
-            // note -- we should start a progress bar here...
-        volatile AssetState* state = const_cast<AssetState*>(&_state);
-        while (*state == AssetState::Pending)
-            Threading::YieldTimeSlice();
+            //  Fast path for markers that are already complete
+        auto state = *(volatile AssetState*)&_state;
+        if (state != AssetState::Pending) return state;
+
+            //  Stall until another thread calls SetState()
+            //  note -- we should start a progress bar here...
+        auto& slot = Internal::GetWaitSlot(this);
+        std::unique_lock<Threading::Mutex> lock(slot._lock);
+        while (_state == AssetState::Pending)
+            slot._stateChanged.wait(lock);
+        return _state;
+    }
 
-        return *state;
+    void PendingOperationMarker::AddContinuation(Continuation&& continuation)
+    {
+        auto& slot = Internal::GetWaitSlot(this);
+        AssetState state;
+        {
+            ScopedLock(slot._lock);
+            state = _state;
+            if (state == AssetState::Pending) {
+                slot._continuations.push_back(std::make_pair(this, std::move(continuation)));
+                _hasContinuations = true;
+                return;
+            }
+        }
+        continuation(state);
     }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -9,6 +9,7 @@
 #include "AssetsCore.h"
 #include "Assets.h"
 #include "../Utility/UTFUtils.h"
+#include <functional>
 
 namespace Assets
 {
@@ -31,6 +32,7 @@ namespace Assets
                 { ResolveFile(destination, Count, baseName); }
 
         const ResChar* GetFirstSearchDir() const;
+        uint64 CalculateHash() const;
 
         void Merge(const DirectorySearchRules& mergeFrom);
 
@@ -69,12 +71,21 @@ namespace Assets
         ////////////////////////////////////////////////////////////////////////////////////////////////
 
     /// <summary>Records the status of asynchronous operation, very much like a std::promise<AssetState></summary>
+    /// Threads can block until the operation completes with StallWhilePending(), or
+    /// register a continuation with AddContinuation(). Continuations are called once,
+    /// when the state changes from Pending to Ready or Invalid. They are called in the
+    /// thread that calls SetState() (or immediately, in the calling thread, if the
+    /// operation has already completed). A marker destroyed while still pending calls
+    /// its continuations with AssetState::Invalid.
     class PendingOperationMarker : public std::enable_shared_from_this<PendingOperationMarker>
     {
     public:
+        using Continuation = std::function<void(AssetState)>;
+
         AssetState		GetAssetState() const { return _state; }
         void			SetState(AssetState newState);
         AssetState		StallWhilePending() const;
+        void            AddContinuation(Continuation&& continuation);
 
             // "initializer" interface only provided in debug builds, and only intended for debugging
         const char*     Initializer() const;
@@ -85,6 +96,7 @@ namespace Assets
         ~PendingOperationMarker();
     protected:
         AssetState _state;
+        bool _hasContinuations;
         DEBUG_ONLY(char _initializer[MaxPath];)
     };
 
@@ -65,10 +65,11 @@ namespace Assets
     public:
         virtual void    OnChange();
         unsigned        GetValidationIndex() const        { return _validationIndex; }
+        unsigned        GetDependentCount() const;      ///< (includes expired dependents that haven't been removed yet)
 
         void    RegisterDependency(const std::shared_ptr<Utility::OnChangeCallback>& dependency);
 
-        DependencyValidation() : _validationIndex(0)  {}
+        DependencyValidation() : _validationIndex(0), _propagationId(0)  {}
         DependencyValidation(DependencyValidation&&) never_throws;
         DependencyValidation& operator=(DependencyValidation&&) never_throws;
         ~DependencyValidation();
@@ -82,6 +83,13 @@ namespace Assets
             // this is just to avoid extra allocation where possible
         std::shared_ptr<Utility::OnChangeCallback> _dependencies[4];
         std::vector<std::shared_ptr<Utility::OnChangeCallback>> _dependenciesOverflow;
+
+            // objects that depend on this one (ie, the reverse links of _dependencies)
+            // These are protected by a lock shared with a few other objects (see AssetUtils.cpp)
+        std::vector<std::weak_ptr<DependencyValidation>> _dependents;
+        unsigned _propagationId;
+
+        friend class DependencyPropagation;
     };
 
     /// <summary>Registers a dependency on a file on disk</summary>
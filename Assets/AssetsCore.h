@@ -57,12 +57,19 @@ namespace Assets
         /// For example, shader resources can take some time to compile. If we attempt
         /// to use the shader while it's still compiling, we'll get a PendingAsset
         /// exception.
+        ///
+        /// Hot paths should prefer non-throwing queries (eg, ModelCache::TryGetModel)
+        /// where they are available. GetCreationCount() returns the number of these
+        /// exceptions created since startup, which is useful for measuring how many
+        /// are still being thrown (for example, while a large level is streaming in).
         class PendingAsset : public AssetException
         {
         public: 
             virtual bool CustomReport() const;
             virtual AssetState State() const;
 
+            static unsigned GetCreationCount();
+
             PendingAsset(const ResChar initializer[], const char what[]);
         };
 
@@ -38,6 +38,9 @@ namespace Assets
 		std::unique_ptr<IThreadPump> _threadPump;
 
 		Utility::Threading::Mutex _pollingProcessesLock;
+        Interlocked::Value _completedProcessCount;
+
+        Pimpl() : _completedProcessCount(0) {}
 	};
 
     void CompileAndAsyncManager::Update()
@@ -62,7 +65,10 @@ namespace Assets
                     } CATCH_END
 
                             // remove if necessary...
-			        if (remove) { i = _pimpl->_pollingProcesses.erase(i); }
+			        if (remove) { 
+                        i = _pimpl->_pollingProcesses.erase(i); 
+                        Interlocked::Increment(&_pimpl->_completedProcessCount);
+                    }
                     else { ++i; }
                 }
             } CATCH (...) {
@@ -79,6 +85,11 @@ namespace Assets
 		_pimpl->_pollingProcesses.push_back(pollingProcess);
     }
 
+    unsigned CompileAndAsyncManager::GetCompletedProcessCount() const
+    {
+        return (unsigned)Interlocked::Load(&_pimpl->_completedProcessCount);
+    }
+
     IntermediateAssets::Store& CompileAndAsyncManager::GetIntermediateStore() 
     { 
 		return *_pimpl->_intStore.get();
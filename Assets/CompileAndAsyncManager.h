@@ -45,6 +45,11 @@ namespace Assets
         void Add(const std::shared_ptr<IPollingAsyncProcess>& pollingProcess);
         void Add(std::unique_ptr<IThreadPump>&& threadPump);
 
+            /// <summary>Returns the number of polling processes that have finished so far</summary>
+            /// Compare the result against a previous value to find out if any pending
+            /// work has completed (eg, while waiting for pending assets)
+        unsigned GetCompletedProcessCount() const;
+
         IntermediateAssets::Store&			GetIntermediateStore();
         IntermediateAssets::CompilerSet&	GetIntermediateCompilers();
 		IntermediateAssets::Store&			GetShadowingStore();
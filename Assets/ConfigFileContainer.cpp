@@ -6,7 +6,11 @@
 
 #include "ConfigFileContainer.h"
 #include "AssetServices.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/IteratorUtils.h"
+#include "../Utility/MemoryUtils.h"
 #include <regex>
+#include <algorithm>
 
 namespace Assets
 {
@@ -124,6 +128,204 @@ namespace Assets
             if (Services::GetInvalidAssetMan())
                 Services::GetInvalidAssetMan()->MarkValid(initializer);
         }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        static uint64 HashLowerCase(StringSection<ResChar> str)
+        {
+                //  Case insensitive hash (also treating both types of slashes as the same).
+                //  We convert to lower case in blocks, chaining the hash from one block
+                //  to the next
+            ResChar buffer[256];
+            uint64 result = DefaultSeed64;
+            auto* i = str.begin();
+            while (i != str.end()) {
+                unsigned c = 0;
+                for (; c<dimof(buffer) && i!=str.end(); ++c, ++i)
+                    buffer[c] = (*i == '\\') ? '/' : XlToLower(*i);
+                result = Hash64(buffer, &buffer[c], result);
+            }
+            return result;
+        }
+
+        auto ConfigFileSections::FindSection(StringSection<ResChar> name) const -> const Section*
+        {
+            auto hash = HashLowerCase(name);
+            auto i = std::lower_bound(
+                _sections.cbegin(), _sections.cend(), hash,
+                [](const Section& lhs, uint64 rhs) { return lhs._nameHash < rhs; });
+
+                //  Sections with the same hash are in the order they appear in the
+                //  file, so we will return the first matching section (as when
+                //  reading through the file linearly)
+            for (; i!=_sections.cend() && i->_nameHash == hash; ++i) {
+                StringSection<ResChar> sectionName(
+                    (const ResChar*)PtrAdd(_data.get(), i->_nameBegin),
+                    (const ResChar*)PtrAdd(_data.get(), i->_nameEnd));
+                if (XlEqStringI(sectionName, name))
+                    return AsPointer(i);
+            }
+
+                //  If we couldn't index the whole file, the section we're looking for
+                //  may be after the error
+            if (!_indexError.empty())
+                Throw(::Exceptions::BasicLabel("%s", _indexError.c_str()));
+            return nullptr;
+        }
+
+        ConfigFileSections::ConfigFileSections(const ResChar filename[], const std::shared_ptr<DependencyValidation>& validation)
+        : _validation(validation)
+        {
+            _dataSize = 0;
+            _data = LoadFileAsMemoryBlock(filename, &_dataSize);
+            _tabWidth = 4;
+
+                //  Build the index in a single pass through the file. We record the range
+                //  of each top level element (from the start of the line it begins on, up 
+                //  to the start of the next top level item).
+                //  Note that we always use a utf8 formatter here; the byte ranges will be the
+                //  same for any other single byte formatter.
+            using Formatter = InputStreamFormatter<utf8>;
+            using Blob = Formatter::Blob;
+            Formatter formatter(MemoryMappedInputStream(_data.get(), PtrAdd(_data.get(), _dataSize)));
+            auto offset = [this](const void* ptr) { return size_t(ptr) - size_t(_data.get()); };
+
+            TRY
+            {
+                for (;;) {
+                    auto next = formatter.PeekNext();
+                    if (next == Blob::BeginElement) {
+                        Section section;
+                        section._begin = offset(formatter.GetLineStart());
+                        section._lineIndex = formatter.GetLocation()._lineIndex - 1;
+
+                        Formatter::InteriorSection eleName;
+                        if (!formatter.TryBeginElement(eleName))
+                            Throw(Utility::FormatException("Poorly formed begin element in config file", formatter.GetLocation()));
+
+                        section._nameBegin = offset(eleName.begin());
+                        section._nameEnd = offset(eleName.end());
+                        section._nameHash = HashLowerCase(StringSection<ResChar>((const ResChar*)eleName.begin(), (const ResChar*)eleName.end()));
+
+                        formatter.SkipElement();
+                        if (!formatter.TryEndElement())
+                            Throw(Utility::FormatException("Expecting end element in config file", formatter.GetLocation()));
+
+                        auto* readPtr = formatter.GetReadPointer();
+                        section._end = (readPtr >= PtrAdd(_data.get(), _dataSize)) ? _dataSize : offset(formatter.GetLineStart());
+                        _sections.push_back(section);
+                    } else if (next == Blob::AttributeName) {
+                        Formatter::InteriorSection name, value;
+                        formatter.TryAttribute(name, value);
+                    } else
+                        break;
+                }
+            } CATCH (const std::exception& e) {
+                _indexError = e.what();
+            } CATCH_END
+
+            _tabWidth = formatter.GetTabWidth();
+            std::stable_sort(
+                _sections.begin(), _sections.end(),
+                [](const Section& lhs, const Section& rhs) { return lhs._nameHash < rhs._nameHash; });
+        }
+
+        ConfigFileSections::~ConfigFileSections() {}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        class ConfigFileCache
+        {
+        public:
+            class Entry
+            {
+            public:
+                std::shared_ptr<ConfigFileSections>     _sections;
+                std::shared_ptr<DependencyValidation>   _validation;
+                unsigned                                _lastUsed;
+            };
+
+            Threading::Mutex _lock;
+            std::vector<std::pair<uint64, Entry>> _entries;
+            unsigned _useCounter;
+            size_t _cachedBytes;
+
+                //  Limit on the file data that we keep around. When we go over, we release
+                //  the data for the least recently used files (but keep the validation)
+            static const size_t MaxCachedBytes = 32 * 1024 * 1024;
+
+            void ReleaseOldData();
+
+            ConfigFileCache() : _useCounter(0), _cachedBytes(0) {}
+        };
+
+        void ConfigFileCache::ReleaseOldData()
+        {
+            while (_cachedBytes > MaxCachedBytes) {
+                auto oldest = _entries.end();
+                for (auto i=_entries.begin(); i!=_entries.end(); ++i)
+                    if (i->second._sections && (oldest == _entries.end() || i->second._lastUsed < oldest->second._lastUsed))
+                        oldest = i;
+                if (oldest == _entries.end()) break;
+
+                _cachedBytes -= oldest->second._sections->GetDataSize();
+                oldest->second._sections.reset();
+            }
+        }
+
+        static ConfigFileCache s_configFileCache;
+
+        std::shared_ptr<ConfigFileSections> GetConfigFileSections(const ResChar filename[])
+        {
+            auto& cache = s_configFileCache;
+            auto hash = HashLowerCase(MakeStringSection(filename));
+
+            std::shared_ptr<DependencyValidation> validation;
+            {
+                ScopedLock(cache._lock);
+                auto i = LowerBound(cache._entries, hash);
+                if (i != cache._entries.end() && i->first == hash && i->second._validation->GetValidationIndex() == 0) {
+                    i->second._lastUsed = cache._useCounter++;
+                    if (i->second._sections) return i->second._sections;
+                    validation = i->second._validation;
+                }
+            }
+
+                //  Load outside of the lock. If another thread loads the same file at
+                //  the same time, we'll just use whichever one finishes last
+            if (!validation) {
+                validation = std::make_shared<DependencyValidation>();
+                RegisterFileDependency(validation, filename);
+            }
+            auto sections = std::make_shared<ConfigFileSections>(filename, validation);
+
+            {
+                ScopedLock(cache._lock);
+                auto i = LowerBound(cache._entries, hash);
+                if (i == cache._entries.end() || i->first != hash) {
+                    ConfigFileCache::Entry newEntry;
+                    newEntry._validation = validation;
+                    i = cache._entries.insert(i, std::make_pair(hash, newEntry));
+                } else if (i->second._sections) {
+                    cache._cachedBytes -= i->second._sections->GetDataSize();
+                }
+
+                i->second._sections = sections;
+                i->second._validation = validation;
+                i->second._lastUsed = cache._useCounter++;
+                cache._cachedBytes += sections->GetDataSize();
+                cache.ReleaseOldData();
+            }
+
+            return std::move(sections);
+        }
+
+        void ConfigFileSections_Clear()
+        {
+            ScopedLock(s_configFileCache._lock);
+            s_configFileCache._entries.clear();
+            s_configFileCache._cachedBytes = 0;
+        }
     }
 }
 
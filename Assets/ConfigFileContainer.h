@@ -70,6 +70,60 @@ namespace Assets
     {
         void MarkInvalid(const ResChar initializer[], const char reason[]);
         void MarkValid(const ResChar initializer[]);
+
+        /// <summary>A config file, loaded once and indexed by its top level elements</summary>
+        /// Many assets are loaded from the same file, one section each (eg, materials in
+        /// a material library). These are shared between all of those assets, so the file is
+        /// only loaded and tokenised once. Each asset then only parses the range of the file
+        /// for its own section.
+        ///
+        /// The dependency validation is invalidated when the file changes; the next call
+        /// to GetConfigFileSections() will load it again. Only a limited amount of file data
+        /// is kept in the cache, but the dependency validation for each file is retained (so
+        /// assets that depend on it will still be invalidated after the data is released).
+        class ConfigFileSections
+        {
+        public:
+            class Section
+            {
+            public:
+                uint64      _nameHash;
+                size_t      _begin, _end;
+                size_t      _nameBegin, _nameEnd;
+                unsigned    _lineIndex;
+            };
+
+            const Section* FindSection(StringSection<ResChar> name) const;
+
+            template<typename Formatter>
+                Formatter OpenSection(const Section& section) const;
+
+            const std::shared_ptr<DependencyValidation>& GetDependencyValidation() const { return _validation; }
+            size_t GetSectionCount() const { return _sections.size(); }
+            size_t GetDataSize() const { return _dataSize; }
+
+            ConfigFileSections(const ResChar filename[], const std::shared_ptr<DependencyValidation>& validation);
+            ~ConfigFileSections();
+        protected:
+            std::unique_ptr<uint8[]>    _data;
+            size_t                      _dataSize;
+            std::vector<Section>        _sections;      // sorted by _nameHash (and then by position in the file)
+            unsigned                    _tabWidth;
+            std::string                 _indexError;
+            std::shared_ptr<DependencyValidation> _validation;
+        };
+
+        std::shared_ptr<ConfigFileSections> GetConfigFileSections(const ResChar filename[]);
+        void ConfigFileSections_Clear();
+
+        template<typename Formatter>
+            Formatter ConfigFileSections::OpenSection(const Section& section) const
+            {
+                static_assert(sizeof(typename Formatter::value_type) == 1, "Config file sections can only be read with single byte formatters");
+                return Formatter(
+                    MemoryMappedInputStream(PtrAdd(_data.get(), section._begin), PtrAdd(_data.get(), section._end)),
+                    _tabWidth, section._lineIndex);
+            }
     }
 
     template<typename Type, typename Formatter>
@@ -142,52 +196,29 @@ namespace Assets
         if (!splitName.ParametersWithDivider().Empty()) configName = splitName.Parameters();
         else configName = "default";
 
-        size_t fileSize = 0;
-        auto sourceFile = LoadFileAsMemoryBlock(filename, &fileSize);
+        std::shared_ptr<DependencyValidation> fileValidation;
 
         TRY
         {
             _searchRules = DefaultDirectorySearchRules(initializer);
 
-            Formatter formatter(
-                MemoryMappedInputStream(sourceFile.get(), PtrAdd(sourceFile.get(), fileSize)));
+                //  The file is shared by all of the containers that reference it, and
+                //  indexed by section name, so we only need to parse our own section
+            auto file = Internal::GetConfigFileSections(filename);
+            fileValidation = file->GetDependencyValidation();
+
+            auto* section = file->FindSection(configName);
+            if (section) {
+                auto formatter = file->OpenSection<Formatter>(*section);
+
+                Formatter::InteriorSection eleName;
+                if (!formatter.TryBeginElement(eleName))
+                    Throw(Utility::FormatException("Poorly formed begin element in config file", formatter.GetLocation()));
+
+                _asset = Type(formatter, _searchRules);
 
-            bool gotConfig = false;
-
-            // search through for the specific element we need (ignoring other elements)
-            while (!gotConfig) {
-                using Blob = Formatter::Blob;
-                switch (formatter.PeekNext()) {
-                case Blob::BeginElement:
-                    {
-                        Formatter::InteriorSection eleName;
-                        if (!formatter.TryBeginElement(eleName))
-                            Throw(Utility::FormatException("Poorly formed begin element in config file", formatter.GetLocation()));
-
-                        if (XlEqStringI(StringSection<ResChar>((const ResChar*)eleName.begin(), (const ResChar*)eleName.end()), configName)) {
-                            _asset = Type(formatter, _searchRules);
-                            gotConfig = true;
-                        } else {
-                            formatter.SkipElement();    // skip the whole element; it's not required
-                        }
-
-                        if (!formatter.TryEndElement())
-                            Throw(Utility::FormatException("Expecting end element in config file", formatter.GetLocation()));
-
-                        continue;
-                    }
-
-                case Blob::AttributeName:
-                    {
-                        Formatter::InteriorSection name, value;
-                        formatter.TryAttribute(name, value);
-                        continue;
-                    }
-
-                default:
-                    break;
-                }
-                break;
+                if (!formatter.TryEndElement())
+                    Throw(Utility::FormatException("Expecting end element in config file", formatter.GetLocation()));
             }
             
             //      Missing entry isn't an exception... just return the defaults
@@ -204,7 +235,7 @@ namespace Assets
         } CATCH_END
 
         _validationCallback = std::make_shared<DependencyValidation>();
-        RegisterFileDependency(_validationCallback, filename);
+        RegisterAssetDependency(_validationCallback, fileValidation);
     }
 
     template<typename Type, typename Formatter>
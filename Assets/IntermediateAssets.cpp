@@ -382,6 +382,12 @@ namespace Assets { namespace IntermediateAssets
         return nullptr;
     }
 
+    bool CompilerSet::HasCompiler(uint64 typeCode) const
+    {
+        auto i = LowerBound(_pimpl->_compilers, typeCode);
+        return i != _pimpl->_compilers.cend() && i->first == typeCode;
+    }
+
     void CompilerSet::StallOnPendingOperations(bool cancelAll)
     {
         for (auto i=_pimpl->_compilers.cbegin(); i!=_pimpl->_compilers.cend(); ++i)
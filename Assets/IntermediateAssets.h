@@ -131,6 +131,7 @@ namespace Assets { namespace IntermediateAssets
         std::shared_ptr<ICompileMarker> PrepareAsset(
             uint64 typeCode, const ResChar* initializers[], unsigned initializerCount,
             Store& store);
+        bool HasCompiler(uint64 typeCode) const;
         void StallOnPendingOperations(bool cancelAll);
 
         CompilerSet();
@@ -10,13 +10,13 @@
 #include "NascentCommandStream.h"
 #include "NascentRawGeometry.h"
 #include "NascentAnimController.h"
+#include "../RenderCore/Assets/VertexConversion.h"
 #include "../Assets/Assets.h"       // (for RegisterFileDependency)
 #include "../ConsoleRig/Log.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/StreamDOM.h"
 #include "../Utility/Streams/StreamFormatter.h"
 #include "../Utility/StringUtils.h"
-#include "../Foreign/half-1.9.2/include/half.hpp"
 
 
 namespace RenderCore { namespace ColladaConversion
@@ -123,51 +123,6 @@ namespace RenderCore { namespace ColladaConversion
         boundingBox.second[2]   = std::max(transformedPosition[2], boundingBox.second[2]);
     }
 
-    static float UNormAsFloat32(unsigned char unormValue)
-    {
-        return float(unormValue) / 255.f;
-    }
-
-    static float Float16AsFloat32(unsigned short input)
-    {
-        return half_float::detail::half2float(input);
-    }
-
-    static Float4 AsFloat4(const void* rawData, Metal::NativeFormat::Enum nativeFormat)
-    {   
-            //
-            //      todo -- this needs to move to the metal layer, so it can use
-            //              platform specific formats
-            //
-        using namespace Metal::NativeFormat;
-        switch (nativeFormat) {
-        case R32G32B32A32_FLOAT:    return *(const Float4*)rawData;
-        case R32G32B32_FLOAT:       return Float4(((const float*)rawData)[0], ((const float*)rawData)[1], ((const float*)rawData)[2], 0.f);
-        case R32G32_FLOAT:          return Float4(((const float*)rawData)[0], ((const float*)rawData)[1], 0.f, 1.f);
-        case R32_FLOAT:             return Float4(((const float*)rawData)[0], 0.f, 0.f, 1.f);
-
-        case R10G10B10A2_UNORM:
-        case R10G10B10A2_UINT:
-        case R11G11B10_FLOAT:       
-        case B5G6R5_UNORM:
-        case B5G5R5A1_UNORM:        assert(0); return Float4(0,0,0,1);  // requires some custom adjustments (these are uncommon uses, anyway)
-
-        case R16G16B16A16_FLOAT:    return Float4(Float16AsFloat32(((const unsigned short*)rawData)[0]), Float16AsFloat32(((const unsigned short*)rawData)[1]), Float16AsFloat32(((const unsigned short*)rawData)[2]), Float16AsFloat32(((const unsigned short*)rawData)[3]));
-        case R16G16_FLOAT:          return Float4(Float16AsFloat32(((const unsigned short*)rawData)[0]), Float16AsFloat32(((const unsigned short*)rawData)[1]), 0.f, 1.f);
-        case R16_FLOAT:             return Float4(Float16AsFloat32(((const unsigned short*)rawData)[0]), 0.f, 0.f, 1.f);
-
-        case B8G8R8A8_UNORM:
-        case R8G8B8A8_UNORM:        return Float4(UNormAsFloat32(((const unsigned char*)rawData)[0]), UNormAsFloat32(((const unsigned char*)rawData)[1]), UNormAsFloat32(((const unsigned char*)rawData)[2]), UNormAsFloat32(((const unsigned char*)rawData)[3]));
-        case R8G8_UNORM:            return Float4(UNormAsFloat32(((const unsigned char*)rawData)[0]), UNormAsFloat32(((const unsigned char*)rawData)[1]), 0.f, 1.f);
-        case R8_UNORM:              return Float4(UNormAsFloat32(((const unsigned char*)rawData)[0]), 0.f, 0.f, 1.f);
-        
-        case B8G8R8X8_UNORM:        return Float4(UNormAsFloat32(((const unsigned char*)rawData)[0]), UNormAsFloat32(((const unsigned char*)rawData)[1]), UNormAsFloat32(((const unsigned char*)rawData)[2]), 1.f);
-        }
-
-        assert(0);
-        return Float4(0,0,0,1);
-    }
-
     void AddToBoundingBox(  std::pair<Float3, Float3>& boundingBox,
                             const void* vertexData, size_t vertexStride, size_t vertexCount,
                             const Assets::VertexElement& elementDesc, 
@@ -179,11 +134,27 @@ namespace RenderCore { namespace ColladaConversion
             //      But since we don't know the previous elements, we can't be sure
             //
         assert(elementDesc._alignedByteOffset != ~unsigned(0x0));
-        for (size_t c=0; c<vertexCount; ++c) {
-            const void* v    = PtrAdd(vertexData, vertexStride*c + elementDesc._alignedByteOffset);
-            Float3 position  = Truncate(AsFloat4(v, Metal::NativeFormat::Enum(elementDesc._nativeFormat)));
-            assert(!isinf(position[0]) && !isinf(position[1]) && !isinf(position[2]));
-            AddToBoundingBox(boundingBox, position, localToWorld);
+        if (!vertexCount) return;
+
+            //  Expand the positions into Float4s in small blocks, so the format
+            //  conversion can be done in bulk
+        auto format = Assets::GeoProc::AsVertexElementFormat(Metal::NativeFormat::Enum(elementDesc._nativeFormat));
+        const void* positions = PtrAdd(vertexData, elementDesc._alignedByteOffset);
+        size_t positionsSize = vertexStride*vertexCount - elementDesc._alignedByteOffset;
+
+        const size_t blockSize = 256;
+        Float4 block[blockSize];
+        for (size_t start=0; start<vertexCount; start+=blockSize) {
+            auto count = std::min(blockSize, vertexCount-start);
+            Assets::GeoProc::ExpandVertexStream(
+                block, count, 
+                PtrAdd(positions, vertexStride*start), format, vertexStride, positionsSize - vertexStride*start);
+
+            for (size_t c=0; c<count; ++c) {
+                Float3 position = Truncate(block[c]);
+                assert(!isinf(position[0]) && !isinf(position[1]) && !isinf(position[2]));
+                AddToBoundingBox(boundingBox, position, localToWorld);
+            }
         }
     }
 
@@ -19,6 +19,7 @@
 #include "../Utility/Conversion.h"
 #include <assert.h>
 #include <random>
+#include <algorithm>
 
 namespace ConsoleRig
 {
@@ -90,8 +91,11 @@ namespace ConsoleRig
         _logConfigFile = "log.cfg";
         _setWorkingDir = true;
         _redirectCout = true;
-        _longTaskThreadPoolCount = 4;
-        _shortTaskThreadPoolCount = 2;
+        _longTaskThreadPoolCount = 0;
+        _shortTaskThreadPoolCount = 0;
+        _longTaskThreadPriority = ThreadPriority::Low;
+        _shortTaskThreadPriority = ThreadPriority::Normal;
+        _reserveMainThreadCore = true;
     }
 
     StartupConfig::StartupConfig(const char applicationName[]) : StartupConfig()
@@ -138,12 +142,47 @@ namespace ConsoleRig
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+    static void CalculateThreadPoolDescs(
+        CompletionThreadPool::Desc& shortTaskDesc, CompletionThreadPool::Desc& longTaskDesc,
+        const StartupConfig& cfg)
+    {
+        auto topology = XlGetCPUTopology();
+        auto physicalCores = unsigned(topology._physicalCores.size());
+
+            //  When reserving a core for the main thread, we remove the first physical
+            //  core (and its hyperthreads) from the affinity mask of the pool threads.
+            //  The main thread itself isn't pinned -- the scheduler will naturally
+            //  move it onto the free core.
+        uint64 affinityMask = 0;
+        unsigned reservedLogical = 0;
+        if (cfg._reserveMainThreadCore && physicalCores > 1) {
+            for (auto c:topology._physicalCores) affinityMask |= c;
+            affinityMask &= ~topology._physicalCores[0];
+            for (auto m=topology._physicalCores[0]; m; m &= m-1) ++reservedLogical;
+        }
+        auto availableCores = std::max(physicalCores - (affinityMask ? 1u : 0u), 1u);
+        auto availableLogical = std::max(topology._logicalProcessorCount - reservedLogical, 1u);
+
+            //  Long tasks (shader compiles, model conversions, etc) can use every
+            //  available hardware thread, because they run at a lower priority than 
+            //  the frame. Short tasks are mostly waiting on IO completion; we only
+            //  need a few of them.
+        longTaskDesc = CompletionThreadPool::Desc(
+            cfg._longTaskThreadPoolCount ? cfg._longTaskThreadPoolCount : availableLogical,
+            cfg._longTaskThreadPriority, affinityMask);
+        shortTaskDesc = CompletionThreadPool::Desc(
+            cfg._shortTaskThreadPoolCount ? cfg._shortTaskThreadPoolCount : std::max(2u, std::min(availableCores/2, 4u)),
+            cfg._shortTaskThreadPriority, affinityMask);
+    }
+
     GlobalServices* GlobalServices::s_instance = nullptr;
 
     GlobalServices::GlobalServices(const StartupConfig& cfg)
     {
-        _shortTaskPool = std::make_unique<CompletionThreadPool>(cfg._shortTaskThreadPoolCount);
-        _longTaskPool = std::make_unique<CompletionThreadPool>(cfg._longTaskThreadPoolCount);
+        CompletionThreadPool::Desc shortTaskDesc, longTaskDesc;
+        CalculateThreadPoolDescs(shortTaskDesc, longTaskDesc, cfg);
+        _shortTaskPool = std::make_unique<CompletionThreadPool>(shortTaskDesc);
+        _longTaskPool = std::make_unique<CompletionThreadPool>(longTaskDesc);
 
         MainRig_Startup(cfg, _crossModule._services);
         _crossModule.Publish(*this);
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "../Utility/FunctionUtils.h"
+#include "../Utility/SystemUtils.h"
 #include <string>
 #include <memory>
 
@@ -99,8 +100,16 @@ namespace ConsoleRig
         std::string _logConfigFile;
         bool _setWorkingDir;
         bool _redirectCout;
+
+            //  Thread pool configuration. A thread count of 0 means the pool will be
+            //  sized from the number of cores in the machine. When _reserveMainThreadCore
+            //  is set, the thread pools will not use the first physical core, leaving
+            //  it free for the main (rendering) thread.
         unsigned _longTaskThreadPoolCount;
         unsigned _shortTaskThreadPoolCount;
+        Utility::ThreadPriority::Enum _longTaskThreadPriority;
+        Utility::ThreadPriority::Enum _shortTaskThreadPriority;
+        bool _reserveMainThreadCore;
 
         StartupConfig();
         StartupConfig(const char applicationName[]);
@@ -0,0 +1,25 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "HalfFloat.h"
+#include "../Foreign/half-1.9.2/include/half.hpp"
+
+namespace XLEMath
+{
+    void ConvertHalfToFloat(float dst[], const uint16 src[], size_t count)
+    {
+        size_t c = 0;
+        #if defined(XLEMATH_HALF_FLOAT_USE_SSE2)
+            for (; (c+8)<=count; c+=8) {
+                __m128i h = _mm_loadu_si128((const __m128i*)&src[c]);
+                _mm_storeu_ps(&dst[c],   HalfToFloat4(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+                _mm_storeu_ps(&dst[c+4], HalfToFloat4(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+            }
+        #endif
+        for (; c<count; ++c)
+            dst[c] = half_float::detail::half2float(src[c]);
+    }
+}
@@ -0,0 +1,48 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Core/Types.h"
+#include <cstddef>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+    #define XLEMATH_HALF_FLOAT_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace XLEMath
+{
+    /// <summary>Converts 16 bit floats to 32 bit floats, using SIMD instructions when available</summary>
+    /// The result matches half_float::detail::half2float exactly (including denormals,
+    /// infinities and NaNs).
+    void ConvertHalfToFloat(float dst[], const uint16 src[], size_t count);
+
+    #if defined(XLEMATH_HALF_FLOAT_USE_SSE2)
+
+            //  Converts 4 half floats (in the low 16 bits of each 32 bit lane) to 4 floats.
+            //  We shift the exponent and mantissa into place, and then use a multiply to
+            //  rebias the exponent (which also takes care of denormals). Infinities and NaNs
+            //  need their exponent forced to the maximum.
+            //  See Fabian Giesen's "half_to_float_fast" variations for a description.
+        inline __m128 HalfToFloat4(__m128i h)
+        {
+            const __m128i maskNoSign    = _mm_set1_epi32(0x7fff);
+            const __m128  magic         = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+            const __m128i wasInfNan     = _mm_set1_epi32(0x7bff);
+            const __m128  expInfNan     = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+            __m128i expMant     = _mm_and_si128(maskNoSign, h);
+            __m128i justSign    = _mm_xor_si128(h, expMant);
+            __m128  scaled      = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)), magic);
+            __m128i isInfNan    = _mm_cmpgt_epi32(expMant, wasInfNan);
+            __m128  sign        = _mm_castsi128_ps(_mm_slli_epi32(justSign, 16));
+            __m128  infNanExp   = _mm_and_ps(_mm_castsi128_ps(isInfNan), expInfNan);
+            return _mm_or_ps(scaled, _mm_or_ps(sign, infNanExp));
+        }
+
+    #endif
+}
@@ -24,11 +24,29 @@ namespace PlatformRig
         unsigned index, const RenderCore::Techniques::ProjectionDesc& mainSceneProjectionDesc) const 
         -> ShadowProjectionDesc
     {
+        const auto& shadowProj = GetEnvSettings()._shadowProj[index];
+        if (shadowProj._shadowFrustumSettings._flags & DefaultShadowFrustumSettings::Flags::FitToSceneBounds) {
+            std::vector<ShadowCascadeSceneBounds::AABB> receivers, casters;
+            GetShadowCascadeBounds(receivers, casters);
+
+            ShadowCascadeSceneBounds sceneBounds;
+            sceneBounds._receivers = MakeIteratorRange(receivers);
+            sceneBounds._casters = MakeIteratorRange(casters);
+            return PlatformRig::CalculateDefaultShadowCascades(
+                shadowProj._light, shadowProj._lightId,
+                mainSceneProjectionDesc, shadowProj._shadowFrustumSettings,
+                sceneBounds);
+        }
+
         return PlatformRig::CalculateDefaultShadowCascades(
-            GetEnvSettings()._shadowProj[index]._light, 
-            GetEnvSettings()._shadowProj[index]._lightId,
-            mainSceneProjectionDesc,
-            GetEnvSettings()._shadowProj[index]._shadowFrustumSettings);
+            shadowProj._light, shadowProj._lightId,
+            mainSceneProjectionDesc, shadowProj._shadowFrustumSettings);
+    }
+
+    void BasicSceneParser::GetShadowCascadeBounds(
+        std::vector<ShadowCascadeSceneBounds::AABB>& receivers,
+        std::vector<ShadowCascadeSceneBounds::AABB>& casters) const
+    {
     }
 
     unsigned BasicSceneParser::GetLightCount() const 
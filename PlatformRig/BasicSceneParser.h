@@ -78,6 +78,12 @@ namespace PlatformRig
 
     protected:
         virtual const EnvironmentSettings&  GetEnvSettings() const = 0;
+
+            /// Override to provide world space bounds for shadow cascade fitting (used
+            /// by shadow projections with DefaultShadowFrustumSettings::Flags::FitToSceneBounds)
+        virtual void GetShadowCascadeBounds(
+            std::vector<ShadowCascadeSceneBounds::AABB>& receivers,
+            std::vector<ShadowCascadeSceneBounds::AABB>& casters) const;
     };
 
     SceneEngine::LightDesc          DefaultDominantLight();
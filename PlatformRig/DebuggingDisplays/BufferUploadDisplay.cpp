@@ -11,6 +11,7 @@
 #include "../../Utility/MemoryUtils.h"
 #include "../../Utility/PtrUtils.h"
 #include "../../Utility/StringFormat.h"
+#include "../../Utility/TypedFormat.h"
 #include "../../Utility/StringUtils.h"
 #include "../../Utility/IteratorUtils.h"
 #include "../../Utility/TimeUtils.h"
@@ -100,13 +101,13 @@ namespace PlatformRig { namespace Overlays
     static std::string BuildDescription(const BufferUploads::BufferDesc& desc)
     {
         using namespace BufferUploads;
-        char buffer[2048];
+        char buffer[256];
         if (desc._type == BufferDesc::Type::Texture) {
             const TextureDesc& tDesc = desc._textureDesc;
-            xl_snprintf(buffer, dimof(buffer), "(%4ix%4i) mips:(%i), array:(%i)", 
+            FormatInto(buffer, "(%4ix%4i) mips:(%i), array:(%i)", 
                 tDesc._width, tDesc._height, tDesc._mipCount, tDesc._arrayCount);
         } else if (desc._type == BufferDesc::Type::LinearBuffer) {
-            xl_snprintf(buffer, dimof(buffer), "%6.2fkb", 
+            FormatInto(buffer, "%6.2fkb", 
                 desc._linearBufferDesc._sizeInBytes/1024.f);
         } else {
             buffer[0] = '\0';
@@ -379,9 +380,10 @@ namespace PlatformRig { namespace Overlays
 
 			if (valuesCount > 0) {
 				float mostRecentValue = valuesBuffer[dimof(valuesBuffer) - valuesCount];
+                char valueText[32];
+                FormatInto(valueText, "%6.3f", mostRecentValue);
 				context->DrawText(AsPixelCoords(historyRect), nullptr, ColorB(0xffffffffu), 
-                    TextAlignment::Top,
-                    XlDynFormatString("%6.3f", mostRecentValue).c_str(), nullptr);
+                    TextAlignment::Top, valueText, nullptr);
 			}
 
             DrawHistoryGraph(
@@ -0,0 +1,226 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "FramePacing.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Core/SelectConfiguration.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+    #include "../Core/WinAPI/IncludeWindows.h"
+    #include <mmsystem.h>
+    #pragma comment(lib, "winmm.lib")     // for timeBeginPeriod (PlatformRig is a static library, so consumers pick this up at link time)
+#endif
+
+namespace PlatformRig
+{
+    uint64 FramePacer::WaitForFrameStart()
+    {
+        auto now = GetPerformanceCounter();
+        if (!_interval) {
+            _nextDeadline = 0;
+            return now;
+        }
+
+        if (!_nextDeadline || now > _nextDeadline + _interval) {
+                //  Either this is the first paced frame, or we've fallen more than
+                //  a whole frame behind. Restart the timeline from now.
+            if (_nextDeadline) ++_metrics._reanchors;
+            _nextDeadline = now;
+        } else {
+            SleepUntil(_nextDeadline);
+            now = GetPerformanceCounter();
+        }
+
+            //  Note that the next deadline is calculated from this frame's deadline,
+            //  not from the time we actually woke up. If we wake a little late, the
+            //  next wait is a little shorter.
+        _nextDeadline += _interval;
+        ++_metrics._pacedFrames;
+        return now;
+    }
+
+    bool FramePacer::WaitForPendingWork(uint64 deadline, const std::function<bool()>& poll)
+    {
+        for (;;) {
+            if (poll && poll()) return true;
+            if (GetPerformanceCounter() >= deadline) return false;
+            SleepSlice(1);
+        }
+    }
+
+    void FramePacer::SleepUntil(uint64 deadline)
+    {
+        auto now = GetPerformanceCounter();
+        while (now < deadline) {
+            auto remaining = deadline - now;
+            if (remaining > (_ticksPerMillisecond + _sleepOvershoot + _spinMargin)) {
+                    //  Sleep for as long as we can, while still expecting to wake
+                    //  before the deadline
+                auto sleepTicks = remaining - _sleepOvershoot - _spinMargin;
+                SleepSlice(unsigned(sleepTicks / _ticksPerMillisecond));
+                now = GetPerformanceCounter();
+                if (now > deadline) ++_metrics._oversleeps;
+            } else {
+                    //  Too close to the deadline to trust the scheduler. Spin, but
+                    //  give up our time slice to any other thread that is ready to run.
+                auto spinStart = now;
+                while (now < deadline) {
+                    Threading::YieldTimeSlice();
+                    now = GetPerformanceCounter();
+                }
+                _metrics._spinTime += now - spinStart;
+            }
+        }
+    }
+
+    void FramePacer::SleepSlice(unsigned milliseconds)
+    {
+        auto start = GetPerformanceCounter();
+        Threading::Sleep(milliseconds);
+        auto actual = GetPerformanceCounter() - start;
+        _metrics._sleepTime += actual;
+
+            //  Track how much longer than requested our sleeps take, as a rolling mean
+            //  and mean deviation. We aim to wake a couple of deviations before the
+            //  deadline, so we're biased towards waking early (and spinning a little)
+            //  rather than waking late. Rare very long sleeps (eg, when another
+            //  process takes the core) don't have much effect.
+        auto requested = milliseconds * _ticksPerMillisecond;
+        auto overshoot = double((actual > requested) ? (actual - requested) : 0);
+        _overshootMean += (overshoot - _overshootMean) / 8.0;
+        _overshootDeviation += (std::abs(overshoot - _overshootMean) - _overshootDeviation) / 8.0;
+        _sleepOvershoot = uint64(_overshootMean + 2.0 * _overshootDeviation);
+    }
+
+    void FramePacer::SetTargetInterval(uint64 interval)
+    {
+        _interval = interval;
+        _nextDeadline = 0;
+
+        #if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+                //  By default, the Windows scheduler only wakes sleeping threads every
+                //  15.6ms, which is far too coarse for pacing frames. Raise the timer
+                //  resolution while we're pacing.
+            if (_interval && !_raisedTimerResolution) {
+                _raisedTimerResolution = timeBeginPeriod(1) == TIMERR_NOERROR;
+            } else if (!_interval && _raisedTimerResolution) {
+                timeEndPeriod(1);
+                _raisedTimerResolution = false;
+            }
+        #endif
+    }
+
+    auto FramePacer::GetMetrics() const -> Metrics
+    {
+        auto result = _metrics;
+        result._sleepOvershootEstimate = _sleepOvershoot;
+        return result;
+    }
+
+    FramePacer::FramePacer()
+    {
+        auto frequency = GetPerformanceCounterFrequency();
+        _interval = 0;
+        _nextDeadline = 0;
+        _ticksPerMillisecond = std::max(frequency / 1000, uint64(1));
+        _overshootMean = double(frequency / 1000);      // start with a pessimistic estimate, and refine as we go
+        _overshootDeviation = double(frequency / 2000);
+        _sleepOvershoot = uint64(_overshootMean + 2.0 * _overshootDeviation);
+        _spinMargin = frequency / 4000;         // 0.25ms
+        _raisedTimerResolution = false;
+        XlZeroMemory(_metrics);
+    }
+
+    FramePacer::~FramePacer() 
+    {
+        #if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+            if (_raisedTimerResolution) timeEndPeriod(1);
+        #endif
+    }
+
+///////////////////////////////////////////////////////////////////////////////
+
+    void FrameTimeHistogram::PushFrameDuration(uint64 duration)
+    {
+        if (_entryCount >= 8 && duration > HitchFactor * _runningMedian)
+            ++_totalHitches;
+
+        _durationHistory[_next] = duration;
+        _next = (_next+1)%WindowSize;
+        _entryCount = std::min(_entryCount+1, unsigned(WindowSize));
+
+            //  Recalculating the median is cheap for this window size, but there's
+            //  no need to do it every frame
+        if (_entryCount <= 8 || (_next % 32) == 0) {
+            uint64 sorted[WindowSize];
+            CalculateSorted(sorted);
+            _runningMedian = sorted[_entryCount/2];
+        }
+    }
+
+    std::tuple<float, float, float> FrameTimeHistogram::GetPerformanceStats() const
+    {
+        if (!_entryCount)
+            return std::make_tuple(0.f, 0.f, 0.f);
+
+        uint64 accumulation = 0;
+        uint64 minTime = std::numeric_limits<uint64>::max(), maxTime = 0;
+        for (unsigned c=0; c<_entryCount; ++c) {
+            accumulation += _durationHistory[c];
+            minTime = std::min(minTime, _durationHistory[c]);
+            maxTime = std::max(maxTime, _durationHistory[c]);
+        }
+
+        double toMilliseconds = 1000.0 / double(_frequency);
+        return std::make_tuple(
+            float(double(accumulation) * toMilliseconds / double(_entryCount)),
+            float(double(minTime) * toMilliseconds),
+            float(double(maxTime) * toMilliseconds));
+    }
+
+    auto FrameTimeHistogram::GetPercentiles() const -> Percentiles
+    {
+        Percentiles result;
+        XlZeroMemory(result);
+        if (!_entryCount) return result;
+
+        uint64 sorted[WindowSize];
+        CalculateSorted(sorted);
+
+        double toMilliseconds = 1000.0 / double(_frequency);
+        auto percentile = [&](unsigned p) { return float(double(sorted[std::min((_entryCount * p) / 100, _entryCount-1)]) * toMilliseconds); };
+        result._p50 = percentile(50);
+        result._p95 = percentile(95);
+        result._p99 = percentile(99);
+
+        auto hitchThreshold = HitchFactor * sorted[_entryCount/2];
+        result._hitches = unsigned(sorted + _entryCount - std::upper_bound(sorted, sorted + _entryCount, hitchThreshold));
+        return result;
+    }
+
+    void FrameTimeHistogram::CalculateSorted(uint64 dst[]) const
+    {
+            //  When the window isn't full yet, the valid entries are at the start of the buffer
+        std::copy(_durationHistory, &_durationHistory[_entryCount], dst);
+        std::sort(dst, &dst[_entryCount]);
+    }
+
+    FrameTimeHistogram::FrameTimeHistogram()
+    {
+        _frequency = GetPerformanceCounterFrequency();
+        _next = _entryCount = 0;
+        _totalHitches = 0;
+        _runningMedian = 0;
+    }
+
+    FrameTimeHistogram::~FrameTimeHistogram() {}
+}
+
@@ -0,0 +1,116 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Core/Types.h"
+#include <functional>
+#include <tuple>
+
+namespace PlatformRig
+{
+    /// <summary>Limits the frame rate without burning a CPU core</summary>
+    /// Frame deadlines are scheduled on an absolute timeline. The deadline for the next
+    /// frame is the previous deadline plus the frame interval (not the time the previous
+    /// frame actually started plus the interval). So small errors in each wait don't
+    /// accumulate into a drift in the frame rate.
+    ///
+    /// While waiting, we sleep in short slices until we get close to the deadline, and
+    /// then spin for the remainder. The OS scheduler is not precise enough to wake us
+    /// exactly on time, so the pacer measures how late sleeps really wake up and only
+    /// spins for the final part of the wait that a sleep can't hit reliably.
+    ///
+    /// If we fall behind by more than a whole frame interval, the timeline is re-anchored
+    /// to the current time, rather than running a burst of unpaced frames to catch up.
+    class FramePacer
+    {
+    public:
+            /// <summary>Waits until the next frame should start</summary>
+            /// Returns the performance counter time at which the frame started.
+            /// If there is no target interval, returns immediately.
+        uint64  WaitForFrameStart();
+
+            /// <summary>Waits for some pending background work to make progress</summary>
+            /// Sleeps until either the "poll" function returns true, or the given
+            /// deadline (in performance counter time) is reached. Returns true if
+            /// "poll" reported progress.
+        bool    WaitForPendingWork(uint64 deadline, const std::function<bool()>& poll);
+
+            /// <summary>Sets the target duration of a frame (in performance counter ticks)</summary>
+            /// Use 0 to disable frame pacing.
+        void    SetTargetInterval(uint64 interval);
+        uint64  GetTargetInterval() const { return _interval; }
+
+        class Metrics
+        {
+        public:
+            uint64      _sleepTime;             ///< total time spent sleeping (in performance counter ticks)
+            uint64      _spinTime;              ///< total time spent spinning (in performance counter ticks)
+            unsigned    _pacedFrames;
+            unsigned    _oversleeps;            ///< number of sleeps that woke after the deadline
+            unsigned    _reanchors;             ///< number of times we fell behind and restarted the timeline
+            uint64      _sleepOvershootEstimate;    ///< current estimate for how late the OS wakes us from a sleep
+        };
+        Metrics GetMetrics() const;
+
+        FramePacer();
+        ~FramePacer();
+
+    private:
+        uint64      _interval;
+        uint64      _nextDeadline;
+        uint64      _ticksPerMillisecond;
+        uint64      _sleepOvershoot;
+        double      _overshootMean, _overshootDeviation;
+        bool        _raisedTimerResolution;
+        uint64      _spinMargin;
+        Metrics     _metrics;
+
+        void        SleepUntil(uint64 deadline);
+        void        SleepSlice(unsigned milliseconds);
+    };
+
+    /// <summary>Rolling record of recent frame times</summary>
+    /// Keeps a window of recent frame durations, from which we can calculate
+    /// average, min/max and percentiles. Frames much longer than the median of the
+    /// window are counted as "hitches".
+    class FrameTimeHistogram
+    {
+    public:
+        void    PushFrameDuration(uint64 duration);
+
+            /// <summary>Returns (average, min, max) frame durations in milliseconds</summary>
+        std::tuple<float, float, float> GetPerformanceStats() const;
+
+        class Percentiles
+        {
+        public:
+            float       _p50, _p95, _p99;       ///< in milliseconds
+            unsigned    _hitches;               ///< number of hitches in the current window
+        };
+        Percentiles GetPercentiles() const;
+
+            /// <summary>Total number of hitches recorded since construction</summary>
+        unsigned GetTotalHitches() const { return _totalHitches; }
+        unsigned GetFrameCount() const { return _entryCount; }
+
+        static const unsigned WindowSize = 256;
+        static const unsigned HitchFactor = 2;      ///< frames longer than this multiple of the median are hitches
+
+        FrameTimeHistogram();
+        ~FrameTimeHistogram();
+
+    private:
+        uint64      _frequency;
+        uint64      _durationHistory[WindowSize];
+        unsigned    _next, _entryCount;
+        unsigned    _totalHitches;
+        uint64      _runningMedian;
+
+        void        CalculateSorted(uint64 dst[]) const;
+    };
+}
+
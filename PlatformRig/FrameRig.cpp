@@ -5,6 +5,7 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "FrameRig.h"
+#include "FramePacing.h"
 #include "AllocationProfiler.h"
 #include "OverlaySystem.h"
 #include "MainInputHandler.h"
@@ -39,21 +40,6 @@ namespace PlatformRig
     using namespace RenderOverlays;
     using namespace RenderOverlays::DebuggingDisplay;
 
-    class FrameRateRecorder
-    {
-    public:
-        void PushFrameDuration(uint64 duration);
-        std::tuple<float, float, float> GetPerformanceStats() const;
-
-        FrameRateRecorder();
-        ~FrameRateRecorder();
-
-    private:
-        uint64      _frequency;
-        uint64      _durationHistory[64];
-        unsigned    _bufferStart, _bufferEnd;
-    };
-
     class FrameRigDisplay : public RenderOverlays::DebuggingDisplay::IWidget
     {
     public:
@@ -62,11 +48,11 @@ namespace PlatformRig
 
         FrameRigDisplay(
             std::shared_ptr<DebugScreensSystem> debugSystem,
-            const AccumulatedAllocations::Snapshot& prevFrameAllocationCount, const FrameRateRecorder& frameRate);
+            const AccumulatedAllocations::Snapshot& prevFrameAllocationCount, const FrameTimeHistogram& frameRate);
         ~FrameRigDisplay();
     protected:
         const AccumulatedAllocations::Snapshot* _prevFrameAllocationCount;
-        const FrameRateRecorder* _frameRate;
+        const FrameTimeHistogram* _frameRate;
         unsigned _subMenuOpen;
 
         std::weak_ptr<DebugScreensSystem> _debugSystem;
@@ -76,11 +62,11 @@ namespace PlatformRig
     {
     public:
         AccumulatedAllocations::Snapshot _prevFrameAllocationCount;
-        FrameRateRecorder _frameRate;
+        FrameTimeHistogram _frameRate;
+        FramePacer  _framePacer;
         uint64      _prevFrameStartTime;
         float       _timerToSeconds;
         unsigned    _frameRenderCount;
-        uint64      _frameLimiter;
         uint64      _timerFrequency;
         bool        _updateAsyncMan;
 
@@ -92,7 +78,6 @@ namespace PlatformRig
         : _prevFrameStartTime(0) 
         , _timerFrequency(GetPerformanceCounterFrequency())
         , _frameRenderCount(0)
-        , _frameLimiter(0)
         , _updateAsyncMan(false)
         {
             _timerToSeconds = 1.0f / float(_timerFrequency);
@@ -172,18 +157,19 @@ namespace PlatformRig
 
         assert(presChain);
 
-        uint64 startTime = GetPerformanceCounter();
-        if (_pimpl->_frameLimiter) {
+        uint64 startTime;
+        {
             CPUProfileEvent_Conditional pEvnt("FrameLimiter", cpuProfiler);
-            while (startTime < _pimpl->_prevFrameStartTime + _pimpl->_frameLimiter) {
-                Threading::YieldTimeSlice();
-                startTime = GetPerformanceCounter();
-            }
+            startTime = _pimpl->_framePacer.WaitForFrameStart();
         }
 
         float frameElapsedTime = 1.f/60.f;
         if (_pimpl->_prevFrameStartTime!=0) {
-            frameElapsedTime = (startTime - _pimpl->_prevFrameStartTime) * _pimpl->_timerToSeconds;
+                //  Record the full start-to-start frame time (including any time spent
+                //  waiting), because that's what determines the visible frame rate
+            auto frameDuration = startTime - _pimpl->_prevFrameStartTime;
+            frameElapsedTime = frameDuration * _pimpl->_timerToSeconds;
+            _pimpl->_frameRate.PushFrameDuration(frameDuration);
         }
         _pimpl->_prevFrameStartTime = startTime;
 
@@ -196,6 +182,9 @@ namespace PlatformRig
         if (_pimpl->_updateAsyncMan)
             Assets::Services::GetAsyncMan().Update();
 
+            // commit glyphs rendered in the background to the font textures
+        RenderOverlays::UpdateFontSystem();
+
         auto device = context.GetDevice();
         assert(device);
         device->BeginFrame(presChain);
@@ -221,7 +210,8 @@ namespace PlatformRig
         {
             if (Tweakable("FrameRigStats", false) && (_pimpl->_frameRenderCount % 64) == (64-1)) {
                 auto f = _pimpl->_frameRate.GetPerformanceStats();
-                LogInfo << "Ave FPS: " << 1000.f / std::get<0>(f);
+                auto p = _pimpl->_frameRate.GetPercentiles();
+                LogInfo << "Ave FPS: " << 1000.f / std::get<0>(f) << " (50th/95th/99th percentile frame times: " << p._p50 << "/" << p._p95 << "/" << p._p99 << "ms, " << p._hitches << " hitches)";
                     // todo -- we should get a rolling average of these values
                 if (_pimpl->_prevFrameAllocationCount._allocationCount) {
                     LogInfo << "(" << _pimpl->_prevFrameAllocationCount._freeCount << ") frees and (" << _pimpl->_prevFrameAllocationCount._allocationCount << ") allocs during frame. Ave alloc: (" << _pimpl->_prevFrameAllocationCount._allocationsSize / _pimpl->_prevFrameAllocationCount._allocationCount << ").";
@@ -244,8 +234,6 @@ namespace PlatformRig
             RenderCore::Metal::GPUProfiler::Frame_End(*metalContext, gpuProfiler);
         }
 
-        uint64 duration = GetPerformanceCounter() - startTime;
-        _pimpl->_frameRate.PushFrameDuration(duration);
         ++_pimpl->_frameRenderCount;
         auto accAlloc = AccumulatedAllocations::GetInstance();
         if (accAlloc) {
@@ -253,7 +241,20 @@ namespace PlatformRig
         }
 
         if (renderRes._hasPendingResources) {
-            Sleep(16);  // slow down while we're building pending resources
+                //  Slow down while we're building pending resources. Rather than sleeping
+                //  for a fixed time, wait until some pending work completes (or until
+                //  a 60Hz frame would have finished).
+            CPUProfileEvent_Conditional pEvnt("WaitForPendingResources", cpuProfiler);
+            auto& asyncMan = Assets::Services::GetAsyncMan();
+            auto initialCompletions = asyncMan.GetCompletedProcessCount();
+            bool updateAsyncMan = _pimpl->_updateAsyncMan;
+            _pimpl->_framePacer.WaitForPendingWork(
+                startTime + _pimpl->_timerFrequency / 60,
+                [&asyncMan, initialCompletions, updateAsyncMan]() -> bool
+                {
+                    if (updateAsyncMan) asyncMan.Update();
+                    return asyncMan.GetCompletedProcessCount() != initialCompletions;
+                });
         } else {
             Threading::YieldTimeSlice();    // this might be too extreme. We risk not getting execution back for a long while
         }
@@ -266,8 +267,8 @@ namespace PlatformRig
 
     void FrameRig::SetFrameLimiter(unsigned maxFPS)
     {
-        if (maxFPS) { _pimpl->_frameLimiter = _pimpl->_timerFrequency / uint64(maxFPS); }
-        else { _pimpl->_frameLimiter = 0; }
+        if (maxFPS) { _pimpl->_framePacer.SetTargetInterval(_pimpl->_timerFrequency / uint64(maxFPS)); }
+        else { _pimpl->_framePacer.SetTargetInterval(0); }
     }
 
     void FrameRig::AddPostPresentCallback(const PostPresentCallback& postPresentCallback)
@@ -337,44 +338,6 @@ namespace PlatformRig
         }
     }
 
-///////////////////////////////////////////////////////////////////////////////
-
-    void FrameRateRecorder::PushFrameDuration(uint64 duration)
-    {
-            // (note, in this scheme, one entry is always empty -- so actual capacity is really dimof(_durationHistory)-1)
-        _durationHistory[_bufferEnd] = duration;
-        _bufferEnd      = (_bufferEnd+1)%dimof(_durationHistory);
-        if (_bufferEnd == _bufferStart) {
-            _bufferStart = (_bufferStart+1)%dimof(_durationHistory);
-        }
-    }
-
-    std::tuple<float, float, float> FrameRateRecorder::GetPerformanceStats() const
-    {
-        unsigned    entryCount = 0;
-        uint64      accumulation = 0;
-        uint64      minTime = std::numeric_limits<uint64>::max(), maxTime = 0;
-        for (unsigned c=_bufferStart; c!=_bufferEnd; c=(c+1)%dimof(_durationHistory)) {
-            accumulation += _durationHistory[c];
-            minTime = std::min(minTime, _durationHistory[c]);
-            maxTime = std::max(maxTime, _durationHistory[c]);
-            ++entryCount;
-        }
-
-        double averageDuration = double(accumulation) / double(_frequency/1000) / double(entryCount);
-        double minDuration = minTime / double(_frequency/1000);
-        double maxDuration = maxTime / double(_frequency/1000);
-        return std::make_tuple(float(averageDuration), float(minDuration), float(maxDuration));
-    }
-
-    FrameRateRecorder::FrameRateRecorder()
-    {
-        _bufferStart = _bufferEnd = 0;
-        _frequency = GetPerformanceCounterFrequency();
-    }
-
-    FrameRateRecorder::~FrameRateRecorder() {}
-
 ///////////////////////////////////////////////////////////////////////////////
 
     static const InteractableId Id_FrameRigDisplayMain = InteractableId_Make("FrameRig");
@@ -405,7 +368,7 @@ namespace PlatformRig
         const auto bigLineHeight = Coord(res._frameRateFont->LineHeight());
         const auto smallLineHeight = Coord(res._smallFrameRateFont->LineHeight());
         const auto tabHeadingLineHeight = Coord(res._tabHeadingFont->LineHeight());
-        const Coord rectHeight = bigLineHeight + 3 * margin + smallLineHeight;
+        const Coord rectHeight = bigLineHeight + 5 * margin + 3 * smallLineHeight;
         Rect displayRect(
             Coord2(outerRect._bottomRight[0] - rectWidth - padding, outerRect._topLeft[1] + padding),
             Coord2(outerRect._bottomRight[0] - padding, outerRect._topLeft[1] + padding + rectHeight));
@@ -445,13 +408,33 @@ namespace PlatformRig
             &smallStyle, ColorB(0xffffffff), TextAlignment::Center,
             "%.2fM (%i)", heapMetrics._usage / (1024.f*1024.f), frameAllocations);
 
+        auto percentiles = _frameRate->GetPercentiles();
+        DrawFormatText(
+            context, innerLayout.AllocateFullWidth(smallLineHeight), 0.f,
+            &smallStyle, ColorB(0xffffffff), TextAlignment::Center,
+            "%.1f/%.1f/%.1fms (%i)", percentiles._p50, percentiles._p95, percentiles._p99, percentiles._hitches);
+
+        auto ds = _debugSystem.lock();
+        if (ds) {
+                //  Cost of the previous overlay render: CPU time, draw calls and the
+                //  fraction of text that reused a cached layout
+            const auto& overlayMetrics = ds->GetLastRenderMetrics();
+            auto layoutLookups = overlayMetrics._layoutCacheHits + overlayMetrics._layoutCacheMisses;
+            DrawFormatText(
+                context, innerLayout.AllocateFullWidth(smallLineHeight), 0.f,
+                &smallStyle, ColorB(0xffffffff), TextAlignment::Center,
+                "ui %.2fms (%i, %.0f%%)",
+                float(overlayMetrics._cpuTime) * 1000.f / float(GetPerformanceCounterFrequency()),
+                overlayMetrics._drawCalls,
+                layoutLookups ? (100.f * overlayMetrics._layoutCacheHits / float(layoutLookups)) : 100.f);
+        }
+
         interactables.Register(Interactables::Widget(displayRect, Id_FrameRigDisplayMain));
 
         TextStyle tabHeader(*res._tabHeadingFont);
         // tabHeader._options.shadow = 0;
         // tabHeader._options.outline = 1;
 
-        auto ds = _debugSystem.lock();
         if (ds) {
             const char* categories[] = {
                 "Console", "Terrain", "Browser", "Placements", "Profiler", "Settings", "Test"
@@ -575,7 +558,7 @@ namespace PlatformRig
 
     FrameRigDisplay::FrameRigDisplay(
         std::shared_ptr<DebugScreensSystem> debugSystem,
-        const AccumulatedAllocations::Snapshot& prevFrameAllocationCount, const FrameRateRecorder& frameRate)
+        const AccumulatedAllocations::Snapshot& prevFrameAllocationCount, const FrameTimeHistogram& frameRate)
     {
         _frameRate = &frameRate;
         _prevFrameAllocationCount = &prevFrameAllocationCount;
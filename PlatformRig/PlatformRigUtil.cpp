@@ -15,6 +15,7 @@
 #include "../Utility/BitUtils.h"
 #include "../Math/Transformations.h"
 #include "../Math/ProjectionMath.h"
+#include "../Utility/MemoryUtils.h"
 
 namespace PlatformRig
 {
@@ -415,6 +416,414 @@ namespace PlatformRig
         return std::make_pair(result, worldToClip);
     }
 
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static const unsigned CoverageGridDims = 32;
+
+    using AABB = ShadowCascadeSceneBounds::AABB;
+
+        //  Transform a world space box into the shadow definition space, with the same
+        //  z flip as above (ie, +z is away from the light)
+    static AABB AsLightSpaceBox(const Float4x4& worldToLight, const AABB& box)
+    {
+        AABB result(Float3(FLT_MAX, FLT_MAX, FLT_MAX), Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+        for (unsigned c=0; c<8; ++c) {
+            Float3 corner(
+                (c&1) ? box.second[0] : box.first[0],
+                (c&2) ? box.second[1] : box.first[1],
+                (c&4) ? box.second[2] : box.first[2]);
+            auto p = TransformPoint(worldToLight, corner);
+            p[2] = -p[2];
+            for (unsigned q=0; q<3; ++q) {
+                result.first[q] = std::min(result.first[q], p[q]);
+                result.second[q] = std::max(result.second[q], p[q]);
+            }
+        }
+        return result;
+    }
+
+    static bool OverlapsXY(const Float3& aMins, const Float3& aMaxs, const Float3& bMins, const Float3& bMaxs)
+    {
+        return aMins[0] <= bMaxs[0] && aMaxs[0] >= bMins[0]
+            && aMins[1] <= bMaxs[1] && aMaxs[1] >= bMins[1];
+    }
+
+        //  Fraction of the given rectangle covered by the footprints, measured on a coarse grid
+    static float CalculateCoverage(
+        const Float2& mins, const Float2& maxs,
+        IteratorRange<const std::pair<Float2, Float2>*> footprints)
+    {
+        const float cellWidth = (maxs[0] - mins[0]) / float(CoverageGridDims);
+        const float cellHeight = (maxs[1] - mins[1]) / float(CoverageGridDims);
+        if (cellWidth <= 0.f || cellHeight <= 0.f) return 0.f;
+
+        bool grid[CoverageGridDims*CoverageGridDims];
+        XlZeroMemory(grid);
+        for (const auto& f:footprints) {
+            if (f.first[0] > maxs[0] || f.second[0] < mins[0] || f.first[1] > maxs[1] || f.second[1] < mins[1]) continue;
+            int x0 = Clamp(int(std::floor((f.first[0] - mins[0]) / cellWidth)), 0, int(CoverageGridDims-1));
+            int x1 = Clamp(int(std::ceil((f.second[0] - mins[0]) / cellWidth)) - 1, x0, int(CoverageGridDims-1));
+            int y0 = Clamp(int(std::floor((f.first[1] - mins[1]) / cellHeight)), 0, int(CoverageGridDims-1));
+            int y1 = Clamp(int(std::ceil((f.second[1] - mins[1]) / cellHeight)) - 1, y0, int(CoverageGridDims-1));
+            for (int y=y0; y<=y1; ++y)
+                for (int x=x0; x<=x1; ++x)
+                    grid[y*CoverageGridDims+x] = true;
+        }
+
+        unsigned covered = 0;
+        for (unsigned c=0; c<dimof(grid); ++c) covered += grid[c];
+        return float(covered) / float(dimof(grid));
+    }
+
+        //  A receiver bounding box in light space, with its depth range along the
+        //  camera forward direction
+    class FittingReceiver
+    {
+    public:
+        AABB    _lightSpace;
+        float   _minDepth, _maxDepth;
+    };
+
+    class FittedCascade
+    {
+    public:
+        Float3  _frustumMins, _frustumMaxs;
+        Float2  _fittedMins, _fittedMaxs;
+        Float3  _mins, _maxs;
+        float   _receiverMinZ, _receiverMaxZ;
+        std::vector<std::pair<Float2, Float2>> _footprints;
+        float   _nearDistance, _farDistance;
+    };
+
+    class CameraFrustumCorners
+    {
+    public:
+        Float3  _cameraPos;
+        Float3  _cornerDir[4];
+        float   _cornerCosMin, _cornerCosMax;
+    };
+
+        //  Clamp a slice of the camera frustum (between the given split distances) to
+        //  the receivers that overlap it
+    static void FitCascadeToReceivers(
+        FittedCascade& cascade, float nearDistance, float farDistance,
+        const CameraFrustumCorners& frustum, const Float4x4& worldToLight,
+        IteratorRange<const FittingReceiver*> receivers)
+    {
+        cascade._nearDistance = nearDistance;
+        cascade._farDistance = farDistance;
+        cascade._frustumMins = Float3( FLT_MAX,  FLT_MAX,  FLT_MAX);
+        cascade._frustumMaxs = Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (unsigned c=0; c<8; ++c) {
+            auto p = TransformPoint(
+                worldToLight, 
+                frustum._cameraPos + ((c < 4) ? nearDistance : farDistance) * frustum._cornerDir[c&3]);
+            p[2] = -p[2];
+            for (unsigned q=0; q<3; ++q) {
+                cascade._frustumMins[q] = std::min(cascade._frustumMins[q], p[q]);
+                cascade._frustumMaxs[q] = std::max(cascade._frustumMaxs[q], p[q]);
+            }
+        }
+
+        float sliceMinDepth = nearDistance * frustum._cornerCosMin;
+        float sliceMaxDepth = farDistance * frustum._cornerCosMax;
+        cascade._fittedMins = Float2( FLT_MAX,  FLT_MAX);
+        cascade._fittedMaxs = Float2(-FLT_MAX, -FLT_MAX);
+        cascade._receiverMinZ = FLT_MAX; cascade._receiverMaxZ = -FLT_MAX;
+        cascade._footprints.clear();
+        for (const auto& r:receivers) {
+            if (r._maxDepth < sliceMinDepth || r._minDepth > sliceMaxDepth) continue;
+            if (!OverlapsXY(r._lightSpace.first, r._lightSpace.second, cascade._frustumMins, cascade._frustumMaxs)) continue;
+
+            Float2 fpMins(
+                std::max(r._lightSpace.first[0], cascade._frustumMins[0]),
+                std::max(r._lightSpace.first[1], cascade._frustumMins[1]));
+            Float2 fpMaxs(
+                std::min(r._lightSpace.second[0], cascade._frustumMaxs[0]),
+                std::min(r._lightSpace.second[1], cascade._frustumMaxs[1]));
+            cascade._footprints.push_back(std::make_pair(fpMins, fpMaxs));
+            for (unsigned q=0; q<2; ++q) {
+                cascade._fittedMins[q] = std::min(cascade._fittedMins[q], fpMins[q]);
+                cascade._fittedMaxs[q] = std::max(cascade._fittedMaxs[q], fpMaxs[q]);
+            }
+            cascade._receiverMinZ = std::min(cascade._receiverMinZ, r._lightSpace.first[2]);
+            cascade._receiverMaxZ = std::max(cascade._receiverMaxZ, r._lightSpace.second[2]);
+        }
+
+        if (cascade._footprints.empty()) {
+                // nothing to receive shadows in this slice; just fall back to the frustum
+            cascade._fittedMins = Truncate(cascade._frustumMins);
+            cascade._fittedMaxs = Truncate(cascade._frustumMaxs);
+        }
+    }
+
+        //  Every cascade has the same number of shadow texels. So the wasted area of a
+        //  set of cascades (in units of whole shadow textures) is the sum of the
+        //  fractions of each fitted cascade that don't contain any receivers.
+    static float CalculateWastedArea(IteratorRange<const FittedCascade*> cascades)
+    {
+        float result = 0.f;
+        for (const auto& c:cascades)
+            result += 1.f - CalculateCoverage(c._fittedMins, c._fittedMaxs, MakeIteratorRange(c._footprints));
+        return result;
+    }
+
+    static const unsigned SplitCandidateCount = 9;
+    static const float MinSplitImprovement = 0.05f;
+
+        //  Split distances for a candidate split scheme ("splits" has cascadeCount+1 entries).
+        //  Candidate 0 is the geometric series given by _frustumSizeFactor (as for unfitted
+        //  cascades). The other candidates blend between a logarithmic and a uniform
+        //  distribution, as in "parallel-split" shadow maps.
+    static void CalculateSplitCandidate(
+        float splits[], unsigned cascadeCount, unsigned candidate,
+        float splitsNear, float splitsFar, float frustumSizeFactor)
+    {
+        splits[0] = splitsNear;
+        if (candidate == 0) {
+            float t = 0;
+            for (unsigned c=0; c<cascadeCount; ++c) { t += std::pow(frustumSizeFactor, float(c)); }
+            for (unsigned c=0; c<cascadeCount; ++c)
+                splits[c+1] = splits[c] + std::pow(frustumSizeFactor, float(c)) * (splitsFar - splitsNear) / t;
+        } else {
+            float logWeight = float(SplitCandidateCount - 1 - candidate) / float(SplitCandidateCount - 2);
+            float logNear = std::max(splitsNear, 1e-3f * splitsFar);
+            for (unsigned c=1; c<=cascadeCount; ++c) {
+                float a = float(c) / float(cascadeCount);
+                float logSplit = logNear * std::pow(splitsFar / logNear, a);
+                float uniformSplit = LinearInterpolate(splitsNear, splitsFar, a);
+                splits[c] = LinearInterpolate(uniformSplit, logSplit, logWeight);
+            }
+        }
+        splits[cascadeCount] = splitsFar;
+    }
+
+        //  Cascade sizes are quantized to a fixed ladder of sizes, with this many steps for 
+        //  every doubling in size
+    static const float CascadeSizeStepsPerOctave = 8.f;
+
+    static std::pair<SceneEngine::ShadowProjectionDesc::Projections, Float4x4>  
+        BuildFittedOrthogonalShadowProjections(
+            const SceneEngine::LightDesc& lightDesc,
+            const RenderCore::Techniques::ProjectionDesc& mainSceneProjectionDesc,
+            const DefaultShadowFrustumSettings& settings,
+            const ShadowCascadeSceneBounds& sceneBounds,
+            ShadowCascadeFittingMetrics* metrics)
+    {
+        // This is similar to BuildSimpleOrthogonalShadowProjections, except that we
+        // use the bounds of the scene to tighten the cascades:
+        //  * split distances only cover the part of the camera frustum that contains receivers,
+        //    and are chosen to minimise the cascade area that doesn't contain receivers
+        //  * each cascade is clamped to the receivers within its split
+        //  * the depth range is clamped to the receivers, and the casters that can shadow them
+        //
+        // All cascades in "ortho" mode must share the same depth range (see LightInternal.cpp)
+        // so we take the union of the depth ranges of each cascade.
+
+        using namespace SceneEngine;
+        using namespace RenderCore;
+
+        Float3 cameraPos = ExtractTranslation(mainSceneProjectionDesc._cameraToWorld);
+        Float3 cameraForward = ExtractForward_Cam(mainSceneProjectionDesc._cameraToWorld);
+
+            //  Split distances are measured along the frustum corner directions. We need to
+            //  convert between those distances and depths along the camera forward direction
+        CameraFrustumCorners frustum;
+        frustum._cameraPos = cameraPos;
+        frustum._cornerCosMin = FLT_MAX; frustum._cornerCosMax = -FLT_MAX;
+        CalculateCameraFrustumCornersDirection(frustum._cornerDir, mainSceneProjectionDesc);
+        for (unsigned c=0; c<4; ++c) {
+            auto d = Dot(frustum._cornerDir[c], cameraForward);
+            frustum._cornerCosMin = std::min(frustum._cornerCosMin, d);
+            frustum._cornerCosMax = std::max(frustum._cornerCosMax, d);
+        }
+        if (frustum._cornerCosMin <= 0.f)
+            return BuildSimpleOrthogonalShadowProjections(lightDesc, mainSceneProjectionDesc, settings);
+
+            //  The definition space only depends on the light direction (not the camera position).
+            //  So when we snap the cascades to texel boundaries in this space, shadow texels stay
+            //  fixed in world space as the camera moves.
+        ShadowProjectionDesc::Projections result;
+        result._normalProjCount = settings._frustumCount;
+        result._mode = ShadowProjectionDesc::Projections::Mode::Ortho;
+        result._definitionViewMatrix = MakeWorldToLight(lightDesc._position, Float3(0.f, 0.f, 0.f));
+        const auto& worldToLight = result._definitionViewMatrix;
+
+            //  Find the receivers that are visible from the camera, and transform everything
+            //  into light space.
+        std::vector<FittingReceiver> receivers;
+        receivers.reserve(sceneBounds._receivers.size());
+        float receiversMinDepth = FLT_MAX, receiversMaxDepth = -FLT_MAX;
+        for (const auto& r:sceneBounds._receivers) {
+            if (CullAABB(mainSceneProjectionDesc._worldToProjection, r.first, r.second)) continue;
+
+            Float3 centre = .5f * (r.first + r.second);
+            Float3 halfSize = .5f * (r.second - r.first);
+            float depth = Dot(centre - cameraPos, cameraForward);
+            float radius = 
+                  std::abs(cameraForward[0]) * halfSize[0]
+                + std::abs(cameraForward[1]) * halfSize[1]
+                + std::abs(cameraForward[2]) * halfSize[2];
+
+            FittingReceiver rec;
+            rec._lightSpace = AsLightSpaceBox(worldToLight, r);
+            rec._minDepth = depth - radius;
+            rec._maxDepth = depth + radius;
+            receivers.push_back(rec);
+            receiversMinDepth = std::min(receiversMinDepth, rec._minDepth);
+            receiversMaxDepth = std::max(receiversMaxDepth, rec._maxDepth);
+        }
+
+        if (receivers.empty())
+            return BuildSimpleOrthogonalShadowProjections(lightDesc, mainSceneProjectionDesc, settings);
+
+            //  Restrict the split distances to the range that contains receivers. 
+        float splitsNear = Clamp(receiversMinDepth / frustum._cornerCosMax, 0.f, settings._maxDistanceFromCamera);
+        float splitsFar = Clamp(receiversMaxDepth / frustum._cornerCosMin, splitsNear, settings._maxDistanceFromCamera);
+        if (splitsFar <= splitsNear)
+            return BuildSimpleOrthogonalShadowProjections(lightDesc, mainSceneProjectionDesc, settings);
+
+            //  Within that range, choose the split distances that waste the least shadow 
+            //  texture area on parts of the cascades that don't contain receivers. We search
+            //  over a small family of split schemes, and only move away from the default 
+            //  geometric distribution when it gives a clear improvement (so the splits don't
+            //  flip between schemes with similar costs as the camera moves)
+        FittedCascade cascadesBuffer[2][MaxShadowTexturesPerLight];
+        FittedCascade* cascades = cascadesBuffer[0];
+        FittedCascade* workingCascades = cascadesBuffer[1];
+        const auto cascadeCount = result._normalProjCount;
+        float bestWastedArea = FLT_MAX, geometricWastedArea = FLT_MAX;
+        for (unsigned candidate=0; candidate<SplitCandidateCount; ++candidate) {
+            float splits[MaxShadowTexturesPerLight+1];
+            CalculateSplitCandidate(splits, cascadeCount, candidate, splitsNear, splitsFar, settings._frustumSizeFactor);
+            for (unsigned f=0; f<cascadeCount; ++f)
+                FitCascadeToReceivers(
+                    workingCascades[f], splits[f], splits[f+1],
+                    frustum, worldToLight, MakeIteratorRange(receivers));
+
+            float wastedArea = CalculateWastedArea(MakeIteratorRange(workingCascades, workingCascades + cascadeCount));
+            if (candidate == 0) geometricWastedArea = wastedArea;
+            if (candidate == 0 || wastedArea < bestWastedArea - MinSplitImprovement) {
+                bestWastedArea = wastedArea;
+                std::swap(cascades, workingCascades);
+            }
+        }
+
+        float receiversMinZ = FLT_MAX, receiversMaxZ = -FLT_MAX;
+        const float texelCount = float(settings._textureSize);
+        for (unsigned f=0; f<cascadeCount; ++f) {
+            auto& cascade = cascades[f];
+            if (!cascade._footprints.empty()) {
+                receiversMinZ = std::min(receiversMinZ, cascade._receiverMinZ);
+                receiversMaxZ = std::max(receiversMaxZ, cascade._receiverMaxZ);
+            }
+
+                //  Quantize the size of the cascade to the fixed ladder of sizes, and snap the 
+                //  origin to the shadow texel grid. The ladder doesn't depend on the camera, so
+                //  small camera movements don't change the texel size of the cascade.
+                //  Leave a little slack, so the snapped cascade still contains the fitted area.
+            cascade._mins = cascade._frustumMins;
+            cascade._maxs = cascade._frustumMaxs;
+            for (unsigned q=0; q<2; ++q) {
+                float size = (cascade._fittedMaxs[q] - cascade._fittedMins[q]) * (1.f + 2.f / texelCount);
+                if (size <= 0.f) continue;
+                size = std::pow(2.f, std::ceil(std::log(size) / std::log(2.f) * CascadeSizeStepsPerOctave) / CascadeSizeStepsPerOctave);
+                float texelSize = size / texelCount;
+                cascade._mins[q] = std::floor(cascade._fittedMins[q] / texelSize) * texelSize;
+                cascade._maxs[q] = cascade._mins[q] + size;
+            }
+        }
+
+        if (receiversMinZ > receiversMaxZ)
+            return BuildSimpleOrthogonalShadowProjections(lightDesc, mainSceneProjectionDesc, settings);
+
+            //  The depth range must contain all of the receivers, and all of the casters that
+            //  could cast shadows on them (ie, casters that overlap a cascade, and are closer
+            //  to the light than the furthest receiver in that cascade)
+        unsigned casterCount = 0;
+        float castersMinZ = receiversMinZ;
+        for (const auto& c:sceneBounds._casters) {
+            auto lightSpace = AsLightSpaceBox(worldToLight, c);
+            bool overlaps = false;
+            for (unsigned f=0; f<result._normalProjCount; ++f) {
+                const auto& cascade = cascades[f];
+                if (cascade._footprints.empty() || lightSpace.first[2] > cascade._receiverMaxZ) continue;
+                if (!OverlapsXY(lightSpace.first, lightSpace.second, cascade._mins, cascade._maxs)) continue;
+                overlaps = true;
+                break;
+            }
+            if (overlaps) {
+                castersMinZ = std::min(castersMinZ, lightSpace.first[2]);
+                ++casterCount;
+            }
+        }
+
+            //  Never make the depth range larger than the unfitted range. Note that the 
+            //  unfitted range is centered on the camera here
+        float cameraZ = -TransformPoint(worldToLight, cameraPos)[2];
+        const float depthMargin = 0.01f * (receiversMaxZ - castersMinZ) + 0.1f;
+        float shadowNearPlane = std::max(castersMinZ - depthMargin, cameraZ - settings._maxDistanceFromCamera);
+        float shadowFarPlane = std::min(receiversMaxZ + depthMargin, cameraZ + settings._maxDistanceFromCamera);
+        if (shadowFarPlane <= shadowNearPlane) {
+            shadowNearPlane = cameraZ - settings._maxDistanceFromCamera;
+            shadowFarPlane = cameraZ + settings._maxDistanceFromCamera;
+        }
+
+        Float3 allCascadesMins( FLT_MAX,  FLT_MAX, shadowNearPlane);
+        Float3 allCascadesMaxs(-FLT_MAX, -FLT_MAX, shadowFarPlane);
+        for (unsigned f=0; f<result._normalProjCount; ++f) {
+            auto& cascade = cascades[f];
+            cascade._mins[2] = shadowNearPlane;
+            cascade._maxs[2] = shadowFarPlane;
+            result._orthoSub[f]._projMins = cascade._mins;
+            result._orthoSub[f]._projMaxs = cascade._maxs;
+            for (unsigned q=0; q<2; ++q) {
+                allCascadesMins[q] = std::min(allCascadesMins[q], cascade._mins[q]);
+                allCascadesMaxs[q] = std::max(allCascadesMaxs[q], cascade._maxs[q]);
+            }
+
+            result._fullProj[f]._viewMatrix = result._definitionViewMatrix;
+            Float4x4 projMatrix = OrthogonalProjection(
+                cascade._mins[0], cascade._maxs[1], cascade._maxs[0], cascade._mins[1], shadowNearPlane, shadowFarPlane,
+                GeometricCoordinateSpace::RightHanded, Techniques::GetDefaultClipSpaceType());
+            result._fullProj[f]._projectionMatrix = projMatrix;
+            result._minimalProjection[f] = ExtractMinimalProjection(projMatrix);
+        }
+
+        Float4x4 clippingProjMatrix = OrthogonalProjection(
+            allCascadesMins[0], allCascadesMaxs[1], allCascadesMaxs[0], allCascadesMins[1], 
+            shadowNearPlane, shadowFarPlane,
+            GeometricCoordinateSpace::RightHanded, Techniques::GetDefaultClipSpaceType());
+        Float4x4 worldToClip = Combine(result._definitionViewMatrix, clippingProjMatrix);
+
+        std::tie(result._specialNearProjection, result._specialNearMinimalProjection) = 
+            BuildCameraAlignedOrthogonalShadowProjection(lightDesc, mainSceneProjectionDesc, 2.5, 30.f);
+        result._useNearProj = true;
+
+        if (metrics) {
+            for (unsigned f=0; f<result._normalProjCount; ++f) {
+                const auto& cascade = cascades[f];
+                ShadowCascadeFittingMetrics::Cascade m;
+                m._nearDistance = cascade._nearDistance;
+                m._farDistance = cascade._farDistance;
+                m._coverage = CalculateCoverage(Truncate(cascade._mins), Truncate(cascade._maxs), MakeIteratorRange(cascade._footprints));
+                m._unfittedCoverage = CalculateCoverage(Truncate(cascade._frustumMins), Truncate(cascade._frustumMaxs), MakeIteratorRange(cascade._footprints));
+                float unfittedArea = (cascade._frustumMaxs[0] - cascade._frustumMins[0]) * (cascade._frustumMaxs[1] - cascade._frustumMins[1]);
+                float fittedArea = (cascade._maxs[0] - cascade._mins[0]) * (cascade._maxs[1] - cascade._mins[1]);
+                m._areaRatio = (unfittedArea > 0.f) ? (fittedArea / unfittedArea) : 1.f;
+                m._receiverCount = (unsigned)cascade._footprints.size();
+                metrics->_cascades.push_back(m);
+            }
+            metrics->_depthRange = shadowFarPlane - shadowNearPlane;
+            metrics->_unfittedDepthRange = 2.f * settings._maxDistanceFromCamera;
+            metrics->_casterCount = casterCount;
+            metrics->_wastedArea = bestWastedArea;
+            metrics->_geometricWastedArea = geometricWastedArea;
+        }
+
+        return std::make_pair(result, worldToClip);
+    }
     
 
     SceneEngine::ShadowProjectionDesc 
@@ -423,6 +832,20 @@ namespace PlatformRig
             unsigned lightId,
             const RenderCore::Techniques::ProjectionDesc& mainSceneProjectionDesc,
             const DefaultShadowFrustumSettings& settings)
+    {
+        return CalculateDefaultShadowCascades(
+            lightDesc, lightId, mainSceneProjectionDesc, settings,
+            ShadowCascadeSceneBounds());
+    }
+
+    SceneEngine::ShadowProjectionDesc 
+        CalculateDefaultShadowCascades(
+            const SceneEngine::LightDesc& lightDesc,
+            unsigned lightId,
+            const RenderCore::Techniques::ProjectionDesc& mainSceneProjectionDesc,
+            const DefaultShadowFrustumSettings& settings,
+            const ShadowCascadeSceneBounds& sceneBounds,
+            ShadowCascadeFittingMetrics* metrics)
     {
             //  Build a default shadow frustum projection from the given inputs
             //  Note -- this is a very primitive implementation!
@@ -444,10 +867,17 @@ namespace PlatformRig
             result._readFormat      = RenderCore::Metal::NativeFormat::R16_UNORM;
         }
         
+        if (metrics)
+            *metrics = ShadowCascadeFittingMetrics();
+
         if (settings._flags & DefaultShadowFrustumSettings::Flags::ArbitraryCascades) {
             auto t = BuildBasicShadowProjections(lightDesc, mainSceneProjectionDesc, settings);
             result._projections = t.first;
             result._worldToClip = t.second;
+        } else if ((settings._flags & DefaultShadowFrustumSettings::Flags::FitToSceneBounds) && !sceneBounds._receivers.empty()) {
+            auto t = BuildFittedOrthogonalShadowProjections(lightDesc, mainSceneProjectionDesc, settings, sceneBounds, metrics);
+            result._projections = t.first;
+            result._worldToClip = t.second;
         } else {
             auto t = BuildSimpleOrthogonalShadowProjections(lightDesc, mainSceneProjectionDesc, settings);
             result._projections = t.first;
@@ -9,6 +9,9 @@
 #include "OverlappedWindow.h"
 #include "../RenderCore/IDevice_Forward.h"
 #include "../RenderCore/Techniques/Techniques.h"
+#include "../Math/Vector.h"
+#include "../Utility/IteratorUtils.h"
+#include <vector>
 
 namespace RenderOverlays { namespace DebuggingDisplay { class DebugScreensSystem; }}
 namespace SceneEngine { class ShadowProjectionDesc; class LightDesc; }
@@ -55,7 +58,8 @@ namespace PlatformRig
                 HighPrecisionDepths = 1<<0, 
                 ArbitraryCascades = 1<<1,
                 RayTraced = 1<<2,
-                CullFrontFaces = 1<<3       //< When set, cull front faces and leave back faces; when not set, cull back faces and leave front faces
+                CullFrontFaces = 1<<3,      //< When set, cull front faces and leave back faces; when not set, cull back faces and leave front faces
+                FitToSceneBounds = 1<<4     //< When set (and scene bounds are provided), cascades are fitted to the shadow casters and receivers
             };
             typedef unsigned BitField;
         };
@@ -93,6 +97,65 @@ namespace PlatformRig
         const RenderCore::Techniques::ProjectionDesc& mainSceneCameraDesc,
         const DefaultShadowFrustumSettings& settings);
 
+    /// <summary>World space bounding boxes used to fit shadow cascades</summary>
+    /// Receivers are objects that shadows can fall on; casters are objects that can
+    /// cast shadows. Typically a single object will be both a caster and a receiver. 
+    /// These are intended to be coarse bounds (such as placement cell and terrain 
+    /// cell bounds) -- just enough to find the parts of the camera frustum that
+    /// contain geometry.
+    class ShadowCascadeSceneBounds
+    {
+    public:
+        using AABB = std::pair<Float3, Float3>;
+        IteratorRange<const AABB*>  _receivers;
+        IteratorRange<const AABB*>  _casters;
+    };
+
+    /// <summary>Results from fitting shadow cascades to scene bounds</summary>
+    /// "Coverage" is the fraction of the area of a cascade that contains shadow
+    /// receivers (measured on a coarse grid in shadow projection space). The
+    /// unfitted values are for cascades fitted to the camera frustum only.
+    class ShadowCascadeFittingMetrics
+    {
+    public:
+        class Cascade
+        {
+        public:
+            float       _nearDistance, _farDistance;    ///< camera split distances
+            float       _coverage;
+            float       _unfittedCoverage;
+            float       _areaRatio;                     ///< fitted area / unfitted area
+            unsigned    _receiverCount;
+        };
+        std::vector<Cascade>    _cascades;
+        float                   _depthRange;            ///< shared depth range of all cascades
+        float                   _unfittedDepthRange;
+        unsigned                _casterCount;           ///< casters that overlap at least one cascade
+        float                   _wastedArea;            ///< cascade area without receivers, in whole shadow textures
+        float                   _geometricWastedArea;   ///< same, for the default geometric split distances
+    };
+
+    /// <summary>Calculate shadow cascades for the sun, fitted to the given scene bounds<summary>
+    /// When DefaultShadowFrustumSettings::Flags::FitToSceneBounds is set, the split
+    /// distances are restricted to the range of the camera frustum that contains
+    /// receivers. Within that range, the splits are chosen (from a small family of split
+    /// schemes) to minimise the cascade area that doesn't contain receivers. Each cascade
+    /// is then clamped to the receivers within its split, and the (shared) depth range is
+    /// clamped to the receivers and the casters that can shadow them.
+    /// Cascade sizes are quantized to a fixed ladder of sizes, and snapped to shadow texels
+    /// in a space that only depends on the light direction; so the shadows don't shimmer
+    /// as the camera moves.
+    ///
+    /// If the flag isn't set, or there are no receivers, this is the same as the
+    /// version without scene bounds. "metrics" is optional.
+    SceneEngine::ShadowProjectionDesc CalculateDefaultShadowCascades(
+        const SceneEngine::LightDesc& lightDesc,
+        unsigned lightId,
+        const RenderCore::Techniques::ProjectionDesc& mainSceneCameraDesc,
+        const DefaultShadowFrustumSettings& settings,
+        const ShadowCascadeSceneBounds& sceneBounds,
+        ShadowCascadeFittingMetrics* metrics = nullptr);
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     void InitDebugDisplays(RenderOverlays::DebuggingDisplay::DebugScreensSystem& system);
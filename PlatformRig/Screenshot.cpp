@@ -5,6 +5,7 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "Screenshot.h"
+#include "TiledImagePipeline.h"
 #include "../SceneEngine/LightingParserContext.h"
 #include "../SceneEngine/LightingParser.h"
 #include "../SceneEngine/GestaltResource.h"
@@ -15,78 +16,144 @@
 #include "../RenderCore/Techniques/TechniqueUtils.h"
 #include "../RenderCore/IThreadContext.h"
 #include "../RenderCore/Metal/DeviceContext.h"
+#include "../RenderCore/Metal/Resource.h"
 #include "../RenderCore/Metal/State.h"
 #include "../RenderCore/Assets/Services.h"
 #include "../BufferUploads/IBufferUploads.h"
 #include "../BufferUploads/DataPacket.h"
+#include "../BufferUploads/ResourceLocator.h"
 #include "../ConsoleRig/Console.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../ConsoleRig/Log.h"
 #include "../Utility/BitUtils.h"
-#include "../Utility/Conversion.h"
+#include "../Utility/FunctionUtils.h"
 #include "../Utility/PtrUtils.h"
 #include "../Utility/StringFormat.h"
 #include "../Utility/Streams/FileUtils.h"
 
-#include "../Core/WinAPI/IncludeWindows.h"
-#include "../Foreign/DirectXTex/DirectXTex/DirectXTex.h"
-#include "../Foreign/half-1.9.2/include/half.hpp"
-// #include <wincodec.h>        (avoiding an extra header from the winsdk by hard coding GUID_ContainerFormatTiff below)
-
 namespace PlatformRig
 {
     using namespace SceneEngine;
     using namespace RenderCore;
     using namespace BufferUploads;
 
-    static void SaveImage(
-        const char destinationFile[],
-        const void* imageData,
-        UInt2 dimensions,
-        unsigned rowPitch,
-        Metal::NativeFormat::Enum format)
+    class TileFrustum
+    {
+    public:
+        float _left, _top, _right, _bottom;
+    };
+
+    static TileFrustum CalculateFrustum(const Techniques::CameraDesc& camera, UInt2 dimensions)
+    {
+        const auto coordinateSpace = GeometricCoordinateSpace::RightHanded;
+        const float aspectRatio = dimensions[0] / float(dimensions[1]);
+        const float n = camera._nearClip;
+        const float h = n * XlTan(.5f * camera._verticalFieldOfView);
+        const float w = h * aspectRatio;
+
+        TileFrustum result;
+        result._top = h; result._bottom = -h;
+        const auto isLH = coordinateSpace == GeometricCoordinateSpace::LeftHanded;
+        if (constant_expression<isLH>::result())    { result._left = w; result._right = -w; }
+        else                                        { result._left = -w; result._right = w; }
+        return result;
+    }
+
+    static void RenderTile(
+        IThreadContext& context,
+        LightingParserContext& parserContext,
+        ISceneParser& sceneParser,
+        const Techniques::CameraDesc& camera,
+        const RenderingQualitySettings& tileQualSettings,
+        const GestaltTypes::RTVSRV& target,
+        const Float4x4& customProjectionMatrix,
+        unsigned samplingPassIndex, unsigned samplingPassCount)
+    {
+        auto metalContext = RenderCore::Metal::DeviceContext::Get(context);
+        auto sceneMarker = LightingParser_SetupScene(
+            *metalContext, parserContext, 
+            &sceneParser, samplingPassIndex, samplingPassCount);
+
+        const auto& dims = tileQualSettings._dimensions;
+        auto projDesc = BuildProjectionDesc(camera, dims, &customProjectionMatrix);
+
+            // now we can just render, using the normal process.
+        parserContext.Reset();
+        metalContext->Bind(MakeResourceList(target.RTV()), nullptr);
+        metalContext->Bind(Metal::ViewportDesc(0.f, 0.f, float(dims[0]), float(dims[1])));
+        LightingParser_SetGlobalTransform(*metalContext, parserContext, projDesc);
+        LightingParser_PrepareScene(context, parserContext, sceneParser, sceneMarker.GetPreparedScene());
+        LightingParser_ExecuteScene(context, parserContext, tileQualSettings, sceneMarker.GetPreparedScene());
+    }
+
+        //  Copies the given render target into a new staging texture. The copy is queued
+        //  on the GPU, and only blocks when we read back from the staging texture. So we
+        //  can read back one tile while the GPU is still working on the next.
+    static intrusive_ptr<ResourceLocator> CopyToStaging(
+        IThreadContext& context, const GestaltTypes::RTVSRV& target,
+        const TextureDesc& textureDesc)
+    {
+        auto desc = CreateDesc(0, CPUAccess::Read, 0, textureDesc, "ScreenshotReadback");
+        desc._allocationRules = AllocationRules::Staging;
+        auto& uploads = RenderCore::Assets::Services::GetBufferUploads();
+        auto staging = uploads.Transaction_Immediate(desc);
+        if (!staging || !staging->GetUnderlying())
+            Throw(::Exceptions::BasicLabel("Failed while allocating screenshot readback texture"));
+
+        auto metalContext = RenderCore::Metal::DeviceContext::Get(context);
+        Metal::Copy(*metalContext, staging->GetUnderlying(), target.Locator().GetUnderlying());
+        return staging;
+    }
+
+    class PendingTile
     {
-            // using DirectXTex to save to disk as a TGA file...
-        DirectX::Image image {
-            dimensions[0], dimensions[1],
-            Metal::AsDXGIFormat(format),
-            rowPitch, rowPitch * dimensions[1],
-            (uint8_t*)imageData };
-        auto fn = Conversion::Convert<std::wstring>(std::string(destinationFile));
-
-        // DirectX::SaveToDDSFile(image, DirectX::DDS_FLAGS_NONE, fn.c_str());
-
-        const GUID GUID_ContainerFormatTiff = 
-            { 0x163bcc30, 0xe2e9, 0x4f0b, { 0x96, 0x1d, 0xa3, 0xe9, 0xfd, 0xb7, 0x88, 0xa3 }};
-        auto hresult = DirectX::SaveToWICFile(
-            image, DirectX::WIC_FLAGS_NONE,
-            GUID_ContainerFormatTiff,
-            fn.c_str());
-        (void)hresult;
-        assert(SUCCEEDED(hresult));
+    public:
+        intrusive_ptr<ResourceLocator> _staging;
+        UInt2       _origin, _dims;
+        unsigned    _skirt;
+    };
+
+    static void ReadBackTile(TiledImagePipeline& pipeline, const PendingTile& tile, unsigned bytesPerPixel)
+    {
+        auto& uploads = RenderCore::Assets::Services::GetBufferUploads();
+        auto readback = uploads.Resource_ReadBack(*tile._staging);
+        auto rowPitch = readback->GetPitches()._rowPitch;
+        pipeline.PushTile(
+            tile._origin, tile._dims,
+            PtrAdd(readback->GetData(), tile._skirt*rowPitch + tile._skirt*bytesPerPixel),
+            rowPitch);
     }
 
-    static intrusive_ptr<DataPacket> RenderTiled(
+    static void RenderTiled(
         IThreadContext& context,
         LightingParserContext& parserContext,
         ISceneParser& sceneParser,
         const Techniques::CameraDesc& camera,
         const RenderingQualitySettings& qualitySettings,
         UInt2 sampleCount,
-        Metal::NativeFormat::Enum format, bool interleavedTiles)
+        Metal::NativeFormat::Enum format, bool interleavedTiles,
+        TiledImagePipeline& pipeline)
     {
         // We want to separate the view into several tiles, and render
-        // each as a separate high-res render. Then we will stitch them
-        // together and write out one extremely high-res result.
+        // each as a separate high-res render. Each tile is passed to the
+        // pipeline as soon as it has been read back, and the pipeline
+        // downsamples, tonemaps and writes it out on background threads.
 
         UInt2 tileDims;
         unsigned tilesX, tilesY;
         unsigned skirt = 0;     // we need to ignore the outermost pixels when not in interleaved mode... This is because AO often has the wrong values on the edge of the screen
         UInt2 activeDims;
+        const UInt2 finalImageDims(qualitySettings._dimensions[0] * sampleCount[0], qualitySettings._dimensions[1] * sampleCount[1]);
         if (!interleavedTiles) {
             tileDims = UInt2(2048u, 2048u);
             skirt = Tweakable("ScreenshotSkirt", 32);
-            activeDims = UInt2(tileDims[0]-2*skirt, tileDims[1]-2*skirt);
-            tilesX = CeilToMultiple(qualitySettings._dimensions[0] * sampleCount[0], activeDims[0]) / (activeDims[0]);
-            tilesY = CeilToMultiple(qualitySettings._dimensions[1] * sampleCount[1], activeDims[1]) / (activeDims[1]);
+                // tiles must cover a whole number of output pixels, so the
+                // pipeline can downsample each one independently
+            activeDims = UInt2(
+                (tileDims[0]-2*skirt) / sampleCount[0] * sampleCount[0],
+                (tileDims[1]-2*skirt) / sampleCount[1] * sampleCount[1]);
+            tilesX = CeilToMultiple(finalImageDims[0], activeDims[0]) / (activeDims[0]);
+            tilesY = CeilToMultiple(finalImageDims[1], activeDims[1]) / (activeDims[1]);
         } else {
             tilesX = sampleCount[0];
             tilesY = sampleCount[1];
@@ -94,52 +161,35 @@ namespace PlatformRig
             activeDims = tileDims;
         }
         auto tileQualSettings = qualitySettings;
+        const auto frustum = CalculateFrustum(camera, qualitySettings._dimensions);
+        const float l = frustum._left, r = frustum._right, t = frustum._top, b = frustum._bottom;
+        const float n = camera._nearClip;
+        const auto bytesPerPixel = Metal::BitsPerPixel(format) / 8;
 
             // Note that we should write out to a linear format
             // so that downsampling can be done in linear space
             // Because it's linear, we need a little extra precision
             // to avoid banding post gamma correction.
         using TargetType = GestaltTypes::RTVSRV;
-        std::vector<TargetType> targets;
-        targets.resize(tilesX*tilesY);
-
-        auto metalContext = RenderCore::Metal::DeviceContext::Get(context);
-
-        const auto coordinateSpace = GeometricCoordinateSpace::RightHanded;
-        const float aspectRatio = qualitySettings._dimensions[0] / float(qualitySettings._dimensions[1]);
-        const float n = camera._nearClip;
-        const float h = n * XlTan(.5f * camera._verticalFieldOfView);
-        const float w = h * aspectRatio;
-        const float t = h, b = -h;
-
-        float l, r;
-        const auto isLH = coordinateSpace == GeometricCoordinateSpace::LeftHanded;
-        if (constant_expression<isLH>::result())    { l = w; r = -w; }
-        else                                        { l = -w; r = w; }
-
-        auto& doToneMap = Tweakable("DoToneMap", true);
-        auto oldDoToneMap = doToneMap;
-        doToneMap = false;  // hack to disable tone mapping
-        auto cleanup = MakeAutoCleanup([&doToneMap, oldDoToneMap]() { doToneMap = oldDoToneMap; });
 
             // Render each tile, one by one...
-            // Note that there is a problem here because the tonemapping will want to
-            // sample the lumiance for each tile separately. That's not ideal for us,
-            // because it can mean that different tiles get different tonemapping!
-            // And, anyway, we want to do down-sampling in pre-tonemapped linear space.
-            // So, ideally, we should not do the tonemapping step during execute scene.
-            // Instead, we will get the "lighting target" output from the lighting parser,
-            // then downsampling, and then use the lighting parser to resolve HDR/gamma
-            // afterwards.
+            // Tone mapping is disabled while rendering the tiles, because the
+            // luminance would be sampled for each tile separately (and different
+            // tiles would get different tonemapping). And anyway, we want to do
+            // down-sampling in pre-tonemapped linear space. The pipeline does the
+            // tone map after downsampling.
+            //
+            // While we're rendering tile N, tile N-1 is waiting in a staging texture.
+            // We only read it back after tile N has been submitted, so the GPU can
+            // work on the next tile while we're copying the previous one.
+        PendingTile pendingTile;
         for (unsigned y=0; y<tilesY; ++y)
             for (unsigned x=0; x<tilesX; ++x) {
-                auto& target = targets[y*tilesX+x];
-
                 unsigned samplingPassIndex = 0, samplingPassCount = 1;
                 unsigned viewWidth, viewHeight;
                 if (!interleavedTiles) {
-                    viewWidth  = std::min((x+1)*activeDims[0], qualitySettings._dimensions[0] * sampleCount[0]) - (x*activeDims[0]);
-                    viewHeight = std::min((y+1)*activeDims[1], qualitySettings._dimensions[1] * sampleCount[1]) - (y*activeDims[1]);
+                    viewWidth  = std::min((x+1)*activeDims[0], finalImageDims[0]) - (x*activeDims[0]);
+                    viewHeight = std::min((y+1)*activeDims[1], finalImageDims[1]) - (y*activeDims[1]);
                 } else {
                     viewWidth = activeDims[0];
                     viewHeight = activeDims[1];
@@ -148,11 +198,7 @@ namespace PlatformRig
                 }
                 tileQualSettings._dimensions = UInt2(viewWidth+2*skirt, viewHeight+2*skirt);
                 auto rtDesc = TextureDesc::Plain2D(viewWidth+2*skirt, viewHeight+2*skirt, format);
-                target = TargetType(rtDesc, "HighResScreenShot");
-
-                auto sceneMarker = LightingParser_SetupScene(
-                    *metalContext, parserContext, 
-                    &sceneParser, samplingPassIndex, samplingPassCount);
+                TargetType target(rtDesc, "HighResScreenShot");
 
                     // We build a custom projection matrix that limits
                     // the frustum to the particular tile we're rendering.
@@ -170,10 +216,10 @@ namespace PlatformRig
                 Float4x4 customProjectionMatrix;
                 if (!interleavedTiles) {
                     customProjectionMatrix = PerspectiveProjection(
-                        LinearInterpolate(l, r, (int(x*activeDims[0]              - skirt))/float(qualitySettings._dimensions[0] * sampleCount[0])),
-                        LinearInterpolate(t, b, (int(y*activeDims[1]              - skirt))/float(qualitySettings._dimensions[1] * sampleCount[1])),
-                        LinearInterpolate(l, r, (int(x*activeDims[0] +  viewWidth + skirt))/float(qualitySettings._dimensions[0] * sampleCount[0])),
-                        LinearInterpolate(t, b, (int(y*activeDims[1] + viewHeight + skirt))/float(qualitySettings._dimensions[1] * sampleCount[1])),
+                        LinearInterpolate(l, r, (int(x*activeDims[0]              - skirt))/float(finalImageDims[0])),
+                        LinearInterpolate(t, b, (int(y*activeDims[1]              - skirt))/float(finalImageDims[1])),
+                        LinearInterpolate(l, r, (int(x*activeDims[0] +  viewWidth + skirt))/float(finalImageDims[0])),
+                        LinearInterpolate(t, b, (int(y*activeDims[1] + viewHeight + skirt))/float(finalImageDims[1])),
                         camera._nearClip, camera._farClip, Techniques::GetDefaultClipSpaceType());
                 } else {
                     Float2 subpixelOffset(
@@ -185,173 +231,54 @@ namespace PlatformRig
                         camera._nearClip, camera._farClip, Techniques::GetDefaultClipSpaceType());
                 }
 
-                auto projDesc = BuildProjectionDesc(camera, UInt2(rtDesc._width, rtDesc._height), &customProjectionMatrix);
-
-                    // now we can just render, using the normal process.
-                parserContext.Reset();
-                metalContext->Bind(MakeResourceList(target.RTV()), nullptr);
-                metalContext->Bind(Metal::ViewportDesc(0.f, 0.f, float(rtDesc._width), float(rtDesc._height)));
-                LightingParser_SetGlobalTransform(*metalContext, parserContext, projDesc);
-                sceneParser.PrepareScene(context, parserContext, sceneMarker.GetPreparedScene());
-                LightingParser_ExecuteScene(context, parserContext, tileQualSettings, sceneMarker.GetPreparedScene());
-            }
-
-        doToneMap = oldDoToneMap;
-
-        auto& uploads = RenderCore::Assets::Services::GetBufferUploads();
-
-            // Now pull the data over to the CPU, and stitch together
-            // We will write out the raw data in some simple format
-            //      -- the user can complete processing in a image editing application
-        UInt2 finalImageDims(qualitySettings._dimensions[0]*sampleCount[0], qualitySettings._dimensions[1]*sampleCount[1]);
-        auto bpp = Metal::BitsPerPixel(format);
-        auto finalRowPitch = finalImageDims[0]*bpp/8;
-        auto rawData = CreateBasicPacket(
-            finalImageDims[1]*finalRowPitch, nullptr,
-            TexturePitches(finalRowPitch, finalImageDims[1]*finalRowPitch));
-        auto* rawDataEnd = PtrAdd(rawData->GetData(), rawData->GetDataSize());
-        (void)rawDataEnd;
-
-        for (unsigned y=0; y<tilesY; ++y)
-            for (unsigned x=0; x<tilesX; ++x) {
-                auto& target = targets[y*tilesX+x];
-                {
-                    auto readback = uploads.Resource_ReadBack(target.Locator());
-                    auto* readbackEnd = PtrAdd(readback->GetData(), readback->GetDataSize());
-                    (void)readbackEnd;
-
-                    unsigned viewWidth, viewHeight;
-                    if (!interleavedTiles) {
-                        viewWidth  = std::min((x+1)*activeDims[0], qualitySettings._dimensions[0] * sampleCount[0]) - (x*activeDims[0]);
-                        viewHeight = std::min((y+1)*activeDims[1], qualitySettings._dimensions[1] * sampleCount[1]) - (y*activeDims[1]);
-                    } else {
-                        viewWidth = activeDims[0];
-                        viewHeight = activeDims[1];
-                    }
-
-                        // copy each row of the tile into the correct spot in the output texture
-                    for (unsigned r=0; r<viewHeight; ++r) {
-                        const void* rowSrc = PtrAdd(readback->GetData(), (r+skirt)*readback->GetPitches()._rowPitch + skirt*bpp/8);
-                        void* rowDst = PtrAdd(rawData->GetData(), (y*activeDims[1]+r)*finalRowPitch + x*activeDims[0]*bpp/8);
-                        assert(PtrAdd(rowDst, viewWidth*bpp/8) <= rawDataEnd);
-                        assert(PtrAdd(rowSrc, viewWidth*bpp/8) <= readbackEnd);
-                        XlCopyMemory(rowDst, rowSrc, viewWidth*bpp/8);
-                    }
-                }
-                    // destroy now to free up some memory
-                target = TargetType();
-            }
-
-        return std::move(rawData);
-    }
-
-    static float Float16AsFloat32(unsigned short input) { return half_float::detail::half2float(input); }
-    static unsigned short Float32AsFloat16(float input) { return half_float::detail::float2half<std::round_to_nearest>(input); }
-
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
-    static intrusive_ptr<DataPacket> BoxFilterR16G16B16A16F(
-        DataPacket& highRes, UInt2 srcDims, UInt2 downsample,
-        bool interleavedTiles)
-    {
-        const auto bpp = unsigned(sizeof(uint16)*4*8);
-        UInt2 downsampledSize(srcDims[0] / downsample[0], srcDims[1] / downsample[1]);
-        auto downsampledRowPitch = downsampledSize[0] * bpp / 8;
-        auto rawData = CreateBasicPacket(
-            downsampledSize[1]*downsampledRowPitch, nullptr,
-            TexturePitches(downsampledRowPitch, downsampledSize[1]*downsampledRowPitch));
-
-        const uint16* srcData = (const uint16*)highRes.GetData();
-        const auto srcRowPitch = highRes.GetPitches()._rowPitch;
-
-        uint16* dstData = (uint16*)rawData->GetData();
-        const auto dstRowPitch = rawData->GetPitches()._rowPitch;
+                RenderTile(
+                    context, parserContext, sceneParser, camera, tileQualSettings, 
+                    target, customProjectionMatrix, samplingPassIndex, samplingPassCount);
 
-            // note that we can do this in-place (or tile-by-tile) to save some memory
-        const unsigned weightDiv = downsample[0] * downsample[1];
-        for (unsigned y=0; y<downsampledSize[1]; ++y)
-            for (unsigned x=0; x<downsampledSize[0]; ++x) {
-                Float4 dst(0, 0, 0, 0);
+                PendingTile newTile;
+                newTile._staging = CopyToStaging(context, target, rtDesc);
+                newTile._origin = interleavedTiles ? UInt2(x, y) : UInt2(x*activeDims[0], y*activeDims[1]);
+                newTile._dims = UInt2(viewWidth, viewHeight);
+                newTile._skirt = skirt;
 
-                if (!interleavedTiles) {
-                    for (unsigned sy=0; sy<downsample[1]; ++sy)
-                        for (unsigned sx=0; sx<downsample[0]; ++sx) {
-                            UInt2 src(x*downsample[0]+sx, y*downsample[1]+sy);
-                            auto* s = PtrAdd(srcData, src[1] * srcRowPitch + src[0] * bpp/8);
-                            dst[0] += Float16AsFloat32(s[0]);
-                            dst[1] += Float16AsFloat32(s[1]);
-                            dst[2] += Float16AsFloat32(s[2]);
-                        }
-                } else {
-                    for (unsigned sy=0; sy<downsample[1]; ++sy)
-                        for (unsigned sx=0; sx<downsample[0]; ++sx) {
-                            UInt2 src(x+sx*downsampledSize[0], y+sy*downsampledSize[1]);
-                            auto* s = PtrAdd(srcData, src[1] * srcRowPitch + src[0] * bpp/8);
-                            dst[0] += Float16AsFloat32(s[0]);
-                            dst[1] += Float16AsFloat32(s[1]);
-                            dst[2] += Float16AsFloat32(s[2]);
-                        }
-                }
-
-                dst[0] /= float(weightDiv);
-                dst[1] /= float(weightDiv);
-                dst[2] /= float(weightDiv);
-                dst[3] = 1.f;
-
-                auto* d = PtrAdd(dstData, y*dstRowPitch+x*bpp/8);
-                d[0] = Float32AsFloat16(dst[0]);
-                d[1] = Float32AsFloat16(dst[1]);
-                d[2] = Float32AsFloat16(dst[2]);
-                d[3] = Float32AsFloat16(dst[3]);
+                if (pendingTile._staging)
+                    ReadBackTile(pipeline, pendingTile, bytesPerPixel);
+                pendingTile = std::move(newTile);
             }
 
-        return std::move(rawData);
+        if (pendingTile._staging)
+            ReadBackTile(pipeline, pendingTile, bytesPerPixel);
     }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-    static intrusive_ptr<DataPacket> DoToneMap(
+        //  Renders the scene once at the normal resolution, and measures the scene
+        //  luminance the same way the GPU tone mapping does. All of the tiles are
+        //  tone mapped with the exposure calculated here.
+    static float CalculatePreviewLuminance(
         IThreadContext& context,
         LightingParserContext& parserContext,
-        DataPacket& inputImage, UInt2 dimensions, 
-        Metal::NativeFormat::Enum preFilterFormat,
-        Metal::NativeFormat::Enum postFilterFormat,
-        const SceneEngine::ToneMapSettings& toneMapSettings)
+        ISceneParser& sceneParser,
+        const Techniques::CameraDesc& camera,
+        const RenderingQualitySettings& qualitySettings,
+        Metal::NativeFormat::Enum format,
+        const ToneMapSettings& toneMapSettings)
     {
-                    // Now we want to do HDR resolve (on the GPU)
-            // We should end up with an 8 bit SRGB image.
-            // We have to do both the luminance sample and final tone map on
-            // the post-aa image (the operations would otherwise require special
-            // 
-        SceneEngine::GestaltTypes::SRV preToneMap(
-            BufferUploads::TextureDesc::Plain2D(dimensions[0], dimensions[1], preFilterFormat),
-            "SS-PreToneMap", &inputImage);
-        SceneEngine::GestaltTypes::RTV postToneMap(
-            BufferUploads::TextureDesc::Plain2D(dimensions[0], dimensions[1], postFilterFormat),
-            "SS-PostToneMap");
+        const auto& dims = qualitySettings._dimensions;
+        auto rtDesc = TextureDesc::Plain2D(dims[0], dims[1], format);
+        GestaltTypes::RTVSRV target(rtDesc, "ScreenshotPreview");
 
-        auto metalContext = RenderCore::Metal::DeviceContext::Get(context);
-        auto luminanceRes = 
-            SceneEngine::ToneMap_SampleLuminance(
-                *metalContext, 
-                (RenderCore::Techniques::ParsingContext&)parserContext,
-                toneMapSettings, preToneMap.SRV(), false);
-
-        {
-            SceneEngine::ProtectState protectState(
-                *metalContext, 
-                SceneEngine::ProtectState::States::RenderTargets | SceneEngine::ProtectState::States::Viewports);
-
-            metalContext->Bind(MakeResourceList(postToneMap.RTV()), nullptr);
-            metalContext->Bind(Metal::ViewportDesc(0, 0, float(dimensions[0]), float(dimensions[1])));
-            ToneMap_Execute(
-                *metalContext, parserContext,
-                luminanceRes, toneMapSettings,
-                preToneMap.SRV());
-        }
+        const auto frustum = CalculateFrustum(camera, dims);
+        auto projection = PerspectiveProjection(
+            frustum._left, frustum._top, frustum._right, frustum._bottom,
+            camera._nearClip, camera._farClip, Techniques::GetDefaultClipSpaceType());
+        RenderTile(context, parserContext, sceneParser, camera, qualitySettings, target, projection, 0, 1);
 
         auto& uploads = RenderCore::Assets::Services::GetBufferUploads();
-        return uploads.Resource_ReadBack(postToneMap.Locator());
+        auto readback = uploads.Resource_ReadBack(target.Locator());
+        return CalculateSceneLuminance(
+            readback->GetData(), dims, readback->GetPitches()._rowPitch,
+            toneMapSettings._luminanceMin, toneMapSettings._luminanceMax);
     }
 
     std::string FindOutputFilename()
@@ -375,46 +302,40 @@ namespace PlatformRig
         UInt2 sampleCount)
     {
         auto preFilterFormat = Metal::NativeFormat::R16G16B16A16_FLOAT;
-        auto postFilterFormat = Metal::NativeFormat::R8G8B8A8_UNORM_SRGB;
-        auto highResQual = qualitySettings;
-        highResQual._dimensions[0] *= sampleCount[0];
-        highResQual._dimensions[1] *= sampleCount[1];
         const bool interleavedTiles = Tweakable("ScreenshotInterleaved", false);
+        auto toneMapSettings = sceneParser.GetToneMapSettings();
+
+        auto& doToneMap = Tweakable("DoToneMap", true);
+        auto oldDoToneMap = doToneMap;
+        doToneMap = false;  // hack to disable tone mapping
+        auto cleanup = MakeAutoCleanup([&doToneMap, oldDoToneMap]() { doToneMap = oldDoToneMap; });
 
-        auto image = RenderTiled(
+            // The tone map is applied on the CPU, after downsampling. It approximates
+            // the GPU tone mapping, but bloom and color grading are not applied.
+        TiledImagePipeline::Desc desc(qualitySettings._dimensions, sampleCount, interleavedTiles);
+        desc._toneMapOperator = TiledImagePipeline::ToneMapOperator::None;
+        if (toneMapSettings._flags & ToneMapSettings::Flags::EnableToneMap) {
+            auto luminance = CalculatePreviewLuminance(
+                context, parserContext, sceneParser,
+                camera, qualitySettings, preFilterFormat, toneMapSettings);
+            desc._exposure = toneMapSettings._sceneKey / luminance;
+            desc._whitepoint = toneMapSettings._whitepoint;
+            desc._toneMapOperator = (Tweakable("ToneMapOperator", 1) == 0)
+                ? TiledImagePipeline::ToneMapOperator::Reinhard
+                : TiledImagePipeline::ToneMapOperator::Uncharted2;
+        }
+
+        auto outputFile = FindOutputFilename();
+        TiledImagePipeline pipeline(outputFile.c_str(), desc, ConsoleRig::GlobalServices::GetShortTaskThreadPool());
+        RenderTiled(
             context, parserContext, sceneParser,
             camera, qualitySettings, sampleCount, 
-            preFilterFormat, interleavedTiles);
-
-            // Save the unfiltered image (this is a 16 bit depth linear image)
-            // We can use a program like "Luminance HDR" to run custom tonemapping
-            // on the unfiltered image...
-        // SaveImage(
-        //     "screenshot_unfiltered.tiff",
-        //     image->GetData(), highResQual._dimensions, 
-        //     image->GetPitches()._rowPitch, preFilterFormat);
-
-            // Do a box filter on the CPU to shrink the result down to
-            // the output size. We could consider other filters. But (assuming
-            // we're doing an integer downsample) the box filter will mean that
-            // each sample point is equally weighted, and it will avoid any
-            // blurring to the image.
-        image = BoxFilterR16G16B16A16F(*image, highResQual._dimensions, sampleCount, interleavedTiles);
-
-        // SaveImage(
-        //     "pretonemap.tiff",
-        //     image->GetData(), qualitySettings._dimensions, 
-        //     image->GetPitches()._rowPitch, preFilterFormat);
-
-        auto postToneMapImage = DoToneMap(
-            context, parserContext,
-            *image, qualitySettings._dimensions, preFilterFormat, postFilterFormat,
-            sceneParser.GetToneMapSettings());
-
-        SaveImage(
-            FindOutputFilename().c_str(),
-            postToneMapImage->GetData(), qualitySettings._dimensions, 
-            postToneMapImage->GetPitches()._rowPitch, postFilterFormat);
+            preFilterFormat, interleavedTiles, pipeline);
+        pipeline.Finish();
+
+        auto metrics = pipeline.GetMetrics();
+        LogInfo << "Wrote tiled screenshot (" << outputFile << ") from " << metrics._tilesProcessed 
+            << " tiles. Peak buffered tile data: " << metrics._peakBufferedBytes / (1024*1024) << "MB";
     }
 }
 
@@ -0,0 +1,539 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TiledImagePipeline.h"
+#include "../Math/HalfFloat.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Core/Exceptions.h"
+#include "../Foreign/LibTiff/tiffio.h"
+#include "../Foreign/half-1.9.2/include/half.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <assert.h>
+
+#if defined(XLEMATH_HALF_FLOAT_USE_SSE2)
+    #define TILED_IMAGE_USE_SSE2
+#endif
+
+namespace PlatformRig
+{
+    static const unsigned BytesPerSample = 4 * sizeof(uint16);     // R16G16B16A16_FLOAT
+    static const unsigned OutputChannels = 3;                       // 8 bit sRGB, no alpha
+    static const unsigned RowsPerJob = 16;                          // output rows processed by each job on the thread pool
+    static const unsigned LinearToSRGBTableSize = 1<<14;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    #if defined(TILED_IMAGE_USE_SSE2)
+
+        static __m128 LoadHalf4(const uint16* src)
+        {
+            return XLEMath::HalfToFloat4(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)src), _mm_setzero_si128()));
+        }
+
+    #endif
+
+        //  Sums each "downsample[0] x downsample[1]" block of samples from the source rows
+        //  into a single RGBA float value in "dst". The caller applies the normalisation.
+    static void BoxFilterRow(float dst[], const void* srcRows, unsigned srcRowPitch, unsigned outputWidth, UInt2 downsample)
+    {
+        #if defined(TILED_IMAGE_USE_SSE2)
+            for (unsigned x=0; x<outputWidth; ++x) {
+                __m128 acc = _mm_setzero_ps();
+                for (unsigned sy=0; sy<downsample[1]; ++sy) {
+                    auto* s = (const uint16*)PtrAdd(srcRows, sy*srcRowPitch + x*downsample[0]*BytesPerSample);
+                    for (unsigned sx=0; sx<downsample[0]; ++sx)
+                        acc = _mm_add_ps(acc, LoadHalf4(&s[sx*4]));
+                }
+                _mm_storeu_ps(&dst[x*4], acc);
+            }
+        #else
+            for (unsigned x=0; x<outputWidth; ++x) {
+                float acc[4] = { 0.f, 0.f, 0.f, 0.f };
+                for (unsigned sy=0; sy<downsample[1]; ++sy) {
+                    auto* s = (const uint16*)PtrAdd(srcRows, sy*srcRowPitch + x*downsample[0]*BytesPerSample);
+                    for (unsigned sx=0; sx<downsample[0]; ++sx)
+                        for (unsigned c=0; c<4; ++c)
+                            acc[c] += half_float::detail::half2float(s[sx*4+c]);
+                }
+                for (unsigned c=0; c<4; ++c) dst[x*4+c] = acc[c];
+            }
+        #endif
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  These match the operators in tonemap.psh
+    static float Uncharted2Curve(float x)
+    {
+        const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+        return ((x*(A*x+C*B)+D*E)/(x*(A*x+B)+D*F))-E/F;
+    }
+
+    static float ReinhardCurve(float x)
+    {
+        const float whiteSq = 2.f * 2.f;
+        return (x * (1.f + x/whiteSq)) / (1.f + x);
+    }
+
+    static float LinearToSRGB(float linear)
+    {
+        if (linear <= 0.0031308f) return 12.92f * linear;
+        return 1.055f * std::pow(linear, 1.f/2.4f) - 0.055f;
+    }
+
+    float CalculateSceneLuminance(const void* data, UInt2 dims, unsigned rowPitch, float luminanceMin, float luminanceMax)
+    {
+        if (!dims[0] || !dims[1]) return 1.f;
+
+            //  Geometric mean of the "perceived brightness" of each pixel, as in hdrluminance.csh
+        std::vector<float> row(dims[0]*4);
+        double logSum = 0.0;
+        for (unsigned y=0; y<dims[1]; ++y) {
+            XLEMath::ConvertHalfToFloat(AsPointer(row.begin()), (const uint16*)PtrAdd(data, y*rowPitch), dims[0]*4);
+            for (unsigned x=0; x<dims[0]; ++x) {
+                const float* c = &row[x*4];
+                float l = std::sqrt(std::max(0.f, 0.299f*c[0]*c[0] + 0.587f*c[1]*c[1] + 0.114f*c[2]*c[2]));
+                l = std::min(l, 1e3f);
+                logSum += std::log(1e-5f + l);
+            }
+        }
+
+        float result = float(std::exp(logSum / double(dims[0]*dims[1])));
+        result = std::max(luminanceMin, std::min(luminanceMax, result));
+        if (!(result == result) || result > std::numeric_limits<float>::max())
+            result = 1.f;
+        return result;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class TiledImagePipeline::Pimpl
+    {
+    public:
+        class Strip
+        {
+        public:
+            unsigned                    _firstRow, _rowCount;
+            std::unique_ptr<uint8[]>    _pixels;
+            size_t                      _pixelsRemaining;       // guarded by Pimpl::_lock
+        };
+
+        class Tile
+        {
+        public:
+            UInt2                       _origin, _dims;         // in samples
+            unsigned                    _rowPitch;
+            std::unique_ptr<uint8[]>    _data;
+            Strip*                      _strip;
+            unsigned                    _jobsRemaining;         // guarded by Pimpl::_lock
+        };
+
+        Desc                    _desc;
+        CompletionThreadPool*   _threadPool;
+        TIFF*                   _tiff;
+        std::vector<uint8>      _linearToSRGB;
+        float                   _whitepointScale;
+
+        Threading::Mutex        _lock;
+        std::vector<std::unique_ptr<Strip>> _strips;        // sorted by _firstRow
+        unsigned                _tilesInFlight;
+        unsigned                _jobsInFlight;
+        size_t                  _bufferedBytes;
+        Metrics                 _metrics;
+        std::string             _error;
+
+        Threading::Mutex        _writeLock;
+        unsigned                _nextRowToWrite;            // guarded by _writeLock
+
+        std::unique_ptr<float[]>            _accumulation;          // (interleaved tiles only)
+        std::unique_ptr<Threading::Mutex[]> _accumulationLocks;     // one per RowsPerJob output rows
+
+        Strip*  FindOrCreateStrip(unsigned firstRow, unsigned rowCount);
+        void    ProcessRegularTile(Tile& tile, unsigned firstRow, unsigned rowCount);
+        void    AccumulateInterleavedTile(Tile& tile, unsigned firstRow, unsigned rowCount);
+        void    EncodeAccumulatedRows(Strip& strip);
+        void    ToneMapRow(uint8 dst[], const float src[], unsigned width, float scale) const;
+
+        void    EnqueueJob(std::shared_ptr<Tile> tile, Strip* strip, unsigned firstRow, unsigned rowCount, unsigned pixelCount);
+        void    OnJobComplete(Tile* tile, Strip* strip, size_t pixelCount);
+        void    WriteCompletedStrips();
+        std::unique_ptr<Strip> PopCompletedStrip();
+        void    OnStripWritten(const Strip& strip);
+        void    ReportError(const char message[]);
+        void    WaitForJobs();
+
+        size_t  StripBytes(unsigned rowCount) const { return size_t(_desc._outputDims[0]) * rowCount * OutputChannels; }
+
+        Pimpl(const Desc& desc) : _desc(desc) {}
+    };
+
+    auto TiledImagePipeline::Pimpl::FindOrCreateStrip(unsigned firstRow, unsigned rowCount) -> Strip*
+    {
+        auto i = std::lower_bound(_strips.begin(), _strips.end(), firstRow,
+            [](const std::unique_ptr<Strip>& lhs, unsigned rhs) { return lhs->_firstRow < rhs; });
+        if (i != _strips.end() && (*i)->_firstRow == firstRow) {
+            if ((*i)->_rowCount != rowCount)
+                Throw(::Exceptions::BasicLabel("Tiles in the same row of a tiled image must have the same height"));
+            return i->get();
+        }
+
+        auto strip = std::make_unique<Strip>();
+        strip->_firstRow = firstRow;
+        strip->_rowCount = rowCount;
+        strip->_pixels = std::unique_ptr<uint8[]>(new uint8[StripBytes(rowCount)]);
+        strip->_pixelsRemaining = size_t(_desc._outputDims[0]) * rowCount;
+        _bufferedBytes += StripBytes(rowCount);
+        _metrics._peakBufferedBytes = std::max(_metrics._peakBufferedBytes, _bufferedBytes);
+        return _strips.insert(i, std::move(strip))->get();
+    }
+
+    void TiledImagePipeline::Pimpl::ToneMapRow(uint8 dst[], const float src[], unsigned width, float scale) const
+    {
+        const float exposure = scale * _desc._exposure;
+        const float tableScale = float(LinearToSRGBTableSize-1);
+        for (unsigned x=0; x<width; ++x) {
+            for (unsigned c=0; c<OutputChannels; ++c) {
+                float v = exposure * src[x*4+c];
+                switch (_desc._toneMapOperator) {
+                case ToneMapOperator::Reinhard:     v = ReinhardCurve(v); break;
+                case ToneMapOperator::Uncharted2:   v = Uncharted2Curve(v) * _whitepointScale; break;
+                default: break;
+                }
+                    // (note that this also clamps NaNs to 0)
+                v = (v > 0.f) ? std::min(v, 1.f) : 0.f;
+                dst[x*OutputChannels+c] = _linearToSRGB[unsigned(v * tableScale + .5f)];
+            }
+        }
+    }
+
+    void TiledImagePipeline::Pimpl::ProcessRegularTile(Tile& tile, unsigned firstRow, unsigned rowCount)
+    {
+        const auto ds = _desc._downsample;
+        const unsigned outputWidth = tile._dims[0] / ds[0];
+        const unsigned outputX = tile._origin[0] / ds[0];
+        const unsigned outputY = tile._origin[1] / ds[1];
+        const float normalize = 1.f / float(ds[0] * ds[1]);
+
+        std::vector<float> filtered(outputWidth*4);
+        auto& strip = *tile._strip;
+        for (unsigned r=firstRow; r<firstRow+rowCount; ++r) {
+            BoxFilterRow(
+                AsPointer(filtered.begin()),
+                PtrAdd(tile._data.get(), r*ds[1]*tile._rowPitch), tile._rowPitch,
+                outputWidth, ds);
+
+            auto* dst = &strip._pixels[(size_t(outputY + r - strip._firstRow) * _desc._outputDims[0] + outputX) * OutputChannels];
+            ToneMapRow(dst, AsPointer(filtered.begin()), outputWidth, normalize);
+        }
+    }
+
+    void TiledImagePipeline::Pimpl::AccumulateInterleavedTile(Tile& tile, unsigned firstRow, unsigned rowCount)
+    {
+            //  Convert outside of the lock, and then just do the sum while locked
+        const unsigned width = tile._dims[0];
+        std::vector<float> converted(size_t(width)*4*rowCount);
+        for (unsigned r=0; r<rowCount; ++r)
+            XLEMath::ConvertHalfToFloat(
+                &converted[size_t(r)*width*4],
+                (const uint16*)PtrAdd(tile._data.get(), (firstRow+r)*tile._rowPitch),
+                width*4);
+
+        ScopedLock(_accumulationLocks[firstRow/RowsPerJob]);
+        float* dst = &_accumulation[size_t(firstRow)*width*4];
+        for (size_t c=0; c<converted.size(); ++c)
+            dst[c] += converted[c];
+    }
+
+    void TiledImagePipeline::Pimpl::EncodeAccumulatedRows(Strip& strip)
+    {
+        const unsigned width = _desc._outputDims[0];
+        const float normalize = 1.f / float(_desc._downsample[0] * _desc._downsample[1]);
+        for (unsigned r=0; r<strip._rowCount; ++r)
+            ToneMapRow(
+                &strip._pixels[size_t(r)*width*OutputChannels],
+                &_accumulation[size_t(strip._firstRow+r)*width*4],
+                width, normalize);
+    }
+
+    void TiledImagePipeline::Pimpl::EnqueueJob(std::shared_ptr<Tile> tile, Strip* strip, unsigned firstRow, unsigned rowCount, unsigned pixelCount)
+    {
+        _threadPool->Enqueue(
+            [this, tile, strip, firstRow, rowCount, pixelCount]()
+            {
+                TRY {
+                    if (!tile) {
+                        EncodeAccumulatedRows(*strip);
+                    } else if (_desc._interleavedTiles) {
+                        AccumulateInterleavedTile(*tile, firstRow, rowCount);
+                    } else {
+                        ProcessRegularTile(*tile, firstRow, rowCount);
+                    }
+                } CATCH (const std::exception& e) {
+                    ReportError(e.what());
+                } CATCH (...) {
+                    ReportError("Unknown exception while processing tile");
+                } CATCH_END
+
+                OnJobComplete(tile.get(), strip, pixelCount);
+            });
+    }
+
+    void TiledImagePipeline::Pimpl::OnJobComplete(Tile* tile, Strip* strip, size_t pixelCount)
+    {
+        bool stripComplete = false;
+        {
+            ScopedLock(_lock);
+            if (strip) {
+                assert(strip->_pixelsRemaining >= pixelCount);
+                strip->_pixelsRemaining -= pixelCount;
+                stripComplete = !strip->_pixelsRemaining;
+            }
+            if (tile && !--tile->_jobsRemaining) {
+                    // release the tile data as soon as we're finished with it
+                _bufferedBytes -= size_t(tile->_rowPitch) * tile->_dims[1];
+                tile->_data.reset();
+                --_tilesInFlight;
+                ++_metrics._tilesProcessed;
+            }
+        }
+
+        if (stripComplete)
+            WriteCompletedStrips();
+
+            // (this must be the last time we touch "this" -- after this, the pipeline can be destroyed)
+        ScopedLock(_lock);
+        --_jobsInFlight;
+    }
+
+    auto TiledImagePipeline::Pimpl::PopCompletedStrip() -> std::unique_ptr<Strip>
+    {
+        ScopedLock(_lock);
+        if (_strips.empty()) return nullptr;
+        auto& front = _strips.front();
+        if (front->_firstRow != _nextRowToWrite || front->_pixelsRemaining) return nullptr;
+        auto result = std::move(front);
+        _strips.erase(_strips.begin());
+        return result;
+    }
+
+    void TiledImagePipeline::Pimpl::OnStripWritten(const Strip& strip)
+    {
+        ScopedLock(_lock);
+        _bufferedBytes -= StripBytes(strip._rowCount);
+        _metrics._rowsWritten += strip._rowCount;
+    }
+
+    void TiledImagePipeline::Pimpl::WriteCompletedStrips()
+    {
+            //  Rows must be written to the TIFF file in order. Whichever thread holds the
+            //  write lock will write every strip that is ready, including strips completed
+            //  by other threads while it was writing.
+        ScopedLock(_writeLock);
+        for (;;) {
+            auto strip = PopCompletedStrip();
+            if (!strip) break;
+
+            const auto rowBytes = StripBytes(1);
+            for (unsigned r=0; r<strip->_rowCount; ++r) {
+                if (TIFFWriteScanline(_tiff, &strip->_pixels[r*rowBytes], _nextRowToWrite + r, 0) < 0) {
+                    ReportError("Failed while writing to tiled image output file");
+                    break;
+                }
+            }
+            _nextRowToWrite += strip->_rowCount;
+            OnStripWritten(*strip);
+        }
+    }
+
+    void TiledImagePipeline::Pimpl::ReportError(const char message[])
+    {
+        ScopedLock(_lock);
+        if (_error.empty()) _error = message;
+    }
+
+    void TiledImagePipeline::Pimpl::WaitForJobs()
+    {
+        for (;;) {
+            {
+                ScopedLock(_lock);
+                if (!_jobsInFlight) break;
+            }
+            Threading::Sleep(1);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void TiledImagePipeline::PushTile(UInt2 tileOrigin, UInt2 tileDims, const void* data, unsigned rowPitch)
+    {
+        auto& p = *_pimpl;
+        const auto& desc = p._desc;
+        const auto ds = desc._downsample;
+
+        UInt2 outputOrigin(0,0), outputDims = tileDims;
+        if (desc._interleavedTiles) {
+            if (tileDims[0] != desc._outputDims[0] || tileDims[1] != desc._outputDims[1])
+                Throw(::Exceptions::BasicLabel("Interleaved tiles must have the same dimensions as the output image"));
+        } else {
+            if ((tileOrigin[0] % ds[0]) || (tileOrigin[1] % ds[1]) || (tileDims[0] % ds[0]) || (tileDims[1] % ds[1]))
+                Throw(::Exceptions::BasicLabel("Tile origin and dimensions must be multiples of the downsample factor"));
+            outputOrigin = UInt2(tileOrigin[0] / ds[0], tileOrigin[1] / ds[1]);
+            outputDims = UInt2(tileDims[0] / ds[0], tileDims[1] / ds[1]);
+            if ((outputOrigin[0] + outputDims[0]) > desc._outputDims[0] || (outputOrigin[1] + outputDims[1]) > desc._outputDims[1])
+                Throw(::Exceptions::BasicLabel("Tile is outside of the bounds of the output image"));
+        }
+        if (!outputDims[0] || !outputDims[1]) return;
+
+            //  Limit the number of tiles being processed at the same time, so that
+            //  our memory usage is bounded
+        for (;;) {
+            {
+                ScopedLock(p._lock);
+                if (p._tilesInFlight < std::max(desc._maxTilesInFlight, 1u)) break;
+            }
+            Threading::Sleep(1);
+        }
+
+        auto tile = std::make_shared<Pimpl::Tile>();
+        tile->_origin = tileOrigin;
+        tile->_dims = tileDims;
+        tile->_rowPitch = tileDims[0] * BytesPerSample;
+        const size_t tileBytes = size_t(tile->_rowPitch) * tileDims[1];
+        tile->_data = std::unique_ptr<uint8[]>(new uint8[tileBytes]);
+        for (unsigned r=0; r<tileDims[1]; ++r)
+            XlCopyMemory(PtrAdd(tile->_data.get(), r*tile->_rowPitch), PtrAdd(data, r*rowPitch), tile->_rowPitch);
+        tile->_strip = nullptr;
+
+        const unsigned jobCount = (outputDims[1] + RowsPerJob - 1) / RowsPerJob;
+        {
+            ScopedLock(p._lock);
+            if (!desc._interleavedTiles)
+                tile->_strip = p.FindOrCreateStrip(outputOrigin[1], outputDims[1]);
+            tile->_jobsRemaining = jobCount;
+            ++p._tilesInFlight;
+            p._jobsInFlight += jobCount;
+            p._bufferedBytes += tileBytes;
+            p._metrics._peakBufferedBytes = std::max(p._metrics._peakBufferedBytes, p._bufferedBytes);
+        }
+
+        for (unsigned j=0; j<jobCount; ++j) {
+            auto firstRow = j*RowsPerJob;
+            auto rowCount = std::min(RowsPerJob, outputDims[1] - firstRow);
+            p.EnqueueJob(tile, tile->_strip, firstRow, rowCount, desc._interleavedTiles ? 0 : rowCount * outputDims[0]);
+        }
+    }
+
+    void TiledImagePipeline::Finish()
+    {
+        auto& p = *_pimpl;
+        p.WaitForJobs();
+
+        if (p._desc._interleavedTiles && p._error.empty()) {
+                //  All of the tiles have been accumulated. Now we can tone map and write the result
+            std::vector<Pimpl::Strip*> strips;
+            {
+                ScopedLock(p._lock);
+                for (unsigned r=0; r<p._desc._outputDims[1]; r+=RowsPerJob)
+                    strips.push_back(p.FindOrCreateStrip(r, std::min(RowsPerJob, p._desc._outputDims[1] - r)));
+                p._jobsInFlight += unsigned(strips.size());
+            }
+            for (auto s:strips)
+                p.EnqueueJob(nullptr, s, s->_firstRow, s->_rowCount, s->_rowCount * p._desc._outputDims[0]);
+            p.WaitForJobs();
+        }
+
+        if (!p._error.empty())
+            Throw(::Exceptions::BasicLabel("Error while building tiled image: %s", p._error.c_str()));
+
+        unsigned rowsWritten;
+        {
+            ScopedLock(p._writeLock);
+            rowsWritten = p._nextRowToWrite;
+        }
+        if (rowsWritten != p._desc._outputDims[1])
+            Throw(::Exceptions::BasicLabel("Tiled image is incomplete (only %i of %i rows written)", rowsWritten, p._desc._outputDims[1]));
+
+        TIFFClose(p._tiff);
+        p._tiff = nullptr;
+    }
+
+    auto TiledImagePipeline::GetMetrics() const -> Metrics
+    {
+        ScopedLock(_pimpl->_lock);
+        return _pimpl->_metrics;
+    }
+
+    TiledImagePipeline::TiledImagePipeline(const char destinationFile[], const Desc& desc, Utility::CompletionThreadPool& threadPool)
+    {
+        if (!desc._outputDims[0] || !desc._outputDims[1] || !desc._downsample[0] || !desc._downsample[1])
+            Throw(::Exceptions::BasicLabel("Invalid dimensions for tiled image"));
+
+        auto pimpl = std::make_unique<Pimpl>(desc);
+        pimpl->_threadPool = &threadPool;
+        pimpl->_tilesInFlight = pimpl->_jobsInFlight = 0;
+        pimpl->_bufferedBytes = 0;
+        pimpl->_nextRowToWrite = 0;
+        XlZeroMemory(pimpl->_metrics);
+
+        pimpl->_linearToSRGB.resize(LinearToSRGBTableSize);
+        for (unsigned c=0; c<LinearToSRGBTableSize; ++c)
+            pimpl->_linearToSRGB[c] = uint8(std::min(255.f, LinearToSRGB(c / float(LinearToSRGBTableSize-1)) * 255.f + .5f));
+        pimpl->_whitepointScale = 1.f / Uncharted2Curve(std::max(desc._whitepoint, 1e-3f));
+
+        if (desc._interleavedTiles) {
+            const size_t accumulationSize = size_t(desc._outputDims[0]) * desc._outputDims[1] * 4;
+            pimpl->_accumulation = std::unique_ptr<float[]>(new float[accumulationSize]);
+            std::fill(pimpl->_accumulation.get(), pimpl->_accumulation.get() + accumulationSize, 0.f);
+            pimpl->_accumulationLocks = std::unique_ptr<Threading::Mutex[]>(
+                new Threading::Mutex[(desc._outputDims[1] + RowsPerJob - 1) / RowsPerJob]);
+            pimpl->_bufferedBytes = accumulationSize * sizeof(float);
+            pimpl->_metrics._peakBufferedBytes = pimpl->_bufferedBytes;
+        }
+
+        pimpl->_tiff = TIFFOpen(destinationFile, "w");
+        if (!pimpl->_tiff)
+            Throw(::Exceptions::BasicLabel("Could not open (%s) for writing tiled image", destinationFile));
+
+        auto* tiff = pimpl->_tiff;
+        TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, uint32(desc._outputDims[0]));
+        TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, uint32(desc._outputDims[1]));
+        TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, uint16(OutputChannels));
+        TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, uint16(8));
+        TIFFSetField(tiff, TIFFTAG_ORIENTATION, uint16(ORIENTATION_TOPLEFT));
+        TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, uint16(PLANARCONFIG_CONTIG));
+        TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, uint16(PHOTOMETRIC_RGB));
+        TIFFSetField(tiff, TIFFTAG_COMPRESSION, uint16(COMPRESSION_LZW));
+        TIFFSetField(tiff, TIFFTAG_PREDICTOR, uint16(PREDICTOR_HORIZONTAL));
+        TIFFSetField(tiff, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tiff, 0));
+
+        _pimpl = std::move(pimpl);
+    }
+
+    TiledImagePipeline::~TiledImagePipeline()
+    {
+            //  Jobs on the thread pool still reference the pimpl; we must wait for them
+        _pimpl->WaitForJobs();
+        if (_pimpl->_tiff)
+            TIFFClose(_pimpl->_tiff);
+    }
+
+    TiledImagePipeline::Desc::Desc(UInt2 outputDims, UInt2 downsample, bool interleavedTiles)
+    : _outputDims(outputDims), _downsample(downsample), _interleavedTiles(interleavedTiles)
+    {
+        _toneMapOperator = ToneMapOperator::Uncharted2;
+        _exposure = 1.f;
+        _whitepoint = 8.f;
+        _maxTilesInFlight = 3;
+    }
+}
+
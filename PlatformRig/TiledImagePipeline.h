@@ -0,0 +1,84 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Math/Vector.h"
+#include "../Core/Types.h"
+#include <memory>
+
+namespace Utility { class CompletionThreadPool; }
+
+namespace PlatformRig
+{
+    /// <summary>Builds a very high resolution image from separately rendered tiles</summary>
+    /// Tiles contain linear R16G16B16A16_FLOAT samples. Each tile is downsampled with a box
+    /// filter, tone mapped and converted to 8 bit sRGB on the given thread pool. The result
+    /// is streamed to a TIFF file in horizontal strips, so the full resolution image never
+    /// needs to exist in memory.
+    ///
+    /// There are 2 tile layouts (matching TiledScreenshot):
+    /// <list>
+    ///     <item>Regular tiles: each tile covers a rectangle of the full resolution sample grid.
+    ///         Tile origins and dimensions must be multiples of the downsample factor. All the
+    ///         tiles in a row of tiles must have the same height, and the rows should be pushed
+    ///         from top to bottom (tiles within a row can be in any order). A row of output is
+    ///         written as soon as all of the tiles covering it are complete.</item>
+    ///     <item>Interleaved tiles: each tile covers the entire image, at a sub-pixel offset.
+    ///         Each tile has the dimensions of the output image, and the final result is the
+    ///         average of all tiles. The output is written after the last tile.</item>
+    /// </list>
+    ///
+    /// PushTile() copies the tile data and returns quickly. It only blocks if too many tiles
+    /// are still being processed (which limits the amount of memory we can use).
+    class TiledImagePipeline
+    {
+    public:
+        struct ToneMapOperator { enum Enum { Reinhard, Uncharted2, None }; };
+
+        class Desc
+        {
+        public:
+            UInt2       _outputDims;
+            UInt2       _downsample;            ///< number of samples in each dimension for each output pixel
+            bool        _interleavedTiles;
+            ToneMapOperator::Enum _toneMapOperator;
+            float       _exposure;              ///< scale applied before the tone map operator (ie, scene key / scene luminance)
+            float       _whitepoint;            ///< used by the Uncharted2 operator
+            unsigned    _maxTilesInFlight;
+
+            Desc(UInt2 outputDims, UInt2 downsample, bool interleavedTiles);
+        };
+
+        void    PushTile(UInt2 tileOrigin, UInt2 tileDims, const void* data, unsigned rowPitch);
+        void    Finish();
+
+        class Metrics
+        {
+        public:
+            unsigned    _tilesProcessed;
+            unsigned    _rowsWritten;
+            size_t      _peakBufferedBytes;     ///< largest amount of tile and strip data held at once
+        };
+        Metrics GetMetrics() const;
+
+        TiledImagePipeline(const char destinationFile[], const Desc& desc, Utility::CompletionThreadPool& threadPool);
+        ~TiledImagePipeline();
+
+        TiledImagePipeline(const TiledImagePipeline&) = delete;
+        TiledImagePipeline& operator=(const TiledImagePipeline&) = delete;
+
+    private:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+
+    /// <summary>Calculates the scene luminance of a R16G16B16A16_FLOAT image</summary>
+    /// This matches the calculation used by the GPU tone mapping (see hdrluminance.csh),
+    /// so it can be used to find the exposure for a tiled image from a low resolution preview.
+    float   CalculateSceneLuminance(const void* data, UInt2 dims, unsigned rowPitch, float luminanceMin, float luminanceMax);
+}
+
@@ -220,26 +220,38 @@ namespace RenderCore { namespace Assets
         return *this;
     }
 
-    const Metal::ShaderResourceView&       DeferredShaderResource::GetShaderResource() const
+    ::Assets::AssetState DeferredShaderResource::TryGetShaderResource(const Metal::ShaderResourceView*& result) const
     {
+        result = nullptr;
         if (!_pimpl->_srv.IsGood()) {
             if (_pimpl->_transaction == ~BufferUploads::TransactionID(0))
-                Throw(::Assets::Exceptions::InvalidAsset(Initializer(), "Unknown error during loading"));
+                return ::Assets::AssetState::Invalid;
 
             auto& bu = Services::GetBufferUploads();
             if (!bu.IsCompleted(_pimpl->_transaction))
-                Throw(::Assets::Exceptions::PendingAsset(Initializer(), ""));
+                return ::Assets::AssetState::Pending;
 
             auto state = TryResolve();
-            if (state == ::Assets::AssetState::Invalid) {
-                Throw(::Assets::Exceptions::InvalidAsset(Initializer(), "Unknown error during loading"));
-            } else if (state == ::Assets::AssetState::Pending)
-                Throw(::Assets::Exceptions::PendingAsset(Initializer(), ""));
+            if (state != ::Assets::AssetState::Ready)
+                return state;
 
             assert(_pimpl->_srv.IsGood());
         }
 
-        return _pimpl->_srv;
+        result = &_pimpl->_srv;
+        return ::Assets::AssetState::Ready;
+    }
+
+    const Metal::ShaderResourceView&       DeferredShaderResource::GetShaderResource() const
+    {
+        const Metal::ShaderResourceView* result = nullptr;
+        auto state = TryGetShaderResource(result);
+        if (state == ::Assets::AssetState::Invalid) {
+            Throw(::Assets::Exceptions::InvalidAsset(Initializer(), "Unknown error during loading"));
+        } else if (state == ::Assets::AssetState::Pending)
+            Throw(::Assets::Exceptions::PendingAsset(Initializer(), ""));
+
+        return *result;
     }
 
     ::Assets::AssetState DeferredShaderResource::GetAssetState() const
@@ -15,7 +15,8 @@ namespace RenderCore { namespace Assets
     /// This is used to load a file from disk, as use as a shader resource (eg, a texture).
     /// Disk access and GPU upload are performed in background threads. While
     /// the resource is being loaded and upload, GetShaderResource() will throw
-    /// PendingAsset().
+    /// PendingAsset(). Per-frame code that would otherwise catch that exception
+    /// should use TryGetShaderResource(), which reports the state instead.
     ///
     /// The filename can have flags appended after a colon. For example:
     ///   texture.dds:l1
@@ -44,6 +45,7 @@ namespace RenderCore { namespace Assets
     {
     public:
         const Metal::ShaderResourceView&        GetShaderResource() const;
+        ::Assets::AssetState                    TryGetShaderResource(const Metal::ShaderResourceView*& result) const;
         const std::shared_ptr<::Assets::DependencyValidation>& GetDependencyValidation() const     { return _validationCallback; }
         const ::Assets::ResChar*                Initializer() const;
 
@@ -5,6 +5,8 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "LocalCompiledShaderSource.h"
+#include "ShaderPreprocessor.h"
+#include "ShaderIncludeGraph.h"
 #include "../Metal/Shader.h"
 
 #include "../../Assets/ChunkFile.h"
@@ -21,8 +23,10 @@
 #include "../../../Utility/Streams/FileUtils.h"
 #include "../../../Utility/Threading/CompletionThreadPool.h"
 #include "../../../Utility/StringFormat.h"
+#include "../../../Utility/PtrUtils.h"
 
 #include <functional>
+#include <algorithm>
 #include <deque>
 #include <regex>
 
@@ -40,6 +44,100 @@ namespace RenderCore { namespace Assets
 
         ////////////////////////////////////////////////////////////
 
+    /// <summary>Compiled byte code indexed by the hash of the preprocessed source</summary>
+    /// Many define combinations don't effect the preprocessed source of a particular entry
+    /// point. When we see the same preprocessed source a second time, we can reuse the
+    /// result of the first compile.
+    class SharedShaderByteCode
+    {
+    public:
+        using Payload = std::shared_ptr<std::vector<uint8>>;
+
+        bool TryFind(uint64 key, Payload& result, ::Assets::ArchiveCache* archive);
+        void Register(uint64 key, const Payload& payload);
+        void RecordCompile();
+
+        class Metrics
+        {
+        public:
+            unsigned _compileCount;
+            unsigned _sharedCount;
+            uint64 _sharedBytes;
+        };
+        Metrics GetMetrics() const;
+
+        SharedShaderByteCode();
+        ~SharedShaderByteCode();
+    protected:
+        std::vector<std::pair<uint64, std::weak_ptr<std::vector<uint8>>>> _byteCode;
+        mutable Threading::Mutex _lock;
+        Metrics _metrics;
+    };
+
+    bool SharedShaderByteCode::TryFind(uint64 key, Payload& result, ::Assets::ArchiveCache* archive)
+    {
+        {
+            ScopedLock(_lock);
+            auto i = LowerBound(_byteCode, key);
+            if (i != _byteCode.end() && i->first == key) {
+                result = i->second.lock();
+                if (result) {
+                    ++_metrics._sharedCount;
+                    _metrics._sharedBytes += result->size();
+                    return true;
+                }
+            }
+        }
+
+            // the shared byte code might have been written into the archive in a previous session
+        if (archive) {
+            auto fromArchive = archive->TryOpenFromCache(key);
+            if (fromArchive && !fromArchive->empty()) {
+                result = fromArchive;
+                Register(key, result);
+                ScopedLock(_lock);
+                ++_metrics._sharedCount;
+                _metrics._sharedBytes += result->size();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void SharedShaderByteCode::Register(uint64 key, const Payload& payload)
+    {
+        ScopedLock(_lock);
+        auto i = LowerBound(_byteCode, key);
+        if (i != _byteCode.end() && i->first == key) {
+            i->second = payload;
+        } else
+            _byteCode.insert(i, std::make_pair(key, std::weak_ptr<std::vector<uint8>>(payload)));
+    }
+
+    void SharedShaderByteCode::RecordCompile()
+    {
+        ScopedLock(_lock);
+        ++_metrics._compileCount;
+    }
+
+    auto SharedShaderByteCode::GetMetrics() const -> Metrics
+    {
+        ScopedLock(_lock);
+        return _metrics;
+    }
+
+    SharedShaderByteCode::SharedShaderByteCode()
+    {
+        _metrics._compileCount = 0;
+        _metrics._sharedCount = 0;
+        _metrics._sharedBytes = 0;
+    }
+
+    SharedShaderByteCode::~SharedShaderByteCode() {}
+
+        ////////////////////////////////////////////////////////////
+
     class ShaderCompileMarker : public ShaderService::IPendingMarker, public ::Assets::AsyncLoadOperation
     {
     public:
@@ -68,8 +166,13 @@ namespace RenderCore { namespace Assets
             const char shaderModel[], const ResChar definesTable[]);
 
         ShaderStage::Enum GetStage() const { return _shaderPath.AsShaderStage(); }
+        uint64 GetSharedCodeKey() const { return _sharedCodeKey; }
 
-        ShaderCompileMarker(std::shared_ptr<ShaderService::ILowLevelCompiler>);
+        ShaderCompileMarker(
+            std::shared_ptr<ShaderService::ILowLevelCompiler>,
+            std::shared_ptr<SharedShaderByteCode> sharedByteCode = nullptr,
+            std::shared_ptr<::Assets::ArchiveCache> archive = nullptr,
+            std::shared_ptr<ShaderIncludeGraph> includeGraph = nullptr);
         ~ShaderCompileMarker();
 
         ShaderCompileMarker(ShaderCompileMarker&) = delete;
@@ -85,6 +188,14 @@ namespace RenderCore { namespace Assets
 
         ChainFn _chain;
         ResId _shaderPath;
+
+        std::shared_ptr<SharedShaderByteCode> _sharedByteCode;
+        std::shared_ptr<::Assets::ArchiveCache> _archive;
+        std::shared_ptr<ShaderIncludeGraph> _includeGraph;
+        uint64 _sharedCodeKey;
+
+        bool TryFindSharedByteCode(const void* buffer, size_t bufferSize);
+        void RegisterDependencies(const std::shared_ptr<::Assets::DependencyValidation>& depVal) const;
     };
 
     auto ShaderCompileMarker::GetDependencies() const 
@@ -156,8 +267,13 @@ namespace RenderCore { namespace Assets
         }
     }
 
-    ShaderCompileMarker::ShaderCompileMarker(std::shared_ptr<ShaderService::ILowLevelCompiler> compiler)
-    : _compiler(compiler) {}
+    ShaderCompileMarker::ShaderCompileMarker(
+        std::shared_ptr<ShaderService::ILowLevelCompiler> compiler,
+        std::shared_ptr<SharedShaderByteCode> sharedByteCode,
+        std::shared_ptr<::Assets::ArchiveCache> archive,
+        std::shared_ptr<ShaderIncludeGraph> includeGraph)
+    : _compiler(compiler), _sharedByteCode(std::move(sharedByteCode)), _archive(std::move(archive))
+    , _includeGraph(std::move(includeGraph)), _sharedCodeKey(0) {}
     ShaderCompileMarker::~ShaderCompileMarker() {}
 
     static bool CancelAllShaderCompiles = false;
@@ -166,7 +282,7 @@ namespace RenderCore { namespace Assets
         const void* buffer, size_t bufferSize)
     {
         if (CancelAllShaderCompiles) {
-            _chain(::Assets::AssetState::Invalid, nullptr, nullptr, nullptr);
+            if (_chain) _chain(::Assets::AssetState::Invalid, nullptr, nullptr, nullptr);
             return ::Assets::AssetState::Invalid;
         }
 
@@ -174,10 +290,20 @@ namespace RenderCore { namespace Assets
         _payload.reset();
         _deps.clear();
 
-        auto success = _compiler->DoLowLevelCompile(
-            _payload, errors, _deps,
-            buffer, bufferSize, _shaderPath,
-            _definesTable.c_str());
+        bool success;
+        if (!TryFindSharedByteCode(buffer, bufferSize)) {
+            success = _compiler->DoLowLevelCompile(
+                _payload, errors, _deps,
+                buffer, bufferSize, _shaderPath,
+                _definesTable.c_str());
+
+            if (_sharedByteCode) {
+                _sharedByteCode->RecordCompile();
+                if (success && _sharedCodeKey)
+                    _sharedByteCode->Register(_sharedCodeKey, _payload);
+            }
+        } else
+            success = true;
 
             // before we can finish the "complete" step, we need to commit
             // to archive output
@@ -203,6 +329,33 @@ namespace RenderCore { namespace Assets
         return result;
     }
 
+    bool ShaderCompileMarker::TryFindSharedByteCode(const void* buffer, size_t bufferSize)
+    {
+        _sharedCodeKey = 0;
+        if (!_sharedByteCode) return false;
+
+            //  Preprocess with the full set of defines the compiler will use. The hash
+            //  of the result (combined with the entry point and shader model) identifies
+            //  the compiled byte code, regardless of which unreferenced defines were set.
+        auto defines = _compiler->MakeImplicitDefines(_shaderPath) + ";" + _definesTable;
+        auto preprocessed = PreprocessShaderSource(
+            MakeStringSection((const char*)buffer, (const char*)PtrAdd(buffer, bufferSize)),
+            MakeStringSection(_shaderPath._filename), MakeStringSection(defines),
+            MakeFileSystemIncludeLoader(MakeStringSection(_shaderPath._filename)));
+        if (!preprocessed._isReliable) return false;
+
+        _sharedCodeKey = HashCombine(
+            preprocessed._hash,
+            Hash64(StringMeld<128>() << _shaderPath._entryPoint << ":" << _shaderPath._shaderModel << (_shaderPath._dynamicLinkageEnabled?":!":"")));
+
+        if (!_sharedByteCode->TryFind(_sharedCodeKey, _payload, _archive.get()))
+            return false;
+
+        _deps = std::move(preprocessed._includeFiles);
+        _deps.push_back(::Assets::IntermediateAssets::Store::GetDependentFileState(MakeStringSection(_shaderPath._filename)));
+        return true;
+    }
+
     auto ShaderCompileMarker::Resolve(
         const char initializer[], 
         const std::shared_ptr<::Assets::DependencyValidation>& depVal) const -> const Payload&
@@ -214,10 +367,7 @@ namespace RenderCore { namespace Assets
         if (state == ::Assets::AssetState::Pending) 
             Throw(::Assets::Exceptions::PendingAsset(initializer, "Pending shader code while resolving"));
 
-        if (depVal)
-            for (const auto& i:_deps)
-                RegisterFileDependency(depVal, MakeStringSection(i._filename));
-
+        if (depVal) RegisterDependencies(depVal);
         return _payload;
     }
 
@@ -229,14 +379,24 @@ namespace RenderCore { namespace Assets
         if (state != ::Assets::AssetState::Ready)
             return state;
 
-        if (depVal)
-            for (const auto& i:_deps)
-                RegisterFileDependency(depVal, MakeStringSection(i._filename));
-
+        if (depVal) RegisterDependencies(depVal);
         result = _payload;
         return ::Assets::AssetState::Ready;
     }
 
+    void ShaderCompileMarker::RegisterDependencies(const std::shared_ptr<::Assets::DependencyValidation>& depVal) const
+    {
+            //  With an include graph, we attach to the shared validation object for the
+            //  root file (rather than monitoring every included file separately)
+        if (_includeGraph) {
+            _includeGraph->RegisterDependencies(
+                depVal, MakeStringSection(_shaderPath._filename), MakeIteratorRange(_deps));
+        } else {
+            for (const auto& i:_deps)
+                RegisterFileDependency(depVal, MakeStringSection(i._filename));
+        }
+    }
+
     auto ShaderCompileMarker::GetErrors() const -> Payload { return Payload(); }
 
     ::Assets::AssetState ShaderCompileMarker::StallWhilePending() const
@@ -255,12 +415,17 @@ namespace RenderCore { namespace Assets
 
         void LogStats(const ::Assets::IntermediateAssets::Store& intermediateStore);
 
+        const std::shared_ptr<SharedShaderByteCode>& GetSharedByteCode() const { return _sharedByteCode; }
+        const std::shared_ptr<ShaderIncludeGraph>& GetIncludeGraph() const { return _includeGraph; }
+
         ShaderCacheSet();
         ~ShaderCacheSet();
     protected:
         typedef std::pair<uint64, std::shared_ptr<::Assets::ArchiveCache>> Archive;
         std::vector<Archive> _archives;
         Threading::Mutex _archivesLock;
+        std::shared_ptr<SharedShaderByteCode> _sharedByteCode;
+        std::shared_ptr<ShaderIncludeGraph> _includeGraph;
     };
 
     std::shared_ptr<::Assets::ArchiveCache> ShaderCacheSet::GetArchive(
@@ -389,6 +554,11 @@ namespace RenderCore { namespace Assets
             LogInfo << e->second;
         }
 
+        auto sharedMetrics = _sharedByteCode->GetMetrics();
+        LogInfo << "------------------------------------------------------------------------------------------";
+        LogInfo << "Compiles this session: " << sharedMetrics._compileCount;
+        LogInfo << "Compiles avoided by sharing preprocessed source: " << sharedMetrics._sharedCount << " (" << sharedMetrics._sharedBytes / 1024 << "k of byte code)";
+
         LogInfo << "------------------------------------------------------------------------------------------";
         LogInfo << "Total shader size: " << totalShaderSize;
         LogInfo << "Total allocated space: " << totalAllocationSpace;
@@ -398,7 +568,11 @@ namespace RenderCore { namespace Assets
         LogInfo << "------------------------------------------------------------------------------------------";
     }
 
-    ShaderCacheSet::ShaderCacheSet() {}
+    ShaderCacheSet::ShaderCacheSet()
+    {
+        _sharedByteCode = std::make_shared<SharedShaderByteCode>();
+        _includeGraph = std::make_shared<ShaderIncludeGraph>();
+    }
     ShaderCacheSet::~ShaderCacheSet() {}
 
         ////////////////////////////////////////////////////////////
@@ -453,6 +627,11 @@ namespace RenderCore { namespace Assets
         XlCopyString(result._sourceID0, archiveName);
         result._sourceID1 = archiveId;
         result._archive = c->_shaderCacheSet->GetArchive(archiveName, *_store);
+
+            // record this variant, so it can be recompiled early when a file it depends on changes
+        c->_shaderCacheSet->GetIncludeGraph()->RegisterVariant(
+            MakeStringSection(_initializer), _res, MakeStringSection(_definesTable),
+            result._dependencyValidation);
         return std::move(result);
     }
 
@@ -487,7 +666,9 @@ namespace RenderCore { namespace Assets
         using Payload = ShaderCompileMarker::Payload;
 
         ::Assets::rstring depNameAsString = depName;
-        auto compileHelper = std::make_shared<ShaderCompileMarker>(c->_compiler);
+        auto includeGraph = c->_shaderCacheSet->GetIncludeGraph();
+        auto compileHelper = std::make_shared<ShaderCompileMarker>(
+            c->_compiler, c->_shaderCacheSet->GetSharedByteCode(), marker->GetLocator()._archive, includeGraph);
 
         Interlocked::Increment(&c->_activeCompileCount);
         {
@@ -499,9 +680,12 @@ namespace RenderCore { namespace Assets
 
         auto tempPtr = compileHelper.get();
         auto store = _store;
+        auto res = _res;
+        auto initializer = _initializer;
+        auto definesTable = _definesTable;
         compileHelper->Enqueue(
             _res, _definesTable,
-            [marker, archiveCacheAttachment, depNameAsString, store, tempPtr, c]
+            [marker, archiveCacheAttachment, depNameAsString, store, tempPtr, c, includeGraph, res, initializer, definesTable]
             (   ::Assets::AssetState newState, const Payload& payload, 
                 const ::Assets::DependentFileState* depsBegin, const ::Assets::DependentFileState* depsEnd)
             {
@@ -517,8 +701,26 @@ namespace RenderCore { namespace Assets
                     std::vector<::Assets::DependentFileState> deps(depsBegin, depsEnd);
                     auto baseDirAsString = MakeFileNameSplitter(marker->GetLocator()._sourceID0).DriveAndPath().AsString();
 
-                    marker->GetLocator()._archive->Commit(
-                        marker->GetLocator()._sourceID1, Payload(payload),
+                        //  When the preprocessed source could be identified, the byte code is
+                        //  stored once under the shared key, and this variation gets an alias
+                    auto& archive = *marker->GetLocator()._archive;
+                    auto sharedCodeKey = tempPtr->GetSharedCodeKey();
+                    Payload blockToCommit = payload;
+                    if (sharedCodeKey) {
+                        if (!archive.HasItem(sharedCodeKey))
+                            archive.Commit(
+                                sharedCodeKey, Payload(payload),
+                                #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
+                                    ("[shared] [" + metricsString + "]"),
+                                #else
+                                    std::string(),
+                                #endif
+                                []() {});
+                        blockToCommit = ShaderService::MakeArchiveAlias(sharedCodeKey);
+                    }
+
+                    archive.Commit(
+                        marker->GetLocator()._sourceID1, std::move(blockToCommit),
                         #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
                             (archiveCacheAttachment + " [" + metricsString + "]"),
                         #else
@@ -537,9 +739,13 @@ namespace RenderCore { namespace Assets
                     (void)archiveCacheAttachment;
                 }
 
-                marker->GetLocator()._dependencyValidation = std::make_shared<::Assets::DependencyValidation>();
-                for (auto i=depsBegin; i!=depsEnd; ++i)
-                    RegisterFileDependency(marker->GetLocator()._dependencyValidation, i->_filename.c_str());
+                auto depVal = std::make_shared<::Assets::DependencyValidation>();
+                includeGraph->RegisterDependencies(
+                    depVal, MakeStringSection(res._filename), MakeIteratorRange(depsBegin, depsEnd));
+                includeGraph->RegisterVariant(
+                    MakeStringSection(initializer), res, MakeStringSection(definesTable),
+                    depVal, false);
+                marker->GetLocator()._dependencyValidation = std::move(depVal);
 
                     // give the PendingCompileMarker object the same state
                 marker->SetState(newState);
@@ -622,7 +828,8 @@ namespace RenderCore { namespace Assets
         const ::Assets::ResChar resource[], 
         const ResChar definesTable[]) const -> std::shared_ptr<IPendingMarker>
     {
-        auto compileHelper = std::make_shared<ShaderCompileMarker>(_compiler);
+        auto compileHelper = std::make_shared<ShaderCompileMarker>(
+            _compiler, _shaderCacheSet->GetSharedByteCode(), nullptr, _shaderCacheSet->GetIncludeGraph());
         auto resId = ShaderService::MakeResId(resource, *_compiler);
         compileHelper->Enqueue(resId, definesTable?definesTable:"", nullptr);
         return compileHelper;
@@ -632,11 +839,79 @@ namespace RenderCore { namespace Assets
         const char shaderInMemory[], const char entryPoint[], 
         const char shaderModel[], const ResChar definesTable[]) const -> std::shared_ptr<IPendingMarker>
     {
-        auto compileHelper = std::make_shared<ShaderCompileMarker>(_compiler);
+        auto compileHelper = std::make_shared<ShaderCompileMarker>(_compiler, _shaderCacheSet->GetSharedByteCode());
         compileHelper->Enqueue(shaderInMemory, entryPoint, shaderModel, definesTable); 
         return compileHelper;
     }
 
+        ////////////////////////////////////////////////////////////
+
+    /// <summary>Recompiles shaders affected by file changes ahead of them being requested</summary>
+    /// After an edit to a shared header, many variants become invalid at the same time. Rather
+    /// than waiting for each to be requested (and compiled in request order), we start
+    /// compiling them immediately; with the variants currently in use first. When the assets
+    /// are reloaded, the results are found in the archive (or via the shared byte code table).
+    class LocalCompiledShaderSource::RecompileScheduler : public ::Assets::IPollingAsyncProcess
+    {
+    public:
+        Result::Enum Update();
+
+        RecompileScheduler(
+            std::weak_ptr<LocalCompiledShaderSource> source,
+            const ::Assets::IntermediateAssets::Store& store,
+            unsigned maxActiveCompiles);
+        ~RecompileScheduler();
+    protected:
+        std::weak_ptr<LocalCompiledShaderSource> _source;
+        const ::Assets::IntermediateAssets::Store* _store;
+        std::vector<std::shared_ptr<::Assets::PendingCompileMarker>> _activeCompiles;
+        unsigned _maxActiveCompiles;
+    };
+
+    auto LocalCompiledShaderSource::RecompileScheduler::Update() -> Result::Enum
+    {
+        auto source = _source.lock();
+        if (!source || CancelAllShaderCompiles) return Result::Finish;
+
+        _activeCompiles.erase(
+            std::remove_if(
+                _activeCompiles.begin(), _activeCompiles.end(),
+                [](const std::shared_ptr<::Assets::PendingCompileMarker>& m)
+                { return m->GetAssetState() != ::Assets::AssetState::Pending; }),
+            _activeCompiles.end());
+
+        if (_activeCompiles.size() >= _maxActiveCompiles) return Result::KeepPolling;
+
+        auto& graph = *source->_shaderCacheSet->GetIncludeGraph();
+        auto batch = graph.TakeRecompileBatch(unsigned(_maxActiveCompiles - _activeCompiles.size()));
+        for (const auto& v:batch) {
+            Marker marker(v._initializer.c_str(), v._res, v._definesTable.c_str(), *_store, source);
+            auto pending = marker.InvokeCompile();
+            if (pending) _activeCompiles.push_back(std::move(pending));
+        }
+
+        return Result::KeepPolling;
+    }
+
+    LocalCompiledShaderSource::RecompileScheduler::RecompileScheduler(
+        std::weak_ptr<LocalCompiledShaderSource> source,
+        const ::Assets::IntermediateAssets::Store& store,
+        unsigned maxActiveCompiles)
+    : _source(std::move(source)), _store(&store), _maxActiveCompiles(std::max(1u, maxActiveCompiles)) {}
+
+    LocalCompiledShaderSource::RecompileScheduler::~RecompileScheduler() {}
+
+    std::shared_ptr<::Assets::IPollingAsyncProcess> LocalCompiledShaderSource::CreateRecompileScheduler(
+        const ::Assets::IntermediateAssets::Store& store, unsigned maxActiveCompiles)
+    {
+        return std::make_shared<RecompileScheduler>(shared_from_this(), store, maxActiveCompiles);
+    }
+
+    ShaderIncludeGraph& LocalCompiledShaderSource::GetIncludeGraph()
+    {
+        return *_shaderCacheSet->GetIncludeGraph();
+    }
+
     void LocalCompiledShaderSource::StallOnPendingOperations(bool cancelAll)
     {
         if (cancelAll) CancelAllShaderCompiles = true;
@@ -8,6 +8,7 @@
 
 #include "../ShaderService.h"
 #include "../../Assets/IntermediateAssets.h"
+#include "../../Assets/CompileAndAsyncManager.h"
 #include "../../Utility/Threading/ThreadingUtils.h"
 #include <vector>
 #include <memory>
@@ -17,6 +18,7 @@ namespace RenderCore { namespace Assets
 {
     class ShaderCacheSet;
     class ShaderCompileMarker;
+    class ShaderIncludeGraph;
 
     class LocalCompiledShaderSource 
         : public ::Assets::IntermediateAssets::IAssetCompiler
@@ -40,6 +42,14 @@ namespace RenderCore { namespace Assets
         void StallOnPendingOperations(bool cancelAll);
 
         ShaderCacheSet& GetCacheSet() { return *_shaderCacheSet; }
+        ShaderIncludeGraph& GetIncludeGraph();
+
+        /// <summary>Creates a process that recompiles variants invalidated by file changes</summary>
+        /// Add the result to the CompileAndAsyncManager. At most "maxActiveCompiles"
+        /// recompiles will be in flight at any time.
+        std::shared_ptr<::Assets::IPollingAsyncProcess> CreateRecompileScheduler(
+            const ::Assets::IntermediateAssets::Store& store,
+            unsigned maxActiveCompiles = 4);
 
         LocalCompiledShaderSource(std::shared_ptr<ShaderService::ILowLevelCompiler> compiler);
         ~LocalCompiledShaderSource();
@@ -51,6 +61,7 @@ namespace RenderCore { namespace Assets
         std::shared_ptr<ShaderService::ILowLevelCompiler> _compiler;
 
         class Marker;
+        class RecompileScheduler;
     };
 }}
 
@@ -20,6 +20,8 @@
 #include "../../Utility/Streams/StreamDOM.h"
 #include "../../Utility/StringFormat.h"
 #include "../../Utility/MemoryUtils.h"
+#include "../../Utility/IteratorUtils.h"
+#include "../../Utility/Threading/Mutex.h"
 #include "../../Utility/Streams/PathUtils.h"
 
 namespace Assets
@@ -551,6 +553,146 @@ namespace RenderCore { namespace Assets
         MergeInto(result);
     }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static void AddDep(
+        std::vector<::Assets::DependentFileState>& deps, 
+        const ::Assets::DependentFileState& depState)
+    {
+            // (depState should already be in the format returned from GetDependentFileState)
+        auto existing = std::find_if(deps.cbegin(), deps.cend(),
+            [&](const ::Assets::DependentFileState& test) 
+            {
+                return !XlCompareStringI(test._filename.c_str(), depState._filename.c_str());
+            });
+        if (existing == deps.cend())
+            deps.push_back(depState);
+    }
+
+    static void MergeResolved(ResolvedMaterial& dest, const ResolvedMaterial& source)
+    {
+            // Merging a flattened material is equivalent to merging in each of
+            // the layers that were flattened into it (in the same order). The 
+            // parameter boxes are always kept sorted & packed, so the result is
+            // identical, regardless of the order the parameters were set in.
+        dest._bindings.MergeIn(source._bindings);
+        dest._matParams.MergeIn(source._matParams);
+        dest._stateSet = Merge(dest._stateSet, source._stateSet);
+        dest._constants.MergeIn(source._constants);
+        if (source._techniqueConfig[0])
+            XlCopyString(dest._techniqueConfig, source._techniqueConfig);
+    }
+
+    class RawMaterialResolveCache::Pimpl
+    {
+    public:
+        class Entry
+        {
+        public:
+            ResolvedMaterial _flattened;
+            std::vector<::Assets::DependentFileState> _deps;
+            std::shared_ptr<::Assets::DependencyValidation> _depVal;
+        };
+
+        std::vector<std::pair<uint64, std::shared_ptr<Entry>>> _entries;
+        Threading::Mutex _lock;
+
+        std::shared_ptr<Entry> GetFlattened(
+            const ::Assets::ResChar initializer[],
+            const ::Assets::DirectorySearchRules& searchRules,
+            bool mergeContainerSearchRules);
+    };
+
+    auto RawMaterialResolveCache::Pimpl::GetFlattened(
+        const ::Assets::ResChar initializer[],
+        const ::Assets::DirectorySearchRules& searchRules,
+        bool mergeContainerSearchRules) -> std::shared_ptr<Entry>
+    {
+            // The flattened result depends on the search rules used to resolve
+            // the inherited names, so they must be part of the key.
+            // When "mergeContainerSearchRules" is set, the rules from the container
+            // are merged in (this is what RawMaterial::Resolve does for inherited materials)
+        auto hash = Hash64(initializer, searchRules.CalculateHash() + (mergeContainerSearchRules?1:0));
+        {
+            ScopedLock(_lock);
+            auto i = LowerBound(_entries, hash);
+            if (i!=_entries.end() && i->first == hash && i->second->_depVal->GetValidationIndex() == 0)
+                return i->second;
+        }
+
+            // note -- we can throw pending & invalid from here...
+        auto& container = RawMaterial::GetAsset(initializer);
+        ::Assets::DirectorySearchRules mergedSearchRules;
+        if (mergeContainerSearchRules) {
+            mergedSearchRules = searchRules;
+            mergedSearchRules.Merge(container._searchRules);
+        }
+        const auto& finalSearchRules = mergeContainerSearchRules ? mergedSearchRules : searchRules;
+
+        auto entry = std::make_shared<Entry>();
+        entry->_depVal = std::make_shared<::Assets::DependencyValidation>();
+        if (container.GetDependencyValidation())
+            ::Assets::RegisterAssetDependency(entry->_depVal, container.GetDependencyValidation());
+
+            // This follows the same pattern as RawMaterial::Resolve -- but we merge 
+            // in flattened results for the inherited materials
+        auto inheritted = container._asset.ResolveInherited(finalSearchRules);
+        for (auto i=inheritted.cbegin(); i!=inheritted.cend(); ++i) {
+            FileNameSplitter<::Assets::ResChar> splitName(i->c_str());
+            AddDep(entry->_deps, splitName.FullFilename());
+
+            TRY {
+                auto inherittedEntry = GetFlattened(i->c_str(), finalSearchRules, true);
+
+                MergeResolved(entry->_flattened, inherittedEntry->_flattened);
+                for (const auto& d:inherittedEntry->_deps)
+                    AddDep(entry->_deps, d);
+                ::Assets::RegisterAssetDependency(entry->_depVal, inherittedEntry->_depVal);
+            } CATCH (const ::Assets::Exceptions::InvalidAsset&) {
+                    // If this file appears later, we must rebuild
+                ::Assets::RegisterFileDependency(entry->_depVal, splitName.AllExceptParameters());
+            } CATCH_END
+        }
+
+        container._asset.MergeInto(entry->_flattened);
+
+        {
+            ScopedLock(_lock);
+            auto i = LowerBound(_entries, hash);
+            if (i!=_entries.end() && i->first == hash) {
+                i->second = entry;
+            } else
+                _entries.insert(i, std::make_pair(hash, entry));
+        }
+        return std::move(entry);
+    }
+
+    void RawMaterialResolveCache::Resolve(
+        ResolvedMaterial& result,
+        const ::Assets::ResChar initializer[],
+        const ::Assets::DirectorySearchRules& searchRules,
+        std::vector<::Assets::DependentFileState>* deps)
+    {
+        auto entry = _pimpl->GetFlattened(initializer, searchRules, false);
+        MergeResolved(result, entry->_flattened);
+        if (deps)
+            for (const auto& d:entry->_deps)
+                AddDep(*deps, d);
+    }
+
+    void RawMaterialResolveCache::Clear()
+    {
+        ScopedLock(_pimpl->_lock);
+        _pimpl->_entries.clear();
+    }
+
+    RawMaterialResolveCache::RawMaterialResolveCache()
+    {
+        _pimpl = std::make_unique<Pimpl>();
+    }
+
+    RawMaterialResolveCache::~RawMaterialResolveCache() {}
+
 
 
 }}
@@ -146,6 +146,41 @@ namespace RenderCore { namespace Assets
         std::shared_ptr<::Assets::DependencyValidation> _depVal;
 
         void MergeInto(ResolvedMaterial& dest) const;
+        friend class RawMaterialResolveCache;
+    };
+
+    /// <summary>Resolves RawMaterials, remembering the result of flattening each inheritance chain</summary>
+    /// RawMaterial::Resolve() walks the entire inheritance tree every time it is called.
+    /// When many materials share the same base materials (for example, every configuration
+    /// in a model inheriting from a few common library materials) the same ancestors are
+    /// looked up, filename-resolved and merged over and over again.
+    ///
+    /// This cache flattens each RawMaterial together with its ancestors once, and merges
+    /// that flattened result into the destination. The output is identical to calling
+    /// RawMaterial::Resolve() directly (including the list of dependencies).
+    ///
+    /// Cached entries are invalidated when any of the files in their inheritance chain
+    /// change (including inherited files that were missing when the entry was built).
+    class RawMaterialResolveCache
+    {
+    public:
+        /// <summary>Equivalent to RawMaterial::GetAsset(initializer)._asset.Resolve(...)</summary>
+        /// Can throw the same exceptions as RawMaterial::GetAsset().
+        void Resolve(
+            ResolvedMaterial& result,
+            const ::Assets::ResChar initializer[],
+            const ::Assets::DirectorySearchRules& searchRules,
+            std::vector<::Assets::DependentFileState>* deps = nullptr);
+
+        void Clear();
+
+        RawMaterialResolveCache();
+        ~RawMaterialResolveCache();
+        RawMaterialResolveCache(const RawMaterialResolveCache&) = delete;
+        RawMaterialResolveCache& operator=(const RawMaterialResolveCache&) = delete;
+    private:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
     };
 
     void ResolveMaterialFilename(
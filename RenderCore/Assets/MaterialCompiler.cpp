@@ -90,7 +90,7 @@ namespace RenderCore { namespace Assets
 
     static ::Assets::CompilerHelper::CompileResult CompileMaterialScaffold(
         const ::Assets::ResChar sourceMaterial[], const ::Assets::ResChar sourceModel[],
-        const ::Assets::ResChar destination[])
+        const ::Assets::ResChar destination[], RawMaterialResolveCache& resolveCache)
     {
             // Parameters must be stripped off the source model filename before we get here.
             // the parameters are irrelevant to the compiler -- so if they stay on the request
@@ -103,8 +103,9 @@ namespace RenderCore { namespace Assets
         std::vector<::Assets::DependentFileState> deps;
 
             //  for each configuration, we want to build a resolved material
-            //  Note that this is a bit crazy, because we're going to be loading
-            //  and re-parsing the same files over and over again!
+            //  Many configurations will share the same inherited materials (and
+            //  "material:*" is used by every configuration), so we resolve through
+            //  a cache that remembers flattened inheritance chains.
         SerializableVector<std::pair<MaterialGuid, ResolvedMaterial>> resolved;
         SerializableVector<std::pair<MaterialGuid, std::string>> resolvedNames;
         resolved.reserve(modelMat._configurations.size());
@@ -148,8 +149,7 @@ namespace RenderCore { namespace Assets
                 auto configName = Conversion::Convert<::Assets::rstring>(*i);
                 Meld meld; meld << sourceModel << ":" << configName;
                 resName << meld;
-                auto& rawMat = RawMaterial::GetAsset(meld);
-                rawMat._asset.Resolve(resMat, searchRules, &deps);
+                resolveCache.Resolve(resMat, meld, searchRules, &deps);
             } CATCH (const ::Assets::Exceptions::InvalidAsset&) {
             } CATCH_END
 
@@ -160,8 +160,7 @@ namespace RenderCore { namespace Assets
                         // resolve in material:*
                     Meld meld; meld << resolvedSourceMaterial << ":*";
                     resName << ";" << meld;
-                    auto& rawMat = RawMaterial::GetAsset(meld);
-                    rawMat._asset.Resolve(resMat, searchRules, &deps);
+                    resolveCache.Resolve(resMat, meld, searchRules, &deps);
                 } CATCH (const ::Assets::Exceptions::InvalidAsset&) {
                 } CATCH_END
 
@@ -169,8 +168,7 @@ namespace RenderCore { namespace Assets
                         // resolve in material:configuration
                     Meld meld; meld << resolvedSourceMaterial << ":" << Conversion::Convert<::Assets::rstring>(*i);
                     resName << ";" << meld;
-                    auto& rawMat = RawMaterial::GetAsset(meld);
-                    rawMat._asset.Resolve(resMat, searchRules, &deps);
+                    resolveCache.Resolve(resMat, meld, searchRules, &deps);
                 } CATCH (const ::Assets::Exceptions::InvalidAsset&) {
                 } CATCH_END
             }
@@ -203,11 +201,11 @@ namespace RenderCore { namespace Assets
         return ::Assets::CompilerHelper::CompileResult { std::move(deps), std::string() };
     }
 
-    static void DoCompileMaterialScaffold(QueuedCompileOperation& op)
+    static void DoCompileMaterialScaffold(QueuedCompileOperation& op, RawMaterialResolveCache& resolveCache)
     {
         TRY
         {
-            auto compileResult = CompileMaterialScaffold(op._initializer0, op._initializer1, op.GetLocator()._sourceID0);
+            auto compileResult = CompileMaterialScaffold(op._initializer0, op._initializer1, op.GetLocator()._sourceID0, resolveCache);
             op.GetLocator()._dependencyValidation = op._destinationStore->WriteDependencies(
                 op.GetLocator()._sourceID0, MakeStringSection(compileResult._baseDir), 
                 MakeIteratorRange(compileResult._dependencies));
@@ -226,6 +224,7 @@ namespace RenderCore { namespace Assets
     class MaterialScaffoldCompiler::Pimpl
     {
     public:
+        RawMaterialResolveCache _resolveCache;      // (must outlive _thread)
         Threading::Mutex _threadLock;
         std::unique_ptr<CompilationThread> _thread;
     };
@@ -283,9 +282,11 @@ namespace RenderCore { namespace Assets
 
 		{
 			ScopedLock(c->_pimpl->_threadLock);
-			if (!c->_pimpl->_thread)
+			if (!c->_pimpl->_thread) {
+				auto* resolveCache = &c->_pimpl->_resolveCache;
 				c->_pimpl->_thread = std::make_unique<CompilationThread>(
-					[](QueuedCompileOperation& op) { DoCompileMaterialScaffold(op); });
+					[resolveCache](QueuedCompileOperation& op) { DoCompileMaterialScaffold(op, *resolveCache); });
+			}
 		}
 		c->_pimpl->_thread->Push(backgroundOp);
 
@@ -21,7 +21,6 @@ namespace RenderCore { namespace Assets { namespace GeoProc
 
     enum class ComponentType { Float32, Float16, UNorm8 };
     static std::pair<ComponentType, unsigned> BreakdownFormat(Metal::NativeFormat::Enum fmt);
-    static unsigned short AsFloat16(float input);
     static float AsFloat32(unsigned short f16input);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -384,8 +383,9 @@ namespace RenderCore { namespace Assets { namespace GeoProc
         dst[3] = (srcComponentCount > 3) ? src[3] : 1.f;
         if (processingFlags & ProcessingFlags::Renormalize) {
             float scale;
-            if (XlRSqrt_Checked(&scale, dst[0] * dst[0] + dst[1] * dst[1] + dst[2] * dst[2]))
+            if (XlRSqrt_Checked(&scale, dst[0] * dst[0] + dst[1] * dst[1] + dst[2] * dst[2])) {
                 dst[0] *= scale; dst[1] *= scale; dst[2] *= scale;
+            }
         }
 
         if (processingFlags & ProcessingFlags::TexCoordFlip) {
@@ -411,8 +411,9 @@ namespace RenderCore { namespace Assets { namespace GeoProc
         dst[3] = (srcComponentCount > 3) ? AsFloat32(src[3]) : 1.f;
         if (processingFlags & ProcessingFlags::Renormalize) {
             float scale;
-            if (XlRSqrt_Checked(&scale, dst[0] * dst[0] + dst[1] * dst[1] + dst[2] * dst[2]))
+            if (XlRSqrt_Checked(&scale, dst[0] * dst[0] + dst[1] * dst[1] + dst[2] * dst[2])) {
                 dst[0] *= scale; dst[1] *= scale; dst[2] *= scale;
+            }
         }
 
         if (processingFlags & ProcessingFlags::TexCoordFlip) {
@@ -488,84 +489,13 @@ namespace RenderCore { namespace Assets { namespace GeoProc
         const void* dst, Metal::NativeFormat::Enum dstFmt, size_t dstStride, size_t dstDataSize,
         const void* src, Metal::NativeFormat::Enum srcFmt, size_t srcStride, size_t srcDataSize,
         unsigned count, 
-        std::vector<unsigned> mapping,
+        const std::vector<unsigned>& mapping,
         ProcessingFlags::BitField processingFlags)
     {
-        auto dstFormat = BreakdownFormat(dstFmt);
-        auto srcFormat = BreakdownFormat(srcFmt);
-
-            //      This could be be made more efficient with a smarter loop..
-        if (srcFormat.first == ComponentType::Float32) {
-
-            if (dstFormat.first == ComponentType::Float32) {  ////////////////////////////////////////////////
-
-                for (unsigned v = 0; v<count; ++v, dst = PtrAdd(dst, dstStride)) {
-                    auto srcIndex = (v < mapping.size()) ? mapping[v] : v;
-                    assert(srcIndex * srcStride + sizeof(float) <= srcDataSize);
-                    auto* srcV = PtrAdd(src, srcIndex * srcStride);
-
-                    float input[4];
-                    GetVertDataF32(input, (const float*)srcV, srcFormat.second, processingFlags);
-
-                    for (unsigned c=0; c<dstFormat.second; ++c) {
-                        assert(&((float*)dst)[c+1] <= PtrAdd(dst, dstDataSize));
-                        ((float*)dst)[c] = input[c];
-                    }
-                }
-
-            } else if (dstFormat.first == ComponentType::Float16) {  ////////////////////////////////////////////////
-
-                for (unsigned v = 0; v<count; ++v, dst = PtrAdd(dst, dstStride)) {
-                    auto srcIndex = (v < mapping.size()) ? mapping[v] : v;
-                    assert(srcIndex * srcStride + sizeof(float) <= srcDataSize);
-                    auto* srcV = PtrAdd(src, srcIndex * srcStride);
-
-                    float input[4];
-                    GetVertDataF32(input, (const float*)srcV, srcFormat.second, processingFlags);
-
-                    for (unsigned c=0; c<dstFormat.second; ++c) {
-                        assert(&((unsigned short*)dst)[c+1] <= PtrAdd(dst, dstDataSize));
-                        ((unsigned short*)dst)[c] = AsFloat16(input[c]);
-                    }
-                }
-
-            } else if (dstFormat.first == ComponentType::UNorm8) {  ////////////////////////////////////////////////
-
-                for (unsigned v = 0; v<count; ++v, dst = PtrAdd(dst, dstStride)) {
-                    auto srcIndex = (v < mapping.size()) ? mapping[v] : v;
-                    assert(srcIndex * srcStride + sizeof(float) <= srcDataSize);
-                    auto* srcV = PtrAdd(src, srcIndex * srcStride);
-
-                    float input[4];
-                    GetVertDataF32(input, (const float*)srcV, srcFormat.second, processingFlags);
-
-                    for (unsigned c=0; c<dstFormat.second; ++c) {
-                        assert(&((unsigned char*)dst)[c+1] <= PtrAdd(dst, dstDataSize));
-                        ((unsigned char*)dst)[c] = (unsigned char)Clamp(((float*)input)[c]*255.f, 0.f, 255.f);
-                    }
-                }
-
-            } else {
-                Throw(FormatError("Error while copying vertex data. Unexpected format for destination parameter."));
-            }
-        } else if (
-                srcFormat.first == ComponentType::UNorm8 && dstFormat.first == ComponentType::UNorm8
-            &&  srcFormat.second == dstFormat.second) {
-
-                // simple copy of uint8 data
-            for (unsigned v = 0; v<count; ++v, dst = PtrAdd(dst, dstStride)) {
-                auto srcIndex = (v < mapping.size()) ? mapping[v] : v;
-                assert(srcIndex * srcStride + sizeof(uint8) * dstFormat.second <= srcDataSize);
-                auto* srcV = (uint8*)PtrAdd(src, srcIndex * srcStride);
-                for (unsigned c=0; c<dstFormat.second; ++c) {
-                    assert(&((uint8*)dst)[c+1] <= PtrAdd(dst, dstDataSize));
-                    ((uint8*)dst)[c] = srcV[c];
-                }
-            }
-
-        } else {
-            Throw(FormatError("Error while copying vertex data. Format not supported."));
-        }
+        ConvertVertexStream(
+            const_cast<void*>(dst), AsVertexElementFormat(dstFmt), dstStride, dstDataSize,
+            src, AsVertexElementFormat(srcFmt), srcStride, srcDataSize,
+            count, MakeIteratorRange(mapping), processingFlags);
     }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -885,49 +815,10 @@ namespace RenderCore { namespace Assets { namespace GeoProc
         return std::make_pair(componentType, componentCount);
     }
 
-    unsigned short AsFloat16(float input)
-    {
-        //
-        //      Using "half" library
-        //          http://sourceforge.net/projects/half/
-        //
-        //      It doesn't have vectorized conversions,
-        //      and it looks like it doesn't support denormalized
-        //      or overflowed numbers. But it has lots of rounding
-        //      modes!
-        //
-
-        auto result = half_float::detail::float2half<std::round_to_nearest>(input);
-        // assert(!isinf(half_float::detail::half2float(result)));
-        return result;
-    }
-
     float AsFloat32(unsigned short input)
     {
         return half_float::detail::half2float(input);
     }
 
-    // static unsigned short AsFloat16_Fast(float input)
-    // {
-    //         //
-    //         //      See stack overflow article:
-    //         //          http://stackoverflow.com/questions/3026441/float32-to-float16
-    //         //
-    //         //      He suggests either using a table lookup or vectorising
-    //         //      this code for further optimisation.
-    //         //
-    //     unsigned int fltInt32 = FloatBits(input);
-    // 
-    //     unsigned short fltInt16 = (fltInt32 >> 31) << 5;
-    // 
-    //     unsigned short tmp = (fltInt32 >> 23) & 0xff;
-    //     tmp = (tmp - 0x70) & ((unsigned int)((int)(0x70 - tmp) >> 4) >> 27);
-    // 
-    //     fltInt16 = (fltInt16 | tmp) << 10;
-    //     fltInt16 |= (fltInt32 >> 13) & 0x3ff;
-    // 
-    //     return fltInt16;
-    // }
-
 }}}
 
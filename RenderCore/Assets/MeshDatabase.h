@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "VertexConversion.h"
 #include "../Metal/Format.h"
 #include "../Metal/InputLayout.h"
 #include "../../Utility/IteratorUtils.h"
@@ -16,12 +17,6 @@
 
 namespace RenderCore { namespace Assets { namespace GeoProc
 {
-    namespace ProcessingFlags 
-    {
-        enum Enum { TexCoordFlip = 1<<0, TangentHandinessFlip = 1<<1, BitangentFlip = 1<<2, Renormalize = 1<<3 };
-        typedef unsigned BitField;
-    }
-
     namespace FormatHint
     {
         enum Enum { IsColor = 1<<0 };
@@ -188,12 +183,13 @@ namespace RenderCore { namespace Assets { namespace GeoProc
 
     /// <summary>Copy vertex data with format conversion</summary>
     /// This is typically used for copying vertex data between similar formats
-    /// (for example, 32 bit floats to 16 bit floats)
+    /// (for example, 32 bit floats to 16 bit floats). See ConvertVertexStream
+    /// for the details of the conversion.
     void CopyVertexData(
         const void* dst, Metal::NativeFormat::Enum dstFmt, size_t dstStride, size_t dstDataSize,
         const void* src, Metal::NativeFormat::Enum srcFmt, size_t srcStride, size_t srcDataSize,
         unsigned count, 
-        std::vector<unsigned> mapping = std::vector<unsigned>(),
+        const std::vector<unsigned>& mapping = std::vector<unsigned>(),
         ProcessingFlags::BitField processingFlags = 0);
 
 }}}
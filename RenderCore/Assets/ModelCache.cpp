@@ -180,10 +180,30 @@ namespace RenderCore { namespace Assets
         const ResChar modelFilename[], const ResChar materialFilename[],
         IteratorRange<const SupplementGUID*> supplements,
         unsigned LOD) -> Model
+    {
+        Model result;
+        if (TryGetModel(result, modelFilename, materialFilename, supplements, LOD) != ::Assets::AssetState::Ready)
+            Throw(::Assets::Exceptions::PendingAsset(modelFilename, "Scaffolds still pending in ModelCache"));
+        return result;
+    }
+
+    ::Assets::AssetState ModelCache::TryGetModel(
+        Model& result,
+        const ResChar modelFilename[], const ResChar materialFilename[],
+        IteratorRange<const SupplementGUID*> supplements,
+        unsigned LOD)
     {
         auto scaffold = GetScaffolds(modelFilename, materialFilename);
         if (!scaffold._model || !scaffold._material)
-            Throw(::Assets::Exceptions::PendingAsset(modelFilename, "Scaffolds still pending in ModelCache"));
+            return ::Assets::AssetState::Pending;
+
+            //  The material scaffold may still be compiling. Check it here, rather
+            //  than letting the ModelRenderer constructor throw a PendingAsset
+        auto materialState = scaffold._material->TryResolve();
+        if (materialState == ::Assets::AssetState::Invalid)
+            Throw(::Assets::Exceptions::InvalidAsset(materialFilename, "Material scaffold invalid in ModelCache"));
+        if (materialState == ::Assets::AssetState::Pending)
+            return ::Assets::AssetState::Pending;
 
         auto maxLOD = scaffold._model->GetMaxLOD();
         LOD = std::min(LOD, maxLOD);
@@ -220,7 +240,6 @@ namespace RenderCore { namespace Assets
             boundingBox = boundingBoxI->second;
         }
 
-        Model result;
         result._renderer = renderer.get();
         result._sharedStateSet = _pimpl->_sharedStateSet.get();
         result._model = scaffold._model;
@@ -229,7 +248,7 @@ namespace RenderCore { namespace Assets
         result._hashedMaterialName = scaffold._hashedMaterialName;
         result._selectedLOD = LOD;
         result._maxLOD = maxLOD;
-        return result;
+        return ::Assets::AssetState::Ready;
     }
 
     ::Assets::AssetState ModelCache::PrepareModel(
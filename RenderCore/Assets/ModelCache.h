@@ -71,6 +71,18 @@ namespace RenderCore { namespace Assets
             const ResChar materialFilename[],
             SupplementRange supplements = SupplementRange(),
             unsigned LOD = 0);
+
+        /// <summary>Non-throwing version of GetModel</summary>
+        /// Returns AssetState::Pending (and leaves "result" unchanged) while the
+        /// scaffolds are still loading, rather than throwing a PendingAsset exception.
+        /// Use this in loops that look up many models per frame (for example, when
+        /// rendering placements), so that pending models can just be skipped.
+        ::Assets::AssetState TryGetModel(
+            Model& result,
+            const ResChar modelFilename[], 
+            const ResChar materialFilename[],
+            SupplementRange supplements = SupplementRange(),
+            unsigned LOD = 0);
         Scaffolds GetScaffolds(
             const ResChar modelFilename[], 
             const ResChar materialFilename[]);
@@ -25,6 +25,26 @@ namespace RenderCore { namespace Assets
 
     class DeferredShaderResource;
 
+    /// <summary>Everything required to execute a single draw call in a ModelRenderer</summary>
+    /// Draw packets are resolved when the renderer is constructed. While rendering, we
+    /// only need to change the state that differs from the previous packet.
+    class ModelDrawPacket
+    {
+    public:
+        unsigned                _meshIndex;         // index into _meshes (or _skinnedMeshes)
+        unsigned                _transformMarker;
+
+        SharedTechniqueConfig   _shaderName;
+        SharedParameterBox      _geoParamBox;
+        SharedParameterBox      _materialParamBox;
+        SharedRenderStateSet    _renderStateSet;
+        unsigned                _textureSet;
+        unsigned                _constantBuffer;
+
+        unsigned                _topology;
+        unsigned                _indexCount, _firstIndex, _firstVertex;
+    };
+
     class PendingGeoUpload
     {
     public:
@@ -102,6 +122,10 @@ namespace RenderCore { namespace Assets
         typedef std::pair<unsigned, DrawCallDesc> MeshAndDrawCall;
         std::vector<MeshAndDrawCall>    _drawCalls;
 
+            //  one packet for each entry in _drawCallRes (unskinned draw calls, followed
+            //  by skinned draw calls)
+        std::vector<ModelDrawPacket>    _drawPackets;
+
         const ModelScaffold*    _scaffold;
         unsigned                _levelOfDetail;
 
@@ -120,17 +144,11 @@ namespace RenderCore { namespace Assets
         Pimpl() : _scaffold(nullptr), _levelOfDetail(~unsigned(0x0)) {}
         ~Pimpl() {}
 
-        Metal::BoundUniforms* BeginVariation(
-            const ModelRendererContext&, const SharedStateSet&, unsigned, SharedTechniqueInterface) const;
-
-        SharedTechniqueInterface BeginGeoCall(
+        SharedTechniqueInterface BindMesh(
             const ModelRendererContext& context,
-            Metal::ConstantBuffer&  localTransformBuffer,
-            const MeshToModel&      transforms,
-            const Float4x4&         modelToWorld,
-            unsigned                geoCallIndex) const;
+            unsigned                    meshIndex) const;
 
-        void ApplyBoundUnforms(
+        bool ApplyBoundUnforms(
             const ModelRendererContext&     context,
             Metal::BoundUniforms&           boundUniforms,
             unsigned                        resourcesIndex,
@@ -150,6 +168,12 @@ namespace RenderCore { namespace Assets
             const uint64 textureBindPoints[], unsigned textureBindPointsCnt,
             ModelConstruction::ParamBoxDescriptions& paramBoxDesc,
             bool normalFromSkinning = false) -> Mesh;
+
+        static ModelDrawPacket MakeDrawPacket(
+            unsigned meshIndex,
+            const ModelCommandStream::GeoCall& geoInst,
+            const DrawCallDesc& drawCall,
+            const DrawCallResources& res);
     };
 
     class ModelRenderer::PimplWithSkinning : public Pimpl
@@ -183,13 +207,12 @@ namespace RenderCore { namespace Assets
         std::vector<SkinnedMeshAnimBinding> _skinnedBindings;
         std::vector<MeshAndDrawCall>        _skinnedDrawCalls;
 
-        SharedTechniqueInterface BeginSkinCall(
-            const ModelRendererContext&     context,
-            Metal::ConstantBuffer&  localTransformBuffer,
-            const MeshToModel&      transforms,
-            const Float4x4&         modelToWorld,
-            unsigned                geoCallIndex,
-            PreparedAnimation*      preparedAnimation) const;
+        class DeviceSink;
+
+        SharedTechniqueInterface BindSkinnedMesh(
+            const ModelRendererContext& context,
+            unsigned                    meshIndex,
+            PreparedAnimation*          preparedAnimation) const;
 
     ///////////////////////////////////////////////////////////////////////////////
         //   B U I L D I N G   A N D   I N I T I A L I Z A T I O N   //
@@ -236,6 +259,76 @@ namespace RenderCore { namespace Assets
         void EndBuildingSkinning(Metal::DeviceContext& context) const;
     };
 
+    /// <summary>Executes a sequence of draw packets</summary>
+    /// Only the state that differs from the previous packet is changed. The 
+    /// state changes and draw calls are passed to "sink". ModelRenderer::Render uses
+    /// a sink that writes to the device context, but other sinks can be used to
+    /// record the command stream. Sink must implement:
+    /// <code>\code
+    ///     SharedTechniqueInterface BindMesh(const ModelDrawPacket&);
+    ///     void SetTransform(const ModelDrawPacket&);
+    ///     void BeginRenderState(const ModelDrawPacket&);
+    ///     Uniforms* BeginVariation(const ModelDrawPacket&, SharedTechniqueInterface);
+    ///     bool ApplyUniforms(const ModelDrawPacket&, Uniforms&);
+    ///     void BindTopology(const ModelDrawPacket&);
+    ///     void Draw(const ModelDrawPacket&, unsigned drawCallIndex);
+    /// \endcode</code>
+    /// SetTransform is only called when "perMeshTransforms" is set.
+    /// ApplyUniforms returns false when the uniforms can't be bound yet (for example,
+    /// while textures are pending). The draw call is skipped, and the uniforms
+    /// are applied again for the next packet.
+    template<typename Sink>
+        void ExecuteDrawPackets(
+            Sink& sink, 
+            const ModelDrawPacket* begin, const ModelDrawPacket* end,
+            unsigned firstDrawCallIndex, bool perMeshTransforms)
+        {
+            if (begin == end) return;
+
+            const ModelDrawPacket* prev = nullptr;
+            auto techniqueInterface = SharedTechniqueInterface(SharedTechniqueInterface::Invalid);
+            decltype(sink.BeginVariation(*begin, techniqueInterface)) uniforms = nullptr, appliedUniforms = nullptr;
+            bool variationChanged = true;
+
+            unsigned drawCallIndex = firstDrawCallIndex;
+            for (auto p=begin; p!=end; ++p, ++drawCallIndex) {
+                if (!prev || p->_meshIndex != prev->_meshIndex) {
+                    auto newInterface = sink.BindMesh(*p);
+                    variationChanged |= newInterface != techniqueInterface;
+                    techniqueInterface = newInterface;
+                }
+
+                if (perMeshTransforms && (!prev || p->_transformMarker != prev->_transformMarker))
+                    sink.SetTransform(*p);
+
+                if (!prev || p->_renderStateSet != prev->_renderStateSet)
+                    sink.BeginRenderState(*p);
+
+                if (    variationChanged 
+                    ||  p->_shaderName != prev->_shaderName || p->_geoParamBox != prev->_geoParamBox
+                    ||  p->_materialParamBox != prev->_materialParamBox) {
+                    uniforms = sink.BeginVariation(*p, techniqueInterface);
+                    variationChanged = false;
+                }
+
+                bool skipDraw = false;
+                if (    !prev || uniforms != appliedUniforms
+                    ||  p->_textureSet != prev->_textureSet || p->_constantBuffer != prev->_constantBuffer) {
+                    appliedUniforms = uniforms;
+                    if (uniforms && !sink.ApplyUniforms(*p, *uniforms)) {
+                        appliedUniforms = nullptr;
+                        skipDraw = true;
+                    }
+                }
+
+                if (!prev || p->_topology != prev->_topology)
+                    sink.BindTopology(*p);
+
+                if (!skipDraw) sink.Draw(*p, drawCallIndex);
+                prev = p;
+            }
+        }
+
     unsigned BuildLowLevelInputAssembly(
         Metal::InputElementDesc dst[], unsigned dstMaxCount,
         const VertexElement* source, unsigned sourceCount,
@@ -533,8 +533,10 @@ namespace RenderCore { namespace Assets
         std::vector<Pimpl::Mesh> meshes;
         std::vector<Pimpl::MeshAndDrawCall> drawCalls;
         std::vector<Pimpl::DrawCallResources> drawCallRes;
+        std::vector<ModelDrawPacket> drawPackets;
         drawCalls.reserve(drawCallCount);
         drawCallRes.reserve(drawCallCount);
+        drawPackets.reserve(drawCallCount);
 
         for (unsigned gi=0; gi<geoCallCount; ++gi) {
             auto& geoInst = cmdStream.GetGeoCall(gi);
@@ -584,6 +586,7 @@ namespace RenderCore { namespace Assets
                     matRes._renderStateSet, matRes._delayStep, scaffoldMatIndex);
                 drawCallRes.push_back(res);
                 drawCalls.push_back(std::make_pair(gi, d));
+                drawPackets.push_back(Pimpl::MakeDrawPacket(unsigned(std::distance(meshes.begin(), mesh)), geoInst, d, res));
             }
         }
 
@@ -638,6 +641,7 @@ namespace RenderCore { namespace Assets
 
                 drawCallRes.push_back(res);
                 skinnedDrawCalls.push_back(std::make_pair(gi, d));
+                drawPackets.push_back(Pimpl::MakeDrawPacket(unsigned(std::distance(skinnedMeshes.begin(), mesh)), geoInst, d, res));
             }
         }
 
@@ -701,6 +705,7 @@ namespace RenderCore { namespace Assets
 
         pimpl->_drawCalls = std::move(drawCalls);
         pimpl->_drawCallRes = std::move(drawCallRes);
+        pimpl->_drawPackets = std::move(drawPackets);
         pimpl->_skinnedDrawCalls = std::move(skinnedDrawCalls);
 
         pimpl->_boundTextures = std::move(boundTextures);
@@ -732,88 +737,49 @@ namespace RenderCore { namespace Assets
         class Desc {};
 
         Metal::ConstantBuffer _localTransformBuffer;
+        Metal::ConstantBuffer _drawCallIndexBuffer;
         ModelRenderingBox(const Desc&)
         {
             Metal::ConstantBuffer localTransformBuffer(nullptr, sizeof(Techniques::LocalTransformConstants));
             _localTransformBuffer = std::move(localTransformBuffer);
+            Metal::ConstantBuffer drawCallIndexBuffer(nullptr, sizeof(unsigned)*4);
+            _drawCallIndexBuffer = std::move(drawCallIndexBuffer);
         }
         ~ModelRenderingBox() {}
     };
 
-    Metal::BoundUniforms*    ModelRenderer::Pimpl::BeginVariation(
-            const ModelRendererContext& context,
-            const SharedStateSet&   sharedStateSet,
-            unsigned                drawCallIndex,
-            SharedTechniqueInterface      techniqueInterface) const
-    {
-        const auto& res = _drawCallRes[drawCallIndex];
-        sharedStateSet.BeginRenderState(context, res._renderStateSet);
-        return sharedStateSet.BeginVariation(
-            context, res._shaderName, techniqueInterface, res._geoParamBox, res._materialParamBox);
-    }
-
-    auto ModelRenderer::Pimpl::BeginGeoCall(
+    auto ModelRenderer::Pimpl::BindMesh(
             const ModelRendererContext& context,
-            Metal::ConstantBuffer&      localTransformBuffer,
-            const MeshToModel&          transforms,
-            const Float4x4&             modelToWorld,
-            unsigned                    geoCallIndex) const -> SharedTechniqueInterface
+            unsigned                    meshIndex) const -> SharedTechniqueInterface
     {
-        auto& cmdStream = _scaffold->CommandStream();
-        auto& geoCall = cmdStream.GetGeoCall(geoCallIndex);
-
-        if (transforms.IsGood()) {
-            auto meshToWorld = Combine(transforms.GetMeshToModel(geoCall._transformMarker), modelToWorld);
-            auto trans = Techniques::MakeLocalTransform(meshToWorld, ExtractTranslation(context._parserContext->GetProjectionDesc()._cameraToWorld));
-            localTransformBuffer.Update(*context._context, &trans, sizeof(trans));
-        }
-
-            // todo -- should be possible to avoid this search
-        auto mesh = FindIf(_meshes, [=](const Pimpl::Mesh& mesh) { return mesh._id == geoCall._geoId; });
-        assert(mesh != _meshes.end());
-
+        auto& mesh = _meshes[meshIndex];
         auto& devContext = *context._context;
-        devContext.Bind(_indexBuffer, Metal::NativeFormat::Enum(mesh->_indexFormat), mesh->_ibOffset);
+        devContext.Bind(_indexBuffer, Metal::NativeFormat::Enum(mesh._indexFormat), mesh._ibOffset);
 
         const Metal::VertexBuffer* vbs[] = { &_vertexBuffer, &_vertexBuffer, &_vertexBuffer };
         static_assert(dimof(vbs) == MaxVertexStreams, "Vertex buffer array size doesn't match vertex streams");
-        assert(mesh->_vertexStreamCount <= MaxVertexStreams);
+        assert(mesh._vertexStreamCount <= MaxVertexStreams);
         devContext.Bind(
-            0, mesh->_vertexStreamCount, vbs,
-            mesh->_vertexStrides, mesh->_vbOffsets);
+            0, mesh._vertexStreamCount, vbs,
+            mesh._vertexStrides, mesh._vbOffsets);
 
-        return mesh->_techniqueInterface;
+        return mesh._techniqueInterface;
     }
 
-    auto ModelRenderer::PimplWithSkinning::BeginSkinCall(
+    auto ModelRenderer::PimplWithSkinning::BindSkinnedMesh(
         const ModelRendererContext& context,
-        Metal::ConstantBuffer&      localTransformBuffer,
-        const MeshToModel&          transforms,
-        const Float4x4&             modelToWorld,
-        unsigned                    geoCallIndex,
+        unsigned                    meshIndex,
         PreparedAnimation*          preparedAnimation) const -> SharedTechniqueInterface
     {
-        auto& cmdStream = _scaffold->CommandStream();
-        auto& geoCall = cmdStream.GetSkinCall(geoCallIndex);
-
-        if (transforms.IsGood()) {
-            auto meshToWorld = Combine(transforms.GetMeshToModel(geoCall._transformMarker), modelToWorld);
-            auto trans = Techniques::MakeLocalTransform(meshToWorld, ExtractTranslation(context._parserContext->GetProjectionDesc()._cameraToWorld));
-            localTransformBuffer.Update(*context._context, &trans, sizeof(trans));
-        }
-
-        auto cm = FindIf(_skinnedMeshes, [=](const PimplWithSkinning::SkinnedMesh& mesh) { return mesh._id == geoCall._geoId; });
-        assert(cm != _skinnedMeshes.end());
-        auto meshIndex = std::distance(_skinnedMeshes.cbegin(), cm);
-
-        auto result = cm->_skinnedTechniqueInterface;
+        auto& cm = _skinnedMeshes[meshIndex];
+        auto result = cm._skinnedTechniqueInterface;
 
         auto& devContext = *context._context;
-        devContext.Bind(_indexBuffer, Metal::NativeFormat::Enum(cm->_indexFormat), cm->_ibOffset);
+        devContext.Bind(_indexBuffer, Metal::NativeFormat::Enum(cm._indexFormat), cm._ibOffset);
 
         auto animGeo = SkinnedMesh::VertexStreams::AnimatedGeo;
-        UINT strides[] = { cm->_extraVbStride[animGeo], cm->_vertexStrides[0], cm->_vertexStrides[1], cm->_vertexStrides[2] };
-        UINT offsets[] = { cm->_extraVbOffset[animGeo], cm->_vbOffsets[0], cm->_vbOffsets[1], cm->_vbOffsets[2] };
+        UINT strides[] = { cm._extraVbStride[animGeo], cm._vertexStrides[0], cm._vertexStrides[1], cm._vertexStrides[2] };
+        UINT offsets[] = { cm._extraVbOffset[animGeo], cm._vbOffsets[0], cm._vbOffsets[1], cm._vbOffsets[2] };
         ID3D::Buffer* underlyingVBs[] = { _vertexBuffer.GetUnderlying(), _vertexBuffer.GetUnderlying(), _vertexBuffer.GetUnderlying(), _vertexBuffer.GetUnderlying() };
         static_assert(dimof(underlyingVBs) == (MaxVertexStreams+1), "underlyingVBs doesn't match MaxVertexStreams");
 
@@ -831,7 +797,93 @@ namespace RenderCore { namespace Assets
         return result;
     }
 
-    void ModelRenderer::Pimpl::ApplyBoundUnforms(
+    ModelDrawPacket ModelRenderer::Pimpl::MakeDrawPacket(
+        unsigned meshIndex,
+        const ModelCommandStream::GeoCall& geoInst,
+        const DrawCallDesc& drawCall,
+        const DrawCallResources& res)
+    {
+        ModelDrawPacket result;
+        result._meshIndex = meshIndex;
+        result._transformMarker = geoInst._transformMarker;
+        result._shaderName = res._shaderName;
+        result._geoParamBox = res._geoParamBox;
+        result._materialParamBox = res._materialParamBox;
+        result._renderStateSet = res._renderStateSet;
+        result._textureSet = res._textureSet;
+        result._constantBuffer = res._constantBuffer;
+        result._topology = unsigned(drawCall._topology);
+        result._indexCount = drawCall._indexCount;
+        result._firstIndex = drawCall._firstIndex;
+        result._firstVertex = drawCall._firstVertex;
+        return result;
+    }
+
+        //  Sink for ExecuteDrawPackets that writes to the device context
+    class ModelRenderer::PimplWithSkinning::DeviceSink
+    {
+    public:
+        const ModelRendererContext*     _context;
+        const SharedStateSet*           _sharedStateSet;
+        PimplWithSkinning*              _pimpl;
+        ModelRenderingBox*              _box;
+        const Metal::ConstantBuffer**   _pkts;
+        const MeshToModel*              _transforms;
+        const Float4x4*                 _modelToWorld;
+        PreparedAnimation*              _preparedAnimation;
+        bool                            _skinned;
+
+        SharedTechniqueInterface BindMesh(const ModelDrawPacket& packet)
+        {
+            if (_skinned)
+                return _pimpl->BindSkinnedMesh(*_context, packet._meshIndex, _preparedAnimation);
+            return _pimpl->BindMesh(*_context, packet._meshIndex);
+        }
+
+        void SetTransform(const ModelDrawPacket& packet)
+        {
+            auto meshToWorld = Combine(_transforms->GetMeshToModel(packet._transformMarker), *_modelToWorld);
+            auto trans = Techniques::MakeLocalTransform(meshToWorld, ExtractTranslation(_context->_parserContext->GetProjectionDesc()._cameraToWorld));
+            _box->_localTransformBuffer.Update(*_context->_context, &trans, sizeof(trans));
+        }
+
+        void BeginRenderState(const ModelDrawPacket& packet)
+        {
+            _sharedStateSet->BeginRenderState(*_context, packet._renderStateSet);
+        }
+
+        Metal::BoundUniforms* BeginVariation(const ModelDrawPacket& packet, SharedTechniqueInterface techniqueInterface)
+        {
+            return _sharedStateSet->BeginVariation(
+                *_context, packet._shaderName, techniqueInterface, packet._geoParamBox, packet._materialParamBox);
+        }
+
+        bool ApplyUniforms(const ModelDrawPacket& packet, Metal::BoundUniforms& boundUniforms)
+        {
+            return _pimpl->ApplyBoundUnforms(*_context, boundUniforms, packet._textureSet, packet._constantBuffer, _pkts);
+        }
+
+        void BindTopology(const ModelDrawPacket& packet)
+        {
+            _context->_context->Bind(Metal::Topology::Enum(packet._topology));
+        }
+
+        void Draw(const ModelDrawPacket& packet, unsigned drawCallIndex)
+        {
+            auto& devContext = *_context->_context;
+
+                // -- this draw call index stuff is only required in some cases --
+                //      we need some way to customise the model rendering method for different purposes
+            devContext.Bind(Techniques::CommonResources()._dssReadWriteWriteStencil, 1+drawCallIndex);  // write stencil buffer with draw index
+            unsigned drawCallIndexB[4] = { drawCallIndex, 0, 0, 0 };
+            _box->_drawCallIndexBuffer.Update(devContext, drawCallIndexB, sizeof(drawCallIndexB));
+                // -------------
+
+            devContext.DrawIndexed(packet._indexCount, packet._firstIndex, packet._firstVertex);
+        }
+    };
+
+    bool ModelRenderer::Pimpl::ApplyBoundUnforms(
         const ModelRendererContext&     context,
         Metal::BoundUniforms&           boundUniforms,
         unsigned                        resourcesIndex,
@@ -842,13 +894,22 @@ namespace RenderCore { namespace Assets
         assert(_texturesPerMaterial <= dimof(srvs));
         for (unsigned c=0; c<_texturesPerMaterial; c++) {
             auto* t = _boundTextures[resourcesIndex * _texturesPerMaterial + c];
-            srvs[c] = t?(&t->GetShaderResource()):nullptr;
+            srvs[c] = nullptr;
+            if (!t) continue;
+
+                //  Textures are still streaming in for the first few frames after a model
+                //  is loaded. Skip draw calls using pending textures, rather than throwing
+                //  and abandoning the rest of the model. Invalid textures still throw.
+            auto state = t->TryGetShaderResource(srvs[c]);
+            if (state == ::Assets::AssetState::Pending) return false;
+            if (state == ::Assets::AssetState::Invalid) t->GetShaderResource();
         }
         cbs[1] = &_constantBuffers[constantsIndex];
         assert(cbs[1] && cbs[1]->GetUnderlying());
         boundUniforms.Apply(
             *context._context, context._parserContext->GetGlobalUniformsStream(),
             RenderCore::Metal::UniformsStream(nullptr, cbs, 2, srvs, _texturesPerMaterial));
+        return true;
     }
 
     auto ModelRenderer::Pimpl::BuildMesh(
@@ -1025,13 +1086,7 @@ namespace RenderCore { namespace Assets
     {
         auto& box = Techniques::FindCachedBox<ModelRenderingBox>(ModelRenderingBox::Desc());
         const Metal::ConstantBuffer* pkts[] = { &box._localTransformBuffer, nullptr };
-
-        unsigned currTextureSet = ~unsigned(0x0), currCB = ~unsigned(0x0), currGeoCall = ~unsigned(0x0);
-        SharedTechniqueInterface currTechniqueInterface = SharedTechniqueInterface::Invalid;
-        Metal::BoundUniforms* currUniforms = nullptr;
         auto& devContext = *context._context;
-        auto& scaffold = *_pimpl->_scaffold;
-        auto& cmdStream = scaffold.CommandStream();
 
         if (!transforms.IsGood()) {
             Techniques::LocalTransformConstants trans;
@@ -1044,94 +1099,21 @@ namespace RenderCore { namespace Assets
         CATCH_ASSETS_BEGIN
 
                 // skinned and unskinned geometry are almost the same, except for
-                // "BeginGeoCall" / "BeginSkinCall". Never the less, we need to split
-                // them into separate loops
+                // the way the mesh is bound. Never the less, we need to split
+                // them into separate passes
 
-                //////////// Render un-skinned geometry ////////////
+            devContext.BindGS(MakeResourceList(box._drawCallIndexBuffer));
 
-            Metal::ConstantBuffer drawCallIndexBuffer(nullptr, sizeof(unsigned)*4);
-            devContext.BindGS(MakeResourceList(drawCallIndexBuffer));
+            PimplWithSkinning::DeviceSink sink { 
+                &context, &sharedStateSet, _pimpl.get(), &box, pkts,
+                &transforms, &modelToWorld, preparedAnimation, false };
 
-            unsigned drawCallIndex = 0;
-            for (auto md=_pimpl->_drawCalls.cbegin(); md!=_pimpl->_drawCalls.cend(); ++md, ++drawCallIndex) {
-
-                if (md->first != currGeoCall) {
-                    currTechniqueInterface = _pimpl->BeginGeoCall(
-                        context, box._localTransformBuffer, transforms, modelToWorld, md->first);
-                    currGeoCall = md->first;
-                }
-
-                auto* boundUniforms = _pimpl->BeginVariation(context, sharedStateSet, drawCallIndex, currTechniqueInterface);
-                const auto& drawCallRes = _pimpl->_drawCallRes[drawCallIndex];
-
-                if (    boundUniforms != currUniforms 
-                    ||  drawCallRes._textureSet != currTextureSet 
-                    ||  drawCallRes._constantBuffer != currCB) {
-
-                    if (boundUniforms) {
-                        _pimpl->ApplyBoundUnforms(
-                            context, *boundUniforms, drawCallRes._textureSet, drawCallRes._constantBuffer, pkts);
-                    }
-
-                    currTextureSet = drawCallRes._textureSet; currCB = drawCallRes._constantBuffer;
-                    currUniforms = boundUniforms;
-                }
-            
-                const auto& d = md->second;
-                devContext.Bind(Metal::Topology::Enum(d._topology));
+            auto unskinnedCount = (unsigned)_pimpl->_drawCalls.size();
+            auto* packets = AsPointer(_pimpl->_drawPackets.cbegin());
+            ExecuteDrawPackets(sink, packets, packets + unskinnedCount, 0, transforms.IsGood());
 
-                    // -- this draw call index stuff is only required in some cases --
-                    //      we need some way to customise the model rendering method for different purposes
-                devContext.Bind(Techniques::CommonResources()._dssReadWriteWriteStencil, 1+drawCallIndex);  // write stencil buffer with draw index
-                unsigned drawCallIndexB[4] = { drawCallIndex, 0, 0, 0 };
-                drawCallIndexBuffer.Update(devContext, drawCallIndexB, sizeof(drawCallIndexB));
-                    // -------------
-
-                devContext.DrawIndexed(d._indexCount, d._firstIndex, d._firstVertex);
-            }
-
-
-                //////////// Render skinned geometry ////////////
-
-            currGeoCall = ~unsigned(0x0);
-            for (auto md=_pimpl->_skinnedDrawCalls.cbegin(); 
-                md!=_pimpl->_skinnedDrawCalls.cend(); ++md, ++drawCallIndex) {
-
-                if (md->first != currGeoCall) {
-                    currTechniqueInterface = _pimpl->BeginSkinCall(
-                        context, box._localTransformBuffer, transforms, modelToWorld, md->first, 
-                        preparedAnimation);
-                    currGeoCall = md->first;
-                }
-
-                auto* boundUniforms = _pimpl->BeginVariation(context, sharedStateSet, drawCallIndex, currTechniqueInterface);
-                const auto& drawCallRes = _pimpl->_drawCallRes[drawCallIndex];
-
-                if (    boundUniforms != currUniforms 
-                    ||  drawCallRes._textureSet != currTextureSet 
-                    ||  drawCallRes._constantBuffer != currCB) {
-
-                    if (boundUniforms) {
-                        _pimpl->ApplyBoundUnforms(
-                            context, *boundUniforms, drawCallRes._textureSet, drawCallRes._constantBuffer, pkts);
-                    }
-
-                    currTextureSet = drawCallRes._textureSet; currCB = drawCallRes._constantBuffer;
-                    currUniforms = boundUniforms;
-                }
-            
-                const auto& d = md->second;
-                devContext.Bind(Metal::Topology::Enum(d._topology));  // do we really need to set the topology every time?
-
-                    // -- this draw call index stuff is only required in some cases --
-                    //      we need some way to customise the model rendering method for different purposes
-                devContext.Bind(Techniques::CommonResources()._dssReadWriteWriteStencil, 1+drawCallIndex);  // write stencil buffer with draw index
-                unsigned drawCallIndexB[4] = { drawCallIndex, 0, 0, 0 };
-                drawCallIndexBuffer.Update(devContext, drawCallIndexB, sizeof(drawCallIndexB));
-                    // -------------
-
-                devContext.DrawIndexed(d._indexCount, d._firstIndex, d._firstVertex);
-            }
+            sink._skinned = true;
+            ExecuteDrawPackets(sink, packets + unskinnedCount, AsPointer(_pimpl->_drawPackets.cend()), unskinnedCount, transforms.IsGood());
 
         CATCH_ASSETS_END(*context._parserContext)
     }
@@ -1176,12 +1158,8 @@ namespace RenderCore { namespace Assets
             auto matParamIndex = drawCallRes._materialParamBox;
             auto shaderNameIndex = drawCallRes._shaderName;
 
-            auto& cmdStream = _pimpl->_scaffold->CommandStream();
-            auto& geoCall = cmdStream.GetGeoCall(md->first);
-            auto mesh = FindIf(
-                _pimpl->_meshes, [=](const Pimpl::Mesh& mesh) 
-                { return mesh._id == geoCall._geoId; });
-            assert(mesh != _pimpl->_meshes.end());
+            const auto& packet = _pimpl->_drawPackets[drawCallIndex];
+            auto mesh = _pimpl->_meshes.cbegin() + packet._meshIndex;
 
             auto step = unsigned(drawCallRes._delayStep);
 
@@ -1190,7 +1168,7 @@ namespace RenderCore { namespace Assets
             entry._renderer = this;
             if (transforms.IsGood()) {
                 auto trans = Combine(
-                    transforms.GetMeshToModel(geoCall._transformMarker), 
+                    transforms.GetMeshToModel(packet._transformMarker), 
                     modelToWorld);
                 entry._meshToWorld = (unsigned)dest._transforms.size();
                 dest._transforms.push_back(trans);
@@ -1217,12 +1195,8 @@ namespace RenderCore { namespace Assets
             auto matParamIndex = drawCallRes._materialParamBox;
             auto shaderNameIndex = drawCallRes._shaderName;
 
-            auto& cmdStream = _pimpl->_scaffold->CommandStream();
-            auto& geoCall = cmdStream.GetSkinCall(md->first);
-            auto mesh = FindIf(
-                _pimpl->_skinnedMeshes, 
-                [=](const Pimpl::Mesh& mesh) { return mesh._id == geoCall._geoId; });
-            assert(mesh != _pimpl->_skinnedMeshes.end());
+            const auto& packet = _pimpl->_drawPackets[drawCallIndex];
+            auto mesh = _pimpl->_skinnedMeshes.cbegin() + packet._meshIndex;
 
             auto step = unsigned(drawCallRes._delayStep);
 
@@ -1231,7 +1205,7 @@ namespace RenderCore { namespace Assets
             entry._renderer = this;
             if (transforms.IsGood()) {
                 auto trans = Combine(
-                    transforms.GetMeshToModel(geoCall._transformMarker), 
+                    transforms.GetMeshToModel(packet._transformMarker), 
                     modelToWorld);
                 entry._meshToWorld = (unsigned)dest._transforms.size();
                 dest._transforms.push_back(trans);
@@ -1381,9 +1355,12 @@ namespace RenderCore { namespace Assets
                 //  Sometimes the same render call may be rendered in several different locations. In these cases,
                 //  we can reduce the API thrashing to the minimum by avoiding re-setting resources and constants
             if (boundUniforms && (textureSet != currentTextureSet || constantBufferIndex != currentConstantBufferIndex)) {
-                renderer._pimpl->ApplyBoundUnforms(
+                if (!renderer._pimpl->ApplyBoundUnforms(
                     context, *boundUniforms,
-                    textureSet, constantBufferIndex, pkts);
+                    textureSet, constantBufferIndex, pkts)) {
+                    currentTextureSet = ~unsigned(0x0);
+                    continue;
+                }
 
                 currentTextureSet = textureSet;
                 currentConstantBufferIndex = constantBufferIndex;
@@ -32,6 +32,7 @@ namespace RenderCore { namespace Assets
         auto& asyncMan = ::Assets::Services::GetAsyncMan();
         asyncMan.GetIntermediateCompilers().AddCompiler(
             CompiledShaderByteCode::CompileProcessType, shaderSource);
+        asyncMan.Add(shaderSource->CreateRecompileScheduler(asyncMan.GetIntermediateStore()));
 
         if (device) {
             BufferUploads::AttachLibrary(ConsoleRig::GlobalServices::GetInstance());
@@ -0,0 +1,529 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ShaderIncludeGraph.h"
+#include "../../Assets/Assets.h"
+#include "../../Assets/AssetUtils.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../Utility/Streams/FileUtils.h"
+#include "../../Utility/Streams/PathUtils.h"
+#include "../../Utility/Streams/FileSystemMonitor.h"
+#include "../../Utility/Threading/Mutex.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Utility/StringFormat.h"
+#include "../../Utility/PtrUtils.h"
+#include <algorithm>
+
+namespace RenderCore { namespace Assets
+{
+    using ::Assets::ResChar;
+
+    static uint64 MakeFileKey(StringSection<ResChar> filename)
+    {
+            // Filenames are compared case-insensitively, and with simplified paths, so that
+            // the names reported by the compiler match names we resolve here
+        ResChar buffer[MaxPath];
+        SplitPath<ResChar>(filename).Simplify().Rebuild(buffer);
+        for (ResChar* c=buffer; *c; ++c) {
+            if (*c == '\\') *c = '/';
+            else *c = XlToLower(*c);
+        }
+        return Hash64(buffer, XlStringEnd(buffer));
+    }
+
+    static void FindIncludeDirectives(StringSection<char> source, std::vector<std::string>& result)
+    {
+            //  Look for #include directives at the start of lines. We skip over comments, but
+            //  we don't attempt to evaluate #if blocks -- so includes in disabled blocks are
+            //  also returned.
+        auto i = source.begin();
+        bool lineStart = true;
+        while (i < source.end()) {
+            if (*i == '/' && (i+1) < source.end() && i[1] == '/') {
+                while (i < source.end() && *i != '\n') ++i;
+                continue;
+            }
+            if (*i == '/' && (i+1) < source.end() && i[1] == '*') {
+                i += 2;
+                while ((i+1) < source.end() && !(i[0] == '*' && i[1] == '/')) ++i;
+                i = std::min(i+2, source.end());
+                continue;
+            }
+            if (*i == '\n') { lineStart = true; ++i; continue; }
+            if (*i == ' ' || *i == '\t' || *i == '\r') { ++i; continue; }
+
+            if (lineStart && *i == '#') {
+                ++i;
+                while (i < source.end() && (*i == ' ' || *i == '\t')) ++i;
+                const char includeKeyword[] = "include";
+                auto keywordLength = dimof(includeKeyword)-1;
+                if (size_t(source.end() - i) > keywordLength && !XlComparePrefix(i, includeKeyword, keywordLength)) {
+                    i += keywordLength;
+                    while (i < source.end() && (*i == ' ' || *i == '\t')) ++i;
+                    if (i < source.end() && (*i == '"' || *i == '<')) {
+                        char terminator = (*i == '"') ? '"' : '>';
+                        auto nameStart = ++i;
+                        while (i < source.end() && *i != terminator && *i != '\n') ++i;
+                        if (i < source.end() && *i == terminator)
+                            result.push_back(std::string(nameStart, i));
+                    }
+                }
+            }
+
+                // skip to the end of the line (but we still need to look for comments)
+            lineStart = false;
+            while (i < source.end() && *i != '\n' && *i != '/') ++i;
+            if (i < source.end() && *i == '/' && !((i+1) < source.end() && (i[1] == '/' || i[1] == '*'))) ++i;
+        }
+    }
+
+    static ShaderIncludeLoader MakeGraphFileSystemLoader()
+    {
+            //  Search relative to the including file first, and then relative to the
+            //  asset root. The compiler will also search relative to the directories of
+            //  other files included previously; but those rules depend on the root file,
+            //  and can't be represented in a shared graph. Any extra files found that way
+            //  get their own nodes in RegisterDependencies.
+        std::string assetRoot;
+        if (&ConsoleRig::GlobalServices::GetInstance()) {
+            auto& serv = ConsoleRig::GlobalServices::GetCrossModule()._services;
+            assetRoot = serv.CallDefault(ConstHash64<'asse', 'troo', 't'>::Value, std::string());
+        }
+
+        return [assetRoot](
+            std::string& contents, ::Assets::DependentFileState& resolvedFile,
+            StringSection<ResChar> requestedName, StringSection<ResChar> includingFile) -> bool
+        {
+            std::string searchDirectories[2];
+            unsigned searchDirectoryCount = 0;
+            if (!includingFile.Empty()) {
+                searchDirectories[searchDirectoryCount++] = FileNameSplitter<ResChar>(includingFile).DriveAndPath().AsString();
+                searchDirectories[searchDirectoryCount++] = assetRoot;
+            } else
+                searchDirectories[searchDirectoryCount++] = std::string();
+
+            ResChar buffer[MaxPath], path[MaxPath];
+            for (unsigned c=0; c<searchDirectoryCount; ++c) {
+                const auto& dir = searchDirectories[c];
+                XlCopyString(buffer, dir.c_str());
+                if (!dir.empty()) XlCatString(buffer, dimof(buffer), "/");
+                XlCatString(buffer, dimof(buffer), requestedName.AsString().c_str());
+                SplitPath<ResChar>(buffer).Simplify().Rebuild(path);
+
+                if (!DoesFileExist(path)) continue;
+
+                size_t size = 0;
+                auto file = LoadFileAsMemoryBlock(path, &size);
+
+                contents = std::string((const char*)file.get(), (const char*)PtrAdd(file.get(), size));
+                resolvedFile._filename = path;
+                return true;
+            }
+            return false;
+        };
+    }
+
+        ////////////////////////////////////////////////////////////
+
+    class ShaderIncludeGraph::Pimpl : public std::enable_shared_from_this<ShaderIncludeGraph::Pimpl>
+    {
+    public:
+        class Node
+        {
+        public:
+            std::basic_string<ResChar> _filename;
+            std::vector<uint64> _includes;
+            std::vector<uint64> _includedBy;
+            bool _scanned;
+            ::Assets::DepValPtr _depVal;
+            std::shared_ptr<Utility::OnChangeCallback> _monitor;
+
+            Node() : _scanned(false) {}
+        };
+
+        class VariantRecord
+        {
+        public:
+            Variant _variant;
+            uint64 _rootKey;
+            std::weak_ptr<::Assets::DependencyValidation> _depVal;
+        };
+
+        std::vector<std::pair<uint64, std::unique_ptr<Node>>> _nodes;
+        std::vector<std::pair<uint64, VariantRecord>> _variants;
+        std::vector<uint64> _pendingRecompiles;
+        uint64 _requestCounter;
+        Metrics _metrics;
+        mutable Threading::Mutex _lock;
+
+        ShaderIncludeLoader _loader;
+        bool _monitorFiles;
+
+        Node& GetNode(StringSection<ResChar> filename, uint64* key = nullptr, const std::string* contents = nullptr);
+        Node* FindNode(uint64 key);
+        void Scan(uint64 key, Node& node, const std::string* contents);
+        void CollectClosure(uint64 key, std::vector<uint64>& result);
+        void CollectDependents(uint64 key, std::vector<uint64>& result);
+        void OnFileChange(StringSection<ResChar> filename);
+
+        class FileMonitor;
+
+        Pimpl() : _requestCounter(0), _monitorFiles(false) { XlZeroMemory(_metrics); }
+    };
+
+    class ShaderIncludeGraph::Pimpl::FileMonitor : public Utility::OnChangeCallback
+    {
+    public:
+        void OnChange()
+        {
+            auto graph = _graph.lock();
+            if (graph) graph->OnFileChange(MakeStringSection(_filename));
+        }
+
+        FileMonitor(std::weak_ptr<Pimpl> graph, const std::basic_string<ResChar>& filename)
+        : _graph(std::move(graph)), _filename(filename) {}
+    private:
+        std::weak_ptr<Pimpl> _graph;
+        std::basic_string<ResChar> _filename;
+    };
+
+    auto ShaderIncludeGraph::Pimpl::FindNode(uint64 key) -> Node*
+    {
+        auto i = LowerBound(_nodes, key);
+        if (i != _nodes.end() && i->first == key) return i->second.get();
+        return nullptr;
+    }
+
+    auto ShaderIncludeGraph::Pimpl::GetNode(StringSection<ResChar> filename, uint64* keyResult, const std::string* contents) -> Node&
+    {
+        auto key = MakeFileKey(filename);
+        if (keyResult) *keyResult = key;
+
+        auto i = LowerBound(_nodes, key);
+        if (i == _nodes.end() || i->first != key) {
+            auto newNode = std::make_unique<Node>();
+            newNode->_filename = filename.AsString();
+            newNode->_depVal = std::make_shared<::Assets::DependencyValidation>();
+            if (_monitorFiles) {
+                newNode->_monitor = std::make_shared<FileMonitor>(shared_from_this(), newNode->_filename);
+                ::Assets::RegisterFileDependency(newNode->_monitor, filename);
+            }
+            i = _nodes.insert(i, std::make_pair(key, std::move(newNode)));
+            ++_metrics._fileCount;
+        }
+
+        auto& node = *i->second;
+        if (!node._scanned) Scan(key, node, contents);
+        return node;
+    }
+
+    void ShaderIncludeGraph::Pimpl::Scan(uint64 key, Node& node, const std::string* contents)
+    {
+            // mark as scanned first, so include cycles terminate
+        node._scanned = true;
+        ++_metrics._fileScans;
+
+        std::string loadedContents;
+        if (!contents) {
+            ::Assets::DependentFileState resolved;
+            if (_loader(loadedContents, resolved, MakeStringSection(node._filename), StringSection<ResChar>()))
+                contents = &loadedContents;
+        }
+
+            // disconnect from the previous version of the include list
+        for (auto i:node._includes) {
+            auto* child = FindNode(i);
+            if (!child) continue;
+            auto r = std::find(child->_includedBy.begin(), child->_includedBy.end(), key);
+            if (r != child->_includedBy.end()) child->_includedBy.erase(r);
+        }
+        node._includes.clear();
+        if (!contents) return;
+
+        std::vector<std::string> includes;
+        FindIncludeDirectives(MakeStringSection(*contents), includes);
+
+        for (const auto& inc:includes) {
+            std::string includeContents;
+            ::Assets::DependentFileState resolved;
+            if (!_loader(includeContents, resolved, MakeStringSection(inc), MakeStringSection(node._filename)))
+                continue;
+
+            auto childKey = MakeFileKey(MakeStringSection(resolved._filename));
+            if (std::find(node._includes.begin(), node._includes.end(), childKey) != node._includes.end())
+                continue;
+
+                //  We already have the contents of the included file, so scan it now
+                //  (if it's new) rather than loading it again later
+            auto* child = &GetNode(MakeStringSection(resolved._filename), nullptr, &includeContents);
+
+            node._includes.push_back(childKey);
+            if (std::find(child->_includedBy.begin(), child->_includedBy.end(), key) == child->_includedBy.end())
+                child->_includedBy.push_back(key);
+        }
+    }
+
+    void ShaderIncludeGraph::Pimpl::CollectClosure(uint64 key, std::vector<uint64>& result)
+    {
+        std::vector<uint64> stack;
+        stack.push_back(key);
+        while (!stack.empty()) {
+            auto k = stack.back(); stack.pop_back();
+            auto existing = std::lower_bound(result.begin(), result.end(), k);
+            if (existing != result.end() && *existing == k) continue;
+            result.insert(existing, k);
+
+            auto* node = FindNode(k);
+            if (!node) continue;
+            if (!node->_scanned) Scan(k, *node, nullptr);
+            stack.insert(stack.end(), node->_includes.begin(), node->_includes.end());
+        }
+    }
+
+    void ShaderIncludeGraph::Pimpl::CollectDependents(uint64 key, std::vector<uint64>& result)
+    {
+        std::vector<uint64> stack;
+        stack.push_back(key);
+        while (!stack.empty()) {
+            auto k = stack.back(); stack.pop_back();
+            auto existing = std::lower_bound(result.begin(), result.end(), k);
+            if (existing != result.end() && *existing == k) continue;
+            result.insert(existing, k);
+
+            auto* node = FindNode(k);
+            if (node) stack.insert(stack.end(), node->_includedBy.begin(), node->_includedBy.end());
+        }
+    }
+
+    void ShaderIncludeGraph::Pimpl::OnFileChange(StringSection<ResChar> filename)
+    {
+        std::vector<::Assets::DepValPtr> toNotify;
+        {
+            ScopedLock(_lock);
+            auto key = MakeFileKey(filename);
+            auto* node = FindNode(key);
+            if (!node) return;
+
+                //  The include list for this file will be rebuilt the next time it's needed.
+                //  We keep the old edges until then, because the reverse edges to the files
+                //  it includes are still required for changes to those files.
+            node->_scanned = false;
+            ++_metrics._fileChanges;
+
+            std::vector<uint64> affected;
+            CollectDependents(key, affected);
+
+            for (auto a:affected) {
+                auto* n = FindNode(a);
+                if (n) toNotify.push_back(n->_depVal);
+            }
+
+                //  Queue the variants compiled from an affected root file that are still in use.
+                //  Variants whose owners have expired are dropped here; if they are requested 
+                //  again, they will be registered again.
+            std::vector<uint64> expired;
+            for (const auto& v:_variants) {
+                if (!std::binary_search(affected.begin(), affected.end(), v.second._rootKey)) continue;
+                if (v.second._depVal.expired()) {
+                    expired.push_back(v.first);
+                    continue;
+                }
+                auto p = std::lower_bound(_pendingRecompiles.begin(), _pendingRecompiles.end(), v.first);
+                if (p != _pendingRecompiles.end() && *p == v.first) continue;
+                _pendingRecompiles.insert(p, v.first);
+                ++_metrics._queuedRecompiles;
+            }
+
+            if (!expired.empty()) {
+                    // (both lists are sorted by id)
+                _variants.erase(
+                    std::remove_if(
+                        _variants.begin(), _variants.end(),
+                        [&expired](const std::pair<uint64, VariantRecord>& v)
+                        { return std::binary_search(expired.begin(), expired.end(), v.first); }),
+                    _variants.end());
+                _pendingRecompiles.erase(
+                    std::remove_if(
+                        _pendingRecompiles.begin(), _pendingRecompiles.end(),
+                        [&expired](uint64 p) { return std::binary_search(expired.begin(), expired.end(), p); }),
+                    _pendingRecompiles.end());
+                _metrics._droppedVariants += (unsigned)expired.size();
+            }
+        }
+
+            // notify outside of the lock, because callbacks can come back into this object
+        for (const auto& d:toNotify) d->OnChange();
+    }
+
+        ////////////////////////////////////////////////////////////
+
+    ::Assets::DepValPtr ShaderIncludeGraph::GetDependencyValidation(StringSection<ResChar> filename)
+    {
+        ScopedLock(_pimpl->_lock);
+        return _pimpl->GetNode(filename)._depVal;
+    }
+
+    std::vector<std::basic_string<ResChar>> ShaderIncludeGraph::GetIncludeClosure(StringSection<ResChar> filename)
+    {
+        ScopedLock(_pimpl->_lock);
+        uint64 rootKey;
+        _pimpl->GetNode(filename, &rootKey);
+        std::vector<uint64> closure;
+        _pimpl->CollectClosure(rootKey, closure);
+
+        std::vector<std::basic_string<ResChar>> result;
+        result.reserve(closure.size());
+        for (auto c:closure) {
+            auto* node = _pimpl->FindNode(c);
+            if (node) result.push_back(node->_filename);
+        }
+        return result;
+    }
+
+    void ShaderIncludeGraph::RegisterDependencies(
+        const ::Assets::DepValPtr& depVal,
+        StringSection<ResChar> rootFile,
+        IteratorRange<const ::Assets::DependentFileState*> compileDeps)
+    {
+        std::vector<::Assets::DepValPtr> dependencies;
+        {
+            ScopedLock(_pimpl->_lock);
+            uint64 rootKey;
+            dependencies.push_back(_pimpl->GetNode(rootFile, &rootKey)._depVal);
+
+            std::vector<uint64> closure;
+            _pimpl->CollectClosure(rootKey, closure);
+            for (const auto& d:compileDeps) {
+                auto key = MakeFileKey(MakeStringSection(d._filename));
+                if (std::binary_search(closure.begin(), closure.end(), key)) continue;
+                dependencies.push_back(_pimpl->GetNode(MakeStringSection(d._filename))._depVal);
+            }
+        }
+
+        for (const auto& d:dependencies)
+            ::Assets::RegisterAssetDependency(depVal, d);
+    }
+
+    uint64 ShaderIncludeGraph::RegisterVariant(
+        StringSection<ResChar> initializer,
+        const ShaderService::ResId& res, StringSection<ResChar> definesTable,
+        const ::Assets::DepValPtr& depVal, bool isRequest)
+    {
+        auto variantId = HashCombine(
+            Hash64(StringMeld<MaxPath+128, ResChar>() << res._filename << ":" << res._entryPoint << ":" << res._shaderModel),
+            Hash64(definesTable.begin(), definesTable.end()));
+
+        ScopedLock(_pimpl->_lock);
+        uint64 rootKey;
+        _pimpl->GetNode(MakeStringSection(res._filename), &rootKey);
+
+        auto i = LowerBound(_pimpl->_variants, variantId);
+        if (i == _pimpl->_variants.end() || i->first != variantId) {
+            Pimpl::VariantRecord newRecord;
+            newRecord._variant._initializer = initializer.AsString();
+            newRecord._variant._res = res;
+            newRecord._variant._definesTable = definesTable.AsString();
+            newRecord._variant._lastRequest = 0;
+            newRecord._variant._inUse = false;
+            newRecord._rootKey = rootKey;
+            i = _pimpl->_variants.insert(i, std::make_pair(variantId, std::move(newRecord)));
+        }
+
+        if (isRequest) i->second._variant._lastRequest = ++_pimpl->_requestCounter;
+            //  Background recompiles register with their own (short lived) validation object.
+            //  Don't let those replace the validation object of an asset that is still alive.
+        if (depVal && (isRequest || i->second._depVal.expired())) i->second._depVal = depVal;
+        return variantId;
+    }
+
+    auto ShaderIncludeGraph::FindDependentVariants(StringSection<ResChar> filename) -> std::vector<Variant>
+    {
+        std::vector<Variant> result;
+
+        ScopedLock(_pimpl->_lock);
+        auto* node = _pimpl->FindNode(MakeFileKey(filename));
+        if (!node) return result;
+
+        std::vector<uint64> affected;
+        _pimpl->CollectDependents(MakeFileKey(filename), affected);
+        for (const auto& v:_pimpl->_variants) {
+            if (!std::binary_search(affected.begin(), affected.end(), v.second._rootKey)) continue;
+            result.push_back(v.second._variant);
+            result.back()._inUse = !v.second._depVal.expired();
+        }
+        return result;
+    }
+
+    auto ShaderIncludeGraph::TakeRecompileBatch(unsigned maxCount) -> std::vector<Variant>
+    {
+        std::vector<Variant> result;
+
+        ScopedLock(_pimpl->_lock);
+        if (_pimpl->_pendingRecompiles.empty()) return result;
+
+            //  Variants can expire after they are queued. Those are dropped from the queue
+            //  (and from the graph) rather than compiled.
+        std::vector<std::pair<uint64, Variant>> pending;
+        pending.reserve(_pimpl->_pendingRecompiles.size());
+        for (auto p=_pimpl->_pendingRecompiles.begin(); p!=_pimpl->_pendingRecompiles.end();) {
+            auto i = LowerBound(_pimpl->_variants, *p);
+            if (i == _pimpl->_variants.end() || i->first != *p) {
+                p = _pimpl->_pendingRecompiles.erase(p);
+                continue;
+            }
+            if (i->second._depVal.expired()) {
+                _pimpl->_variants.erase(i);
+                ++_pimpl->_metrics._droppedVariants;
+                p = _pimpl->_pendingRecompiles.erase(p);
+                continue;
+            }
+            pending.push_back(std::make_pair(*p, i->second._variant));
+            pending.back().second._inUse = true;
+            ++p;
+        }
+
+            // most recently requested first
+        std::stable_sort(pending.begin(), pending.end(),
+            [](const std::pair<uint64, Variant>& lhs, const std::pair<uint64, Variant>& rhs)
+            { return lhs.second._lastRequest > rhs.second._lastRequest; });
+
+        auto count = std::min(size_t(maxCount), pending.size());
+        result.reserve(count);
+        for (size_t c=0; c<count; ++c) {
+            result.push_back(std::move(pending[c].second));
+            auto p = std::lower_bound(_pimpl->_pendingRecompiles.begin(), _pimpl->_pendingRecompiles.end(), pending[c].first);
+            _pimpl->_pendingRecompiles.erase(p);
+        }
+        return result;
+    }
+
+    unsigned ShaderIncludeGraph::GetPendingRecompileCount() const
+    {
+        ScopedLock(_pimpl->_lock);
+        return (unsigned)_pimpl->_pendingRecompiles.size();
+    }
+
+    void ShaderIncludeGraph::OnFileChange(StringSection<ResChar> filename)
+    {
+        _pimpl->OnFileChange(filename);
+    }
+
+    auto ShaderIncludeGraph::GetMetrics() const -> Metrics
+    {
+        ScopedLock(_pimpl->_lock);
+        return _pimpl->_metrics;
+    }
+
+    ShaderIncludeGraph::ShaderIncludeGraph(ShaderIncludeLoader loader)
+    {
+        _pimpl = std::make_shared<Pimpl>();
+        _pimpl->_monitorFiles = !loader;
+        _pimpl->_loader = loader ? std::move(loader) : MakeGraphFileSystemLoader();
+    }
+
+    ShaderIncludeGraph::~ShaderIncludeGraph() {}
+}}
+
@@ -0,0 +1,113 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "ShaderPreprocessor.h"
+#include "../ShaderService.h"
+#include "../../Assets/AssetsCore.h"
+#include "../../Utility/IteratorUtils.h"
+#include "../../Utility/StringUtils.h"
+#include "../../Core/Types.h"
+#include <vector>
+#include <memory>
+
+namespace RenderCore { namespace Assets
+{
+    /// <summary>Shared record of the #include relationships between shader source files</summary>
+    /// Each source file is read and scanned for #include directives once per version of
+    /// that file. Every file gets a single file system monitor and a single
+    /// DependencyValidation object (which is invalidated when the file, or anything it
+    /// includes, changes). Compiled shaders attach to those shared objects, rather than
+    /// monitoring every include file separately.
+    ///
+    /// Include scanning ignores #if blocks, so the graph is a conservative superset of
+    /// the includes the compiler actually sees.
+    ///
+    /// The graph also records the shader variants (entry point + defines table) that have
+    /// been compiled from each root file. Variants only hold weak references to their owners.
+    /// When a file changes, the dependent variants that are still in use are queued for 
+    /// recompile (most recently requested first, see TakeRecompileBatch()). Dependent variants
+    /// whose owners have expired are removed from the graph instead.
+    class ShaderIncludeGraph
+    {
+    public:
+        using ResChar = ::Assets::ResChar;
+
+        /// <summary>Validation object invalidated when this file, or anything it includes, changes</summary>
+        ::Assets::DepValPtr GetDependencyValidation(StringSection<ResChar> filename);
+
+        /// <summary>This file and every file it includes (directly or indirectly)</summary>
+        std::vector<std::basic_string<ResChar>> GetIncludeClosure(StringSection<ResChar> filename);
+
+        /// <summary>Attaches a compiled shader's dependencies to the given validation object</summary>
+        /// "compileDeps" are the files reported by the compiler. Any that aren't already
+        /// covered by the include closure of "rootFile" are attached individually.
+        void RegisterDependencies(
+            const ::Assets::DepValPtr& depVal,
+            StringSection<ResChar> rootFile,
+            IteratorRange<const ::Assets::DependentFileState*> compileDeps);
+
+        class Variant
+        {
+        public:
+            ::Assets::rstring _initializer;
+            ShaderService::ResId _res;
+            ::Assets::rstring _definesTable;
+            uint64 _lastRequest;
+            bool _inUse;
+        };
+
+        /// <summary>Records a variant compiled from a root file</summary>
+        /// "depVal" should be the validation object of the asset using the compiled code. While
+        /// it remains alive, the variant is considered in use; after it expires, the variant is
+        /// no longer recompiled eagerly. When "isRequest" is true, the variant is marked as the
+        /// most recently requested.
+        uint64 RegisterVariant(
+            StringSection<ResChar> initializer,
+            const ShaderService::ResId& res, StringSection<ResChar> definesTable,
+            const ::Assets::DepValPtr& depVal, bool isRequest = true);
+
+        /// <summary>Which variants depend on this file</summary>
+        std::vector<Variant> FindDependentVariants(StringSection<ResChar> filename);
+
+        /// <summary>Removes and returns variants that need to be recompiled after file changes</summary>
+        /// Variants are returned most recently requested first. Variants that have expired
+        /// since they were queued are skipped (and removed).
+        std::vector<Variant> TakeRecompileBatch(unsigned maxCount = ~0u);
+        unsigned GetPendingRecompileCount() const;
+
+        /// <summary>Processes a change to the given file</summary>
+        /// Normally called by the file system monitor; but can be called directly when
+        /// a file change must be processed immediately.
+        void OnFileChange(StringSection<ResChar> filename);
+
+        class Metrics
+        {
+        public:
+            unsigned _fileCount;
+            unsigned _fileScans;
+            unsigned _fileChanges;
+            unsigned _queuedRecompiles;
+            unsigned _droppedVariants;      ///< expired variants removed from the graph
+        };
+        Metrics GetMetrics() const;
+
+        /// <summary>Constructs a graph that reads from the file system</summary>
+        /// If "loader" is given, it's used to read source files instead of the file system
+        /// (and files are not monitored for changes). For the root file of a tree, the loader
+        /// is called with an empty "includingFile".
+        ShaderIncludeGraph(ShaderIncludeLoader loader = nullptr);
+        ~ShaderIncludeGraph();
+
+        ShaderIncludeGraph(const ShaderIncludeGraph&) = delete;
+        ShaderIncludeGraph& operator=(const ShaderIncludeGraph&) = delete;
+    protected:
+        class Pimpl;
+        std::shared_ptr<Pimpl> _pimpl;
+    };
+}}
+
@@ -0,0 +1,660 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ShaderPreprocessor.h"
+#include "../../Assets/IntermediateAssets.h"
+#include "../../Assets/ConfigFileContainer.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../Utility/Streams/FileUtils.h"
+#include "../../Utility/Streams/PathUtils.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include <algorithm>
+#include <memory>
+
+namespace RenderCore { namespace Assets
+{
+    using ::Assets::ResChar;
+
+        ////////////////////////////////////////////////////////////
+
+    static bool IsIdentifierStart(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+    static bool IsIdentifierChar(char c) { return IsIdentifierStart(c) || (c >= '0' && c <= '9'); }
+    static bool IsWhitespace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v'; }
+
+    static StringSection<char> Trim(StringSection<char> str)
+    {
+        auto b = str.begin(), e = str.end();
+        while (b < e && IsWhitespace(*b)) ++b;
+        while (e > b && IsWhitespace(*(e-1))) --e;
+        return MakeStringSection(b, e);
+    }
+
+    static std::string StripCommentsAndSplices(StringSection<char> input)
+    {
+            //  Remove line splices and comments, in the same order as the
+            //  translation phases of the C preprocessor. Comments become a
+            //  single space. String literals are copied verbatim.
+        std::string spliced;
+        spliced.reserve(input.Length());
+        for (auto i=input.begin(); i<input.end(); ++i) {
+            if (*i == '\\') {
+                auto n = i+1;
+                if (n < input.end() && *n == '\r') ++n;
+                if (n < input.end() && *n == '\n') { i = n; continue; }
+            }
+            spliced.push_back(*i);
+        }
+
+        std::string result;
+        result.reserve(spliced.size());
+        auto i = spliced.cbegin(), e = spliced.cend();
+        while (i < e) {
+            if (*i == '"') {
+                result.push_back(*i++);
+                while (i < e && *i != '"' && *i != '\n') {
+                    if (*i == '\\' && (i+1) < e) result.push_back(*i++);
+                    result.push_back(*i++);
+                }
+                if (i < e && *i == '"') result.push_back(*i++);
+            } else if (*i == '/' && (i+1) < e && *(i+1) == '/') {
+                while (i < e && *i != '\n') ++i;
+            } else if (*i == '/' && (i+1) < e && *(i+1) == '*') {
+                i += 2;
+                while ((i+1) < e && !(*i == '*' && *(i+1) == '/')) ++i;
+                i = ((i+1) < e) ? (i+2) : e;
+                result.push_back(' ');
+            } else {
+                result.push_back(*i++);
+            }
+        }
+        return result;
+    }
+
+        ////////////////////////////////////////////////////////////
+
+    class ShaderPreprocessor
+    {
+    public:
+        void ProcessFile(StringSection<char> source, StringSection<ResChar> filename, unsigned depth);
+        PreprocessedShaderSource Complete();
+
+        ShaderPreprocessor(StringSection<ResChar> definesTable, const ShaderIncludeLoader& includeLoader);
+    private:
+        class ExternalDefine
+        {
+        public:
+            std::string _name, _value;
+            bool _referencedByConditional;
+            bool _referencedByText;
+        };
+        std::vector<ExternalDefine> _externalDefines;       // sorted by name
+
+        class LocalMacro
+        {
+        public:
+            std::string _value;
+            bool _functionLike;
+            bool _undefined;
+        };
+        std::vector<std::pair<std::string, LocalMacro>> _localMacros;
+
+        class ConditionalBlock
+        {
+        public:
+            bool _parentActive, _active, _taken;
+        };
+        std::vector<ConditionalBlock> _conditionals;
+
+        std::string _output;
+        std::vector<::Assets::DependentFileState> _includeFiles;
+        const ShaderIncludeLoader* _includeLoader;
+        bool _isReliable;
+
+        static const unsigned MaxIncludeDepth = 64;
+        static const unsigned MaxMacroDepth = 16;
+
+        bool IsActive() const;
+        bool IsDefined(StringSection<char> name);
+        int64 EvaluateExpression(StringSection<char> expression, unsigned depth);
+        int64 EvaluateIdentifier(StringSection<char> name, unsigned depth);
+        void RecordReferences(StringSection<char> text);
+        void Emit(StringSection<char> line);
+        ExternalDefine* FindExternal(StringSection<char> name);
+        LocalMacro* FindLocal(StringSection<char> name);
+
+        class ExpressionParser;
+    };
+
+    auto ShaderPreprocessor::FindExternal(StringSection<char> name) -> ExternalDefine*
+    {
+        auto i = std::lower_bound(
+            _externalDefines.begin(), _externalDefines.end(), name,
+            [](const ExternalDefine& lhs, StringSection<char> rhs) { return XlCompareString(rhs, lhs._name.c_str()) > 0; });
+        if (i != _externalDefines.end() && XlEqString(name, i->_name)) return AsPointer(i);
+        return nullptr;
+    }
+
+    auto ShaderPreprocessor::FindLocal(StringSection<char> name) -> LocalMacro*
+    {
+        auto i = std::find_if(
+            _localMacros.begin(), _localMacros.end(),
+            [name](const std::pair<std::string, LocalMacro>& p) { return XlEqString(name, p.first); });
+        if (i != _localMacros.end()) return &i->second;
+        return nullptr;
+    }
+
+    bool ShaderPreprocessor::IsActive() const
+    {
+        return _conditionals.empty() || (_conditionals.back()._parentActive && _conditionals.back()._active);
+    }
+
+    bool ShaderPreprocessor::IsDefined(StringSection<char> name)
+    {
+        auto* local = FindLocal(name);
+        if (local) return !local->_undefined;
+        auto* external = FindExternal(name);
+        if (external) { external->_referencedByConditional = true; return true; }
+        return false;
+    }
+
+    void ShaderPreprocessor::RecordReferences(StringSection<char> text)
+    {
+            //  Any identifier in the output text that matches an external define
+            //  will be substituted by the real preprocessor. So the value of that
+            //  define becomes part of the output.
+        auto i = text.begin();
+        while (i < text.end()) {
+            if (IsIdentifierStart(*i)) {
+                auto start = i;
+                while (i < text.end() && IsIdentifierChar(*i)) ++i;
+                auto* external = FindExternal(MakeStringSection(start, i));
+                if (external) external->_referencedByText = true;
+            } else if (*i >= '0' && *i <= '9') {
+                while (i < text.end() && (IsIdentifierChar(*i) || *i == '.')) ++i;
+            } else
+                ++i;
+        }
+    }
+
+    void ShaderPreprocessor::Emit(StringSection<char> line)
+    {
+            // Normalise by collapsing whitespace runs, so indentation changes don't effect the hash
+        bool pendingSpace = false;
+        for (auto c:line) {
+            if (IsWhitespace(c)) { pendingSpace = true; continue; }
+            if (pendingSpace && !_output.empty() && _output.back() != '\n') _output.push_back(' ');
+            pendingSpace = false;
+            _output.push_back(c);
+        }
+        _output.push_back('\n');
+    }
+
+        ////////////////////////////////////////////////////////////
+
+    class ShaderPreprocessor::ExpressionParser
+    {
+    public:
+        int64 Parse();
+        ExpressionParser(StringSection<char> expression, ShaderPreprocessor& pp, unsigned depth);
+    private:
+        enum class TokenType { Number, Identifier, Operator, End };
+        class Token
+        {
+        public:
+            TokenType _type;
+            StringSection<char> _text;
+            int64 _value;
+        };
+        std::vector<Token> _tokens;
+        unsigned _pos;
+        ShaderPreprocessor* _pp;
+        unsigned _depth;
+
+        const Token& Peek() const { return _tokens[_pos]; }
+        bool IsOp(const char op[]) const { return Peek()._type == TokenType::Operator && XlEqString(Peek()._text, op); }
+        int64 ParseTernary();
+        int64 ParseBinary(unsigned minPrecedence);
+        int64 ParseUnary();
+        int64 ParsePrimary();
+        void Fail() { _pp->_isReliable = false; }
+    };
+
+    ShaderPreprocessor::ExpressionParser::ExpressionParser(StringSection<char> expression, ShaderPreprocessor& pp, unsigned depth)
+    : _pos(0), _pp(&pp), _depth(depth)
+    {
+        static const char* twoCharOps[] = { "&&", "||", "==", "!=", "<=", ">=", "<<", ">>" };
+        auto i = expression.begin();
+        while (i < expression.end()) {
+            if (IsWhitespace(*i) || *i == '\n') { ++i; continue; }
+            Token t;
+            auto start = i;
+            if (IsIdentifierStart(*i)) {
+                while (i < expression.end() && IsIdentifierChar(*i)) ++i;
+                t._type = TokenType::Identifier;
+                t._value = 0;
+            } else if (*i >= '0' && *i <= '9') {
+                t._type = TokenType::Number;
+                t._value = 0;
+                if (*i == '0' && (i+1) < expression.end() && (*(i+1) == 'x' || *(i+1) == 'X')) {
+                    i += 2;
+                    for (; i < expression.end(); ++i) {
+                        unsigned digit;
+                        if (*i >= '0' && *i <= '9') digit = *i - '0';
+                        else if (*i >= 'a' && *i <= 'f') digit = *i - 'a' + 10;
+                        else if (*i >= 'A' && *i <= 'F') digit = *i - 'A' + 10;
+                        else break;
+                        t._value = t._value * 16 + digit;
+                    }
+                } else {
+                    for (; i < expression.end() && *i >= '0' && *i <= '9'; ++i)
+                        t._value = t._value * 10 + (*i - '0');
+                }
+                    // integer suffixes
+                while (i < expression.end() && (*i == 'u' || *i == 'U' || *i == 'l' || *i == 'L')) ++i;
+                if (i < expression.end() && (IsIdentifierChar(*i) || *i == '.')) {
+                    Fail();     // floating point and other unusual literals aren't supported
+                    while (i < expression.end() && (IsIdentifierChar(*i) || *i == '.')) ++i;
+                }
+            } else {
+                t._type = TokenType::Operator;
+                t._value = 0;
+                ++i;
+                if (i < expression.end())
+                    for (auto op:twoCharOps)
+                        if (op[0] == *start && op[1] == *i) { ++i; break; }
+            }
+            t._text = MakeStringSection(start, i);
+            _tokens.push_back(t);
+        }
+        Token end; end._type = TokenType::End; end._value = 0;
+        _tokens.push_back(end);
+    }
+
+    int64 ShaderPreprocessor::ExpressionParser::Parse()
+    {
+        auto result = ParseTernary();
+        if (Peek()._type != TokenType::End) Fail();
+        return result;
+    }
+
+    int64 ShaderPreprocessor::ExpressionParser::ParseTernary()
+    {
+        auto cond = ParseBinary(1);
+        if (IsOp("?")) {
+            ++_pos;
+            auto a = ParseTernary();
+            if (!IsOp(":")) { Fail(); return 0; }
+            ++_pos;
+            auto b = ParseTernary();
+            return cond ? a : b;
+        }
+        return cond;
+    }
+
+    static unsigned BinaryPrecedence(StringSection<char> op)
+    {
+        static const std::pair<const char*, unsigned> table[] = {
+            {"||", 1}, {"&&", 2}, {"|", 3}, {"^", 4}, {"&", 5},
+            {"==", 6}, {"!=", 6}, {"<", 7}, {">", 7}, {"<=", 7}, {">=", 7},
+            {"<<", 8}, {">>", 8}, {"+", 9}, {"-", 9}, {"*", 10}, {"/", 10}, {"%", 10}
+        };
+        for (const auto& t:table)
+            if (XlEqString(op, t.first)) return t.second;
+        return 0;
+    }
+
+    int64 ShaderPreprocessor::ExpressionParser::ParseBinary(unsigned minPrecedence)
+    {
+        auto lhs = ParseUnary();
+        for (;;) {
+            if (Peek()._type != TokenType::Operator) break;
+            auto op = Peek()._text;
+            auto prec = BinaryPrecedence(op);
+            if (prec == 0 || prec < minPrecedence) break;
+            ++_pos;
+            auto rhs = ParseBinary(prec+1);
+            switch (op[0]) {
+            case '|': lhs = (op.Length() == 2) ? int64(lhs || rhs) : (lhs | rhs); break;
+            case '&': lhs = (op.Length() == 2) ? int64(lhs && rhs) : (lhs & rhs); break;
+            case '^': lhs = lhs ^ rhs; break;
+            case '=': lhs = lhs == rhs; break;
+            case '!': lhs = lhs != rhs; break;
+            case '<':
+                if (op.Length() == 1) lhs = lhs < rhs;
+                else if (op[1] == '=') lhs = lhs <= rhs;
+                else lhs = lhs << rhs;
+                break;
+            case '>':
+                if (op.Length() == 1) lhs = lhs > rhs;
+                else if (op[1] == '=') lhs = lhs >= rhs;
+                else lhs = lhs >> rhs;
+                break;
+            case '+': lhs = lhs + rhs; break;
+            case '-': lhs = lhs - rhs; break;
+            case '*': lhs = lhs * rhs; break;
+            case '/': if (rhs) lhs = lhs / rhs; else { Fail(); lhs = 0; } break;
+            case '%': if (rhs) lhs = lhs % rhs; else { Fail(); lhs = 0; } break;
+            }
+        }
+        return lhs;
+    }
+
+    int64 ShaderPreprocessor::ExpressionParser::ParseUnary()
+    {
+        if (IsOp("!")) { ++_pos; return !ParseUnary(); }
+        if (IsOp("~")) { ++_pos; return ~ParseUnary(); }
+        if (IsOp("-")) { ++_pos; return -ParseUnary(); }
+        if (IsOp("+")) { ++_pos; return ParseUnary(); }
+        return ParsePrimary();
+    }
+
+    int64 ShaderPreprocessor::ExpressionParser::ParsePrimary()
+    {
+        const auto& t = Peek();
+        if (t._type == TokenType::Number) { ++_pos; return t._value; }
+        if (t._type == TokenType::Operator && XlEqString(t._text, "(")) {
+            ++_pos;
+            auto result = ParseTernary();
+            if (!IsOp(")")) { Fail(); return 0; }
+            ++_pos;
+            return result;
+        }
+        if (t._type == TokenType::Identifier) {
+            ++_pos;
+            if (XlEqString(t._text, "defined")) {
+                bool paren = IsOp("(");
+                if (paren) ++_pos;
+                if (Peek()._type != TokenType::Identifier) { Fail(); return 0; }
+                auto result = _pp->IsDefined(Peek()._text);
+                ++_pos;
+                if (paren) {
+                    if (!IsOp(")")) { Fail(); return 0; }
+                    ++_pos;
+                }
+                return result;
+            }
+            if (IsOp("(")) { Fail(); return 0; }     // function-like macro invocation
+            return _pp->EvaluateIdentifier(t._text, _depth);
+        }
+        Fail();
+        if (t._type != TokenType::End) ++_pos;
+        return 0;
+    }
+
+    int64 ShaderPreprocessor::EvaluateExpression(StringSection<char> expression, unsigned depth)
+    {
+        if (depth > MaxMacroDepth) { _isReliable = false; return 0; }
+        return ExpressionParser(expression, *this, depth).Parse();
+    }
+
+    int64 ShaderPreprocessor::EvaluateIdentifier(StringSection<char> name, unsigned depth)
+    {
+        auto* local = FindLocal(name);
+        if (local) {
+            if (local->_undefined) return 0;
+            if (local->_functionLike) { _isReliable = false; return 0; }
+            if (Trim(MakeStringSection(local->_value)).Empty()) return 0;
+            return EvaluateExpression(MakeStringSection(local->_value), depth+1);
+        }
+
+        auto* external = FindExternal(name);
+        if (external) {
+            external->_referencedByConditional = true;
+                // a define with no value is given the value "1" by the compiler
+            if (Trim(MakeStringSection(external->_value)).Empty()) return 1;
+            return EvaluateExpression(MakeStringSection(external->_value), depth+1);
+        }
+
+        return 0;   // undefined identifiers evaluate to 0
+    }
+
+        ////////////////////////////////////////////////////////////
+
+    static StringSection<char> ReadIdentifier(const char*& i, const char* end)
+    {
+        while (i < end && IsWhitespace(*i)) ++i;
+        auto start = i;
+        while (i < end && IsIdentifierChar(*i)) ++i;
+        return MakeStringSection(start, i);
+    }
+
+    void ShaderPreprocessor::ProcessFile(StringSection<char> source, StringSection<ResChar> filename, unsigned depth)
+    {
+        if (depth > MaxIncludeDepth) { _isReliable = false; return; }
+
+        auto cleaned = StripCommentsAndSplices(source);
+        auto lineStart = AsPointer(cleaned.cbegin());
+        auto end = AsPointer(cleaned.cend());
+
+        while (lineStart < end && _isReliable) {
+            auto lineEnd = lineStart;
+            while (lineEnd < end && *lineEnd != '\n') ++lineEnd;
+            auto line = Trim(MakeStringSection(lineStart, lineEnd));
+            lineStart = (lineEnd < end) ? (lineEnd+1) : end;
+
+            if (line.Empty()) continue;
+
+            if (line[0] != '#') {
+                if (IsActive()) {
+                    RecordReferences(line);
+                    Emit(line);
+                }
+                continue;
+            }
+
+            auto i = line.begin() + 1;
+            auto directive = ReadIdentifier(i, line.end());
+            auto rest = Trim(MakeStringSection(i, line.end()));
+
+            if (XlEqString(directive, "if") || XlEqString(directive, "ifdef") || XlEqString(directive, "ifndef")) {
+                ConditionalBlock block;
+                block._parentActive = IsActive();
+                block._active = false;
+                if (block._parentActive) {
+                    if (XlEqString(directive, "if")) {
+                        block._active = EvaluateExpression(rest, 0) != 0;
+                    } else {
+                        auto r = rest.begin();
+                        auto name = ReadIdentifier(r, rest.end());
+                        block._active = IsDefined(name) == XlEqString(directive, "ifdef");
+                    }
+                }
+                block._taken = block._active;
+                _conditionals.push_back(block);
+            } else if (XlEqString(directive, "elif")) {
+                if (_conditionals.empty()) { _isReliable = false; return; }
+                auto& block = _conditionals.back();
+                if (!block._parentActive || block._taken) {
+                    block._active = false;
+                } else {
+                    block._active = EvaluateExpression(rest, 0) != 0;
+                    block._taken = block._active;
+                }
+            } else if (XlEqString(directive, "else")) {
+                if (_conditionals.empty()) { _isReliable = false; return; }
+                auto& block = _conditionals.back();
+                block._active = !block._taken;
+                block._taken = true;
+            } else if (XlEqString(directive, "endif")) {
+                if (_conditionals.empty()) { _isReliable = false; return; }
+                _conditionals.pop_back();
+            } else if (!IsActive()) {
+                continue;
+            } else if (XlEqString(directive, "include")) {
+                if (rest.Length() < 2 || (rest[0] != '"' && rest[0] != '<')) { _isReliable = false; return; }
+                auto closeChar = (rest[0] == '"') ? '"' : '>';
+                auto nameEnd = rest.begin()+1;
+                while (nameEnd < rest.end() && *nameEnd != closeChar) ++nameEnd;
+                if (nameEnd >= rest.end()) { _isReliable = false; return; }
+
+                std::string contents;
+                ::Assets::DependentFileState resolvedFile;
+                auto requested = MakeStringSection(rest.begin()+1, nameEnd).AsString();
+                if (!(*_includeLoader)(contents, resolvedFile, MakeStringSection(requested), filename)) {
+                    _isReliable = false;
+                    return;
+                }
+
+                auto existing = std::find_if(_includeFiles.cbegin(), _includeFiles.cend(),
+                    [&resolvedFile](const ::Assets::DependentFileState& depState)
+                    { return !XlCompareStringI(depState._filename.c_str(), resolvedFile._filename.c_str()); });
+                if (existing == _includeFiles.cend())
+                    _includeFiles.push_back(resolvedFile);
+
+                    // the resolved name goes into the output, because the same include
+                    // string can resolve to different files from different base files
+                Emit(MakeStringSection(std::string("#include ") + resolvedFile._filename));
+                ProcessFile(MakeStringSection(contents), MakeStringSection(resolvedFile._filename), depth+1);
+            } else if (XlEqString(directive, "define")) {
+                auto r = rest.begin();
+                auto name = ReadIdentifier(r, rest.end());
+                if (name.Empty()) { _isReliable = false; return; }
+                LocalMacro macro;
+                macro._functionLike = r < rest.end() && *r == '(';
+                macro._undefined = false;
+                macro._value = Trim(MakeStringSection(r, rest.end())).AsString();
+                auto* existing = FindLocal(name);
+                if (existing) *existing = macro;
+                else _localMacros.push_back(std::make_pair(name.AsString(), macro));
+
+                RecordReferences(MakeStringSection(r, rest.end()));
+                Emit(line);
+            } else if (XlEqString(directive, "undef")) {
+                auto r = rest.begin();
+                auto name = ReadIdentifier(r, rest.end());
+                LocalMacro macro;
+                macro._functionLike = false;
+                macro._undefined = true;
+                auto* existing = FindLocal(name);
+                if (existing) *existing = macro;
+                else _localMacros.push_back(std::make_pair(name.AsString(), macro));
+                Emit(line);
+            } else {
+                    // #pragma, #line, #error and anything else just passes through
+                RecordReferences(rest);
+                Emit(line);
+            }
+        }
+    }
+
+    PreprocessedShaderSource ShaderPreprocessor::Complete()
+    {
+        PreprocessedShaderSource result;
+        if (!_conditionals.empty()) _isReliable = false;     // missing #endif
+        result._isReliable = _isReliable;
+        result._normalizedLength = _output.size();
+        result._includeFiles = std::move(_includeFiles);
+
+            //  Defines that only effect conditionals are already represented by the
+            //  branches taken in the output text. But defines that appear in the
+            //  text itself will be substituted by the compiler, so their values must
+            //  be part of the hash.
+        auto hash = Hash64(_output);
+        for (const auto& d:_externalDefines) {
+            if (d._referencedByText) {
+                hash = HashCombine(Hash64(d._name), hash);
+                hash = HashCombine(Hash64(d._value), hash);
+            }
+            if (d._referencedByText || d._referencedByConditional)
+                result._referencedDefines.push_back(d._name);
+        }
+        result._hash = hash;
+        return result;
+    }
+
+    ShaderPreprocessor::ShaderPreprocessor(StringSection<ResChar> definesTable, const ShaderIncludeLoader& includeLoader)
+    : _includeLoader(&includeLoader), _isReliable(true)
+    {
+            // defines table format is "NAME=value;NAME2;NAME3=value"
+        auto i = definesTable.begin();
+        while (i < definesTable.end()) {
+            auto defineEnd = std::find(i, definesTable.end(), ';');
+            auto equals = std::find(i, defineEnd, '=');
+            auto name = Trim(MakeStringSection(i, equals));
+            if (!name.Empty()) {
+                ExternalDefine d;
+                d._name = name.AsString();
+                d._value = (equals < defineEnd) ? Trim(MakeStringSection(equals+1, defineEnd)).AsString() : std::string();
+                d._referencedByConditional = d._referencedByText = false;
+                    // later definitions replace earlier ones
+                auto existing = std::find_if(_externalDefines.begin(), _externalDefines.end(),
+                    [&d](const ExternalDefine& e) { return e._name == d._name; });
+                if (existing != _externalDefines.end()) *existing = d;
+                else _externalDefines.push_back(d);
+            }
+            i = (defineEnd < definesTable.end()) ? (defineEnd+1) : definesTable.end();
+        }
+
+        std::sort(_externalDefines.begin(), _externalDefines.end(),
+            [](const ExternalDefine& lhs, const ExternalDefine& rhs) { return lhs._name < rhs._name; });
+    }
+
+        ////////////////////////////////////////////////////////////
+
+    PreprocessedShaderSource PreprocessShaderSource(
+        StringSection<char> sourceCode,
+        StringSection<ResChar> sourceFilename,
+        StringSection<ResChar> definesTable,
+        const ShaderIncludeLoader& includeLoader)
+    {
+            //  Compound text documents (eg, function linking graphs) are interpreted
+            //  by the low level compiler in special ways. We can't reason about them here.
+        if (!::Assets::ReadCompoundTextDocument(sourceCode).empty())
+            return PreprocessedShaderSource();
+
+        ShaderPreprocessor pp(definesTable, includeLoader);
+        pp.ProcessFile(sourceCode, sourceFilename, 0);
+        return pp.Complete();
+    }
+
+    ShaderIncludeLoader MakeFileSystemIncludeLoader(StringSection<ResChar> baseFilename)
+    {
+            //  Search rules mirror the include handler used by the low level compiler; so
+            //  that we resolve the same files. Every time a new file is included,
+            //  it's directory is appended to the search directories.
+        auto searchDirectories = std::make_shared<std::vector<std::string>>();
+        ResChar directoryName[MaxPath];
+        XlDirname(directoryName, dimof(directoryName), baseFilename.AsString().c_str());
+        searchDirectories->push_back(directoryName);
+
+        if (&ConsoleRig::GlobalServices::GetInstance()) {
+            auto& serv = ConsoleRig::GlobalServices::GetCrossModule()._services;
+            searchDirectories->push_back(serv.CallDefault(ConstHash64<'asse', 'troo', 't'>::Value, std::string()));
+        } else {
+            searchDirectories->push_back(std::string());
+        }
+
+        return [searchDirectories](
+            std::string& contents, ::Assets::DependentFileState& resolvedFile,
+            StringSection<ResChar> requestedName, StringSection<ResChar>) -> bool
+        {
+            ResChar buffer[MaxPath], path[MaxPath];
+            for (unsigned c=0; c<unsigned(searchDirectories->size()); ++c) {
+                const auto& dir = (*searchDirectories)[c];
+                XlCopyString(buffer, dir.c_str());
+                if (!dir.empty()) XlCatString(buffer, dimof(buffer), "/");
+                XlCatString(buffer, dimof(buffer), requestedName.AsString().c_str());
+                SplitPath<ResChar>(buffer).Simplify().Rebuild(path);
+
+                if (!DoesFileExist(path)) continue;
+
+                size_t size = 0;
+                auto file = LoadFileAsMemoryBlock(path, &size);
+                contents = std::string((const char*)file.get(), (const char*)PtrAdd(file.get(), size));
+                resolvedFile = ::Assets::IntermediateAssets::Store::GetDependentFileState(MakeStringSection(path));
+                resolvedFile._filename = path;
+
+                auto newDirectory = FileNameSplitter<ResChar>(path).DriveAndPath().AsString();
+                if (std::find(searchDirectories->cbegin(), searchDirectories->cend(), newDirectory) == searchDirectories->cend())
+                    searchDirectories->push_back(newDirectory);
+                return true;
+            }
+            return false;
+        };
+    }
+}}
+
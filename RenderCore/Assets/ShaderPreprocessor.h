@@ -0,0 +1,64 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Assets/AssetsCore.h"
+#include "../../Assets/AssetUtils.h"
+#include "../../Utility/StringUtils.h"
+#include "../../Core/Types.h"
+#include <vector>
+#include <string>
+#include <functional>
+
+namespace RenderCore { namespace Assets
+{
+    /// <summary>Result of a light-weight preprocessing pass over shader source</summary>
+    /// The preprocessor expands #includes and evaluates #if/#ifdef blocks, but
+    /// doesn't perform macro substitution on the output. Instead, it records which
+    /// defines from the defines table were referenced (either by a conditional
+    /// or by the remaining shader text). The hash covers the normalised output
+    /// plus the values of the defines referenced by the output text; so two define
+    /// tables that produce the same hash will compile to the same byte code.
+    ///
+    /// When the source uses constructs that aren't understood (function-like
+    /// macros in conditionals, unresolvable includes, etc) _isReliable is false,
+    /// and the hash must not be used for sharing compiled code.
+    class PreprocessedShaderSource
+    {
+    public:
+        uint64 _hash;
+        bool _isReliable;
+        std::vector<std::string> _referencedDefines;
+        std::vector<::Assets::DependentFileState> _includeFiles;
+        size_t _normalizedLength;
+
+        PreprocessedShaderSource() : _hash(0), _isReliable(false), _normalizedLength(0) {}
+    };
+
+    /// <summary>Loads an included file for the shader preprocessor</summary>
+    /// Should return false if the file can't be found. "requestedName" is the
+    /// string from the #include directive; "includingFile" is the resolved name
+    /// of the file containing that directive.
+    using ShaderIncludeLoader = std::function<bool(
+        /*out*/ std::string& contents,
+        /*out*/ ::Assets::DependentFileState& resolvedFile,
+        StringSection<::Assets::ResChar> requestedName,
+        StringSection<::Assets::ResChar> includingFile)>;
+
+    PreprocessedShaderSource PreprocessShaderSource(
+        StringSection<char> sourceCode,
+        StringSection<::Assets::ResChar> sourceFilename,
+        StringSection<::Assets::ResChar> definesTable,
+        const ShaderIncludeLoader& includeLoader);
+
+    /// <summary>Include loader that searches the file system</summary>
+    /// Uses the same search rules as the D3D include handler: first relative
+    /// to the including file, then relative to the base shader file and
+    /// finally relative to the asset root.
+    ShaderIncludeLoader MakeFileSystemIncludeLoader(StringSection<::Assets::ResChar> baseFilename);
+}}
+
@@ -0,0 +1,518 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "VertexConversion.h"
+#include "../../Assets/AssetsCore.h"
+#include "../../Math/Math.h"
+#include "../../Math/HalfFloat.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Foreign/half-1.9.2/include/half.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+    #define VERTEX_CONVERSION_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace RenderCore { namespace Assets { namespace GeoProc
+{
+    using ::Assets::Exceptions::FormatError;
+
+        //  Vertices are converted in blocks. Each block is expanded into 4 floats per
+        //  vertex (the "pivot"), and then encoded into the destination format. The pivot
+        //  for a block is small enough to stay in L1.
+    static const unsigned BlockSize = 64;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    #if defined(VERTEX_CONVERSION_USE_SSE2)
+
+        static __m128i Select(__m128i mask, __m128i a, __m128i b)
+        {
+            return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+        }
+
+            //  Converts 4 floats to half floats, returning the magnitude bits in each 32 bit
+            //  lane and the sign separately. This must match half_float::detail::float2half
+            //  with std::round_to_nearest exactly -- so it rounds half away from zero (not
+            //  to even), and NaNs keep the top bits of their payload.
+        static __m128i FloatToHalfMagnitude4(__m128 f)
+        {
+            const __m128i absBits = _mm_and_si128(_mm_castps_si128(f), _mm_set1_epi32(0x7fffffff));
+
+                //  Normal halfs: rebias the exponent, and add half of the lowest mantissa
+                //  bit before truncating. Carries propagate into the exponent correctly
+            __m128i normal = _mm_srli_epi32(
+                _mm_add_epi32(_mm_sub_epi32(absBits, _mm_set1_epi32(112 << 23)), _mm_set1_epi32(0x1000)), 13);
+
+                //  Denormal halfs: scale so that the lowest half mantissa bit is 1.0. This
+                //  multiply is exact, so we can separate the integer and fractional parts
+            __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(absBits), _mm_set1_ps(16777216.f));
+            __m128i truncated = _mm_cvttps_epi32(scaled);
+            __m128 fraction = _mm_sub_ps(scaled, _mm_cvtepi32_ps(truncated));
+            __m128i roundUp = _mm_castps_si128(_mm_cmpge_ps(fraction, _mm_set1_ps(.5f)));
+            __m128i denormal = _mm_sub_epi32(truncated, roundUp);
+
+            __m128i infNan = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(_mm_srli_epi32(absBits, 13), _mm_set1_epi32(0x3ff)));
+
+            __m128i isDenormal  = _mm_cmplt_epi32(absBits, _mm_set1_epi32(113 << 23));
+            __m128i isOverflow  = _mm_cmpgt_epi32(absBits, _mm_set1_epi32((143 << 23) - 1));
+            __m128i isInfNan    = _mm_cmpgt_epi32(absBits, _mm_set1_epi32((255 << 23) - 1));
+
+            __m128i result = Select(isDenormal, denormal, normal);
+            result = Select(isOverflow, _mm_set1_epi32(0x7c00), result);
+            return Select(isInfNan, infNan, result);
+        }
+
+        static __m128i FloatToHalf8(__m128 f0, __m128 f1)
+        {
+            __m128i magnitude = _mm_packs_epi32(FloatToHalfMagnitude4(f0), FloatToHalfMagnitude4(f1));
+            __m128i sign = _mm_packs_epi32(_mm_srai_epi32(_mm_castps_si128(f0), 31), _mm_srai_epi32(_mm_castps_si128(f1), 31));
+            return _mm_or_si128(magnitude, _mm_and_si128(sign, _mm_set1_epi16(short(0x8000))));
+        }
+
+    #endif
+
+    void ConvertFloat32ToFloat16(uint16 dst[], const float src[], size_t count)
+    {
+        size_t c = 0;
+        #if defined(VERTEX_CONVERSION_USE_SSE2)
+            for (; (c+8)<=count; c+=8)
+                _mm_storeu_si128((__m128i*)&dst[c], FloatToHalf8(_mm_loadu_ps(&src[c]), _mm_loadu_ps(&src[c+4])));
+        #endif
+        for (; c<count; ++c)
+            dst[c] = half_float::detail::float2half<std::round_to_nearest>(src[c]);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  Normalized integer formats. "_scale" is the value that maps to 1.f. The 4th
+        //  component of 10:10:10:2 has a different scale to the others.
+    class NormalizedParams
+    {
+    public:
+        float   _scale[4];
+        bool    _signed;
+    };
+
+    static NormalizedParams GetNormalizedParams(VertexElementFormat::Encoding::Enum encoding)
+    {
+        using E = VertexElementFormat::Encoding;
+        switch (encoding) {
+        case E::UNorm8:             return NormalizedParams { { 255.f, 255.f, 255.f, 255.f }, false };
+        case E::SNorm8:             return NormalizedParams { { 127.f, 127.f, 127.f, 127.f }, true };
+        case E::UNorm16:            return NormalizedParams { { 65535.f, 65535.f, 65535.f, 65535.f }, false };
+        case E::SNorm16:            return NormalizedParams { { 32767.f, 32767.f, 32767.f, 32767.f }, true };
+        case E::UNorm10_10_10_2:    return NormalizedParams { { 1023.f, 1023.f, 1023.f, 3.f }, false };
+        default:                    assert(0); return NormalizedParams { { 1.f, 1.f, 1.f, 1.f }, false };
+        }
+    }
+
+        //  int -> float for normalized formats. "count" must be a multiple of 4
+    static void DequantizeBlock(float dst[], const int32 src[], size_t count, const NormalizedParams& params)
+    {
+        #if defined(VERTEX_CONVERSION_USE_SSE2)
+            const __m128 scale = _mm_loadu_ps(params._scale);
+            const __m128 minusOne = _mm_set1_ps(-1.f);
+            for (size_t c=0; c<count; c+=4) {
+                __m128 v = _mm_div_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&src[c])), scale);
+                if (params._signed) v = _mm_max_ps(v, minusOne);     // (the most negative value is clamped to -1)
+                _mm_storeu_ps(&dst[c], v);
+            }
+        #else
+            for (size_t c=0; c<count; ++c) {
+                float v = float(src[c]) / params._scale[c&3];
+                dst[c] = params._signed ? std::max(v, -1.f) : v;
+            }
+        #endif
+    }
+
+        //  float -> int for normalized formats, with clamping and rounding to nearest.
+        //  NaNs become 0. "count" must be a multiple of 4
+    static void QuantizeBlock(int32 dst[], const float src[], size_t count, const NormalizedParams& params)
+    {
+        #if defined(VERTEX_CONVERSION_USE_SSE2)
+            const __m128 scale = _mm_loadu_ps(params._scale);
+            const __m128 lower = _mm_set1_ps(params._signed ? -1.f : 0.f);
+            const __m128 upper = _mm_set1_ps(1.f);
+            const __m128 half = _mm_set1_ps(.5f);
+            const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+            for (size_t c=0; c<count; c+=4) {
+                __m128 v = _mm_loadu_ps(&src[c]);
+                v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+                v = _mm_mul_ps(_mm_min_ps(_mm_max_ps(v, lower), upper), scale);
+                    // round half away from zero
+                v = _mm_add_ps(v, _mm_or_ps(half, _mm_and_ps(v, signMask)));
+                _mm_storeu_si128((__m128i*)&dst[c], _mm_cvttps_epi32(v));
+            }
+        #else
+            const float lower = params._signed ? -1.f : 0.f;
+            for (size_t c=0; c<count; ++c) {
+                float v = src[c];
+                if (!(v == v)) v = 0.f;
+                v = std::min(std::max(v, lower), 1.f) * params._scale[c&3];
+                dst[c] = int32(v + ((v < 0.f) ? -.5f : .5f));
+            }
+        #endif
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  Decoders read the components for "count" vertices (from the given pointers)
+        //  and expand them into 4 floats each, filling in the defaults (0, 0, 0, 1)
+    template<unsigned ComponentCount>
+        static void DecodeFloat32(float pivot[], const void* const srcs[], unsigned count)
+        {
+            static const float defaults[] = { 0.f, 0.f, 0.f, 1.f };
+            for (unsigned v=0; v<count; ++v) {
+                auto* s = (const float*)srcs[v];
+                for (unsigned c=0; c<ComponentCount; ++c) pivot[v*4+c] = s[c];
+                for (unsigned c=ComponentCount; c<4; ++c) pivot[v*4+c] = defaults[c];
+            }
+        }
+
+    template<typename Type>
+        static void GatherComponents(Type dst[], const void* const srcs[], unsigned count, unsigned componentCount, const Type defaults[4])
+        {
+            for (unsigned v=0; v<count; ++v) {
+                auto* s = (const Type*)srcs[v];
+                for (unsigned c=0; c<componentCount; ++c) dst[v*4+c] = s[c];
+                for (unsigned c=componentCount; c<4; ++c) dst[v*4+c] = defaults[c];
+            }
+        }
+
+    template<typename Type>
+        static void GatherNormalized(int32 dst[], const void* const srcs[], unsigned count, unsigned componentCount, int32 one)
+        {
+            for (unsigned v=0; v<count; ++v) {
+                auto* s = (const Type*)srcs[v];
+                for (unsigned c=0; c<componentCount; ++c) dst[v*4+c] = int32(s[c]);
+                for (unsigned c=componentCount; c<4; ++c) dst[v*4+c] = (c==3) ? one : 0;
+            }
+        }
+
+    static void DecodeBlock(float pivot[], const void* const srcs[], unsigned count, const VertexElementFormat& fmt)
+    {
+        using E = VertexElementFormat::Encoding;
+        switch (fmt._encoding) {
+        case E::Float32:
+            switch (fmt._componentCount) {
+            case 0: DecodeFloat32<0>(pivot, srcs, count); break;
+            case 1: DecodeFloat32<1>(pivot, srcs, count); break;
+            case 2: DecodeFloat32<2>(pivot, srcs, count); break;
+            case 3: DecodeFloat32<3>(pivot, srcs, count); break;
+            default: DecodeFloat32<4>(pivot, srcs, count); break;
+            }
+            break;
+
+        case E::Float16:
+            {
+                static const uint16 defaults[] = { 0, 0, 0, 0x3c00 };
+                uint16 halfs[BlockSize*4];
+                GatherComponents(halfs, srcs, count, fmt._componentCount, defaults);
+                XLEMath::ConvertHalfToFloat(pivot, halfs, count*4);
+            }
+            break;
+
+        case E::UNorm8:
+        case E::SNorm8:
+        case E::UNorm16:
+        case E::SNorm16:
+        case E::UNorm10_10_10_2:
+            {
+                auto params = GetNormalizedParams(fmt._encoding);
+                int32 ints[BlockSize*4];
+                switch (fmt._encoding) {
+                case E::UNorm8:     GatherNormalized<uint8>(ints, srcs, count, fmt._componentCount, 255); break;
+                case E::SNorm8:     GatherNormalized<int8>(ints, srcs, count, fmt._componentCount, 127); break;
+                case E::UNorm16:    GatherNormalized<uint16>(ints, srcs, count, fmt._componentCount, 65535); break;
+                case E::SNorm16:    GatherNormalized<int16>(ints, srcs, count, fmt._componentCount, 32767); break;
+                default:
+                    for (unsigned v=0; v<count; ++v) {
+                        uint32 packed;
+                        std::memcpy(&packed, srcs[v], sizeof(packed));
+                        ints[v*4+0] = int32(packed & 0x3ff);
+                        ints[v*4+1] = int32((packed >> 10) & 0x3ff);
+                        ints[v*4+2] = int32((packed >> 20) & 0x3ff);
+                        ints[v*4+3] = int32(packed >> 30);
+                    }
+                    break;
+                }
+                DequantizeBlock(pivot, ints, count*4, params);
+            }
+            break;
+
+        default:
+            assert(0);
+            break;
+        }
+
+        if (fmt._bgraSwizzle)
+            for (unsigned v=0; v<count; ++v)
+                std::swap(pivot[v*4+0], pivot[v*4+2]);
+        if (fmt._paddingAlpha)
+            for (unsigned v=0; v<count; ++v)
+                pivot[v*4+3] = 1.f;
+    }
+
+    template<unsigned ComponentCount>
+        static void EncodeFloat32(void* const dsts[], const float pivot[], unsigned count)
+        {
+            for (unsigned v=0; v<count; ++v) {
+                auto* d = (float*)dsts[v];
+                for (unsigned c=0; c<ComponentCount; ++c) d[c] = pivot[v*4+c];
+            }
+        }
+
+    template<typename Type, typename SrcType>
+        static void ScatterComponents(void* const dsts[], const SrcType src[], unsigned count, unsigned componentCount)
+        {
+            for (unsigned v=0; v<count; ++v) {
+                auto* d = (Type*)dsts[v];
+                for (unsigned c=0; c<componentCount; ++c) d[c] = Type(src[v*4+c]);
+            }
+        }
+
+        //  Note that this may modify the pivot
+    static void EncodeBlock(void* const dsts[], float pivot[], unsigned count, const VertexElementFormat& fmt)
+    {
+        if (fmt._bgraSwizzle)
+            for (unsigned v=0; v<count; ++v)
+                std::swap(pivot[v*4+0], pivot[v*4+2]);
+        if (fmt._paddingAlpha)
+            for (unsigned v=0; v<count; ++v)
+                pivot[v*4+3] = 1.f;
+
+        using E = VertexElementFormat::Encoding;
+        switch (fmt._encoding) {
+        case E::Float32:
+            switch (fmt._componentCount) {
+            case 0: break;
+            case 1: EncodeFloat32<1>(dsts, pivot, count); break;
+            case 2: EncodeFloat32<2>(dsts, pivot, count); break;
+            case 3: EncodeFloat32<3>(dsts, pivot, count); break;
+            default: EncodeFloat32<4>(dsts, pivot, count); break;
+            }
+            break;
+
+        case E::Float16:
+            {
+                uint16 halfs[BlockSize*4];
+                ConvertFloat32ToFloat16(halfs, pivot, count*4);
+                ScatterComponents<uint16>(dsts, halfs, count, fmt._componentCount);
+            }
+            break;
+
+        case E::UNorm8:
+        case E::SNorm8:
+        case E::UNorm16:
+        case E::SNorm16:
+        case E::UNorm10_10_10_2:
+            {
+                int32 ints[BlockSize*4];
+                QuantizeBlock(ints, pivot, count*4, GetNormalizedParams(fmt._encoding));
+                switch (fmt._encoding) {
+                case E::UNorm8:     ScatterComponents<uint8>(dsts, ints, count, fmt._componentCount); break;
+                case E::SNorm8:     ScatterComponents<int8>(dsts, ints, count, fmt._componentCount); break;
+                case E::UNorm16:    ScatterComponents<uint16>(dsts, ints, count, fmt._componentCount); break;
+                case E::SNorm16:    ScatterComponents<int16>(dsts, ints, count, fmt._componentCount); break;
+                default:
+                    for (unsigned v=0; v<count; ++v) {
+                        uint32 packed = uint32(ints[v*4+0]) | (uint32(ints[v*4+1]) << 10) | (uint32(ints[v*4+2]) << 20) | (uint32(ints[v*4+3]) << 30);
+                        std::memcpy(dsts[v], &packed, sizeof(packed));
+                    }
+                    break;
+                }
+            }
+            break;
+
+        default:
+            assert(0);
+            break;
+        }
+    }
+
+    static void ApplyProcessing(float pivot[], unsigned count, ProcessingFlags::BitField processingFlags)
+    {
+        for (unsigned v=0; v<count; ++v) {
+            float* p = &pivot[v*4];
+            if (processingFlags & ProcessingFlags::Renormalize) {
+                float scale;
+                if (XlRSqrt_Checked(&scale, p[0] * p[0] + p[1] * p[1] + p[2] * p[2])) {
+                    p[0] *= scale; p[1] *= scale; p[2] *= scale;
+                }
+            }
+
+            if (processingFlags & ProcessingFlags::TexCoordFlip) {
+                p[1] = 1.0f - p[1];
+            } else if (processingFlags & ProcessingFlags::BitangentFlip) {
+                p[0] = -p[0];
+                p[1] = -p[1];
+                p[2] = -p[2];
+            } else if (processingFlags & ProcessingFlags::TangentHandinessFlip) {
+                p[3] = -p[3];
+            }
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static bool IsSupported(const VertexElementFormat& fmt)
+    {
+        return fmt._encoding != VertexElementFormat::Encoding::Unsupported && fmt._componentCount <= 4;
+    }
+
+    static size_t FindMaxSourceIndex(size_t count, IteratorRange<const unsigned*> mapping)
+    {
+        size_t result = (mapping.size() < count) ? (count-1) : 0;
+        auto mappedCount = std::min(mapping.size(), count);
+        for (size_t c=0; c<mappedCount; ++c)
+            result = std::max(result, size_t(mapping[c]));
+        return result;
+    }
+
+    void ConvertVertexStream(
+        void* dst, VertexElementFormat dstFormat, size_t dstStride, size_t dstDataSize,
+        const void* src, VertexElementFormat srcFormat, size_t srcStride, size_t srcDataSize,
+        size_t count,
+        IteratorRange<const unsigned*> mapping,
+        ProcessingFlags::BitField processingFlags)
+    {
+        if (!IsSupported(srcFormat) || !IsSupported(dstFormat))
+            Throw(FormatError("Error while copying vertex data. Format not supported."));
+        if (!count) return;
+
+            //  Check the bounds once up-front, rather than for every component
+        auto srcElementSize = srcFormat.GetElementSize();
+        auto dstElementSize = dstFormat.GetElementSize();
+        if (srcElementSize && (FindMaxSourceIndex(count, mapping) * srcStride + srcElementSize) > srcDataSize)
+            Throw(FormatError("Error while copying vertex data. Vertex mapping or count overruns source data."));
+        if (dstElementSize && ((count-1) * dstStride + dstElementSize) > dstDataSize)
+            Throw(FormatError("Error while copying vertex data. Destination buffer is too small."));
+        if (!dstElementSize) return;
+
+        auto getSource = [&](size_t v) { return PtrAdd(src, ((v < mapping.size()) ? mapping[v] : v) * srcStride); };
+
+            //  When the formats match, we just need to copy the bytes of each element
+            //  (but only when the buffers don't overlap -- in-place conversions must go
+            //  through the block path below)
+        bool overlapping =
+                (size_t(dst) < size_t(src) + srcDataSize)
+            &&  (size_t(src) < size_t(dst) + dstDataSize);
+        if (    srcFormat._encoding == dstFormat._encoding && srcFormat._componentCount == dstFormat._componentCount
+            &&  srcFormat._bgraSwizzle == dstFormat._bgraSwizzle && srcFormat._paddingAlpha == dstFormat._paddingAlpha
+            &&  !processingFlags && !overlapping) {
+
+            for (size_t v=0; v<count; ++v)
+                std::memcpy(PtrAdd(dst, v*dstStride), getSource(v), dstElementSize);
+            return;
+        }
+
+        float pivot[BlockSize*4];
+        const void* srcs[BlockSize];
+        void* dsts[BlockSize];
+        for (size_t blockStart=0; blockStart<count; blockStart+=BlockSize) {
+            auto blockCount = unsigned(std::min(size_t(BlockSize), count - blockStart));
+            for (unsigned v=0; v<blockCount; ++v) {
+                srcs[v] = getSource(blockStart+v);
+                dsts[v] = PtrAdd(dst, (blockStart+v)*dstStride);
+            }
+
+            DecodeBlock(pivot, srcs, blockCount, srcFormat);
+            if (processingFlags)
+                ApplyProcessing(pivot, blockCount, processingFlags);
+            EncodeBlock(dsts, pivot, blockCount, dstFormat);
+        }
+    }
+
+    void ExpandVertexStream(
+        Float4 dst[], size_t count,
+        const void* src, VertexElementFormat srcFormat, size_t srcStride, size_t srcDataSize)
+    {
+        if (!IsSupported(srcFormat))
+            Throw(FormatError("Error while reading vertex data. Format not supported."));
+        if (!count) return;
+
+        auto srcElementSize = srcFormat.GetElementSize();
+        if (srcElementSize && ((count-1) * srcStride + srcElementSize) > srcDataSize)
+            Throw(FormatError("Error while reading vertex data. Vertex count overruns source data."));
+
+        const void* srcs[BlockSize];
+        for (size_t blockStart=0; blockStart<count; blockStart+=BlockSize) {
+            auto blockCount = unsigned(std::min(size_t(BlockSize), count - blockStart));
+            for (unsigned v=0; v<blockCount; ++v)
+                srcs[v] = PtrAdd(src, (blockStart+v)*srcStride);
+            DecodeBlock(&dst[blockStart][0], srcs, blockCount, srcFormat);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    unsigned VertexElementFormat::GetElementSize() const
+    {
+        switch (_encoding) {
+        case Encoding::Float32:         return 4 * _componentCount;
+        case Encoding::Float16:         return 2 * _componentCount;
+        case Encoding::UNorm8:
+        case Encoding::SNorm8:          return _componentCount;
+        case Encoding::UNorm16:
+        case Encoding::SNorm16:         return 2 * _componentCount;
+        case Encoding::UNorm10_10_10_2: return 4;
+        default:                        return 0;
+        }
+    }
+
+    VertexElementFormat::VertexElementFormat(Encoding::Enum encoding, unsigned componentCount, bool bgraSwizzle, bool paddingAlpha)
+    : _encoding(encoding), _componentCount(componentCount), _bgraSwizzle(bgraSwizzle), _paddingAlpha(paddingAlpha) {}
+
+    VertexElementFormat AsVertexElementFormat(Metal::NativeFormat::Enum fmt)
+    {
+        using E = VertexElementFormat::Encoding;
+        switch (fmt) {
+        case Metal::NativeFormat::Unknown:              return VertexElementFormat(E::Float32, 0);
+        case Metal::NativeFormat::R10G10B10A2_UNORM:    return VertexElementFormat(E::UNorm10_10_10_2, 4);
+        case Metal::NativeFormat::B8G8R8A8_UNORM:
+        case Metal::NativeFormat::B8G8R8A8_UNORM_SRGB:  return VertexElementFormat(E::UNorm8, 4, true);
+        case Metal::NativeFormat::B8G8R8X8_UNORM:
+        case Metal::NativeFormat::B8G8R8X8_UNORM_SRGB:  return VertexElementFormat(E::UNorm8, 4, true, true);
+        default: break;
+        }
+
+        if (Metal::GetCompressionType(fmt) != Metal::FormatCompressionType::None)
+            return VertexElementFormat(E::Unsupported, 0);
+
+        unsigned componentCount = Metal::GetComponentCount(Metal::GetComponents(fmt));
+        unsigned prec = Metal::GetComponentPrecision(fmt);
+        switch (Metal::GetComponentType(fmt)) {
+        case Metal::FormatComponentType::Float:
+            if (prec == 32) return VertexElementFormat(E::Float32, componentCount);
+            if (prec == 16) return VertexElementFormat(E::Float16, componentCount);
+            break;
+
+        case Metal::FormatComponentType::UnsignedFloat16:
+        case Metal::FormatComponentType::SignedFloat16:
+            return VertexElementFormat(E::Float16, componentCount);
+
+        case Metal::FormatComponentType::UNorm:
+        case Metal::FormatComponentType::UNorm_SRGB:
+            if (prec == 8) return VertexElementFormat(E::UNorm8, componentCount);
+            if (prec == 16) return VertexElementFormat(E::UNorm16, componentCount);
+            break;
+
+        case Metal::FormatComponentType::SNorm:
+            if (prec == 8) return VertexElementFormat(E::SNorm8, componentCount);
+            if (prec == 16) return VertexElementFormat(E::SNorm16, componentCount);
+            break;
+
+        default:
+            break;
+        }
+
+        return VertexElementFormat(E::Unsupported, 0);
+    }
+}}}
+
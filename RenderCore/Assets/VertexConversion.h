@@ -0,0 +1,77 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Metal/Format.h"
+#include "../../Math/Vector.h"
+#include "../../Utility/IteratorUtils.h"
+#include "../../Core/Types.h"
+
+namespace RenderCore { namespace Assets { namespace GeoProc
+{
+    namespace ProcessingFlags
+    {
+        enum Enum { TexCoordFlip = 1<<0, TangentHandinessFlip = 1<<1, BitangentFlip = 1<<2, Renormalize = 1<<3 };
+        typedef unsigned BitField;
+    }
+
+    /// <summary>Describes how the components of a vertex element are stored in memory</summary>
+    /// This is a simplified version of Metal::NativeFormat, containing only
+    /// the information the vertex conversion functions need.
+    class VertexElementFormat
+    {
+    public:
+        struct Encoding
+        {
+            enum Enum { Float32, Float16, UNorm8, SNorm8, UNorm16, SNorm16, UNorm10_10_10_2, Unsupported };
+        };
+        Encoding::Enum  _encoding;
+        unsigned        _componentCount;
+        bool            _bgraSwizzle;       ///< first and third components are swapped in memory (eg, B8G8R8A8_UNORM)
+        bool            _paddingAlpha;      ///< 4th component is only padding; it reads as 1 (eg, B8G8R8X8_UNORM)
+
+        unsigned        GetElementSize() const;
+
+        VertexElementFormat(Encoding::Enum encoding = Encoding::Float32, unsigned componentCount = 0, bool bgraSwizzle = false, bool paddingAlpha = false);
+    };
+
+    VertexElementFormat AsVertexElementFormat(Metal::NativeFormat::Enum fmt);
+
+    /// <summary>Converts a stream of vertex elements from one format to another</summary>
+    /// Each destination vertex "v" is read from source vertex "mapping[v]" (or just "v"
+    /// for vertices past the end of the mapping). Both source and destination may have
+    /// any stride, so this can read from and write into interleaved vertex buffers.
+    ///
+    /// Missing source components are treated as 0 (or 1 for the 4th component). Conversion
+    /// to normalized integer formats clamps and rounds to nearest. Conversion to 16 bit float
+    /// matches AsFloat16 (via the "half" library) exactly.
+    ///
+    /// Vertices are processed in blocks, so the source and destination can be the same
+    /// buffer when there is no mapping and the destination stride is not larger than
+    /// the source stride.
+    ///
+    /// Throws a FormatError if the formats are not supported, or if the source or
+    /// destination ranges would be overrun.
+    void ConvertVertexStream(
+        void* dst, VertexElementFormat dstFormat, size_t dstStride, size_t dstDataSize,
+        const void* src, VertexElementFormat srcFormat, size_t srcStride, size_t srcDataSize,
+        size_t count,
+        IteratorRange<const unsigned*> mapping = IteratorRange<const unsigned*>(),
+        ProcessingFlags::BitField processingFlags = 0);
+
+    /// <summary>Reads a stream of vertex elements into Float4s</summary>
+    /// Missing components are filled with the defaults (0, 0, 0, 1).
+    void ExpandVertexStream(
+        Float4 dst[], size_t count,
+        const void* src, VertexElementFormat srcFormat, size_t srcStride, size_t srcDataSize);
+
+    /// <summary>Converts 32 bit floats to 16 bit floats</summary>
+    /// Uses SIMD instructions when available. The result matches AsFloat16 exactly
+    /// (including rounding, denormals and infinities).
+    void ConvertFloat32ToFloat16(uint16 dst[], const float src[], size_t count);
+}}}
+
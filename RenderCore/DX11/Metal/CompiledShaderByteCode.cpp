@@ -56,6 +56,9 @@ namespace RenderCore { namespace Metal_DX11
         virtual std::string MakeShaderMetricsString(
             const void* byteCode, size_t byteCodeSize) const;
 
+        virtual std::string MakeImplicitDefines(
+            const ShaderService::ResId& shaderPath) const;
+
         HRESULT D3DReflect_Wrapper(
             const void* pSrcData, size_t SrcDataSize, 
             const IID& pInterface, void** ppReflector) const;
@@ -271,6 +274,19 @@ namespace RenderCore { namespace Metal_DX11
     static const char s_shaderModelDef_D[] = "DSH";
     static const char s_shaderModelDef_C[] = "CSH";
 
+    static const char* AsShaderModelDefine(const char shaderModel[])
+    {
+        switch (tolower(shaderModel[0])) {
+        case 'v': return s_shaderModelDef_V;
+        case 'p': return s_shaderModelDef_P;
+        case 'g': return s_shaderModelDef_G;
+        case 'h': return s_shaderModelDef_H;
+        case 'd': return s_shaderModelDef_D;
+        case 'c': return s_shaderModelDef_C;
+        default:  return nullptr;
+        }
+    }
+
     static std::vector<D3D10_SHADER_MACRO> MakeDefinesTable(const char definesTable[], const char shaderModel[], std::string& definesCopy)
     {
         definesCopy = definesTable?definesTable:std::string();
@@ -287,15 +303,7 @@ namespace RenderCore { namespace Metal_DX11
             arrayOfDefines.push_back(MakeShaderMacro("_DEBUG", "1"));
         #endif
 
-        const char* shaderModelStr = nullptr;
-        switch (tolower(shaderModel[0])) {
-        case 'v': shaderModelStr = s_shaderModelDef_V; break;
-        case 'p': shaderModelStr = s_shaderModelDef_P; break;
-        case 'g': shaderModelStr = s_shaderModelDef_G; break;
-        case 'h': shaderModelStr = s_shaderModelDef_H; break;
-        case 'd': shaderModelStr = s_shaderModelDef_D; break;
-        case 'c': shaderModelStr = s_shaderModelDef_C; break;
-        }
+        const char* shaderModelStr = AsShaderModelDefine(shaderModel);
         if (shaderModelStr)
             arrayOfDefines.push_back(MakeShaderMacro(shaderModelStr, "1"));
 
@@ -1539,6 +1547,22 @@ namespace RenderCore { namespace Metal_DX11
         return (*fn)(pSrcData, SrcDataSize, riid, ppReflector);
     }
 
+    std::string D3DShaderCompiler::MakeImplicitDefines(const ShaderService::ResId& shaderPath) const
+    {
+            // These must match the defines added by MakeDefinesTable
+        std::string result = "D3D11=1";
+        #if defined(_DEBUG)
+            result += ";_DEBUG=1";
+        #endif
+        auto* shaderModelStr = AsShaderModelDefine(shaderPath._shaderModel);
+        if (shaderModelStr) {
+            result += ";";
+            result += shaderModelStr;
+            result += "=1";
+        }
+        return result;
+    }
+
     std::string D3DShaderCompiler::MakeShaderMetricsString(const void* data, size_t dataSize) const
     {
             // Build some metrics information about the given shader, using the D3D
@@ -54,7 +54,7 @@ namespace RenderCore
             if (i) _stage = AsShaderStage(i+1);
 
             if (existing._dependencyValidation && existing._dependencyValidation->GetValidationIndex() == 0) {
-                _shader = existing._archive->TryOpenFromCache(existing._sourceID1);
+                _shader = ShaderService::TryOpenFromArchive(*existing._archive, existing._sourceID1);
                 if (_shader)
                     _validationCallback = std::move(existing._dependencyValidation);
             } 
@@ -154,7 +154,7 @@ namespace RenderCore
                 //  Find that file, and get the completed shader.
                 //  Note that this might hit the disk currently...?
             if (loc._archive) {
-                _shader = loc._archive->TryOpenFromCache(loc._sourceID1);
+                _shader = ShaderService::TryOpenFromArchive(*loc._archive, loc._sourceID1);
                 if (!_shader) {
                     LogWarning << "Compilation marker is finished, but shader couldn't be opened from cache (" << loc._sourceID0 << ":" <<loc._sourceID1 << ")";
                     // caller should throw InvalidAsset in this case
@@ -346,6 +346,33 @@ namespace RenderCore
         return std::move(shaderId);
     }
 
+    std::shared_ptr<std::vector<uint8>> ShaderService::TryOpenFromArchive(
+        ::Assets::ArchiveCache& archive, uint64 id)
+    {
+            //  Variations of a shader that preprocess to the same source share
+            //  a single block of byte code. The other variations get a small alias
+            //  block that refers to the shared one.
+        auto result = archive.TryOpenFromCache(id);
+        if (result && result->size() == sizeof(ShaderHeader) + sizeof(uint64)) {
+            auto* hdr = (const ShaderHeader*)AsPointer(result->cbegin());
+            if (hdr->_version == ShaderHeader::AliasVersion) {
+                auto targetId = *(const uint64*)PtrAdd(hdr, sizeof(ShaderHeader));
+                result = archive.TryOpenFromCache(targetId);
+            }
+        }
+        return result;
+    }
+
+    std::shared_ptr<std::vector<uint8>> ShaderService::MakeArchiveAlias(uint64 targetId)
+    {
+        auto result = std::make_shared<std::vector<uint8>>(sizeof(ShaderHeader) + sizeof(uint64));
+        auto* hdr = (ShaderHeader*)AsPointer(result->begin());
+        hdr->_version = ShaderHeader::AliasVersion;
+        hdr->_dynamicLinkageEnabled = 0;
+        *(uint64*)PtrAdd(hdr, sizeof(ShaderHeader)) = targetId;
+        return result;
+    }
+
     auto ShaderService::CompileFromFile(
         const ::Assets::ResChar resId[], 
         const ::Assets::ResChar definesTable[]) const -> std::shared_ptr<IPendingMarker>
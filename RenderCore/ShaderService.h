@@ -14,7 +14,7 @@
 #include <utility>
 #include <assert.h>
 
-namespace Assets { class DependencyValidation; class DependentFileState; class PendingCompileMarker; class ICompileMarker; }
+namespace Assets { class DependencyValidation; class DependentFileState; class PendingCompileMarker; class ICompileMarker; class ArchiveCache; }
 
 // We need to store the shader initializer in order to get the "pending assets" type 
 // messages while shaders are compiling. But it shouldn't be required in the normal game run-time.
@@ -59,6 +59,7 @@ namespace RenderCore
         {
         public:
             static const auto Version = 0u;
+            static const auto AliasVersion = 0xa11a5u;      // block contains only the id of another block in the same archive
             unsigned _version;
             unsigned _dynamicLinkageEnabled;
         };
@@ -113,6 +114,12 @@ namespace RenderCore
             virtual std::string MakeShaderMetricsString(
                 const void* byteCode, size_t byteCodeSize) const = 0;
 
+                /// <summary>Defines the compiler adds to every compile, in "defines table" format</summary>
+                /// Required so that shader source can be preprocessed outside of the compiler
+                /// with the same result as the compiler's preprocessor.
+            virtual std::string MakeImplicitDefines(
+                const ResId& shaderPath) const = 0;
+
             virtual ~ILowLevelCompiler();
         };
 
@@ -131,6 +138,10 @@ namespace RenderCore
             const ::Assets::ResChar initializer[], 
             ILowLevelCompiler& compiler);
 
+        static std::shared_ptr<std::vector<uint8>> TryOpenFromArchive(
+            ::Assets::ArchiveCache& archive, uint64 id);
+        static std::shared_ptr<std::vector<uint8>> MakeArchiveAlias(uint64 targetId);
+
         static ShaderService& GetInstance() { assert(s_instance); return *s_instance; }
         static void SetInstance(ShaderService*);
 
@@ -18,6 +18,7 @@
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/StringUtils.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/TimeUtils.h"
 #include <stdarg.h>
 #include <assert.h>
 
@@ -1029,6 +1030,8 @@ namespace RenderOverlays { namespace DebuggingDisplay
 
     void DebugScreensSystem::Render(RenderCore::IThreadContext* context, const RenderCore::Techniques::ProjectionDesc& projDesc)
     {
+        auto startTime = GetPerformanceCounter();
+        auto startLayoutMetrics = GetTextLayoutCacheMetrics();
         _currentInteractables = Interactables();
         
         auto maxCoords = context->GetStateDesc()._viewportDimensions;
@@ -1098,7 +1101,15 @@ namespace RenderOverlays { namespace DebuggingDisplay
         } CATCH_END
 
         overlayContext->ReleaseState();
+        const auto& overlayMetrics = overlayContext->GetMetrics();
+        _lastRenderMetrics._drawCalls = overlayMetrics._drawCalls;
+        _lastRenderMetrics._textDraws = overlayMetrics._textDraws;
+        _lastRenderMetrics._glyphQuads = overlayMetrics._glyphQuads;
+        auto endLayoutMetrics = GetTextLayoutCacheMetrics();
+        _lastRenderMetrics._layoutCacheHits = endLayoutMetrics._hits - startLayoutMetrics._hits;
+        _lastRenderMetrics._layoutCacheMisses = endLayoutMetrics._misses - startLayoutMetrics._misses;
         overlayContext.reset();
+        _lastRenderMetrics._cpuTime = GetPerformanceCounter() - startTime;
 
         //      Redo the current interface state, in case any of the interactables have moved during the render...
         _currentInterfaceState = _currentInteractables.BuildInterfaceState(_currentMouse, _currentMouseHeld);
@@ -1184,6 +1195,7 @@ namespace RenderOverlays { namespace DebuggingDisplay
     {
         _currentMouse = Coord2(0,0);
         _currentMouseHeld = 0;
+        XlZeroMemory(_lastRenderMetrics);
 
         Panel p;
         p._widgetIndex = size_t(-1);
@@ -348,6 +348,18 @@ namespace RenderOverlays { namespace DebuggingDisplay
         bool    ConsumedInputEvent()       { return _consumedInputEvent; }
         void    ResetConsumedInputEvent()  { _consumedInputEvent = false; }
 
+        class RenderMetrics
+        {
+        public:
+            unsigned    _drawCalls;
+            unsigned    _textDraws;
+            unsigned    _glyphQuads;
+            unsigned    _layoutCacheHits;
+            unsigned    _layoutCacheMisses;
+            uint64      _cpuTime;       ///< in performance counter units (see GetPerformanceCounterFrequency())
+        };
+        const RenderMetrics& GetLastRenderMetrics() const { return _lastRenderMetrics; }
+
         DebugScreensSystem();
         ~DebugScreensSystem();
 
@@ -370,6 +382,7 @@ namespace RenderOverlays { namespace DebuggingDisplay
         Coord2      _currentMouse;
         unsigned    _currentMouseHeld;
         bool        _consumedInputEvent;
+        RenderMetrics _lastRenderMetrics;
 
         void    RenderPanelControls(        IOverlayContext*    context,
                                             unsigned            panelIndex, const std::string& name, Layout&layout, bool allowDestroy,
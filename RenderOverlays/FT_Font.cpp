@@ -241,23 +241,6 @@ static void NotifyDeletingFont(FTFont* font, FontTexKind kind)
     }
 }
 
-static void CheckTextureValidate(FT_Face face, int size, FontChar *fc, FontTexKind kind)
-{
-    switch (kind) {
-    case FTK_DAMAGEDISPLAY: 
-        if(damageDisplayFontTexMgr) {
-            damageDisplayFontTexMgr->CheckTextureValidate(face, size, fc);
-        }
-        break;
-
-    case FTK_GENERAL:
-    default:
-        if(fontTexMgr) {
-            fontTexMgr->CheckTextureValidate(face, size, fc);
-        }
-    }
-}
-
 static void Register(const FontDef& def, FTFont* font)
 {
     fontMap.insert(UiFontMap::value_type(def, font));
@@ -393,7 +376,7 @@ FontCharID FTFont::CreateFontChar(ucs4 ch) const
             if (!face) {
                 face = damageDisplayFontTexMgr->CreateFontFace(_face, _size);
             }
-            return face->CreateChar(ch, _texKind);
+            return face->CreateChar(ch);
         }
         break;
 
@@ -404,7 +387,7 @@ FontCharID FTFont::CreateFontChar(ucs4 ch) const
             if (!face) {
                 face = fontTexMgr->CreateFontFace(_face, _size);
             }
-            return face->CreateChar(ch, _texKind);
+            return face->CreateChar(ch);
         }
         break;
     }
@@ -428,7 +411,7 @@ std::pair<const FontChar*, const FontTexture2D*> FTFont::GetChar(ucs4 ch) const
             if (!face) {
                 face = damageDisplayFontTexMgr->CreateFontFace(_face, _size);
             }
-            return std::make_pair(face->GetChar(ch, _texKind), face->GetTexture());
+            return face->GetChar(ch);
         }
         break;
 
@@ -439,7 +422,7 @@ std::pair<const FontChar*, const FontTexture2D*> FTFont::GetChar(ucs4 ch) const
             if (!face) {
                 face = fontTexMgr->CreateFontFace(_face, _size);
             }
-            return std::make_pair(face->GetChar(ch, _texKind), face->GetTexture());
+            return face->GetChar(ch);
         }
         break;
     }
@@ -447,12 +430,6 @@ std::pair<const FontChar*, const FontTexture2D*> FTFont::GetChar(ucs4 ch) const
     return std::pair<const FontChar*, const FontTexture2D*>(nullptr, nullptr);
 }
 
-void FTFont::TouchFontChar(const FontChar *fc)
-{
-    // fc->usedTime = desktop.time;
-    CheckTextureValidate(_face, _size, const_cast<FontChar*>(fc), _texKind);
-}
-
 float FTFont::Descent() const
 {
     if (!_face) return 1.0f;
@@ -1009,6 +986,29 @@ void CheckResetFTFontSystem()
     }
 }
 
+void UpdateFTFontSystem()
+{
+    if (fontTexMgr) {
+        fontTexMgr->OnFrameBarrier();
+    }
+
+    if (damageDisplayFontTexMgr) {
+        damageDisplayFontTexMgr->OnFrameBarrier();
+    }
+}
+
+FT_FontTextureMgr::Metrics GetFTFontTextureMetrics(FontTexKind kind)
+{
+    FT_FontTextureMgr* mgr = (kind == FTK_DAMAGEDISPLAY) ? damageDisplayFontTexMgr.get() : fontTexMgr.get();
+    if (mgr) {
+        return mgr->GetMetrics();
+    }
+
+    FT_FontTextureMgr::Metrics result;
+    XlZeroMemory(result);
+    return result;
+}
+
 int GetFTFontCount(FontTexKind kind)
 {
     switch (kind) {
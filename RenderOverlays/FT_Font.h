@@ -8,6 +8,7 @@
 
 #include "Font.h"
 #include "FontPrimitives.h"
+#include "FT_FontTexture.h"
 #include "../Utility/StringUtils.h"
 #include <map>
 #include <vector>
@@ -57,7 +58,6 @@ public:
     virtual float Ascent(bool includeAccent) const;
     virtual float LineHeight() const;
     // virtual bool SacrificeChar(int ch);
-    virtual void TouchFontChar(const FontChar *fc);
     virtual Float2 GetKerning(int prevGlyph, ucs4 ch, int* curGlyph) const;
 
 protected:
@@ -126,6 +126,8 @@ bool    InitFTFontSystem();
 bool    LoadFontConfigFile();
 void    CleanupFTFontSystem();
 void    CheckResetFTFontSystem();
+void    UpdateFTFontSystem();
+FT_FontTextureMgr::Metrics GetFTFontTextureMetrics(FontTexKind kind = FTK_GENERAL);
 int     GetFTFontCount(FontTexKind kind);
 int     GetFTFontFileCount();
 
@@ -7,10 +7,13 @@
 #include "FT_Font.h"
 #include "FT_FontTexture.h"
 #include "FontRendering.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include "../Core/Types.h"
 #include "../Utility/PtrUtils.h"
 #include "../Utility/StringUtils.h"
 #include "../Utility/MemoryUtils.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
 #include "../RenderCore/Metal/Format.h"
 
 #include "../BufferUploads/IBufferUploads.h"
@@ -20,346 +23,312 @@
 #include <assert.h>
 #include <algorithm>
 #include <functional>
+#include <climits>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_OUTLINE_H
 
 namespace RenderOverlays
 {
 
 #pragma warning(disable:4127)
 
-class CharSlotArray
+static int NextPower2(int n)
 {
-private:
-    int         _height;
-    int         _heightEnd;
-    uint32      _usedCount;
-    std::vector<FontChar> _array;
+    int result = 1;
+    while (result < n) result <<= 1;
+    return result;
+}
 
-public:
-    CharSlotArray(int height, int heightEnd, int count);
-    ~CharSlotArray();
+    //  Glyphs are separated by a 1 pixel border, so that bilinear filtering
+    //  doesn't bleed in the neighbouring glyph
+static const int GlyphMargin = 1;
+static const int ShelfHeightGranularity = 4;
+static const unsigned NoPage = ~0u;
 
-public:
-    bool            IsFull() const;
-    inline int      GetSlotHeight() const { return _height; }
-    inline int      GetSlotHeightEnd() const { return _heightEnd; }
+//-------------------------------------------------------------------------------------------------
 
+class FT_FontTextureMgr::FontFace::Glyph
+{
 public:
-        //if there is not empty slot, return -1
-    FontCharID      UseEmptySlot(const FontChar& fc);
-    bool            ReleaseSlot(FontCharID id);
-    const FontChar* GetLeastUsedChar() const;
-    const FontChar* GetChar(unsigned index) const;
-    FontChar*       GetChar(unsigned index);
+    FontChar    _char;
+    unsigned    _page;              // NoPage when there's no space in the atlas for this glyph
+    unsigned    _shelf;
+    int         _slotX, _slotY;
+    int         _slotWidth, _slotHeight;
+    uint64      _pendingRequest;    // non-zero while waiting for a background rasterisation
+    unsigned    _allocationFrame;
+    int         _boxLeft, _boxTop;
+
+    Glyph(int ch) : _char(ch), _page(NoPage), _shelf(0), _slotX(0), _slotY(0), _slotWidth(0), _slotHeight(0), _pendingRequest(0), _allocationFrame(~0u), _boxLeft(0), _boxTop(0) {}
 };
 
-CharSlotArray::CharSlotArray(int height, int heightEnd, int count)
-{
-    _height = height;
-    _heightEnd = heightEnd;
-    _usedCount = 0;
-
-    _array.resize(count);
-}
-
-CharSlotArray::~CharSlotArray()
+class FT_FontTextureMgr::Page
 {
+public:
+    class Shelf
+    {
+    public:
+        int         _y, _height;
+        int         _glyphHeight;       // glyphs stored on this shelf are rounded up to this height
+        int         _cursorX;
+        unsigned    _lastUsedFrame;
+        std::vector<std::pair<FontFace*, FontCharID>> _glyphs;
+    };
+
+    std::unique_ptr<FontTexture2D>  _texture;
+    std::vector<uint8>              _cpuData;
+    std::vector<Shelf>              _shelves;
+    int                             _nextShelfY;
+    int                             _dirtyMinX, _dirtyMinY, _dirtyMaxX, _dirtyMaxY;
+
+    void MarkDirty(int x0, int y0, int x1, int y1)
+    {
+        _dirtyMinX = std::min(_dirtyMinX, x0); _dirtyMinY = std::min(_dirtyMinY, y0);
+        _dirtyMaxX = std::max(_dirtyMaxX, x1); _dirtyMaxY = std::max(_dirtyMaxY, y1);
+    }
+
+    bool HasDirtyRegion() const { return _dirtyMinX < _dirtyMaxX && _dirtyMinY < _dirtyMaxY; }
+    void ClearDirtyRegion() { _dirtyMinX = _dirtyMinY = INT_MAX; _dirtyMaxX = _dirtyMaxY = INT_MIN; }
+
+    Page(int width, int height);
+    ~Page();
+};
 
-}
+extern BufferUploads::IManager* gBufferUploads;
 
-bool CharSlotArray::IsFull() const
+FT_FontTextureMgr::Page::Page(int width, int height)
 {
-    if (_usedCount >= _array.size()) {
-        return true;
-    }
-
-    return false;
+        //  The texture is only created when we have a buffer uploads manager (so the
+        //  atlas can still be used without a device, eg, for measuring text)
+    if (gBufferUploads)
+        _texture = std::make_unique<FontTexture2D>(width, height, RenderCore::Metal::NativeFormat::R8_UNORM);
+    _cpuData.resize(width*height, 0);
+    _nextShelfY = 0;
+    ClearDirtyRegion();
 }
 
-static bool IsUsed(const FontChar& fc) { return fc.ch != 0; }
-
-FontCharID CharSlotArray::UseEmptySlot(const FontChar& fc)
-{
-    uint32 maxCount = (uint32)_array.size();
-    for (uint32 i = 0; i < maxCount; i++) {
-        if (!IsUsed(_array[i])) {
-            _array[i] = fc;
-            _usedCount++;
-            return FontCharID(i);
-        }
-    }
+FT_FontTextureMgr::Page::~Page() {}
 
-    //cannot be reached
-    return FontCharID_Invalid;
-}
+//-------------------------------------------------------------------------------------------------
 
-bool CharSlotArray::ReleaseSlot(FontCharID id)
+    //  Renders glyphs with FreeType in a background thread. FreeType objects can't be shared
+    //  between threads, so we have our own FT_Library, and our own FT_Face for each FontFace
+    //  (created from the same font file in memory).
+    //  Only one thread rasterises at a time (but the thread used can change from batch to batch)
+class FT_FontTextureMgr::Rasterizer : public std::enable_shared_from_this<Rasterizer>
 {
-    if (id < _array.size()) {
-        _array[id].ch = 0;
-        return true;
-    }
-    return false;
-}
+public:
+    class Request
+    {
+    public:
+        FontFace*       _owner;
+        FontCharID      _glyph;
+        uint64          _requestId;
+        int             _ch;
+        const void*     _fontData;
+        size_t          _fontDataSize;
+        long            _faceIndex;
+        int             _size;
+    };
+
+    class Result
+    {
+    public:
+        FontFace*       _owner;
+        FontCharID      _glyph;
+        uint64          _requestId;
+        bool            _success;
+        int             _left, _top;
+        int             _width, _height;
+        std::vector<uint8> _bitmap;
+    };
+
+    void                Queue(Request&& request);
+    std::vector<Result> TakeCompleted();
+    unsigned            Purge(const FontFace* owner);
+
+    Rasterizer();
+    ~Rasterizer();
+private:
+    Threading::Mutex        _queueLock;     // protects _pending, _completed & _jobInFlight
+    Threading::Mutex        _rasterLock;    // held while our FreeType objects are in use
+    std::vector<Request>    _pending;
+    std::vector<Result>     _completed;
+    bool                    _jobInFlight;
+
+    FT_Library              _library;
+    std::vector<std::pair<const FontFace*, FT_Face>> _faces;
+
+    void                    Execute();
+    std::vector<Request>    TakePending();
+    void                    PushCompleted(std::vector<Result>&& results);
+    unsigned                PurgeQueues(const FontFace* owner);
+    Result                  Rasterize(const Request& request);
+};
 
-const FontChar* CharSlotArray::GetLeastUsedChar() const
+void FT_FontTextureMgr::Rasterizer::Queue(Request&& request)
 {
-    const FontChar* fontCh = &_array[0];
-    uint32 maxCount = (uint32)_array.size();
-    for(uint32 i = 1; i < maxCount; i++) {
-        const FontChar& cursor = _array[i];
-        if (IsUsed(*fontCh) && IsUsed(cursor)) {
-            if (fontCh->usedTime > cursor.usedTime) {
-                fontCh = &cursor;
-            }
-        } else if (!IsUsed(*fontCh)) {       // (DavidJ -- is this correctly? Or was it intended to be 
-            fontCh = &_array[i];
+    bool startJob = false;
+    {
+        ScopedLock(_queueLock);
+        _pending.push_back(std::move(request));
+        if (!_jobInFlight) {
+            _jobInFlight = true;
+            startJob = true;
         }
     }
-    return fontCh;
-}
-
-const FontChar* CharSlotArray::GetChar(unsigned index) const
-{
-    if (index < _array.size()) {
-        return &_array[index];
-    }
-    return NULL;
-}
 
-FontChar* CharSlotArray::GetChar(unsigned index)
-{
-    if (index < _array.size()) {
-        return &_array[index];
+    if (startJob) {
+        auto self = shared_from_this();
+        ConsoleRig::GlobalServices::GetShortTaskThreadPool().Enqueue([self]() { self->Execute(); });
     }
-    return NULL;
 }
 
-//-------------------------------------------------------------------------------------------------
-
-class TextureHeap
-{
-private:
-    enum { CHUNK_MARGIN = 1 };
-
-    struct Chunk
-	{
-		int _start;
-		int _end;
-		Chunk *_prev;
-		Chunk *_next;
-		bool _used;
-
-        Chunk(int start, int end)
-        {
-            _start = start;
-	        _end   = end;
-	        _prev  = NULL;
-	        _next  = NULL;
-	        _used  = false;
-        }
-
-		inline int AllocSize() const { return _end - _start; }
-	};
-
-	typedef std::vector<std::unique_ptr<Chunk>> UsedList;
-	UsedList _usedList;
-
-	typedef std::vector<std::unique_ptr<Chunk>> EmptyList;
-	EmptyList _emptyList;
-
-    int _heapSize;
-
-public:
-    bool IsAllocable(int size);
-    std::unique_ptr<CharSlotArray> CreateCharSlotArray(int size, int maxCount);
-    void DestroyCharSlotArray(CharSlotArray* slot);
-
-private:
-    bool AllocNewChunk(int size, int& startPos, int& endPos);
-    void DeAllocChunk(int startPos);
-
-    Chunk* FindBestChunk(int size);
-    Chunk* FindUsedChunk(int startPos);
-
-public:
-    TextureHeap(int size);
-    virtual ~TextureHeap();
-};
-
-TextureHeap::TextureHeap(int size)
+auto FT_FontTextureMgr::Rasterizer::TakeCompleted() -> std::vector<Result>
 {
-    _heapSize = size;
-	_emptyList.push_back(std::make_unique<Chunk>(0, _heapSize));
+    std::vector<Result> result;
+    ScopedLock(_queueLock);
+    result.swap(_completed);
+    return result;
 }
 
-TextureHeap::~TextureHeap()
+auto FT_FontTextureMgr::Rasterizer::TakePending() -> std::vector<Request>
 {
-    if( !_usedList.empty() ) {
-		// GameWarning("TextureHeap - %ld chunks not released", _usedList.size());
-		_usedList.clear();
-	}
-
-	// if( _emptyList.size() != 1 ) {
-	// 	GameWarning("TextureHeap - too many empty chunks(%ld) remained", _emptyList.size() );
-	// }
-	_emptyList.clear();
+    std::vector<Request> result;
+    ScopedLock(_queueLock);
+    result.swap(_pending);
+    if (result.empty()) _jobInFlight = false;
+    return result;
 }
 
-bool TextureHeap::IsAllocable(int size)
+void FT_FontTextureMgr::Rasterizer::PushCompleted(std::vector<Result>&& results)
 {
-    if( FindBestChunk(size + CHUNK_MARGIN))
-        return true;
-
-    return false;
+    ScopedLock(_queueLock);
+    _completed.insert(_completed.end(), std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
 }
 
-std::unique_ptr<CharSlotArray> TextureHeap::CreateCharSlotArray(int size, int maxCount)
+void FT_FontTextureMgr::Rasterizer::Execute()
 {
-    int startPos, endPos;
-    AllocNewChunk(size + CHUNK_MARGIN, startPos, endPos);
-    return std::make_unique<CharSlotArray>(startPos, endPos, maxCount);
-}
+    ScopedLock(_rasterLock);
+    for (;;) {
+        auto batch = TakePending();
+        if (batch.empty()) break;
 
-void TextureHeap::DestroyCharSlotArray(CharSlotArray* slot)
-{
-    if(slot) {
-        DeAllocChunk(slot->GetSlotHeight());
-        // delete slot;     (delete is called by the owner, now)
+        std::vector<Result> results;
+        results.reserve(batch.size());
+        for (const auto& r:batch)
+            results.push_back(Rasterize(r));
+        PushCompleted(std::move(results));
     }
 }
 
-bool TextureHeap::AllocNewChunk(int size, int& startPos, int& endPos)
+auto FT_FontTextureMgr::Rasterizer::Rasterize(const Request& request) -> Result
 {
-    startPos = endPos = 0;
+    Result result;
+    result._owner = request._owner;
+    result._glyph = request._glyph;
+    result._requestId = request._requestId;
+    result._success = false;
+    result._left = result._top = result._width = result._height = 0;
 
-    Chunk *bestChunk = FindBestChunk(size);
-    if(!bestChunk) {
-        // GameWarning("TextureHeap - overflow");
-        return false;
+    auto i = std::find_if(_faces.begin(), _faces.end(), 
+        [&request](const std::pair<const FontFace*, FT_Face>& f) { return f.first == request._owner; });
+    if (i == _faces.end()) {
+        FT_Face face = nullptr;
+        FT_Error error = FT_New_Memory_Face(
+            _library, (const FT_Byte*)request._fontData, (FT_Long)request._fontDataSize, 
+            request._faceIndex, &face);
+        if (error) return result;
+        FT_Set_Pixel_Sizes(face, 0, request._size);
+        i = _faces.insert(_faces.end(), std::make_pair(request._owner, face));
     }
 
-    std::unique_ptr<Chunk> usedChunk;
-    if(bestChunk->AllocSize() == size) {
-        EmptyList::iterator i = std::remove_if(_emptyList.begin(), _emptyList.end(), [=](const std::unique_ptr<Chunk>& i){return i.get() == bestChunk;});
-        std::swap(usedChunk, *i);
-        _emptyList.erase(i);
-    } else {
-        usedChunk = std::make_unique<Chunk>(bestChunk->_start, bestChunk->_start + size);
+    FT_Error error = FT_Load_Char(i->second, request._ch, FT_LOAD_RENDER | FT_LOAD_NO_AUTOHINT);
+    if (error) return result;
 
-		bestChunk->_start = usedChunk->_end;
-		usedChunk->_prev = bestChunk->_prev;
-
-        if( bestChunk->_prev )
-			bestChunk->_prev->_next = usedChunk.get();
-
-		usedChunk->_next = bestChunk;
-		bestChunk->_prev = usedChunk.get();
+    const auto& bitmap = i->second->glyph->bitmap;
+    result._left = i->second->glyph->bitmap_left;
+    result._top = i->second->glyph->bitmap_top;
+    if (bitmap.pixel_mode == FT_PIXEL_MODE_GRAY) {
+        result._width = (int)bitmap.width;
+        result._height = (int)bitmap.rows;
+        result._bitmap.resize(result._width * result._height);
+        for (int y=0; y<result._height; ++y)
+            XlCopyMemory(
+                &result._bitmap[y*result._width], 
+                bitmap.buffer + y * bitmap.pitch, result._width);
     }
-
-    usedChunk->_used = true;
-	startPos = usedChunk->_start;
-    endPos   = usedChunk->_end;
-    _usedList.push_back(std::move(usedChunk));
-	return true;
+    result._success = true;
+    return result;
 }
 
-void TextureHeap::DeAllocChunk(int startPos)
+unsigned FT_FontTextureMgr::Rasterizer::PurgeQueues(const FontFace* owner)
 {
-	Chunk *usedChunk = FindUsedChunk(startPos);
-
-    Chunk *prev = usedChunk->_prev;
-	if( prev && !prev->_used ) {
-		usedChunk->_start = prev->_start;
-		usedChunk->_prev  = prev->_prev;
-
-        if( prev->_prev )
-			prev->_prev->_next = usedChunk;
-
-        _emptyList.erase(std::remove_if(_emptyList.begin(), _emptyList.end(), [=](const std::unique_ptr<Chunk>& i){return i.get() == prev;}));
-	}
-
-	Chunk *next = usedChunk->_next;
-	if( next && !next->_used ) {
-		usedChunk->_end  = next->_end;
-		usedChunk->_next = next->_next;
-		
-        if( next->_next )
-			next->_next->_prev = usedChunk;
-
-		_emptyList.erase(std::remove_if(_emptyList.begin(), _emptyList.end(), [=](const std::unique_ptr<Chunk>& i){return i.get() == next;}));
-	}
-
-    UsedList::iterator i = std::partition(_usedList.begin(), _usedList.end(), [=](const std::unique_ptr<Chunk>& i){return i.get() != usedChunk;});
-    assert(*i);
-    std::unique_ptr<Chunk> newPtr; std::swap(newPtr, *i);
-    _usedList.erase(i);
-	newPtr->_used = false;
-	_emptyList.push_back(std::move(newPtr));
+    ScopedLock(_queueLock);
+    auto p = std::remove_if(_pending.begin(), _pending.end(), 
+        [owner](const Request& r) { return !owner || r._owner == owner; });
+    unsigned purgedCount = (unsigned)std::distance(p, _pending.end());
+    _pending.erase(p, _pending.end());
+    auto c = std::remove_if(_completed.begin(), _completed.end(), 
+        [owner](const Result& r) { return !owner || r._owner == owner; });
+    purgedCount += (unsigned)std::distance(c, _completed.end());
+    _completed.erase(c, _completed.end());
+    return purgedCount;
 }
 
-TextureHeap::Chunk* TextureHeap::FindBestChunk(int size)
+unsigned FT_FontTextureMgr::Rasterizer::Purge(const FontFace* owner)
 {
-    EmptyList::iterator iter = _emptyList.begin();
-    for( ; iter != _emptyList.end(); ++iter) {
-        if((*iter)->AllocSize() >= size)
-            return iter->get();
-    }
+        //  Removes any requests and results for the given face (or for all faces, if
+        //  "owner" is null). Waits for any batch in flight, so the FT_Faces we release
+        //  (and the font data they refer to) are no longer in use.
+    ScopedLock(_rasterLock);
+    unsigned purgedCount = PurgeQueues(owner);
 
-    return NULL;
+    auto f = std::partition(_faces.begin(), _faces.end(), 
+        [owner](const std::pair<const FontFace*, FT_Face>& f) { return owner && f.first != owner; });
+    for (auto i=f; i!=_faces.end(); ++i)
+        FT_Done_Face(i->second);
+    _faces.erase(f, _faces.end());
+    return purgedCount;
 }
 
-TextureHeap::Chunk* TextureHeap::FindUsedChunk(int startPos)
+FT_FontTextureMgr::Rasterizer::Rasterizer()
 {
-    UsedList::iterator iter = _usedList.begin();
-    for( ; iter != _usedList.end(); ++iter) {
-        if((*iter)->_start == startPos)
-            return iter->get();
-    }
+    _jobInFlight = false;
+    _library = nullptr;
+    FT_Init_FreeType(&_library);
+}
 
-	// GameWarning("TextureHeap - cannot find used chunk(%d)", startPos);
-	return NULL;
+FT_FontTextureMgr::Rasterizer::~Rasterizer()
+{
+    for (auto& f:_faces) FT_Done_Face(f.second);
+    _faces.clear();
+    if (_library) FT_Done_FreeType(_library);
 }
 
-//------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
 
 FT_FontTextureMgr::FT_FontTextureMgr()
 {
     _texWidth = 0;
     _texHeight = 0;
-
-    // _tex = 0;
-
+    _maxPageCount = 0;
+    _frameIndex = 0;
+    _nextRequestId = 1;
+    XlZeroMemory(_metrics);
     _needReset = false;
 }
 
 FT_FontTextureMgr::~FT_FontTextureMgr()
 {
-    if(!_faceList.empty()) {
-        FontFaceList::iterator faceIter = _faceList.begin();
-        for( ; faceIter != _faceList.end(); ++faceIter) {
-            std::unique_ptr<FontFace>& face = *faceIter;
-
-            CharSlotArrayList::iterator slotIter = face->_slotList.begin();
-            for( ; slotIter != face->_slotList.end(); ++slotIter) {
-                _texHeap->DestroyCharSlotArray((*slotIter).get());
-            }
-
-            face.reset();
-        }
-        _faceList.clear();
+    if (_rasterizer) {
+        _rasterizer->Purge(nullptr);
+        _rasterizer.reset();
     }
-
-    _texHeap.reset();
-}
-
-static int NextPower2(int n)
-{
-    int result = 1;
-    while (result < n) result <<= 1;
-    return result;
+    _faceList.clear();
+    _pages.clear();
 }
 
 extern BufferUploads::IManager* gBufferUploads;
@@ -387,29 +356,6 @@ FontTexture2D::~FontTexture2D()
     }
 }
 
-void FontTexture2D::UpdateGlyphToTexture(FT_GlyphSlot glyph, int offX, int offY, int width, int height)
-{
-    auto packet = BufferUploads::CreateBasicPacket(
-        width*height, nullptr, BufferUploads::TexturePitches(width, width*height));
-    uint8* data = (uint8*)packet->GetData();
-
-    int widthCursor = 0;
-    for (int j = 0; j < height; ++j) {
-        for (int i = 0; i < width; ++i) {
-            if (glyph->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY) {
-                uint8 pixel = 0;
-                if (i < int(glyph->bitmap.width) && j < int(glyph->bitmap.rows))
-                    pixel = glyph->bitmap.buffer[i + glyph->bitmap.width * j];
-
-                data[i + widthCursor] = pixel;
-            }
-        }
-        widthCursor += width;
-    }
-
-    UpdateToTexture(packet.get(), offX, offY, width, height);
-}
-
 void FontTexture2D::UpdateToTexture(BufferUploads::DataPacket* packet, int offX, int offY, int width, int height)
 {
     if (_transaction == ~BufferUploads::TransactionID(0x0)) {
@@ -433,40 +379,215 @@ void* FontTexture2D::GetUnderlying() const
     return _locator?_locator->GetUnderlying():nullptr;
 }
 
-bool FT_FontTextureMgr::Init(int texWidth, int texHeight)
+
+
+bool FT_FontTextureMgr::Init(int texWidth, int texHeight, unsigned maxPageCount, bool asyncRasterisation)
 {
     _texWidth = NextPower2(texWidth);
     _texHeight = NextPower2(texHeight);
-    _texture = std::make_unique<FontTexture2D>(_texWidth, _texHeight, RenderCore::Metal::NativeFormat::R8_UNORM);
-    _texHeap = std::make_unique<TextureHeap>(_texHeight);
+    _maxPageCount = std::max(1u, maxPageCount);
+    _pages.push_back(std::make_unique<Page>(_texWidth, _texHeight));
+    if (asyncRasterisation)
+        _rasterizer = std::make_shared<Rasterizer>();
     return true;
 }
 
-void FT_FontTextureMgr::CheckTextureValidate(FT_Face face, int size, FontChar *fc)
+void FT_FontTextureMgr::OnFrameBarrier()
+{
+        //  Write the glyphs completed in the background into our pages. The glyph
+        //  may have been evicted (or deleted) since the request was made -- in that
+        //  case, the result is ignored
+    if (_rasterizer) {
+        auto completed = _rasterizer->TakeCompleted();
+        for (const auto& r:completed) {
+            --_metrics._pendingGlyphs;
+            auto* glyph = r._owner->GetGlyph(r._glyph);
+            if (!glyph || glyph->_pendingRequest != r._requestId) continue;
+
+            glyph->_pendingRequest = 0;
+            if (r._success) {
+                CommitGlyph(*glyph, r._left, r._top, r._width, r._height, AsPointer(r._bitmap.cbegin()), r._width);
+            } else
+                CommitGlyph(*glyph, glyph->_boxLeft, glyph->_boxTop, 0, 0, nullptr, 0);
+        }
+    }
+
+        //  Upload the dirty region of each page as a single update
+    for (auto& p:_pages)
+        UploadDirtyRegion(*p);
+
+    ++_frameIndex;
+}
+
+void FT_FontTextureMgr::UploadDirtyRegion(Page& page)
 {
-    if(!fc->needTexUpdate /*|| fc->tex*/) {
-        return;
+    if (!page.HasDirtyRegion()) return;
+
+    int width = page._dirtyMaxX - page._dirtyMinX, height = page._dirtyMaxY - page._dirtyMinY;
+    if (page._texture) {
+        auto packet = BufferUploads::CreateBasicPacket(
+            width*height, nullptr, BufferUploads::TexturePitches(width, width*height));
+        uint8* dst = (uint8*)packet->GetData();
+        for (int y=0; y<height; ++y)
+            XlCopyMemory(
+                &dst[y*width], 
+                &page._cpuData[(page._dirtyMinY+y)*_texWidth + page._dirtyMinX], width);
+        page._texture->UpdateToTexture(packet.get(), page._dirtyMinX, page._dirtyMinY, width, height);
     }
 
-    FT_Error error = FT_Load_Char(face, fc->ch, FT_LOAD_RENDER | FT_LOAD_NO_AUTOHINT);
-    if (error)  return;
+    ++_metrics._pageUpdates;
+    _metrics._pageUpdateBytes += width*height;
+    page.ClearDirtyRegion();
+}
 
-    FT_GlyphSlot glyph = face->glyph;
+void FT_FontTextureMgr::CommitGlyph(FontFace::Glyph& glyph, int left, int top, int width, int height, const uint8* bitmap, int pitch)
+{
+    assert(glyph._page < _pages.size());
+    auto& page = *_pages[glyph._page];
 
-    int updateWidth = 0;
-    int updateHeight = 0;
+        //  The bitmap should fit in the box we calculated from the outline. But we clamp, 
+        //  just in case (for example, if the hinting has moved the outline)
+    width = std::min(width, glyph._slotWidth - GlyphMargin);
+    height = std::min(height, glyph._slotHeight - GlyphMargin);
 
-    if(0/*fc->tex == _tex*/) {
-        updateWidth = face->size->metrics.max_advance / 64;
-        updateHeight = size;
-    } else {
-        updateWidth = NextPower2(glyph->bitmap.width);
-        updateHeight = NextPower2(glyph->bitmap.rows);
+        //  We write the entire slot (including the margin), so we don't need to
+        //  clear the slot when it's reused
+    for (int y=0; y<glyph._slotHeight; ++y) {
+        uint8* dst = &page._cpuData[(glyph._slotY+y)*_texWidth + glyph._slotX];
+        if (y < height) {
+            XlCopyMemory(dst, bitmap + y*pitch, width);
+            XlSetMemory(dst + width, 0, glyph._slotWidth - width);
+        } else
+            XlSetMemory(dst, 0, glyph._slotWidth);
+    }
+    page.MarkDirty(glyph._slotX, glyph._slotY, glyph._slotX + glyph._slotWidth, glyph._slotY + glyph._slotHeight);
+
+    auto& fc = glyph._char;
+    fc.left     = (float)left;
+    fc.top      = (float)top;
+    fc.width    = (float)width;
+    fc.height   = (float)height;
+    fc.u0       = (float)glyph._slotX / _texWidth;
+    fc.v0       = (float)glyph._slotY / _texHeight;
+    fc.u1       = (float)(glyph._slotX + width) / _texWidth;
+    fc.v1       = (float)(glyph._slotY + height) / _texHeight;
+    fc.offsetX  = glyph._slotX;
+    fc.offsetY  = glyph._slotY;
+    fc.needTexUpdate = false;
+    ++_metrics._glyphsRasterised;
+}
+
+bool FT_FontTextureMgr::AllocateGlyph(FontFace& face, FontCharID id)
+{
+    auto& glyph = *face.GetGlyph(id);
+    glyph._allocationFrame = _frameIndex;
+
+    int width = glyph._slotWidth, height = glyph._slotHeight;
+    int shelfHeight = (height + ShelfHeightGranularity - 1) & ~(ShelfHeightGranularity - 1);
+    if (width > _texWidth || shelfHeight > _texHeight) {
+        ++_metrics._allocationFailures;
+        return false;
+    }
+
+    unsigned pageIndex = NoPage, shelfIndex = 0;
+
+        //  First, look for a shelf for glyphs of this height with some space left
+    for (unsigned p=0; p<_pages.size() && pageIndex == NoPage; ++p) {
+        const auto& shelves = _pages[p]->_shelves;
+        for (unsigned s=0; s<shelves.size(); ++s)
+            if (shelves[s]._glyphHeight == shelfHeight && (shelves[s]._cursorX + width) <= _texWidth) {
+                pageIndex = p; shelfIndex = s;
+                break;
+            }
     }
 
-    // UpdateGlyphToTexture(glyph, fc->tex->GetTextureID(), fc->offsetX, fc->offsetY, updateWidth, updateHeight);
+        //  Next, try to create a new shelf (possibly on a new page)
+    if (pageIndex == NoPage) {
+        for (unsigned p=0; p<_pages.size(); ++p)
+            if (_pages[p]->_nextShelfY + shelfHeight <= _texHeight) {
+                pageIndex = p;
+                break;
+            }
+
+        if (pageIndex == NoPage && _pages.size() < _maxPageCount) {
+            _pages.push_back(std::make_unique<Page>(_texWidth, _texHeight));
+            pageIndex = unsigned(_pages.size()-1);
+        }
 
-    fc->needTexUpdate = false;
+        if (pageIndex != NoPage) {
+            auto& page = *_pages[pageIndex];
+            Page::Shelf newShelf;
+            newShelf._y = page._nextShelfY;
+            newShelf._height = newShelf._glyphHeight = shelfHeight;
+            newShelf._cursorX = 0;
+            newShelf._lastUsedFrame = _frameIndex;
+            page._shelves.push_back(std::move(newShelf));
+            page._nextShelfY += shelfHeight;
+            shelfIndex = unsigned(page._shelves.size()-1);
+        }
+    }
+
+        //  Finally, evict the least recently used shelf that is big enough. Each page
+        //  finds it's own LRU shelf, and we take the oldest of those.
+        //  Shelves used in this frame can't be evicted (their glyphs might be in use)
+    if (pageIndex == NoPage) {
+        unsigned oldestFrame = _frameIndex;
+        for (unsigned p=0; p<_pages.size(); ++p) {
+            const auto& shelves = _pages[p]->_shelves;
+            for (unsigned s=0; s<shelves.size(); ++s)
+                if (shelves[s]._height >= shelfHeight && shelves[s]._lastUsedFrame < oldestFrame) {
+                    oldestFrame = shelves[s]._lastUsedFrame;
+                    pageIndex = p; shelfIndex = s;
+                }
+        }
+
+        if (pageIndex == NoPage) {
+            ++_metrics._allocationFailures;
+            return false;
+        }
+
+        EvictShelf(*_pages[pageIndex], shelfIndex);
+        _pages[pageIndex]->_shelves[shelfIndex]._glyphHeight = shelfHeight;
+    }
+
+    auto& shelf = _pages[pageIndex]->_shelves[shelfIndex];
+    glyph._page = pageIndex;
+    glyph._shelf = shelfIndex;
+    glyph._slotX = shelf._cursorX;
+    glyph._slotY = shelf._y;
+    shelf._cursorX += width;
+    shelf._lastUsedFrame = _frameIndex;
+    shelf._glyphs.push_back(std::make_pair(&face, id));
+    return true;
+}
+
+void FT_FontTextureMgr::EvictShelf(Page& page, unsigned shelfIndex)
+{
+    auto& shelf = page._shelves[shelfIndex];
+    ++_metrics._shelfEvictions;
+    _metrics._glyphEvictions += (unsigned)shelf._glyphs.size();
+
+        //  The glyphs are removed from their faces entirely; they will be
+        //  recreated if they are used again
+    auto glyphs = std::move(shelf._glyphs);
+    shelf._glyphs.clear();
+    for (const auto& g:glyphs)
+        g.first->ReleaseGlyph(g.second);
+    shelf._cursorX = 0;
+}
+
+void FT_FontTextureMgr::RemoveFromShelf(FontFace& face, FontCharID id)
+{
+    auto* glyph = face.GetGlyph(id);
+    if (!glyph || glyph->_page == NoPage) return;
+
+    auto& shelf = _pages[glyph->_page]->_shelves[glyph->_shelf];
+    shelf._glyphs.erase(
+        std::remove(shelf._glyphs.begin(), shelf._glyphs.end(), std::make_pair(&face, id)),
+        shelf._glyphs.end());
+    if (shelf._glyphs.empty())
+        shelf._cursorX = 0;
+    glyph->_page = NoPage;
 }
 
 void FT_FontTextureMgr::RequestReset()
@@ -483,267 +604,215 @@ void FT_FontTextureMgr::Reset()
 {
     if(!IsNeedReset())  return;
 
-    FontFaceList::iterator faceIter = _faceList.begin();
-    for( ; faceIter != _faceList.end(); ++faceIter) {
-        std::unique_ptr<FontFace>& face = *faceIter;
+    if (_rasterizer) _rasterizer->Purge(nullptr);
+    _metrics._pendingGlyphs = 0;
+    _faceList.clear();
 
-        CharSlotArrayList::iterator slotIter = face->_slotList.begin();
-        for( ; slotIter != face->_slotList.end(); ++slotIter) {
-            _texHeap->DestroyCharSlotArray((*slotIter).get());
-        }
+    for (auto& p:_pages) {
+        p->_shelves.clear();
+        p->_nextShelfY = 0;
     }
-    _faceList.clear();
     _needReset = false;
 }
 
-FontCharID FT_FontTextureMgr::FontFace::CreateChar(int ch, FontTexKind kind)
+auto FT_FontTextureMgr::GetMetrics() const -> Metrics
 {
-    // if (!_tex) {
-    //     // GameWarning("FT_FontTextureMgr::CreateChar - not initialized");
-    //     return 0;
-    // }
+    auto result = _metrics;
+    result._pageCount = (unsigned)_pages.size();
+    return result;
+}
+
+//-------------------------------------------------------------------------------------------------
 
-    FT_Error error = FT_Load_Char(_face, ch, FT_LOAD_RENDER | FT_LOAD_NO_AUTOHINT);
+FontCharID FT_FontTextureMgr::FontFace::CreateChar(int ch)
+{
+        //  We only need the metrics here -- the bitmap is rendered later (usually
+        //  in a background thread)
+    FT_Error error = FT_Load_Char(_face, ch, FT_LOAD_NO_AUTOHINT);
     if (error) {
         if(ch != ' ') {
-            // GameWarning("Failed to load character \'%d\'", ch);
-
-            // FontChar* fc = CreateEmptyFontChar(ch);
-            // fc->xAdvance = size * 0.5f;
-            // return fc;
             return FontCharID_Invalid;
         } else {
-            error = FT_Load_Char(_face, ch, FT_LOAD_RENDER);
+            error = FT_Load_Char(_face, ch, FT_LOAD_DEFAULT);
             if (error) {
-                // FontChar* fc = CreateEmptyFontChar(ch);
-                // fc->xAdvance = size * 0.5f;
-                // return fc;
                 return FontCharID_Invalid;
             }
         }
     }
 
     FT_GlyphSlot glyph = _face->glyph;
+    ++_mgr->_metrics._glyphMisses;
 
-    FontChar fc(ch);
-    fc.left     = (float)glyph->bitmap_left;
-    fc.top      = (float)glyph->bitmap_top;
-    fc.width    = (float)glyph->bitmap.width;
-    fc.height   = (float)glyph->bitmap.rows;
-    fc.xAdvance = (float)glyph->advance.x / 64.0f;
-
-    // assert((face->size->metrics.max_advance / 64) < glyph->bitmap.width);
-
-    int offsetX, offsetY;
-    FontCharID charID = FindEmptyCharSlot(fc, &offsetX, &offsetY, kind);
-    if (charID != FontCharID_Invalid) {
-        if (_texture) {
-            _texture->UpdateGlyphToTexture( glyph, offsetX, offsetY,
-                                            _face->size->metrics.max_advance / 64, _size);
-        }
-        return charID;
+    FontCharID id;
+    if (!_freeGlyphs.empty()) {
+        id = _freeGlyphs.back();
+        _freeGlyphs.pop_back();
     } else {
-        return FontCharID_Invalid;
-        // RequestReset();
-        // 
-        // int texWidth = NextPower2(glyph->bitmap.width);
-        // int texHeight = NextPower2(glyph->bitmap.rows);
-        // // ITexture *newTex = CreateTempTexture(glyph, texWidth, texHeight);
-        // // fc->tex = newTex;
-        // 
-        // fc.u0 = 0.0f;
-        // fc.v0 = 0.0f;
-        // fc.u1 = (float)glyph->bitmap.width / texWidth;
-        // fc.v1 = (float)glyph->bitmap.rows / texHeight;
-        // 
-        // fc.offsetX = 0;
-        // fc.offsetY = 0;
-    }
-}
+        id = FontCharID(_glyphs.size());
+        _glyphs.push_back(nullptr);
+    }
+    _glyphs[id] = std::make_unique<Glyph>(ch);
+    auto& result = *_glyphs[id];
+
+        //  Find the box for the rendered bitmap. This is the same calculation
+        //  FreeType's smooth renderer uses (the outline's control box, rounded
+        //  out to whole pixels)
+    bool isOutline = glyph->format == FT_GLYPH_FORMAT_OUTLINE;
+    int width, height;
+    if (isOutline) {
+        FT_BBox cbox;
+        FT_Outline_Get_CBox(&glyph->outline, &cbox);
+        int xMin = int(cbox.xMin & ~63), yMin = int(cbox.yMin & ~63);
+        int xMax = int((cbox.xMax + 63) & ~63), yMax = int((cbox.yMax + 63) & ~63);
+        result._boxLeft = xMin >> 6;
+        result._boxTop = yMax >> 6;
+        width = (xMax - xMin) >> 6;
+        height = (yMax - yMin) >> 6;
+    } else {
+        result._boxLeft = glyph->bitmap_left;
+        result._boxTop = glyph->bitmap_top;
+        width = (int)glyph->bitmap.width;
+        height = (int)glyph->bitmap.rows;
+    }
+
+        //  Until the bitmap is ready, the glyph is a blank placeholder with the correct advance
+    result._char.left       = (float)result._boxLeft;
+    result._char.top        = (float)result._boxTop;
+    result._char.width      = 0.f;
+    result._char.height     = 0.f;
+    result._char.xAdvance   = (float)glyph->advance.x / 64.0f;
+    result._char.needTexUpdate = true;
+    result._slotWidth       = width + GlyphMargin;
+    result._slotHeight      = height + GlyphMargin;
+
+    if (!_mgr->AllocateGlyph(*this, id))
+        return id;
+
+    if (_mgr->_rasterizer && isOutline) {
+        Rasterizer::Request request;
+        request._owner = this;
+        request._glyph = id;
+        request._requestId = _mgr->_nextRequestId++;
+        request._ch = ch;
+        request._fontData = _face->stream->base;
+        request._fontDataSize = _face->stream->size;
+        request._faceIndex = _face->face_index;
+        request._size = _size;
+        result._pendingRequest = request._requestId;
+        ++_mgr->_metrics._pendingGlyphs;
+        _mgr->_rasterizer->Queue(std::move(request));
+    } else {
+            //  render immediately (bitmap fonts, or when background rendering is disabled)
+        if (isOutline) {
+            error = FT_Render_Glyph(glyph, FT_RENDER_MODE_NORMAL);
+            if (error) return id;
+        }
+        if (glyph->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY) {
+            _mgr->CommitGlyph(
+                result, glyph->bitmap_left, glyph->bitmap_top, 
+                (int)glyph->bitmap.width, (int)glyph->bitmap.rows, 
+                glyph->bitmap.buffer, glyph->bitmap.pitch);
+        } else
+            _mgr->CommitGlyph(result, result._boxLeft, result._boxTop, 0, 0, nullptr, 0);
 
-FT_FontTextureMgr::FontFace* FT_FontTextureMgr::FindFontFace(FT_Face face, int size)
-{
-    auto it = _faceList.begin();
-    for( ; it != _faceList.end(); ++it) {
-        if((*it)->_face == face && (*it)->_size == size)
-            return (*it).get();
+            //  The glyph may be drawn before the next frame barrier, and its slot might
+            //  still contain an evicted glyph. So we must upload now.
+        _mgr->UploadDirtyRegion(*_mgr->_pages[result._page]);
     }
 
-    return NULL;
+    return id;
 }
 
-auto FT_FontTextureMgr::CreateFontFace(FT_Face face, int size) -> FontFace*
+auto FT_FontTextureMgr::FontFace::GetGlyph(FontCharID id) -> Glyph*
 {
-    if(!_texHeap->IsAllocable(size)) {
-        return nullptr;
-    } else {
-        {
-            std::unique_ptr<FontFace> fontFace = std::make_unique<FontFace>(_texHeap.get(), _texture.get(), _texWidth, _texHeight);
-            fontFace->_face = face;
-            fontFace->_size = size;
-            _faceList.insert(_faceList.begin(), std::move(fontFace));
-        }
-
-        int maxCount = _texWidth / (face->size->metrics.max_advance / 64);
-        CharSlotArray* newSlot = (*_faceList.begin())->_slotList.insert(
-            (*_faceList.begin())->_slotList.begin(), 
-            _texHeap->CreateCharSlotArray(size, maxCount))->get();
-
-        ClearFontTextureRegion(newSlot->GetSlotHeight(), newSlot->GetSlotHeightEnd());
-        return _faceList.begin()->get();
-    }
+    return (id < _glyphs.size()) ? _glyphs[id].get() : nullptr;
 }
 
-FontCharID FT_FontTextureMgr::FontFace::FindEmptyCharSlot(const FontChar& fc, int *x, int *y, FontTexKind kind)
+void FT_FontTextureMgr::FontFace::ReleaseGlyph(FontCharID id)
 {
-    CharSlotArray *slot = NULL;
-    unsigned slotIndex = ~unsigned(0x0);
-    CharSlotArrayList::iterator slotIter = _slotList.begin();
-    for( ; slotIter != _slotList.end(); ++slotIter) {
-        CharSlotArray *cursor = (*slotIter).get();
-        if(!cursor->IsFull()) {
-            slot = cursor;
-            slotIndex = (unsigned)std::distance(_slotList.begin(), slotIter);
-            break;
-        }
-    }
-
-    if(!slot) {
-        if(!_texHeap->IsAllocable(_size)) {
-            // slot = OverwriteLRUChar(*this, kind);
-            // if(!slot) {
-            //     // all character used current frame, will be reset
-            //     return false;
-            // }
-            return FontCharID_Invalid;
-        } else {
-            int maxCount = _texWidth / (_face->size->metrics.max_advance / 64);
-                // DavidJ -- note --    we have to add on to the back here. The _table member of
-                //                      FontFace keeps indices into the _slotList array. So we can't
-                //                      change the position of existing slot arrays
-            _slotList.push_back(_texHeap->CreateCharSlotArray(_size, maxCount));
-            slotIndex = unsigned(_slotList.size()-1);
-            slot = _slotList[slotIndex].get();
-
-            // ClearFontTextureRegion(slot->GetSlotHeight(), slot->GetSlotHeightEnd());
-        }
-    }
-
-    FontCharID result = slot->UseEmptySlot(fc);
-    if (result != FontCharID_Invalid) {
-        FontChar* newChar = slot->GetChar(result);
-        int offsetX = result * (_face->size->metrics.max_advance / 64);
-        int offsetY = slot->GetSlotHeight();
-        newChar->u0 = (float)offsetX / _texWidth;
-        newChar->v0 = (float)offsetY / _texHeight;
-        newChar->u1 = (float)(offsetX + _face->glyph->bitmap.width) / _texWidth;
-        newChar->v1 = (float)(offsetY + _face->glyph->bitmap.rows) / _texHeight;
-        newChar->offsetX = offsetX;
-        newChar->offsetY = offsetY;
-
-        *x = offsetX;
-        *y = offsetY;
-
-        return (result & 0xffff) | (slotIndex << 16);
-    }
-
-    return FontCharID_Invalid;
+    auto* glyph = GetGlyph(id);
+    if (!glyph) return;
+    _table[glyph->_char.ch] = FontCharID_Invalid;
+    _glyphs[id].reset();
+    _freeGlyphs.push_back(id);
 }
 
-FT_FontTextureMgr::FontFace::FontFace(TextureHeap* texHeap, FontTexture2D* texture, int texWidth, int texHeight)
-: _texHeap(texHeap), _texture(texture), _texWidth(texWidth), _texHeight(texHeight)
+void FT_FontTextureMgr::FontFace::DeleteChar(FontCharID fc)
 {
+    auto* glyph = GetGlyph(fc);
+    if (!glyph) return;
+    _mgr->RemoveFromShelf(*this, fc);
+    ReleaseGlyph(fc);
 }
 
-CharSlotArray* FT_FontTextureMgr::OverwriteLRUChar(FontFace* face, FontTexKind kind)
+std::pair<const FontChar*, const FontTexture2D*> FT_FontTextureMgr::FontFace::GetChar(int ch)
 {
-    CharSlotArrayList::iterator it = face->_slotList.begin();
-
-    CharSlotArray* minSlot = (*it).get();
-    const FontChar* minChar = minSlot->GetLeastUsedChar();
-
-    ++it;
-
-    for( ; it != face->_slotList.end(); ++it) {        
-        CharSlotArray* curSlot = (*it).get();
-        const FontChar* curChar = curSlot->GetLeastUsedChar();
-        if (minChar && curChar) {
-            if (minChar->usedTime > curChar->usedTime) {
-                minSlot = curSlot;
-                minChar = curChar;
-            }
-        } else if (!minChar) {
-            minSlot = curSlot;
-            minChar = curChar;
-        }
+    FontCharID& id = _table[ch];
+    if (id == FontCharID_Invalid) {
+        id = CreateChar(ch);
     }
 
-    assert(minChar);
-
-    // float minTime = minChar->usedTime;
-    // if(minTime - 0.001f <= desktop.time && desktop.time <= minTime + 0.001f) {
-    //     // all character is used current time, will be reset
-    //     return NULL;
-    // }
-
-    // if(RequestSacrificeChar(face->_face, minChar->ch, kind)) {
-    //     return minSlot;
-    // }
+    auto* glyph = GetGlyph(id);
+    if (!glyph) 
+        return std::pair<const FontChar*, const FontTexture2D*>(nullptr, nullptr);
 
-    //cannot be reached
-    // GameWarning("OverwriteLRUChar - cannot be reached");
-    return NULL;
-}
+    assert(glyph->_char.ch == ch);
 
-void FT_FontTextureMgr::ClearFontTextureRegion(int height, int heightEnd)
-{
-    int texHeight = heightEnd - height;
-    if(texHeight <= 0) {
-        return;
+        //  If there was no space in the atlas when this glyph was created, we
+        //  try again once per frame
+    if (glyph->_page == NoPage && glyph->_allocationFrame != _mgr->_frameIndex) {
+        DeleteChar(id);
+        id = CreateChar(ch);
+        glyph = GetGlyph(id);
+        if (!glyph) 
+            return std::pair<const FontChar*, const FontTexture2D*>(nullptr, nullptr);
     }
 
-    if(heightEnd > _texHeight) {
-        return;
+    if (glyph->_page != NoPage) {
+        auto& page = *_mgr->_pages[glyph->_page];
+        page._shelves[glyph->_shelf]._lastUsedFrame = _mgr->_frameIndex;
+        return std::make_pair(&glyph->_char, page._texture.get());
     }
 
-    auto blankBuf = BufferUploads::CreateBasicPacket(_texWidth * texHeight, nullptr, BufferUploads::TexturePitches(_texWidth, _texWidth*texHeight));
-    XlSetMemory(const_cast<void*>(blankBuf->GetData()), 0, _texWidth * texHeight);
-    _texture->UpdateToTexture(blankBuf.get(), 0, height, _texWidth, texHeight);
+        //  (no space in the atlas; the glyph has it's advance, but will draw nothing)
+    return std::make_pair(&glyph->_char, _mgr->_pages[0]->_texture.get());
 }
 
-void FT_FontTextureMgr::FontFace::DeleteChar(FontCharID fc)
+FT_FontTextureMgr::FontFace::FontFace(FT_FontTextureMgr* mgr, FT_Face face, int size)
+: _face(face), _size(size), _mgr(mgr)
 {
-    unsigned slotIndex = fc >> 16;
-    if (slotIndex < _slotList.size()) {
-        CharSlotArray* slot = _slotList[slotIndex].get();
-        slot->ReleaseSlot(fc & 0xffff);
-    }
 }
 
-const FontChar* FT_FontTextureMgr::FontFace::GetChar(int ch, FontTexKind kind)
+FT_FontTextureMgr::FontFace::~FontFace() {}
+
+FT_FontTextureMgr::FontFace* FT_FontTextureMgr::FindFontFace(FT_Face face, int size)
 {
-    FontCharID& id = _table[ch];
-    if (id == FontCharID_Invalid) {
-        id = CreateChar(ch, kind);
+    auto it = _faceList.begin();
+    for( ; it != _faceList.end(); ++it) {
+        if((*it)->_face == face && (*it)->_size == size)
+            return (*it).get();
     }
 
-    unsigned slotIndex = id >> 16;
-    if (slotIndex < _slotList.size()) {
-        auto* result = _slotList[slotIndex]->GetChar(id & 0xffff);
-        assert(result->ch == ch);
-        return result;
-    }
     return NULL;
 }
 
+auto FT_FontTextureMgr::CreateFontFace(FT_Face face, int size) -> FontFace*
+{
+    _faceList.insert(_faceList.begin(), std::make_unique<FontFace>(this, face, size));
+    return _faceList.begin()->get();
+}
+
 void FT_FontTextureMgr::DeleteFontFace(FTFont* font)
 {
     FontFace *face = FindFontFace(font->GetFace(), font->GetSize());
     if(face) {
-        CharSlotArrayList::iterator it = face->_slotList.begin();
-        for( ; it != face->_slotList.end(); ++it) {
-            _texHeap->DestroyCharSlotArray((*it).get());
-        }
+            //  The font data is about to be released, so we must make sure that the
+            //  rasterizer has finished with it
+        if (_rasterizer)
+            _metrics._pendingGlyphs -= _rasterizer->Purge(face);
+
+        for (FontCharID c=0; c<face->_glyphs.size(); ++c)
+            RemoveFromShelf(*face, c);
 
             //
             //      operator==( std::unique_ptr<A>, A* ) comparison is not defined
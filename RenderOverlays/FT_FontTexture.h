@@ -7,6 +7,7 @@
 #pragma once
 
 #include "FontPrimitives.h"
+#include "../Core/Types.h"
 #include <vector>
 #include <memory>
 
@@ -16,22 +17,29 @@ namespace RenderOverlays
 struct FontChar;
 
 class FTFont;
-class CharSlotArray;
-class TextureHeap;
-
 class FontTexture2D;
 
+/// <summary>Packs rendered glyphs into font textures</summary>
+/// Glyphs are packed into one or more atlas pages. Each page is divided into horizontal
+/// shelves, and each shelf holds glyphs of similar height (glyph heights are rounded up
+/// to a multiple of 4 pixels to find the shelf height). When all pages are full, the least
+/// recently used shelf is evicted (but never a shelf used in the current frame).
+///
+/// Glyph bitmaps are rasterised by FreeType in the short task thread pool. Until the bitmap
+/// is ready, a glyph has its final advance, but draws nothing. Completed glyphs are
+/// written into a CPU side copy of each page, and OnFrameBarrier() uploads the dirty
+/// region of each page as a single update. When asynchronous rasterisation is disabled,
+/// glyphs are rendered and uploaded as soon as they are created.
 class FT_FontTextureMgr
 {
 public:
-    bool            Init(int texWidth, int texHeight);
-    void            CheckTextureValidate(FT_Face face, int size, FontChar *fc);
+    bool            Init(int texWidth, int texHeight, unsigned maxPageCount = 4, bool asyncRasterisation = true);
+    void            OnFrameBarrier();
 
     bool            IsNeedReset() const;
     void            RequestReset();
     void            Reset();
 
-    typedef std::vector<std::unique_ptr<CharSlotArray>> CharSlotArrayList;
     struct FontCharTable
     {
         std::vector<std::vector<std::pair<ucs4, FontCharID> > >  _table;
@@ -44,46 +52,71 @@ public:
     class FontFace
     {
     public:
-        const FontChar*     GetChar(int ch, FontTexKind kind);
-        FontCharID          CreateChar(int ch, FontTexKind kind);
+        std::pair<const FontChar*, const FontTexture2D*> GetChar(int ch);
+        FontCharID          CreateChar(int ch);
         void                DeleteChar(FontCharID fc);
-        const FontTexture2D*    GetTexture() const { return _texture; }
 
-        FontFace(TextureHeap* texHeap, FontTexture2D* texture, int texWidth, int texHeight);
-    
-        CharSlotArrayList   _slotList;
+        FontFace(FT_FontTextureMgr* mgr, FT_Face face, int size);
+        ~FontFace();
+
         FT_Face             _face;
         int                 _size;
 
     private:
+        class Glyph;
         FontCharTable       _table;
+        std::vector<std::unique_ptr<Glyph>> _glyphs;
+        std::vector<FontCharID> _freeGlyphs;
+        FT_FontTextureMgr*  _mgr;
 
-        int                 _texWidth, _texHeight;
-        TextureHeap *       _texHeap;
-        FontTexture2D *     _texture;
+        Glyph*              GetGlyph(FontCharID id);
+        void                ReleaseGlyph(FontCharID id);
 
-        FontCharID          FindEmptyCharSlot(const FontChar& fc, int *x, int *y, FontTexKind kind);
+        friend class FT_FontTextureMgr;
     };
 
     FontFace*       FindFontFace(FT_Face face, int size);
     FontFace*       CreateFontFace(FT_Face face, int size);
     void            DeleteFontFace(FTFont* font);
 
+    class Metrics
+    {
+    public:
+        unsigned    _pageCount;
+        unsigned    _glyphMisses;
+        unsigned    _glyphsRasterised;
+        unsigned    _pendingGlyphs;
+        unsigned    _shelfEvictions;
+        unsigned    _glyphEvictions;
+        unsigned    _allocationFailures;
+        unsigned    _pageUpdates;
+        size_t      _pageUpdateBytes;
+    };
+    Metrics         GetMetrics() const;
+
     FT_FontTextureMgr();
     virtual ~FT_FontTextureMgr();
 
 private:
+    class Page;
+    class Rasterizer;
     typedef std::vector<std::unique_ptr<FontFace>> FontFaceList;
 
-    CharSlotArray*      OverwriteLRUChar(FontFace* face, FontTexKind kind);
-    void                ClearFontTextureRegion(int height, int heightEnd);
+    bool            AllocateGlyph(FontFace& face, FontCharID id);
+    void            EvictShelf(Page& page, unsigned shelfIndex);
+    void            CommitGlyph(FontFace::Glyph& glyph, int left, int top, int width, int height, const uint8* bitmap, int pitch);
+    void            RemoveFromShelf(FontFace& face, FontCharID id);
+    void            UploadDirtyRegion(Page& page);
 
     int                             _texWidth, _texHeight;
+    unsigned                        _maxPageCount;
+    unsigned                        _frameIndex;
+    uint64                          _nextRequestId;
     FontFaceList                    _faceList;
-    std::unique_ptr<TextureHeap>    _texHeap;
-    std::unique_ptr<FontTexture2D>  _texture;
+    std::vector<std::unique_ptr<Page>> _pages;
+    std::shared_ptr<Rasterizer>     _rasterizer;
+    Metrics                         _metrics;
     bool                            _needReset;
 };
 
 }
-
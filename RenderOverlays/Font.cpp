@@ -272,6 +272,7 @@ bool InitFontSystem(RenderCore::IDevice* device, BufferUploads::IManager* buffer
 
 void CleanupFontSystem()
 {
+    ClearTextLayoutCache();
     CleanupFTFontSystem();
     // CleanupImageTextFontSystem();
     gBufferUploads = nullptr;
@@ -283,6 +284,11 @@ void CheckResetFontSystem()
     CheckResetFTFontSystem();
 }
 
+void UpdateFontSystem()
+{
+    UpdateFTFontSystem();
+}
+
 int GetFontCount(FontTexKind kind)
 {
     switch (kind) {
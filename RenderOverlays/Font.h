@@ -92,6 +92,16 @@ namespace RenderOverlays
     bool InitFontSystem(RenderCore::IDevice* device, BufferUploads::IManager* bufferUploads);
     void CleanupFontSystem();
     void CheckResetFontSystem();
+    void UpdateFontSystem();        ///< call once per frame (uploads glyphs rendered in the background)
+    void ClearTextLayoutCache();
+
+    class TextLayoutCacheMetrics
+    {
+    public:
+        unsigned _hits, _misses;        ///< accumulated since startup
+        unsigned _layoutCount;
+    };
+    TextLayoutCacheMetrics GetTextLayoutCacheMetrics();
     int GetFontCount(FontTexKind kind);
     int GetFontFileCount();
 
@@ -140,6 +150,18 @@ namespace RenderOverlays
         UI_TEXT_STATE_INACTIVE_REVERSE, 
     };
 
+    /// <summary>Receives the quads generated when drawing text</summary>
+    /// Positions are snapped to pixel boundaries when the style has the "snap" option
+    /// set, and colors are in the vertex format (ie, ABGR)
+    class IGlyphQuadSink
+    {
+    public:
+        virtual void PushQuad(
+            const FontTexture2D* texture, const Quad& positions, const Quad& texCoords, 
+            unsigned colorABGR, float depth) = 0;
+        virtual ~IGlyphQuadSink();
+    };
+
     class TextStyle
     {
     public:
@@ -154,6 +176,14 @@ namespace RenderOverlays
                             float spaceExtra, float scale, float mx, float depth,
                             unsigned colorARGB, UI_TEXT_STATE textState, bool applyDescender, Quad* q) const;
 
+            /// <summary>Generates the quads for a string, without drawing them</summary>
+            /// String layouts (pen positions, kerning and color tags) are cached between calls,
+            /// so drawing the same string every frame only requires the glyph lookups.
+        float       Draw(   IGlyphQuadSink& sink, 
+                            float x, float y, const ucs4 text[], int maxLen,
+                            float spaceExtra, float scale, float mx, float depth,
+                            unsigned colorARGB, bool applyDescender, Quad* q) const;
+
         Float2     AlignText(const Quad& q, UiAlign align, const ucs4* text, int maxLen = -1);
         Float2     AlignText(const Quad& q, UiAlign align, float width, float indent);
         float       StringWidth(const ucs4* text, int maxlen = -1);
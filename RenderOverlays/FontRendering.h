@@ -20,7 +20,6 @@ public:
     ~FontTexture2D();
 
     void*   GetUnderlying() const;
-    void    UpdateGlyphToTexture(FT_GlyphSlot glyph, int offX, int offY, int width, int height);
     void    UpdateToTexture(BufferUploads::DataPacket* packet, int offX, int offY, int width, int height);
 
 private:
@@ -6,6 +6,7 @@
 
 #include "OverlayContext.h"
 #include "Font.h"
+#include "FontRendering.h"
 #include "../RenderCore/Metal/DeviceContext.h"
 #include "../RenderCore/Metal/DeviceContextImpl.h"
 #include "../RenderCore/Metal/Buffer.h"
@@ -286,15 +287,54 @@ namespace RenderOverlays
         }
     }
 
+        //  Writes text quads into the same vertex stream as everything else, so text
+        //  can be batched with other geometry, rather than forcing a flush
+    class ImmediateOverlayContext::GlyphQuadSink : public IGlyphQuadSink
+    {
+    public:
+        void PushQuad(const FontTexture2D* texture, const Quad& positions, const Quad& texCoords, unsigned colorABGR, float depth)
+        {
+            typedef Vertex_PCT Vertex;
+            if (!texture) return;
+
+            auto& context = *_context;
+            if ((context._writePointer + 6 * sizeof(Vertex)) > context._workingBufferSize) {
+                context.Flush();
+            }
+
+                //  Adjacent quads that use the same font texture can always be drawn together. 
+                //  We check for that first, to avoid building a new DrawCall for every glyph
+            if (    !context._drawCalls.empty() && context._drawCalls.back()._fontTexture == texture
+                &&  (context._drawCalls.back()._vertexOffset + context._drawCalls.back()._vertexCount * sizeof(Vertex)) == context._writePointer) {
+                context._drawCalls.back()._vertexCount += 6;
+            } else {
+                static const std::string textPixelShader = "basic.psh:PCT_Text";
+                context.PushDrawCall(DrawCall(
+                    unsigned(Metal::Topology::TriangleList), context._writePointer, 6, 
+                    context.AsVertexFormat<Vertex>(), ProjectionMode::P2D, 
+                    textPixelShader, std::string(), texture));
+            }
+
+            const Float2& mins = positions.min, maxs = positions.max;
+            auto* dst = (Vertex*)&context._workingBuffer.get()[context._writePointer];
+            dst[0] = Vertex(Float3(mins[0], mins[1], depth), colorABGR, Float2(texCoords.min[0], texCoords.min[1]));
+            dst[1] = Vertex(Float3(mins[0], maxs[1], depth), colorABGR, Float2(texCoords.min[0], texCoords.max[1]));
+            dst[2] = Vertex(Float3(maxs[0], mins[1], depth), colorABGR, Float2(texCoords.max[0], texCoords.min[1]));
+            dst[3] = Vertex(Float3(maxs[0], mins[1], depth), colorABGR, Float2(texCoords.max[0], texCoords.min[1]));
+            dst[4] = Vertex(Float3(mins[0], maxs[1], depth), colorABGR, Float2(texCoords.min[0], texCoords.max[1]));
+            dst[5] = Vertex(Float3(maxs[0], maxs[1], depth), colorABGR, Float2(texCoords.max[0], texCoords.max[1]));
+            context._writePointer += 6 * sizeof(Vertex);
+            ++context._metrics._glyphQuads;
+        }
+
+        GlyphQuadSink(ImmediateOverlayContext& context) : _context(&context) {}
+    private:
+        ImmediateOverlayContext* _context;
+    };
+
     float ImmediateOverlayContext::DrawText      (  const std::tuple<Float3, Float3>& quad, TextStyle* textStyle, ColorB col, 
                                                     TextAlignment::Enum alignment, const char text[], va_list args)
     {
-            //
-            //      Because _textStyle.Draw() will draw immediately, we need to flush out
-            //      any pending draws
-            //
-        Flush();
-
         ucs4 unicharBuffer[4096];
 
         utf8 buffer[dimof(unicharBuffer)];
@@ -312,17 +352,21 @@ namespace RenderOverlays
         if (!textStyle)
             textStyle = &_defaultTextStyle;
 
+        ++_metrics._textDraws;
+
         Quad q;
         q.min = Float2(std::get<0>(quad)[0], std::get<0>(quad)[1]);
         q.max = Float2(std::get<1>(quad)[0], std::get<1>(quad)[1]);
         Float2 alignedPosition = textStyle->AlignText(q, AsUiAlign(alignment), unicharBuffer);
+
+        GlyphQuadSink sink(*this);
         return textStyle->Draw(
-            _metalContext.get(), 
+            sink,
             alignedPosition[0], alignedPosition[1],
             unicharBuffer, dimof(unicharBuffer),
             0.f, 1.f, 0.f, 
             LinearInterpolate(std::get<0>(quad)[2], std::get<1>(quad)[2], 0.5f),
-            col.AsUInt32(), UI_TEXT_STATE_NORMAL, true, nullptr); // &q);
+            col.AsUInt32(), true, nullptr);
     }
 
     float ImmediateOverlayContext::StringWidth    (float scale, TextStyle* textStyle, const char text[], va_list args)
@@ -361,6 +405,9 @@ namespace RenderOverlays
 
     void ImmediateOverlayContext::ReleaseState() 
     {
+            //  Callers will often draw directly to the device context after this,
+            //  so we must commit everything that's pending
+        Flush();
     }
 
     struct ReciprocalViewportDimensions
@@ -392,7 +439,27 @@ namespace RenderOverlays
     {
         if (_writePointer != 0) {
 			Metal::VertexBuffer temporaryBuffer(_workingBuffer.get(), _writePointer);
+            bool textStates = false;
             for (auto i=_drawCalls.cbegin(); i!=_drawCalls.cend(); ++i) {
+                Metal::ShaderResourceView::UnderlyingResource fontTexture = nullptr;
+                if (i->_fontTexture) {
+                    fontTexture = (Metal::ShaderResourceView::UnderlyingResource)i->_fontTexture->GetUnderlying();
+                    if (!fontTexture) continue;     // (font texture is still pending a background upload)
+                }
+
+                    //  Text is drawn without depth testing or culling (and everything else
+                    //  with the states from SetState)
+                if ((i->_fontTexture != nullptr) != textStates) {
+                    textStates = i->_fontTexture != nullptr;
+                    if (textStates) {
+                        _metalContext->Bind(Techniques::CommonResources()._dssDisable);
+                        _metalContext->Bind(Techniques::CommonResources()._cullDisable);
+                    } else {
+                        _metalContext->Bind(Techniques::CommonResources()._dssReadWrite);
+                        _metalContext->Bind(Techniques::CommonResources()._defaultRasterizer);
+                    }
+                }
+
                 _metalContext->Bind((Metal::Topology::Enum)i->_topology);
 
                     //
@@ -416,9 +483,19 @@ namespace RenderOverlays
                 if (!i->_textureName.empty()) {
                     _metalContext->BindPS(MakeResourceList(
                         ::Assets::GetAssetDep<RenderCore::Assets::DeferredShaderResource>(i->_textureName.c_str()).GetShaderResource()));
+                } else if (fontTexture) {
+                    Metal::ShaderResourceView srv(fontTexture);
+                    _metalContext->BindPS(MakeResourceList(srv));
                 }
                 _metalContext->Draw(i->_vertexCount);
+                ++_metrics._drawCalls;
+            }
+
+            if (textStates) {
+                _metalContext->Bind(Techniques::CommonResources()._dssReadWrite);
+                _metalContext->Bind(Techniques::CommonResources()._defaultRasterizer);
             }
+            ++_metrics._flushes;
         }
 
         _drawCalls.clear();
@@ -445,6 +522,7 @@ namespace RenderOverlays
                 &&  prevCall._vertexFormat == drawCall._vertexFormat
                 &&  prevCall._pixelShaderName == drawCall._pixelShaderName
                 &&  prevCall._textureName == drawCall._textureName
+                &&  prevCall._fontTexture == drawCall._fontTexture
                 &&  (prevCall._vertexOffset + prevCall._vertexCount * VertexSize(prevCall._vertexFormat)) == drawCall._vertexOffset) {
                 prevCall._vertexCount += drawCall._vertexCount;
                 return;
@@ -639,6 +717,7 @@ namespace RenderOverlays
 
         _writePointer = 0;
         _drawCalls.reserve(64);
+        XlZeroMemory(_metrics);
 
         auto trans = Techniques::BuildGlobalTransformConstants(projDesc);
         _globalTransformConstantBuffer = MakeSharedPkt(
@@ -66,6 +66,16 @@ namespace RenderOverlays
         RenderCore::Techniques::ProjectionDesc      GetProjectionDesc() const;
         const RenderCore::Metal::UniformsStream&    GetGlobalUniformsStream() const;
 
+        class Metrics
+        {
+        public:
+            unsigned    _drawCalls;
+            unsigned    _flushes;
+            unsigned    _textDraws;
+            unsigned    _glyphQuads;
+        };
+        const Metrics&  GetMetrics() const { return _metrics; }
+
         ImmediateOverlayContext(
             RenderCore::IThreadContext* threadContext, 
             const RenderCore::Techniques::ProjectionDesc& projDesc = RenderCore::Techniques::ProjectionDesc());
@@ -74,6 +84,7 @@ namespace RenderOverlays
         class ShaderBox;
 
     private:
+        class GlyphQuadSink;
         RenderCore::IThreadContext*                         _deviceContext;
         std::shared_ptr<RenderCore::Metal::DeviceContext>   _metalContext;
         std::unique_ptr<uint8[]>	_workingBuffer;
@@ -100,17 +111,20 @@ namespace RenderOverlays
             std::string     _pixelShaderName;
             std::string     _textureName;
             ProjectionMode::Enum  _projMode;
+            const FontTexture2D* _fontTexture;
 
             DrawCall(   unsigned topology, unsigned vertexOffset, 
                         unsigned vertexCount, VertexFormat format, ProjectionMode::Enum projMode, 
                         const std::string& pixelShaderName = std::string(),
-                        const std::string& textureName = std::string()) 
+                        const std::string& textureName = std::string(),
+                        const FontTexture2D* fontTexture = nullptr) 
                 : _topology(topology), _vertexOffset(vertexOffset), _vertexCount(vertexCount)
                 , _vertexFormat(format), _pixelShaderName(pixelShaderName), _projMode(projMode)
-                , _textureName(textureName) {}
+                , _textureName(textureName), _fontTexture(fontTexture) {}
         };
 
         std::vector<DrawCall>   _drawCalls;
+        Metrics                 _metrics;
         void                    Flush();
         void                    SetShader(unsigned topology, VertexFormat format, ProjectionMode::Enum projMode, const std::string& pixelShaderName);
 
@@ -11,6 +11,8 @@
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/StringUtils.h"
 #include "../Utility/PtrUtils.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/IteratorUtils.h"
 #include "../Math/Vector.h"
 #include "../Core/Exceptions.h"
 #include <initializer_list>
@@ -225,230 +227,246 @@ TextStyleResources::TextStyleResources(const Desc& desc)
 TextStyleResources::~TextStyleResources()
 {}
 
-float   TextStyle::Draw(    
-    RenderCore::Metal::DeviceContext* renderer, 
-    float x, float y, const ucs4 text[], int maxLen,
-    float spaceExtra, float scale, float mx, float depth,
-    unsigned colorARGB, UI_TEXT_STATE textState, bool applyDescender, Quad* q) const
+    ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  The result of laying out a string: the pen position of each visible glyph (in unscaled
+        //  font units) and the colour set with "{Color:...}" tags. We don't store texture
+        //  coordinates here, because glyphs can move around in the font textures.
+class TextLayout
 {
-    if (!_font) {
-        return 0.f;
-    }
+public:
+    class Glyph
+    {
+    public:
+        ucs4        _ch;
+        Float2      _pen;
+        unsigned    _spaceCount;        // number of spaces before this glyph (for "spaceExtra")
+        unsigned    _colorOverride;
+    };
 
-    TRY {
+    std::vector<Glyph>  _glyphs;
+    float               _width;
+    unsigned            _spaceCount;
+    unsigned            _lastUsed;
 
-        using namespace RenderCore::Metal;
+    TextLayout(Font& font, bool outline, const ucs4 text[], size_t length);
+};
+
+TextLayout::TextLayout(Font& font, bool outline, const ucs4 text[], size_t length)
+{
+    int prevGlyph = 0;
+    Float2 pen(0.f, 0.f);
+    unsigned spaceCount = 0;
+    unsigned colorOverride = 0x0;
+    _glyphs.reserve(length);
+
+    for (size_t i = 0; i < length; ++i) {
+        ucs4 ch = text[i];
+        if (ch == '\n' || ch == '\r') continue;
+
+        if (!XlComparePrefixI((ucs4*)"{\0\0\0C\0\0\0o\0\0\0l\0\0\0o\0\0\0r\0\0\0:\0\0\0", &text[i], 7)) {
+            unsigned newColorOverride = 0;
+            unsigned parseLength = ParseColorValue(&text[i+7], &newColorOverride);
+            if (parseLength) {
+                colorOverride = newColorOverride;
+                i += 7 + parseLength;
+                while (i<length && text[i] != '}') ++i;
+                continue;
+            }
+        }
 
-        int prevGlyph = 0;
-        float xScale = scale;
-        float yScale = scale;
+        int curGlyph;
+        pen += font.GetKerning(prevGlyph, ch, &curGlyph);
+        prevGlyph = curGlyph;
 
-        if (_options.snap) {
-            x = xScale * (int)(0.5f + x / xScale);
-            y = yScale * (int)(0.5f + y / yScale);
+        const FontChar* fc = font.GetChar(ch).first;
+        if (!fc) continue;
+
+        Glyph glyph;
+        glyph._ch = ch;
+        glyph._pen = pen;
+        glyph._spaceCount = spaceCount;
+        glyph._colorOverride = colorOverride;
+        _glyphs.push_back(glyph);
+
+        pen[0] += fc->xAdvance;
+        if (outline) {
+            pen[0] += 2.f;
+        }
+        if (ch == ' ') {
+            ++spaceCount;
         }
+    }
 
-        float width     = _font->StringWidth(text, maxLen, spaceExtra, _options.outline);
-        float height    = _font->LineHeight() * yScale;
+    _width = pen[0];
+    _spaceCount = spaceCount;
+    _lastUsed = 0;
+}
 
-        if (textState != UI_TEXT_STATE_NORMAL) {
-            const float magicGap = 3.0f;
+        //  Layouts are shared by every draw of the same string with the same font. Most
+        //  overlay text is the same from frame to frame, so this avoids most of the 
+        //  kerning and glyph lookups.
+class TextLayoutCache
+{
+public:
+    std::shared_ptr<const TextLayout> Get(Font& font, bool outline, const ucs4 text[], int maxLen);
+    void Clear();
+    TextLayoutCacheMetrics GetMetrics();
 
-            Quad reverseBox;
-            reverseBox.min[0] = x;
-            reverseBox.min[1] = y - height + magicGap * yScale;
-            reverseBox.max[0] = x + width;
-            reverseBox.max[1] = y + magicGap * xScale;
+    TextLayoutCache() : _tick(0), _hits(0), _misses(0) {}
+private:
+    Threading::Mutex _lock;
+    std::vector<std::pair<uint64, std::shared_ptr<TextLayout>>> _layouts;
+    unsigned _tick;
+    unsigned _hits, _misses;
 
-            if(_options.outline) {
-                reverseBox.min[0] -= xScale;
-                reverseBox.min[1] -= yScale; 
-                reverseBox.max[0] -= xScale;
-                reverseBox.max[1] -= yScale;
-            }
+    static const size_t MaxCachedLayouts = 2048;
+};
 
-            if(mx > 0.0f) {
-                reverseBox.max[0] = std::min(reverseBox.max[0], mx);
-            }
+std::shared_ptr<const TextLayout> TextLayoutCache::Get(Font& font, bool outline, const ucs4 text[], int maxLen)
+{
+    size_t length = 0;
+    while (length < (size_t)(uint32)maxLen && text[length]) ++length;
+
+    uint64 hash = Hash64(text, PtrAdd(text, length * sizeof(ucs4)));
+    hash = HashCombine(hash, Hash64(font.GetPath(), (uint64(font.GetSize()) << 1) | uint64(outline)));
+
+    ScopedLock(_lock);
+    auto i = LowerBound(_layouts, hash);
+    if (i != _layouts.end() && i->first == hash) {
+        i->second->_lastUsed = ++_tick;
+        ++_hits;
+        return i->second;
+    }
+    ++_misses;
+
+    if (_layouts.size() >= MaxCachedLayouts) {
+            //  Release the least recently used half of the layouts
+        std::vector<unsigned> lastUsed;
+        lastUsed.reserve(_layouts.size());
+        for (const auto& l:_layouts) lastUsed.push_back(l.second->_lastUsed);
+        auto median = lastUsed.begin() + lastUsed.size()/2;
+        std::nth_element(lastUsed.begin(), median, lastUsed.end());
+        auto threshold = *median;
+        _layouts.erase(
+            std::remove_if(_layouts.begin(), _layouts.end(), 
+                [threshold](const std::pair<uint64, std::shared_ptr<TextLayout>>& l) { return l.second->_lastUsed < threshold; }),
+            _layouts.end());
+        i = LowerBound(_layouts, hash);
+    }
 
-            // ITexture* backTex = NULL;
-            // if (textState == UI_TEXT_STATE_REVERSE) {
-            //     backTex = desktop.greyTex;
-            // }
-            // else if( textState == UI_TEXT_STATE_INACTIVE_REVERSE) {
-            //     backTex = desktop.greyTex;
-            // }
-            // if (backTex) {
-            //     DrawQuad(list, reverseBox, Quad::MinMax(0,0,1,1), Color4::Create(1,1,1,1), backTex, true, false);
-            // }
-        }
+    auto layout = std::make_shared<TextLayout>(font, outline, text, length);
+    layout->_lastUsed = ++_tick;
+    _layouts.insert(i, std::make_pair(hash, layout));
+    return std::move(layout);
+}
 
-        // VertexShader& vshader    = GetResource<VertexShader>(vertexShaderSource);
-        // PixelShader& pshader     = GetResource<PixelShader>(pixelShaderSource);
+void TextLayoutCache::Clear()
+{
+    ScopedLock(_lock);
+    _layouts.clear();
+}
 
-        auto& res = RenderCore::Techniques::FindCachedBoxDep<TextStyleResources>(TextStyleResources::Desc());
-        renderer->Bind(res._boundInputLayout);     // have to bind a standard P2CT input layout
-        renderer->Bind(*res._shaderProgram);
-        renderer->Bind(Topology::TriangleList);
+TextLayoutCacheMetrics TextLayoutCache::GetMetrics()
+{
+    ScopedLock(_lock);
+    TextLayoutCacheMetrics result;
+    result._hits = _hits;
+    result._misses = _misses;
+    result._layoutCount = unsigned(_layouts.size());
+    return result;
+}
 
-        renderer->Bind(RenderCore::Techniques::CommonResources()._dssDisable);
-        renderer->Bind(RenderCore::Techniques::CommonResources()._cullDisable);
+static TextLayoutCache& GetTextLayoutCache()
+{
+    static TextLayoutCache cache;
+    return cache;
+}
 
-        {
-            ViewportDesc viewportDesc(*renderer);
-            ReciprocalViewportDimensions reciprocalViewportDimensions = { 1.f / float(viewportDesc.Width), 1.f / float(viewportDesc.Height), 0.f, 0.f };
-            
-            // ConstantBuffer constantBuffer(&reciprocalViewportDimensions, sizeof(reciprocalViewportDimensions));
-            // std::shared_ptr<std::vector<uint8>> packet = constantBuffer.GetUnderlying();
-            auto packet = RenderCore::MakeSharedPkt(
-                (const uint8*)&reciprocalViewportDimensions, 
-                (const uint8*)PtrAdd(&reciprocalViewportDimensions, sizeof(reciprocalViewportDimensions)));
-            res._boundUniforms.Apply(*renderer, UniformsStream(), UniformsStream(&packet, nullptr, 1));
-            
-            // renderer->BindVS(boundLayout, constantBuffer);
-            // renderer.BindVS(ResourceList<ConstantBuffer, 1>(std::make_tuple()));
-        }
-        const FontTexture2D *   currentBoundTexture = nullptr;
-        WorkingVertexSetPCT     workingVertices;
+void ClearTextLayoutCache()
+{
+    GetTextLayoutCache().Clear();
+}
 
-        // bool batchFont = _font->GetTexKind() == FTK_IMAGETEXT ? false : true;
-        float descent = 0.0f;
-        if (applyDescender) {
-            descent = _font->Descent();
-        }
-        float opacity = (colorARGB >> 24) / float(0xff);
-        unsigned colorOverride = 0x0;
-        for (uint32 i = 0; i < (uint32)maxLen; ++i) {
-            ucs4 ch = text[i];
-            if (!ch) break;
-            if (ch == '\n' || ch == '\r' || ch == '\0') continue;
-            if (mx > 0.0f && x > mx) {
-                return x;
-            }
+TextLayoutCacheMetrics GetTextLayoutCacheMetrics()
+{
+    return GetTextLayoutCache().GetMetrics();
+}
 
-            if (!XlComparePrefixI((ucs4*)"{\0\0\0C\0\0\0o\0\0\0l\0\0\0o\0\0\0r\0\0\0:\0\0\0", &text[i], 7)) {
-                unsigned newColorOverride = 0;
-                unsigned parseLength = ParseColorValue(&text[i+7], &newColorOverride);
-                if (parseLength) {
-                    colorOverride = newColorOverride;
-                    i += 7 + parseLength;
-                    while (i<(uint32)maxLen && text[i] && text[i] != '}') ++i;
-                    continue;
-                }
-            }
+static Quad SnapToPixels(const Quad& q)
+{
+    return Quad::MinMax(
+        (float)(int)(0.5f + q.min[0]), (float)(int)(0.5f + q.min[1]),
+        (float)(int)(0.5f + q.max[0]), (float)(int)(0.5f + q.max[1]));
+}
 
-            int curGlyph;
-            Float2 v = _font->GetKerning(prevGlyph, ch, &curGlyph);
-            x += xScale * v[0];
-            y += yScale * v[1];
-            prevGlyph = curGlyph;
-
-            std::pair<const FontChar*, const FontTexture2D*> charAndTexture = _font->GetChar(ch);
-            const FontChar* fc       = charAndTexture.first;
-            const FontTexture2D* tex = charAndTexture.second;
-            if(!fc) continue;
-
-                // Set the new texture if needed (changing state requires flushing completed work)
-            if (tex != currentBoundTexture) {
-                Flush(*renderer, workingVertices);
-
-                ShaderResourceView::UnderlyingResource sourceTexture = 
-                    (ShaderResourceView::UnderlyingResource)tex->GetUnderlying();
-                if (!sourceTexture) {
-                    throw ::Assets::Exceptions::PendingAsset("", "Pending background upload of font texture");
-                }
+IGlyphQuadSink::~IGlyphQuadSink() {}
 
-                ShaderResourceView shadRes(sourceTexture);
-                renderer->BindPS(RenderCore::MakeResourceList(shadRes));
-                currentBoundTexture = tex;
-            }
+float   TextStyle::Draw(    
+    IGlyphQuadSink& sink, 
+    float x, float y, const ucs4 text[], int maxLen,
+    float spaceExtra, float scale, float mx, float depth,
+    unsigned colorARGB, bool applyDescender, Quad* q) const
+{
+    if (!_font) {
+        return 0.f;
+    }
 
-            _font->TouchFontChar(fc);
+    float xScale = scale;
+    float yScale = scale;
 
-            float baseX = x + fc->left * xScale;
-            float baseY = y - (fc->top + descent) * yScale;
-            if (_options.snap) {
-                baseX = xScale * (int)(0.5f + baseX / xScale);
-                baseY = yScale * (int)(0.5f + baseY / yScale);
-            }
+    if (_options.snap) {
+        x = xScale * (int)(0.5f + x / xScale);
+        y = yScale * (int)(0.5f + y / yScale);
+    }
 
-            Quad pos    = Quad::MinMax(baseX, baseY, baseX + fc->width * xScale, baseY + fc->height * yScale);
-            Quad tc     = Quad::MinMax(fc->u0, fc->v0, fc->u1, fc->v1);
+    auto layout = GetTextLayoutCache().Get(*_font, !!_options.outline, text, maxLen);
 
-            if (_options.outline) {
-                Quad shadowPos;
-                unsigned shadowColor = RGBA8(Color4::Create(0, 0, 0, opacity));
-
-                shadowPos = pos;
-                shadowPos.min[0] -= xScale;
-                shadowPos.max[0] -= xScale;
-                shadowPos.min[1] -= yScale;
-                shadowPos.max[1] -= yScale;
-                if (!workingVertices.PushQuad(shadowPos, shadowColor, tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, shadowColor, tc, depth);
-                }
+    float descent = 0.0f;
+    if (applyDescender) {
+        descent = _font->Descent();
+    }
+    float opacity = (colorARGB >> 24) / float(0xff);
+    unsigned shadowColor = RGBA8(Color4::Create(0, 0, 0, opacity));
 
-                shadowPos = pos;
-                shadowPos.min[1] -= yScale;
-                shadowPos.max[1] -= yScale;
-                if (!workingVertices.PushQuad(shadowPos, shadowColor, tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, shadowColor, tc, depth);
-                }
+        //  (the outline is made from 8 copies of the glyph, offset by a pixel in each direction)
+    static const float outlineOffsets[][2] = { {-1.f, -1.f}, {0.f, -1.f}, {1.f, -1.f}, {-1.f, 0.f}, {1.f, 0.f}, {-1.f, 1.f}, {0.f, 1.f}, {1.f, 1.f} };
 
-                shadowPos = pos;
-                shadowPos.min[0] += xScale;
-                shadowPos.max[0] += xScale;
-                shadowPos.min[1] -= yScale;
-                shadowPos.max[1] -= yScale;
-                if (!workingVertices.PushQuad(shadowPos, shadowColor, tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, shadowColor, tc, depth);
-                }
+    auto place = [this](const Quad& q) { return _options.snap ? SnapToPixels(q) : q; };
 
-                shadowPos = pos;
-                shadowPos.min[0] -= xScale;
-                shadowPos.max[0] -= xScale;
-                if (!workingVertices.PushQuad(shadowPos, shadowColor, tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, shadowColor, tc, depth);
-                }
+    bool firstQuad = true;
+    for (const auto& g:layout->_glyphs) {
+        float penX = x + g._pen[0] * xScale + g._spaceCount * spaceExtra;
+        float penY = y + g._pen[1] * yScale;
+        if (mx > 0.0f && penX > mx) {
+            return penX;
+        }
 
-                shadowPos = pos;
-                shadowPos.min[0] += xScale;
-                shadowPos.max[0] += xScale;
-                if (!workingVertices.PushQuad(shadowPos, shadowColor, tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, shadowColor, tc, depth);
-                }
+        std::pair<const FontChar*, const FontTexture2D*> charAndTexture = _font->GetChar(g._ch);
+        const FontChar* fc       = charAndTexture.first;
+        const FontTexture2D* tex = charAndTexture.second;
+        if (!fc) continue;
 
-                shadowPos = pos;
-                shadowPos.min[0] -= xScale;
-                shadowPos.max[0] -= xScale;
-                shadowPos.min[1] += yScale;
-                shadowPos.max[1] += yScale;
-                if (!workingVertices.PushQuad(shadowPos, shadowColor, tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, shadowColor, tc, depth);
-                }
+        float baseX = penX + fc->left * xScale;
+        float baseY = penY - (fc->top + descent) * yScale;
+        if (_options.snap) {
+            baseX = xScale * (int)(0.5f + baseX / xScale);
+            baseY = yScale * (int)(0.5f + baseY / yScale);
+        }
 
-                shadowPos = pos;
-                shadowPos.min[1] += yScale;
-                shadowPos.max[1] += yScale;
-                if (!workingVertices.PushQuad(shadowPos, shadowColor, tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, shadowColor, tc, depth);
-                }
+        Quad pos    = Quad::MinMax(baseX, baseY, baseX + fc->width * xScale, baseY + fc->height * yScale);
+        Quad tc     = Quad::MinMax(fc->u0, fc->v0, fc->u1, fc->v1);
 
-                shadowPos = pos;
-                shadowPos.min[0] += xScale;
-                shadowPos.max[0] += xScale;
-                shadowPos.min[1] += yScale;
-                shadowPos.max[1] += yScale;
-                if (!workingVertices.PushQuad(shadowPos, shadowColor, tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, shadowColor, tc, depth);
+            //  (glyphs that are still being rendered have no size; but they still occupy space)
+        if (fc->width > 0.f && fc->height > 0.f) {
+            if (_options.outline) {
+                for (unsigned c=0; c<dimof(outlineOffsets); ++c) {
+                    Quad shadowPos = pos;
+                    shadowPos.min[0] += outlineOffsets[c][0] * xScale;
+                    shadowPos.max[0] += outlineOffsets[c][0] * xScale;
+                    shadowPos.min[1] += outlineOffsets[c][1] * yScale;
+                    shadowPos.max[1] += outlineOffsets[c][1] * yScale;
+                    sink.PushQuad(tex, place(shadowPos), tc, shadowColor, depth);
                 }
             }
 
@@ -458,47 +476,101 @@ float   TextStyle::Draw(
                 shadowPos.max[0] += xScale;
                 shadowPos.min[1] += yScale;
                 shadowPos.max[1] += yScale;
-                if (!workingVertices.PushQuad(shadowPos, RGBA8(Color4::Create(0,0,0,opacity)), tc, depth)) {
-                    Flush(*renderer, workingVertices);
-                    workingVertices.PushQuad(shadowPos, RGBA8(Color4::Create(0,0,0,opacity)), tc, depth);
-                }
+                sink.PushQuad(tex, place(shadowPos), tc, shadowColor, depth);
             }
 
-            if (!workingVertices.PushQuad(pos, RenderCore::ARGBtoABGR(colorOverride?colorOverride:colorARGB), tc, depth)) {
-                Flush(*renderer, workingVertices);
-                workingVertices.PushQuad(pos, RenderCore::ARGBtoABGR(colorOverride?colorOverride:colorARGB), tc, depth);
-            }
+            sink.PushQuad(tex, place(pos), tc, RenderCore::ARGBtoABGR(g._colorOverride?g._colorOverride:colorARGB), depth);
+        }
 
-            x += fc->xAdvance * xScale;
-            if (_options.outline) {
-                x += 2 * xScale;
-            }
-            if (ch == ' ') {
-                x += spaceExtra;
+        if (q) {
+            if (firstQuad) {
+                *q = pos;
+                firstQuad = false;
+            } else {
+                q->min[0] = std::min(q->min[0], pos.min[0]);
+                q->min[1] = std::min(q->min[1], pos.min[1]);
+                q->max[0] = std::max(q->max[0], pos.max[0]);
+                q->max[1] = std::max(q->max[1], pos.max[1]);
             }
+        }
+    }
 
-            if (q) {
-                if (i == 0) {
-                    *q = pos;
-                } else {
-                    if (q->min[0] > pos.min[0]) {
-                        q->min[0] = pos.min[0];
-                    }
-                    if (q->min[1] > pos.min[1]) {
-                        q->min[1] = pos.min[1];
-                    }
-
-                    if (q->max[0] < pos.max[0]) {
-                        q->max[0] = pos.max[0];
-                    }
-                    if (q->max[1] < pos.max[1]) {
-                        q->max[1] = pos.max[1];
-                    }
-                }
+    return x + layout->_width * xScale + layout->_spaceCount * spaceExtra;
+}
+
+        //  Draws glyph quads immediately, in batches that share a font texture
+class ImmediateGlyphSink : public IGlyphQuadSink
+{
+public:
+    void PushQuad(const FontTexture2D* texture, const Quad& positions, const Quad& texCoords, unsigned colorABGR, float depth)
+    {
+        using namespace RenderCore::Metal;
+
+            // Set the new texture if needed (changing state requires flushing completed work)
+        if (texture != _currentBoundTexture) {
+            RenderOverlays::Flush(*_renderer, _workingVertices);
+
+            ShaderResourceView::UnderlyingResource sourceTexture = 
+                (ShaderResourceView::UnderlyingResource)texture->GetUnderlying();
+            if (!sourceTexture) {
+                throw ::Assets::Exceptions::PendingAsset("", "Pending background upload of font texture");
             }
+
+            ShaderResourceView shadRes(sourceTexture);
+            _renderer->BindPS(RenderCore::MakeResourceList(shadRes));
+            _currentBoundTexture = texture;
+        }
+
+        if (!_workingVertices.PushQuad(positions, colorABGR, texCoords, depth, false)) {
+            RenderOverlays::Flush(*_renderer, _workingVertices);
+            _workingVertices.PushQuad(positions, colorABGR, texCoords, depth, false);
+        }
+    }
+
+    void Flush() { RenderOverlays::Flush(*_renderer, _workingVertices); }
+
+    ImmediateGlyphSink(RenderCore::Metal::DeviceContext& renderer) : _renderer(&renderer), _currentBoundTexture(nullptr) {}
+
+private:
+    RenderCore::Metal::DeviceContext*   _renderer;
+    const FontTexture2D*                _currentBoundTexture;
+    WorkingVertexSetPCT                 _workingVertices;
+};
+
+float   TextStyle::Draw(    
+    RenderCore::Metal::DeviceContext* renderer, 
+    float x, float y, const ucs4 text[], int maxLen,
+    float spaceExtra, float scale, float mx, float depth,
+    unsigned colorARGB, UI_TEXT_STATE /*textState*/, bool applyDescender, Quad* q) const
+{
+    if (!_font) {
+        return 0.f;
+    }
+
+    TRY {
+
+        using namespace RenderCore::Metal;
+
+        auto& res = RenderCore::Techniques::FindCachedBoxDep<TextStyleResources>(TextStyleResources::Desc());
+        renderer->Bind(res._boundInputLayout);     // have to bind a standard P2CT input layout
+        renderer->Bind(*res._shaderProgram);
+        renderer->Bind(Topology::TriangleList);
+
+        renderer->Bind(RenderCore::Techniques::CommonResources()._dssDisable);
+        renderer->Bind(RenderCore::Techniques::CommonResources()._cullDisable);
+
+        {
+            ViewportDesc viewportDesc(*renderer);
+            ReciprocalViewportDimensions reciprocalViewportDimensions = { 1.f / float(viewportDesc.Width), 1.f / float(viewportDesc.Height), 0.f, 0.f };
+            auto packet = RenderCore::MakeSharedPkt(
+                (const uint8*)&reciprocalViewportDimensions, 
+                (const uint8*)PtrAdd(&reciprocalViewportDimensions, sizeof(reciprocalViewportDimensions)));
+            res._boundUniforms.Apply(*renderer, UniformsStream(), UniformsStream(&packet, nullptr, 1));
         }
 
-        Flush(*renderer, workingVertices);
+        ImmediateGlyphSink sink(*renderer);
+        x = Draw(sink, x, y, text, maxLen, spaceExtra, scale, mx, depth, colorARGB, applyDescender, q);
+        sink.Flush();
 
     } CATCH(...) {
         // OutputDebugString("Suppressed exception while drawing text");
@@ -577,7 +649,7 @@ static Float2 AlignText(const Quad& q, Font* font, float stringWidth, float inde
 Float2 TextStyle::AlignText(const Quad& q, UiAlign align, const ucs4* text, int maxLen /*= -1*/)
 {
     assert(_font);
-    return RenderOverlays::AlignText(q, _font.get(), _font->StringWidth(text, maxLen), 0, align);
+    return RenderOverlays::AlignText(q, _font.get(), StringWidth(text, maxLen), 0, align);
 }
 
 Float2 TextStyle::AlignText(const Quad& q, UiAlign align, float width, float indent)
@@ -588,7 +660,8 @@ Float2 TextStyle::AlignText(const Quad& q, UiAlign align, float width, float ind
 
 float TextStyle::StringWidth(const ucs4* text, int maxlen)
 {
-    return _font->StringWidth(text, maxlen);
+        //  (this is the width of the string as drawn, so "{Color:...}" tags aren't included)
+    return GetTextLayoutCache().Get(*_font, !!_options.outline, text, maxlen)->_width;
 }
 
 int TextStyle::CharCountFromWidth(const ucs4* text, float width)
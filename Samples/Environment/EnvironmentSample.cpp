@@ -32,6 +32,7 @@
 #include "../../RenderCore/Techniques/ResourceBox.h"
 #include "../../SceneEngine/PlacementsQuadTreeDebugger.h"
 #include "../../SceneEngine/IntersectionTest.h"
+#include "../../SceneEngine/TerrainMaterialCompiler.h"
 
 #include "../../RenderCore/IDevice.h"
 #include "../../RenderCore/Metal/GPUProfiler.h"
@@ -153,6 +154,11 @@ namespace Sample
         compilers.AddCompiler(
             ToolsRig::AOSupplementCompiler::CompilerType,
             std::move(aoGeoCompiler));
+
+            // terrain material texture arrays are built on the CPU (no device required)
+        compilers.AddCompiler(
+            SceneEngine::TerrainMaterialArrayCompiler::CompileProcessType,
+            std::make_shared<SceneEngine::TerrainMaterialArrayCompiler>());
     }
 
     static PlatformRig::FrameRig::RenderResult RenderFrame(
@@ -290,6 +290,23 @@ namespace Sample
         return _pimpl->_envSettings; 
     }
 
+    void EnvironmentSceneParser::GetShadowCascadeBounds(
+        std::vector<PlatformRig::ShadowCascadeSceneBounds::AABB>& receivers,
+        std::vector<PlatformRig::ShadowCascadeSceneBounds::AABB>& casters) const
+    {
+            //  Terrain and placement cells both cast and receive shadows. Cell bounds
+            //  are coarse, but they are always available, and cheap to test.
+        if (_pimpl->_terrainManager) {
+            auto terrainCells = _pimpl->_terrainManager->GetCellBoundingBoxes();
+            receivers.insert(receivers.end(), terrainCells.begin(), terrainCells.end());
+        }
+        if (_pimpl->_placementsRenderer && _pimpl->_placementsCells) {
+            auto placementCells = _pimpl->_placementsRenderer->GetCellBoundingBoxes(*_pimpl->_placementsCells);
+            receivers.insert(receivers.end(), placementCells.begin(), placementCells.end());
+        }
+        casters = receivers;
+    }
+
     static const ::Assets::ResChar TerrainCfg[] = "terrain.cfg";
     static const ::Assets::ResChar TerrainMaterialCfg[] = "terrainmaterial.cfg";
     static const ::Assets::ResChar PlacementsCfg[] = "placements.cfg";
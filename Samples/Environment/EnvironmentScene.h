@@ -65,6 +65,9 @@ namespace Sample
         std::unique_ptr<Pimpl> _pimpl;
 
         const PlatformRig::EnvironmentSettings& GetEnvSettings() const;
+        void GetShadowCascadeBounds(
+            std::vector<PlatformRig::ShadowCascadeSceneBounds::AABB>& receivers,
+            std::vector<PlatformRig::ShadowCascadeSceneBounds::AABB>& casters) const;
     };
 
 }
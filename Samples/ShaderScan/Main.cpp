@@ -33,7 +33,7 @@ namespace ShaderScan
         auto inputFileBlock = LoadFileAsMemoryBlock(inputFile.AsString().c_str(), &inputFileSize);
 
         TRY {
-            ShaderSourceParser::BuildShaderFragmentSignature(
+            ShaderSourceParser::ParseShaderFragmentSignature(
                 (const char*)inputFileBlock.get(), inputFileSize);
         } CATCH(const ShaderSourceParser::Exceptions::ParsingFailure& e) {
 
@@ -57,6 +57,9 @@ int main(int argc, char *argv[])
     ConsoleRig::StartupConfig cfg("shaderscan");
     cfg._setWorkingDir = false;
     cfg._redirectCout = false;
+        // batch tool -- background tasks can use the whole machine
+    cfg._reserveMainThreadCore = false;
+    cfg._longTaskThreadPriority = Utility::ThreadPriority::Normal;
     ConsoleRig::GlobalServices services(cfg);
 
     TRY {
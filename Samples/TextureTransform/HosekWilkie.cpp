@@ -5,11 +5,14 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "Transform.h"
+#include "IBLPrecalc.h"
 #include "../../RenderCore/Metal/Format.h"
 #include "../../BufferUploads/IBufferUploads.h"
 #include "../../BufferUploads/DataPacket.h"
 #include "../../Math/Geometry.h"
 #include "../../Utility/ParameterBox.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../ConsoleRig/GlobalServices.h"
 
 extern "C"
 {
@@ -39,65 +42,92 @@ namespace TextureTransform
         { Float2(2.0f/3.0f, 1.0f/4.0f), Float2(1.0f, 2.0f/4.0f) }
     };
 
+    class SkyModel
+    {
+    public:
+        Float3 GetRadiance(Float3 direction) const
+        {
+            auto theta = CartesianToSpherical(direction)[0];
+            theta = std::min(.4998f * gPI, theta);
+            auto gamma = XlACos(std::max(0.f, Dot(Normalize(direction), _sunDirection)));
+
+                // (arhosek_tristim_skymodel_radiance only reads from the state object, so 
+                // we can call it from multiple threads at the same time)
+            auto R = arhosek_tristim_skymodel_radiance(_state, theta, gamma, 0);
+            auto G = arhosek_tristim_skymodel_radiance(_state, theta, gamma, 1);
+            auto B = arhosek_tristim_skymodel_radiance(_state, theta, gamma, 2);
+            return Float3((float)R, (float)G, (float)B);
+        }
+
+        SkyModel(const ParameterBox& parameters)
+        {
+                // The "turbidity" parameter is Linkes turbidity factor. Hosek and Wilkie give these example parameters:
+                //      T = 2 yields a very clear, Arctic-like sky
+                //      T = 3 a clear sky in a temperate climate
+                //      T = 6 a sky on a warm, moist day
+                //      T = 10 a slightly hazy day
+                //      T > 50 represent dense fog
+
+            auto defaultSunDirection = Normalize(Float3(1.f, 1.f, 0.33f));
+            _sunDirection = parameters.GetParameter<Float3>(ParameterBox::ParameterNameHash("SunDirection"), defaultSunDirection);
+            _sunDirection = Normalize(_sunDirection);
+
+            auto turbidity = (double)parameters.GetParameter(ParameterBox::ParameterNameHash("turbidity"), 3.f);
+            auto albedo = (double)parameters.GetParameter(ParameterBox::ParameterNameHash("albedo"), 0.1f);
+            auto elevation = (double)Deg2Rad(parameters.GetParameter(ParameterBox::ParameterNameHash("elevation"), XlASin(_sunDirection[2])));
+            _state = arhosek_rgb_skymodelstate_alloc_init(turbidity, albedo, elevation);
+        }
+
+        ~SkyModel() { arhosekskymodelstate_free(_state); }
+
+        SkyModel(const SkyModel&) = delete;
+        SkyModel& operator=(const SkyModel&) = delete;
+    private:
+        ArHosekSkyModelState* _state;
+        Float3 _sunDirection;
+    };
+
     TextureResult HosekWilkieSky(const BufferUploads::TextureDesc& desc, const ParameterBox& parameters)
     {
-            // The "turbidity" parameter is Linkes turbidity factor. Hosek and Wilkie give these example parameters:
-            //      T = 2 yields a very clear, Arctic-like sky
-            //      T = 3 a clear sky in a temperate climate
-            //      T = 6 a sky on a warm, moist day
-            //      T = 10 a slightly hazy day
-            //      T > 50 represent dense fog
-
-        auto defaultSunDirection = Normalize(Float3(1.f, 1.f, 0.33f));
-        Float3 sunDirection = parameters.GetParameter<Float3>(ParameterBox::ParameterNameHash("SunDirection"), defaultSunDirection);
-        sunDirection = Normalize(sunDirection);
-
-        auto turbidity = (double)parameters.GetParameter(ParameterBox::ParameterNameHash("turbidity"), 3.f);
-        auto albedo = (double)parameters.GetParameter(ParameterBox::ParameterNameHash("albedo"), 0.1f);
-        auto elevation = (double)Deg2Rad(parameters.GetParameter(ParameterBox::ParameterNameHash("elevation"), XlASin(sunDirection[2])));
-        auto* state = arhosek_rgb_skymodelstate_alloc_init(turbidity, albedo, elevation);
+        SkyModel sky(parameters);
 
+            // Each row is independent, so we can distribute them across the thread pool
         auto pixels = std::make_unique<Float4[]>(desc._width*desc._height);
-        for (unsigned y=0; y<desc._height; ++y)
-            for (unsigned x=0; x<desc._width; ++x) {
-                auto p = y*desc._width+x;
-                pixels[p] = Float4(0.f, 0.f, 0.f, 1.f);
-
-                Float3 direction(0.f, 0.f, 0.f);
-                bool hitPanel = false;
-
-                for (unsigned c = 0; c < 6; ++c) {
-                    Float2 tc(x / float(desc._width), y / float(desc._height));
-                    auto tcMins = s_verticalPanelCoords[c][0];
-                    auto tcMaxs = s_verticalPanelCoords[c][1];
-                    if (tc[0] >= tcMins[0] && tc[1] >= tcMins[1] && tc[0] <  tcMaxs[0] && tc[1] <  tcMaxs[1]) {
-                        tc[0] = 2.0f * (tc[0] - tcMins[0]) / (tcMaxs[0] - tcMins[0]) - 1.0f;
-                        tc[1] = 2.0f * (tc[1] - tcMins[1]) / (tcMaxs[1] - tcMins[1]) - 1.0f;
-
-                        hitPanel = true;
-                        auto plusX = s_verticalPanels[c][0];
-                        auto plusY = s_verticalPanels[c][1];
-                        auto center = s_verticalPanels[c][2];
-                        direction = center + plusX * tc[0] + plusY * tc[1];
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetLongTaskThreadPool(), desc._height,
+            [&desc, &sky, &pixels](unsigned y)
+            {
+                for (unsigned x=0; x<desc._width; ++x) {
+                    auto p = y*desc._width+x;
+                    pixels[p] = Float4(0.f, 0.f, 0.f, 1.f);
+
+                    Float3 direction(0.f, 0.f, 0.f);
+                    bool hitPanel = false;
+
+                    for (unsigned c = 0; c < 6; ++c) {
+                        Float2 tc(x / float(desc._width), y / float(desc._height));
+                        auto tcMins = s_verticalPanelCoords[c][0];
+                        auto tcMaxs = s_verticalPanelCoords[c][1];
+                        if (tc[0] >= tcMins[0] && tc[1] >= tcMins[1] && tc[0] <  tcMaxs[0] && tc[1] <  tcMaxs[1]) {
+                            tc[0] = 2.0f * (tc[0] - tcMins[0]) / (tcMaxs[0] - tcMins[0]) - 1.0f;
+                            tc[1] = 2.0f * (tc[1] - tcMins[1]) / (tcMaxs[1] - tcMins[1]) - 1.0f;
+
+                            hitPanel = true;
+                            auto plusX = s_verticalPanels[c][0];
+                            auto plusY = s_verticalPanels[c][1];
+                            auto center = s_verticalPanels[c][2];
+                            direction = center + plusX * tc[0] + plusY * tc[1];
+                        }
                     }
-                }
-
-                if (hitPanel) {
-                    auto theta = CartesianToSpherical(direction)[0];
-                    theta = std::min(.4998f * gPI, theta);
-                    auto gamma = XlACos(std::max(0.f, Dot(Normalize(direction), sunDirection)));
 
-                    auto R = arhosek_tristim_skymodel_radiance(state, theta, gamma, 0);
-                    auto G = arhosek_tristim_skymodel_radiance(state, theta, gamma, 1);
-                    auto B = arhosek_tristim_skymodel_radiance(state, theta, gamma, 2);
-
-                    pixels[p][0] = (float)R;
-                    pixels[p][1] = (float)G;
-                    pixels[p][2] = (float)B;
+                    if (hitPanel) {
+                        auto radiance = sky.GetRadiance(direction);
+                        pixels[p][0] = radiance[0];
+                        pixels[p][1] = radiance[1];
+                        pixels[p][2] = radiance[2];
+                    }
                 }
-            }
-
-        arhosekskymodelstate_free(state);
+            });
 
         return TextureResult
             {
@@ -109,5 +139,30 @@ namespace TextureTransform
                 UInt2(desc._width, desc._height)
             };
     }
-}
 
+    TextureResult HosekWilkieSkyCube(const BufferUploads::TextureDesc& desc, const ParameterBox& parameters)
+    {
+            // Build the sky directly into a cubemap (rather than the vertical cross layout used
+            // by HosekWilkieSky). This can be passed straight into the IBL filters, and the
+            // mipmaps are generated here as well. "Dims" is the size of each face.
+        SkyModel sky(parameters);
+
+        auto faceDim = desc._width;
+        FloatCubeMap result(faceDim, std::max(1u, unsigned(desc._mipCount)));
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetLongTaskThreadPool(), 6*faceDim,
+            [faceDim, &sky, &result](unsigned row)
+            {
+                auto face = row / faceDim, y = row % faceDim;
+                auto* dst = result.GetFace(face) + y*faceDim;
+                for (unsigned x=0; x<faceDim; ++x) {
+                    Float2 texCoord((x + .5f) / float(faceDim), (y + .5f) / float(faceDim));
+                    auto radiance = sky.GetRadiance(CubeMapToWorld(CubeMapDirection(face, texCoord)));
+                    dst[x] = Float4(radiance[0], radiance[1], radiance[2], 1.f);
+                }
+            });
+
+        GenerateCubeMapMipmaps(result);
+        return ConvertTexture(AsTextureResult(std::move(result)), desc._nativePixelFormat);
+    }
+}
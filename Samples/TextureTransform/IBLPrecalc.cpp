@@ -0,0 +1,619 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "IBLPrecalc.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../Math/Math.h"
+#include "../../Core/Types.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../Utility/Threading/ThreadingUtils.h"
+#include <cmath>
+#include <assert.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+    #define IBL_PRECALC_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace TextureTransform
+{
+        // These must match the constants in "Lighting/IBL/IBLAlgorithm.h"
+    static const float MinSamplingAlpha = 0.001f;
+    static const float MinSamplingRoughness = 0.03f;
+    static const float SpecularIBLMipMapCount = 9.f;
+
+    static const unsigned RowsPerTile = 16;     // output rows processed by each task on the thread pool
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    Float4* FloatCubeMap::GetFace(unsigned face, unsigned mip)
+    {
+        assert(face < 6 && mip < _mipCount);
+        return &_texels[face*_faceStride + _mipOffsets[mip]];
+    }
+
+    const Float4* FloatCubeMap::GetFace(unsigned face, unsigned mip) const
+    {
+        assert(face < 6 && mip < _mipCount);
+        return &_texels[face*_faceStride + _mipOffsets[mip]];
+    }
+
+    FloatCubeMap::FloatCubeMap(unsigned faceDim, unsigned mipCount)
+    : _faceDim(std::max(1u, faceDim)), _mipCount(std::max(1u, mipCount))
+    {
+        _faceStride = 0;
+        _mipOffsets.reserve(_mipCount);
+        for (unsigned m=0; m<_mipCount; ++m) {
+            _mipOffsets.push_back(_faceStride);
+            _faceStride += GetFaceDim(m) * GetFaceDim(m);
+        }
+        _texels.resize(6*_faceStride, Float4(0.f, 0.f, 0.f, 1.f));
+    }
+
+    FloatCubeMap::FloatCubeMap(FloatCubeMap&& moveFrom)
+    : _texels(std::move(moveFrom._texels))
+    , _mipOffsets(std::move(moveFrom._mipOffsets))
+    , _faceStride(moveFrom._faceStride)
+    , _faceDim(moveFrom._faceDim), _mipCount(moveFrom._mipCount)
+    {}
+
+    FloatCubeMap& FloatCubeMap::operator=(FloatCubeMap&& moveFrom)
+    {
+        _texels = std::move(moveFrom._texels);
+        _mipOffsets = std::move(moveFrom._mipOffsets);
+        _faceStride = moveFrom._faceStride;
+        _faceDim = moveFrom._faceDim;
+        _mipCount = moveFrom._mipCount;
+        return *this;
+    }
+
+    FloatCubeMap::~FloatCubeMap() {}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        // See DirectX documentation:
+        // https://msdn.microsoft.com/en-us/library/windows/desktop/bb204881(v=vs.85).aspx
+        // (this is the same table as CubeMapPanels_DX in "ToolsHelper/SplitSum.sh")
+    static const Float3 s_cubeMapPanels[6][3] =
+    {
+            // +X, -X
+        { Float3(0,0,-1), Float3(0,-1,0), Float3(1,0,0) },
+        { Float3(0,0,1), Float3(0,-1,0), Float3(-1,0,0) },
+
+            // +Y, -Y
+        { Float3(1,0,0), Float3(0,0,1), Float3(0,1,0) },
+        { Float3(1,0,0), Float3(0,0,-1), Float3(0,-1,0) },
+
+            // +Z, -Z
+        { Float3(1,0,0), Float3(0,-1,0), Float3(0,0,1) },
+        { Float3(-1,0,0), Float3(0,-1,0), Float3(0,0,-1) }
+    };
+
+    Float3 CubeMapDirection(unsigned face, Float2 texCoord)
+    {
+        assert(face < 6);
+        return Normalize(
+              s_cubeMapPanels[face][2]
+            + s_cubeMapPanels[face][0] * (2.f * texCoord[0] - 1.f)
+            + s_cubeMapPanels[face][1] * (2.f * texCoord[1] - 1.f));
+    }
+
+    unsigned CubeMapFace(Float3 direction, Float2& texCoord)
+    {
+        float ax = XlAbs(direction[0]), ay = XlAbs(direction[1]), az = XlAbs(direction[2]);
+        unsigned face;
+        float sc, tc, ma;
+        if (ax >= ay && ax >= az) {
+            bool neg = direction[0] < 0.f;
+            face = neg ? 1 : 0; ma = ax;
+            sc = neg ? direction[2] : -direction[2];
+            tc = -direction[1];
+        } else if (ay >= az) {
+            bool neg = direction[1] < 0.f;
+            face = neg ? 3 : 2; ma = ay;
+            sc = direction[0];
+            tc = neg ? -direction[2] : direction[2];
+        } else {
+            bool neg = direction[2] < 0.f;
+            face = neg ? 5 : 4; ma = az;
+            sc = neg ? -direction[0] : direction[0];
+            tc = -direction[1];
+        }
+
+        if (ma > 0.f) {
+            texCoord = Float2(.5f * (sc / ma + 1.f), .5f * (tc / ma + 1.f));
+        } else
+            texCoord = Float2(.5f, .5f);
+        return face;
+    }
+
+    Float3 CubeMapToWorld(Float3 cubeMapDirection)
+    {
+            // InvAdjSkyCubeMapCoords in "Lighting/LightingAlgorithm.h"
+        return Float3(cubeMapDirection[0], -cubeMapDirection[2], cubeMapDirection[1]);
+    }
+
+    float MipmapToRoughness(unsigned mipIndex)
+    {
+        return 0.05f + Clamp(float(mipIndex) / SpecularIBLMipMapCount, 0.f, 1.f);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    #if defined(IBL_PRECALC_USE_SSE2)
+        using Texel4 = __m128;
+        static Texel4 LoadTexel(const Float4& texel)            { return _mm_loadu_ps(&texel[0]); }
+        static Texel4 ZeroTexel()                               { return _mm_setzero_ps(); }
+        static Texel4 MulAdd(Texel4 acc, Texel4 t, float w)     { return _mm_add_ps(acc, _mm_mul_ps(t, _mm_set1_ps(w))); }
+        static Float4 AsFloat4(Texel4 t)                        { Float4 result; _mm_storeu_ps(&result[0], t); return result; }
+    #else
+        using Texel4 = Float4;
+        static Texel4 LoadTexel(const Float4& texel)            { return texel; }
+        static Texel4 ZeroTexel()                               { return Float4(0.f, 0.f, 0.f, 0.f); }
+        static Texel4 MulAdd(Texel4 acc, Texel4 t, float w)     { return acc + t * w; }
+        static Float4 AsFloat4(Texel4 t)                        { return t; }
+    #endif
+
+        //  Bilinear filtering within a single face. We don't filter across the edges of
+        //  faces (like the hardware does); instead we just clamp.
+    static Texel4 SampleBilinear(const FloatCubeMap& cubeMap, unsigned face, unsigned mip, float u, float v)
+    {
+        auto dim = cubeMap.GetFaceDim(mip);
+        auto* texels = cubeMap.GetFace(face, mip);
+        float x = Clamp(u * float(dim) - .5f, 0.f, float(dim-1));
+        float y = Clamp(v * float(dim) - .5f, 0.f, float(dim-1));
+        unsigned x0 = unsigned(x), y0 = unsigned(y);
+        unsigned x1 = std::min(x0+1, dim-1), y1 = std::min(y0+1, dim-1);
+        float fx = x - float(x0), fy = y - float(y0);
+
+        auto result = MulAdd(ZeroTexel(), LoadTexel(texels[y0*dim+x0]), (1.f-fx)*(1.f-fy));
+        result = MulAdd(result, LoadTexel(texels[y0*dim+x1]), fx*(1.f-fy));
+        result = MulAdd(result, LoadTexel(texels[y1*dim+x0]), (1.f-fx)*fy);
+        return MulAdd(result, LoadTexel(texels[y1*dim+x1]), fx*fy);
+    }
+
+    static Texel4 SampleTrilinear(const FloatCubeMap& cubeMap, unsigned face, float u, float v, unsigned mip0, float mipFraction)
+    {
+        auto result = SampleBilinear(cubeMap, face, mip0, u, v);
+        if (mipFraction > 0.f) {
+            #if defined(IBL_PRECALC_USE_SSE2)
+                auto t = SampleBilinear(cubeMap, face, mip0+1, u, v);
+                result = _mm_add_ps(result, _mm_mul_ps(_mm_sub_ps(t, result), _mm_set1_ps(mipFraction)));
+            #else
+                auto t = SampleBilinear(cubeMap, face, mip0+1, u, v);
+                result = result + (t - result) * mipFraction;
+            #endif
+        }
+        return result;
+    }
+
+        //  Gets the solid angle covered by a cubemap texel. See
+        //  http://www.rorydriscoll.com/2012/01/15/cubemap-texel-solid-angle/
+    static float AreaElement(float x, float y)
+    {
+        return std::atan2(x * y, std::sqrt(x * x + y * y + 1.f));
+    }
+
+    static float TexelSolidAngle(unsigned x, unsigned y, unsigned dim)
+    {
+        float x0 = 2.f * float(x) / float(dim) - 1.f, x1 = 2.f * float(x+1) / float(dim) - 1.f;
+        float y0 = 2.f * float(y) / float(dim) - 1.f, y1 = 2.f * float(y+1) / float(dim) - 1.f;
+        return AreaElement(x1, y1) - AreaElement(x0, y1) - AreaElement(x1, y0) + AreaElement(x0, y0);
+    }
+
+    static Float2 TexelCenter(unsigned x, unsigned y, unsigned dim)
+    {
+        return Float2((float(x) + .5f) / float(dim), (float(y) + .5f) / float(dim));
+    }
+
+        //  Tasks for processing every face & mip of a cubemap, in tiles of a few rows each
+    class CubeMapTile
+    {
+    public:
+        unsigned _face, _mip;
+        unsigned _rowStart, _rowEnd;
+    };
+
+    static std::vector<CubeMapTile> BuildTiles(const FloatCubeMap& cubeMap, unsigned firstMip, unsigned mipCount)
+    {
+        std::vector<CubeMapTile> result;
+        for (unsigned m=firstMip; m<firstMip+mipCount; ++m) {
+            auto dim = cubeMap.GetFaceDim(m);
+            for (unsigned f=0; f<6; ++f)
+                for (unsigned y=0; y<dim; y+=RowsPerTile)
+                    result.push_back(CubeMapTile{f, m, y, std::min(y+RowsPerTile, dim)});
+        }
+        return std::move(result);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static Float4 SampleEquirectangular(const Float4 texels[], UInt2 dims, Float3 cubeMapDirection)
+    {
+            //  EquiRectFilterGlossySpecular flips the cubemap direction to get (-c.x, c.z, c.y),
+            //  and then IBLPrecalc_SampleInputTexture swaps x & y before calling
+            //  EquirectangularMappingCoord (and then flips the u coordinate). Here's the
+            //  same thing, with the swizzles folded together.
+        const auto& c = cubeMapDirection;
+        float theta = XlATan2(c[2], -c[0]);
+        float inc = XlATan2(c[1], XlSqrt(c[0]*c[0] + c[2]*c[2]));
+        float u = -(.5f + .5f * theta / gPI);
+        float v = .5f - inc / gPI;
+
+            // bilinear filtering, wrapping on both axes (like DefaultSampler)
+        float x = u * float(dims[0]) - .5f, y = v * float(dims[1]) - .5f;
+        float fx0 = std::floor(x), fy0 = std::floor(y);
+        float fx = x - fx0, fy = y - fy0;
+        int w = int(dims[0]), h = int(dims[1]);
+        int x0 = ((int(fx0) % w) + w) % w, y0 = ((int(fy0) % h) + h) % h;
+        int x1 = (x0+1) % w, y1 = (y0+1) % h;
+
+        return
+              texels[y0*w+x0] * ((1.f-fx)*(1.f-fy))
+            + texels[y0*w+x1] * (fx*(1.f-fy))
+            + texels[y1*w+x0] * ((1.f-fx)*fy)
+            + texels[y1*w+x1] * (fx*fy);
+    }
+
+    FloatCubeMap CubeMapFromEquirectangular(
+        const Float4 texels[], UInt2 dims,
+        unsigned faceDim, unsigned mipCount,
+        bool parallel)
+    {
+        FloatCubeMap result(faceDim, mipCount);
+        auto tiles = BuildTiles(result, 0, 1);
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetLongTaskThreadPool(), unsigned(tiles.size()),
+            [&](unsigned t)
+            {
+                const auto& tile = tiles[t];
+                auto dim = result.GetFaceDim(tile._mip);
+                auto* dst = result.GetFace(tile._face, tile._mip);
+                for (unsigned y=tile._rowStart; y<tile._rowEnd; ++y)
+                    for (unsigned x=0; x<dim; ++x) {
+                        Float4 total(0.f, 0.f, 0.f, 0.f);
+                        for (unsigned s=0; s<4; ++s) {
+                            Float2 tc(
+                                (float(x) + .25f + .5f * float(s&1)) / float(dim),
+                                (float(y) + .25f + .5f * float(s>>1)) / float(dim));
+                            total += SampleEquirectangular(texels, dims, CubeMapDirection(tile._face, tc));
+                        }
+                        dst[y*dim+x] = Float4(.25f * total[0], .25f * total[1], .25f * total[2], 1.f);
+                    }
+            }, parallel ? ~0u : 0u);
+
+        GenerateCubeMapMipmaps(result, parallel);
+        return std::move(result);
+    }
+
+    void GenerateCubeMapMipmaps(FloatCubeMap& cubeMap, bool parallel)
+    {
+        for (unsigned m=1; m<cubeMap.GetMipCount(); ++m) {
+            auto tiles = BuildTiles(cubeMap, m, 1);
+            ParallelFor(
+                ConsoleRig::GlobalServices::GetLongTaskThreadPool(), unsigned(tiles.size()),
+                [&](unsigned t)
+                {
+                    const auto& tile = tiles[t];
+                    auto srcDim = cubeMap.GetFaceDim(m-1), dstDim = cubeMap.GetFaceDim(m);
+                    const auto* src = cubeMap.GetFace(tile._face, m-1);
+                    auto* dst = cubeMap.GetFace(tile._face, m);
+                    for (unsigned y=tile._rowStart; y<tile._rowEnd; ++y)
+                        for (unsigned x=0; x<dstDim; ++x) {
+                            unsigned x0 = std::min(x*2, srcDim-1), x1 = std::min(x*2+1, srcDim-1);
+                            unsigned y0 = std::min(y*2, srcDim-1), y1 = std::min(y*2+1, srcDim-1);
+                            dst[y*dstDim+x] = .25f * (src[y0*srcDim+x0] + src[y0*srcDim+x1] + src[y1*srcDim+x0] + src[y1*srcDim+x1]);
+                        }
+                }, parallel ? ~0u : 0u);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+    //  G G X   f i l t e r i n g
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static float SmithG(float NdotV, float alpha)
+    {
+        float a = alpha * alpha;
+        float b = NdotV * NdotV;
+        return (2.f * NdotV) / (NdotV + XlSqrt(b + (1.f - b) * a));
+    }
+
+    static float TrowReitzD(float NdotH, float alpha)
+    {
+        float alphaSqr = alpha * alpha;
+        float denom = 1.f + (alphaSqr - 1.f) * NdotH * NdotH;
+        return alphaSqr / (gPI * denom * denom);
+    }
+
+    static float VanderCorputRadicalInverse(uint32 bits)
+    {
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return float(bits) * 2.3283064365386963e-10f;
+    }
+
+        //  The sample directions & weights don't depend on the direction we're filtering (because
+        //  normal & view direction are the same). So we can calculate them once per mipmap, in
+        //  a space where the normal is +Z. The arrays are padded to a multiple of 4 with zero
+        //  weight samples (so we can evaluate 4 at a time).
+    class GGXSampleTable
+    {
+    public:
+        std::vector<float> _x, _y, _z;
+        std::vector<float> _weight;
+        std::vector<unsigned> _sourceMip;
+        std::vector<float> _sourceMipFraction;
+        float _totalWeight;
+
+        GGXSampleTable(float roughness, unsigned sampleCount, const FloatCubeMap& source);
+    private:
+        void Push(Float3 L, float weight, float lod);
+    };
+
+    GGXSampleTable::GGXSampleTable(float roughness, unsigned sampleCount, const FloatCubeMap& source)
+    {
+            //  See GenerateFilteredSpecular & SampleMicrofacetNormalGGX in "Lighting/IBL/IBLPrecalc.h" and
+            //  "Lighting/IBL/IBLAlgorithm.h". We're using the "Method_Complex" weighting, where each
+            //  sample is weighted by the full specular equation.
+        roughness = std::max(roughness, MinSamplingRoughness);
+        float alphag = (roughness * .5f + .5f) * (roughness * .5f + .5f);
+        float alphad = roughness * roughness;
+        float samplingAlpha = std::max(MinSamplingAlpha, alphad);
+
+            //  For filtered importance sampling, we compare the solid angle of each sample with
+            //  the solid angle of a texel in the top mip of the source
+        float sourceDim = float(source.GetFaceDim());
+        float texelSolidAngle = 4.f * gPI / (6.f * sourceDim * sourceDim);
+        float maxLod = float(source.GetMipCount()-1);
+
+        _totalWeight = 0.f;
+        sampleCount = std::max(1u, sampleCount);
+        for (unsigned s=0; s<sampleCount; ++s) {
+            float xi0 = float(s) / float(sampleCount), xi1 = VanderCorputRadicalInverse(s);
+            float q = samplingAlpha * XlSqrt(xi0) / XlSqrt(1.f - xi0);
+            float cosTheta = 1.f / XlSqrt(1.f + q*q);
+            float sinTheta = XlSqrt(std::max(0.f, 1.f - cosTheta * cosTheta));
+            float phi = 2.f * gPI * xi1;
+            Float3 H(sinTheta * XlCos(phi), sinTheta * XlSin(phi), cosTheta);
+
+                //  L = 2.f * dot(V, H) * H - V, with V = N = +Z
+            float NdotH = cosTheta;
+            float NdotL = 2.f * cosTheta * cosTheta - 1.f;
+            if (NdotL <= 0.f) continue;
+            Float3 L(2.f * cosTheta * H[0], 2.f * cosTheta * H[1], NdotL);
+
+                //  CalculateSpecular(...) * InversePDFWeight(...). NdotV is 1 and fresnel is 1 here
+            float G = SmithG(NdotL, alphag) * SmithG(1.f, alphag);
+            float D = TrowReitzD(NdotH, alphad);
+            float samplingD = TrowReitzD(NdotH, samplingAlpha);
+            float weight = (G * D / 4.f) / (samplingD * NdotH);
+
+                //  The pdf of L is (D * NdotH) / (4 * VdotH). VdotH == NdotH here.
+            float pdf = samplingD * .25f;
+            float sampleSolidAngle = 1.f / (float(sampleCount) * pdf);
+            float lod = Clamp(.5f * std::log(sampleSolidAngle / texelSolidAngle) / std::log(2.f) + 1.f, 0.f, maxLod);
+            Push(L, weight, lod);
+            _totalWeight += weight;
+        }
+
+        while (_weight.size() % 4)
+            Push(Float3(0.f, 0.f, 1.f), 0.f, 0.f);
+    }
+
+    void GGXSampleTable::Push(Float3 L, float weight, float lod)
+    {
+        _x.push_back(L[0]); _y.push_back(L[1]); _z.push_back(L[2]);
+        _weight.push_back(weight);
+        auto mip = unsigned(lod);
+        _sourceMip.push_back(mip);
+        _sourceMipFraction.push_back(lod - float(mip));
+    }
+
+    static Float4 FilterTexel(Float3 N, const GGXSampleTable& table, const FloatCubeMap& source)
+    {
+            // tangent frame (as per SampleMicrofacetNormalGGX)
+        Float3 up = (XlAbs(N[2]) < 0.999f) ? Float3(0.f, 0.f, 1.f) : Float3(1.f, 0.f, 0.f);
+        Float3 tangentX = Normalize(Cross(up, N));
+        Float3 tangentY = Cross(N, tangentX);
+
+        auto result = ZeroTexel();
+        auto count = unsigned(table._weight.size());
+
+        #if defined(IBL_PRECALC_USE_SSE2)
+
+            const __m128 tXx = _mm_set1_ps(tangentX[0]), tXy = _mm_set1_ps(tangentX[1]), tXz = _mm_set1_ps(tangentX[2]);
+            const __m128 tYx = _mm_set1_ps(tangentY[0]), tYy = _mm_set1_ps(tangentY[1]), tYz = _mm_set1_ps(tangentY[2]);
+            const __m128 Nx = _mm_set1_ps(N[0]), Ny = _mm_set1_ps(N[1]), Nz = _mm_set1_ps(N[2]);
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), half = _mm_set1_ps(.5f);
+            const __m128 two = _mm_set1_ps(2.f), four = _mm_set1_ps(4.f);
+
+            auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+
+            for (unsigned s=0; s<count; s+=4) {
+                    //  Rotate 4 sample directions into the space of the cubemap
+                __m128 lx = _mm_loadu_ps(&table._x[s]), ly = _mm_loadu_ps(&table._y[s]), lz = _mm_loadu_ps(&table._z[s]);
+                __m128 dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tXx, lx), _mm_mul_ps(tYx, ly)), _mm_mul_ps(Nx, lz));
+                __m128 dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tXy, lx), _mm_mul_ps(tYy, ly)), _mm_mul_ps(Ny, lz));
+                __m128 dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tXz, lx), _mm_mul_ps(tYz, ly)), _mm_mul_ps(Nz, lz));
+
+                    //  Select the cubemap face & texture coordinates (the same as CubeMapFace)
+                __m128 ax = _mm_and_ps(dx, absMask), ay = _mm_and_ps(dy, absMask), az = _mm_and_ps(dz, absMask);
+                __m128 isX = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+                __m128 isY = _mm_andnot_ps(isX, _mm_cmpge_ps(ay, az));
+                __m128 negX = _mm_cmplt_ps(dx, zero), negY = _mm_cmplt_ps(dy, zero), negZ = _mm_cmplt_ps(dz, zero);
+
+                __m128 ma = select(isX, ax, select(isY, ay, az));
+                __m128 sc = select(isX, select(negX, dz, _mm_sub_ps(zero, dz)), select(isY, dx, select(negZ, _mm_sub_ps(zero, dx), dx)));
+                __m128 tc = select(isY, select(negY, _mm_sub_ps(zero, dz), dz), _mm_sub_ps(zero, dy));
+                __m128 face = select(isX, _mm_and_ps(negX, one), select(isY, _mm_add_ps(two, _mm_and_ps(negY, one)), _mm_add_ps(four, _mm_and_ps(negZ, one))));
+
+                __m128 rcpMa = _mm_div_ps(one, _mm_max_ps(ma, _mm_set1_ps(1e-20f)));
+                __m128 u = _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(sc, rcpMa), one));
+                __m128 v = _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(tc, rcpMa), one));
+
+                float uArray[4], vArray[4];
+                __m128i faceArray[1];
+                _mm_storeu_ps(uArray, u);
+                _mm_storeu_ps(vArray, v);
+                _mm_storeu_si128(faceArray, _mm_cvttps_epi32(face));
+                const int* faces = (const int*)faceArray;
+
+                    //  Texture lookups (the blending of the texels is also SIMD)
+                for (unsigned c=0; c<4; ++c) {
+                    float weight = table._weight[s+c];
+                    if (weight == 0.f) continue;
+                    auto texel = SampleTrilinear(
+                        source, unsigned(faces[c]), uArray[c], vArray[c],
+                        table._sourceMip[s+c], table._sourceMipFraction[s+c]);
+                    result = MulAdd(result, texel, weight);
+                }
+            }
+
+        #else
+
+            for (unsigned s=0; s<count; ++s) {
+                float weight = table._weight[s];
+                if (weight == 0.f) continue;
+                Float3 L = tangentX * table._x[s] + tangentY * table._y[s] + N * table._z[s];
+                Float2 texCoord;
+                auto face = CubeMapFace(L, texCoord);
+                auto texel = SampleTrilinear(
+                    source, face, texCoord[0], texCoord[1],
+                    table._sourceMip[s], table._sourceMipFraction[s]);
+                result = MulAdd(result, texel, weight);
+            }
+
+        #endif
+
+        auto r = AsFloat4(result);
+        float scale = 1.f / (table._totalWeight + 1e-6f);
+        return Float4(r[0] * scale, r[1] * scale, r[2] * scale, 1.f);
+    }
+
+    void FilterGlossySpecular(
+        FloatCubeMap& dst, const FloatCubeMap& source,
+        unsigned sampleCount, bool parallel)
+    {
+        std::vector<GGXSampleTable> tables;
+        tables.reserve(dst.GetMipCount());
+        for (unsigned m=0; m<dst.GetMipCount(); ++m)
+            tables.push_back(GGXSampleTable(MipmapToRoughness(m), sampleCount, source));
+
+            //  Every tile of every mip is independent, so we can process them all at
+            //  the same time. Larger mips come first, so the smaller tiles at the end
+            //  help balance out the work.
+        auto tiles = BuildTiles(dst, 0, dst.GetMipCount());
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetLongTaskThreadPool(), unsigned(tiles.size()),
+            [&](unsigned t)
+            {
+                const auto& tile = tiles[t];
+                auto dim = dst.GetFaceDim(tile._mip);
+                auto* dstTexels = dst.GetFace(tile._face, tile._mip);
+                for (unsigned y=tile._rowStart; y<tile._rowEnd; ++y)
+                    for (unsigned x=0; x<dim; ++x)
+                        dstTexels[y*dim+x] = FilterTexel(
+                            CubeMapDirection(tile._face, TexelCenter(x, y, dim)),
+                            tables[tile._mip], source);
+            }, parallel ? ~0u : 0u);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+    //  S p h e r i c a l   h a r m o n i c s
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static void EvaluateSHBasis(float result[9], Float3 d)
+    {
+        result[0] = 0.282095f;
+        result[1] = 0.488603f * d[1];
+        result[2] = 0.488603f * d[2];
+        result[3] = 0.488603f * d[0];
+        result[4] = 1.092548f * d[0] * d[1];
+        result[5] = 1.092548f * d[1] * d[2];
+        result[6] = 0.315392f * (3.f * d[2] * d[2] - 1.f);
+        result[7] = 1.092548f * d[0] * d[2];
+        result[8] = 0.546274f * (d[0] * d[0] - d[1] * d[1]);
+    }
+
+    SHCoefficients ProjectToSH(const FloatCubeMap& source, unsigned maxFaceDim, bool parallel)
+    {
+        unsigned mip = 0;
+        while ((mip+1) < source.GetMipCount() && source.GetFaceDim(mip) > maxFaceDim) ++mip;
+
+            //  Each tile writes to its own partial sum; and we add them together in a fixed
+            //  order at the end. So the result doesn't depend on the thread scheduling.
+        auto tiles = BuildTiles(source, mip, 1);
+        std::vector<SHCoefficients> partialSums(tiles.size());
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetLongTaskThreadPool(), unsigned(tiles.size()),
+            [&](unsigned t)
+            {
+                const auto& tile = tiles[t];
+                auto dim = source.GetFaceDim(tile._mip);
+                const auto* texels = source.GetFace(tile._face, tile._mip);
+                auto& sum = partialSums[t];
+                for (unsigned c=0; c<9; ++c) sum._coefficients[c] = Float3(0.f, 0.f, 0.f);
+
+                for (unsigned y=tile._rowStart; y<tile._rowEnd; ++y)
+                    for (unsigned x=0; x<dim; ++x) {
+                        auto direction = CubeMapToWorld(CubeMapDirection(tile._face, TexelCenter(x, y, dim)));
+                        float basis[9];
+                        EvaluateSHBasis(basis, direction);
+                        const auto& texel = texels[y*dim+x];
+                        Float3 radiance = Float3(texel[0], texel[1], texel[2]) * TexelSolidAngle(x, y, dim);
+                        for (unsigned c=0; c<9; ++c)
+                            sum._coefficients[c] += radiance * basis[c];
+                    }
+            }, parallel ? ~0u : 0u);
+
+        SHCoefficients result;
+        for (unsigned c=0; c<9; ++c) result._coefficients[c] = Float3(0.f, 0.f, 0.f);
+        for (const auto& p:partialSums)
+            for (unsigned c=0; c<9; ++c)
+                result._coefficients[c] += p._coefficients[c];
+        return result;
+    }
+
+    Float3 CalculateIrradiance(const SHCoefficients& sh, Float3 worldSpaceNormal)
+    {
+            //  Convolution with the clamped cosine lobe just scales each band.
+            //  See Ramamoorthi & Hanrahan, "An Efficient Representation for Irradiance
+            //  Environment Maps"
+        const float bandScale[] = { gPI, 2.f * gPI / 3.f, gPI / 4.f };
+        const unsigned bandForCoefficient[] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+
+        float basis[9];
+        EvaluateSHBasis(basis, worldSpaceNormal);
+        Float3 result(0.f, 0.f, 0.f);
+        for (unsigned c=0; c<9; ++c)
+            result += sh._coefficients[c] * (bandScale[bandForCoefficient[c]] * basis[c]);
+        return Float3(std::max(0.f, result[0]), std::max(0.f, result[1]), std::max(0.f, result[2]));
+    }
+
+    void BuildIrradianceCubeMap(FloatCubeMap& dst, const SHCoefficients& sh, bool parallel)
+    {
+        auto tiles = BuildTiles(dst, 0, dst.GetMipCount());
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetLongTaskThreadPool(), unsigned(tiles.size()),
+            [&](unsigned t)
+            {
+                const auto& tile = tiles[t];
+                auto dim = dst.GetFaceDim(tile._mip);
+                auto* dstTexels = dst.GetFace(tile._face, tile._mip);
+                for (unsigned y=tile._rowStart; y<tile._rowEnd; ++y)
+                    for (unsigned x=0; x<dim; ++x) {
+                        auto normal = CubeMapToWorld(CubeMapDirection(tile._face, TexelCenter(x, y, dim)));
+                        auto irradiance = CalculateIrradiance(sh, normal);
+                        dstTexels[y*dim+x] = Float4(irradiance[0], irradiance[1], irradiance[2], 1.f);
+                    }
+            }, parallel ? ~0u : 0u);
+    }
+}
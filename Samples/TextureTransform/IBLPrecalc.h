@@ -0,0 +1,111 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Math/Vector.h"
+#include <vector>
+#include <algorithm>
+
+namespace TextureTransform
+{
+    /// <summary>Floating point cubemap with a mipmap chain, used by the CPU IBL filters</summary>
+    /// Faces are in the D3D order (+X, -X, +Y, -Y, +Z, -Z), and each face uses the D3D
+    /// orientation (see CubeMapDirection). Texels for each face are stored together, with
+    /// all of the mipmaps for a face following each other -- this is the same order as the
+    /// subresources of a D3D texture array.
+    ///
+    /// Like the rest of the IBL pipeline, the runtime samples these cubemaps with
+    /// "AdjSkyCubeMapCoords". So the world space direction for a cubemap direction "c" is
+    /// (c.x, -c.z, c.y) (see CubeMapToWorld).
+    class FloatCubeMap
+    {
+    public:
+        Float4*         GetFace(unsigned face, unsigned mip = 0);
+        const Float4*   GetFace(unsigned face, unsigned mip = 0) const;
+        unsigned        GetFaceDim(unsigned mip = 0) const  { return std::max(1u, _faceDim >> mip); }
+        unsigned        GetMipCount() const                 { return _mipCount; }
+
+        FloatCubeMap(unsigned faceDim, unsigned mipCount = 1);
+        FloatCubeMap(FloatCubeMap&& moveFrom);
+        FloatCubeMap& operator=(FloatCubeMap&& moveFrom);
+        ~FloatCubeMap();
+    private:
+        std::vector<Float4> _texels;
+        std::vector<size_t> _mipOffsets;
+        size_t _faceStride;
+        unsigned _faceDim, _mipCount;
+    };
+
+    /// <summary>Second order spherical harmonic projection of an environment (RGB)</summary>
+    /// Coefficients use the usual real basis ordering: (0,0), (1,-1), (1,0), (1,1),
+    /// (2,-2), (2,-1), (2,0), (2,1), (2,2). They are in world space (ie, Z up).
+    class SHCoefficients
+    {
+    public:
+        Float3 _coefficients[9];
+    };
+
+    /// <summary>Direction through the given point on a cube face (D3D conventions)</summary>
+    /// "texCoord" is in the range [0, 1] across the face. The result is normalized.
+    Float3 CubeMapDirection(unsigned face, Float2 texCoord);
+
+    /// <summary>Inverse of CubeMapDirection</summary>
+    /// Returns the face index, and writes the texture coordinate on that face to "texCoord".
+    unsigned CubeMapFace(Float3 direction, Float2& texCoord);
+
+    Float3 CubeMapToWorld(Float3 cubeMapDirection);
+
+    /// <summary>Roughness for each mipmap of the specular IBL texture</summary>
+    /// Matches MipmapToRoughness in the "Lighting/IBL/IBLAlgorithm.h" shader.
+    float MipmapToRoughness(unsigned mipIndex);
+
+    /// <summary>Resamples an equirectangular environment into a cubemap</summary>
+    /// Uses the same mapping (and the same flips) as the "EquiRectFilterGlossySpecular"
+    /// shader in "ToolsHelper/SplitSum.sh", so the results of the CPU filters line up with
+    /// the results from the GPU. Each output texel is an average of 2x2 bilinear samples.
+    /// The remaining mipmaps are built from the top mip with GenerateCubeMapMipmaps.
+    FloatCubeMap CubeMapFromEquirectangular(
+        const Float4 texels[], UInt2 dims,
+        unsigned faceDim, unsigned mipCount = 1,
+        bool parallel = true);
+
+    /// <summary>Fills in all of the mipmaps of a cubemap from the top mip, using a box filter</summary>
+    void GenerateCubeMapMipmaps(FloatCubeMap& cubeMap, bool parallel = true);
+
+    /// <summary>Builds the specular IBL mip chain, using GGX importance sampling</summary>
+    /// This is a CPU implementation of GenerateFilteredSpecular (from "Lighting/IBL/IBLPrecalc.h").
+    /// Like that function, we assume that the normal and view direction are the same, and
+    /// weight each sample by the full specular equation (with F0 = 1). Each mipmap of "dst"
+    /// is filtered with the roughness from MipmapToRoughness().
+    ///
+    /// To get a converged result with a small number of samples, we use "filtered importance
+    /// sampling" (see Krivanek & Colbert, GPU Gems 3, chapter 20). Each sample reads from a
+    /// mipmap of "source" that matches the solid angle covered by that sample. So "source"
+    /// must have a full mip chain (see GenerateCubeMapMipmaps).
+    ///
+    /// The work is split into tiles of rows (from every face and mip) and distributed across
+    /// the long task thread pool. Samples are evaluated 4 at a time using SSE2, where available.
+    void FilterGlossySpecular(
+        FloatCubeMap& dst, const FloatCubeMap& source,
+        unsigned sampleCount, bool parallel = true);
+
+    /// <summary>Projects an environment onto the second order spherical harmonics</summary>
+    /// Every texel is weighted by the solid angle it covers. We use a mipmap of the source
+    /// that is no larger than "maxFaceDim" (smaller mipmaps have enough detail for this
+    /// projection).
+    SHCoefficients ProjectToSH(const FloatCubeMap& source, unsigned maxFaceDim = 64, bool parallel = true);
+
+    /// <summary>Irradiance for the given world space normal</summary>
+    /// This is the cosine weighted integral of the incoming light. There is no 1/pi normalization
+    /// factor (the runtime applies this when sampling DiffuseIBL).
+    Float3 CalculateIrradiance(const SHCoefficients& sh, Float3 worldSpaceNormal);
+
+    /// <summary>Fills in every mip of an irradiance cubemap from a spherical harmonic projection</summary>
+    /// This produces the DiffuseIBL texture.
+    void BuildIrradianceCubeMap(FloatCubeMap& dst, const SHCoefficients& sh, bool parallel = true);
+}
+
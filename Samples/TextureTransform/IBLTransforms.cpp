@@ -0,0 +1,295 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "Transform.h"
+#include "IBLPrecalc.h"
+#include "../../RenderCore/Metal/Format.h"
+#include "../../Assets/AssetsCore.h"
+#include "../../BufferUploads/IBufferUploads.h"
+#include "../../BufferUploads/DataPacket.h"
+#include "../../Utility/ParameterBox.h"
+#include "../../Utility/Conversion.h"
+#include "../../Utility/Streams/PathUtils.h"
+#include "../../Utility/BitUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Utility/MemoryUtils.h"
+
+#include "../../Foreign/DirectXTex/DirectXTex/DirectXTex.h" // (includes windows.h indirectly)
+#undef max
+#undef min
+
+namespace TextureTransform
+{
+    DirectX::TexMetadata AsMetadata(
+        const BufferUploads::TextureDesc& desc);
+
+    std::vector<DirectX::Image> BuildImages(
+        const DirectX::TexMetadata& metaData,
+        BufferUploads::DataPacket& pkt);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class FloatCubeMapPacket : public BufferUploads::DataPacket
+    {
+    public:
+        virtual void*   GetData         (SubResource subRes);
+        virtual size_t  GetDataSize     (SubResource subRes) const;
+        virtual auto    GetPitches      (SubResource subRes) const -> BufferUploads::TexturePitches;
+        virtual std::shared_ptr<Marker>     BeginBackgroundLoad();
+
+        FloatCubeMapPacket(FloatCubeMap&& moveFrom);
+        ~FloatCubeMapPacket();
+    private:
+        FloatCubeMap _cubeMap;
+    };
+
+    void*   FloatCubeMapPacket::GetData         (SubResource subRes)
+    {
+        auto arrayIndex = subRes >> 16u, mip = subRes & 0xffffu;
+        assert(arrayIndex < 6 && mip < _cubeMap.GetMipCount());
+        return _cubeMap.GetFace(arrayIndex, mip);
+    }
+
+    size_t  FloatCubeMapPacket::GetDataSize     (SubResource subRes) const
+    {
+        return GetPitches(subRes)._slicePitch;
+    }
+
+    auto    FloatCubeMapPacket::GetPitches      (SubResource subRes) const
+        -> BufferUploads::TexturePitches
+    {
+        auto dim = _cubeMap.GetFaceDim(subRes & 0xffffu);
+        return BufferUploads::TexturePitches(unsigned(dim*sizeof(Float4)), unsigned(dim*dim*sizeof(Float4)));
+    }
+
+    auto    FloatCubeMapPacket::BeginBackgroundLoad() -> std::shared_ptr<Marker> { return nullptr; }
+
+    FloatCubeMapPacket::FloatCubeMapPacket(FloatCubeMap&& moveFrom)
+    : _cubeMap(std::move(moveFrom))
+    {}
+
+    FloatCubeMapPacket::~FloatCubeMapPacket() {}
+
+    TextureResult AsTextureResult(FloatCubeMap&& cubeMap)
+    {
+        auto dim = cubeMap.GetFaceDim();
+        auto mipCount = cubeMap.GetMipCount();
+        return TextureResult
+            {
+                make_intrusive<FloatCubeMapPacket>(std::move(cubeMap)),
+                unsigned(RenderCore::Metal::NativeFormat::R32G32B32A32_FLOAT),
+                UInt2(dim, dim), mipCount, 6
+            };
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static DirectX::ScratchImage AsFloatImage(const DirectX::Image& image)
+    {
+        DirectX::ScratchImage result;
+        HRESULT hresult;
+        if (DirectX::IsCompressed(image.format)) {
+            hresult = DirectX::Decompress(image, DXGI_FORMAT_R32G32B32A32_FLOAT, result);
+        } else if (image.format != DXGI_FORMAT_R32G32B32A32_FLOAT) {
+                // (SRGB formats are converted to linear here)
+            hresult = DirectX::Convert(image, DXGI_FORMAT_R32G32B32A32_FLOAT, DirectX::TEX_FILTER_DEFAULT, 0.5f, result);
+        } else
+            hresult = result.InitializeFromImage(image);
+
+        if (!SUCCEEDED(hresult))
+            Throw(::Exceptions::BasicLabel("Could not convert texture to floating point format"));
+        return std::move(result);
+    }
+
+    static void CopyTexels(Float4 dst[], const DirectX::Image& image)
+    {
+        for (unsigned y=0; y<image.height; ++y)
+            XlCopyMemory(&dst[y*image.width], PtrAdd(image.pixels, y*image.rowPitch), image.width*sizeof(Float4));
+    }
+
+        //  Pick a face size that roughly matches the resolution of an equirectangular
+        //  input (4 faces wrap around the equator)
+    static unsigned EquirectangularFaceDim(unsigned inputWidth)
+    {
+        unsigned faceDim = 1;
+        while (faceDim < inputWidth/4) faceDim <<= 1;
+        return faceDim;
+    }
+
+        //  "Dims" is the size of each output face. When it's omitted, the default dims
+        //  come from the input -- which is only square for a cubemap input
+    static unsigned GetOutputFaceDim(const BufferUploads::TextureDesc& desc, const ParameterBox& parameters)
+    {
+        auto dimsParam = parameters.GetParameter<UInt2>(ParameterBox::MakeParameterNameHash("Dims"));
+        if (dimsParam.first) {
+            if (desc._width != desc._height)
+                Throw(::Exceptions::BasicLabel("IBL output must have square faces"));
+            return desc._width;
+        }
+        return (desc._width == desc._height) ? desc._width : EquirectangularFaceDim(desc._width);
+    }
+
+    static FloatCubeMap LoadInputCubeMap(const ParameterBox& parameters, unsigned minFaceDim)
+    {
+            //  The input can either be a cubemap (a 6 element array), or an equirectangular
+            //  environment map (like the input to the EquiRectFilterGlossySpecular shader).
+            //  Either way, we need a floating point cubemap with a full mip chain.
+        auto inputTexture = parameters.GetString<char>(ParameterBox::MakeParameterNameHash("Input"));
+        if (inputTexture.empty())
+            Throw(::Exceptions::BasicLabel("Expecting 'Input' parameter"));
+
+            //  The initializer can have parameters that select the color space (as with
+            //  the shader path). They aren't part of the filename.
+        auto inputAssetName = Conversion::Convert<::Assets::rstring>(inputTexture);
+        auto splitter = MakeFileNameSplitter(inputAssetName);
+        auto srcDesc = BufferUploads::LoadTextureFormat(splitter.AllExceptParameters());
+        if (srcDesc._width == 0)
+            Throw(::Exceptions::BasicLabel("Failure while loading input texture"));
+
+        auto pkt = BufferUploads::CreateStreamingTextureSource(splitter.AllExceptParameters(), 0);
+        auto load = pkt->BeginBackgroundLoad();
+        auto state = load->StallWhilePending();
+        if (state != ::Assets::AssetState::Ready)
+            Throw(::Exceptions::BasicLabel("Failure while loading input texture"));
+
+        srcDesc._nativePixelFormat = AsSourceFormat(
+            srcDesc._nativePixelFormat, GetSourceColorSpace(inputAssetName.c_str()));
+        auto metaData = AsMetadata(srcDesc);
+        auto images = BuildImages(metaData, *pkt);
+
+        if (srcDesc._arrayCount == 6) {
+            if (srcDesc._width != srcDesc._height)
+                Throw(::Exceptions::BasicLabel("Cubemap input must have square faces"));
+
+            auto faceDim = srcDesc._width;
+            FloatCubeMap result(faceDim, IntegerLog2(uint32(faceDim))+1);
+            for (unsigned f=0; f<6; ++f) {
+                auto floatImage = AsFloatImage(images[f*metaData.mipLevels]);
+                CopyTexels(result.GetFace(f), *floatImage.GetImage(0, 0, 0));
+            }
+            GenerateCubeMapMipmaps(result);
+            return std::move(result);
+        }
+
+        auto floatImage = AsFloatImage(images[0]);
+        const auto& image = *floatImage.GetImage(0, 0, 0);
+        std::vector<Float4> texels(image.width*image.height);
+        CopyTexels(AsPointer(texels.begin()), image);
+
+        auto faceDim = std::max(EquirectangularFaceDim(unsigned(image.width)), minFaceDim);
+        return CubeMapFromEquirectangular(
+            AsPointer(texels.cbegin()), UInt2(unsigned(image.width), unsigned(image.height)),
+            faceDim, IntegerLog2(uint32(faceDim))+1);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    TextureResult SpecularIBLTransform(
+        const BufferUploads::TextureDesc& desc,
+        const ParameterBox& parameters)
+    {
+            //  CPU version of the "SplitSum.sh:EquiRectFilterGlossySpecular" shader. Takes
+            //  the same "Input", "Dims" and "MipCount" parameters (though "PassCount" is replaced
+            //  with "SampleCount"). Filtering is done in 32 bit floats, and the result is
+            //  converted to the requested "Format".
+        auto faceDim = GetOutputFaceDim(desc, parameters);
+        auto sampleCount = parameters.GetParameter(ParameterBox::MakeParameterNameHash("SampleCount"), 256u);
+        auto source = LoadInputCubeMap(parameters, faceDim);
+
+        FloatCubeMap result(faceDim, std::max(1u, unsigned(desc._mipCount)));
+        FilterGlossySpecular(result, source, std::max(1u, sampleCount));
+        return ConvertTexture(AsTextureResult(std::move(result)), desc._nativePixelFormat);
+    }
+
+    TextureResult DiffuseIBLTransform(
+        const BufferUploads::TextureDesc& desc,
+        const ParameterBox& parameters)
+    {
+            //  Builds the DiffuseIBL cubemap, via a projection onto the second order spherical
+            //  harmonics. Every mip gets the same irradiance (just with fewer texels). The
+            //  projection only needs a small version of the input.
+        auto faceDim = GetOutputFaceDim(desc, parameters);
+        auto source = LoadInputCubeMap(parameters, 64);
+        auto sh = ProjectToSH(source);
+
+        FloatCubeMap result(faceDim, std::max(1u, unsigned(desc._mipCount)));
+        BuildIrradianceCubeMap(result, sh);
+        return ConvertTexture(AsTextureResult(std::move(result)), desc._nativePixelFormat);
+    }
+
+    TextureResult SHTransform(
+        const BufferUploads::TextureDesc& desc,
+        const ParameterBox& parameters)
+    {
+            //  Writes the 9 spherical harmonic coefficients for the input environment
+            //  into a 9x1 texture (coefficients in world space, without the irradiance
+            //  convolution applied)
+        auto source = LoadInputCubeMap(parameters, 64);
+        auto sh = ProjectToSH(source);
+
+        Float4 texels[9];
+        for (unsigned c=0; c<9; ++c)
+            texels[c] = Float4(sh._coefficients[c][0], sh._coefficients[c][1], sh._coefficients[c][2], 1.f);
+
+        return TextureResult
+            {
+                BufferUploads::CreateBasicPacket(
+                    sizeof(texels), texels,
+                    BufferUploads::TexturePitches(unsigned(sizeof(texels)), unsigned(sizeof(texels)))),
+                RenderCore::Metal::NativeFormat::R32G32B32A32_FLOAT,
+                UInt2(dimof(texels), 1)
+            };
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    TextureComparison CompareTextures(const TextureResult& texture, const TextureResult& reference)
+    {
+        if (texture._dimensions != reference._dimensions
+            || std::max(1u, texture._mipCount) != std::max(1u, reference._mipCount)
+            || std::max(1u, texture._arrayCount) != std::max(1u, reference._arrayCount))
+            Throw(::Exceptions::BasicLabel("Cannot compare textures with different dimensions, mip counts or array counts"));
+
+        auto mipCount = std::max(1u, texture._mipCount), arrayCount = std::max(1u, texture._arrayCount);
+        auto metaData0 = AsMetadata(BufferUploads::TextureDesc::Plain2D(
+            texture._dimensions[0], texture._dimensions[1], texture._format, uint8(mipCount), uint16(arrayCount)));
+        auto metaData1 = AsMetadata(BufferUploads::TextureDesc::Plain2D(
+            reference._dimensions[0], reference._dimensions[1], reference._format, uint8(mipCount), uint16(arrayCount)));
+        auto images0 = BuildImages(metaData0, *texture._pkt);
+        auto images1 = BuildImages(metaData1, *reference._pkt);
+
+        double totalDifference = 0., totalReference = 0.;
+        float maxRelativeError = 0.f;
+        for (size_t i=0; i<images0.size(); ++i) {
+            auto floatImage0 = AsFloatImage(images0[i]);
+            auto floatImage1 = AsFloatImage(images1[i]);
+            const auto& image0 = *floatImage0.GetImage(0, 0, 0);
+            const auto& image1 = *floatImage1.GetImage(0, 0, 0);
+            for (unsigned y=0; y<image0.height; ++y) {
+                auto* row0 = (const Float4*)PtrAdd(image0.pixels, y*image0.rowPitch);
+                auto* row1 = (const Float4*)PtrAdd(image1.pixels, y*image1.rowPitch);
+                for (unsigned x=0; x<image0.width; ++x) {
+                    float difference = 0.f, magnitude = 0.f;
+                    for (unsigned c=0; c<3; ++c) {
+                        difference += std::abs(row0[x][c] - row1[x][c]);
+                        magnitude += std::abs(row1[x][c]);
+                    }
+                    totalDifference += difference;
+                    totalReference += magnitude;
+                        // (near black texels are compared with an absolute error)
+                    maxRelativeError = std::max(maxRelativeError, difference / std::max(magnitude, 1e-3f));
+                }
+            }
+        }
+
+        return TextureComparison
+            {
+                float(totalDifference / std::max(totalReference, 1e-6)),
+                maxRelativeError
+            };
+    }
+}
+
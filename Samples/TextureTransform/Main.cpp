@@ -70,6 +70,12 @@ namespace TextureTransform
         auto outputFile = doc.Attribute("o").Value();
         auto shader = doc.Attribute("s").Value();
 
+            // When "v" is set, we will also run that shader on the GPU, and compare the results
+            // (this is intended for validating the CPU transforms against the shader versions). 
+            // "t" is the largest mean relative error we will accept.
+        auto validationShader = doc.Attribute("v").Value();
+        auto validationTolerance = doc.Attribute("t", 0.05f);
+
         if (outputFile.Empty() || shader.Empty()) {
             LogAlwaysError << "Output file and shader required on the command line";
             LogAlwaysError << "Cmdline: " << cmdLine.AsString().c_str();
@@ -85,7 +91,15 @@ namespace TextureTransform
 
             // we can now construct basic services
         auto cleanup = MakeAutoCleanup([]() { TerminateFileSystemMonitoring(); });
-        auto device = RenderCore::CreateDevice();
+
+            // Build machines may not have a GPU. The CPU transforms can still be used in that
+            // case, so failing to create a device isn't fatal.
+        std::shared_ptr<RenderCore::IDevice> device;
+        TRY {
+            device = RenderCore::CreateDevice();
+        } CATCH (const std::exception& e) {
+            LogAlwaysWarning << "Could not create a GPU device. Only CPU transforms are available. Error: " << e.what();
+        } CATCH_END
         Samples::MinimalAssetServices services(device.get());
             
             // We need to think about SRGB modes... do we want to do the processing in
@@ -93,15 +107,36 @@ namespace TextureTransform
         auto shaderParameters = CreateParameterBox(doc.Element("p"));
 
         auto resultTexture = ExecuteTransform(
-            *device, MakeStringSection(xleDir), shader, shaderParameters,
+            device.get(), MakeStringSection(xleDir), shader, shaderParameters,
             {
                 { "Sky", HosekWilkieSky },
-                { "Compress", CompressTexture }
+                { "SkyCube", HosekWilkieSkyCube },
+                { "Compress", CompressTexture },
+                { "SpecularIBL", SpecularIBLTransform },
+                { "DiffuseIBL", DiffuseIBLTransform },
+                { "ProjectSH", SHTransform }
             });
         if (!resultTexture._pkt) {
             LogAlwaysError << "Error while performing texture transform";
             return -1;
         }
+
+        if (!validationShader.Empty()) {
+            if (device) {
+                auto referenceTexture = ExecuteTransform(
+                    device.get(), MakeStringSection(xleDir), validationShader, shaderParameters, {});
+                auto comparison = CompareTextures(resultTexture, referenceTexture);
+                LogAlwaysWarning 
+                    << "Comparison with (" << validationShader.AsString().c_str() << "). Mean relative error: " 
+                    << comparison._meanRelativeError << ", max relative error: " << comparison._maxRelativeError;
+                if (comparison._meanRelativeError > validationTolerance) {
+                    LogAlwaysError << "Result doesn't match the GPU reference (tolerance: " << validationTolerance << ")";
+                    return -1;
+                }
+            } else {
+                LogAlwaysWarning << "No GPU device available; skipping validation against (" << validationShader.AsString().c_str() << ")";
+            }
+        }
         
             // save "readback" as an output texture.
             // We will write a uncompressed format; normally a second command line
@@ -115,6 +150,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine,
 {
     ConsoleRig::StartupConfig cfg("texturetransform");
     cfg._setWorkingDir = false;
+        // batch tool -- background tasks can use the whole machine
+    cfg._reserveMainThreadCore = false;
+    cfg._longTaskThreadPriority = Utility::ThreadPriority::Normal;
     ConsoleRig::GlobalServices services(cfg);
 
     TRY {
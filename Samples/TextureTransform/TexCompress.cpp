@@ -263,6 +263,8 @@ namespace TextureTransform
         return std::move(result);
     }
 
+    static TextureResult AsTextureResult(DirectX::ScratchImage&& scratchImage);
+
     TextureResult CompressTexture(
         const BufferUploads::TextureDesc& desc, 
         const ParameterBox& parameters)
@@ -302,6 +304,11 @@ namespace TextureTransform
         } else
             scratchImage = PeformCompression_DXTex(srcDesc, *pkt, dstFormat);
 
+        return AsTextureResult(std::move(scratchImage));
+    }
+
+    static TextureResult AsTextureResult(DirectX::ScratchImage&& scratchImage)
+    {
         // We need to convert the output to a TextureResult to pass back. 
         // This requires creating a special case DataPacket that wraps the ScratchImage object
         auto format = scratchImage.GetMetadata().format;
@@ -317,5 +324,33 @@ namespace TextureTransform
                 unsigned(format), dims, mipCount, arrayCount
             };
     }
+
+    TextureResult ConvertTexture(TextureResult&& input, unsigned dstFormat)
+    {
+        if (input._format == dstFormat)
+            return std::move(input);
+
+        using namespace RenderCore::Metal;
+        auto srcDesc = BufferUploads::TextureDesc::Plain2D(
+            input._dimensions[0], input._dimensions[1], input._format,
+            uint8(input._mipCount), uint16(input._arrayCount));
+
+        DirectX::ScratchImage scratchImage;
+        auto dst = NativeFormat::Enum(dstFormat);
+        if (GetCompressionType(dst) == FormatCompressionType::BlockCompression) {
+                // (the intel compressor can't handle the smallest mips of a full chain, so use DirectXTex)
+            scratchImage = PeformCompression_DXTex(srcDesc, *input._pkt, dst);
+        } else {
+            auto metaData = AsMetadata(srcDesc);
+            auto images = BuildImages(metaData, *input._pkt);
+            auto hresult = DirectX::Convert(
+                AsPointer(images.cbegin()), images.size(), metaData,
+                AsDXGIFormat(dst), DirectX::TEX_FILTER_DEFAULT, 0.5f, scratchImage);
+            if (!SUCCEEDED(hresult))
+                Throw(::Exceptions::BasicLabel("Could not convert texture to the requested format"));
+        }
+
+        return AsTextureResult(std::move(scratchImage));
+    }
 }
 
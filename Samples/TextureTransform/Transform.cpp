@@ -52,6 +52,27 @@ namespace TextureTransform
         return std::move(compiledByteCode);
     }
 
+    SourceColorSpace GetSourceColorSpace(const ::Assets::ResChar initializer[])
+    {
+        SourceColorSpace colSpace = SourceColorSpace::Unspecified;
+        for (auto c:MakeFileNameSplitter(initializer).Parameters()) {
+            if (c == 'l' || c == 'L') { colSpace = SourceColorSpace::Linear; }
+            if (c == 's' || c == 'S') { colSpace = SourceColorSpace::SRGB; }
+        }
+
+        if (colSpace == SourceColorSpace::Unspecified)
+            colSpace = XlFindStringI(initializer, "_ddn") ? SourceColorSpace::Linear : SourceColorSpace::SRGB;
+        return colSpace;
+    }
+
+    unsigned AsSourceFormat(unsigned format, SourceColorSpace colSpace)
+    {
+        auto f = Metal::NativeFormat::Enum(format);
+        if (colSpace == SourceColorSpace::SRGB) return (unsigned)Metal::AsSRGBFormat(f);
+        else if (colSpace == SourceColorSpace::Linear) return (unsigned)Metal::AsLinearFormat(f);
+        return format;
+    }
+
     class InputResource
     {
     public:
@@ -63,8 +84,6 @@ namespace TextureTransform
 
         InputResource(const ::Assets::ResChar initializer[]);
         ~InputResource();
-    private:
-        enum class SourceColorSpace { SRGB, Linear, Unspecified };
     };
 
     InputResource::InputResource(const ::Assets::ResChar initializer[])
@@ -74,15 +93,7 @@ namespace TextureTransform
         _bindingHash = 0;
 
         auto splitter = MakeFileNameSplitter(initializer);
-
-        SourceColorSpace colSpace = SourceColorSpace::Unspecified;
-        for (auto c:splitter.Parameters()) {
-            if (c == 'l' || c == 'L') { colSpace = SourceColorSpace::Linear; }
-            if (c == 's' || c == 'S') { colSpace = SourceColorSpace::SRGB; }
-        }
-
-        if (colSpace == SourceColorSpace::Unspecified)
-            colSpace = XlFindStringI(initializer, "_ddn") ? SourceColorSpace::Linear : SourceColorSpace::SRGB;
+        auto colSpace = GetSourceColorSpace(initializer);
         
         using namespace BufferUploads;
         auto& uploads = Samples::MinimalAssetServices::GetBufferUploads();
@@ -97,9 +108,7 @@ namespace TextureTransform
         if (_resLocator) {
             _desc = ExtractDesc(*_resLocator->GetUnderlying())._textureDesc;
 
-            auto format = (Metal::NativeFormat::Enum)_desc._nativePixelFormat;
-            if (colSpace == SourceColorSpace::SRGB) format = Metal::AsSRGBFormat(format);
-            else if (colSpace == SourceColorSpace::Linear) format = Metal::AsLinearFormat(format);
+            auto format = (Metal::NativeFormat::Enum)AsSourceFormat(_desc._nativePixelFormat, colSpace);
             _srv = Metal::ShaderResourceView(_resLocator->GetUnderlying(), format);
             _finalFormat = format;
         }
@@ -132,7 +141,7 @@ namespace TextureTransform
     }
 
     TextureResult ExecuteTransform(
-        IDevice& device,
+        IDevice* device,
         StringSection<char> xleDir,
         StringSection<char> shaderName,
         const ParameterBox& parameters,
@@ -140,7 +149,16 @@ namespace TextureTransform
     {
         using namespace BufferUploads;
 
+            // CPU transforms load their own inputs, so they don't need a device. For these,
+            // we only need the format of the first input (to select default dimensions & format)
+        auto cpuFn = fns.find(shaderName.AsString());
+        bool isCPUTransform = cpuFn != fns.end();
+        if (!isCPUTransform && !device)
+            Throw(::Exceptions::BasicLabel("Shader based texture transforms require a GPU device"));
+
         std::vector<InputResource> inputResources;
+        auto firstInputFormat = Metal::NativeFormat::Unknown;
+        UInt2 firstInputDims(0, 0);
 
             // We'll interpret every string in the input parameters as a resource name
         for (auto i=parameters.Begin(); !i.IsEnd(); ++i) {
@@ -148,9 +166,24 @@ namespace TextureTransform
                 auto value = ImpliedTyping::AsString(
                     i.RawValue(), ptrdiff_t(i.ValueTableEnd()) - ptrdiff_t(i.RawValue()), i.Type());
 
+                if (isCPUTransform) {
+                    if (firstInputFormat == Metal::NativeFormat::Unknown) {
+                        auto desc = LoadTextureFormat(MakeFileNameSplitter(value).AllExceptParameters());
+                        if (desc._width != 0) {
+                            firstInputFormat = (Metal::NativeFormat::Enum)AsSourceFormat(desc._nativePixelFormat, GetSourceColorSpace(value.c_str()));
+                            firstInputDims = UInt2(desc._width, desc._height);
+                        }
+                    }
+                    continue;
+                }
+
                 InputResource inputRes(value.c_str());
                 if (inputRes._srv.IsGood()) {
                     inputRes._bindingHash = Hash64((const char*)i.Name());
+                    if (firstInputFormat == Metal::NativeFormat::Unknown) {
+                        firstInputFormat = inputRes._finalFormat;
+                        firstInputDims = UInt2(inputRes._desc._width, inputRes._desc._height);
+                    }
                     inputResources.push_back(std::move(inputRes));
                 }
             }
@@ -167,9 +200,9 @@ namespace TextureTransform
         unsigned arrayCount = 1;
         unsigned mipCount = 1;
         unsigned passCount = 1;
-        if (!inputResources.empty()) {
-            rtFormat = inputResources[0]._finalFormat;
-            viewDims = UInt2(inputResources[0]._desc._width, inputResources[0]._desc._height);
+        if (firstInputFormat != Metal::NativeFormat::Unknown) {
+            rtFormat = firstInputFormat;
+            viewDims = firstInputDims;
         }
 
         auto dimsParam = parameters.GetParameter<UInt2>(ParameterBox::MakeParameterNameHash("Dims"));
@@ -190,9 +223,8 @@ namespace TextureTransform
             viewDims[0], viewDims[1], unsigned(rtFormat), 
             uint8(mipCount), uint16(arrayCount));
 
-        auto i = fns.find(shaderName.AsString());
-        if (i != fns.end()) {
-            return (i->second)(dstDesc, parameters);
+        if (isCPUTransform) {
+            return (cpuFn->second)(dstDesc, parameters);
         } else {
             rtFormat = AsRTFormat(rtFormat);
             dstDesc._nativePixelFormat = rtFormat;
@@ -223,7 +255,7 @@ namespace TextureTransform
                     dstDesc, 
                     "TextureProcessOutput"));
 
-            auto metalContext = Metal::DeviceContext::Get(*device.GetImmediateContext());
+            auto metalContext = Metal::DeviceContext::Get(*device->GetImmediateContext());
             auto& commonRes = Techniques::CommonResources();
             metalContext->Bind(commonRes._cullDisable);
             metalContext->Bind(commonRes._dssDisable);
@@ -32,13 +32,50 @@ namespace TextureTransform
 
     using ProcessingFn = std::function<TextureResult(const BufferUploads::TextureDesc&, const ParameterBox&)>;
 
+    /// <summary>Runs a texture transform, either as a GPU shader or with a CPU function</summary>
+    /// When "shaderName" matches one of the entries in "fns", that function is used, and the 
+    /// device isn't required (so "device" can be null on machines without a GPU).
     TextureResult ExecuteTransform(
-        RenderCore::IDevice& device,
+        RenderCore::IDevice* device,
         StringSection<char> xleDir,
         StringSection<char> shaderName,
         const ParameterBox& parameters,
         std::map<std::string, ProcessingFn> fns);
 
+    enum class SourceColorSpace { SRGB, Linear, Unspecified };
+
+    /// <summary>Selects the color space for an input texture</summary>
+    /// The initializer can select the color space explicitly with a parameter (eg, "tex.dds:L"
+    /// or "tex.dds:S"). Otherwise normal maps ("_ddn") are linear, and everything else is SRGB.
+    SourceColorSpace GetSourceColorSpace(const ::Assets::ResChar initializer[]);
+    unsigned AsSourceFormat(unsigned nativeFormat, SourceColorSpace colSpace);
+
     TextureResult HosekWilkieSky(const BufferUploads::TextureDesc&, const ParameterBox& parameters);
+    TextureResult HosekWilkieSkyCube(const BufferUploads::TextureDesc&, const ParameterBox& parameters);
     TextureResult CompressTexture(const BufferUploads::TextureDesc& desc, const ParameterBox& parameters);
+
+        // CPU versions of the image based lighting filters (see IBLPrecalc.h)
+    TextureResult SpecularIBLTransform(const BufferUploads::TextureDesc& desc, const ParameterBox& parameters);
+    TextureResult DiffuseIBLTransform(const BufferUploads::TextureDesc& desc, const ParameterBox& parameters);
+    TextureResult SHTransform(const BufferUploads::TextureDesc& desc, const ParameterBox& parameters);
+
+    class FloatCubeMap;
+    TextureResult AsTextureResult(FloatCubeMap&& cubeMap);
+
+    /// <summary>Converts a texture to another format (compressing, if necessary)</summary>
+    /// CPU transforms generate floating point textures; this is used to write them in the 
+    /// format requested by the "Format" parameter.
+    TextureResult ConvertTexture(TextureResult&& input, unsigned dstFormat);
+
+    class TextureComparison
+    {
+    public:
+        float   _meanRelativeError;     ///< sum of absolute differences, divided by the sum of the reference values
+        float   _maxRelativeError;      ///< largest error for a single texel, relative to that reference texel
+    };
+
+    /// <summary>Compares the color channels of two textures with the same layout</summary>
+    /// Used to validate the CPU transforms against the GPU shaders. Both textures are converted
+    /// to 32 bit floats first, so the formats don't have to match.
+    TextureComparison CompareTextures(const TextureResult& texture, const TextureResult& reference);
 }
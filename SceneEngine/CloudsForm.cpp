@@ -9,6 +9,9 @@
 #include "Fluid.h"
 #include "FluidAdvection.h"
 #include "../Math/Noise.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/ThreadingUtils.h"
 #include "../Utility/Meta/ClassAccessorsImpl.h"
 
 namespace SceneEngine
@@ -77,6 +80,61 @@ namespace SceneEngine
         return std::pow(pressure/p0, kappa);
     }
     
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static float WindProfile(float altitudeKm)
+    {
+            // We will calculate the wind strength at altitude using the "power
+            // wind profile":
+            //      https://en.wikipedia.org/wiki/Wind_profile_power_law
+            //
+            // See also the "log wind profile" (which can be used to estimate
+            // the wind strength in the bottom 100 meters, and takes into account
+            // roughness of the terrain (such as forests and hills)
+        const float zr = 100.f;
+        const float alpha = 1.f/7.f;
+        return std::pow(altitudeKm * 1000.f / zr, alpha);
+    }
+
+    static float SaturationPressure(float temperature)
+    {
+            // August-Roche-Magnus formula (see Troposphere::GetEquilibriumMixingRatio)
+            // Result is in pascals
+        return XlExp(24.04f - 4283.58f / (temperature - 30.11f));
+    }
+
+        //  The saturation pressure depends only on temperature, so we can replace
+        //  the exponential with a lookup table. The table covers -80C to 60C in
+        //  steps of 1/8 of a degree. With linear interpolation, the relative error
+        //  is less than 5e-5 across the whole range (the error is largest at the cold end).
+        //  Temperatures outside of the table fall back to the full calculation.
+    static const float SaturationTableMinTemperature = 193.15f;
+    static const float SaturationTableStepsPerKelvin = 8.f;
+
+    class SaturationPressureTable
+    {
+    public:
+        float Lookup(float temperature) const
+        {
+            auto f = (temperature - SaturationTableMinTemperature) * SaturationTableStepsPerKelvin;
+            if (!(f >= 0.f && f < float(EntryCount-1)))
+                return SaturationPressure(temperature);
+            auto i = unsigned(f);
+            return LinearInterpolate(_table[i], _table[i+1], f - float(i));
+        }
+
+        SaturationPressureTable()
+        {
+            for (unsigned c=0; c<EntryCount; ++c)
+                _table[c] = SaturationPressure(SaturationTableMinTemperature + float(c) / SaturationTableStepsPerKelvin);
+        }
+    private:
+        static const unsigned EntryCount = 140*8+1;
+        float _table[EntryCount];
+    };
+
+    static SaturationPressureTable s_saturationPressureTable;
+    
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     class Troposphere
@@ -89,6 +147,22 @@ namespace SceneEngine
         float   GetEquilibriumMixingRatio(float potentialTemp, unsigned gridY) const;
         float   GetPotentialTemperatureRelease(unsigned gridY) const;
 
+            //  Values that depend only on the altitude are precalculated for each
+            //  level of the grid (each row in 2D, or each horizontal slice in 3D)
+        class Level
+        {
+        public:
+            float   _altitudeKm;
+            float   _pressure;                      // pascals
+            float   _exner;
+            float   _potentialTemperature;          // ambient potential temperature
+            float   _vaporMixingRatio;              // ambient vapor mixing ratio
+            float   _potentialTemperatureRelease;
+            float   _windProfile;
+        };
+        const Level& GetLevel(unsigned gridY) const { assert(gridY < _levels.size()); return _levels[gridY]; }
+        float   GetEquilibriumMixingRatio(float potentialTemp, const Level& level) const;
+
         float   AltitudeMinKm() const       { return _altitudeMin; }
         float   AltitudeMaxKm() const       { return _altitudeMax; }
         float   AirTemperature() const      { return _airTemperature; }
@@ -96,18 +170,19 @@ namespace SceneEngine
         float   LapseRate() const           { return _lapseRate; }
 
         Troposphere(
-            UInt2 gridDims,
+            unsigned gridHeight,
             float altitudeMinKm, float altitudeMaxKm,
             float airTemperature,
             float relativeHumidity, float lapseRate);
         Troposphere();
         ~Troposphere();
     private:
-        UInt2   _gridDims;
-        float   _altitudeMin, _altitudeMax;
-        float   _relativeHumidity;
-        float   _airTemperature;
-        float   _lapseRate;
+        unsigned    _gridHeight;
+        float       _altitudeMin, _altitudeMax;
+        float       _relativeHumidity;
+        float       _airTemperature;
+        float       _lapseRate;
+        std::vector<Level> _levels;
     };
 
     float Troposphere::GetVaporMixingRatio(unsigned gridY) const
@@ -159,7 +234,7 @@ namespace SceneEngine
             // using (x+b)/(x+b+c) == 1 - c/(x+b+c)
             //  (17.625f * T) / (T + 243.04f) == 17.625f - 4283.58f / (T - 30.11)
             // using c * exp(e) = exp(e + ln(c)),  for positive c
-        auto saturationPressure = XlExp(24.04f - 4283.58f / (T - 30.11f));
+        auto saturationPressure = SaturationPressure(T);
         // auto saturationPressure = 27570129378.f / XlExp(4283.58f / (T - 30.11f));
         // auto saturationPressure = 610.94f * std::pow(XlExp(1.f - 243.04f / (T - 30.11f)), 17.625f);
 
@@ -192,6 +267,15 @@ namespace SceneEngine
         return gasConstantRatio * saturationPressure/(pressure-saturationPressure);
     }
 
+    float Troposphere::GetEquilibriumMixingRatio(float potentialTemp, const Level& level) const
+    {
+            // Same as above, but using the precalculated pressure & exner function
+            // for this level, and the saturation pressure lookup table
+        auto saturationPressure = s_saturationPressureTable.Lookup(potentialTemp * level._exner);
+        const auto gasConstantRatio = 287.058f / 461.495f;     // Rd/Rv
+        return gasConstantRatio * saturationPressure/(level._pressure-saturationPressure);
+    }
+
     float Troposphere::GetPotentialTemperatureRelease(unsigned gridY) const
     {
             // Returns the potential temperature released during condensation
@@ -216,30 +300,126 @@ namespace SceneEngine
     float Troposphere::AltitudeKm(unsigned gridY) const
     {
         return LinearInterpolate(
-            _altitudeMin, _altitudeMax, float(gridY)/float(_gridDims[1]));
+            _altitudeMin, _altitudeMax, float(gridY)/float(_gridHeight));
     }
 
     float Troposphere::ZScale() const
     {
-        return (_altitudeMax-_altitudeMin) / float(_gridDims[1]);
+        return (_altitudeMax-_altitudeMin) / float(_gridHeight);
     }
 
     Troposphere::Troposphere(
-        UInt2 gridDims,
+        unsigned gridHeight,
         float altitudeMin, float altitudeMax,
         float airTemperature, float relativeHumidity, float lapseRate)
     {
-        _gridDims = gridDims;
+        _gridHeight = gridHeight;
         _altitudeMin = altitudeMin;
         _altitudeMax = altitudeMax;
         _airTemperature = airTemperature;
         _relativeHumidity = relativeHumidity;
         _lapseRate = lapseRate;
+
+            // (include 2 extra levels, for the case where gridHeight doesn't include the border)
+        _levels.resize(gridHeight+2);
+        for (unsigned y=0; y<unsigned(_levels.size()); ++y) {
+            auto& level = _levels[y];
+            level._altitudeKm = AltitudeKm(y);
+            level._pressure = PressureAtAltitude(level._altitudeKm, _lapseRate);
+            level._exner = ExnerFunction(level._pressure);
+            level._potentialTemperature = GetPotentialTemperature(y);
+            level._vaporMixingRatio = GetVaporMixingRatio(y);
+            level._potentialTemperatureRelease = GetPotentialTemperatureRelease(y);
+            level._windProfile = WindProfile(level._altitudeKm);
+        }
     }
 
-    Troposphere::Troposphere() {}
+    Troposphere::Troposphere() : _gridHeight(0), _altitudeMin(0.f), _altitudeMax(0.f), _relativeHumidity(0.f), _airTemperature(0.f), _lapseRate(0.f) {}
     Troposphere::~Troposphere() {}
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  Tuning values shared by the 2D & 3D simulations
+    static float tempDissipate = 0.9985f;
+    static float vaporDissipate = 0.9985f;  // we're adding so much extra vapor into the system that we need to remove it sometimes too
+    // static float velDissipate = 0.985f;
+    static float condensationDissipate = 0.9985f;
+    static float edgeDissipate = 0.f;
+
+    static float gain = 0.5f;
+    static float lacunarity = 2.1042f;
+    static unsigned octaves = 4;
+
+    template<typename Fn>
+        static void ForEachRowBlock(unsigned rowBegin, unsigned rowEnd, bool parallel, Fn&& fn)
+        {
+                //  Split the rows into blocks, and execute the blocks on the short task
+                //  thread pool (this thread also executes blocks). Each row only writes
+                //  to its own cells, so the blocks don't need any other synchronisation.
+            if (rowEnd <= rowBegin) return;
+            const unsigned minRowsPerBlock = 8;
+            auto& threadPool = ConsoleRig::GlobalServices::GetShortTaskThreadPool();
+            auto blockCount = std::min(threadPool.GetDesc()._threadCount + 1, (rowEnd - rowBegin + minRowsPerBlock - 1) / minRowsPerBlock);
+            if (!parallel || blockCount <= 1) {
+                fn(rowBegin, rowEnd);
+                return;
+            }
+
+            auto rowsPerBlock = (rowEnd - rowBegin + blockCount - 1) / blockCount;
+            ParallelFor(
+                threadPool, blockCount,
+                [&fn, rowBegin, rowEnd, rowsPerBlock](unsigned b)
+                {
+                    auto s = rowBegin + b*rowsPerBlock;
+                    if (s < rowEnd) fn(s, std::min(s+rowsPerBlock, rowEnd));
+                });
+        }
+
+    static void BuoyancyRow(
+        VectorX& velUpSrc, const VectorX& potTemp, const VectorX& qv, const VectorX& qc,
+        unsigned rowStart, unsigned rowLength, 
+        const Troposphere::Level& level, float scale, const CloudsForm2D::Settings& settings)
+    {
+            //  This is the same buoyancy equation as CloudsForm2D::Tick uses with the
+            //  reference update method, just written over a full row:
+            //      B = g * ((T/T0 * (1 + 0.61 * qv) - 1) * alpha - qc * beta)
+            //  (where "scale" is g / zScale)
+        velUpSrc.segment(rowStart, rowLength).array() += scale * (
+                ((potTemp.segment(rowStart, rowLength).array() * (1.f / level._potentialTemperature)) 
+                * (1.f + 0.61f * qv.segment(rowStart, rowLength).array()) - 1.f) * settings._buoyancyAlpha
+            -   qc.segment(rowStart, rowLength).array() * settings._buoyancyBeta);
+    }
+
+    static void CondensationRow(
+        VectorX& potTemp, VectorX& qv, VectorX& qc,
+        unsigned rowStart, unsigned rowLength,
+        const Troposphere& troposphere, const Troposphere::Level& level, 
+        const CloudsForm2D::Settings& settings)
+    {
+            //  See CloudsForm2D::Tick for a description of the condensation rules.
+            //  The saturation pressure lookup is a gather, so this part isn't vectorized
+        const auto condensationSpeed = std::min(1.f, settings._condensationSpeed);
+        const auto potTempRelease = level._potentialTemperatureRelease * settings._temperatureChangeSpeed;
+        auto* t = &potTemp[rowStart];
+        auto* v = &qv[rowStart];
+        auto* c = &qc[rowStart];
+        for (unsigned x=0; x<rowLength; ++x) {
+            auto equilibriumMixingRatio = troposphere.GetEquilibriumMixingRatio(t[x], level);
+
+            float deltaCondensation = 0.f;
+            if (v[x] > equilibriumMixingRatio) {
+                deltaCondensation = condensationSpeed * (v[x] - equilibriumMixingRatio);
+            } else if (v[x] < settings._evaporateThreshold * equilibriumMixingRatio) {
+                deltaCondensation = condensationSpeed * (v[x] - settings._evaporateThreshold * equilibriumMixingRatio);
+                deltaCondensation = std::max(deltaCondensation, -c[x]);
+            }
+
+            v[x] -= deltaCondensation;
+            c[x] += deltaCondensation;
+            t[x] += potTempRelease * deltaCondensation;
+        }
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     class CloudsForm2D::Pimpl
@@ -267,8 +447,63 @@ namespace SceneEngine
         EnforceIncompressibilityHelper _incompressibility;
 
         Troposphere _troposphere;
+
+        void BuoyancyRows(unsigned rowBegin, unsigned rowEnd, const Settings& settings);
+        void UpdateRows(unsigned rowBegin, unsigned rowEnd, float deltaTime, const Settings& settings);
+        void CondensationRows(unsigned rowBegin, unsigned rowEnd, const Settings& settings);
     };
 
+    void CloudsForm2D::Pimpl::BuoyancyRows(unsigned rowBegin, unsigned rowEnd, const Settings& settings)
+    {
+        const auto w = _dimsWithBorder[0];
+        const auto scale = 9.81f / 1000.f / _troposphere.ZScale();
+        for (unsigned y=rowBegin; y<rowEnd; ++y)
+            BuoyancyRow(
+                _velV[2], _potentialTemperature[1], _vaporMixingRatio[1], _condensedMixingRatio[1],
+                y*w, w, _troposphere.GetLevel(y), scale, settings);
+    }
+
+    void CloudsForm2D::Pimpl::UpdateRows(unsigned rowBegin, unsigned rowEnd, float dt, const Settings& settings)
+    {
+            //  Integrate the sources, dissipate towards ambient values and blend in
+            //  the cross wind. See the reference path in CloudsForm2D::Tick
+        const auto w = _dimsWithBorder[0];
+        const auto zScale = _troposphere.ZScale();
+        const auto windFactor = 0.075f;
+        for (unsigned y=rowBegin; y<rowEnd; ++y) {
+            const auto& level = _troposphere.GetLevel(y);
+            const auto s = y*w;
+
+            _velU[0].segment(s, w) = _velU[1].segment(s, w);
+            _velV[0].segment(s, w) = _velV[1].segment(s, w);
+            _velV[2].segment(s, w) = _velV[1].segment(s, w) + dt * _velV[2].segment(s, w);
+
+            _potentialTemperature[0].segment(s, w).array() = 
+                (_potentialTemperature[1].segment(s, w).array() - level._potentialTemperature) * tempDissipate + level._potentialTemperature;
+            _vaporMixingRatio[0].segment(s, w).array() = 
+                (_vaporMixingRatio[1].segment(s, w).array() + dt * _vaporMixingRatio[0].segment(s, w).array() - level._vaporMixingRatio) * vaporDissipate + level._vaporMixingRatio;
+            _condensedMixingRatio[0].segment(s, w) = _condensedMixingRatio[1].segment(s, w) * condensationDissipate;
+
+                // wind strength is constant across the row
+            auto noiseValue = SimplexFBM(
+                Float2(float(y) / 60.f, _time / 5.f),
+                1.f, gain, lacunarity, octaves);
+            auto windStrength = settings._crossWindSpeed * level._windProfile;
+            windStrength *= (0.5f + 0.5f * noiseValue) / 1000.f / zScale;
+            _velU[2].segment(s, w).array() = 
+                (_velU[1].segment(s, w).array() + dt * _velU[2].segment(s, w).array()) * (1.f - windFactor) + windStrength * windFactor;
+        }
+    }
+
+    void CloudsForm2D::Pimpl::CondensationRows(unsigned rowBegin, unsigned rowEnd, const Settings& settings)
+    {
+        const auto w = _dimsWithBorder[0];
+        for (unsigned y=rowBegin; y<rowEnd; ++y)
+            CondensationRow(
+                _potentialTemperature[1], _vaporMixingRatio[1], _condensedMixingRatio[1],
+                y*w, w, _troposphere, _troposphere.GetLevel(y), settings);
+    }
+
     void CloudsForm2D::Tick(float deltaTime, const Settings& settings)
     {
         float dt = deltaTime;
@@ -336,7 +571,7 @@ namespace SceneEngine
             ||  _pimpl->_troposphere.LapseRate() != settings._lapseRate) {
 
             _pimpl->_troposphere = Troposphere(
-                _pimpl->_dimsWithoutBorder, 
+                _pimpl->_dimsWithoutBorder[1], 
                 settings._altitudeMin, settings._altitudeMax,
                 settings._airTemperature, settings._relativeHumidity, settings._lapseRate);
         }
@@ -353,132 +588,130 @@ namespace SceneEngine
         const auto zScale = _pimpl->_troposphere.ZScale();
         const auto g = 9.81f / 1000.f;  // (in km/second)
 
+            //  With the table update methods, the thermodynamic parts of the update use
+            //  values precalculated for each row (and the saturation pressure table), and
+            //  are processed row by row (optionally spread across the short task thread pool).
+            //  The reference method calculates everything for each cell.
+        const bool useTables = settings._updateMethod != UpdateMethod::Reference;
+        const bool parallel = settings._updateMethod == UpdateMethod::ParallelTables;
+        auto* pimpl = _pimpl.get();
+
             // Buoyancy force
         const UInt2 border(0,1);
-        for (unsigned y=border[1]; y<dims[1]-border[1]; ++y)
-            for (unsigned x=border[0]; x<dims[0]-border[0]; ++x) {
+        if (useTables) {
+            ForEachRowBlock(border[1], dims[1]-border[1], parallel,
+                [pimpl, &settings](unsigned rowBegin, unsigned rowEnd) { pimpl->BuoyancyRows(rowBegin, rowEnd, settings); });
+        } else {
+            for (unsigned y=border[1]; y<dims[1]-border[1]; ++y)
+                for (unsigned x=border[0]; x<dims[0]-border[0]; ++x) {
                 
-                const auto i = y*dims[0]+x;
-                auto potentialTemp = potTempT1[i];
-                auto vapourMixingRatio = qvT1[i];
-                auto condensationMixingRatio = qcT1[i];
+                    const auto i = y*dims[0]+x;
+                    auto potentialTemp = potTempT1[i];
+                    auto vapourMixingRatio = qvT1[i];
+                    auto condensationMixingRatio = qcT1[i];
                     
-                    //
-                    // We must calculate a buoyancy force for the parcel of air. We're going
-                    // to use an equation that calculates the buoyancy from the temperature
-                    // (relative to the ambient temperature). Our basic equation for buoyancy
-                    // will be:
-                    //      B = g * (T - T0) / T0
-                    //      where T is the temperature, and T0 is the ambient temperature
-                    //
-                    // This is slightly different from what Harris uses in his paper:
-                    //      B = g * T / T0
-                    //
-                    // Since temperature and potential temperature are proportional to each
-                    // other, they can be used interchangeable (in other words, the "Exner" function
-                    // factors out of the equation).
-                    //
-                    // T0 should be the temperature of the air that the parcel is "submerged" in.
-                    // We will use the starting ambient temperature for T0.
-                    //
-                    // see:
-                    //  http://www.iac.ethz.ch/edu/courses/bachelor/vertiefung/atmospheric_physics/Slides_2012/buoyancy.pdf
-                    //  http://storm.colorado.edu/~dcn/ATOC5050/lectures/06_ThermoStabilty.pdf
-                    //
-                    // The "g" value is calibrated for dry air. But we can use the "virtual temperature"
-                    // to get a result for moist air.
-                    //
-                    // In atmosphere thermodynamics, the "virtual temperature" of a parcel of air
-                    // is a concept that allows us to simplify some equations. Given a "moist" packet
-                    // of air -- that is, a packet with some water vapor -- it should behave the same
-                    // as a dry packet of air at some temperature.
-                    // That is what the virtual temperature is -- the temperature of a dry packet of air
-                    // that would behave the same the given moist packet.
-                    //
-                    // It seems that the virtual temperature, for realistic vapour mixing ratios,
-                    // is close to linear against the vapour mixing ratio. So we can
-                    // use a simple equation to find it.
-                    //
-                    //  see also -- https://en.wikipedia.org/wiki/Virtual_temperature
-                    //
-                const auto ambientPotTemp = _pimpl->_troposphere.GetPotentialTemperature(y);
+                        //
+                        // We must calculate a buoyancy force for the parcel of air. We're going
+                        // to use an equation that calculates the buoyancy from the temperature
+                        // (relative to the ambient temperature). Our basic equation for buoyancy
+                        // will be:
+                        //      B = g * (T - T0) / T0
+                        //      where T is the temperature, and T0 is the ambient temperature
+                        //
+                        // This is slightly different from what Harris uses in his paper:
+                        //      B = g * T / T0
+                        //
+                        // Since temperature and potential temperature are proportional to each
+                        // other, they can be used interchangeable (in other words, the "Exner" function
+                        // factors out of the equation).
+                        //
+                        // T0 should be the temperature of the air that the parcel is "submerged" in.
+                        // We will use the starting ambient temperature for T0.
+                        //
+                        // see:
+                        //  http://www.iac.ethz.ch/edu/courses/bachelor/vertiefung/atmospheric_physics/Slides_2012/buoyancy.pdf
+                        //  http://storm.colorado.edu/~dcn/ATOC5050/lectures/06_ThermoStabilty.pdf
+                        //
+                        // The "g" value is calibrated for dry air. But we can use the "virtual temperature"
+                        // to get a result for moist air.
+                        //
+                        // In atmosphere thermodynamics, the "virtual temperature" of a parcel of air
+                        // is a concept that allows us to simplify some equations. Given a "moist" packet
+                        // of air -- that is, a packet with some water vapor -- it should behave the same
+                        // as a dry packet of air at some temperature.
+                        // That is what the virtual temperature is -- the temperature of a dry packet of air
+                        // that would behave the same the given moist packet.
+                        //
+                        // It seems that the virtual temperature, for realistic vapour mixing ratios,
+                        // is close to linear against the vapour mixing ratio. So we can
+                        // use a simple equation to find it.
+                        //
+                        //  see also -- https://en.wikipedia.org/wiki/Virtual_temperature
+                        //
+                    const auto ambientPotTemp = _pimpl->_troposphere.GetPotentialTemperature(y);
+
+                        // Our basic equation:
+                        //  B0 = (VT - T0) / T0
+                        //
+                        // We can simplify this a little bit to:
+                        //  VT = T * (1 + 0.61 * qv)
+                        //  B0 = (VT - T0) / T0
+                        //     = VT / T0 - 1
+                        //     = T/T0 - 1 + 0.61 * T / T0 * qv
+                        //     = T/T0 * (1 + 0.61 * qv)  - 1
+                    auto B0 = (potentialTemp/ambientPotTemp) * (1.f + 0.61f * vapourMixingRatio) - 1.f;
+                    auto B = g * (B0 * settings._buoyancyAlpha - condensationMixingRatio * settings._buoyancyBeta);
+                    velVSrc[i] += B / zScale;
 
-                    // Our basic equation:
-                    //  B0 = (VT - T0) / T0
-                    //
-                    // We can simplify this a little bit to:
-                    //  VT = T * (1 + 0.61 * qv)
-                    //  B0 = (VT - T0) / T0
-                    //     = VT / T0 - 1
-                    //     = T/T0 - 1 + 0.61 * T / T0 * qv
-                    //     = T/T0 * (1 + 0.61 * qv)  - 1
-                auto B0 = (potentialTemp/ambientPotTemp) * (1.f + 0.61f * vapourMixingRatio) - 1.f;
-                auto B = g * (B0 * settings._buoyancyAlpha - condensationMixingRatio * settings._buoyancyBeta);
-                velVSrc[i] += B / zScale;
+                }
+        }
 
+        if (useTables) {
+            ForEachRowBlock(0, dims[1], parallel,
+                [pimpl, dt, &settings](unsigned rowBegin, unsigned rowEnd) { pimpl->UpdateRows(rowBegin, rowEnd, dt, settings); });
+        } else {
+            for (unsigned c=0; c<N; ++c) {
+                velUT0[c] = velUT1[c];
+                velVT0[c] = velVT1[c];
+                velUWorking[c] = velUT1[c] + dt * velUSrc[c];
+                velVWorking[c] = velVT1[c] + dt * velVSrc[c];
+
+                qcWorking[c] = qcT1[c];
+                qvWorking[c] = qvT1[c] + dt * qvSrc[c];
+                potTempWorking[c] = potTempT1[c];
+
+                    // In theory, the diffusion is the only kind of dissipation we should have for these
+                    // properties. But when we're wrapping around the edges, we will probably need some
+                    // extra artifical dissipation to a cycling that just gets stronger and stronger.
+                const auto gridY = c/_pimpl->_dimsWithBorder[0];
+                const auto ambientPotTemp = _pimpl->_troposphere.GetPotentialTemperature(gridY);
+                const auto ambientVapor = _pimpl->_troposphere.GetVaporMixingRatio(gridY);
+                potTempWorking[c] = LinearInterpolate(ambientPotTemp, potTempWorking[c], tempDissipate);
+                // velUWorking[c] *= velDissipate;
+                // velVWorking[c] *= velDissipate;
+                    // when the vapor/condensation dissipates, what happens to it's latent heat? Let's just ignore that...
+                qvWorking[c] = LinearInterpolate(ambientVapor, qvWorking[c], vaporDissipate);
+                qcWorking[c] = LinearInterpolate(0.f, qcWorking[c], condensationDissipate);
+
+                    // Adjust velocity based on ambient wind
+                    // Rather than adding wind in any single part, we'll just blend the 
+                    // simulated velocity value with the ambient wind value
+                    // (see WindProfile for the wind strength at altitude)
+
+                auto altitudeKm = _pimpl->_troposphere.AltitudeKm(gridY);
+                auto windStrength = settings._crossWindSpeed * WindProfile(altitudeKm);
+                auto noiseValue = SimplexFBM(
+                    Float2(float(gridY) / 60.f, _pimpl->_time / 5.f),
+                    1.f, gain, lacunarity, octaves);
+                windStrength *= (0.5f + 0.5f * noiseValue) / 1000.f / zScale;      // assuming square grid -- using z scale for xy value
+                const auto windFactor = 0.075f;
+                velUWorking[c] = LinearInterpolate(velUWorking[c], windStrength, windFactor);
+
+                    // add a little random up/down movement as well
+                // velVWorking[c] += windStrength * 0.1f * SimplexFBM(
+                //     Float2(float(gridY) / 78.f, _pimpl->_time / 7.8f),
+                //     1.f, gain, lacunarity, octaves);
             }
-
-        static float tempDissipate = 0.9985f;
-        static float vaporDissipate = 0.9985f;  // we're adding so much extra vapor into the system that we need to remove it sometimes too
-        // static float velDissipate = 0.985f;
-        static float condensationDissipate = 0.9985f;
-        static float edgeDissipate = 0.f;
-
-        const float zr = 100.f;
-        const float alpha = 1.f/7.f;
-
-        static float gain = 0.5f;
-        static float lacunarity = 2.1042f;
-        static unsigned octaves = 4;
-
-        for (unsigned c=0; c<N; ++c) {
-            velUT0[c] = velUT1[c];
-            velVT0[c] = velVT1[c];
-            velUWorking[c] = velUT1[c] + dt * velUSrc[c];
-            velVWorking[c] = velVT1[c] + dt * velVSrc[c];
-
-            qcWorking[c] = qcT1[c];
-            qvWorking[c] = qvT1[c] + dt * qvSrc[c];
-            potTempWorking[c] = potTempT1[c];
-
-                // In theory, the diffusion is the only kind of dissipation we should have for these
-                // properties. But when we're wrapping around the edges, we will probably need some
-                // extra artifical dissipation to a cycling that just gets stronger and stronger.
-            const auto gridY = c/_pimpl->_dimsWithBorder[0];
-            const auto ambientPotTemp = _pimpl->_troposphere.GetPotentialTemperature(gridY);
-            const auto ambientVapor = _pimpl->_troposphere.GetVaporMixingRatio(gridY);
-            potTempWorking[c] = LinearInterpolate(ambientPotTemp, potTempWorking[c], tempDissipate);
-            // velUWorking[c] *= velDissipate;
-            // velVWorking[c] *= velDissipate;
-                // when the vapor/condensation dissipates, what happens to it's latent heat? Let's just ignore that...
-            qvWorking[c] = LinearInterpolate(ambientVapor, qvWorking[c], vaporDissipate);
-            qcWorking[c] = LinearInterpolate(0.f, qcWorking[c], condensationDissipate);
-
-                // Adjust velocity based on ambient wind
-                // Rather than adding wind in any single part, we'll just blend the 
-                // simulated velocity value with the ambient wind value
-                //
-                // We will calculate the wind strength at altitude using the "power
-                // wind profile":
-                //      https://en.wikipedia.org/wiki/Wind_profile_power_law
-                //
-                // See also the "log wind profile" (which can be used to estimate
-                // the wind strength in the bottom 100 meters, and takes into account
-                // roughness of the terrain (such as forests and hills)
-
-            auto altitudeKm = _pimpl->_troposphere.AltitudeKm(gridY);
-            auto windStrength = settings._crossWindSpeed * std::pow(altitudeKm * 1000.f / zr, alpha);
-            auto noiseValue = SimplexFBM(
-                Float2(float(gridY) / 60.f, _pimpl->_time / 5.f),
-                1.f, gain, lacunarity, octaves);
-            windStrength *= (0.5f + 0.5f * noiseValue) / 1000.f / zScale;      // assuming square grid -- using z scale for xy value
-            const auto windFactor = 0.075f;
-            velUWorking[c] = LinearInterpolate(velUWorking[c], windStrength, windFactor);
-
-                // add a little random up/down movement as well
-            // velVWorking[c] += windStrength * 0.1f * SimplexFBM(
-            //     Float2(float(gridY) / 78.f, _pimpl->_time / 7.8f),
-            //     1.f, gain, lacunarity, octaves);
         }
 
         // const auto marginFlags = 0u;
@@ -514,6 +747,10 @@ namespace SceneEngine
         const auto v_amp = settings._inputVapor;
         const auto u_amp = settings._inputUpdraft;
         const auto t_amp = settings._inputTemperature;
+        const auto bottomVapor = _pimpl->_troposphere.GetVaporMixingRatio(0);
+        const auto bottomPotTemp = _pimpl->_troposphere.GetPotentialTemperature(0);
+        const auto topVapor = _pimpl->_troposphere.GetVaporMixingRatio(_pimpl->_dimsWithBorder[1]-1);
+        const auto topPotTemp = _pimpl->_troposphere.GetPotentialTemperature(_pimpl->_dimsWithBorder[1]-1);
         for (unsigned x=0; x<_pimpl->_dimsWithBorder[0]; ++x) {
             auto vaporNoiseValue = SimplexFBM(
                 Float2(float(x) / v_scale[0], _pimpl->_time / v_scale[1]),
@@ -525,13 +762,16 @@ namespace SceneEngine
                 Float2(float(x) / u_scale[0], _pimpl->_time / u_scale[1]),
                 1.f, gain, lacunarity, octaves);
 
-            qvWorking[x]  = _pimpl->_troposphere.GetVaporMixingRatio(0);
+            qvWorking[x]  = bottomVapor;
             vaporNoiseValue -= 0.25f;
             qvWorking[x] += std::max(0.f, vaporNoiseValue * vaporNoiseValue * vaporNoiseValue) * v_amp;
-            potTempWorking[x]  = _pimpl->_troposphere.GetPotentialTemperature(0);
+            potTempWorking[x]  = bottomPotTemp;
             potTempWorking[x] += tempNoiseValue * tempNoiseValue * tempNoiseValue * t_amp;
             velUWorking[x]  = 0.f;
-            velVWorking[x] += std::max(0.f, std::pow(updraftNoiseValue, 5.f)) * u_amp;
+            auto updraft = useTables
+                ? (updraftNoiseValue * updraftNoiseValue) * (updraftNoiseValue * updraftNoiseValue) * updraftNoiseValue
+                : std::pow(updraftNoiseValue, 5.f);
+            velVWorking[x] += std::max(0.f, updraft) * u_amp;
             qcWorking[x]    = 0.f;
 
                 // shouldn't really need to set the "T1" values here
@@ -553,10 +793,10 @@ namespace SceneEngine
             qcT1[i2] = qcWorking[i2] = 0.f; // LinearInterpolate(  qcWorking[i2], 0.f, 0.05f);
             qvT1[i2] = qvWorking[i2] = 
                 // _pimpl->_troposphere.GetVaporMixingRatio(_pimpl->_dimsWithBorder[1]-1);
-                std::min(qvWorking[i2], LinearInterpolate(_pimpl->_troposphere.GetVaporMixingRatio(_pimpl->_dimsWithBorder[1]-1), qvWorking[i2], edgeDissipate));
+                std::min(qvWorking[i2], LinearInterpolate(topVapor, qvWorking[i2], edgeDissipate));
             potTempT1[i2] = potTempWorking[i2] = 
                 // _pimpl->_troposphere.GetPotentialTemperature(_pimpl->_dimsWithBorder[1]-1);
-                std::min(potTempWorking[i2], LinearInterpolate(_pimpl->_troposphere.GetPotentialTemperature(_pimpl->_dimsWithBorder[1]-1), potTempWorking[i2], edgeDissipate));
+                std::min(potTempWorking[i2], LinearInterpolate(topPotTemp, potTempWorking[i2], edgeDissipate));
         }
 
         if (settings._obstructionType != 0) {
@@ -635,78 +875,81 @@ namespace SceneEngine
 
             // Perform condenstation after advection
             // Does it matter much if we do this before or after advection?
-        for (unsigned y=border[1]; y<dims[1]-border[1]; ++y)
-            for (unsigned x=border[0]; x<dims[0]-border[0]; ++x) {
-
-                    //
-                    // When the water vapour mixing ratio exceeds a certain point, condensation
-                    // may occur. This point is called the equilibrium point. It depends on
-                    // the temperature of the parcel. If any vapor condenses, we must release some
-                    // latent heat into surrounding the atmosphere.
-                    //
-                    // So there are 2 controlling variables here:
-                    //  * equilibrium mixing ratio -- the threshold at which vapor starts to condense
-                    //  * potential temperature release -- how much potential temperature is released on condensation
-                    //
-
-                const auto i = y*dims[0]+x;
-                auto& potentialTemp = potTempT1[i];
-                auto& vapourMixingRatio = qvT1[i];
-                auto& condensationMixingRatio = qcT1[i];
-
-                auto equilibriumMixingRatio = _pimpl->_troposphere.GetEquilibriumMixingRatio(potentialTemp, y);
-                auto potTempRelease = _pimpl->_troposphere.GetPotentialTemperatureRelease(y);
-
-                    // Once we know our mixing ratio is above the equilibrium point -- how quickly should we
-                    // get condensation? Delta time should be a factor here, but the integration isn't very
-                    // accurate.
-                    // Adjusting mixing ratios like this seems awkward. But I guess that the values tracked
-                    // should generally be small relative to the total mixture (ie, ratios should be much
-                    // smaller than 1.f). Otherwise changing one ratio effectively changes the meaning of
-                    // the other (given that they are ratios against all other substances in the mixture).
-                    // But, then again, in this simple model the condensationMixingRatio doesn't effect the 
-                    // equilibriumMixingRatio equation. Only the change in temperature (which is adjusted 
-                    // here) effects the equilibriumMixingRatio -- which can result in oscillation in some
-                    // cases.
-
-                float deltaCondensation = 0.f;
-                if (vapourMixingRatio > equilibriumMixingRatio) {
-                    auto upperDifference = vapourMixingRatio - equilibriumMixingRatio;
-                    deltaCondensation = std::min(1.f, settings._condensationSpeed) * upperDifference;
-                } else if (vapourMixingRatio < settings._evaporateThreshold * equilibriumMixingRatio) {
-                    auto lowerDifference = vapourMixingRatio - settings._evaporateThreshold * equilibriumMixingRatio;
-                    deltaCondensation = std::min(1.f, settings._condensationSpeed) * lowerDifference;
-                    deltaCondensation = std::max(deltaCondensation, -condensationMixingRatio);
-                }
+        if (useTables) {
+            ForEachRowBlock(border[1], dims[1]-border[1], parallel,
+                [pimpl, &settings](unsigned rowBegin, unsigned rowEnd) { pimpl->CondensationRows(rowBegin, rowEnd, settings); });
+        } else {
+            for (unsigned y=border[1]; y<dims[1]-border[1]; ++y)
+                for (unsigned x=border[0]; x<dims[0]-border[0]; ++x) {
 
-                vapourMixingRatio -= deltaCondensation;
-                condensationMixingRatio += deltaCondensation;
+                        //
+                        // When the water vapour mixing ratio exceeds a certain point, condensation
+                        // may occur. This point is called the equilibrium point. It depends on
+                        // the temperature of the parcel. If any vapor condenses, we must release some
+                        // latent heat into surrounding the atmosphere.
+                        //
+                        // So there are 2 controlling variables here:
+                        //  * equilibrium mixing ratio -- the threshold at which vapor starts to condense
+                        //  * potential temperature release -- how much potential temperature is released on condensation
+                        //
+
+                    const auto i = y*dims[0]+x;
+                    auto& potentialTemp = potTempT1[i];
+                    auto& vapourMixingRatio = qvT1[i];
+                    auto& condensationMixingRatio = qcT1[i];
+
+                    auto equilibriumMixingRatio = _pimpl->_troposphere.GetEquilibriumMixingRatio(potentialTemp, y);
+                    auto potTempRelease = _pimpl->_troposphere.GetPotentialTemperatureRelease(y);
+
+                        // Once we know our mixing ratio is above the equilibrium point -- how quickly should we
+                        // get condensation? Delta time should be a factor here, but the integration isn't very
+                        // accurate.
+                        // Adjusting mixing ratios like this seems awkward. But I guess that the values tracked
+                        // should generally be small relative to the total mixture (ie, ratios should be much
+                        // smaller than 1.f). Otherwise changing one ratio effectively changes the meaning of
+                        // the other (given that they are ratios against all other substances in the mixture).
+                        // But, then again, in this simple model the condensationMixingRatio doesn't effect the 
+                        // equilibriumMixingRatio equation. Only the change in temperature (which is adjusted 
+                        // here) effects the equilibriumMixingRatio -- which can result in oscillation in some
+                        // cases.
+
+                    float deltaCondensation = 0.f;
+                    if (vapourMixingRatio > equilibriumMixingRatio) {
+                        auto upperDifference = vapourMixingRatio - equilibriumMixingRatio;
+                        deltaCondensation = std::min(1.f, settings._condensationSpeed) * upperDifference;
+                    } else if (vapourMixingRatio < settings._evaporateThreshold * equilibriumMixingRatio) {
+                        auto lowerDifference = vapourMixingRatio - settings._evaporateThreshold * equilibriumMixingRatio;
+                        deltaCondensation = std::min(1.f, settings._condensationSpeed) * lowerDifference;
+                        deltaCondensation = std::max(deltaCondensation, -condensationMixingRatio);
+                    }
 
-                    // Delta condensation should effect the temperature, as well
-                    // When water vapour condenses, it releases its latent heat (this is heat
-                    // that was absorbed when the vapor was originally evaporated).
-                    //
-                    // Note that the change in temperature will change the equilibrium
-                    // mixing ratio (for the next update). And it will also effect buoyancy.
-                    // So the heat change should have an important effect on the dynamics of
-                    // the system.
-                    //
-                    // We have to be careful, because this can make conversion from vapor to
-                    // condensed back to vapor unstable (which can cause rapid fluxuations back
-                    // and forth). To avoid this, we adjust the conversion points and maybe
-                    // leak some heat so that less heat is absorbed when cloud is evaporating
-                    // back into vapor.
+                    vapourMixingRatio -= deltaCondensation;
+                    condensationMixingRatio += deltaCondensation;
+
+                        // Delta condensation should effect the temperature, as well
+                        // When water vapour condenses, it releases its latent heat (this is heat
+                        // that was absorbed when the vapor was originally evaporated).
+                        //
+                        // Note that the change in temperature will change the equilibrium
+                        // mixing ratio (for the next update). And it will also effect buoyancy.
+                        // So the heat change should have an important effect on the dynamics of
+                        // the system.
+                        //
+                        // We have to be careful, because this can make conversion from vapor to
+                        // condensed back to vapor unstable (which can cause rapid fluxuations back
+                        // and forth). To avoid this, we adjust the conversion points and maybe
+                        // leak some heat so that less heat is absorbed when cloud is evaporating
+                        // back into vapor.
                                     
-                auto deltaPotTemp = potTempRelease * deltaCondensation;
-                potentialTemp += deltaPotTemp * settings._temperatureChangeSpeed;
-            }
-
-        for (unsigned c=0; c<N; ++c) {
-            velUSrc[c] = 0.f;
-            velVSrc[c] = 0.f;
-            qvSrc[c] = 0.f;
+                    auto deltaPotTemp = potTempRelease * deltaCondensation;
+                    potentialTemp += deltaPotTemp * settings._temperatureChangeSpeed;
+                }
         }
 
+        velUSrc.fill(0.f);
+        velVSrc.fill(0.f);
+        qvSrc.fill(0.f);
+
         _pimpl->_time += deltaTime;
     }
 
@@ -1085,6 +1328,18 @@ namespace SceneEngine
 
     UInt2 CloudsForm2D::GetDimensions() const { return _pimpl->_dimsWithBorder; }
 
+    const float* CloudsForm2D::GetField(Field::Enum field) const
+    {
+        switch (field) {
+        case Field::VelocityU:              return _pimpl->_velU[1].data();
+        case Field::VelocityV:              return _pimpl->_velV[1].data();
+        case Field::Vapor:                  return _pimpl->_vaporMixingRatio[1].data();
+        case Field::Condensed:              return _pimpl->_condensedMixingRatio[1].data();
+        case Field::PotentialTemperature:   return _pimpl->_potentialTemperature[1].data();
+        default:                            return nullptr;
+        }
+    }
+
     CloudsForm2D::CloudsForm2D(UInt2 dimensions)
     {
         _pimpl = std::make_unique<Pimpl>();
@@ -1104,7 +1359,7 @@ namespace SceneEngine
 
         Settings defaults;
         _pimpl->_troposphere = Troposphere(
-            _pimpl->_dimsWithBorder, 
+            _pimpl->_dimsWithBorder[1], 
             defaults._altitudeMin, defaults._altitudeMax, 
             defaults._airTemperature, defaults._relativeHumidity, defaults._lapseRate);
         
@@ -1170,7 +1425,375 @@ namespace SceneEngine
         _altitudeMax = 4.f;
         _lapseRate = 6.5f;
         _obstructionType = 0;
+        _updateMethod = UpdateMethod::ParallelTables;
     }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class CloudsForm3D::Pimpl
+    {
+    public:
+        VectorX _velU[3];
+        VectorX _velV[3];
+        VectorX _velW[3];
+
+        VectorX _vaporMixingRatio[2];      // qv
+        VectorX _condensedMixingRatio[2];   // qc
+        VectorX _potentialTemperature[2];   // theta
+
+        UInt3 _dimsWithoutBorder;
+        UInt3 _dimsWithBorder;
+        unsigned _N;
+        float _time;
+
+        PoissonSolver _poissonSolver;
+
+        DiffusionHelper _velocityDiffusion;
+        DiffusionHelper _vaporDiffusion;
+        DiffusionHelper _condensedDiffusion;
+        DiffusionHelper _temperatureDiffusion;
+        std::shared_ptr<PoissonSolver::PreparedMatrix> _incompressibility;
+
+        Troposphere _troposphere;
+
+            //  Rows run along X, and there are _dimsWithBorder[1] rows in each
+            //  altitude level. So the level for a row is row / _dimsWithBorder[1]
+        void BuoyancyRows(unsigned rowBegin, unsigned rowEnd, const Settings& settings);
+        void UpdateRows(unsigned rowBegin, unsigned rowEnd, float deltaTime, const Settings& settings);
+        void CondensationRows(unsigned rowBegin, unsigned rowEnd, const Settings& settings);
+    };
+
+    void CloudsForm3D::Pimpl::BuoyancyRows(unsigned rowBegin, unsigned rowEnd, const Settings& settings)
+    {
+        const auto w = _dimsWithBorder[0];
+        const auto scale = 9.81f / 1000.f / _troposphere.ZScale();
+        for (unsigned r=rowBegin; r<rowEnd; ++r)
+            BuoyancyRow(
+                _velW[2], _potentialTemperature[1], _vaporMixingRatio[1], _condensedMixingRatio[1],
+                r*w, w, _troposphere.GetLevel(r / _dimsWithBorder[1]), scale, settings);
+    }
+
+    void CloudsForm3D::Pimpl::UpdateRows(unsigned rowBegin, unsigned rowEnd, float dt, const Settings& settings)
+    {
+        const auto w = _dimsWithBorder[0];
+        const auto zScale = _troposphere.ZScale();
+        const auto windFactor = 0.075f;
+        unsigned currentLevel = ~0u;
+        float windStrength = 0.f;
+        for (unsigned r=rowBegin; r<rowEnd; ++r) {
+            const auto z = r / _dimsWithBorder[1];
+            const auto& level = _troposphere.GetLevel(z);
+            const auto s = r*w;
+
+            _velU[0].segment(s, w) = _velU[1].segment(s, w);
+            _velV[0].segment(s, w) = _velV[1].segment(s, w);
+            _velW[0].segment(s, w) = _velW[1].segment(s, w);
+            _velV[2].segment(s, w) = _velV[1].segment(s, w) + dt * _velV[2].segment(s, w);
+            _velW[2].segment(s, w) = _velW[1].segment(s, w) + dt * _velW[2].segment(s, w);
+
+            _potentialTemperature[0].segment(s, w).array() = 
+                (_potentialTemperature[1].segment(s, w).array() - level._potentialTemperature) * tempDissipate + level._potentialTemperature;
+            _vaporMixingRatio[0].segment(s, w).array() = 
+                (_vaporMixingRatio[1].segment(s, w).array() + dt * _vaporMixingRatio[0].segment(s, w).array() - level._vaporMixingRatio) * vaporDissipate + level._vaporMixingRatio;
+            _condensedMixingRatio[0].segment(s, w) = _condensedMixingRatio[1].segment(s, w) * condensationDissipate;
+
+                // wind strength is constant across the whole level
+            if (z != currentLevel) {
+                auto noiseValue = SimplexFBM(
+                    Float2(float(z) / 60.f, _time / 5.f),
+                    1.f, gain, lacunarity, octaves);
+                windStrength = settings._crossWindSpeed * level._windProfile;
+                windStrength *= (0.5f + 0.5f * noiseValue) / 1000.f / zScale;
+                currentLevel = z;
+            }
+            _velU[2].segment(s, w).array() = 
+                (_velU[1].segment(s, w).array() + dt * _velU[2].segment(s, w).array()) * (1.f - windFactor) + windStrength * windFactor;
+        }
+    }
+
+    void CloudsForm3D::Pimpl::CondensationRows(unsigned rowBegin, unsigned rowEnd, const Settings& settings)
+    {
+        const auto w = _dimsWithBorder[0];
+        for (unsigned r=rowBegin; r<rowEnd; ++r)
+            CondensationRow(
+                _potentialTemperature[1], _vaporMixingRatio[1], _condensedMixingRatio[1],
+                r*w, w, _troposphere, _troposphere.GetLevel(r / _dimsWithBorder[1]), settings);
+    }
+
+    void CloudsForm3D::Tick(float deltaTime, const Settings& settings)
+    {
+            //  This follows the same steps as CloudsForm2D::Tick -- see the comments
+            //  there for more information about the simulation
+        float dt = deltaTime;
+        auto* pimpl = _pimpl.get();
+        const auto dims = pimpl->_dimsWithBorder;
+        const auto rowsPerLevel = dims[1];
+        const auto rowCount = dims[1] * dims[2];
+        const auto levelSize = dims[0] * dims[1];
+        const bool parallel = settings._updateMethod == CloudsForm2D::UpdateMethod::ParallelTables;
+
+        auto& velUT0 = pimpl->_velU[0];
+        auto& velUT1 = pimpl->_velU[1];
+        auto& velUWorking = pimpl->_velU[2];
+
+        auto& velVT0 = pimpl->_velV[0];
+        auto& velVT1 = pimpl->_velV[1];
+        auto& velVWorking = pimpl->_velV[2];
+
+        auto& velWT0 = pimpl->_velW[0];
+        auto& velWT1 = pimpl->_velW[1];
+        auto& velWWorking = pimpl->_velW[2];
+
+        auto& potTempT1 = pimpl->_potentialTemperature[1];
+        auto& potTempWorking = pimpl->_potentialTemperature[0];
+        auto& qvT1 = pimpl->_vaporMixingRatio[1];
+        auto& qvWorking = pimpl->_vaporMixingRatio[0];
+        auto& qcT1 = pimpl->_condensedMixingRatio[1];
+        auto& qcWorking = pimpl->_condensedMixingRatio[0];
+
+        if (    pimpl->_troposphere.AltitudeMinKm() != settings._altitudeMin 
+            ||  pimpl->_troposphere.AltitudeMaxKm() != settings._altitudeMax
+            ||  pimpl->_troposphere.AirTemperature() != settings._airTemperature 
+            ||  pimpl->_troposphere.RelativeHumidity() != settings._relativeHumidity
+            ||  pimpl->_troposphere.LapseRate() != settings._lapseRate) {
+
+            pimpl->_troposphere = Troposphere(
+                dims[2], 
+                settings._altitudeMin, settings._altitudeMax,
+                settings._airTemperature, settings._relativeHumidity, settings._lapseRate);
+        }
+
+            // Buoyancy force (skipping the top and bottom levels)
+        ForEachRowBlock(rowsPerLevel, rowCount-rowsPerLevel, parallel,
+            [pimpl, &settings](unsigned rowBegin, unsigned rowEnd) { pimpl->BuoyancyRows(rowBegin, rowEnd, settings); });
+
+        ForEachRowBlock(0, rowCount, parallel,
+            [pimpl, dt, &settings](unsigned rowBegin, unsigned rowEnd) { pimpl->UpdateRows(rowBegin, rowEnd, dt, settings); });
+
+        const auto wrapEdges = 0u;
+        pimpl->_velocityDiffusion.Execute(
+            pimpl->_poissonSolver,
+            VectorField3D(&velUWorking, &velVWorking, &velWWorking, dims),
+            settings._viscosity, deltaTime, (PoissonSolver::Method)settings._diffusionMethod, wrapEdges, "Velocity");
+
+        pimpl->_condensedDiffusion.Execute(
+            pimpl->_poissonSolver,
+            ScalarField3D(&qcWorking, dims),
+            settings._condensedDiffusionRate, deltaTime, (PoissonSolver::Method)settings._diffusionMethod, wrapEdges, "Condensed");
+
+        pimpl->_vaporDiffusion.Execute(
+            pimpl->_poissonSolver,
+            ScalarField3D(&qvWorking, dims),
+            settings._vaporDiffusionRate, deltaTime, (PoissonSolver::Method)settings._diffusionMethod, wrapEdges, "Vapor");
+
+        pimpl->_temperatureDiffusion.Execute(
+            pimpl->_poissonSolver,
+            ScalarField3D(&potTempWorking, dims),
+            settings._temperatureDiffusionRate, deltaTime, (PoissonSolver::Method)settings._diffusionMethod, wrapEdges, "Temperature");
+
+            // Fill in the bottom level with vapor and temperature entering
+            // from landscape below, and fade the top level to ambient values
+        static Float3 v_scale = Float3(485.5f, 485.5f, 3.6f);
+        static Float3 t_scale = Float3(210.6f, 210.6f, 2.4f);
+        static Float3 u_scale = Float3(234.3f, 234.3f, 15.7f);
+
+        const auto v_amp = settings._inputVapor;
+        const auto u_amp = settings._inputUpdraft;
+        const auto t_amp = settings._inputTemperature;
+        const auto& bottomLevel = pimpl->_troposphere.GetLevel(0);
+        const auto& topLevel = pimpl->_troposphere.GetLevel(dims[2]-1);
+        for (unsigned y=0; y<dims[1]; ++y)
+            for (unsigned x=0; x<dims[0]; ++x) {
+                auto vaporNoiseValue = SimplexFBM(
+                    Float3(float(x) / v_scale[0], float(y) / v_scale[1], pimpl->_time / v_scale[2]),
+                    1.f, gain, lacunarity, octaves);
+                auto tempNoiseValue = SimplexFBM(
+                    Float3(float(x) / t_scale[0], float(y) / t_scale[1], pimpl->_time / t_scale[2]),
+                    1.f, gain, lacunarity, octaves);
+                auto updraftNoiseValue = SimplexFBM(
+                    Float3(float(x) / u_scale[0], float(y) / u_scale[1], pimpl->_time / u_scale[2]),
+                    1.f, gain, lacunarity, octaves);
+
+                const auto i = y*dims[0]+x;
+                vaporNoiseValue -= 0.25f;
+                qvWorking[i] = bottomLevel._vaporMixingRatio + std::max(0.f, vaporNoiseValue * vaporNoiseValue * vaporNoiseValue) * v_amp;
+                potTempWorking[i] = bottomLevel._potentialTemperature + tempNoiseValue * tempNoiseValue * tempNoiseValue * t_amp;
+                velUWorking[i] = 0.f;
+                velVWorking[i] = 0.f;
+                auto updraft = (updraftNoiseValue * updraftNoiseValue) * (updraftNoiseValue * updraftNoiseValue) * updraftNoiseValue;
+                velWWorking[i] += std::max(0.f, updraft) * u_amp;
+                qcWorking[i] = 0.f;
+
+                qvT1[i] = qvWorking[i];
+                potTempT1[i] = potTempWorking[i];
+                velUT1[i] = velUWorking[i];
+                velVT1[i] = velVWorking[i];
+                velWT1[i] = velWWorking[i];
+                qcT1[i] = qcWorking[i];
+
+                const auto i2 = (dims[2]-1)*levelSize + i;
+                qcT1[i2] = qcWorking[i2] = 0.f;
+                qvT1[i2] = qvWorking[i2] = 
+                    std::min(qvWorking[i2], LinearInterpolate(topLevel._vaporMixingRatio, qvWorking[i2], edgeDissipate));
+                potTempT1[i2] = potTempWorking[i2] = 
+                    std::min(potTempWorking[i2], LinearInterpolate(topLevel._potentialTemperature, potTempWorking[i2], edgeDissipate));
+            }
+
+        AdvectionSettings advSettings {
+            (AdvectionMethod)settings._advectionMethod, 
+            (AdvectionInterp)settings._interpolationMethod, settings._advectionSteps,
+            AdvectionBorder::Margin, AdvectionBorder::Margin, AdvectionBorder::Margin
+        };
+        PerformAdvection(
+            VectorField3D(&velUT1,      &velVT1,        &velWT1,        dims),
+            VectorField3D(&velUWorking, &velVWorking,   &velWWorking,   dims),
+            VectorField3D(&velUT0,      &velVT0,        &velWT0,        dims),
+            VectorField3D(&velUWorking, &velVWorking,   &velWWorking,   dims),
+            deltaTime, advSettings);
+
+        ReflectBorder3D(velUT1, dims, 0);
+        ReflectBorder3D(velVT1, dims, 1);
+        ReflectBorder3D(velWT1, dims, 2);
+        EnforceIncompressibility(
+            VectorField3D(&velUT1, &velVT1, &velWT1, dims),
+            pimpl->_poissonSolver, *pimpl->_incompressibility,
+            (PoissonSolver::Method)settings._enforceIncompressibilityMethod);
+
+        PerformAdvection(
+            ScalarField3D(&qcT1, dims), ScalarField3D(&qcWorking, dims),
+            VectorField3D(&velUT0, &velVT0, &velWT0, dims), VectorField3D(&velUT1, &velVT1, &velWT1, dims),
+            deltaTime, advSettings);
+        PerformAdvection(
+            ScalarField3D(&qvT1, dims), ScalarField3D(&qvWorking, dims),
+            VectorField3D(&velUT0, &velVT0, &velWT0, dims), VectorField3D(&velUT1, &velVT1, &velWT1, dims),
+            deltaTime, advSettings);
+        PerformAdvection(
+            ScalarField3D(&potTempT1, dims), ScalarField3D(&potTempWorking, dims),
+            VectorField3D(&velUT0, &velVT0, &velWT0, dims), VectorField3D(&velUT1, &velVT1, &velWT1, dims),
+            deltaTime, advSettings);
+
+        ForEachRowBlock(rowsPerLevel, rowCount-rowsPerLevel, parallel,
+            [pimpl, &settings](unsigned rowBegin, unsigned rowEnd) { pimpl->CondensationRows(rowBegin, rowEnd, settings); });
+
+        velUWorking.fill(0.f);
+        velVWorking.fill(0.f);
+        velWWorking.fill(0.f);
+        qvWorking.fill(0.f);
+
+        pimpl->_time += deltaTime;
+    }
+
+    void CloudsForm3D::AddVapor(UInt3 coords, float amount)
+    {
+        if (    coords[0] < _pimpl->_dimsWithoutBorder[0] 
+            &&  coords[1] < _pimpl->_dimsWithoutBorder[1]
+            &&  coords[2] < _pimpl->_dimsWithoutBorder[2]) {
+
+            unsigned i = (coords[0]+1) + _pimpl->_dimsWithBorder[0] * ((coords[1]+1) + (coords[2]+1) * _pimpl->_dimsWithBorder[1]);
+            _pimpl->_vaporMixingRatio[0][i] += amount;
+        }
+    }
+
+    UInt3 CloudsForm3D::GetDimensions() const { return _pimpl->_dimsWithBorder; }
+
+    const float* CloudsForm3D::GetField(Field::Enum field) const
+    {
+        switch (field) {
+        case Field::VelocityU:              return _pimpl->_velU[1].data();
+        case Field::VelocityV:              return _pimpl->_velV[1].data();
+        case Field::VelocityW:              return _pimpl->_velW[1].data();
+        case Field::Vapor:                  return _pimpl->_vaporMixingRatio[1].data();
+        case Field::Condensed:              return _pimpl->_condensedMixingRatio[1].data();
+        case Field::PotentialTemperature:   return _pimpl->_potentialTemperature[1].data();
+        default:                            return nullptr;
+        }
+    }
+
+    void CloudsForm3D::RenderDebugging(
+        RenderCore::Metal::DeviceContext& metalContext,
+        LightingParserContext& parserContext,
+        FluidDebuggingMode debuggingMode)
+    {
+        static float qcMin = 0.f, qcMax = 1e-3f;
+        static float qvMin = 0.f, qvMax = 1e-2f;
+        static float tMin = CelsiusToKelvin(15.f), tMax = CelsiusToKelvin(32.f);
+        switch (debuggingMode) {
+        case FluidDebuggingMode::Density:
+            RenderFluidDebugging3D(
+                metalContext, parserContext, RenderFluidMode::Scalar,
+                _pimpl->_dimsWithBorder, qcMin, qcMax,
+                { _pimpl->_condensedMixingRatio[1].data() });
+            break;
+
+        case FluidDebuggingMode::Velocity:
+            RenderFluidDebugging3D(
+                metalContext, parserContext, RenderFluidMode::Vector,
+                _pimpl->_dimsWithBorder, 0.f, 1.f,
+                { _pimpl->_velU[1].data(), _pimpl->_velV[1].data(), _pimpl->_velW[1].data() });
+            break;
+
+        case FluidDebuggingMode::Temperature:
+            RenderFluidDebugging3D(
+                metalContext, parserContext, RenderFluidMode::Scalar,
+                _pimpl->_dimsWithBorder, tMin, tMax,
+                { _pimpl->_potentialTemperature[1].data() });
+            break;
+
+        case FluidDebuggingMode::Vapor:
+            RenderFluidDebugging3D(
+                metalContext, parserContext, RenderFluidMode::Scalar,
+                _pimpl->_dimsWithBorder, qvMin, qvMax,
+                { _pimpl->_vaporMixingRatio[1].data() });
+            break;
+        }
+    }
+
+    CloudsForm3D::CloudsForm3D(UInt3 dimensions)
+    {
+        _pimpl = std::make_unique<Pimpl>();
+        _pimpl->_dimsWithoutBorder = dimensions;
+        _pimpl->_dimsWithBorder = dimensions + UInt3(2, 2, 2);
+        const auto& dims = _pimpl->_dimsWithBorder;
+        auto N = dims[0] * dims[1] * dims[2];
+        _pimpl->_N = N;
+        _pimpl->_time = 0.f;
+
+        for (unsigned c=0; c<dimof(_pimpl->_velU); ++c) {
+            _pimpl->_velU[c] = VectorX(N);
+            _pimpl->_velV[c] = VectorX(N);
+            _pimpl->_velW[c] = VectorX(N);
+            _pimpl->_velU[c].fill(0.f);
+            _pimpl->_velV[c].fill(0.f);
+            _pimpl->_velW[c].fill(0.f);
+        }
+
+        Settings defaults;
+        _pimpl->_troposphere = Troposphere(
+            dims[2], 
+            defaults._altitudeMin, defaults._altitudeMax, 
+            defaults._airTemperature, defaults._relativeHumidity, defaults._lapseRate);
+
+            // start with ambient values in every level (see the CloudsForm2D constructor)
+        const auto levelSize = dims[0] * dims[1];
+        for (unsigned c=0; c<dimof(_pimpl->_vaporMixingRatio); ++c) {
+            _pimpl->_potentialTemperature[c] = VectorX(N);
+            _pimpl->_condensedMixingRatio[c] = VectorX(N);
+            _pimpl->_vaporMixingRatio[c] = VectorX(N);
+
+            for (unsigned z=0; z<dims[2]; ++z) {
+                const auto& level = _pimpl->_troposphere.GetLevel(z);
+                _pimpl->_potentialTemperature[c].segment(z*levelSize, levelSize).fill(level._potentialTemperature);
+                _pimpl->_vaporMixingRatio[c].segment(z*levelSize, levelSize).fill(level._vaporMixingRatio);
+            }
+            _pimpl->_condensedMixingRatio[c].fill(0.f);
+        }
+
+        _pimpl->_poissonSolver = PoissonSolver(3, &_pimpl->_dimsWithBorder[0]);
+        _pimpl->_incompressibility = _pimpl->_poissonSolver.PrepareDivergenceMatrix(
+            PoissonSolver::Method::PreconCG, 0u);
+    }
+
+    CloudsForm3D::~CloudsForm3D() {}
 }
 
 #include "../RenderOverlays/OverlayContext.h"
@@ -1333,6 +1956,7 @@ template<> const ClassAccessors& GetAccessors<SceneEngine::CloudsForm2D::Setting
         props.Add(u("AltitudeMax"), DefaultGet(Obj, _altitudeMax),  DefaultSet(Obj, _altitudeMax));
         props.Add(u("LapseRate"), DefaultGet(Obj, _lapseRate),  DefaultSet(Obj, _lapseRate));
         props.Add(u("ObstructionType"), DefaultGet(Obj, _obstructionType),  DefaultSet(Obj, _obstructionType));
+        props.Add(u("UpdateMethod"), DefaultGet(Obj, _updateMethod),  DefaultSet(Obj, _updateMethod));
         
         init = true;
     }
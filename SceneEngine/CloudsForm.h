@@ -20,6 +20,13 @@ namespace SceneEngine
     class CloudsForm2D
     {
     public:
+            //  Reference calculates all thermodynamic values for every cell. The table
+            //  methods precalculate values for each altitude, and use a lookup table for 
+            //  the saturation pressure (see CloudsForm.cpp for the error bounds).
+            //  ParallelTables also spreads the rows across the short task thread pool
+        struct UpdateMethod { enum Enum { Reference, Tables, ParallelTables }; };
+        struct Field { enum Enum { VelocityU, VelocityV, VelocityW, Vapor, Condensed, PotentialTemperature }; };
+
         struct Settings
         {
                 // diffusion
@@ -59,6 +66,9 @@ namespace SceneEngine
             float       _lapseRate;         // Kelvin/KM
             int         _obstructionType;
 
+                // update
+            int         _updateMethod;      // (UpdateMethod::Enum)
+
             Settings();
         };
 
@@ -69,6 +79,10 @@ namespace SceneEngine
 
         UInt2 GetDimensions() const;
 
+            //  Returns the results of the last tick (including the border). Field::VelocityW
+            //  isn't used in 2D
+        const float* GetField(Field::Enum field) const;
+
         void RenderDebugging(
             RenderCore::Metal::DeviceContext& metalContext,
             LightingParserContext& parserContext,
@@ -87,6 +101,35 @@ namespace SceneEngine
 
         void OldTick(float deltaTime, const Settings& settings);
     };
+
+        //  3D version of CloudsForm2D. The altitude axis is Z.
+        //  Vorticity confinement & the obstruction aren't supported in 3D, and the 
+        //  borders are margins on every side (so the cross wind doesn't wrap around). 
+        //  The thermodynamic parts always use the table update methods
+    class CloudsForm3D
+    {
+    public:
+        using Settings = CloudsForm2D::Settings;
+        using Field = CloudsForm2D::Field;
+
+        void Tick(float deltaTime, const Settings& settings);
+        void AddVapor(UInt3 coords, float amount);
+
+        UInt3 GetDimensions() const;                        // (including the border)
+        const float* GetField(Field::Enum field) const;
+
+        void RenderDebugging(
+            RenderCore::Metal::DeviceContext& metalContext,
+            LightingParserContext& parserContext,
+            FluidDebuggingMode debuggingMode = FluidDebuggingMode::Density);
+
+        CloudsForm3D(UInt3 dimensions);
+        ~CloudsForm3D();
+
+    private:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
 }
 
 
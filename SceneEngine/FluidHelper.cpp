@@ -19,14 +19,10 @@ namespace SceneEngine
         return solver.PrepareDiffusionMatrix(diffusion, method, wrapEdges);
     }
 
-    void DiffusionHelper::Execute(
-        PoissonSolver& solver, VectorField2D vectorField,
-        float diffusionAmount, float deltaTime,
-        PoissonSolver::Method method, unsigned wrapEdges,
-        const char name[])
+    void DiffusionHelper::PrepareMatrix(
+        PoissonSolver& solver, float diffusionAmount, float deltaTime,
+        PoissonSolver::Method method, unsigned wrapEdges)
     {
-        if (!diffusionAmount || !deltaTime) return;
-
         if (    !_matrix || _preparedValue != deltaTime * diffusionAmount || method != _preparedMethod 
                 || wrapEdges != _preparedWrapEdges) {
 
@@ -35,6 +31,16 @@ namespace SceneEngine
             _preparedWrapEdges = wrapEdges;
             _matrix = BuildDiffusionMethod(solver, _preparedValue, _preparedMethod, _preparedWrapEdges);
         }
+    }
+
+    void DiffusionHelper::Execute(
+        PoissonSolver& solver, VectorField2D vectorField,
+        float diffusionAmount, float deltaTime,
+        PoissonSolver::Method method, unsigned wrapEdges,
+        const char name[])
+    {
+        if (!diffusionAmount || !deltaTime) return;
+        PrepareMatrix(solver, diffusionAmount, deltaTime, method, wrapEdges);
 
         auto iterationsu = solver.Solve(
             AsScalarField1D(*vectorField._u), *_matrix, AsScalarField1D(*vectorField._u), 
@@ -53,13 +59,46 @@ namespace SceneEngine
         PoissonSolver::Method method, unsigned wrapEdges, const char name[])
     {
         if (!diffusionAmount || !deltaTime) return;
+        PrepareMatrix(solver, diffusionAmount, deltaTime, method, wrapEdges);
 
-        if (!_matrix || _preparedValue != deltaTime * diffusionAmount || method != _preparedMethod) {
-            _preparedValue = deltaTime * diffusionAmount;
-            _preparedMethod = method;
-            _preparedWrapEdges = wrapEdges;
-            _matrix = BuildDiffusionMethod(solver, _preparedValue, _preparedMethod, _preparedWrapEdges);
-        }
+        auto iterationsu = solver.Solve(
+            AsScalarField1D(*field._u), *_matrix, AsScalarField1D(*field._u), 
+            method);
+
+        if (name)
+            LogInfo << name << " diffusion took: (" << iterationsu << ") iterations.";
+    }
+
+    void DiffusionHelper::Execute(
+        PoissonSolver& solver, VectorField3D vectorField,
+        float diffusionAmount, float deltaTime,
+        PoissonSolver::Method method, unsigned wrapEdges,
+        const char name[])
+    {
+        if (!diffusionAmount || !deltaTime) return;
+        PrepareMatrix(solver, diffusionAmount, deltaTime, method, wrapEdges);
+
+        auto iterationsu = solver.Solve(
+            AsScalarField1D(*vectorField._u), *_matrix, AsScalarField1D(*vectorField._u), 
+            method);
+        auto iterationsv = solver.Solve(
+            AsScalarField1D(*vectorField._v), *_matrix, AsScalarField1D(*vectorField._v), 
+            method);
+        auto iterationsw = solver.Solve(
+            AsScalarField1D(*vectorField._w), *_matrix, AsScalarField1D(*vectorField._w), 
+            method);
+
+        if (name)
+            LogInfo << name << " diffusion took: (" << iterationsu << ", " << iterationsv << ", " << iterationsw << ") iterations.";
+    }
+
+    void DiffusionHelper::Execute(
+        PoissonSolver& solver, ScalarField3D field,
+        float diffusionAmount, float deltaTime,
+        PoissonSolver::Method method, unsigned wrapEdges, const char name[])
+    {
+        if (!diffusionAmount || !deltaTime) return;
+        PrepareMatrix(solver, diffusionAmount, deltaTime, method, wrapEdges);
 
         auto iterationsu = solver.Solve(
             AsScalarField1D(*field._u), *_matrix, AsScalarField1D(*field._u), 
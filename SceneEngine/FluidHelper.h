@@ -44,6 +44,18 @@ namespace SceneEngine
             PoissonSolver::Method method = PoissonSolver::Method::PreconCG,  unsigned wrapEdges = 0u,
             const char name[] = nullptr);
 
+        void Execute(
+            PoissonSolver& solver, VectorField3D vectorField,
+            float diffusionAmount, float deltaTime,
+            PoissonSolver::Method method = PoissonSolver::Method::PreconCG, unsigned wrapEdges = 0u,
+            const char name[] = nullptr);
+
+        void Execute(
+            PoissonSolver& solver, ScalarField3D field,
+            float diffusionAmount, float deltaTime,
+            PoissonSolver::Method method = PoissonSolver::Method::PreconCG,  unsigned wrapEdges = 0u,
+            const char name[] = nullptr);
+
         DiffusionHelper();
         ~DiffusionHelper();
     private:
@@ -51,6 +63,10 @@ namespace SceneEngine
         unsigned    _preparedWrapEdges;
         PoissonSolver::Method _preparedMethod;
         std::shared_ptr<PoissonSolver::PreparedMatrix> _matrix;
+
+        void PrepareMatrix(
+            PoissonSolver& solver, float diffusionAmount, float deltaTime,
+            PoissonSolver::Method method, unsigned wrapEdges);
     };
 
     class EnforceIncompressibilityHelper
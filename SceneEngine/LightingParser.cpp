@@ -10,6 +10,7 @@
 #include "SceneEngineUtils.h"
 
 #include "LightingTargets.h"
+#include "TransientTargetPool.h"
 #include "LightInternal.h"
 #include "Tonemap.h"
 #include "VolumetricFog.h"
@@ -37,9 +38,12 @@
 #include "../RenderCore/Metal/DeviceContext.h"
 #include "../RenderCore/Metal/Shader.h"
 #include "../ConsoleRig/Console.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include "../Math/Transformations.h"
 #include "../Math/ProjectionMath.h"
 #include "../Utility/FunctionUtils.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/ThreadingUtils.h"
 
 #include "../RenderCore/DX11/Metal/DX11Utils.h"
 
@@ -249,40 +253,43 @@ namespace SceneEngine
     class FinalResolveResources
     {
     public:
-        class Desc
-        {
-        public:
-            Desc(unsigned width, unsigned height, Metal::NativeFormat::Enum format)
-                : _width(width), _height(height), _format(format) {}
-
-            unsigned            _width, _height;
-            Metal::NativeFormat::Enum  _format;
-        };
-
         ResourcePtr         _postMsaaResolveTexture;
         Metal::RenderTargetView    _postMsaaResolveTarget;
         Metal::ShaderResourceView  _postMsaaResolveSRV;
 
-        FinalResolveResources(const Desc& desc);
+        FinalResolveResources(
+            unsigned width, unsigned height, Metal::NativeFormat::Enum format,
+            TransientTargetPool& pool, unsigned firstPass, unsigned lastPass);
     };
 
-    FinalResolveResources::FinalResolveResources(const Desc& desc)
+    FinalResolveResources::FinalResolveResources(
+        unsigned width, unsigned height, Metal::NativeFormat::Enum format,
+        TransientTargetPool& pool, unsigned firstPass, unsigned lastPass)
     {
         using namespace BufferUploads;
         auto bufferUploadsDesc = BuildRenderTargetDesc(
             BindFlag::ShaderResource|BindFlag::RenderTarget,
-            BufferUploads::TextureDesc::Plain2D(desc._width, desc._height, Metal::AsDXGIFormat(desc._format)),
+            BufferUploads::TextureDesc::Plain2D(width, height, Metal::AsDXGIFormat(format)),
             "FinalResolve");
-        auto postMsaaResolveTexture = CreateResourceImmediate(bufferUploadsDesc);
-
-        Metal::RenderTargetView postMsaaResolveTarget(postMsaaResolveTexture.get());
-        Metal::ShaderResourceView postMsaaResolveSRV(postMsaaResolveTexture.get());
+        auto postMsaaResolve = pool.Acquire(bufferUploadsDesc, firstPass, lastPass);
 
-        _postMsaaResolveTexture = std::move(postMsaaResolveTexture);
-        _postMsaaResolveTarget = std::move(postMsaaResolveTarget);
-        _postMsaaResolveSRV = std::move(postMsaaResolveSRV);
+        _postMsaaResolveTexture = pool.GetResource(postMsaaResolve);
+        _postMsaaResolveTarget = pool.GetRTV(postMsaaResolve);
+        _postMsaaResolveSRV = pool.GetSRV(postMsaaResolve);
     }
 
+        //  Render targets used by LightingParser_MainScene come from this pool. 
+        //  The passes below are used to describe when each target is used
+    class MainSceneTargetsBox
+    {
+    public:
+        class Desc {};
+        TransientTargetPool _pool;
+        MainSceneTargetsBox(const Desc&) {}
+    };
+
+    struct MainScenePass { enum Enum { Scene, ResolveMSAA, PostProcess }; };
+
     void LightingParser_ResolveMSAA(
         Metal::DeviceContext& context, 
         LightingParserContext& parserContext,
@@ -722,10 +729,21 @@ namespace SceneEngine
         typedef Metal::NativeFormat::Enum NativeFormat;
         auto sampling = BufferUploads::TextureSamples::Create(
             uint8(std::max(qualitySettings._samplingCount, 1u)), uint8(qualitySettings._samplingQuality));
-        auto& lightingResTargets = Techniques::FindCachedBox2<LightingResolveTextureBox>(
-            unsigned(mainViewport.Width), unsigned(mainViewport.Height),
-            (!precisionTargets) ? FormatStack(NativeFormat::R16G16B16A16_FLOAT) : FormatStack(NativeFormat::R32G32B32A32_FLOAT),
-            sampling);
+        auto& targetPool = Techniques::FindCachedBox2<MainSceneTargetsBox>()._pool;
+        targetPool.BeginFrame();
+
+            //  when we resolve MSAA, the lighting resolve texture isn't needed after that point
+        LightingResolveTextureBox lightingResTargets(
+            LightingResolveTextureBox::Desc(
+                unsigned(mainViewport.Width), unsigned(mainViewport.Height),
+                (!precisionTargets) ? FormatStack(NativeFormat::R16G16B16A16_FLOAT) : FormatStack(NativeFormat::R32G32B32A32_FLOAT),
+                sampling),
+            targetPool, MainScenePass::Scene,
+            (qualitySettings._samplingCount > 1) ? MainScenePass::ResolveMSAA : MainScenePass::PostProcess);
+
+            //  The gbuffer targets must outlive the pending overlays (some debugging
+            //  overlays read from them in LightingParser_Overlays, below)
+        std::unique_ptr<MainTargetsBox> deferredTargets;
 
         if (qualitySettings._lightingModel == RenderingQualitySettings::LightingModel::Deferred) {
 
@@ -743,16 +761,19 @@ namespace SceneEngine
                 //      .. however, it possible some clients might prefer 10 or 16 bit albedo textures
                 //      In these cases, the first buffer should be a matching format.
             const bool enableParametersBuffer = Tweakable("EnableParametersBuffer", true);
-            auto& mainTargets = Techniques::FindCachedBox2<MainTargetsBox>(
-                unsigned(mainViewport.Width), unsigned(mainViewport.Height),
-                (!precisionTargets) ? FormatStack(NativeFormat::R8G8B8A8_UNORM_SRGB) : FormatStack(NativeFormat::R32G32B32A32_FLOAT),
-                (!precisionTargets) ? FormatStack(NativeFormat::R8G8B8A8_SNORM) : FormatStack(NativeFormat::R32G32B32A32_FLOAT),
-                FormatStack(enableParametersBuffer ? ((!precisionTargets) ? FormatStack(NativeFormat::R8G8B8A8_UNORM) : FormatStack(NativeFormat::R32G32B32A32_FLOAT)) : NativeFormat::Unknown),
-                FormatStack(
-                    NativeFormat(DXGI_FORMAT_R24G8_TYPELESS), 
-                    NativeFormat(DXGI_FORMAT_R24_UNORM_X8_TYPELESS), 
-                    NativeFormat(DXGI_FORMAT_D24_UNORM_S8_UINT)),
-                sampling);
+            deferredTargets = std::make_unique<MainTargetsBox>(
+                MainTargetsBox::Desc(
+                    unsigned(mainViewport.Width), unsigned(mainViewport.Height),
+                    (!precisionTargets) ? FormatStack(NativeFormat::R8G8B8A8_UNORM_SRGB) : FormatStack(NativeFormat::R32G32B32A32_FLOAT),
+                    (!precisionTargets) ? FormatStack(NativeFormat::R8G8B8A8_SNORM) : FormatStack(NativeFormat::R32G32B32A32_FLOAT),
+                    FormatStack(enableParametersBuffer ? ((!precisionTargets) ? FormatStack(NativeFormat::R8G8B8A8_UNORM) : FormatStack(NativeFormat::R32G32B32A32_FLOAT)) : NativeFormat::Unknown),
+                    FormatStack(
+                        NativeFormat(DXGI_FORMAT_R24G8_TYPELESS), 
+                        NativeFormat(DXGI_FORMAT_R24_UNORM_X8_TYPELESS), 
+                        NativeFormat(DXGI_FORMAT_D24_UNORM_S8_UINT)),
+                    sampling),
+                targetPool, MainScenePass::Scene, MainScenePass::PostProcess);
+            auto& mainTargets = *deferredTargets;
 
             auto& globalState = parserContext.GetTechniqueContext()._globalEnvironmentState;
             globalState.SetParameter((const utf8*)"GBUFFER_TYPE", enableParametersBuffer?1:2);
@@ -817,12 +838,14 @@ namespace SceneEngine
 
         } else if (qualitySettings._lightingModel == RenderingQualitySettings::LightingModel::Forward) {
 
-            auto& mainTargets = Techniques::FindCachedBox2<ForwardTargetsBox>(
-                unsigned(mainViewport.Width), unsigned(mainViewport.Height),
-                FormatStack(NativeFormat(DXGI_FORMAT_R24G8_TYPELESS), 
-                            NativeFormat(DXGI_FORMAT_R24_UNORM_X8_TYPELESS), 
-                            NativeFormat(DXGI_FORMAT_D24_UNORM_S8_UINT)),
-                sampling);
+            ForwardTargetsBox mainTargets(
+                ForwardTargetsBox::Desc(
+                    unsigned(mainViewport.Width), unsigned(mainViewport.Height),
+                    FormatStack(NativeFormat(DXGI_FORMAT_R24G8_TYPELESS), 
+                                NativeFormat(DXGI_FORMAT_R24_UNORM_X8_TYPELESS), 
+                                NativeFormat(DXGI_FORMAT_D24_UNORM_S8_UINT)),
+                    sampling),
+                targetPool, MainScenePass::Scene, MainScenePass::PostProcess);
 
             metalContext.Clear(mainTargets._msaaDepthBuffer, 1.f, 0);
             metalContext.Bind(
@@ -864,8 +887,9 @@ namespace SceneEngine
                 //
             if (qualitySettings._samplingCount > 1) {
                 Metal::TextureDesc2D inputTextureDesc(postLightingResolveTexture);
-				auto& msaaResolveRes = Techniques::FindCachedBox2<FinalResolveResources>(
-					inputTextureDesc.Width, inputTextureDesc.Height, Metal::AsNativeFormat(inputTextureDesc.Format));
+				FinalResolveResources msaaResolveRes(
+					inputTextureDesc.Width, inputTextureDesc.Height, Metal::AsNativeFormat(inputTextureDesc.Format),
+                    targetPool, MainScenePass::ResolveMSAA, MainScenePass::PostProcess);
                 LightingParser_ResolveMSAA(
                     metalContext, parserContext,
                     msaaResolveRes._postMsaaResolveTexture.get(),
@@ -1025,6 +1049,14 @@ namespace SceneEngine
         return PrepareRTShadows(context, metalContext, parserContext, preparedScene, frustum, shadowFrustumIndex);
     }
 
+        //  Shadow projections calculated by LightingParser_PrepareScene (so we don't
+        //  need to calculate them again in LightingParser_PrepareShadows)
+    class PreparedShadowProjections
+    {
+    public:
+        std::vector<ShadowProjectionDesc> _projections;
+    };
+
     void LightingParser_PrepareShadows(
         IThreadContext& context, Metal::DeviceContext& metalContext, 
         LightingParserContext& parserContext, PreparedScene& preparedScene)
@@ -1039,11 +1071,16 @@ namespace SceneEngine
         Metal::GPUProfiler::DebugAnnotation anno(metalContext, L"Prepare-Shadows");
 
             // todo --  we should be using a temporary frame heap for this vector
-        auto shadowFrustumCount = scene->GetShadowProjectionCount();
+        auto* preparedProjections = preparedScene.Get<PreparedShadowProjections>();
+        auto shadowFrustumCount = preparedProjections 
+            ? (unsigned)preparedProjections->_projections.size() 
+            : scene->GetShadowProjectionCount();
         parserContext._preparedDMShadows.reserve(shadowFrustumCount);
 
         for (unsigned c=0; c<shadowFrustumCount; ++c) {
-            auto frustum = scene->GetShadowProjectionDesc(c, parserContext.GetProjectionDesc());
+            auto frustum = preparedProjections 
+                ? preparedProjections->_projections[c]
+                : scene->GetShadowProjectionDesc(c, parserContext.GetProjectionDesc());
             CATCH_ASSETS_BEGIN
                 if (frustum._resolveType == ShadowProjectionDesc::ResolveType::DepthTexture) {
 
@@ -1062,6 +1099,99 @@ namespace SceneEngine
         }
     }
 
+    auto PrepareSceneViews(
+        const ISceneParser& scene, 
+        IteratorRange<const ScenePrepareView*> views,
+        PreparedScene& preparedPackets,
+        CompletionThreadPool& threadPool) -> std::vector<std::exception_ptr>
+    {
+        class SharedState
+        {
+        public:
+            Interlocked::Value              _pendingViews;
+            XlHandle                        _allViewsPrepared;
+            Threading::Mutex                _exceptionsLock;
+            std::vector<std::exception_ptr> _assetExceptions;
+            std::exception_ptr              _otherException;
+
+            SharedState() : _allViewsPrepared(XlCreateEvent(true)) {}
+            ~SharedState() { XlCloseSyncObject(_allViewsPrepared); }
+        };
+        SharedState state;
+        state._pendingViews = (Interlocked::Value)views.size();
+
+        auto prepareView = [&scene, &preparedPackets, &state](const ScenePrepareView& view)
+            {
+                TRY {
+                    scene.PrepareView(view._parseSettings, view._worldToProjection, preparedPackets);
+                } CATCH (const ::Assets::Exceptions::AssetException&) {
+                    ScopedLock(state._exceptionsLock);
+                    state._assetExceptions.push_back(std::current_exception());
+                } CATCH (...) {
+                    ScopedLock(state._exceptionsLock);
+                    if (!state._otherException)
+                        state._otherException = std::current_exception();
+                } CATCH_END
+                if (Interlocked::Decrement(&state._pendingViews) == 1)
+                    XlSetEvent(state._allViewsPrepared);
+            };
+
+            //  Queue all but the first view on the thread pool. This thread
+            //  prepares the first view while the others are running
+        for (size_t c=1; c<views.size(); ++c) {
+            const auto* view = &views[c];
+            threadPool.Enqueue([prepareView, view]() { prepareView(*view); });
+        }
+        if (!views.empty())
+            prepareView(views[0]);
+
+            //  Sleep until the last view is finished, rather than spinning on
+            //  a core the pool threads could be using
+        if (Interlocked::Load(&state._pendingViews) != 0)
+            XlWaitForSyncObject(state._allViewsPrepared, XL_INFINITE);
+
+        if (state._otherException)
+            std::rethrow_exception(state._otherException);
+        return std::move(state._assetExceptions);
+    }
+
+    void LightingParser_PrepareScene(
+        RenderCore::IThreadContext& context, 
+        LightingParserContext& parserContext,
+        ISceneParser& scene,
+        PreparedScene& preparedScene)
+    {
+            //  Anything that needs the device context happens in PrepareScene (on this thread)
+        scene.PrepareScene(context, parserContext, preparedScene);
+
+            //  Then prepare the main view and each shadow projection in parallel. We calculate
+            //  the shadow projections here, and keep them for LightingParser_PrepareShadows
+        const auto& mainProjection = parserContext.GetProjectionDesc();
+        auto shadowProjectionCount = scene.GetShadowProjectionCount();
+        auto* shadowProjections = preparedScene.Allocate<PreparedShadowProjections>(0);
+        shadowProjections->_projections.reserve(shadowProjectionCount);
+
+        std::vector<ScenePrepareView> views;
+        views.reserve(1 + shadowProjectionCount);
+        views.push_back(ScenePrepareView(SPS(SPS::BatchFilter::General), mainProjection._worldToProjection));
+        for (unsigned c=0; c<shadowProjectionCount; ++c) {
+            shadowProjections->_projections.push_back(scene.GetShadowProjectionDesc(c, mainProjection));
+            const auto& frustum = shadowProjections->_projections[c];
+            auto batchFilter = (frustum._resolveType == ShadowProjectionDesc::ResolveType::RayTraced)
+                ? SPS::BatchFilter::RayTracedShadows : SPS::BatchFilter::DMShadows;
+            views.push_back(ScenePrepareView(SPS(batchFilter, ~SPS::Toggles::BitField(0), c), frustum._worldToClip));
+        }
+
+        auto assetExceptions = PrepareSceneViews(
+            scene, MakeIteratorRange(views), preparedScene, 
+            ConsoleRig::GlobalServices::GetShortTaskThreadPool());
+        for (const auto& e:assetExceptions) {
+            CATCH_ASSETS_BEGIN
+                std::rethrow_exception(e);
+            CATCH_ASSETS_END(parserContext)
+        }
+    }
+
     void LightingParser_InitBasicLightEnv(  
         Metal::DeviceContext& context,
         LightingParserContext& parserContext,
@@ -1107,7 +1237,7 @@ namespace SceneEngine
         LightingParser_SetGlobalTransform(
             *metalContext.get(), parserContext, 
             BuildProjectionDesc(camera, qualitySettings._dimensions));
-        scene.PrepareScene(context, parserContext, marker.GetPreparedScene());
+        LightingParser_PrepareScene(context, parserContext, scene, marker.GetPreparedScene());
 
         // Throw in a "frame priority barrier" here, right after the prepare scene. This will
         // force all uploads started during PrepareScene to be completed when we next call
@@ -1188,6 +1318,11 @@ namespace SceneEngine
     {}
 
 
+    void ISceneParser::PrepareView(
+        const SceneParseSettings& parseSettings,
+        const Float4x4& worldToProjection,
+        PreparedScene& preparedPackets) const {}
+
     ISceneParser::~ISceneParser() {}
 
 }
@@ -106,6 +106,18 @@ namespace SceneEngine
         const RenderingQualitySettings& qualitySettings,
         PreparedScene& preparedScene);
 
+    /// <summary>Prepare the scene currently set to the parser context</summary>
+    /// Calls ISceneParser::PrepareScene() on this thread, and then prepares the main
+    /// view and every shadow projection as parallel tasks (see ISceneParser::PrepareView()).
+    /// Call this before the version of LightingParser_ExecuteScene that takes a 
+    /// PreparedScene. The other version of LightingParser_ExecuteScene calls it 
+    /// automatically.
+    void LightingParser_PrepareScene(
+        RenderCore::IThreadContext& context, 
+        LightingParserContext& parserContext,
+        ISceneParser& sceneParser,
+        PreparedScene& preparedScene);
+
     /// <summary>Initialise basic states for scene rendering</summary>
     /// Some render operations don't want to use the full lighting parser structure.
     /// In these cases, you can use LightingParser_SetupScene() to initialise the
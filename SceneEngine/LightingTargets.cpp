@@ -7,6 +7,7 @@
 #include "LightingTargets.h"
 #include "SceneEngineUtils.h"
 #include "LightingParserContext.h"
+#include "TransientTargetPool.h"
 
 #include "../BufferUploads/ResourceLocator.h"
 #include "../RenderCore/Techniques/Techniques.h"
@@ -40,30 +41,26 @@ namespace SceneEngine
         _sampling = sampling;
     }
 
-    MainTargetsBox::MainTargetsBox(const Desc& desc) 
+    MainTargetsBox::MainTargetsBox(const Desc& desc, TransientTargetPool& pool, unsigned firstPass, unsigned lastPass)
     : _desc(desc)
     {
         using namespace RenderCore;
         using namespace RenderCore::Metal;
         using namespace BufferUploads;
 
-        ResourcePtr gbufferTextures[s_gbufferTextureCount];
-        RenderTargetView gbufferRTV[dimof(gbufferTextures)];
-        ShaderResourceView gbufferSRV[dimof(gbufferTextures)];
-        std::fill(gbufferTextures, &gbufferTextures[dimof(gbufferTextures)], nullptr);
-
         auto bufferUploadsDesc = BufferUploads::CreateDesc(
             BindFlag::ShaderResource|BindFlag::RenderTarget,
             0, GPUAccess::Write | GPUAccess::Read,
             BufferUploads::TextureDesc::Plain2D(
                 desc._width, desc._height, AsDXGIFormat(NativeFormat::Unknown), 1, 0, desc._sampling),
             "GBuffer");
-        for (unsigned c=0; c<dimof(gbufferTextures); ++c) {
+        for (unsigned c=0; c<dimof(_gbufferTextures); ++c) {
             if (desc._gbufferFormats[c]._resourceFormat != NativeFormat::Unknown) {
                 bufferUploadsDesc._textureDesc._nativePixelFormat = AsDXGIFormat(desc._gbufferFormats[c]._resourceFormat);
-                gbufferTextures[c] = CreateResourceImmediate(bufferUploadsDesc);
-                gbufferRTV[c] = RenderTargetView(gbufferTextures[c].get(), desc._gbufferFormats[c]._writeFormat);
-                gbufferSRV[c] = ShaderResourceView(gbufferTextures[c].get(), desc._gbufferFormats[c]._shaderReadFormat);
+                auto target = pool.Acquire(bufferUploadsDesc, firstPass, lastPass);
+                _gbufferTextures[c] = pool.GetResource(target);
+                _gbufferRTVs[c] = pool.GetRTV(target, desc._gbufferFormats[c]._writeFormat);
+                _gbufferRTVsSRV[c] = pool.GetSRV(target, desc._gbufferFormats[c]._shaderReadFormat);
             }
         }
 
@@ -75,26 +72,17 @@ namespace SceneEngine
             BufferUploads::TextureDesc::Plain2D(
                 desc._width, desc._height, AsDXGIFormat(desc._depthFormat._resourceFormat), 1, 0, desc._sampling),
             "MainDepth");
-        auto msaaDepthBufferTexture = CreateResourceImmediate(depthBufferDesc);
-        auto secondaryDepthBufferTexture = CreateResourceImmediate(depthBufferDesc);
-        DepthStencilView msaaDepthBuffer(msaaDepthBufferTexture.get(), desc._depthFormat._writeFormat);
-        DepthStencilView secondaryDepthBuffer(secondaryDepthBufferTexture.get(), desc._depthFormat._writeFormat);
-        ShaderResourceView msaaDepthBufferSRV(msaaDepthBufferTexture.get(), desc._depthFormat._shaderReadFormat);
-        ShaderResourceView secondaryDepthBufferSRV(secondaryDepthBufferTexture.get(), desc._depthFormat._shaderReadFormat);
+        auto msaaDepthBuffer = pool.Acquire(depthBufferDesc, firstPass, lastPass);
+        auto secondaryDepthBuffer = pool.Acquire(depthBufferDesc, firstPass, lastPass);
 
             /////////
 
-        for (unsigned c=0; c<dimof(_gbufferTextures); ++c) {
-            _gbufferTextures[c] = std::move(gbufferTextures[c]);
-            _gbufferRTVs[c] = std::move(gbufferRTV[c]);
-            _gbufferRTVsSRV[c] = std::move(gbufferSRV[c]);
-        }
-        _msaaDepthBufferTexture = std::move(msaaDepthBufferTexture);
-        _secondaryDepthBufferTexture = std::move(secondaryDepthBufferTexture);
-        _msaaDepthBuffer = std::move(msaaDepthBuffer);
-        _secondaryDepthBuffer = std::move(secondaryDepthBuffer);
-        _msaaDepthBufferSRV = std::move(msaaDepthBufferSRV);
-        _secondaryDepthBufferSRV = std::move(secondaryDepthBufferSRV);
+        _msaaDepthBufferTexture = pool.GetResource(msaaDepthBuffer);
+        _secondaryDepthBufferTexture = pool.GetResource(secondaryDepthBuffer);
+        _msaaDepthBuffer = pool.GetDSV(msaaDepthBuffer, desc._depthFormat._writeFormat);
+        _secondaryDepthBuffer = pool.GetDSV(secondaryDepthBuffer, desc._depthFormat._writeFormat);
+        _msaaDepthBufferSRV = pool.GetSRV(msaaDepthBuffer, desc._depthFormat._shaderReadFormat);
+        _secondaryDepthBufferSRV = pool.GetSRV(secondaryDepthBuffer, desc._depthFormat._shaderReadFormat);
     }
 
     MainTargetsBox::~MainTargetsBox() {}
@@ -114,7 +102,7 @@ namespace SceneEngine
         _sampling = sampling;
     }
 
-    ForwardTargetsBox::ForwardTargetsBox(const Desc& desc) 
+    ForwardTargetsBox::ForwardTargetsBox(const Desc& desc, TransientTargetPool& pool, unsigned firstPass, unsigned lastPass)
     : _desc(desc)
     {
         using namespace RenderCore;
@@ -126,27 +114,19 @@ namespace SceneEngine
                 desc._width, desc._height, AsDXGIFormat(desc._depthFormat._resourceFormat), 1, 0, desc._sampling),
             "ForwardTarget");
 
-        auto msaaDepthBufferTexture = CreateResourceImmediate(bufferUploadsDesc);
-        auto secondaryDepthBufferTexture = CreateResourceImmediate(bufferUploadsDesc);
+        auto msaaDepthBuffer = pool.Acquire(bufferUploadsDesc, firstPass, lastPass);
+        auto secondaryDepthBuffer = pool.Acquire(bufferUploadsDesc, firstPass, lastPass);
 
             /////////
 
-        DepthStencilView msaaDepthBuffer(msaaDepthBufferTexture.get(), desc._depthFormat._writeFormat);
-        DepthStencilView secondaryDepthBuffer(secondaryDepthBufferTexture.get(), desc._depthFormat._writeFormat);
+        _msaaDepthBufferTexture = pool.GetResource(msaaDepthBuffer);
+        _secondaryDepthBufferTexture = pool.GetResource(secondaryDepthBuffer);
 
-        ShaderResourceView msaaDepthBufferSRV(msaaDepthBufferTexture.get(), desc._depthFormat._shaderReadFormat);
-        ShaderResourceView secondaryDepthBufferSRV(secondaryDepthBufferTexture.get(), desc._depthFormat._shaderReadFormat);
+        _msaaDepthBuffer = pool.GetDSV(msaaDepthBuffer, desc._depthFormat._writeFormat);
+        _secondaryDepthBuffer = pool.GetDSV(secondaryDepthBuffer, desc._depthFormat._writeFormat);
 
-            /////////
-
-        _msaaDepthBufferTexture = std::move(msaaDepthBufferTexture);
-        _secondaryDepthBufferTexture = std::move(secondaryDepthBufferTexture);
-
-        _msaaDepthBuffer = std::move(msaaDepthBuffer);
-        _secondaryDepthBuffer = std::move(secondaryDepthBuffer);
-
-        _msaaDepthBufferSRV = std::move(msaaDepthBufferSRV);
-        _secondaryDepthBufferSRV = std::move(secondaryDepthBufferSRV);
+        _msaaDepthBufferSRV = pool.GetSRV(msaaDepthBuffer, desc._depthFormat._shaderReadFormat);
+        _secondaryDepthBufferSRV = pool.GetSRV(secondaryDepthBuffer, desc._depthFormat._shaderReadFormat);
     }
 
     ForwardTargetsBox::~ForwardTargetsBox() {}
@@ -166,7 +146,7 @@ namespace SceneEngine
         _sampling = sampling;
     }
     
-    LightingResolveTextureBox::LightingResolveTextureBox(const Desc& desc)
+    LightingResolveTextureBox::LightingResolveTextureBox(const Desc& desc, TransientTargetPool& pool, unsigned firstPass, unsigned lastPass)
     {
         using namespace RenderCore;
         using namespace RenderCore::Metal;
@@ -178,20 +158,15 @@ namespace SceneEngine
                 desc._sampling),
             "LightResolve");
 
-        auto lightingResolveTexture = CreateResourceImmediate(bufferUploadsDesc);
-        auto lightingResolveCopy = CreateResourceImmediate(bufferUploadsDesc);
-        bufferUploadsDesc._textureDesc._samples = TextureSamples::Create();
-
-        RenderTargetView lightingResolveTarget(lightingResolveTexture.get(), desc._lightingResolveFormat._writeFormat);
-        ShaderResourceView lightingResolveSRV(lightingResolveTexture.get(), desc._lightingResolveFormat._shaderReadFormat);
-        ShaderResourceView lightingResolveCopySRV(lightingResolveCopy.get(), desc._lightingResolveFormat._shaderReadFormat);
+        auto lightingResolveTexture = pool.Acquire(bufferUploadsDesc, firstPass, lastPass);
+        auto lightingResolveCopy = pool.Acquire(bufferUploadsDesc, firstPass, lastPass);
 
-        _lightingResolveTexture = std::move(lightingResolveTexture);
-        _lightingResolveRTV = std::move(lightingResolveTarget);
-        _lightingResolveSRV = std::move(lightingResolveSRV);
+        _lightingResolveTexture = pool.GetResource(lightingResolveTexture);
+        _lightingResolveRTV = pool.GetRTV(lightingResolveTexture, desc._lightingResolveFormat._writeFormat);
+        _lightingResolveSRV = pool.GetSRV(lightingResolveTexture, desc._lightingResolveFormat._shaderReadFormat);
 
-        _lightingResolveCopy = std::move(lightingResolveCopy);
-        _lightingResolveCopySRV = std::move(lightingResolveCopySRV);
+        _lightingResolveCopy = pool.GetResource(lightingResolveCopy);
+        _lightingResolveCopySRV = pool.GetSRV(lightingResolveCopy, desc._lightingResolveFormat._shaderReadFormat);
     }
 
     LightingResolveTextureBox::~LightingResolveTextureBox()
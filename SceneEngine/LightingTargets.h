@@ -17,6 +17,12 @@
 
 namespace SceneEngine
 {
+    class TransientTargetPool;
+
+        //  The target boxes below are built every frame, with textures from a 
+        //  TransientTargetPool. The pass range is the range of passes in 
+        //  which the targets will be used (see TransientTargetPool::Acquire)
+
     class MainTargetsBox
     {
     public:
@@ -36,7 +42,7 @@ namespace SceneEngine
             BufferUploads::TextureSamples _sampling;
         };
 
-        MainTargetsBox(const Desc& desc);
+        MainTargetsBox(const Desc& desc, TransientTargetPool& pool, unsigned firstPass, unsigned lastPass);
         ~MainTargetsBox();
 
         Desc _desc;
@@ -73,7 +79,7 @@ namespace SceneEngine
             BufferUploads::TextureSamples _sampling;
         };
 
-        ForwardTargetsBox(const Desc& desc);
+        ForwardTargetsBox(const Desc& desc, TransientTargetPool& pool, unsigned firstPass, unsigned lastPass);
         ~ForwardTargetsBox();
 
         Desc _desc;
@@ -115,7 +121,7 @@ namespace SceneEngine
         ResourcePtr     _lightingResolveCopy;
         SRV             _lightingResolveCopySRV;
 
-        LightingResolveTextureBox(const Desc& desc);
+        LightingResolveTextureBox(const Desc& desc, TransientTargetPool& pool, unsigned firstPass, unsigned lastPass);
         ~LightingResolveTextureBox();
     };
 
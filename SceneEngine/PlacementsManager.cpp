@@ -39,6 +39,7 @@
 #include "../Utility/StringFormat.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/PathUtils.h"
+#include "../Utility/Threading/Mutex.h"
 #include "../Utility/Streams/StreamFormatter.h"
 #include "../Utility/Streams/StreamDOM.h"
 #include "../Utility/Conversion.h"
@@ -430,6 +431,24 @@ namespace SceneEngine
             const PlacementsQuadTree* quadTree,
             const Float3x4& cellToWorld);
 
+        static void CullCell(
+            std::vector<unsigned>& visiblePlacements,
+            const Float4x4& worldToProjection,
+            const Placements& placements,
+            const PlacementsQuadTree* quadTree,
+            const Float3x4& cellToWorld,
+            PlacementsQuadTree::Metrics* metrics = nullptr);
+
+        auto GetCellPlacements(const PlacementCell& cell, bool allowReload)
+            -> std::pair<Placements*, const PlacementsQuadTree*>;
+
+        void CullToPreparedScene(
+            PreparedScene& preparedScene,
+            const Float4x4& worldToProjection,
+            unsigned viewIndex,
+            const PlacementCellSet& cellSet,
+            RenderCore::Techniques::ParsingContext* parserContext);
+
         void Render(
             RenderCore::Metal::DeviceContext* context,
             RenderCore::Techniques::ParsingContext& parserContext,
@@ -474,6 +493,7 @@ namespace SceneEngine
         };
 
         std::vector<std::pair<uint64, CellRenderInfo>> _cells;
+        mutable Threading::Mutex _cellsLock;    // (cells can be culled from multiple threads while preparing the scene)
         std::shared_ptr<PlacementsCache> _placementsCache;
         std::shared_ptr<ModelCache> _cache;
         DelayedDrawCallSet _preparedRenders;
@@ -562,6 +582,7 @@ namespace SceneEngine
 
     auto PlacementsRenderer::Pimpl::GetCachedQuadTree(uint64 cellFilenameHash) const -> const PlacementsQuadTree*
     {
+        ScopedLock(_cellsLock);
         auto i2 = LowerBound(_cells, cellFilenameHash);
         if (i2!=_cells.end() && i2->first == cellFilenameHash) {
             return i2->second._quadTree.get();
@@ -569,10 +590,8 @@ namespace SceneEngine
         return nullptr;
     }
 
-    Placements* PlacementsRenderer::Pimpl::CullCell(
-        std::vector<unsigned>& visibleObjects,
-        RenderCore::Techniques::ParsingContext& parserContext,
-        const PlacementCell& cell)
+    auto PlacementsRenderer::Pimpl::GetCellPlacements(const PlacementCell& cell, bool allowReload)
+        -> std::pair<Placements*, const PlacementsQuadTree*>
     {
         // Look for a "RenderInfo" for this cell.. and create it if it doesn't exist
         // Note that there's a bit of extra overhead here:
@@ -589,8 +608,12 @@ namespace SceneEngine
         //
         // It seems useful to me. But if the overhead becomes too great, we can just change
         // to a basic 2d addressing model.
-        if (cell._filename[0] == '[') return nullptr;   // hack -- if the cell filename begins with '[', it is a cell from the editor (and should be using _cellOverrides)
+        if (cell._filename[0] == '[')   // hack -- if the cell filename begins with '[', it is a cell from the editor (and should be using _cellOverrides)
+            return std::make_pair(nullptr, nullptr);
 
+            // The placements and quad tree objects don't move when "_cells" changes, so we
+            // only need to hold the lock while we find them.
+        ScopedLock(_cellsLock);
         auto i2 = LowerBound(_cells, cell._filenameHash);
         if (i2 == _cells.end() || i2->first != cell._filenameHash) {
             CellRenderInfo newRenderInfo;
@@ -599,7 +622,8 @@ namespace SceneEngine
         }
 
             // check if we need to reload placements
-        if (i2->second._placements->_placements->GetDependencyValidation()->GetValidationIndex() != 0) {
+            // (we can't do this while other threads might be culling the old placements)
+        if (allowReload && i2->second._placements->_placements->GetDependencyValidation()->GetValidationIndex() != 0) {
             i2->second._placements->Reload();
             i2->second._quadTree.reset();
         }
@@ -611,13 +635,23 @@ namespace SceneEngine
                 i2->second._placements->_placements->GetObjectReferenceCount());
         }
 
+        return std::make_pair(i2->second._placements->_placements.get(), i2->second._quadTree.get());
+    }
+
+    Placements* PlacementsRenderer::Pimpl::CullCell(
+        std::vector<unsigned>& visibleObjects,
+        RenderCore::Techniques::ParsingContext& parserContext,
+        const PlacementCell& cell)
+    {
+        auto placements = GetCellPlacements(cell, true);
+        if (!placements.first) return nullptr;
+
         CullCell(
             visibleObjects, parserContext, 
-            *i2->second._placements->_placements, 
-            i2->second._quadTree.get(),
+            *placements.first, placements.second,
             cell._cellToWorld);
 
-        return i2->second._placements->_placements.get();
+        return placements.first;
     }
 
     static SupplementRange AsSupplements(const uint64* supplementsBuffer, unsigned supplementsOffset)
@@ -649,12 +683,14 @@ namespace SceneEngine
                 unsigned _instancesPrepared;
                 unsigned _uniqueModelsPrepared;
                 unsigned _impostersQueued;
+                unsigned _instancesPending;
 
                 Metrics()
                 {
                     _instancesPrepared = 0;
                     _uniqueModelsPrepared = 0;
                     _impostersQueued = 0;
+                    _instancesPending = 0;
                 }
             };
 
@@ -672,6 +708,7 @@ namespace SceneEngine
 
                 _imposters = imposters;
                 _currentModelRendered = false;
+                _currentPending = false;
             }
         protected:
             uint64 _currentModel, _currentMaterial;
@@ -679,6 +716,7 @@ namespace SceneEngine
             ModelCache::Model _current;
             float _maxDistanceSq;
             bool _currentModelRendered;
+            bool _currentPending;
             DynamicImposters* _imposters;
         };
 
@@ -730,16 +768,27 @@ namespace SceneEngine
                 ||  obj._supplementsOffset != _currentSupplements
                 ||  std::min(_current._maxLOD, LOD) != _current._selectedLOD) {
 
-                _current = cache.GetModel(
+                    //  Models that are still loading are skipped (without throwing).
+                    //  Throwing here would abandon the rest of the cell; and while a 
+                    //  large level is streaming in, there can be very many pending models.
+                auto state = cache.TryGetModel(
+                    _current,
                     (const ResChar*)PtrAdd(filenamesBuffer, obj._modelFilenameOffset + sizeof(uint64)),
                     (const ResChar*)PtrAdd(filenamesBuffer, obj._materialFilenameOffset + sizeof(uint64)),
                     AsSupplements(supplementsBuffer, obj._supplementsOffset),
                     LOD);
+                _currentPending = state != ::Assets::AssetState::Ready;
+                if (_currentPending) _current = ModelCache::Model();
                 _currentModel = modelHash;
                 _currentMaterial = materialHash;
                 _currentSupplements = obj._supplementsOffset;
                 _currentModelRendered = false;
             }
+
+            if (_currentPending) {
+                ++_metrics._instancesPending;
+                return;
+            }
                 
             auto localToWorld = Combine(obj._localToCell, cellToWorld);
 
@@ -776,28 +825,42 @@ namespace SceneEngine
         const Placements& placements,
         const PlacementsQuadTree* quadTree,
         const Float3x4& cellToWorld)
+    {
+        PlacementsQuadTree::Metrics metrics;
+        CullCell(
+            visiblePlacements, parserContext.GetProjectionDesc()._worldToProjection,
+            placements, quadTree, cellToWorld, &metrics);
+
+        if (quadTree)
+            QuickMetrics(parserContext) << "Cull placements cell... AABB test: (" << metrics._nodeAabbTestCount << ") nodes + (" << metrics._payloadAabbTestCount << ") payloads\n";
+    }
+
+    void PlacementsRenderer::Pimpl::CullCell(
+        std::vector<unsigned>& visiblePlacements,
+        const Float4x4& worldToProjection,
+        const Placements& placements,
+        const PlacementsQuadTree* quadTree,
+        const Float3x4& cellToWorld,
+        PlacementsQuadTree::Metrics* metrics)
     {
         auto placementCount = placements.GetObjectReferenceCount();
         if (!placementCount)
             return;
         
-        __declspec(align(16)) auto cellToCullSpace = Combine(cellToWorld, parserContext.GetProjectionDesc()._worldToProjection);
+        __declspec(align(16)) auto cellToCullSpace = Combine(cellToWorld, worldToProjection);
 
         const auto* objRef = placements.GetObjectReferences();
         
         if (quadTree) {
             auto cullResults = quadTree->GetMaxResults();
             visiblePlacements.resize(cullResults);
-            PlacementsQuadTree::Metrics metrics;
             quadTree->CalculateVisibleObjects(
                 cellToCullSpace, &objRef->_cellSpaceBoundary,
                 sizeof(Placements::ObjectReference),
                 AsPointer(visiblePlacements.begin()), cullResults, cullResults,
-                &metrics);
+                metrics);
             visiblePlacements.resize(cullResults);
 
-            QuickMetrics(parserContext) << "Cull placements cell... AABB test: (" << metrics._nodeAabbTestCount << ") nodes + (" << metrics._payloadAabbTestCount << ") payloads\n";
-
                 // we have to sort to return to our expected order
             std::sort(visiblePlacements.begin(), visiblePlacements.end());
         } else {
@@ -899,7 +962,7 @@ namespace SceneEngine
             }
         } /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        QuickMetrics(parserContext) << "Placements cell: (" << helper._metrics._instancesPrepared << ") instances from (" << helper._metrics._uniqueModelsPrepared << ") models. Imposters: (" << helper._metrics._impostersQueued << ")\n";
+        QuickMetrics(parserContext) << "Placements cell: (" << helper._metrics._instancesPrepared << ") instances from (" << helper._metrics._uniqueModelsPrepared << ") models. Imposters: (" << helper._metrics._impostersQueued << "). Pending: (" << helper._metrics._instancesPending << ")\n";
     }
 
     PlacementsRenderer::Pimpl::Pimpl(
@@ -943,6 +1006,11 @@ namespace SceneEngine
         std::vector<std::unique_ptr<Cell>> _cells;
     };
 
+    static PreparedScene::Id PreCulledPlacementsId(const PlacementCellSet& cellSet, unsigned viewIndex)
+    {
+        return viewIndex ? HashCombine(viewIndex, (PreparedScene::Id)&cellSet) : (PreparedScene::Id)&cellSet;
+    }
+
     void PlacementsRenderer::Render(
         RenderCore::Metal::DeviceContext* context, 
         RenderCore::Techniques::ParsingContext& parserContext,
@@ -1002,7 +1070,8 @@ namespace SceneEngine
         RenderCore::Techniques::ParsingContext& parserContext,
         PreparedScene& preparedScene,
         unsigned techniqueIndex,
-        const PlacementCellSet& cellSet)
+        const PlacementCellSet& cellSet,
+        unsigned viewIndex)
     {
         if (!Tweakable("DoPlacements", true)) {
             _pimpl->ClearPrepared();
@@ -1011,7 +1080,7 @@ namespace SceneEngine
 
         _pimpl->BeginPrepare();
 
-        auto* prepared = preparedScene.Get<PreCulledPlacements>((PreparedScene::Id)&cellSet);
+        auto* prepared = preparedScene.Get<PreCulledPlacements>(PreCulledPlacementsId(cellSet, viewIndex));
         if (!prepared) return;
 
         for (auto&i:prepared->_cells)
@@ -1047,10 +1116,33 @@ namespace SceneEngine
         RenderCore::Techniques::ParsingContext& parserContext,
         const PlacementCellSet& cellSet)
     {
-        auto* prepared = preparedScene.Allocate<PreCulledPlacements>((PreparedScene::Id)&cellSet);
+        _pimpl->CullToPreparedScene(
+            preparedScene, parserContext.GetProjectionDesc()._worldToProjection, 
+            0, cellSet, &parserContext);
+    }
+
+    void PlacementsRenderer::CullToPreparedScene(
+        PreparedScene& preparedScene,
+        const Float4x4& worldToProjection,
+        unsigned viewIndex,
+        const PlacementCellSet& cellSet)
+    {
+        _pimpl->CullToPreparedScene(preparedScene, worldToProjection, viewIndex, cellSet, nullptr);
+    }
+
+    void PlacementsRenderer::Pimpl::CullToPreparedScene(
+        PreparedScene& preparedScene,
+        const Float4x4& worldToProj,
+        unsigned viewIndex,
+        const PlacementCellSet& cellSet,
+        RenderCore::Techniques::ParsingContext* parserContext)
+    {
+            //  When there's no parsing context, we might be running in parallel with
+            //  other threads culling other views (so we can't reload placements or write 
+            //  to the parsing context)
+        auto* prepared = preparedScene.Allocate<PreCulledPlacements>(PreCulledPlacementsId(cellSet, viewIndex));
 
         auto& cells = cellSet._pimpl->_cells;
-        const auto& worldToProj = parserContext.GetProjectionDesc()._worldToProjection;
         for (unsigned c=0; c<(unsigned)cells.size(); ++c) {
             auto& cell = cells[c];
             if (CullAABB_Aligned(worldToProj, cell._aabbMin, cell._aabbMax))
@@ -1062,11 +1154,16 @@ namespace SceneEngine
 
             auto ovr = LowerBound(cellSet._pimpl->_cellOverrides, cell._filenameHash);
             if (ovr != cellSet._pimpl->_cellOverrides.end() && ovr->first == cell._filenameHash) {
-                _pimpl->CullCell(pcell->_objects, parserContext, *ovr->second.get(), nullptr, cell._cellToWorld);
                 pcell->_placements = ovr->second.get();
-            } else {
-                pcell->_placements = _pimpl->CullCell(pcell->_objects, parserContext, cell);
+                CullCell(pcell->_objects, worldToProj, *pcell->_placements, nullptr, cell._cellToWorld);
+            } else if (parserContext) {
+                pcell->_placements = CullCell(pcell->_objects, *parserContext, cell);
                 if (!pcell->_placements) continue;
+            } else {
+                auto placements = GetCellPlacements(cell, false);
+                if (!placements.first) continue;
+                pcell->_placements = placements.first;
+                CullCell(pcell->_objects, worldToProj, *placements.first, placements.second, cell._cellToWorld);
             }
 
             #if 0
@@ -1083,7 +1180,7 @@ namespace SceneEngine
                     auto LOD = 0u;   // todo -- clamp the LOD against max somehow
                     if (    obj._modelFilenameOffset != currentModel || obj._materialFilenameOffset != currentMaterial 
                         ||  obj._supplementsOffset != currentSupplements || LOD != currentLOD) {
-                        _pimpl->_cache->PrepareModel(
+                        _cache->PrepareModel(
                             (const ResChar*)PtrAdd(filenamesBuffer, obj._modelFilenameOffset + sizeof(uint64)),
                             (const ResChar*)PtrAdd(filenamesBuffer, obj._materialFilenameOffset + sizeof(uint64)),
                             AsSupplements(supplementsBuffer, obj._supplementsOffset),
@@ -1206,6 +1303,16 @@ namespace SceneEngine
         return std::move(result);
     }
 
+    auto PlacementsRenderer::GetCellBoundingBoxes(const PlacementCellSet& cellSet) const
+            -> std::vector<std::pair<Float3, Float3>>
+    {
+        std::vector<std::pair<Float3, Float3>> result;
+        result.reserve(cellSet._pimpl->_cells.size());
+        for (auto i=cellSet._pimpl->_cells.begin(); i!=cellSet._pimpl->_cells.end(); ++i)
+            result.push_back(std::make_pair(i->_aabbMin, i->_aabbMax));
+        return std::move(result);
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     const std::shared_ptr<PlacementsRenderer>& PlacementsManager::GetRenderer()
@@ -97,7 +97,8 @@ namespace SceneEngine
             RenderCore::Techniques::ParsingContext& parserContext,
             PreparedScene& preparedScene,
             unsigned techniqueIndex,
-            const PlacementCellSet& cellSet);
+            const PlacementCellSet& cellSet,
+            unsigned viewIndex = 0);
         void CommitTransparent(
             RenderCore::Metal::DeviceContext* context,
             RenderCore::Techniques::ParsingContext& parserContext,
@@ -110,6 +111,17 @@ namespace SceneEngine
             RenderCore::Techniques::ParsingContext& parserContext,
             const PlacementCellSet& cellSet);
 
+            /// <summary>Cull for a specific view, without a parsing context</summary>
+            /// Unlike the version above, this can be called from multiple threads at the
+            /// same time (eg, for the main view and each shadow projection). Use a different
+            /// viewIndex for each view; viewIndex 0 is the main view. Cells that are not
+            /// loaded (or are invalidated) will not be reloaded here.
+        void CullToPreparedScene(
+            PreparedScene& preparedScene,
+            const Float4x4& worldToProjection,
+            unsigned viewIndex,
+            const PlacementCellSet& cellSet);
+
             // -------------- Render filtered --------------
         using DrawCallPredicate = std::function<bool(const RenderCore::Assets::DelayedDrawCall&)>;
         void RenderFiltered(
@@ -128,6 +140,9 @@ namespace SceneEngine
         auto GetObjectBoundingBoxes(const PlacementCellSet& cellSet, const Float4x4& worldToClip) const
             -> std::vector<std::pair<Float3x4, ObjectBoundingBoxes>>;
 
+        auto GetCellBoundingBoxes(const PlacementCellSet& cellSet) const
+            -> std::vector<std::pair<Float3, Float3>>;
+
         void SetImposters(std::shared_ptr<DynamicImposters> imposters);
 
         PlacementsRenderer(
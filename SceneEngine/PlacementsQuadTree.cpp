@@ -9,6 +9,7 @@
 #include "../Utility/PtrUtils.h"
 #include "../Core/Prefix.h"
 #include <stack>
+#include <vector>
 
 #include "PlacementsQuadTreeDebugger.h"
 #include "PlacementsManager.h"
@@ -380,9 +381,9 @@ namespace SceneEngine
 
             //  Traverse through the quad tree, and find do bounding box level 
             //  culling on each object
-        static std::stack<unsigned> workingStack;
-        static std::stack<unsigned> entirelyVisibleStack;
-        assert(workingStack.empty() && entirelyVisibleStack.empty());
+            //  (these are locals, because we can cull from multiple threads at the same time)
+        std::stack<unsigned, std::vector<unsigned>> workingStack;
+        std::stack<unsigned, std::vector<unsigned>> entirelyVisibleStack;
         workingStack.push(0);
         while (!workingStack.empty()) {
             auto nodeIndex = workingStack.top();
@@ -4,27 +4,136 @@
 // accompanying file "LICENSE" or the website
 // http://www.opensource.org/licenses/mit-license.php)
 
-#pragma once
-
 #include "PreparedScene.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include <vector>
+#include <algorithm>
+#include <assert.h>
 
 namespace SceneEngine
 {
-    PreparedScene::PreparedScene() {}
-    PreparedScene::~PreparedScene() 
+    static const unsigned ArenaCount = 16;
+    static const unsigned IndexShardCount = 16;
+    static const size_t ArenaPageSize = 64 * 1024;
+    static const size_t AllocationAlignment = 16;
+
+    class PreparedScene::Pimpl
+    {
+    public:
+            //  A simple arena that only grows. Everything is released at the same time,
+            //  when the prepared scene is destroyed.
+        class Arena
+        {
+        public:
+            Threading::Mutex _lock;
+            std::vector<std::unique_ptr<uint8[]>> _pages;
+            uint8*  _next;
+            uint8*  _end;
+
+            void* Allocate(size_t size);
+            Arena() : _next(nullptr), _end(nullptr) {}
+        };
+
+        class IndexShard
+        {
+        public:
+            class Block
+            {
+            public:
+                void*       _object;
+                Destructor* _destructor;
+            };
+            using Key = std::pair<size_t, Id>;
+
+            Threading::Mutex _lock;
+            std::vector<std::pair<Key, Block>> _blocks;
+        };
+
+        Arena       _arenas[ArenaCount];
+        IndexShard  _shards[IndexShardCount];
+
+        IndexShard& GetShard(size_t typeHash, Id id)
+        {
+            return _shards[IntegerHash64(uint64(typeHash) ^ id) % IndexShardCount];
+        }
+
+        ~Pimpl()
+        {
+            for (auto& s:_shards)
+                for (auto& b:s._blocks)
+                    (*b.second._destructor)(b.second._object);
+        }
+    };
+
+    void* PreparedScene::Pimpl::Arena::Allocate(size_t size)
+    {
+        size = (size + AllocationAlignment - 1) & ~(AllocationAlignment - 1);
+        ScopedLock(_lock);
+        if (size_t(_end - _next) < size) {
+                //  Large allocations get a page of their own (and we keep
+                //  allocating from the current page)
+            auto pageSize = std::max(size, ArenaPageSize) + AllocationAlignment;
+            _pages.push_back(std::unique_ptr<uint8[]>(new uint8[pageSize]));
+            auto* start = (uint8*)((size_t(_pages.back().get()) + AllocationAlignment - 1) & ~(AllocationAlignment - 1));
+            if (size >= ArenaPageSize) return start;
+            _next = start;
+            _end = _pages.back().get() + pageSize;
+        }
+        auto* result = _next;
+        _next += size;
+        return result;
+    }
+
+    void* PreparedScene::AllocateMemory(size_t size)
     {
-        for (auto& b:_blocks)
-            (*b.second._destructor)(b.second._allocation._allocation);
+            //  Each thread is (almost always) using a different arena
+        auto& arena = _pimpl->_arenas[IntegerHash64(Threading::CurrentThreadId()) % ArenaCount];
+        return arena.Allocate(size);
     }
 
+    void PreparedScene::Register(size_t typeHash, Id id, void* object, Destructor* destructor)
+    {
+        auto& shard = _pimpl->GetShard(typeHash, id);
+        auto key = std::make_pair(typeHash, id);
+
+        ScopedLock(shard._lock);
+        auto i = std::lower_bound(
+            shard._blocks.begin(), shard._blocks.end(),
+            key, CompareFirst<Pimpl::IndexShard::Key, Pimpl::IndexShard::Block>());
+        assert(i == shard._blocks.end() || i->first != key);
+        shard._blocks.insert(i, std::make_pair(key, Pimpl::IndexShard::Block{ object, destructor }));
+    }
+
+    void* PreparedScene::Find(size_t typeHash, Id id) const
+    {
+        auto& shard = _pimpl->GetShard(typeHash, id);
+        auto key = std::make_pair(typeHash, id);
+
+        ScopedLock(shard._lock);
+        auto i = std::lower_bound(
+            shard._blocks.cbegin(), shard._blocks.cend(),
+            key, CompareFirst<Pimpl::IndexShard::Key, Pimpl::IndexShard::Block>());
+        if (i != shard._blocks.cend() && i->first == key)
+            return i->second._object;
+        return nullptr;
+    }
+
+    PreparedScene::PreparedScene()
+    {
+        _pimpl = std::make_unique<Pimpl>();
+    }
+
+    PreparedScene::~PreparedScene() {}
+
     PreparedScene::PreparedScene(PreparedScene&& moveFrom)
-    : _heap(std::move(moveFrom._heap)), _blocks(std::move(moveFrom._blocks))
+    : _pimpl(std::move(moveFrom._pimpl))
     {}
 
     PreparedScene& PreparedScene::operator=(PreparedScene&& moveFrom)
     {
-        _heap = std::move(moveFrom._heap);
-        _blocks = std::move(moveFrom._blocks);
+        _pimpl = std::move(moveFrom._pimpl);
         return *this;
     }
 }
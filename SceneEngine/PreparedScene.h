@@ -7,12 +7,26 @@
 #pragma once
 
 #include "../Core/Types.h"
-#include "../Utility/MiniHeap.h"
 #include "../Utility/IteratorUtils.h"
 #include <memory>
+#include <typeinfo>
 
 namespace SceneEngine
 {
+    /// <summary>Per-frame data prepared for rendering the scene</summary>
+    /// Scene parsers store the results of preparation steps (like culling) in here, and
+    /// retrieve them later during rendering. Every object is identified by its type and
+    /// an id. All objects are destroyed together when the PreparedScene is destroyed.
+    ///
+    /// Allocate() and Get() can be called from multiple threads at the same time (so
+    /// the main view and shadow projections can be prepared in parallel). Allocations
+    /// come from a small set of arenas, and each thread is hashed onto one arena; so
+    /// threads rarely contend for the same lock. The index is split into shards (by
+    /// type and id) for the same reason.
+    ///
+    /// Note that Get() will not find objects that are still being constructed by
+    /// Allocate() on another thread. And access to the objects themselves is not
+    /// synchronized.
     class PreparedScene
     {
     public:
@@ -26,53 +40,38 @@ namespace SceneEngine
         ~PreparedScene();
         PreparedScene& operator=(PreparedScene&&);
     private:
-        MiniHeap _heap;
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
 
         using Destructor = void(void*);
-        class Block
-        {
-        public:
-            Id _id;
-            MiniHeap::Allocation _allocation;
-            Destructor* _destructor;
-        };
-        std::vector<std::pair<size_t, Block>> _blocks;
+        void*   AllocateMemory(size_t size);
+        void    Register(size_t typeHash, Id id, void* object, Destructor* destructor);
+        void*   Find(size_t typeHash, Id id) const;
 
         template<typename Type> static void DestructorImpl(void* ptr)
             { ((Type*)ptr)->~Type(); }
     };
 
-    template<typename Type, typename... Args> 
+    template<typename Type, typename... Args>
         Type* PreparedScene::Allocate(Id id, Args... args)
         {
-            auto r = std::equal_range(
-                _blocks.begin(), _blocks.end(),
-                typeid(Type).hash_code(), CompareFirst<size_t, Block>());
-            for (auto i=r.first; i!=r.second; ++i) {
-                assert(i->second._id != id);
-            }
+            auto* alloc = AllocateMemory(sizeof(Type));
 
+                //  Construct before registering, so other threads never see
+                //  a partially constructed object
             #pragma push_macro("new")
             #undef new
-                auto alloc = _heap.Allocate(sizeof(Type));
-                new(alloc._allocation) Type(args...);
+                auto* result = new(alloc) Type(args...);
             #pragma pop_macro("new")
 
-            Destructor* destr = &DestructorImpl<Type>;
-            _blocks.insert(r.second, std::make_pair(typeid(Type).hash_code(), Block{ id, alloc, destr }));
-            return (Type*)alloc._allocation;
+            Register(typeid(Type).hash_code(), id, result, &DestructorImpl<Type>);
+            return result;
         }
 
-    template<typename Type> 
+    template<typename Type>
         Type* PreparedScene::Get(Id id)
         {
-            auto r = std::equal_range(
-                _blocks.begin(), _blocks.end(),
-                typeid(Type).hash_code(), CompareFirst<size_t, Block>());
-            for (auto i=r.first; i!=r.second; ++i)
-                if (i->second._id == id)
-                    return (Type*)i->second._allocation._allocation;
-            return nullptr;
+            return (Type*)Find(typeid(Type).hash_code(), id);
         }
 }
 
@@ -7,8 +7,13 @@
 #pragma once
 
 #include "../RenderCore/IThreadContext_Forward.h"
+#include "../Math/Matrix.h"
+#include "../Utility/IteratorUtils.h"
+#include <vector>
+#include <exception>
 
 namespace RenderCore { namespace Techniques { class CameraDesc; class ProjectionDesc; } }
+namespace Utility { class CompletionThreadPool; }
 
 namespace SceneEngine
 {
@@ -64,6 +69,17 @@ namespace SceneEngine
             RenderCore::IThreadContext& context, 
             LightingParserContext& parserContext,
             PreparedScene& preparedPackets) const = 0;
+
+            /// <summary>Prepare a single view of the scene</summary>
+            /// Called after PrepareScene(), once for the main view and once for each shadow
+            /// projection. The views are prepared in parallel, so this can be called from 
+            /// multiple threads at the same time. It should only do CPU work (like culling), 
+            /// and store the results in "preparedPackets" for ExecuteScene() to find.
+            /// The default implementation does nothing.
+        virtual void PrepareView(
+            const SceneParseSettings& parseSettings,
+            const Float4x4& worldToProjection,
+            PreparedScene& preparedPackets) const;
         virtual bool HasContent(const SceneParseSettings& parseSettings) const = 0;
 
         using ProjectionDesc    = RenderCore::Techniques::ProjectionDesc;
@@ -84,5 +100,29 @@ namespace SceneEngine
         virtual ~ISceneParser();
     };
 
+    /// <summary>A view of the scene that can be prepared in parallel with other views</summary>
+    class ScenePrepareView
+    {
+    public:
+        SceneParseSettings  _parseSettings;
+        Float4x4            _worldToProjection;
+
+        ScenePrepareView(const SceneParseSettings& parseSettings, const Float4x4& worldToProjection)
+        : _parseSettings(parseSettings), _worldToProjection(worldToProjection) {}
+    };
+
+    /// <summary>Calls ISceneParser::PrepareView for each view, as parallel tasks</summary>
+    /// The first view is prepared on the calling thread, and the remaining views are
+    /// prepared on the given thread pool. Returns when all views are complete.
+    ///
+    /// Asset exceptions (pending or invalid assets) are returned, so they can be passed
+    /// on to a parsing context on the calling thread. Any other exceptions are rethrown
+    /// after all views are complete.
+    auto PrepareSceneViews(
+        const ISceneParser& scene, 
+        IteratorRange<const ScenePrepareView*> views,
+        PreparedScene& preparedPackets,
+        Utility::CompletionThreadPool& threadPool) -> std::vector<std::exception_ptr>;
+
 }
 
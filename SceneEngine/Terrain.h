@@ -10,6 +10,7 @@
 #include "../RenderCore/Metal/Forward.h"    // (for RenderCore::Metal::DeviceContext)
 #include "../Math/Vector.h"
 #include "../Assets/AssetsCore.h"
+#include <vector>
 
 namespace RenderCore { namespace Techniques { class CameraDesc; } }
 namespace Utility { class OutputStream; }
@@ -86,6 +87,7 @@ namespace SceneEngine
 
         const TerrainCoordinateSystem&  GetCoords() const;
         const TerrainConfig&            GetConfig() const;
+        std::vector<std::pair<Float3, Float3>> GetCellBoundingBoxes() const;
         const TerrainMaterialConfig&    GetMaterialConfig() const;
         const std::shared_ptr<ITerrainFormat>& GetFormat() const;
         void SetWorldSpaceOrigin(const Float3& origin);
@@ -146,6 +148,18 @@ namespace SceneEngine
         ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
         const TerrainCoordinateSystem& coords, Float2 queryPosition);
 
+    /// <summary>Gets the height of the terrain for many positions at once</summary>
+    /// Equivalent to calling GetTerrainHeight for each position. But queries are grouped
+    /// by terrain node, so each node's height data is looked up only once. Prefer this
+    /// when snapping many points to the terrain (eg, for scattering placements).
+    /// Positions outside of the terrain (or in nodes that can't be loaded) get a height
+    /// of 0.
+    void GetTerrainHeights(
+        float heights[],
+        ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
+        const TerrainCoordinateSystem& coords, 
+        const Float2 queryPositions[], size_t queryCount);
+
     /// <summary>Like GetTerrainHeight, but also returns the normal</summary>
     bool GetTerrainHeightAndNormal(
         float& height, Float3& normal,
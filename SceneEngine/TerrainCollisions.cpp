@@ -13,6 +13,8 @@
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/HeapUtils.h"
 #include <memory>
+#include <vector>
+#include <algorithm>
 
 namespace SceneEngine
 {
@@ -187,24 +189,29 @@ namespace SceneEngine
 
     extern Int2 TerrainOffset;
 
-    float GetTerrainHeight(
-        ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
-        const TerrainCoordinateSystem& coords, Float2 queryPosition)
+    namespace Internal
     {
-        TRY
+        class TerrainNodeLocation
+        {
+        public:
+            Float2      _cellIndex;
+            Float2      _cellFrac;
+            unsigned    _nodeIndex;
+            uint64      _cellHash;
+        };
+
+        static bool LocateTerrainNode(
+            TerrainNodeLocation& result,
+            const TerrainConfig& cfg, const Float4x4& worldToCell, Float2 queryPosition)
         {
                 //
                 //  Find the cell and node that contains this position.
-                //  Once we've found it, we need to find a cached TerrainNodeHeightCollision
-                //  for the given node, and get the height data from that.
                 //
                 //  We're going to make some assumptions to make this faster. 
                 //      * We'll assume that the cells are arranged in a grid, so we can find the cell quickly
                 //      * we'll also make similar assumptions about the arrangement of nodes within
                 //          the cell, so we can find the node index directly (within loading the cell node)
                 //  
-
-            auto worldToCell = coords.WorldToCellBased();
             auto cellBasedCoord = Truncate(
                 TransformPoint(worldToCell, Expand(queryPosition, 0.f)));
 
@@ -212,7 +219,7 @@ namespace SceneEngine
 
             if (    cellIndex[0] < 0.f || cellIndex[0] >= float(cfg._cellCount[0])
                 ||  cellIndex[1] < 0.f || cellIndex[1] >= float(cfg._cellCount[1])) {
-                return 0.f;
+                return false;
             }
 
             Float2 cellFrac(cellBasedCoord[0] - cellIndex[0], cellBasedCoord[1] - cellIndex[1]);
@@ -222,21 +229,49 @@ namespace SceneEngine
             float nodeY = XlFloor(cellFrac[1] * float(cellDimsInNodes[1]));
             unsigned nodeIndex = 85 + unsigned(nodeY) * cellDimsInNodes[0] + unsigned(nodeX);
 
-            uint64 cellHash = (uint64(nodeIndex) << 32ull) | (uint64(cellIndex[1]) << 6ull) | uint64(cellIndex[0]);
+            result._cellIndex = cellIndex;
+            result._cellFrac = cellFrac;
+            result._nodeIndex = nodeIndex;
+            result._cellHash = (uint64(nodeIndex) << 32ull) | (uint64(cellIndex[1]) << 6ull) | uint64(cellIndex[0]);
+            return true;
+        }
 
+        static std::shared_ptr<TerrainNodeHeightCollision> GetNodeHeightCollision(
+            ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
+            const TerrainNodeLocation& location)
+        {
                 // (simple cache for recently used terrain files -- so we don't have to continually re-load every frame)
                 //      -- \todo -- this cache should be in a manager object! todo many statics in functions!
-            static LRUCache<TerrainNodeHeightCollision> CollisionCache(8);
-            auto collisionObject = CollisionCache.Get(cellHash);
+            static LRUCache<TerrainNodeHeightCollision> CollisionCache(16);
+            auto collisionObject = CollisionCache.Get(location._cellHash);
             if (!collisionObject) {
                 char cellFilename[MaxPath];
-                cfg.GetCellFilename(cellFilename, dimof(cellFilename), UInt2(unsigned(cellIndex[0]), unsigned(cellIndex[1])), CoverageId_Heights);
-                collisionObject = std::make_shared<TerrainNodeHeightCollision>(cellFilename, ioFormat, nodeIndex);
-                CollisionCache.Insert(cellHash, collisionObject);
+                cfg.GetCellFilename(
+                    cellFilename, dimof(cellFilename), 
+                    UInt2(unsigned(location._cellIndex[0]), unsigned(location._cellIndex[1])), CoverageId_Heights);
+                collisionObject = std::make_shared<TerrainNodeHeightCollision>(cellFilename, ioFormat, location._nodeIndex);
+                CollisionCache.Insert(location._cellHash, collisionObject);
             }
 
             assert(collisionObject);
-            return collisionObject->GetHeight(cellFrac) + coords.TerrainOffset()[2];
+            return collisionObject;
+        }
+    }
+
+    float GetTerrainHeight(
+        ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
+        const TerrainCoordinateSystem& coords, Float2 queryPosition)
+    {
+        TRY
+        {
+                //  Once we've found the cell and node, we need to find a cached 
+                //  TerrainNodeHeightCollision for the given node, and get the height data from that.
+            Internal::TerrainNodeLocation location;
+            if (!Internal::LocateTerrainNode(location, cfg, coords.WorldToCellBased(), queryPosition))
+                return 0.f;
+
+            auto collisionObject = Internal::GetNodeHeightCollision(ioFormat, cfg, location);
+            return collisionObject->GetHeight(location._cellFrac) + coords.TerrainOffset()[2];
 
         } CATCH(const ::Assets::Exceptions::PendingAsset&) {
         } CATCH(const std::exception&) {
@@ -247,6 +282,50 @@ namespace SceneEngine
         return 0.f;
     }
 
+    void GetTerrainHeights(
+        float heights[],
+        ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
+        const TerrainCoordinateSystem& coords, 
+        const Float2 queryPositions[], size_t queryCount)
+    {
+            //  Locate the node for every query first, and then sort the queries
+            //  by node. This way we only need to find the TerrainNodeHeightCollision
+            //  object once for each node (rather than once per query)
+        auto worldToCell = coords.WorldToCellBased();
+        std::vector<std::pair<Internal::TerrainNodeLocation, size_t>> located;
+        located.reserve(queryCount);
+        for (size_t c=0; c<queryCount; ++c) {
+            heights[c] = 0.f;
+            Internal::TerrainNodeLocation location;
+            if (Internal::LocateTerrainNode(location, cfg, worldToCell, queryPositions[c]))
+                located.push_back(std::make_pair(location, c));
+        }
+
+        std::sort(
+            located.begin(), located.end(),
+            [](const std::pair<Internal::TerrainNodeLocation, size_t>& lhs, const std::pair<Internal::TerrainNodeLocation, size_t>& rhs)
+            { return lhs.first._cellHash < rhs.first._cellHash; });
+
+        const float heightOffset = coords.TerrainOffset()[2];
+        for (auto i=located.cbegin(); i!=located.cend();) {
+            auto groupEnd = i+1;
+            while (groupEnd != located.cend() && groupEnd->first._cellHash == i->first._cellHash) ++groupEnd;
+
+                //  Failures only affect the queries in this node (they will get the default height)
+            TRY
+            {
+                auto collisionObject = Internal::GetNodeHeightCollision(ioFormat, cfg, i->first);
+                for (auto q=i; q!=groupEnd; ++q)
+                    heights[q->second] = collisionObject->GetHeight(q->first._cellFrac) + heightOffset;
+            } CATCH(const ::Assets::Exceptions::PendingAsset&) {
+            } CATCH(const std::exception&) {
+                LogWarning << "Error when querying terrain height at " << queryPositions[i->second][0] << ", " << queryPositions[i->second][1];
+            } CATCH_END
+
+            i = groupEnd;
+        }
+    }
+
     bool GetTerrainHeightAndNormal(
         float& height, Float3& normal,
         ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
@@ -254,50 +333,12 @@ namespace SceneEngine
     {
         TRY
         {
-                //
-                //  Find the cell and node that contains this position.
-                //  Once we've found it, we need to find a cached TerrainNodeHeightCollision
-                //  for the given node, and get the height data from that.
-                //
-                //  We're going to make some assumptions to make this faster. 
-                //      * We'll assume that the cells are arranged in a grid, so we can find the cell quickly
-                //      * we'll also make similar assumptions about the arrangement of nodes within
-                //          the cell, so we can find the node index directly (within loading the cell node)
-                //  
-
-            auto worldToCell = coords.WorldToCellBased();
-            auto cellBasedCoord = Truncate(
-                TransformPoint(worldToCell, Expand(queryPosition, 0.f)));
-
-            Float2 cellIndex(XlFloor(cellBasedCoord[0]), XlFloor(cellBasedCoord[1]));
-
-            if (    cellIndex[0] < 0.f || cellIndex[0] >= float(cfg._cellCount[0])
-                ||  cellIndex[1] < 0.f || cellIndex[1] >= float(cfg._cellCount[1])) {
+            Internal::TerrainNodeLocation location;
+            if (!Internal::LocateTerrainNode(location, cfg, coords.WorldToCellBased(), queryPosition))
                 return false;
-            }
 
-            Float2 cellFrac(cellBasedCoord[0] - cellIndex[0], cellBasedCoord[1] - cellIndex[1]);
-        
-            auto cellDimsInNodes = cfg.CellDimensionsInNodes();
-            float nodeX = XlFloor(cellFrac[0] * float(cellDimsInNodes[0]));
-            float nodeY = XlFloor(cellFrac[1] * float(cellDimsInNodes[1]));
-            unsigned nodeIndex = 85 + unsigned(nodeY) * cellDimsInNodes[0] + unsigned(nodeX);
-
-            uint64 cellHash = (uint64(nodeIndex) << 32ull) | (uint64(cellIndex[1]) << 6ull) | uint64(cellIndex[0]);
-
-                // (simple cache for recently used terrain files -- so we don't have to continually re-load every frame)
-                //      -- \todo -- this cache should be in a manager object! todo many statics in functions!
-            static LRUCache<TerrainNodeHeightCollision> CollisionCache(8);
-            auto collisionObject = CollisionCache.Get(cellHash);
-            if (!collisionObject) {
-                char cellFilename[MaxPath];
-                cfg.GetCellFilename(cellFilename, dimof(cellFilename), UInt2(unsigned(cellIndex[0]), unsigned(cellIndex[1])), CoverageId_Heights);
-                collisionObject = std::make_shared<TerrainNodeHeightCollision>(cellFilename, ioFormat, nodeIndex);
-                CollisionCache.Insert(cellHash, collisionObject);
-            }
-
-            assert(collisionObject);
-            bool queryResult = collisionObject->GetHeightAndNormal(cellFrac, height, normal);
+            auto collisionObject = Internal::GetNodeHeightCollision(ioFormat, cfg, location);
+            bool queryResult = collisionObject->GetHeightAndNormal(location._cellFrac, height, normal);
             height += coords.TerrainOffset()[2];
             return queryResult;
 
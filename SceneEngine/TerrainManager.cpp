@@ -941,5 +941,15 @@ namespace SceneEngine
     const TerrainConfig& TerrainManager::GetConfig() const                      { return _pimpl->_cfg; }
     const std::shared_ptr<ITerrainFormat>& TerrainManager::GetFormat() const    { return _pimpl->_ioFormat; }
     const TerrainMaterialConfig& TerrainManager::GetMaterialConfig() const      { return _pimpl->_matCfg; }
+
+    std::vector<std::pair<Float3, Float3>> TerrainManager::GetCellBoundingBoxes() const
+    {
+        std::vector<std::pair<Float3, Float3>> result;
+        result.reserve(_pimpl->_cells.size());
+        for (const auto& c:_pimpl->_cells)
+            if (c._aabbMin[0] <= c._aabbMax[0])     // (bounding box may not be known)
+                result.push_back(std::make_pair(c._aabbMin, c._aabbMax));
+        return std::move(result);
+    }
 }
 
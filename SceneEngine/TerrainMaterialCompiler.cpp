@@ -0,0 +1,423 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TerrainMaterialCompiler.h"
+#include "../RenderCore/Assets/CompilationThread.h"
+#include "../Assets/IntermediateAssets.h"
+#include "../Assets/AssetUtils.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Streams/PathUtils.h"
+#include "../Utility/StringFormat.h"
+#include "../Utility/StringUtils.h"
+#include "../Utility/BitUtils.h"
+#include "../Utility/Conversion.h"
+#include "../Utility/ExceptionLogging.h"
+#include <vector>
+
+#include "../Core/WinAPI/IncludeWindows.h"
+#include "../../Foreign/DirectXTex/DirectXTex/DirectXTex.h"
+
+namespace SceneEngine
+{
+    static const char* s_arrayTypeNames[] = { "diffuse", "normal", "roughness" };
+    static const DXGI_FORMAT s_arrayFormats[] = { DXGI_FORMAT_BC1_UNORM_SRGB, DXGI_FORMAT_BC5_UNORM, DXGI_FORMAT_R8_UNORM };
+
+    static HRESULT LoadSourceImage(const ::Assets::ResChar filename[], DirectX::ScratchImage& result)
+    {
+        auto ext = MakeFileNameSplitter(filename).Extension();
+        auto fn = Conversion::Convert<std::wstring>(std::string(filename));
+        DirectX::TexMetadata metadata;
+        if (XlEqStringI(ext, "dds")) return DirectX::LoadFromDDSFile(fn.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, result);
+        if (XlEqStringI(ext, "tga")) return DirectX::LoadFromTGAFile(fn.c_str(), &metadata, result);
+        return DirectX::LoadFromWICFile(fn.c_str(), DirectX::WIC_FLAGS_NONE, &metadata, result);
+    }
+
+    static void FillDefault(const DirectX::Image& image, TerrainTextureArrayType::Enum type)
+    {
+            //  Fill in the default value for layers that don't have a source texture.
+            //  These match the dummy textures TerrainMaterialTextures used to create
+            //  at runtime.
+        if (type == TerrainTextureArrayType::Diffuse) {
+            struct BC1Block { uint16 c0; uint16 c1; uint32 t; } block = { 0xffff, 0xffff, 0 };
+            auto* data = (BC1Block*)image.pixels;
+            for (size_t c=0; c<image.slicePitch / sizeof(BC1Block); ++c) data[c] = block;
+        } else if (type == TerrainTextureArrayType::Normal) {
+            struct BC5Block
+            {
+                uint8 x0; uint8 x1; uint8 tx[6];
+                uint8 y0; uint8 y1; uint8 ty[6];
+            } block = {
+                0x80, 0x80, {0,0,0,0,0,0},
+                0x80, 0x80, {0,0,0,0,0,0}
+            };
+            auto* data = (BC5Block*)image.pixels;
+            for (size_t c=0; c<image.slicePitch / sizeof(BC5Block); ++c) data[c] = block;
+        } else {
+            XlSetMemory(image.pixels, 0, image.slicePitch);
+        }
+    }
+
+    static void CopyImage(const DirectX::Image& dst, const DirectX::Image& src)
+    {
+            //  (rows here are rows of blocks for block compressed formats)
+        assert(dst.format == src.format && dst.width == src.width && dst.height == src.height);
+        auto rowCount = src.slicePitch / src.rowPitch;
+        auto rowSize = std::min(src.rowPitch, dst.rowPitch);
+        for (size_t r=0; r<rowCount; ++r)
+            XlCopyMemory(PtrAdd(dst.pixels, r*dst.rowPitch), PtrAdd(src.pixels, r*src.rowPitch), rowSize);
+    }
+
+    static bool BuildLayer(
+        DirectX::ScratchImage& result,
+        TerrainTextureArrayType::Enum type, UInt2 dims, unsigned mipCount,
+        const ::Assets::ResChar sourceFile[])
+    {
+        using namespace DirectX;
+
+        ScratchImage source;
+        auto hresult = LoadSourceImage(sourceFile, source);
+        if (!SUCCEEDED(hresult)) {
+            LogWarning << "Could not load terrain texture (" << sourceFile << "). Using default value for this layer.";
+            return false;
+        }
+
+            //  Start from the smallest mip in the source that is still at least as large
+            //  as the destination (this is what the runtime used to do, and it avoids
+            //  resampling by large ratios). Everything after this is done in 32 bit float,
+            //  so the resample and mip generation don't lose precision.
+        const auto& srcMetadata = source.GetMetadata();
+        unsigned srcMip = 0;
+        while (     (srcMip+1) < srcMetadata.mipLevels
+                &&  (srcMetadata.width >> (srcMip+1)) >= dims[0]
+                &&  (srcMetadata.height >> (srcMip+1)) >= dims[1])
+            ++srcMip;
+        const auto& srcImage = *source.GetImage(srcMip, 0, 0);
+
+        const auto workingFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        ScratchImage working;
+        if (IsCompressed(srcImage.format)) {
+            hresult = Decompress(srcImage, workingFormat, working);
+        } else {
+            hresult = Convert(srcImage, workingFormat, TEX_FILTER_DEFAULT, 0.f, working);
+        }
+        if (!SUCCEEDED(hresult)) {
+            LogWarning << "Could not convert terrain texture (" << sourceFile << ") into working format. Using default value for this layer.";
+            return false;
+        }
+
+        if (srcImage.width != dims[0] || srcImage.height != dims[1]) {
+            ScratchImage resampled;
+            hresult = Resize(*working.GetImage(0,0,0), dims[0], dims[1], TEX_FILTER_DEFAULT, resampled);
+            if (!SUCCEEDED(hresult)) {
+                LogWarning << "Failed while resampling terrain texture (" << sourceFile << "). Using default value for this layer.";
+                return false;
+            }
+            working = std::move(resampled);
+        }
+
+        ScratchImage mipChain;
+        hresult = GenerateMipMaps(*working.GetImage(0,0,0), TEX_FILTER_DEFAULT, mipCount, mipChain);
+        if (!SUCCEEDED(hresult)) {
+            LogWarning << "Failed while building mipmaps for terrain texture (" << sourceFile << "). Using default value for this layer.";
+            return false;
+        }
+
+            //  Compress with the same flags the runtime used when it had to recompress
+            //  resampled textures. We're already processing many layers in parallel, so
+            //  don't ask the compressor for more threads.
+        auto finalFormat = s_arrayFormats[type];
+        if (IsCompressed(finalFormat)) {
+            DWORD compressFlags = (type == TerrainTextureArrayType::Diffuse)
+                ? (TEX_COMPRESS_DITHER | TEX_COMPRESS_SRGB) : TEX_COMPRESS_DEFAULT;
+            hresult = Compress(
+                mipChain.GetImages(), mipChain.GetImageCount(), mipChain.GetMetadata(),
+                finalFormat, compressFlags, 0.5f, result);
+        } else {
+            hresult = Convert(
+                mipChain.GetImages(), mipChain.GetImageCount(), mipChain.GetMetadata(),
+                finalFormat, TEX_FILTER_DEFAULT, 0.f, result);
+        }
+        if (!SUCCEEDED(hresult)) {
+            LogWarning << "Failed while compressing terrain texture (" << sourceFile << "). Using default value for this layer.";
+            return false;
+        }
+
+        return true;
+    }
+
+    static void InitializeCOMForThread()
+    {
+            //  DirectXTex needs COM for WIC formats, in every thread that uses it. Thread pool
+            //  threads live until shutdown, and DirectXTex keeps its WIC factory for the life
+            //  of the process, so we initialize once per thread and never uninitialize.
+        static thread_local bool initialized = false;
+        if (!initialized) {
+            CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+            initialized = true;
+        }
+    }
+
+    void CompileTerrainTextureArray(
+        const ::Assets::ResChar destinationFile[],
+        TerrainTextureArrayType::Enum type, UInt2 dims,
+        IteratorRange<const ::Assets::rstring*> sourceFiles,
+        bool parallel)
+    {
+        if (type >= TerrainTextureArrayType::Max)
+            Throw(::Exceptions::BasicLabel("Bad terrain texture array type"));
+        if (!IsPowerOfTwo(dims[0]) || dims[0] != dims[1])
+            Throw(::Exceptions::BasicLabel("Expecting square, power of two dimensions for terrain texture arrays"));
+        if (sourceFiles.empty())
+            Throw(::Exceptions::BasicLabel("Terrain texture array has no layers"));
+
+            //  Mip chain stops at 4x4 (the size of a compression block)
+        const auto layerCount = unsigned(sourceFiles.size());
+        const auto mipCount = (unsigned)std::max(int(IntegerLog2(dims[0]))-1, 1);
+        const auto format = s_arrayFormats[type];
+
+        DirectX::ScratchImage finalImage;
+        auto hresult = finalImage.Initialize2D(format, dims[0], dims[1], layerCount, mipCount);
+        if (!SUCCEEDED(hresult))
+            Throw(::Exceptions::BasicLabel("Could not allocate terrain texture array"));
+
+            //  Layers can take very different amounts of time (depending on the source size
+            //  & format), so each thread takes the next unprocessed layer (rather than a
+            //  fixed block of layers). Layers are written into separate parts of the final 
+            //  image, so there is no other synchronisation.
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetLongTaskThreadPool(), layerCount,
+            [&](unsigned l)
+            {
+                InitializeCOMForThread();
+
+                DirectX::ScratchImage layer;
+                const auto& src = sourceFiles[l];
+                bool good = !src.empty() && BuildLayer(layer, type, dims, mipCount, src.c_str());
+                for (unsigned m=0; m<mipCount; ++m) {
+                    auto& dst = *finalImage.GetImage(m, l, 0);
+                    if (good) CopyImage(dst, *layer.GetImage(m, 0, 0));
+                    else FillDefault(dst, type);
+                }
+            }, parallel ? ~0u : 0u);
+
+        CreateDirectoryRecursive(MakeFileNameSplitter(destinationFile).DriveAndPath());
+        auto fn = Conversion::Convert<std::wstring>(std::string(destinationFile));
+        hresult = DirectX::SaveToDDSFile(
+            finalImage.GetImages(), finalImage.GetImageCount(), finalImage.GetMetadata(),
+            DirectX::DDS_FLAGS_NONE, fn.c_str());
+        if (!SUCCEEDED(hresult))
+            Throw(::Exceptions::BasicLabel("Failure while writing terrain texture array (%s)", destinationFile));
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    ::Assets::rstring MakeTerrainTextureArrayDesc(TerrainTextureArrayType::Enum type, UInt2 dimensions)
+    {
+        return ::Assets::rstring(
+            StringMeld<64, ::Assets::ResChar>() << s_arrayTypeNames[type] << ":" << dimensions[0] << "x" << dimensions[1]);
+    }
+
+    static bool ParseTerrainTextureArrayDesc(const ::Assets::ResChar desc[], TerrainTextureArrayType::Enum& type, UInt2& dims)
+    {
+        auto* colon = XlFindChar(desc, ':');
+        if (!colon) return false;
+
+        auto name = MakeStringSection(desc, colon);
+        unsigned t=0;
+        while (t<TerrainTextureArrayType::Max && !XlEqStringI(name, s_arrayTypeNames[t])) ++t;
+        if (t >= TerrainTextureArrayType::Max) return false;
+
+        const char* end = nullptr;
+        dims[0] = XlAtoUI32(colon+1, &end);
+        if (!end || *end != 'x') return false;
+        dims[1] = XlAtoUI32(end+1);
+        type = TerrainTextureArrayType::Enum(t);
+        return dims[0] && dims[1];
+    }
+
+    class TerrainArrayCompileOp : public RenderCore::Assets::QueuedCompileOperation
+    {
+    public:
+        TerrainTextureArrayType::Enum _arrayType;
+        UInt2 _dimensions;
+        std::vector<::Assets::rstring> _sourceFiles;
+    };
+
+    static void DoCompileTerrainArray(RenderCore::Assets::QueuedCompileOperation& queuedOp)
+    {
+        auto& op = static_cast<TerrainArrayCompileOp&>(queuedOp);
+        TRY
+        {
+            CompileTerrainTextureArray(
+                op.GetLocator()._sourceID0, op._arrayType, op._dimensions,
+                MakeIteratorRange(op._sourceFiles));
+
+                //  Missing source files are still dependencies (we want to recompile
+                //  if they appear later)
+            std::vector<::Assets::DependentFileState> deps;
+            for (const auto& s:op._sourceFiles) {
+                if (s.empty()) continue;
+                auto depState = ::Assets::IntermediateAssets::Store::GetDependentFileState(MakeStringSection(s));
+                auto existing = std::find_if(
+                    deps.cbegin(), deps.cend(),
+                    [&](const ::Assets::DependentFileState& test) { return test._filename == depState._filename; });
+                if (existing == deps.cend())
+                    deps.push_back(depState);
+            }
+
+            op.GetLocator()._dependencyValidation = op._destinationStore->WriteDependencies(
+                op.GetLocator()._sourceID0, StringSection<::Assets::ResChar>(),
+                MakeIteratorRange(deps));
+            assert(op.GetLocator()._dependencyValidation);
+
+            op.SetState(::Assets::AssetState::Ready);
+        } CATCH(const std::exception& e) {
+            LogWarning << "Failed while compiling terrain texture array (" << op.GetLocator()._sourceID0 << "): " << e.what();
+            op.SetState(::Assets::AssetState::Invalid);
+        } CATCH(...) {
+            op.SetState(::Assets::AssetState::Invalid);
+        } CATCH_END
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class TerrainMaterialArrayCompiler::Pimpl
+    {
+    public:
+        Threading::Mutex _threadLock;
+        std::unique_ptr<RenderCore::Assets::CompilationThread> _thread;
+    };
+
+    class TerrainMaterialArrayCompiler::Marker : public ::Assets::ICompileMarker
+    {
+    public:
+        ::Assets::IntermediateAssetLocator GetExistingAsset() const;
+        std::shared_ptr<::Assets::PendingCompileMarker> InvokeCompile() const;
+        StringSection<::Assets::ResChar> Initializer() const;
+
+        Marker(
+            TerrainTextureArrayType::Enum type, UInt2 dimensions,
+            std::vector<::Assets::rstring>&& sourceFiles,
+            const ::Assets::IntermediateAssets::Store& store,
+            std::shared_ptr<TerrainMaterialArrayCompiler> compiler);
+        ~Marker();
+    private:
+        TerrainTextureArrayType::Enum _type;
+        UInt2 _dimensions;
+        std::vector<::Assets::rstring> _sourceFiles;
+        ::Assets::rstring _initializer;
+        std::weak_ptr<TerrainMaterialArrayCompiler> _compiler;
+        const ::Assets::IntermediateAssets::Store* _store;
+
+        void MakeIntermediateName(::Assets::ResChar destination[], size_t destinationCount) const;
+    };
+
+    void TerrainMaterialArrayCompiler::Marker::MakeIntermediateName(::Assets::ResChar destination[], size_t destinationCount) const
+    {
+            //  The array depends on the full list of source files (in order), so the
+            //  intermediate name is built from a hash of that list
+        uint64 hash = Hash64(_initializer);
+        for (const auto& s:_sourceFiles)
+            hash = Hash64(s, hash);
+
+        char hashString[32];
+        XlUI64toA(hash, hashString, dimof(hashString), 16);
+
+        _store->MakeIntermediateName(destination, (unsigned)destinationCount, "terrainarrays");
+        StringMeldAppend(destination, &destination[destinationCount])
+            << "/" << s_arrayTypeNames[_type] << "-" << hashString << ".dds";
+    }
+
+    ::Assets::IntermediateAssetLocator TerrainMaterialArrayCompiler::Marker::GetExistingAsset() const
+    {
+        ::Assets::IntermediateAssetLocator result;
+        MakeIntermediateName(result._sourceID0, dimof(result._sourceID0));
+        result._dependencyValidation = _store->MakeDependencyValidation(result._sourceID0);
+        return result;
+    }
+
+    std::shared_ptr<::Assets::PendingCompileMarker> TerrainMaterialArrayCompiler::Marker::InvokeCompile() const
+    {
+        auto c = _compiler.lock();
+        if (!c) return nullptr;
+
+        auto backgroundOp = std::make_shared<TerrainArrayCompileOp>();
+        backgroundOp->SetInitializer(_initializer.c_str());
+        backgroundOp->_initializer0[0] = backgroundOp->_initializer1[0] = '\0';
+        backgroundOp->_destinationStore = _store;
+        backgroundOp->_typeCode = CompileProcessType;
+        backgroundOp->_arrayType = _type;
+        backgroundOp->_dimensions = _dimensions;
+        backgroundOp->_sourceFiles = _sourceFiles;
+        MakeIntermediateName(backgroundOp->GetLocator()._sourceID0, dimof(backgroundOp->GetLocator()._sourceID0));
+
+        {
+            ScopedLock(c->_pimpl->_threadLock);
+            if (!c->_pimpl->_thread)
+                c->_pimpl->_thread = std::make_unique<RenderCore::Assets::CompilationThread>(DoCompileTerrainArray);
+        }
+        c->_pimpl->_thread->Push(backgroundOp);
+
+        return std::move(backgroundOp);
+    }
+
+    StringSection<::Assets::ResChar> TerrainMaterialArrayCompiler::Marker::Initializer() const
+    {
+        return MakeStringSection(_initializer);
+    }
+
+    TerrainMaterialArrayCompiler::Marker::Marker(
+        TerrainTextureArrayType::Enum type, UInt2 dimensions,
+        std::vector<::Assets::rstring>&& sourceFiles,
+        const ::Assets::IntermediateAssets::Store& store,
+        std::shared_ptr<TerrainMaterialArrayCompiler> compiler)
+    : _type(type), _dimensions(dimensions), _sourceFiles(std::move(sourceFiles))
+    , _compiler(std::move(compiler)), _store(&store)
+    {
+        _initializer = MakeTerrainTextureArrayDesc(type, dimensions) + "(terrain texture array)";
+    }
+
+    TerrainMaterialArrayCompiler::Marker::~Marker() {}
+
+    std::shared_ptr<::Assets::ICompileMarker> TerrainMaterialArrayCompiler::PrepareAsset(
+        uint64 typeCode,
+        const ::Assets::ResChar* initializers[], unsigned initializerCount,
+        const ::Assets::IntermediateAssets::Store& store)
+    {
+        TerrainTextureArrayType::Enum type;
+        UInt2 dims;
+        if (initializerCount < 2 || !ParseTerrainTextureArrayDesc(initializers[0], type, dims))
+            Throw(::Exceptions::BasicLabel("Expecting array type and dimensions, followed by source textures in TerrainMaterialArrayCompiler"));
+
+        std::vector<::Assets::rstring> sourceFiles;
+        sourceFiles.reserve(initializerCount-1);
+        for (unsigned c=1; c<initializerCount; ++c)
+            sourceFiles.push_back(initializers[c]);
+        return std::make_shared<Marker>(type, dims, std::move(sourceFiles), store, shared_from_this());
+    }
+
+    void TerrainMaterialArrayCompiler::StallOnPendingOperations(bool cancelAll)
+    {
+        {
+            ScopedLock(_pimpl->_threadLock);
+            if (!_pimpl->_thread) return;
+        }
+        _pimpl->_thread->StallOnPendingOperations(cancelAll);
+    }
+
+    TerrainMaterialArrayCompiler::TerrainMaterialArrayCompiler()
+    {
+        _pimpl = std::make_unique<Pimpl>();
+    }
+
+    TerrainMaterialArrayCompiler::~TerrainMaterialArrayCompiler() {}
+}
+
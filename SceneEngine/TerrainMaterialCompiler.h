@@ -0,0 +1,71 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Assets/IntermediateAssets.h"
+#include "../Math/Vector.h"
+#include "../Utility/IteratorUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Core/Types.h"
+#include <memory>
+
+namespace SceneEngine
+{
+    /// <summary>The type of texture array built by the TerrainMaterialArrayCompiler</summary>
+    /// Each type has a fixed pixel format, and a default value that is used for
+    /// array layers without a source texture.
+    ///     Diffuse -- BC1_UNORM_SRGB (default white)
+    ///     Normal -- BC5_UNORM (default flat normal)
+    ///     Roughness -- R8_UNORM (default black)
+    struct TerrainTextureArrayType { enum Enum { Diffuse, Normal, Roughness, Max }; };
+
+    /// <summary>Builds a terrain material texture array on the CPU, and writes it to disk</summary>
+    /// Every source texture is loaded, resampled to the given dimensions, mip-mapped and
+    /// compressed into the final format. The layers are processed in parallel using the long
+    /// task thread pool (unless "parallel" is false). The result is written as a single
+    /// DDS file that can be uploaded directly. Empty source filenames (and source textures
+    /// that fail to load) are replaced with the default value for the array type.
+    ///
+    /// The array has a mip chain down to 4x4 (to match the block compressed formats).
+    /// Only square, power of two dimensions are supported.
+    void CompileTerrainTextureArray(
+        const ::Assets::ResChar destinationFile[],
+        TerrainTextureArrayType::Enum type, UInt2 dimensions,
+        IteratorRange<const ::Assets::rstring*> sourceFiles,
+        bool parallel = true);
+
+    /// <summary>Intermediate asset compiler for terrain material texture arrays</summary>
+    /// Initializers:
+    ///     [0] -- array type and dimensions, in the form "diffuse:512x512" (see MakeTerrainTextureArrayDesc)
+    ///     [1...] -- source texture for each array layer, in order. Use an empty string for a layer
+    ///         that should be filled with the default value
+    ///
+    /// The compiled asset is a DDS file in the intermediate store (see GetExistingAsset()._sourceID0),
+    /// with dependencies on all of the source textures.
+    class TerrainMaterialArrayCompiler : public ::Assets::IntermediateAssets::IAssetCompiler, public std::enable_shared_from_this<TerrainMaterialArrayCompiler>
+    {
+    public:
+        std::shared_ptr<::Assets::ICompileMarker> PrepareAsset(
+            uint64 typeCode,
+            const ::Assets::ResChar* initializers[], unsigned initializerCount,
+            const ::Assets::IntermediateAssets::Store& destinationStore);
+        void StallOnPendingOperations(bool cancelAll);
+
+        static const uint64 CompileProcessType = ConstHash64<'Terr', 'ainA', 'rray'>::Value;
+
+        TerrainMaterialArrayCompiler();
+        ~TerrainMaterialArrayCompiler();
+    protected:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+
+        class Marker;
+    };
+
+    ::Assets::rstring MakeTerrainTextureArrayDesc(TerrainTextureArrayType::Enum type, UInt2 dimensions);
+}
+
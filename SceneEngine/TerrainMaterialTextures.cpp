@@ -6,6 +6,7 @@
 
 #include "TerrainMaterialTextures.h"
 #include "TerrainMaterial.h"
+#include "TerrainMaterialCompiler.h"
 #include "SceneEngineUtils.h"
 #include "../BufferUploads/ResourceLocator.h"
 #include "../BufferUploads/DataPacket.h"
@@ -15,9 +16,11 @@
 #include "../RenderCore/Assets/DeferredShaderResource.h"
 #include "../Assets/AssetServices.h"
 #include "../Assets/CompileAndAsyncManager.h"
+#include "../Assets/IntermediateAssets.h"
 #include "../ConsoleRig/Log.h"
 #include "../Utility/BitUtils.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/Streams/FileUtils.h"
 
 #include "../RenderCore/DX11/Metal/DX11Utils.h"
 #include "../../Foreign/DirectXTex/DirectXTex/DirectXTex.h"
@@ -314,6 +317,157 @@ namespace SceneEngine
         return GetBufferUploads().Transaction_Immediate(desc, tempBuffer.get());
     }
 
+    static intrusive_ptr<BufferUploads::ResourceLocator> LoadCompiledArray(
+        TerrainTextureArrayType::Enum type, UInt2 dims,
+        const std::vector<::Assets::rstring>& sourceFiles,
+        const std::shared_ptr<::Assets::DependencyValidation>& depVal)
+    {
+            //  Find the precompiled array in the intermediate store (or compile it now), and
+            //  upload it as a single texture. We stall while any compile completes, because
+            //  this constructor has always been synchronous
+        auto& asyncMan = ::Assets::Services::GetAsyncMan();
+        auto arrayDesc = MakeTerrainTextureArrayDesc(type, dims);
+        std::vector<const ::Assets::ResChar*> initializers;
+        initializers.reserve(sourceFiles.size()+1);
+        initializers.push_back(arrayDesc.c_str());
+        for (const auto& s:sourceFiles) initializers.push_back(s.c_str());
+
+        auto marker = asyncMan.GetIntermediateCompilers().PrepareAsset(
+            TerrainMaterialArrayCompiler::CompileProcessType,
+            AsPointer(initializers.begin()), unsigned(initializers.size()),
+            asyncMan.GetIntermediateStore());
+        if (!marker) return nullptr;
+
+        auto locator = marker->GetExistingAsset();
+        if (    !locator._dependencyValidation || locator._dependencyValidation->GetValidationIndex()!=0
+            ||  !DoesFileExist(locator._sourceID0)) {
+
+            auto pendingCompile = marker->InvokeCompile();
+            if (!pendingCompile || pendingCompile->StallWhilePending() != ::Assets::AssetState::Ready)
+                return nullptr;
+            locator = pendingCompile->GetLocator();
+        }
+
+        using namespace BufferUploads;
+        auto pkt = CreateStreamingTextureSource(MakeStringSection(locator._sourceID0));
+        auto result = GetBufferUploads().Transaction_Immediate(
+            CreateDesc(
+                BindFlag::ShaderResource, 0, GPUAccess::Read,
+                TextureDesc::Empty(), "TerrainMaterialTextures"),
+            pkt.get());
+        if (result)
+            ::Assets::RegisterAssetDependency(depVal, locator._dependencyValidation);
+        return std::move(result);
+    }
+
+    static void LoadArraysAtRuntime(
+        Metal::DeviceContext& metalContext,
+        TerrainMaterialTextures::ResLocator textureArrays[],
+        const TerrainMaterialConfig& scaffold,
+        IteratorRange<const ResolvedTextureFiles*> texFiles,
+        const std::shared_ptr<::Assets::DependencyValidation>& depVal)
+    {
+            //  Create the arrays that weren't loaded precompiled, and merge the source textures
+            //  into them one at a time. This is slow (especially when textures must be
+            //  resampled), and it happens every time the terrain is loaded.
+        using Res = TerrainMaterialTextures;
+        const bool loadDiffuse = !textureArrays[Res::Diffuse];
+        const bool loadNormals = !textureArrays[Res::Normal];
+        const bool loadRoughness = !textureArrays[Res::Roughness];
+        const auto layerCount = uint8(texFiles.size());
+
+        using namespace BufferUploads;
+        BufferDesc desc;
+        desc._type = BufferDesc::Type::Texture;
+        desc._bindFlags = BindFlag::ShaderResource;
+        desc._cpuAccess = 0;
+        desc._gpuAccess = GPUAccess::Read;
+        desc._allocationRules = 0;
+        XlCopyString(desc._name, "TerrainMaterialTextures");
+
+        if (loadDiffuse) {
+            desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
+                scaffold._diffuseDims[0], scaffold._diffuseDims[1], Metal::NativeFormat::BC1_UNORM_SRGB, 
+                (uint8)IntegerLog2(std::max(scaffold._diffuseDims[0], scaffold._diffuseDims[1]))-1, layerCount);
+            textureArrays[Res::Diffuse] = GetBufferUploads().Transaction_Immediate(desc);
+        }
+
+        intrusive_ptr<BufferUploads::ResourceLocator> bc5Dummy, r8Dummy;
+        if (loadNormals) {
+            desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
+                scaffold._normalDims[0], scaffold._normalDims[1], Metal::NativeFormat::BC5_UNORM, 
+                (uint8)IntegerLog2(std::max(scaffold._normalDims[0], scaffold._normalDims[1]))-1, layerCount);
+            textureArrays[Res::Normal] = GetBufferUploads().Transaction_Immediate(desc);
+
+            desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
+                scaffold._normalDims[0], scaffold._normalDims[1], Metal::NativeFormat::BC5_UNORM);
+            bc5Dummy = BC5Dummy(desc, 0x80, 0x80);
+        }
+
+        if (loadRoughness) {
+            desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
+                scaffold._paramDims[0], scaffold._paramDims[1], Metal::NativeFormat::R8_UNORM, 
+                (uint8)IntegerLog2(std::max(scaffold._paramDims[0], scaffold._paramDims[1]))-1, layerCount);
+            textureArrays[Res::Roughness] = GetBufferUploads().Transaction_Immediate(desc);
+
+            desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
+                scaffold._paramDims[0], scaffold._paramDims[1], Metal::NativeFormat::R8_UNORM);
+            r8Dummy = R8Dummy(desc, 0);
+        }
+
+        auto* diffuseTextureArray = textureArrays[Res::Diffuse]->GetUnderlying();
+        auto* normalTextureArray = textureArrays[Res::Normal]->GetUnderlying();
+        auto* roughnessTextureArray = textureArrays[Res::Roughness]->GetUnderlying();
+
+        for (unsigned index=0; index<texFiles.size(); ++index) {
+            const auto& files = texFiles[index];
+
+                // --- Diffuse --->
+            if (loadDiffuse) {
+                TRY {
+                    if (files._diffuse.get()[0]) {
+                        LoadTextureIntoArray(metalContext, diffuseTextureArray, files._diffuse.get(), index);
+                        RegisterFileDependency(depVal, files._diffuse.get());
+                    }
+                } CATCH (const ::Assets::Exceptions::InvalidAsset&) {}
+                CATCH_END
+            }
+
+                // --- Normals --->
+            if (loadNormals) {
+                bool fillInDummyNormals = true;
+                TRY {
+                    if (files._normals.get()[0]) {
+                        LoadTextureIntoArray(metalContext, normalTextureArray, files._normals.get(), index);
+                        RegisterFileDependency(depVal, files._normals.get());
+                        fillInDummyNormals = false;
+                    }
+                } CATCH (const ::Assets::Exceptions::InvalidAsset&) {}
+                CATCH_END
+
+                    // on exception or missing files, we should fill in default
+                if (fillInDummyNormals)
+                    CopyDummy(metalContext, normalTextureArray, bc5Dummy->GetUnderlying(), index, true);
+            }
+
+                // --- Specular params --->
+            if (loadRoughness) {
+                bool fillInBlackRoughness = true;
+                TRY {
+                    if (files._roughness.get()[0]) {
+                        LoadTextureIntoArray(metalContext, roughnessTextureArray, files._roughness.get(), index);
+                        RegisterFileDependency(depVal, files._roughness.get());
+                        fillInBlackRoughness = false;
+                    }
+                } CATCH (const ::Assets::Exceptions::InvalidAsset&) {
+                } CATCH_END
+
+                if (fillInBlackRoughness)
+                    CopyDummy(metalContext, roughnessTextureArray, r8Dummy->GetUnderlying(), index, false);
+            }
+        }
+    }
+
     TerrainMaterialTextures::TerrainMaterialTextures(
         Metal::DeviceContext& metalContext,
         const TerrainMaterialConfig& scaffold, 
@@ -432,83 +586,39 @@ namespace SceneEngine
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
             // build the atlas textures
-        using namespace BufferUploads;
-        BufferDesc desc;
-        desc._type = BufferDesc::Type::Texture;
-        desc._bindFlags = BindFlag::ShaderResource;
-        desc._cpuAccess = 0;
-        desc._gpuAccess = GPUAccess::Read;
-        desc._allocationRules = 0;
-        XlCopyString(desc._name, "TerrainMaterialTextures");
-
-        desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
-            scaffold._diffuseDims[0], scaffold._diffuseDims[1], Metal::NativeFormat::BC1_UNORM_SRGB, 
-            (uint8)IntegerLog2(std::max(scaffold._diffuseDims[0], scaffold._diffuseDims[1]))-1, uint8(atlasTextureNames.size()));
-        auto diffuseTextureArray = GetBufferUploads().Transaction_Immediate(desc);
-
-        desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
-            scaffold._normalDims[0], scaffold._normalDims[1], Metal::NativeFormat::BC5_UNORM, 
-            (uint8)IntegerLog2(std::max(scaffold._normalDims[0], scaffold._normalDims[1]))-1, uint8(atlasTextureNames.size()));
-        auto normalTextureArray = GetBufferUploads().Transaction_Immediate(desc);
-
-        desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
-            scaffold._normalDims[0], scaffold._normalDims[1], Metal::NativeFormat::BC5_UNORM);
-        auto bc5Dummy = BC5Dummy(desc, 0x80, 0x80);
-
-        desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
-            scaffold._paramDims[0], scaffold._paramDims[1], Metal::NativeFormat::R8_UNORM, 
-            (uint8)IntegerLog2(std::max(scaffold._paramDims[0], scaffold._paramDims[1]))-1, uint8(atlasTextureNames.size()));
-        auto roughnessTextureArray = GetBufferUploads().Transaction_Immediate(desc);
-
-        desc._textureDesc = BufferUploads::TextureDesc::Plain2D(
-            scaffold._paramDims[0], scaffold._paramDims[1], Metal::NativeFormat::R8_UNORM);
-        auto r8Dummy = R8Dummy(desc, 0);
-        
-
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
+            //  Normally these come precompiled from the intermediate store (see TerrainMaterialArrayCompiler).
+            //  If the compiler isn't registered (or the compile fails), we fall back to merging the
+            //  textures into the arrays here, one at a time.
         _validationCallback = std::make_shared<::Assets::DependencyValidation>();
 
-        for (auto i=atlasTextureNames.cbegin(); i!=atlasTextureNames.cend(); ++i) {
-            ResolvedTextureFiles texFiles(i->c_str(), scaffold._searchRules);
-
-                // --- Diffuse --->
-            TRY {
-                if (texFiles._diffuse.get()[0]) {
-                    LoadTextureIntoArray(metalContext, diffuseTextureArray->GetUnderlying(), texFiles._diffuse.get(), (unsigned)std::distance(atlasTextureNames.cbegin(), i));
-                    RegisterFileDependency(_validationCallback, texFiles._diffuse.get());
-                }
-            } CATCH (const ::Assets::Exceptions::InvalidAsset&) {}
-            CATCH_END
-
-                // --- Normals --->
-            bool fillInDummyNormals = true;
-            TRY {
-                if (texFiles._normals.get()[0]) {
-                    LoadTextureIntoArray(metalContext, normalTextureArray->GetUnderlying(), texFiles._normals.get(), (unsigned)std::distance(atlasTextureNames.cbegin(), i));
-                    RegisterFileDependency(_validationCallback, texFiles._normals.get());
-                    fillInDummyNormals = false;
-                }
-            } CATCH (const ::Assets::Exceptions::InvalidAsset&) {}
-            CATCH_END
-
-                // --- Specular params --->
-            bool fillInBlackRoughness = true;
-            auto index = (unsigned)std::distance(atlasTextureNames.cbegin(), i);
-            TRY {
-                if (texFiles._roughness.get()[0]) {
-                    LoadTextureIntoArray(metalContext, normalTextureArray->GetUnderlying(), texFiles._roughness.get(), index);
-                    RegisterFileDependency(_validationCallback, texFiles._roughness.get());
-                    fillInBlackRoughness = false;
-                }
-            } CATCH (const ::Assets::Exceptions::InvalidAsset&) {
-            } CATCH_END
+        std::vector<ResolvedTextureFiles> texFiles;
+        texFiles.reserve(atlasTextureNames.size());
+        for (const auto& n:atlasTextureNames)
+            texFiles.emplace_back(n.c_str(), scaffold._searchRules);
+
+        ResLocator textureArrays[ResourceCount];
+        const UInt2 arrayDims[] = { scaffold._diffuseDims, scaffold._normalDims, scaffold._paramDims };
+        auto& compilers = ::Assets::Services::GetAsyncMan().GetIntermediateCompilers();
+        if (!texFiles.empty() && compilers.HasCompiler(TerrainMaterialArrayCompiler::CompileProcessType)) {
+            for (unsigned r=0; r<ResourceCount; ++r) {
+                std::vector<::Assets::rstring> sourceFiles;
+                sourceFiles.reserve(texFiles.size());
+                for (const auto& t:texFiles)
+                    sourceFiles.push_back((r==Diffuse) ? t._diffuse.get() : ((r==Normal) ? t._normals.get() : t._roughness.get()));
+
+                TRY {
+                    textureArrays[r] = LoadCompiledArray(
+                        TerrainTextureArrayType::Enum(r), arrayDims[r], sourceFiles, _validationCallback);
+                } CATCH (const std::exception& e) {
+                    LogWarning << "Failed while loading compiled terrain texture array: " << e.what();
+                } CATCH_END
+            }
+        }
 
-                // on exception or missing files, we should fill in default
-            if (fillInDummyNormals)
-                CopyDummy(metalContext, normalTextureArray->GetUnderlying(), bc5Dummy->GetUnderlying(), index, true);
-            if (fillInBlackRoughness)
-                CopyDummy(metalContext, roughnessTextureArray->GetUnderlying(), r8Dummy->GetUnderlying(), index, false);
+        if (!textureArrays[Diffuse] || !textureArrays[Normal] || !textureArrays[Roughness]) {
+            LoadArraysAtRuntime(
+                metalContext, textureArrays,
+                scaffold, MakeIteratorRange(texFiles), _validationCallback);
         }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -521,15 +631,12 @@ namespace SceneEngine
                 texturingConstants.resize(sizeof(Float4) * 32 * 5, 0);
         #endif
 
-        _srv[Diffuse] = Metal::ShaderResourceView(diffuseTextureArray->GetUnderlying());
-        _srv[Normal] = Metal::ShaderResourceView(normalTextureArray->GetUnderlying());
-        _srv[Roughness] = Metal::ShaderResourceView(roughnessTextureArray->GetUnderlying());
+        for (unsigned r=0; r<ResourceCount; ++r) {
+            _srv[r] = Metal::ShaderResourceView(textureArrays[r]->GetUnderlying());
+            _textureArray[r] = std::move(textureArrays[r]);
+        }
         _texturingConstants = Metal::ConstantBuffer(AsPointer(texturingConstants.cbegin()), texturingConstants.size());
         _procTexContsBuffer = Metal::ConstantBuffer(AsPointer(procTextureConstants.cbegin()), procTextureConstants.size());
-
-        _textureArray[Diffuse] = std::move(diffuseTextureArray);
-        _textureArray[Normal] = std::move(normalTextureArray);
-        _textureArray[Roughness] = std::move(roughnessTextureArray);
     }
 
     TerrainMaterialTextures::~TerrainMaterialTextures() {}
@@ -0,0 +1,204 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TransientTargetPool.h"
+#include "../RenderCore/Metal/Format.h"
+#include "../Utility/MemoryUtils.h"
+#include <algorithm>
+
+namespace SceneEngine
+{
+    using namespace RenderCore;
+
+    class TransientTargetPool::PhysicalTarget
+    {
+    public:
+        BufferUploads::BufferDesc   _desc;
+        ResourcePtr     _resource;
+        size_t          _byteCount;
+        unsigned        _lastUsedFrame;
+
+            // pass ranges that are using this resource in the current frame
+        std::vector<std::pair<unsigned, unsigned>> _passRanges;
+
+        std::vector<std::pair<Metal::NativeFormat::Enum, Metal::RenderTargetView>>     _rtvs;
+        std::vector<std::pair<Metal::NativeFormat::Enum, Metal::DepthStencilView>>     _dsvs;
+        std::vector<std::pair<Metal::NativeFormat::Enum, Metal::ShaderResourceView>>   _srvs;
+
+        bool IsFree(unsigned frame, unsigned firstPass, unsigned lastPass) const
+        {
+            if (_lastUsedFrame != frame) return true;
+            for (const auto& r:_passRanges)
+                if (firstPass <= r.second && r.first <= lastPass) return false;
+            return true;
+        }
+    };
+
+    static bool IsCompatible(const BufferUploads::BufferDesc& lhs, const BufferUploads::BufferDesc& rhs)
+    {
+            //  The name doesn't matter here; any resource with the same
+            //  layout and usage can be shared
+        if (    lhs._type != rhs._type || lhs._bindFlags != rhs._bindFlags
+            ||  lhs._cpuAccess != rhs._cpuAccess || lhs._gpuAccess != rhs._gpuAccess
+            ||  lhs._allocationRules != rhs._allocationRules)
+            return false;
+
+        if (lhs._type == BufferUploads::BufferDesc::Type::Texture) {
+            const auto& l = lhs._textureDesc, &r = rhs._textureDesc;
+            return  l._width == r._width && l._height == r._height && l._depth == r._depth
+                &&  l._nativePixelFormat == r._nativePixelFormat && l._dimensionality == r._dimensionality
+                &&  l._mipCount == r._mipCount && l._arrayCount == r._arrayCount
+                &&  l._samples._sampleCount == r._samples._sampleCount
+                &&  l._samples._samplingQuality == r._samples._samplingQuality;
+        }
+
+        return  lhs._linearBufferDesc._sizeInBytes == rhs._linearBufferDesc._sizeInBytes
+            &&  lhs._linearBufferDesc._structureByteSize == rhs._linearBufferDesc._structureByteSize;
+    }
+
+    size_t  CalculateTargetByteCount(const BufferUploads::BufferDesc& desc)
+    {
+        if (desc._type != BufferUploads::BufferDesc::Type::Texture)
+            return desc._linearBufferDesc._sizeInBytes;
+
+            //  This is only an estimate -- the driver can add padding and
+            //  alignment, and compressed formats are rounded up to full blocks
+        const auto& t = desc._textureDesc;
+        size_t bitsPerPixel = Metal::BitsPerPixel(Metal::NativeFormat::Enum(t._nativePixelFormat));
+        size_t width = t._width, height = std::max(t._height, 1u), depth = std::max(t._depth, 1u);
+        size_t result = 0;
+        for (unsigned m=0; m<std::max(unsigned(t._mipCount), 1u); ++m) {
+            result += (width * height * depth * bitsPerPixel + 7) / 8;
+            width = std::max(width/2, size_t(1)); height = std::max(height/2, size_t(1)); depth = std::max(depth/2, size_t(1));
+        }
+        result *= std::max(unsigned(t._arrayCount), 1u);
+        if (t._dimensionality == BufferUploads::TextureDesc::Dimensionality::CubeMap) result *= 6;
+        result *= std::max(unsigned(t._samples._sampleCount), 1u);
+        return result;
+    }
+
+    void TransientTargetPool::BeginFrame()
+    {
+        ++_currentFrame;
+        _targets.clear();
+
+            //  Release resources that haven't been used recently.
+            //  Any target ids from previous frames are invalidated
+        _physical.erase(
+            std::remove_if(_physical.begin(), _physical.end(),
+                [this](const std::unique_ptr<PhysicalTarget>& p)
+                { return (_currentFrame - p->_lastUsedFrame) > _maxUnusedFrames; }),
+            _physical.end());
+    }
+
+    auto TransientTargetPool::Acquire(
+        const BufferUploads::BufferDesc& desc,
+        unsigned firstPass, unsigned lastPass) -> TargetId
+    {
+        assert(firstPass <= lastPass);
+
+            //  Look for a compatible resource that isn't used during this pass range.
+            //  Prefer resources that are already in use this frame (so other resources
+            //  become unused and can age out). Otherwise take the most recently used one.
+        PhysicalTarget* best = nullptr;
+        unsigned bestIndex = ~0u;
+        for (unsigned c=0; c<(unsigned)_physical.size(); ++c) {
+            auto& p = *_physical[c];
+            if (!IsCompatible(p._desc, desc) || !p.IsFree(_currentFrame, firstPass, lastPass)) continue;
+            if (!best || (_currentFrame - p._lastUsedFrame) < (_currentFrame - best->_lastUsedFrame)) {
+                best = &p;
+                bestIndex = c;
+            }
+        }
+
+        if (!best) {
+            auto newPhysical = std::make_unique<PhysicalTarget>();
+            newPhysical->_desc = desc;
+            newPhysical->_resource = _createFn ? _createFn(desc) : CreateResourceImmediate(desc);
+            newPhysical->_byteCount = CalculateTargetByteCount(desc);
+            newPhysical->_lastUsedFrame = _currentFrame - 1;
+            best = newPhysical.get();
+            bestIndex = (unsigned)_physical.size();
+            _physical.push_back(std::move(newPhysical));
+        }
+
+        if (best->_lastUsedFrame != _currentFrame) {
+            best->_passRanges.clear();
+            best->_lastUsedFrame = _currentFrame;
+        }
+        best->_passRanges.push_back(std::make_pair(firstPass, lastPass));
+
+        Target target;
+        target._physical = bestIndex;
+        target._byteCount = best->_byteCount;
+        _targets.push_back(target);
+        return TargetId(_targets.size()-1);
+    }
+
+    const ResourcePtr& TransientTargetPool::GetResource(TargetId target) const
+    {
+        assert(target < _targets.size());
+        return _physical[_targets[target]._physical]->_resource;
+    }
+
+    template<typename View>
+        static View FindOrCreateView(
+            std::vector<std::pair<Metal::NativeFormat::Enum, View>>& views,
+            const ResourcePtr& resource, Metal::NativeFormat::Enum format)
+        {
+            auto i = std::find_if(views.begin(), views.end(),
+                [format](const std::pair<Metal::NativeFormat::Enum, View>& v) { return v.first == format; });
+            if (i != views.end()) return i->second;
+
+            View newView(resource.get(), format);
+            views.push_back(std::make_pair(format, newView));
+            return std::move(newView);
+        }
+
+    Metal::RenderTargetView TransientTargetPool::GetRTV(TargetId target, Metal::NativeFormat::Enum format)
+    {
+        auto& p = *_physical[_targets[target]._physical];
+        return FindOrCreateView(p._rtvs, p._resource, format);
+    }
+
+    Metal::DepthStencilView TransientTargetPool::GetDSV(TargetId target, Metal::NativeFormat::Enum format)
+    {
+        auto& p = *_physical[_targets[target]._physical];
+        return FindOrCreateView(p._dsvs, p._resource, format);
+    }
+
+    Metal::ShaderResourceView TransientTargetPool::GetSRV(TargetId target, Metal::NativeFormat::Enum format)
+    {
+        auto& p = *_physical[_targets[target]._physical];
+        return FindOrCreateView(p._srvs, p._resource, format);
+    }
+
+    auto TransientTargetPool::GetMetrics() const -> Metrics
+    {
+        Metrics result;
+        XlZeroMemory(result);
+        result._targetCount = (unsigned)_targets.size();
+        for (const auto& t:_targets) result._targetBytes += t._byteCount;
+        for (const auto& p:_physical) {
+            ++result._pooledCount;
+            result._pooledBytes += p->_byteCount;
+            if (p->_lastUsedFrame == _currentFrame) {
+                ++result._physicalCount;
+                result._physicalBytes += p->_byteCount;
+            }
+        }
+        return result;
+    }
+
+    TransientTargetPool::TransientTargetPool(CreateFn&& createFn, unsigned maxUnusedFrames)
+    : _currentFrame(0)
+    , _maxUnusedFrames(maxUnusedFrames)
+    , _createFn(std::move(createFn))
+    {}
+
+    TransientTargetPool::~TransientTargetPool() {}
+}
+
@@ -0,0 +1,85 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "SceneEngineUtils.h"
+#include "../RenderCore/Metal/RenderTargetView.h"
+#include "../RenderCore/Metal/ShaderResource.h"
+#include "../BufferUploads/IBufferUploads.h"
+#include <vector>
+#include <functional>
+
+namespace SceneEngine
+{
+    /// <summary>Shares render targets between passes that aren't active at the same time</summary>
+    /// Passes acquire targets for a range of "pass" indices within a frame (the first and
+    /// last pass that will use the target). Physical resources are assigned as the targets
+    /// are acquired. A physical resource can be shared by any number of targets with the
+    /// same description, so long as their pass ranges don't overlap.
+    ///
+    /// Resources that haven't been used for a number of frames are released. So, for
+    /// example, after a resolution change the targets for the old resolution will
+    /// eventually be destroyed.
+    ///
+    /// For the best aliasing, acquire targets in the order of their first use.
+    ///
+    /// The assignment is done entirely on the CPU. The function that creates the physical
+    /// resources can be replaced (eg, to test the assignment without a device). Views are
+    /// only created on demand, and cached with the physical resource.
+    class TransientTargetPool
+    {
+    public:
+        typedef unsigned TargetId;
+        static const TargetId InvalidTarget = ~TargetId(0);
+
+        void        BeginFrame();
+        TargetId    Acquire(const BufferUploads::BufferDesc& desc, unsigned firstPass, unsigned lastPass);
+
+        const ResourcePtr& GetResource(TargetId target) const;
+        RenderCore::Metal::RenderTargetView     GetRTV(TargetId target, RenderCore::Metal::NativeFormat::Enum format = RenderCore::Metal::NativeFormat::Unknown);
+        RenderCore::Metal::DepthStencilView     GetDSV(TargetId target, RenderCore::Metal::NativeFormat::Enum format = RenderCore::Metal::NativeFormat::Unknown);
+        RenderCore::Metal::ShaderResourceView   GetSRV(TargetId target, RenderCore::Metal::NativeFormat::Enum format = RenderCore::Metal::NativeFormat::Unknown);
+
+        class Metrics
+        {
+        public:
+            unsigned    _targetCount;           // targets acquired this frame
+            unsigned    _physicalCount;         // physical resources used this frame
+            unsigned    _pooledCount;           // all physical resources held by the pool
+            size_t      _targetBytes;           // memory required if every target had its own resource
+            size_t      _physicalBytes;         // memory of the physical resources used this frame
+            size_t      _pooledBytes;           // memory of all physical resources held by the pool
+        };
+        Metrics     GetMetrics() const;
+
+        typedef std::function<ResourcePtr(const BufferUploads::BufferDesc&)> CreateFn;
+
+        TransientTargetPool(CreateFn&& createFn = CreateFn(), unsigned maxUnusedFrames = 16);
+        ~TransientTargetPool();
+
+        TransientTargetPool(const TransientTargetPool&) = delete;
+        TransientTargetPool& operator=(const TransientTargetPool&) = delete;
+
+    protected:
+        class PhysicalTarget;
+        class Target
+        {
+        public:
+            unsigned    _physical;
+            size_t      _byteCount;
+        };
+
+        std::vector<std::unique_ptr<PhysicalTarget>> _physical;
+        std::vector<Target> _targets;
+        unsigned    _currentFrame;
+        unsigned    _maxUnusedFrames;
+        CreateFn    _createFn;
+    };
+
+    size_t  CalculateTargetByteCount(const BufferUploads::BufferDesc& desc);
+}
+
@@ -40,7 +40,7 @@ namespace ShaderSourceParser
         return result;
     }
 
-    ShaderFragmentSignature     BuildShaderFragmentSignature(const char sourceCode[], size_t sourceCodeLength)
+    ShaderFragmentSignature     ParseShaderFragmentSignature(const char sourceCode[], size_t sourceCodeLength)
     {
         AntlrHelper::ParserRig psr(sourceCode, sourceCodeLength);
 
@@ -96,7 +96,7 @@ namespace ShaderSourceParser
                                     auto tokenType = GetType(GetToken(child));
                                     if (tokenType == DIRECTION_OUT) {
                                         parameter._direction = FunctionSignature::Parameter::Out;
-                                    } else if (tokenType == DIRECTION_OUT) {
+                                    } else if (tokenType == DIRECTION_IN_OUT) {
                                         parameter._direction = FunctionSignature::Parameter::In | FunctionSignature::Parameter::Out;
                                     } else if (tokenType == SEMANTIC) {
                                         if (child->getChildCount(child) >= 1) {
@@ -175,7 +175,7 @@ namespace ShaderSourceParser
                                                 //  look for a "SEMANTIC" node attached
                                                 //      if there are multiple, it's an error.. but just use the first valid
                                             for (unsigned w=1; w<nameNodeChildCount; ++w) {
-                                                auto partNode   = pANTLR3_BASE_TREE(nameNode->getChild(nameNode, n));
+                                                auto partNode   = pANTLR3_BASE_TREE(nameNode->getChild(nameNode, w));
                                                 auto token      = partNode->getToken(partNode);
                                                 auto tokenType  = token->getType(token);
                                                 if (tokenType == SEMANTIC) {
@@ -214,6 +214,14 @@ namespace ShaderSourceParser
         return result;
     }
 
+    ShaderFragmentSignature     BuildShaderFragmentSignature(const char sourceCode[], size_t sourceCodeLength)
+    {
+        ShaderFragmentSignature result;
+        if (TryScanShaderFragmentSignature(result, sourceCode, sourceCodeLength))
+            return result;
+        return ParseShaderFragmentSignature(sourceCode, sourceCodeLength);
+    }
+
         ////////////////////////////////////////////////////////////
 
     FunctionSignature::FunctionSignature() {}
@@ -74,6 +74,24 @@ namespace ShaderSourceParser
     };
 
 
+    /// <summary>Extracts the function & parameter struct signatures from shader source</summary>
+    /// This will first try the fast top-level scanner, and fall back to the full
+    /// antlr parse if the source contains anything the scanner doesn't understand.
+    /// Throws ShaderSourceParser::Exceptions::ParsingFailure on parse errors.
+    /// Prefer GetShaderFragmentSignature() (in SignatureCache.h) when the same
+    /// source might be requested multiple times.
     ShaderFragmentSignature     BuildShaderFragmentSignature(const char sourceCode[], size_t sourceCodeLength);
+
+    /// <summary>Builds the signature using the full antlr grammar</summary>
+    /// This is much slower than BuildShaderFragmentSignature(), but it validates
+    /// the entire file (including function bodies) and reports all parsing errors.
+    ShaderFragmentSignature     ParseShaderFragmentSignature(const char sourceCode[], size_t sourceCodeLength);
+
+    /// <summary>Builds the signature using only the fast top-level scanner</summary>
+    /// Returns false if the source contains constructs that the scanner can't handle.
+    /// In that case, "result" is unchanged.
+    bool TryScanShaderFragmentSignature(
+        ShaderFragmentSignature& result,
+        const char sourceCode[], size_t sourceCodeLength);
 }
 
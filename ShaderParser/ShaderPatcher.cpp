@@ -6,6 +6,7 @@
 
 #include "ShaderPatcher.h"
 #include "InterfaceSignature.h"
+#include "SignatureCache.h"
 #include "ParameterSignature.h"
 #include "../RenderCore/ShaderLangUtil.h"
 #include "../Core/Exceptions.h"
@@ -23,6 +24,9 @@
     // mustache templates stuff...
 #include "../Assets/AssetUtils.h"
 #include "../Assets/ConfigFileContainer.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/CompileAndAsyncManager.h"
+#include "../Assets/IntermediateAssets.h"
 #include "../Utility/Streams/StreamFormatter.h"
 #include "../Foreign/plustasche/template.hpp"
 
@@ -256,16 +260,16 @@ namespace ShaderPatcher
 		ShaderFragment(const ::Assets::ResChar fn[]);
 		~ShaderFragment();
 	private:
-		ShaderSourceParser::ShaderFragmentSignature _sig;
+		std::shared_ptr<const ShaderSourceParser::ShaderFragmentSignature> _sig;
 		::Assets::DepValPtr _depVal;
 	};
 
 	auto ShaderFragment::GetFunction(const char fnName[]) const -> const ShaderSourceParser::FunctionSignature*
 	{
 		auto i = std::find_if(
-			_sig._functions.cbegin(), _sig._functions.cend(), 
+			_sig->_functions.cbegin(), _sig->_functions.cend(), 
             [fnName](const ShaderSourceParser::FunctionSignature& signature) { return XlEqString(signature._name, fnName); });
-        if (i!=_sig._functions.cend())
+        if (i!=_sig->_functions.cend())
 			return AsPointer(i);
 		return nullptr;
 	}
@@ -273,9 +277,9 @@ namespace ShaderPatcher
 	auto ShaderFragment::GetParameterStruct(const char structName[]) const -> const ShaderSourceParser::ParameterStructSignature*
 	{
 		auto i = std::find_if(
-			_sig._parameterStructs.cbegin(), _sig._parameterStructs.cend(), 
+			_sig->_parameterStructs.cbegin(), _sig->_parameterStructs.cend(), 
             [structName](const ShaderSourceParser::ParameterStructSignature& signature) { return XlEqString(signature._name, structName); });
-        if (i!=_sig._parameterStructs.cend())
+        if (i!=_sig->_parameterStructs.cend())
 			return AsPointer(i);
 		return nullptr;
 	}
@@ -283,7 +287,8 @@ namespace ShaderPatcher
 	ShaderFragment::ShaderFragment(const ::Assets::ResChar fn[])
 	{
 		auto shaderFile = LoadSourceFile(fn);
-		_sig = ShaderSourceParser::BuildShaderFragmentSignature(shaderFile.c_str(), shaderFile.size());
+		_sig = ShaderSourceParser::GetShaderFragmentSignature(
+			MakeStringSection(shaderFile), &::Assets::Services::GetAsyncMan().GetIntermediateStore());
 		_depVal = std::make_shared<::Assets::DependencyValidation>();
 		::Assets::RegisterFileDependency(_depVal, fn);
 	}
@@ -521,12 +526,25 @@ namespace ShaderPatcher
 		std::sort(range.begin(), range.end());
 	}
 
+    using UpstreamIndex = std::vector<std::pair<uint32, uint32>>;
+
+    static UpstreamIndex BuildUpstreamIndex(const NodeGraph& graph)
+    {
+            // pairs of (downstream node, upstream node), sorted by downstream node
+        UpstreamIndex result;
+        result.reserve(graph.GetNodeConnections().size());
+        for (const auto& i:graph.GetNodeConnections())
+            result.push_back(std::make_pair(i.OutputNodeId(), i.InputNodeId()));
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
     static bool SortNodesFunction(  
         uint32                  node,
         std::vector<uint32>&    presorted, 
         std::vector<uint32>&    sorted, 
         std::vector<uint32>&    marks,
-        const NodeGraph&        graph)
+        const UpstreamIndex&    upstreamIndex)
     {
         if (std::find(presorted.begin(), presorted.end(), node) == presorted.end()) {
             return false;   // hit a cycle
@@ -538,14 +556,15 @@ namespace ShaderPatcher
         marks.push_back(node);
 
 		std::vector<uint32> upstream;
-		upstream.reserve(graph.GetNodeConnections().size());
-        for (const auto& i:graph.GetNodeConnections())
-            if (i.OutputNodeId() == node)
-				upstream.push_back(i.InputNodeId());
+        auto range = std::equal_range(
+            upstreamIndex.begin(), upstreamIndex.end(), std::make_pair(node, 0u),
+            [](const std::pair<uint32, uint32>& lhs, const std::pair<uint32, uint32>& rhs) { return lhs.first < rhs.first; });
+        for (auto i=range.first; i!=range.second; ++i)
+			upstream.push_back(i->second);
 
 		OrderNodes(MakeIteratorRange(upstream));
 		for (const auto& i2:upstream)
-			SortNodesFunction(i2, presorted, sorted, marks, graph);
+			SortNodesFunction(i2, presorted, sorted, marks, upstreamIndex);
 
         sorted.push_back(node);
         presorted.erase(std::find(presorted.begin(), presorted.end(), node));
@@ -650,14 +669,21 @@ namespace ShaderPatcher
             return ExpressionString{std::string(), std::string()};
     }
 
+    static bool MatchAngleBrackets(const std::string& input, std::string& inner)
+    {
+            // equivalent to std::regex_match with "<(.*)>" (but without constructing a regex for every query)
+        if (input.size() < 2 || input[0] != '<' || input[input.size()-1] != '>') return false;
+        inner = input.substr(1, input.size()-2);
+        return true;
+    }
+
     static ExpressionString QueryExpression(const NodeGraph& nodeGraph, const ConstantConnection& connection)
     {
             //  we have a "constant connection" value here. We either extract the name of 
             //  the varying parameter, or we interpret this as pure text...
-        std::regex filter("<(.*)>");
-        std::smatch matchResult;
-        if (std::regex_match(connection.Value(), matchResult, filter) && matchResult.size() > 1) {
-            return ExpressionString{matchResult[1].str(), std::string()};
+        std::string inner;
+        if (MatchAngleBrackets(connection.Value(), inner)) {
+            return ExpressionString{inner, std::string()};
         } else {
             return ExpressionString{connection.Value(), std::string()};
         }
@@ -665,24 +691,32 @@ namespace ShaderPatcher
 
     static ExpressionString QueryExpression(const NodeGraph& nodeGraph, const InputParameterConnection& connection)
     {
-        std::regex filter("<(.*)>");
-        std::smatch matchResult;
-        if (std::regex_match(connection.InputName(), matchResult, filter) && matchResult.size() > 1) {
-            return ExpressionString{matchResult[1].str(), std::string()};
+        std::string inner;
+        if (MatchAngleBrackets(connection.InputName(), inner)) {
+            return ExpressionString{inner, std::string()};
         } else {
             return ExpressionString{connection.InputName(), connection.InputType()._name};
         }
     }
 
-    static ExpressionString ParameterExpression(const NodeGraph& nodeGraph, uint32 nodeId, const std::string& parameterName)
+    static ExpressionString ParameterExpression(
+        const NodeGraph& nodeGraph, uint32 nodeId, const std::string& parameterName,
+        const MainFunctionInterface* interf = nullptr)
     {
         auto i = FindConnection(nodeGraph.GetNodeConnections(), nodeId, parameterName);
         if (i!=nodeGraph.GetNodeConnections().cend())
             return QueryExpression(nodeGraph, *i);
 
         auto ci = FindConnection(nodeGraph.GetConstantConnections(), nodeId, parameterName);
-        if (ci!=nodeGraph.GetConstantConnections().cend())
+        if (ci!=nodeGraph.GetConstantConnections().cend()) {
+                // constants that have become material parameters are referenced by name
+            if (interf) {
+                auto constantName = interf->GetConstantParameterName(*ci);
+                if (!constantName.empty())
+                    return ExpressionString{constantName, std::string()};
+            }
             return QueryExpression(nodeGraph, *ci);
+        }
 
         auto ti = FindConnection(nodeGraph.GetInputParameterConnections(), nodeId, parameterName);
         if (ti!=nodeGraph.GetInputParameterConnections().cend())
@@ -691,7 +725,7 @@ namespace ShaderPatcher
         return ExpressionString{std::string(), std::string()};
     }
 
-    static std::stringstream GenerateFunctionCall(const Node& node, const NodeGraph& nodeGraph, const NodeGraph& graphOfTemporaries)
+    static std::stringstream GenerateFunctionCall(const Node& node, const NodeGraph& nodeGraph, const MainFunctionInterface& interf)
     {
         auto splitName = SplitArchiveName(node.ArchiveName());
 
@@ -742,9 +776,9 @@ namespace ShaderPatcher
                 continue;
             }
 
-            auto expr = ParameterExpression(nodeGraph, node.NodeId(), p->_name);
+            auto expr = ParameterExpression(nodeGraph, node.NodeId(), p->_name, &interf);
             if (expr._expression.empty())
-                expr = ParameterExpression(graphOfTemporaries, node.NodeId(), p->_name);
+                expr = ParameterExpression(interf.GetGraphOfTemporaries(), node.NodeId(), p->_name);
 
             if (!expr._expression.empty()) {
                 WriteCastExpression(result, expr, p->_type);
@@ -764,7 +798,145 @@ namespace ShaderPatcher
         return std::move(result);
     }
 
-    static std::string GenerateMainFunctionBody(const NodeGraph& graph, const NodeGraph& graphOfTemporaries)
+        ///////////////////////////////////////////////////////////////
+
+    class GeneratorCache::Pimpl
+    {
+    public:
+        using NodeCode = std::vector<std::pair<uint64, std::string>>;
+        NodeCode _nodeCode;         // (from the previous generation)
+        NodeCode _nextNodeCode;
+        Metrics _metrics;
+
+        Pimpl() { XlZeroMemory(_metrics); }
+    };
+
+    auto GeneratorCache::GetMetrics() const -> Metrics { return _pimpl->_metrics; }
+
+    void GeneratorCache::Clear()
+    {
+        _pimpl->_nodeCode.clear();
+        _pimpl->_nextNodeCode.clear();
+        XlZeroMemory(_pimpl->_metrics);
+    }
+
+    GeneratorCache::GeneratorCache() { _pimpl = std::make_unique<Pimpl>(); }
+    GeneratorCache::~GeneratorCache() {}
+
+    template<typename Connection>
+        static std::vector<std::pair<uint32, const Connection*>> IndexByOutputNode(IteratorRange<const Connection*> connections)
+    {
+        std::vector<std::pair<uint32, const Connection*>> result;
+        result.reserve(connections.size());
+        for (const auto& c:connections)
+            result.push_back(std::make_pair(c.OutputNodeId(), &c));
+        std::stable_sort(result.begin(), result.end(), 
+            [](const std::pair<uint32, const Connection*>& lhs, const std::pair<uint32, const Connection*>& rhs) { return lhs.first < rhs.first; });
+        return result;
+    }
+
+    template<typename Connection>
+        static IteratorRange<const std::pair<uint32, const Connection*>*> ConnectionsInto(
+            const std::vector<std::pair<uint32, const Connection*>>& index, uint32 nodeId)
+    {
+        auto range = std::equal_range(
+            index.begin(), index.end(), std::make_pair(nodeId, (const Connection*)nullptr),
+            [](const std::pair<uint32, const Connection*>& lhs, const std::pair<uint32, const Connection*>& rhs) { return lhs.first < rhs.first; });
+        return MakeIteratorRange(AsPointer(range.first), AsPointer(range.second));
+    }
+
+    static uint64 HashSignature(const ShaderSourceParser::FunctionSignature& sig, uint64 seed)
+    {
+        auto result = Hash64(sig._returnType, Hash64(sig._name, seed));
+        for (const auto& p:sig._parameters) {
+            result = Hash64(p._name, Hash64(p._type, result));
+            result = HashCombine(result, p._direction);
+        }
+        return result;
+    }
+
+        //  Everything that can effect the code generated for a single node in GenerateFunctionCall.
+        //  That is: the node's fragment function, and the connections into the node (including
+        //  the type and fragment function of any node connected to it)
+    class NodeCodeKeyBuilder
+    {
+    public:
+        uint64 MakeKey(const Node& node)
+        {
+            auto key = Hash64(node.ArchiveName(), HashCombine(node.NodeId(), 0));
+            key = HashSignature(GetSignature(node.ArchiveName()), key);
+
+            for (const auto& c:ConnectionsInto(_nodeConnections, node.NodeId())) {
+                key = Hash64(c.second->OutputParameterName(), key);
+                key = Hash64(c.second->InputParameterName(), HashCombine(key, c.second->InputNodeId()));
+                key = Hash64(c.second->InputType()._name, key);
+                auto* inputNode = FindNode(c.second->InputNodeId());
+                if (inputNode) {
+                    key = Hash64(inputNode->ArchiveName(), HashCombine(key, inputNode->GetType()));
+                    if (inputNode->GetType() == Node::Type::Procedure)
+                        key = HashSignature(GetSignature(inputNode->ArchiveName()), key);
+                }
+            }
+
+            for (const auto& c:ConnectionsInto(_constantConnections, node.NodeId())) {
+                key = Hash64(c.second->OutputParameterName(), key);
+                auto parameterName = _interf->GetConstantParameterName(*c.second);
+                key = Hash64(parameterName.empty() ? c.second->Value() : parameterName, key);
+            }
+
+            for (const auto& c:ConnectionsInto(_inputParameterConnections, node.NodeId())) {
+                key = Hash64(c.second->OutputParameterName(), key);
+                key = Hash64(c.second->InputName(), Hash64(c.second->InputType()._name, key));
+            }
+
+            for (const auto& c:ConnectionsInto(_temporaryConnections, node.NodeId()))
+                key = Hash64(c.second->Value(), Hash64(c.second->OutputParameterName(), key));
+
+            return key;
+        }
+
+        const Node* FindNode(uint32 nodeId) const
+        {
+            auto i = std::lower_bound(
+                _nodes.begin(), _nodes.end(), nodeId, 
+                [](const Node* lhs, uint32 rhs) { return lhs->NodeId() < rhs; });
+            return (i != _nodes.end() && (*i)->NodeId() == nodeId) ? *i : nullptr;
+        }
+
+        NodeCodeKeyBuilder(const NodeGraph& graph, const MainFunctionInterface& interf)
+        : _interf(&interf)
+        {
+            _nodes.reserve(graph.GetNodes().size());
+            for (const auto& n:graph.GetNodes()) _nodes.push_back(&n);
+            std::stable_sort(_nodes.begin(), _nodes.end(), [](const Node* lhs, const Node* rhs) { return lhs->NodeId() < rhs->NodeId(); });
+
+            _nodeConnections = IndexByOutputNode(graph.GetNodeConnections());
+            _constantConnections = IndexByOutputNode(graph.GetConstantConnections());
+            _inputParameterConnections = IndexByOutputNode(graph.GetInputParameterConnections());
+            _temporaryConnections = IndexByOutputNode(interf.GetGraphOfTemporaries().GetConstantConnections());
+        }
+
+    private:
+        const MainFunctionInterface* _interf;
+        std::vector<const Node*> _nodes;
+        std::vector<std::pair<uint32, const NodeConnection*>> _nodeConnections;
+        std::vector<std::pair<uint32, const ConstantConnection*>> _constantConnections;
+        std::vector<std::pair<uint32, const InputParameterConnection*>> _inputParameterConnections;
+        std::vector<std::pair<uint32, const ConstantConnection*>> _temporaryConnections;
+        std::vector<std::pair<uint64, const ShaderSourceParser::FunctionSignature*>> _signatures;
+
+        const ShaderSourceParser::FunctionSignature& GetSignature(const std::string& archiveName)
+        {
+                // each fragment function is looked up only once per generation
+            auto hash = Hash64(archiveName);
+            auto i = LowerBound(_signatures, hash);
+            if (i == _signatures.end() || i->first != hash)
+                i = _signatures.insert(i, std::make_pair(hash, &LoadFunctionSignature(SplitArchiveName(archiveName))));
+            return *i->second;
+        }
+    };
+
+    static std::string GenerateMainFunctionBody(const NodeGraph& graph, const MainFunctionInterface& interf, GeneratorCache::Pimpl* cache)
     {
         std::stringstream result;
 
@@ -816,13 +988,14 @@ namespace ShaderPatcher
 
 		OrderNodes(MakeIteratorRange(presortedNodes));
 
+        auto upstreamIndex = BuildUpstreamIndex(graph);
         bool acyclic = true;
         while (!presortedNodes.empty()) {
             std::vector<uint32> temporaryMarks;
             bool sortReturn = SortNodesFunction(
                 presortedNodes[0],
                 presortedNodes, sortedNodes,
-                temporaryMarks, graph);
+                temporaryMarks, upstreamIndex);
 
             if (!sortReturn) {
                 acyclic = false;
@@ -839,16 +1012,48 @@ namespace ShaderPatcher
             result << "// Warning! found a cycle in the graph of nodes. Result will be incomplete!" << std::endl;
         }
 
-        for (auto i=sortedNodes.cbegin(); i!=sortedNodes.cend(); ++i) {
-            auto i2 = std::find_if( graph.GetNodes().cbegin(), 
-                                    graph.GetNodes().cend(), [i](const Node& n) { return n.NodeId() == *i; } );
-            if (i2 != graph.GetNodes().cend()) {
-                if (i2->GetType() == Node::Type::Procedure) {
-                    result << GenerateFunctionCall(*i2, graph, graphOfTemporaries).str();
+        if (!cache) {
+            for (auto i=sortedNodes.cbegin(); i!=sortedNodes.cend(); ++i) {
+                auto i2 = std::find_if( graph.GetNodes().cbegin(), 
+                                        graph.GetNodes().cend(), [i](const Node& n) { return n.NodeId() == *i; } );
+                if (i2 != graph.GetNodes().cend()) {
+                    if (i2->GetType() == Node::Type::Procedure) {
+                        result << GenerateFunctionCall(*i2, graph, interf).str();
+                    }
                 }
             }
+            return result.str();
         }
 
+            //  With a cache, we can reuse the code generated for any node whose key
+            //  hasn't changed since the last generation
+        NodeCodeKeyBuilder keyBuilder(graph, interf);
+        cache->_nextNodeCode.clear();
+        cache->_nextNodeCode.reserve(sortedNodes.size());
+        for (auto i=sortedNodes.cbegin(); i!=sortedNodes.cend(); ++i) {
+            auto* node = keyBuilder.FindNode(*i);
+            if (!node || node->GetType() != Node::Type::Procedure) continue;
+
+            auto key = keyBuilder.MakeKey(*node);
+            auto existing = LowerBound(cache->_nodeCode, key);
+            if (existing != cache->_nodeCode.end() && existing->first == key) {
+                ++cache->_metrics._nodeHits;
+                result << existing->second;
+                cache->_nextNodeCode.push_back(*existing);
+            } else {
+                ++cache->_metrics._nodeMisses;
+                auto code = GenerateFunctionCall(*node, graph, interf).str();
+                result << code;
+                cache->_nextNodeCode.push_back(std::make_pair(key, std::move(code)));
+            }
+        }
+
+            // only the code used in this generation is retained
+        std::sort(cache->_nextNodeCode.begin(), cache->_nextNodeCode.end(), 
+            [](const std::pair<uint64, std::string>& lhs, const std::pair<uint64, std::string>& rhs) { return lhs.first < rhs.first; });
+        std::swap(cache->_nodeCode, cache->_nextNodeCode);
+        cache->_nextNodeCode.clear();
+
         return result.str();
     }
 
@@ -1003,6 +1208,14 @@ namespace ShaderPatcher
         return i->second;
     }
 
+    std::string MainFunctionInterface::GetConstantParameterName(const ConstantConnection& c) const
+    {
+        auto i = LowerBound(_constantParameterNames, (const NodeBaseConnection*)&c);
+        if (i == _constantParameterNames.end() || i->first != &c)
+            return std::string();
+        return i->second;
+    }
+
     static bool CanBeStoredInCBuffer(const StringSection<char> type)
     {
         // HLSL keywords are not case sensitive. We could assume that
@@ -1067,7 +1280,71 @@ namespace ShaderPatcher
 	    }
     }
 
-    MainFunctionInterface::MainFunctionInterface(const NodeGraph& graph)
+    static bool AsParameterDefault(const std::string& value, unsigned elementCount, std::string& defaultValue)
+    {
+            //  Only simple numeric constants can become parameters. We accept a single literal
+            //  (for scalar types) or a constructor with one literal for each element
+            //  (eg, "float3(1, 0, 0)"). The default value is written in the form expected
+            //  by the cb layout parser.
+        auto begin = value.begin(), end = value.end();
+        while (begin != end && XlIsSpace(*begin)) ++begin;
+        while (end != begin && XlIsSpace(*(end-1))) --end;
+        if (begin == end) return false;
+
+        auto open = std::find(begin, end, '(');
+        bool isConstructor = open != end;
+        if (isConstructor) {
+            if (open == begin || *(end-1) != ')') return false;
+            for (auto c=begin; c!=open; ++c)
+                if (!XlIsAlnum(*c) && *c != '_') return false;
+            begin = open+1; --end;
+        }
+
+        unsigned elements = 1;
+        bool hasDigit = false;
+        for (auto c=begin; c!=end; ++c) {
+            if (XlIsDigit(*c)) { hasDigit = true; continue; }
+            if (*c == ',' && isConstructor) { ++elements; continue; }
+            if (    *c == '.' || *c == '-' || *c == '+' || *c == 'e' || *c == 'E' 
+                ||  *c == 'f' || *c == 'F' || *c == 'h' || *c == 'H' || XlIsSpace(*c)) continue;
+            return false;
+        }
+        if (!hasDigit || elements != elementCount) return false;
+
+        defaultValue = isConstructor ? ("{" + std::string(begin, end) + "}") : std::string(begin, end);
+        return true;
+    }
+
+    static bool IsParameterisableConstant(
+        const NodeGraph& graph, const ConstantConnection& connection,
+        std::string& type, std::string& defaultValue)
+    {
+        auto* destinationNode = graph.GetNode(connection.OutputNodeId());
+        if (!destinationNode || destinationNode->GetType() != Node::Type::Procedure) return false;
+
+        const auto& sig = LoadFunctionSignature(SplitArchiveName(destinationNode->ArchiveName()));
+        auto p = std::find_if(sig._parameters.cbegin(), sig._parameters.cend(), 
+            [&connection](const ShaderSourceParser::FunctionSignature::Parameter&p)
+                { return p._name == connection.OutputParameterName(); });
+        if (p == sig._parameters.cend() || !(p->_direction & ShaderSourceParser::FunctionSignature::Parameter::In)) 
+            return false;
+
+        auto typeDesc = RenderCore::ShaderLangTypeNameAsTypeDesc(MakeStringSection(p->_type));
+        if (typeDesc._type == ImpliedTyping::TypeCat::Void || !CanBeStoredInCBuffer(MakeStringSection(p->_type)))
+            return false;
+
+        if (!AsParameterDefault(connection.Value(), typeDesc._arrayCount, defaultValue))
+            return false;
+        type = p->_type;
+        return true;
+    }
+
+    static std::string ConstantParameterName(const ConstantConnection& connection)
+    {
+        return std::string("Constant_") + AsString(connection.OutputNodeId()) + "_" + connection.OutputParameterName();
+    }
+
+    MainFunctionInterface::MainFunctionInterface(const NodeGraph& graph, bool constantsAsParameters)
     {
             //
             //      Look for inputs to the graph that aren't
@@ -1188,11 +1465,105 @@ namespace ShaderPatcher
             }
         }
 
+            //
+            //      Numeric constants become material parameters when requested.
+            //      The code generated doesn't depend on the values, so changing
+            //      a value doesn't require a recompile
+            //
+        if (constantsAsParameters) {
+            for (const auto& i:graph.GetConstantConnections()) {
+                std::string type, defaultValue;
+                if (!IsParameterisableConstant(graph, i, type, defaultValue)) continue;
+
+                auto name = ConstantParameterName(i);
+                _constantParameterNames.insert(
+                    LowerBound(_constantParameterNames, (const NodeBaseConnection*)&i), 
+                    std::make_pair(&i, name));
+                AddWithExistingCheck(_globalParameters, MainFunctionParameter(type, name, std::string(), std::string(), defaultValue));
+            }
+        }
+
         BuildMainFunctionOutputParameters(graph);
     }
 
     MainFunctionInterface::~MainFunctionInterface() {}
 
+        ///////////////////////////////////////////////////////////////
+
+    template<typename Connection, typename KeyFn>
+        static std::vector<std::pair<std::string, const Connection*>> SortedConnections(
+            IteratorRange<const Connection*> connections, KeyFn keyFn)
+    {
+        std::vector<std::pair<std::string, const Connection*>> result;
+        result.reserve(connections.size());
+        for (const auto& c:connections)
+            result.push_back(std::make_pair(keyFn(c), &c));
+        std::stable_sort(result.begin(), result.end(), 
+            [](const std::pair<std::string, const Connection*>& lhs, const std::pair<std::string, const Connection*>& rhs) { return lhs.first < rhs.first; });
+        return result;
+    }
+
+    GraphEdit::Enum ClassifyGraphEdit(const NodeGraph& before, const NodeGraph& after, bool constantsAsParameters)
+    {
+            //  Compare the structure of the graphs, ignoring the order of nodes and connections.
+            //  If the only differences are in values that become material parameters, then
+            //  the generated code is unchanged, and only a parameter update is required.
+        if (before.GetName() != after.GetName()
+            || before.GetNodes().size() != after.GetNodes().size()
+            || before.GetNodeConnections().size() != after.GetNodeConnections().size()
+            || before.GetConstantConnections().size() != after.GetConstantConnections().size()
+            || before.GetInputParameterConnections().size() != after.GetInputParameterConnections().size())
+            return GraphEdit::Recompile;
+
+        auto nodeKey = [](const Node& n) { return AsString(n.NodeId()) + ":" + AsString(uint32(n.GetType())) + ":" + n.ArchiveName(); };
+        auto n0 = SortedConnections(before.GetNodes(), nodeKey), n1 = SortedConnections(after.GetNodes(), nodeKey);
+        for (size_t c=0; c<n0.size(); ++c)
+            if (n0[c].first != n1[c].first) return GraphEdit::Recompile;
+
+        auto connectionKey = [](const NodeConnection& c) 
+            { return AsString(c.OutputNodeId()) + ":" + c.OutputParameterName() + ":" + AsString(c.InputNodeId()) + ":" + c.InputParameterName() + ":" + c.InputType()._name; };
+        auto c0 = SortedConnections(before.GetNodeConnections(), connectionKey), c1 = SortedConnections(after.GetNodeConnections(), connectionKey);
+        for (size_t c=0; c<c0.size(); ++c)
+            if (c0[c].first != c1[c].first) return GraphEdit::Recompile;
+
+        auto result = GraphEdit::None;
+
+            // input parameters (including the default values, which are only parameter changes for cbuffer globals)
+        auto inputKey = [](const InputParameterConnection& c) 
+            { return AsString(c.OutputNodeId()) + ":" + c.OutputParameterName() + ":" + c.InputName() + ":" + c.InputType()._name + ":" + c.InputSemantic(); };
+        auto i0 = SortedConnections(before.GetInputParameterConnections(), inputKey), i1 = SortedConnections(after.GetInputParameterConnections(), inputKey);
+        for (size_t c=0; c<i0.size(); ++c) {
+            if (i0[c].first != i1[c].first) return GraphEdit::Recompile;
+            if (i0[c].second->Default() != i1[c].second->Default()) {
+                std::string inner;
+                bool isCBufferGlobal = 
+                        i0[c].second->InputSemantic().empty()
+                    && !MatchAngleBrackets(i0[c].second->InputName(), inner)
+                    &&  CanBeStoredInCBuffer(MakeStringSection(i0[c].second->InputType()._name));
+                if (!isCBufferGlobal) return GraphEdit::Recompile;
+                result = GraphEdit::ParameterUpdate;
+            }
+        }
+
+            // constants
+        auto constantKey = [](const ConstantConnection& c) { return AsString(c.OutputNodeId()) + ":" + c.OutputParameterName(); };
+        auto k0 = SortedConnections(before.GetConstantConnections(), constantKey), k1 = SortedConnections(after.GetConstantConnections(), constantKey);
+        for (size_t c=0; c<k0.size(); ++c) {
+            if (k0[c].first != k1[c].first) return GraphEdit::Recompile;
+            if (k0[c].second->Value() == k1[c].second->Value()) continue;
+            if (!constantsAsParameters) return GraphEdit::Recompile;
+
+            std::string type0, type1, default0, default1;
+            if (    !IsParameterisableConstant(before, *k0[c].second, type0, default0)
+                ||  !IsParameterisableConstant(after, *k1[c].second, type1, default1)
+                ||  type0 != type1)
+                return GraphEdit::Recompile;
+            result = GraphEdit::ParameterUpdate;
+        }
+
+        return result;
+    }
+
     template<typename Connection>
         static void FillDirectOutputParameters(
             std::stringstream& result,
@@ -1227,7 +1598,7 @@ namespace ShaderPatcher
 
     static void MaybeComma(std::stringstream& stream) { if (stream.tellp() != std::stringstream::pos_type(0)) stream << ", "; }
 
-    std::string GenerateShaderBody(const NodeGraph& graph, const MainFunctionInterface& interf)
+    std::string GenerateShaderBody(const NodeGraph& graph, const MainFunctionInterface& interf, GeneratorCache* cache)
     {
         std::stringstream mainFunctionDeclParameters;
 
@@ -1281,7 +1652,7 @@ namespace ShaderPatcher
 
         result << "void " << graph.GetName() << "(" << mainFunctionDeclParameters.str() << ")" << std::endl;
         result << "{" << std::endl;
-        result << GenerateMainFunctionBody(graph, interf.GetGraphOfTemporaries());
+        result << GenerateMainFunctionBody(graph, interf, cache ? cache->_pimpl.get() : nullptr);
 
         FillDirectOutputParameters(result, graph, graph.GetNodeConnections(), interf);
         FillDirectOutputParameters(result, graph, graph.GetConstantConnections(), interf);
@@ -1311,7 +1682,7 @@ namespace ShaderPatcher
         ParameterMachine();
         ~ParameterMachine();
     private:
-        ShaderSourceParser::ShaderFragmentSignature _systemHeader;
+        std::shared_ptr<const ShaderSourceParser::ShaderFragmentSignature> _systemHeader;
     };
 
     auto ParameterMachine::GetBuildInterpolator(const MainFunctionParameter& param) const
@@ -1319,27 +1690,27 @@ namespace ShaderPatcher
     {
         std::string searchName = "BuildInterpolator_" + param._semantic;
         auto i = std::find_if(
-            _systemHeader._functions.cbegin(), 
-            _systemHeader._functions.cend(),
+            _systemHeader->_functions.cbegin(), 
+            _systemHeader->_functions.cend(),
             [searchName](const ShaderSourceParser::FunctionSignature& sig) { return sig._name == searchName; });
 
-        if (i == _systemHeader._functions.cend()) {
+        if (i == _systemHeader->_functions.cend()) {
             searchName = "BuildInterpolator_" + param._name;
             i = std::find_if(
-                _systemHeader._functions.cbegin(), 
-                _systemHeader._functions.cend(),
+                _systemHeader->_functions.cbegin(), 
+                _systemHeader->_functions.cend(),
                 [searchName](const ShaderSourceParser::FunctionSignature& sig) { return sig._name == searchName; });
         }
 
-        if (i == _systemHeader._functions.cend()) {
+        if (i == _systemHeader->_functions.cend()) {
             searchName = "BuildInterpolator_" + param._type;
             i = std::find_if(
-                _systemHeader._functions.cbegin(), 
-                _systemHeader._functions.cend(),
+                _systemHeader->_functions.cbegin(), 
+                _systemHeader->_functions.cend(),
                 [searchName](const ShaderSourceParser::FunctionSignature& sig) { return sig._name == searchName; });
         }
 
-        if (i != _systemHeader._functions.cend()) {
+        if (i != _systemHeader->_functions.cend()) {
             VaryingParamsFlags::BitField flags = 0;
             if (!i->_returnSemantic.empty()) {
                     // using regex, convert the semantic value into a series of flags...
@@ -1361,9 +1732,9 @@ namespace ShaderPatcher
     {
         std::string searchName = "BuildSystem_" + param._type;
         auto i = std::find_if(
-            _systemHeader._functions.cbegin(), _systemHeader._functions.cend(),
+            _systemHeader->_functions.cbegin(), _systemHeader->_functions.cend(),
             [searchName](const ShaderSourceParser::FunctionSignature& sig) { return sig._name == searchName; });
-        if (i != _systemHeader._functions.cend())
+        if (i != _systemHeader->_functions.cend())
             return i->_name;
         return std::string();
     }
@@ -1371,8 +1742,7 @@ namespace ShaderPatcher
     ParameterMachine::ParameterMachine()
     {
         auto buildInterpolatorsSource = LoadSourceFile("game/xleres/System/BuildInterpolators.h");
-        _systemHeader = ShaderSourceParser::BuildShaderFragmentSignature(
-            AsPointer(buildInterpolatorsSource.begin()), buildInterpolatorsSource.size());
+        _systemHeader = ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(buildInterpolatorsSource));
     }
 
     ParameterMachine::~ParameterMachine() {}
@@ -1734,6 +2104,68 @@ namespace ShaderPatcher
         return result.str();
     }
 
+    std::string GenerateMaterialCBLayout(const MainFunctionInterface& interf)
+    {
+        std::stringstream str;
+            // Input parameters that can be stored in a cbuffer become
+            // part of our cblayout
+        auto globalParams = interf.GetGlobalParameters();
+        for (unsigned c=0; c<globalParams.size(); ++c) {
+            if (interf.IsCBufferGlobal(c)) {
+                const auto& p = globalParams[c];
+                str << p._type << " " << p._name;
+                if (!p._default.empty())
+                    str << " = " << p._default;
+                str << ";" << std::endl;
+            }
+        }
+        return str.str();
+    }
+
+    static bool SamePreviewOptions(const PreviewOptions& lhs, const PreviewOptions& rhs)
+    {
+        return lhs._type == rhs._type
+            && lhs._outputToVisualize == rhs._outputToVisualize
+            && lhs._variableRestrictions == rhs._variableRestrictions;
+    }
+
+    auto PreviewShaderGenerator::Generate(NodeGraph&& graph, const PreviewOptions& options) -> Result
+    {
+        Result result;
+        result._edit = GraphEdit::Recompile;
+        if (_hasLast && SamePreviewOptions(_lastOptions, options))
+            result._edit = ClassifyGraphEdit(_lastGraph, graph, true);
+
+        if (result._edit == GraphEdit::Recompile) {
+            MainFunctionInterface interf(graph, true);
+            result._shaderText = 
+                    GenerateShaderHeader(graph) 
+                +   GenerateShaderBody(graph, interf, _cache) 
+                +   GenerateStructureForPreview(graph, interf, options);
+            result._cbLayout = GenerateMaterialCBLayout(interf);
+        } else {
+                //  The generated code is unchanged; only the defaults in the cbuffer
+                //  layout can differ
+            result._shaderText = _lastShaderText;
+            if (result._edit == GraphEdit::ParameterUpdate) {
+                MainFunctionInterface interf(graph, true);
+                result._cbLayout = GenerateMaterialCBLayout(interf);
+            } else
+                result._cbLayout = _lastCBLayout;
+        }
+
+        _lastGraph = std::move(graph);
+        _lastOptions = options;
+        _lastShaderText = result._shaderText;
+        _lastCBLayout = result._cbLayout;
+        _hasLast = true;
+        return std::move(result);
+    }
+
+    PreviewShaderGenerator::PreviewShaderGenerator(GeneratorCache* cache) 
+    : _hasLast(false), _cache(cache) {}
+    PreviewShaderGenerator::~PreviewShaderGenerator() {}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 	static std::string GetTechniqueTemplate(const char templateName[])
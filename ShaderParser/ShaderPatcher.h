@@ -10,6 +10,7 @@
 #include "../Core/Types.h"
 #include <string>
 #include <vector>
+#include <memory>
 
 namespace ShaderPatcher 
 {
@@ -219,22 +220,70 @@ namespace ShaderPatcher
         auto GetGlobalParameters() const -> IteratorRange<const MainFunctionParameter*>     { return MakeIteratorRange(_globalParameters); }
         const NodeGraph& GetGraphOfTemporaries() const { return _graphOfTemporaries; }
         std::string GetOutputParameterName(const NodeBaseConnection& c) const;
+        std::string GetConstantParameterName(const ConstantConnection& c) const;
         bool IsCBufferGlobal(unsigned c) const;
 
-        MainFunctionInterface(const NodeGraph& graph);
+            /// <param name="constantsAsParameters">When true, numeric constants connected to
+            /// procedure nodes become material parameters (with the constant as the default value)
+            /// rather than literals in the shader code. Changing the value of one of those constants
+            /// then only requires a parameter update, not a recompile</param>
+        MainFunctionInterface(const NodeGraph& graph, bool constantsAsParameters = false);
         ~MainFunctionInterface();
     private:
         std::vector<MainFunctionParameter> _inputParameters;
         std::vector<MainFunctionParameter> _outputParameters;
         std::vector<MainFunctionParameter> _globalParameters;
         std::vector<std::pair<const NodeBaseConnection*, std::string>> _outputParameterNames;
+        std::vector<std::pair<const NodeBaseConnection*, std::string>> _constantParameterNames;
         NodeGraph _graphOfTemporaries;
 
         void BuildMainFunctionOutputParameters(const NodeGraph& graph);
     };
 
+        ///////////////////////////////////////////////////////////////
+
+    /// <summary>Memoises the code generated for each node between calls to GenerateShaderBody</summary>
+    /// The code for a node is keyed by the signature of its fragment function and the connections
+    /// into the node. When only part of a graph changes, the code for the other nodes is reused.
+    /// Entries not used by the most recent generation are released. Not thread safe.
+    class GeneratorCache
+    {
+    public:
+        class Metrics
+        {
+        public:
+            unsigned _nodeHits;
+            unsigned _nodeMisses;
+        };
+        Metrics GetMetrics() const;
+        void Clear();
+
+        GeneratorCache();
+        ~GeneratorCache();
+
+        class Pimpl;
+    private:
+        std::unique_ptr<Pimpl> _pimpl;
+        friend std::string GenerateShaderBody(const NodeGraph&, const MainFunctionInterface&, GeneratorCache*);
+    };
+
     std::string GenerateShaderHeader(const NodeGraph& graph);
-    std::string GenerateShaderBody(const NodeGraph& graph, const MainFunctionInterface& interf);
+    std::string GenerateShaderBody(const NodeGraph& graph, const MainFunctionInterface& interf, GeneratorCache* cache = nullptr);
+
+    struct GraphEdit
+    {
+        enum Enum 
+        {
+            None,               ///< graphs generate the same code and parameters
+            ParameterUpdate,    ///< only material parameter values have changed
+            Recompile           ///< generated code has changed
+        };
+    };
+
+    /// <summary>Classifies the difference between two versions of a graph</summary>
+    /// Assumes both graphs are generated with the same "constantsAsParameters" setting
+    /// (see MainFunctionInterface).
+    GraphEdit::Enum ClassifyGraphEdit(const NodeGraph& before, const NodeGraph& after, bool constantsAsParameters);
 
     struct PreviewOptions
     {
@@ -251,6 +300,39 @@ namespace ShaderPatcher
         const MainFunctionInterface& interf, 
         const PreviewOptions& previewOptions = { PreviewOptions::Type::Object, std::string(), PreviewOptions::VariableRestrictions() });
 
+    std::string GenerateMaterialCBLayout(const MainFunctionInterface& interf);
+
+    /// <summary>Generates the preview shader for a single preview, across edits to the graph</summary>
+    /// The graph from the previous call is retained and compared to the new graph with
+    /// ClassifyGraphEdit (constants become material parameters). When only parameter values
+    /// have changed, the previous shader text is returned as is, so the client can keep its
+    /// compiled shaders and just apply the new cbuffer layout. Not thread safe.
+    class PreviewShaderGenerator
+    {
+    public:
+        class Result
+        {
+        public:
+            std::string _shaderText;
+            std::string _cbLayout;
+            GraphEdit::Enum _edit;
+        };
+        Result Generate(NodeGraph&& graph, const PreviewOptions& options);
+
+        PreviewShaderGenerator(GeneratorCache* cache = nullptr);
+        ~PreviewShaderGenerator();
+
+        PreviewShaderGenerator(const PreviewShaderGenerator&) = delete;
+        PreviewShaderGenerator& operator=(const PreviewShaderGenerator&) = delete;
+    private:
+        NodeGraph _lastGraph;
+        PreviewOptions _lastOptions;
+        std::string _lastShaderText;
+        std::string _lastCBLayout;
+        bool _hasLast;
+        GeneratorCache* _cache;
+    };
+
 	std::string GenerateStructureForTechniqueConfig(const MainFunctionInterface& interf, const char graphName[]);
 }
 
@@ -0,0 +1,289 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "SignatureCache.h"
+#include "../Assets/IntermediateAssets.h"
+#include "../Assets/AssetsCore.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Streams/PathUtils.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/IteratorUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/StringFormat.h"
+#include "../Utility/PtrUtils.h"
+#include "../Core/Exceptions.h"
+#include <vector>
+
+namespace ShaderSourceParser
+{
+    namespace Internal
+    {
+        static const uint32 SignatureFileMagic = 0x53474953;     // 'SIGS'
+        static const uint32 SignatureFileVersion = 1;
+
+        class SignatureWriter
+        {
+        public:
+            std::vector<uint8> _data;
+
+            void Write(uint32 value)
+            {
+                auto* v = (const uint8*)&value;
+                _data.insert(_data.end(), v, v+sizeof(value));
+            }
+
+            void Write(const std::string& str)
+            {
+                Write(uint32(str.size()));
+                _data.insert(_data.end(), str.begin(), str.end());
+            }
+        };
+
+        class SignatureReader
+        {
+        public:
+            bool Read(uint32& value)
+            {
+                if (size_t(_end - _iterator) < sizeof(value)) return false;
+                XlCopyMemory(&value, _iterator, sizeof(value));
+                _iterator += sizeof(value);
+                return true;
+            }
+
+            bool Read(std::string& str)
+            {
+                uint32 length;
+                if (!Read(length) || size_t(_end - _iterator) < length) return false;
+                str.assign((const char*)_iterator, (const char*)_iterator + length);
+                _iterator += length;
+                return true;
+            }
+
+            SignatureReader(const uint8* begin, const uint8* end) : _iterator(begin), _end(end) {}
+        private:
+            const uint8* _iterator;
+            const uint8* _end;
+        };
+
+        static std::vector<uint8> SerializeSignature(const ShaderFragmentSignature& sig, uint64 sourceHash)
+        {
+            SignatureWriter writer;
+            writer.Write(SignatureFileMagic);
+            writer.Write(SignatureFileVersion);
+            writer.Write(uint32(sourceHash));
+            writer.Write(uint32(sourceHash >> 32ull));
+
+            writer.Write(uint32(sig._functions.size()));
+            for (const auto& fn:sig._functions) {
+                writer.Write(fn._returnType);
+                writer.Write(fn._returnSemantic);
+                writer.Write(fn._name);
+                writer.Write(uint32(fn._parameters.size()));
+                for (const auto& p:fn._parameters) {
+                    writer.Write(p._type);
+                    writer.Write(p._semantic);
+                    writer.Write(p._name);
+                    writer.Write(uint32(p._direction));
+                }
+            }
+
+            writer.Write(uint32(sig._parameterStructs.size()));
+            for (const auto& str:sig._parameterStructs) {
+                writer.Write(str._name);
+                writer.Write(uint32(str._parameters.size()));
+                for (const auto& p:str._parameters) {
+                    writer.Write(p._type);
+                    writer.Write(p._semantic);
+                    writer.Write(p._name);
+                }
+            }
+            return std::move(writer._data);
+        }
+
+        static bool DeserializeSignature(ShaderFragmentSignature& result, const uint8* begin, const uint8* end, uint64 sourceHash)
+        {
+            SignatureReader reader(begin, end);
+            uint32 magic, version, hashLow, hashHigh;
+            if (    !reader.Read(magic) || !reader.Read(version) || !reader.Read(hashLow) || !reader.Read(hashHigh)
+                ||  magic != SignatureFileMagic || version != SignatureFileVersion
+                ||  ((uint64(hashHigh) << 32ull) | uint64(hashLow)) != sourceHash)
+                return false;
+
+            uint32 functionCount;
+            if (!reader.Read(functionCount)) return false;
+            for (uint32 f=0; f<functionCount; ++f) {
+                FunctionSignature fn;
+                uint32 paramCount;
+                if (!reader.Read(fn._returnType) || !reader.Read(fn._returnSemantic) || !reader.Read(fn._name) || !reader.Read(paramCount))
+                    return false;
+                for (uint32 p=0; p<paramCount; ++p) {
+                    FunctionSignature::Parameter param;
+                    uint32 direction;
+                    if (!reader.Read(param._type) || !reader.Read(param._semantic) || !reader.Read(param._name) || !reader.Read(direction))
+                        return false;
+                    param._direction = direction;
+                    fn._parameters.push_back(std::move(param));
+                }
+                result._functions.push_back(std::move(fn));
+            }
+
+            uint32 structCount;
+            if (!reader.Read(structCount)) return false;
+            for (uint32 s=0; s<structCount; ++s) {
+                ParameterStructSignature str;
+                uint32 paramCount;
+                if (!reader.Read(str._name) || !reader.Read(paramCount)) return false;
+                for (uint32 p=0; p<paramCount; ++p) {
+                    ParameterStructSignature::Parameter param;
+                    if (!reader.Read(param._type) || !reader.Read(param._semantic) || !reader.Read(param._name))
+                        return false;
+                    str._parameters.push_back(std::move(param));
+                }
+                result._parameterStructs.push_back(std::move(str));
+            }
+            return true;
+        }
+
+        static void MakeStoreFileName(
+            ::Assets::ResChar buffer[], unsigned bufferCount,
+            const ::Assets::IntermediateAssets::Store& store, uint64 sourceHash)
+        {
+            store.MakeIntermediateName(
+                buffer, bufferCount,
+                (StringMeld<64, ::Assets::ResChar>() << "ShaderSignatures/" << std::hex << sourceHash << ".sig").get());
+        }
+
+        class SignatureCache
+        {
+        public:
+            class Entry
+            {
+            public:
+                std::shared_ptr<const ShaderFragmentSignature> _signature;
+                uint64 _lastUsed;
+            };
+
+            Threading::Mutex _lock;
+            std::vector<std::pair<uint64, Entry>> _signatures;
+            uint64 _useCounter;
+            SignatureCacheMetrics _metrics;
+
+            void EvictLeastRecentlyUsed()
+            {
+                    //  Linear search is fine here -- this only happens when inserting
+                    //  a new signature into a full cache
+                auto oldest = _signatures.begin();
+                for (auto i=_signatures.begin(); i!=_signatures.end(); ++i)
+                    if (i->second._lastUsed < oldest->second._lastUsed)
+                        oldest = i;
+                _signatures.erase(oldest);
+                ++_metrics._evictions;
+            }
+
+            SignatureCache() : _useCounter(0) { XlZeroMemory(_metrics); }
+        };
+
+        static SignatureCache& GetCache()
+        {
+            static SignatureCache cache;
+            return cache;
+        }
+    }
+
+    std::shared_ptr<const ShaderFragmentSignature> GetShaderFragmentSignature(
+        StringSection<char> sourceCode,
+        const ::Assets::IntermediateAssets::Store* intermediateStore)
+    {
+        auto& cache = Internal::GetCache();
+        auto hash = Hash64(sourceCode.begin(), sourceCode.end());
+
+        {
+            ScopedLock(cache._lock);
+            auto i = LowerBound(cache._signatures, hash);
+            if (i != cache._signatures.end() && i->first == hash) {
+                ++cache._metrics._memoryHits;
+                i->second._lastUsed = ++cache._useCounter;
+                return i->second._signature;
+            }
+        }
+
+            //  Not in memory... Try the intermediate store next, and then finally
+            //  build it from the source. We don't hold the lock while doing this,
+            //  so it's possible that another thread will build the same signature
+            //  at the same time. In that case, the first one inserted wins.
+        std::shared_ptr<ShaderFragmentSignature> newSig;
+        ::Assets::ResChar storeFileName[MaxPath];
+        bool fromStore = false, fromScan = false;
+        if (intermediateStore) {
+            Internal::MakeStoreFileName(storeFileName, dimof(storeFileName), *intermediateStore, hash);
+            size_t fileSize = 0;
+            auto file = LoadFileAsMemoryBlock(storeFileName, &fileSize);
+            if (file && fileSize) {
+                auto sig = std::make_shared<ShaderFragmentSignature>();
+                if (Internal::DeserializeSignature(*sig, file.get(), PtrAdd(file.get(), fileSize), hash)) {
+                    newSig = std::move(sig);
+                    fromStore = true;
+                }
+            }
+        }
+
+        if (!newSig) {
+            newSig = std::make_shared<ShaderFragmentSignature>();
+            fromScan = TryScanShaderFragmentSignature(*newSig, sourceCode.begin(), sourceCode.Length());
+            if (!fromScan)
+                *newSig = ParseShaderFragmentSignature(sourceCode.begin(), sourceCode.Length());
+
+            if (intermediateStore) {
+                auto data = Internal::SerializeSignature(*newSig, hash);
+                TRY {
+                    CreateDirectoryRecursive(MakeFileNameSplitter(storeFileName).DriveAndPath());
+                    BasicFile file(storeFileName, "wb");
+                    file.Write(AsPointer(data.begin()), 1, data.size());
+                } CATCH (...) {
+                        // failing to write to the store isn't critical; we'll
+                        // just build the signature again next time
+                } CATCH_END
+            }
+        }
+
+        ScopedLock(cache._lock);
+        if (fromStore) ++cache._metrics._storeHits;
+        else if (fromScan) ++cache._metrics._scans;
+        else ++cache._metrics._fullParses;
+
+        auto i = LowerBound(cache._signatures, hash);
+        if (i != cache._signatures.end() && i->first == hash) {
+            i->second._lastUsed = ++cache._useCounter;
+            return i->second._signature;
+        }
+
+        if (cache._signatures.size() >= SignatureCacheCapacity) {
+            cache.EvictLeastRecentlyUsed();
+            i = LowerBound(cache._signatures, hash);
+        }
+
+        std::shared_ptr<const ShaderFragmentSignature> result = std::move(newSig);
+        Internal::SignatureCache::Entry entry = { result, ++cache._useCounter };
+        cache._signatures.insert(i, std::make_pair(hash, std::move(entry)));
+        return result;
+    }
+
+    SignatureCacheMetrics GetSignatureCacheMetrics()
+    {
+        auto& cache = Internal::GetCache();
+        ScopedLock(cache._lock);
+        return cache._metrics;
+    }
+
+    void ClearSignatureCache()
+    {
+        auto& cache = Internal::GetCache();
+        ScopedLock(cache._lock);
+        cache._signatures.clear();
+        XlZeroMemory(cache._metrics);
+    }
+}
+
@@ -0,0 +1,52 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "InterfaceSignature.h"
+#include "../Utility/StringUtils.h"
+#include "../Core/Types.h"
+#include <memory>
+
+namespace Assets { namespace IntermediateAssets { class Store; } }
+
+namespace ShaderSourceParser
+{
+    /// <summary>Returns the signature for some shader source, using a cache</summary>
+    /// Signatures are keyed by a hash of the source code, so the same fragment
+    /// loaded via different paths (or reloaded without changes) will share a
+    /// single signature.
+    ///
+    /// If an intermediate store is given, signatures are also written to (and
+    /// read from) that store, so they can be reused across sessions without
+    /// parsing the source again.
+    ///
+    /// Every edit to a source file produces a new hash, so the in-memory cache holds
+    /// at most SignatureCacheCapacity signatures. Beyond that, the least recently used
+    /// signature is evicted (callers holding a reference to it are unaffected).
+    ///
+    /// Throws ShaderSourceParser::Exceptions::ParsingFailure on parse errors
+    /// (failures are not cached).
+    std::shared_ptr<const ShaderFragmentSignature> GetShaderFragmentSignature(
+        StringSection<char> sourceCode,
+        const ::Assets::IntermediateAssets::Store* intermediateStore = nullptr);
+
+    static const unsigned SignatureCacheCapacity = 512;
+
+    class SignatureCacheMetrics
+    {
+    public:
+        unsigned _memoryHits;
+        unsigned _storeHits;
+        unsigned _scans;            ///< built with the fast scanner
+        unsigned _fullParses;       ///< built with the full antlr parser
+        unsigned _evictions;        ///< least recently used signatures dropped to stay within SignatureCacheCapacity
+    };
+
+    SignatureCacheMetrics GetSignatureCacheMetrics();
+    void ClearSignatureCache();
+}
+
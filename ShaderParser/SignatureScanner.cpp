@@ -0,0 +1,500 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "InterfaceSignature.h"
+#include "../Utility/StringUtils.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace ShaderSourceParser
+{
+        //
+        //  Hand-written scanner for the top level declarations in a shader
+        //  fragment. This recognises the same top level constructs as the
+        //  antlr grammar (see Grammar/Shader.g) -- structs, cbuffers,
+        //  function definitions & declarations and global variables. But it
+        //  doesn't parse function bodies or initializers; they are just
+        //  skipped by matching brackets.
+        //
+        //  If we find something we don't understand, we give up and the caller
+        //  should fall back to the full parser.
+        //
+
+    namespace Internal
+    {
+        class Token
+        {
+        public:
+            enum Type { Identifier, Number, String, Punctuation, End };
+            Type _type;
+            const char* _start;
+            const char* _end;
+
+            bool Is(char c) const { return _type == Punctuation && *_start == c; }
+            bool Is(const char str[]) const { return _type == Identifier && XlEqString(StringSection<char>(_start, _end), str); }
+            std::string AsString() const { return std::string(_start, _end); }
+        };
+
+        static bool IsIdentifierStart(char c)   { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+        static bool IsDigit(char c)             { return c >= '0' && c <= '9'; }
+        static bool IsIdentifierChar(char c)    { return IsIdentifierStart(c) || IsDigit(c); }
+
+        class Tokenizer
+        {
+        public:
+            Token Next();
+            Token Peek();
+            const char* GetPosition() const { return _iterator; }
+            void SetPosition(const char* position) { _iterator = position; }
+
+            Tokenizer(const char* start, const char* end) : _iterator(start), _end(end) {}
+        private:
+            const char* _iterator;
+            const char* _end;
+
+            void SkipWhitespaceAndComments();
+        };
+
+        void Tokenizer::SkipWhitespaceAndComments()
+        {
+            while (_iterator < _end) {
+                char c = *_iterator;
+                if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f') {
+                    ++_iterator;
+                } else if (c == '/' && (_iterator+1) < _end && _iterator[1] == '/') {
+                    while (_iterator < _end && *_iterator != '\n') ++_iterator;
+                } else if (c == '/' && (_iterator+1) < _end && _iterator[1] == '*') {
+                    _iterator += 2;
+                    while ((_iterator+1) < _end && !(_iterator[0] == '*' && _iterator[1] == '/')) ++_iterator;
+                    _iterator = std::min(_iterator+2, _end);
+                } else if (c == '#') {
+                        // preprocessor directives are ignored by the grammar, also. Skip
+                        // to the end of the line, allowing for line continuations
+                    while (_iterator < _end && *_iterator != '\n') {
+                        if (*_iterator == '\\' && (_iterator+1) < _end) {
+                            if (_iterator[1] == '\n') { _iterator += 2; continue; }
+                            if (_iterator[1] == '\r' && (_iterator+2) < _end && _iterator[2] == '\n') { _iterator += 3; continue; }
+                        }
+                        ++_iterator;
+                    }
+                } else
+                    break;
+            }
+        }
+
+        Token Tokenizer::Next()
+        {
+            SkipWhitespaceAndComments();
+
+            Token result;
+            result._start = _iterator;
+            if (_iterator >= _end) {
+                result._type = Token::End;
+                result._end = _iterator;
+                return result;
+            }
+
+            char c = *_iterator;
+            if (IsIdentifierStart(c)) {
+                while (_iterator < _end && IsIdentifierChar(*_iterator)) ++_iterator;
+                result._type = Token::Identifier;
+            } else if (IsDigit(c) || (c == '.' && (_iterator+1) < _end && IsDigit(_iterator[1]))) {
+                    // numeric literals (including hex, floating point exponents & suffixes)
+                bool isHex = c == '0' && (_iterator+1) < _end && (_iterator[1] == 'x' || _iterator[1] == 'X');
+                ++_iterator;
+                while (_iterator < _end) {
+                    char n = *_iterator;
+                    if (IsIdentifierChar(n) || n == '.') { ++_iterator; continue; }
+                    if (!isHex && (n == '+' || n == '-') && (_iterator[-1] == 'e' || _iterator[-1] == 'E')) { ++_iterator; continue; }
+                    break;
+                }
+                result._type = Token::Number;
+            } else if (c == '"' || c == '\'') {
+                ++_iterator;
+                while (_iterator < _end && *_iterator != c) {
+                    if (*_iterator == '\\') ++_iterator;
+                    ++_iterator;
+                }
+                _iterator = std::min(_iterator+1, _end);
+                result._type = Token::String;
+            } else {
+                ++_iterator;
+                result._type = Token::Punctuation;
+            }
+
+            result._end = _iterator;
+            return result;
+        }
+
+        Token Tokenizer::Peek()
+        {
+            auto pos = _iterator;
+            auto result = Next();
+            _iterator = pos;
+            return result;
+        }
+
+        static bool IsStorageClassOrModifier(const Token& token)
+        {
+            static const char* keywords[] =
+            {
+                "extern", "nointerpolation", "precise", "shared", "groupshared", "static", "uniform", "volatile",
+                "const", "row_major", "column_major"
+            };
+            for (auto k:keywords) if (token.Is(k)) return true;
+            return false;
+        }
+
+        static bool IsGeometryPrimitiveType(const Token& token)
+        {
+            return token.Is("point") || token.Is("line") || token.Is("triangle") || token.Is("lineadj") || token.Is("triangleadj");
+        }
+
+        static bool IsTemplateTypeName(const Token& token)
+        {
+                // these are the only type names that the grammar allows
+                // to have template arguments
+            if (token._type != Token::Identifier) return false;
+            StringSection<char> name(token._start, token._end);
+            if (XlBeginsWith(name, MakeStringSection("Texture")) || XlBeginsWith(name, MakeStringSection("RWTexture")))
+                return true;
+            static const char* others[] =
+            {
+                "texture", "StructuredBuffer", "RWStructuredBuffer", "AppendStructuredBuffer",
+                "PointStream", "LineStream", "TriangleStream", "InputPatch", "OutputPatch"
+            };
+            for (auto o:others) if (token.Is(o)) return true;
+            return false;
+        }
+
+        static bool LooksLikePreprocessorMacro(const Token& token)
+        {
+                // same rule as the grammar -- upper case ASCII chars & underscores
+            if (token._type != Token::Identifier) return false;
+            for (auto c=token._start; c!=token._end; ++c)
+                if ((*c < 'A' || *c > 'Z') && *c != '_')
+                    return false;
+            return true;
+        }
+
+        class SignatureScanner
+        {
+        public:
+            bool ScanFile(ShaderFragmentSignature& result);
+
+            SignatureScanner(const char* start, const char* end) : _tokenizer(start, end) {}
+        private:
+            Tokenizer _tokenizer;
+
+            bool SkipBalanced(char open, char close);
+            bool SkipExpression();
+            bool ParseTypeName(std::string& result);
+            bool ParseStructure(ShaderFragmentSignature& result, bool isCBuffer);
+            bool ParseVariable(ParameterStructSignature& str);
+            bool ParseFormalArg(FunctionSignature::Parameter& result);
+            bool ParseFunctionOrGlobal(ShaderFragmentSignature& result);
+        };
+
+        bool SignatureScanner::SkipBalanced(char open, char close)
+        {
+                // we've already consumed the opening bracket; skip until the
+                // matching close, allowing for nested brackets of any type.
+            char stack[64];
+            unsigned depth = 0;
+            stack[depth++] = close;
+            for (;;) {
+                auto token = _tokenizer.Next();
+                if (token._type == Token::End) return false;
+                if (token._type != Token::Punctuation) continue;
+                char c = *token._start;
+                if (c == '(' || c == '[' || c == '{') {
+                    if (depth >= dimof(stack)) return false;
+                    stack[depth++] = (c == '(') ? ')' : ((c == '[') ? ']' : '}');
+                } else if (c == ')' || c == ']' || c == '}') {
+                    if (stack[depth-1] != c) return false;
+                    if (--depth == 0) return true;
+                }
+            }
+        }
+
+        bool SignatureScanner::SkipExpression()
+        {
+                // skip an initializer expression, up to (but not including)
+                // the next ',' or ';' that isn't enclosed in brackets
+            for (;;) {
+                auto token = _tokenizer.Peek();
+                if (token._type == Token::End) return false;
+                if (token.Is(',') || token.Is(';') || token.Is(')')) return true;
+                _tokenizer.Next();
+                if (token.Is('(')) { if (!SkipBalanced('(', ')')) return false; }
+                else if (token.Is('[')) { if (!SkipBalanced('[', ']')) return false; }
+                else if (token.Is('{')) { if (!SkipBalanced('{', '}')) return false; }
+            }
+        }
+
+        bool SignatureScanner::ParseTypeName(std::string& result)
+        {
+            auto baseName = _tokenizer.Next();
+            if (baseName._type != Token::Identifier) return false;
+            result = baseName.AsString();
+
+            if (!_tokenizer.Peek().Is('<')) return true;
+            if (!IsTemplateTypeName(baseName)) return false;
+            _tokenizer.Next();
+
+                // template arguments are a list of static expressions; we build
+                // the same string as AsTypeNameString() does for the antlr tree.
+            result += "<";
+            for (unsigned c=0;; ++c) {
+                auto arg = _tokenizer.Next();
+                if (arg._type != Token::Identifier && arg._type != Token::Number && arg._type != Token::String)
+                    return false;
+                if (c != 0) result += ", ";
+                result.insert(result.end(), arg._start, arg._end);
+
+                auto divider = _tokenizer.Next();
+                if (divider.Is('>')) break;
+                if (!divider.Is(',')) return false;
+            }
+            result += ">";
+            return true;
+        }
+
+        bool SignatureScanner::ParseVariable(ParameterStructSignature& str)
+        {
+                //  (storage_class|type_modifier)* type_name variablename_list ';'
+            while (IsStorageClassOrModifier(_tokenizer.Peek())) _tokenizer.Next();
+
+            std::string type;
+            if (!ParseTypeName(type)) return false;
+
+            for (;;) {
+                auto name = _tokenizer.Next();
+                if (name._type != Token::Identifier) return false;
+
+                ParameterStructSignature::Parameter p;
+                p._name = name.AsString();
+                p._type = type;
+
+                for (;;) {
+                    auto next = _tokenizer.Peek();
+                    if (next.Is('[')) {
+                        _tokenizer.Next();
+                        if (!SkipBalanced('[', ']')) return false;
+                    } else if (next.Is(':')) {
+                        _tokenizer.Next();
+                        auto semantic = _tokenizer.Next();
+                        if (semantic._type != Token::Identifier) return false;
+                        if (semantic.Is("register") || semantic.Is("packoffset")) {
+                            if (!_tokenizer.Next().Is('(') || !SkipBalanced('(', ')')) return false;
+                        } else if (p._semantic.empty())
+                            p._semantic = semantic.AsString();
+                    } else if (next.Is('=')) {
+                        _tokenizer.Next();
+                        if (!SkipExpression()) return false;
+                    } else
+                        break;
+                }
+
+                str._parameters.push_back(std::move(p));
+
+                auto divider = _tokenizer.Next();
+                if (divider.Is(';')) return true;
+                if (!divider.Is(',')) return false;
+            }
+        }
+
+        bool SignatureScanner::ParseStructure(ShaderFragmentSignature& result, bool isCBuffer)
+        {
+            auto name = _tokenizer.Next();
+            if (name._type != Token::Identifier) return false;
+
+            if (isCBuffer && _tokenizer.Peek().Is(':')) {
+                _tokenizer.Next();
+                if (!_tokenizer.Next().Is("register") || !_tokenizer.Next().Is('(') || !SkipBalanced('(', ')'))
+                    return false;
+            }
+
+            if (!_tokenizer.Next().Is('{')) return false;
+
+            ParameterStructSignature str;
+            str._name = name.AsString();
+
+            for (;;) {
+                auto next = _tokenizer.Peek();
+                if (next.Is('}')) { _tokenizer.Next(); break; }
+                if (next._type == Token::End) return false;
+
+                    //  Like the grammar, try to parse a variable first, and then fall
+                    //  back to treating the identifier as an isolated macro
+                auto rewind = _tokenizer.GetPosition();
+                auto parameterCount = str._parameters.size();
+                if (!ParseVariable(str)) {
+                    _tokenizer.SetPosition(rewind);
+                    str._parameters.resize(parameterCount);
+                    if (!LooksLikePreprocessorMacro(next)) return false;
+                    _tokenizer.Next();
+                }
+            }
+
+                // structs must be terminated with a ';' (but it's optional for cbuffers)
+            if (!isCBuffer && !_tokenizer.Next().Is(';')) return false;
+
+            if (!str._parameters.empty())
+                result._parameterStructs.push_back(std::move(str));
+            return true;
+        }
+
+        bool SignatureScanner::ParseFormalArg(FunctionSignature::Parameter& result)
+        {
+                //  (direction | storage_class | type_modifier)* geometryPrimitiveType?
+                //      type_name ident subscript* semantic? ('=' expression)?
+            result._direction = FunctionSignature::Parameter::In;
+            for (;;) {
+                auto next = _tokenizer.Peek();
+                if (next.Is("in")) result._direction = FunctionSignature::Parameter::In;
+                else if (next.Is("out")) result._direction = FunctionSignature::Parameter::Out;
+                else if (next.Is("inout")) result._direction = FunctionSignature::Parameter::In | FunctionSignature::Parameter::Out;
+                else if (!IsStorageClassOrModifier(next)) break;
+                _tokenizer.Next();
+            }
+
+            if (IsGeometryPrimitiveType(_tokenizer.Peek())) _tokenizer.Next();
+            if (!ParseTypeName(result._type)) return false;
+
+            auto name = _tokenizer.Next();
+            if (name._type != Token::Identifier) return false;
+            result._name = name.AsString();
+
+            for (;;) {
+                auto next = _tokenizer.Peek();
+                if (next.Is('[')) {
+                    _tokenizer.Next();
+                    if (!SkipBalanced('[', ']')) return false;
+                } else if (next.Is(':')) {
+                    _tokenizer.Next();
+                    auto semantic = _tokenizer.Next();
+                    if (semantic._type != Token::Identifier) return false;
+                    result._semantic = semantic.AsString();
+                } else if (next.Is('=')) {
+                    _tokenizer.Next();
+                    return SkipExpression();
+                } else
+                    return true;
+            }
+        }
+
+        bool SignatureScanner::ParseFunctionOrGlobal(ShaderFragmentSignature& result)
+        {
+            bool isFunction = false;
+            if (_tokenizer.Peek().Is("export")) { _tokenizer.Next(); isFunction = true; }
+            while (_tokenizer.Peek().Is('[')) {
+                    // function attributes (eg, [numthreads(...)])
+                _tokenizer.Next();
+                if (!SkipBalanced('[', ']')) return false;
+                isFunction = true;
+            }
+
+            bool hasModifiers = false;
+            while (IsStorageClassOrModifier(_tokenizer.Peek())) { _tokenizer.Next(); hasModifiers = true; }
+
+            auto typeStart = _tokenizer.Peek();
+            std::string type;
+            if (!ParseTypeName(type)) return false;
+            auto name = _tokenizer.Next();
+            if (name._type != Token::Identifier) return false;
+
+            if (!_tokenizer.Peek().Is('(')) {
+                    // This is a global variable declaration. These don't contribute to the
+                    // signature, so just skip over it
+                if (isFunction) return false;
+                for (;;) {
+                    if (!SkipExpression()) return false;
+                    auto divider = _tokenizer.Next();
+                    if (divider.Is(';')) return true;
+                    if (!divider.Is(',')) return false;
+                }
+            }
+
+                // The grammar only accepts simple identifiers for return types, and doesn't
+                // allow storage classes. We'll let the full parser deal with anything else.
+            if (hasModifiers || type.size() != size_t(typeStart._end - typeStart._start))
+                return false;
+            _tokenizer.Next();
+
+            FunctionSignature fn;
+            fn._returnType = std::move(type);
+            fn._name = name.AsString();
+
+            if (!_tokenizer.Peek().Is(')')) {
+                for (;;) {
+                    FunctionSignature::Parameter param;
+                    if (!ParseFormalArg(param)) return false;
+                    fn._parameters.push_back(std::move(param));
+
+                    auto next = _tokenizer.Next();
+                    while (LooksLikePreprocessorMacro(next))
+                        next = _tokenizer.Next();
+                    if (next.Is(')')) break;
+                    if (!next.Is(',')) return false;
+                }
+            } else
+                _tokenizer.Next();
+
+            auto next = _tokenizer.Next();
+            if (next.Is(':')) {
+                auto semantic = _tokenizer.Next();
+                if (semantic._type != Token::Identifier) return false;
+                fn._returnSemantic = semantic.AsString();
+                next = _tokenizer.Next();
+                if (!next.Is('{')) return false;
+            }
+
+            if (next.Is('{')) {
+                if (!SkipBalanced('{', '}')) return false;
+            } else if (!next.Is(';'))
+                return false;
+
+            result._functions.push_back(std::move(fn));
+            return true;
+        }
+
+        bool SignatureScanner::ScanFile(ShaderFragmentSignature& result)
+        {
+            for (;;) {
+                auto next = _tokenizer.Peek();
+                if (next._type == Token::End) return true;
+
+                if (next.Is(';')) {
+                    _tokenizer.Next();
+                } else if (next.Is("struct")) {
+                    _tokenizer.Next();
+                    if (!ParseStructure(result, false)) return false;
+                } else if (next.Is("cbuffer") || next.Is("tbuffer")) {
+                    _tokenizer.Next();
+                    if (!ParseStructure(result, true)) return false;
+                } else if (next._type == Token::Identifier || next.Is('[')) {
+                    if (next.Is("interface") || next.Is("class") || next.Is("typedef") || next.Is("namespace"))
+                        return false;
+                    if (!ParseFunctionOrGlobal(result)) return false;
+                } else
+                    return false;
+            }
+        }
+    }
+
+    bool TryScanShaderFragmentSignature(
+        ShaderFragmentSignature& result,
+        const char sourceCode[], size_t sourceCodeLength)
+    {
+        ShaderFragmentSignature temp;
+        Internal::SignatureScanner scanner(sourceCode, sourceCode + sourceCodeLength);
+        if (!scanner.ScanFile(temp)) return false;
+        result = std::move(temp);
+        return true;
+    }
+}
+
@@ -268,6 +268,23 @@ class DiffuseCubeMapGen extends ProcessStep
 	boolean doCheckErrorStream() { return false; }
 }
 
+// CPU alternative to DiffuseCubeMapGen (via a spherical harmonic projection)
+class DiffuseIBLFilter extends TextureTransformStep
+{
+    @Input
+    String format = "R16G16B16A16_FLOAT"
+
+	@Input
+    int faceSize = 32
+
+	Iterable<?> getCommandLine(File input, File output)
+	{
+		return makeCommandLine(output,
+			"DiffuseIBL",
+			"MipCount=${(int)(Math.log(faceSize)/Math.log(2.0f))+1}; Input=${input.getAbsolutePath()}; Dims={${faceSize}, ${faceSize}}; Format=${format}");
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 class SpecularIBLFilter extends TextureTransformStep
@@ -278,8 +295,21 @@ class SpecularIBLFilter extends TextureTransformStep
 	@Input
     int faceSize = 512
 
+		// Use the CPU filter, rather than the shader (for machines without a GPU)
+	@Input
+	boolean cpu = false
+
+	@Input
+	int sampleCount = 256
+
 	Iterable<?> getCommandLine(File input, File output)
 	{
+		if (cpu) {
+			return makeCommandLine(output,
+				"SpecularIBL",
+				"MipCount=${(int)(Math.log(faceSize)/Math.log(2.0f))}; SampleCount=${sampleCount}; Input=${input}; Dims={${faceSize}, ${faceSize}}; Format=${format}");
+		}
+
 		return makeCommandLine(output,
 			"ToolsHelper/SplitSum.sh:EquiRectFilterGlossySpecular",
 			"MipCount=${(int)(Math.log(faceSize)/Math.log(2.0f))}; ArrayCount=6; PassCount=128; Input=${input}; Dims={${faceSize}, ${faceSize}}; Format=${format}");
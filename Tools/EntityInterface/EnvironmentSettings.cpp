@@ -150,6 +150,22 @@ namespace EntityInterface
         return std::move(result);
     }
 
+    uint64 GetEnvironmentSettingsVersion(const RetainedEntities& flexGobInterface)
+    {
+            //  Change versions only ever increase, so the sum changes whenever 
+            //  any of the individual versions change
+        const utf8* types[] = 
+        {
+            EntityTypeName::EnvSettings, EntityTypeName::AmbientSettings,
+            EntityTypeName::DirectionalLight, EntityTypeName::AreaLight,
+            EntityTypeName::ToneMapSettings, EntityTypeName::ShadowFrustumSettings
+        };
+        uint64 result = 0;
+        for (auto t:types)
+            result += flexGobInterface.GetChangeVersion(flexGobInterface.GetTypeId(t));
+        return result;
+    }
+
     template<typename CharType>
         void SerializeBody(
             OutputStreamFormatter& formatter,
@@ -36,6 +36,11 @@ namespace EntityInterface
     EnvSettingsVector BuildEnvironmentSettings(
         const RetainedEntities& flexGobInterface);
 
+    /// <summary>Version number for the inputs to BuildEnvironmentSettings</summary>
+    /// Changes whenever any of the entities read by BuildEnvironmentSettings changes.
+    /// Use this to avoid rebuilding environment settings when nothing has changed.
+    uint64 GetEnvironmentSettingsVersion(const RetainedEntities& flexGobInterface);
+
     void ExportEnvSettings(
         OutputStreamFormatter& formatter,
         const RetainedEntities& flexGobInterface,
@@ -7,6 +7,7 @@
 #include "RetainedEntities.h"
 #include "../../Utility/StringUtils.h"
 #include "../../Utility/PtrUtils.h"
+#include "../../Utility/MemoryUtils.h"
 #include "../../Utility/Streams/StreamFormatter.h"
 
 namespace EntityInterface
@@ -28,9 +29,56 @@ namespace EntityInterface
 
     auto RetainedEntities::GetObjectType(ObjectTypeId id) const -> RegisteredObjectType*
     {
-        for (auto i=_registeredObjectTypes.begin(); i!=_registeredObjectTypes.end(); ++i)
-            if (i->first == id) return &i->second;
-        return nullptr;
+        if (id == 0 || id > _registeredObjectTypes.size()) return nullptr;
+        return &_registeredObjectTypes[id-1];
+    }
+
+    size_t RetainedEntities::ObjectKeyHash::operator()(const std::pair<DocumentId, ObjectId>& key) const
+    {
+        return size_t(IntegerHash64(key.second ^ (key.first * 0x9E3779B97F4A7C15ull)));
+    }
+
+    RetainedEntity& RetainedEntities::AddEntity(RetainedEntity&& newObject, RegisteredObjectType& type)
+    {
+        auto index = (unsigned)_objects.size();
+        _objectIndex.insert(std::make_pair(std::make_pair(newObject._doc, newObject._id), index));
+        _objectTypeSlots.push_back((unsigned)type._members.size());
+        type._members.push_back(index);
+        _objects.push_back(std::move(newObject));
+        return _objects[index];
+    }
+
+    RetainedEntity RetainedEntities::RemoveEntity(unsigned index)
+    {
+        RetainedEntity result(std::move(_objects[index]));
+        _objectIndex.erase(std::make_pair(result._doc, result._id));
+
+            //  remove from the type membership list (swapping the last
+            //  member into the hole)
+        auto* type = GetObjectType(result._type);
+        if (type) {
+            auto typeSlot = _objectTypeSlots[index];
+            auto movedMember = type->_members[type->_members.size()-1];
+            type->_members[typeSlot] = movedMember;
+            _objectTypeSlots[movedMember] = typeSlot;
+            type->_members.pop_back();
+        }
+
+            //  move the last object into the hole, and update the indices
+            //  that refer to it
+        auto lastIndex = (unsigned)(_objects.size()-1);
+        if (index != lastIndex) {
+            auto& moved = _objects[lastIndex];
+            _objectIndex[std::make_pair(moved._doc, moved._id)] = index;
+            auto* movedType = GetObjectType(moved._type);
+            if (movedType)
+                movedType->_members[_objectTypeSlots[lastIndex]] = index;
+            _objectTypeSlots[index] = _objectTypeSlots[lastIndex];
+            _objects[index] = std::move(moved);
+        }
+        _objects.pop_back();
+        _objectTypeSlots.pop_back();
+        return std::move(result);
     }
 
     bool RetainedEntities::RegisterCallback(ObjectTypeId typeId, OnChangeDelegate onChange)
@@ -43,6 +91,7 @@ namespace EntityInterface
 
     void RetainedEntities::InvokeOnChange(RegisteredObjectType& type, RetainedEntity& obj, ChangeType changeType) const
     {
+        ++type._changeVersion;
         for (auto i=type._onChange.begin(); i!=type._onChange.end(); ++i) {
             (*i)(*this, Identifier(obj._doc, obj._id, obj._type), changeType);
         }
@@ -57,60 +106,68 @@ namespace EntityInterface
                 ||  changeType == ChangeType::ChangeHierachy || changeType == ChangeType::Delete)
                 newChangeType = ChangeType::ChangeHierachy;
 
-            for (auto i=_objects.begin(); i!=_objects.end(); ++i)
-                if (i->_id == obj._parent && i->_doc == obj._doc) {
-                    auto type = GetObjectType(i->_type);
-                    if (type) 
-                        InvokeOnChange(*type, *i, newChangeType);
-                }
+            auto* parent = GetEntityInt(obj._doc, obj._parent);
+            if (parent) {
+                auto type = GetObjectType(parent->_type);
+                if (type) 
+                    InvokeOnChange(*type, *parent, newChangeType);
+            }
         }
     }
 
     auto RetainedEntities::GetEntity(DocumentId doc, ObjectId obj) const -> const RetainedEntity*
     {
-        for (auto i=_objects.begin(); i!=_objects.end(); ++i)
-            if (i->_id == obj && i->_doc == doc) {
-                return AsPointer(i);
-            }
-        return nullptr;
+        return GetEntityInt(doc, obj);
     }
 
     auto RetainedEntities::GetEntity(const Identifier& id) const -> const RetainedEntity*
     {
-        for (auto i=_objects.begin(); i!=_objects.end(); ++i)
-            if (i->_id == id.Object() && i->_doc == id.Document() && i->_type == id.ObjectType())
-                return AsPointer(i);
+        auto* result = GetEntityInt(id.Document(), id.Object());
+        if (result && result->_type == id.ObjectType())
+            return result;
         return nullptr;
     }
 
     auto RetainedEntities::GetEntityInt(DocumentId doc, ObjectId obj) const -> RetainedEntity* 
     {
-        for (auto i=_objects.begin(); i!=_objects.end(); ++i)
-            if (i->_id == obj && i->_doc == doc) {
-                return AsPointer(i);
-            }
+        auto i = _objectIndex.find(std::make_pair(doc, obj));
+        if (i != _objectIndex.end())
+            return &_objects[i->second];
         return nullptr;
     }
 
     auto RetainedEntities::FindEntitiesOfType(ObjectTypeId typeId) const -> std::vector<const RetainedEntity*>
     {
         std::vector<const RetainedEntity*> result;
-        for (auto i=_objects.begin(); i!=_objects.end(); ++i)
-            if (i->_type == typeId) {
-                result.push_back(AsPointer(i));
-            }
+        auto* type = GetObjectType(typeId);
+        if (type) {
+            result.reserve(type->_members.size());
+            for (auto i:type->_members)
+                result.push_back(&_objects[i]);
+        }
         return std::move(result);
     }
 
+    unsigned RetainedEntities::GetEntityCount(ObjectTypeId typeId) const
+    {
+        auto* type = GetObjectType(typeId);
+        return type ? (unsigned)type->_members.size() : 0u;
+    }
+
+    uint64 RetainedEntities::GetChangeVersion(ObjectTypeId typeId) const
+    {
+        auto* type = GetObjectType(typeId);
+        return type ? type->_changeVersion : 0ull;
+    }
+
     ObjectTypeId RetainedEntities::GetTypeId(const utf8 name[]) const
     {
         for (auto i=_registeredObjectTypes.cbegin(); i!=_registeredObjectTypes.cend(); ++i)
-            if (!XlCompareStringI(i->second._name.c_str(), name))
-                return i->first;
+            if (!XlCompareStringI(i->_name.c_str(), name))
+                return ObjectTypeId(1+std::distance(_registeredObjectTypes.cbegin(), i));
         
-        _registeredObjectTypes.push_back(
-            std::make_pair(_nextObjectTypeId, RegisteredObjectType(name)));
-        return _nextObjectTypeId++;
+        _registeredObjectTypes.push_back(RegisteredObjectType(name));
+        return ObjectTypeId(_registeredObjectTypes.size());
     }
 
 	PropertyId RetainedEntities::GetPropertyId(ObjectTypeId typeId, const utf8 name[]) const
@@ -141,16 +198,13 @@ namespace EntityInterface
 
     std::basic_string<utf8> RetainedEntities::GetTypeName(ObjectTypeId id) const
     {
-        auto i = LowerBound(_registeredObjectTypes, id);
-        if (i != _registeredObjectTypes.end() && i->first == id) {
-            return i->second._name;
-        }
+        auto* type = GetObjectType(id);
+        if (type) return type->_name;
         return std::basic_string<utf8>();
     }
 
     RetainedEntities::RetainedEntities()
     {
-        _nextObjectTypeId = 1;
         _nextObjectId = 1;
     }
 
@@ -196,8 +250,7 @@ namespace EntityInterface
         auto type = _scene->GetObjectType(id.ObjectType());
         if (!type) return false;
 
-        for (auto i=_scene->_objects.cbegin(); i!=_scene->_objects.cend(); ++i)
-            if (i->_doc == id.Document() && i->_id == id.Object()) return false;
+        if (_scene->GetEntityInt(id.Document(), id.Object())) return false;
 
         RetainedEntity newObject;
         newObject._doc = id.Document();
@@ -208,26 +261,23 @@ namespace EntityInterface
         for (size_t c=0; c<initializerCount; ++c)
             _scene->SetSingleProperties(newObject, *type, initializers[c]);
 
-        _scene->_objects.push_back(std::move(newObject));
-
-        _scene->InvokeOnChange(*type, _scene->_objects[_scene->_objects.size()-1], RetainedEntities::ChangeType::Create);
+        auto& added = _scene->AddEntity(std::move(newObject), *type);
+        _scene->InvokeOnChange(*type, added, RetainedEntities::ChangeType::Create);
         return true;
     }
 
 	bool RetainedEntityInterface::DeleteObject(const Identifier& id)
     {
-        for (auto i=_scene->_objects.begin(); i!=_scene->_objects.end(); ++i)
-            if (i->_doc == id.Document() && i->_id == id.Object()) {
-                assert(i->_type == id.ObjectType());
-                RetainedEntity copy(std::move(*i));
-                _scene->_objects.erase(i);
+        auto i = _scene->_objectIndex.find(std::make_pair(id.Document(), id.Object()));
+        if (i == _scene->_objectIndex.end()) return false;
 
-                auto type = _scene->GetObjectType(id.ObjectType());
-                if (type)
-                    _scene->InvokeOnChange(*type, copy, RetainedEntities::ChangeType::Delete);
-                return true;
-            }
-        return false;
+        assert(_scene->_objects[i->second]._type == id.ObjectType());
+        auto copy = _scene->RemoveEntity(i->second);
+
+        auto type = _scene->GetObjectType(id.ObjectType());
+        if (type)
+            _scene->InvokeOnChange(*type, copy, RetainedEntities::ChangeType::Delete);
+        return true;
     }
 
 	bool RetainedEntityInterface::SetProperty(
@@ -237,18 +287,16 @@ namespace EntityInterface
         auto type = _scene->GetObjectType(id.ObjectType());
         if (!type) return false;
 
-        for (auto i=_scene->_objects.begin(); i!=_scene->_objects.end(); ++i)
-            if (i->_doc == id.Document() && i->_id == id.Object()) {
-                bool gotChange = false;
-                for (size_t c=0; c<initializerCount; ++c) {
-                    auto& prop = initializers[c];
-                    gotChange |= _scene->SetSingleProperties(*i, *type, prop);
-                }
-                if (gotChange) _scene->InvokeOnChange(*type, *i, RetainedEntities::ChangeType::SetProperty);
-                return true;
-            }
+        auto* obj = _scene->GetEntityInt(id.Document(), id.Object());
+        if (!obj) return false;
 
-        return false;
+        bool gotChange = false;
+        for (size_t c=0; c<initializerCount; ++c) {
+            auto& prop = initializers[c];
+            gotChange |= _scene->SetSingleProperties(*obj, *type, prop);
+        }
+        if (gotChange) _scene->InvokeOnChange(*type, *obj, RetainedEntities::ChangeType::SetProperty);
+        return true;
     }
 
 	bool RetainedEntityInterface::GetProperty(const Identifier& id, PropertyId prop, void* dest, unsigned* destSize) const
@@ -259,16 +307,14 @@ namespace EntityInterface
 
         const auto& propertyName = type->_properties[prop-1];
 
-        for (auto i=_scene->_objects.begin(); i!=_scene->_objects.end(); ++i)
-            if (i->_doc == id.Document() && i->_id == id.Object()) {
-                auto res = i->_properties.GetParameter<unsigned>(propertyName.c_str());
-                if (res.first) {
-                    *(unsigned*)dest = res.second;
-                }
-                return true;
-            }
+        auto* obj = _scene->GetEntityInt(id.Document(), id.Object());
+        if (!obj) return false;
 
-        return false;
+        auto res = obj->_properties.GetParameter<unsigned>(propertyName.c_str());
+        if (res.first) {
+            *(unsigned*)dest = res.second;
+        }
+        return true;
     }
 
     bool RetainedEntityInterface::SetParent(
@@ -288,9 +334,10 @@ namespace EntityInterface
             auto* oldParent = _scene->GetEntityInt(child.Document(), childObj->_parent);
             if (oldParent) {
                 auto i = std::find(oldParent->_children.begin(), oldParent->_children.end(), child.Object());
-                oldParent->_children.erase(i);
+                if (i != oldParent->_children.end())
+                    oldParent->_children.erase(i);
 
-                auto oldParentType = _scene->GetObjectType(parent.ObjectType());
+                auto oldParentType = _scene->GetObjectType(oldParent->_type);
                 if (oldParentType)
                     _scene->InvokeOnChange(
                         *oldParentType, *oldParent, 
@@ -12,6 +12,7 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <unordered_map>
 
 namespace Utility { template<typename Type> class InputStreamFormatter; }
 
@@ -45,12 +46,27 @@ namespace EntityInterface
     ///
     /// All of the properties and data related to that object will be available in
     /// the callback.
+    ///
+    /// Entities are stored densely, with an index from (document, object) id to 
+    /// storage slot, and a membership list for each type. So GetEntity() and the
+    /// edit operations are constant time, and FindEntitiesOfType() only visits
+    /// entities of the requested type (in no particular order).
+    /// Pointers returned from GetEntity() and FindEntitiesOfType() are invalidated
+    /// by any create or delete operation.
+    ///
+    /// Each type has a change version (see GetChangeVersion()) that increases 
+    /// whenever an entity of that type changes, or something changes in the subtree
+    /// below an entity of that type. Clients that build derived state from entities
+    /// can compare versions to avoid rebuilding when nothing has changed.
     class RetainedEntities
     {
     public:
         const RetainedEntity* GetEntity(DocumentId doc, ObjectId obj) const;
         const RetainedEntity* GetEntity(const Identifier&) const;
         std::vector<const RetainedEntity*> FindEntitiesOfType(ObjectTypeId typeId) const;
+        unsigned GetEntityCount(ObjectTypeId typeId) const;
+
+        uint64 GetChangeVersion(ObjectTypeId typeId) const;
 
         enum class ChangeType 
         {
@@ -90,7 +106,19 @@ namespace EntityInterface
         ~RetainedEntities();
     protected:
         mutable ObjectId _nextObjectId;
+
+            //  "_objects" is dense storage (deleting swaps the last object into the 
+            //  hole). "_objectTypeSlots" runs parallel to it, and records the position
+            //  of each object in its type's "_members" list.
         mutable std::vector<RetainedEntity> _objects;
+        mutable std::vector<unsigned> _objectTypeSlots;
+
+        class ObjectKeyHash
+        {
+        public:
+            size_t operator()(const std::pair<DocumentId, ObjectId>& key) const;
+        };
+        mutable std::unordered_map<std::pair<DocumentId, ObjectId>, unsigned, ObjectKeyHash> _objectIndex;
 
         class RegisteredObjectType
         {
@@ -101,17 +129,24 @@ namespace EntityInterface
 
             std::vector<OnChangeDelegate> _onChange;
 
-            RegisteredObjectType(const std::basic_string<utf8>& name) : _name(name) {}
+            std::vector<unsigned> _members;     // indices into "_objects"
+            uint64 _changeVersion;
+
+            RegisteredObjectType(const std::basic_string<utf8>& name) : _name(name), _changeVersion(0) {}
         };
-        mutable std::vector<std::pair<ObjectTypeId, RegisteredObjectType>> _registeredObjectTypes;
 
-        mutable ObjectTypeId _nextObjectTypeId;
+            //  Type ids are allocated sequentially, so registered types are stored by
+            //  index (ObjectTypeId - 1)
+        mutable std::vector<RegisteredObjectType> _registeredObjectTypes;
 
         RegisteredObjectType* GetObjectType(ObjectTypeId id) const;
         void InvokeOnChange(RegisteredObjectType& type, RetainedEntity& obj, ChangeType changeType) const;
         RetainedEntity* GetEntityInt(DocumentId doc, ObjectId obj) const;
         bool SetSingleProperties(RetainedEntity& dest, const RegisteredObjectType& type, const PropertyInitializer& initializer) const;
 
+        RetainedEntity& AddEntity(RetainedEntity&& newObject, RegisteredObjectType& type);
+        RetainedEntity RemoveEntity(unsigned index);
+
         friend class RetainedEntityInterface;
     };
 
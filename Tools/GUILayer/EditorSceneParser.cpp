@@ -57,6 +57,10 @@ namespace GUILayer
             RenderCore::IThreadContext& context, 
             LightingParserContext& parserContext,
             PreparedScene& preparedPackets) const;
+        void PrepareView(
+            const SceneParseSettings& parseSettings,
+            const Float4x4& worldToProjection,
+            PreparedScene& preparedPackets) const;
         bool HasContent(const SceneParseSettings& parseSettings) const;
 
         float GetTimeValue() const;
@@ -74,6 +78,8 @@ namespace GUILayer
         std::shared_ptr<ToolsRig::VisCameraSettings> _camera;
 
         EnvironmentSettings _activeEnvSettings;
+        std::string _activeEnvSettingsName;
+        uint64 _activeEnvSettingsVersion;
         const EnvironmentSettings& GetEnvSettings() const { return _activeEnvSettings; }
     };
 
@@ -117,6 +123,12 @@ namespace GUILayer
                             scene._placementsManager->GetRenderer()->Render(
                                 metalContext.get(), parserContext, preparedPackets,
                                 techniqueIndex, *scene._placementsCells);
+                        } else if (batchFilter == SceneParseSettings::BatchFilter::DMShadows) {
+                                //  shadow views are culled in PrepareView (see below)
+                            scene._placementsManager->GetRenderer()->Render(
+                                metalContext.get(), parserContext, preparedPackets,
+                                techniqueIndex, *scene._placementsCells, 
+                                1 + parseSettings._projectionIndex);
                         } else {
                             scene._placementsManager->GetRenderer()->Render(
                                 metalContext.get(), parserContext,
@@ -152,6 +164,23 @@ namespace GUILayer
         }
     }
 
+    void EditorSceneParser::PrepareView(
+        const SceneParseSettings& parseSettings,
+        const Float4x4& worldToProjection,
+        PreparedScene& preparedPackets) const
+    {
+            //  The main view is culled in PrepareScene (because that can also reload
+            //  placements). Here, we only need the shadow projections. This can be 
+            //  called from multiple threads at the same time.
+        auto& scene = *_editorScene;
+        if (    parseSettings._batchFilter == SceneParseSettings::BatchFilter::DMShadows
+            &&  scene._placementsManager && scene._placementsCells) {
+            scene._placementsManager->GetRenderer()->CullToPreparedScene(
+                preparedPackets, worldToProjection,
+                1 + parseSettings._projectionIndex, *scene._placementsCells);
+        }
+    }
+
     void EditorSceneParser::RenderShadowForHiddenPlacements(
         DeviceContext& metalContext, 
         LightingParserContext& parserContext) const
@@ -194,6 +223,15 @@ namespace GUILayer
 
         using namespace EntityInterface;
         const auto& objs = *_editorScene->_flexObjects;
+
+            //  Only rebuild the settings when the entities they're built from have 
+            //  changed (or when we're switching to different settings)
+        auto version = GetEnvironmentSettingsVersion(objs);
+        if (version == _activeEnvSettingsVersion && !XlCompareStringI(_activeEnvSettingsName.c_str(), envSettings))
+            return;
+        _activeEnvSettingsVersion = version;
+        _activeEnvSettingsName = envSettings;
+
         const RetainedEntity* settings = nullptr;
         const auto typeSettings = objs.GetTypeId((const utf8*)"EnvSettings");
 
@@ -229,6 +267,7 @@ namespace GUILayer
         , _camera(std::move(camera))
     {
         _activeEnvSettings = PlatformRig::DefaultEnvironmentSettings();
+        _activeEnvSettingsVersion = ~uint64(0);
     }
     EditorSceneParser::~EditorSceneParser() {}
 
@@ -11,6 +11,7 @@
 #include "DelayedDeleteQueue.h"
 #include "ExportedNativeTypes.h"
 #include "../../SceneEngine/SceneEngineUtils.h"
+#include "../../SceneEngine/TerrainMaterialCompiler.h"
 #include "../../PlatformRig/FrameRig.h"
 #include "../../RenderCore/IDevice.h"
 #include "../../RenderCore/Metal/Shader.h"
@@ -69,6 +70,11 @@ namespace GUILayer
         compilers.AddCompiler(
             ToolsRig::AOSupplementCompiler::CompilerType,
             std::move(aoGeoCompiler));
+
+            // terrain material texture arrays are built on the CPU (no device required)
+        compilers.AddCompiler(
+            SceneEngine::TerrainMaterialArrayCompiler::CompileProcessType,
+            std::make_shared<SceneEngine::TerrainMaterialArrayCompiler>());
     }
 
     BufferUploads::IManager*    NativeEngineDevice::GetBufferUploads()
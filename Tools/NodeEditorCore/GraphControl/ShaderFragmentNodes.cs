@@ -220,21 +220,24 @@ namespace NodeEditorCore
                 if (doc == null) return;
 
                 var currentHash = doc.ShaderStructureHash;
-                if (currentHash != _shaderStructureHash)
+                if (currentHash != _shaderStructureHash || _builder == null)
                 {
-                    _builder = null;
                     _shaderStructureHash = currentHash;
-                }
 
-                if (_builder == null)
-                {
                         // note -- much of this work doesn't really need to be repeated for each node.
                     var prevSettings = PreviewSettings;
                     if (prevSettings.OutputToVisualize.StartsWith("SV_Target"))
                         prevSettings.OutputToVisualize = string.Empty;
-                    var shader = ShaderPatcherLayer.NodeGraph.GeneratePreviewShader(
-                        doc.NodeGraph, ((ShaderFragmentNodeTag)Node.Tag).Id, prevSettings, doc.GraphContext.Variables);
-                    _builder = _previewManager.CreatePreviewBuilder(shader);
+                    bool parametersOnly;
+                    var shader = _shaderGenerator.Generate(
+                        doc.NodeGraph, ((ShaderFragmentNodeTag)Node.Tag).Id, prevSettings, doc.GraphContext.Variables,
+                        out parametersOnly);
+
+                        // when only material parameters have changed, we can keep the compiled shader
+                    if (parametersOnly && _builder != null)
+                        _builder.UpdateParameters(shader.Item2);
+                    else
+                        _builder = _previewManager.CreatePreviewBuilder(shader);
                     _cachedBitmap = null;
                 }
 
@@ -323,6 +326,7 @@ namespace NodeEditorCore
         // bitmap cache --
         private uint _shaderStructureHash;
         private ShaderPatcherLayer.IPreviewBuilder _builder; 
+        private ShaderPatcherLayer.PreviewShaderGenerator _shaderGenerator = new ShaderPatcherLayer.PreviewShaderGenerator();
         private System.Drawing.Bitmap _cachedBitmap;
     }
 
@@ -328,6 +328,7 @@ namespace ShaderPatcherLayer
     public:
         virtual System::Drawing::Bitmap^ Build(
             NodeGraphContext^ doc, Size^ size, PreviewGeometry geometry, unsigned targetToVisualize);
+        virtual void UpdateParameters(System::String^ cbLayout);
 
         PreviewBuilder(
             std::shared_ptr<RenderCore::ShaderService::IShaderSource> shaderSource, 
@@ -462,6 +463,14 @@ namespace ShaderPatcherLayer
 		_pimpl->_materialBinder = std::make_shared<MaterialBinder>(*_pimpl->_shaderSource, _pimpl->_shaderText, _pimpl->_cbLayout);
     }
 
+    void PreviewBuilder::UpdateParameters(System::String^ cbLayout)
+    {
+            //  The material binder references _cbLayout, so replacing it in place changes
+            //  the material constants while keeping the compiled shaders
+        auto nativeCBLayout = clix::marshalString<clix::E_UTF8>(cbLayout);
+        _pimpl->_cbLayout = RenderCore::Techniques::PredefinedCBLayout(MakeStringSection(nativeCBLayout), true);
+    }
+
     PreviewBuilder::~PreviewBuilder()
     {
         delete _pimpl;
@@ -23,6 +23,9 @@ namespace ShaderPatcherLayer
         System::Drawing::Bitmap^ Build(
             NodeGraphContext^ doc, System::Drawing::Size^ size, 
             PreviewGeometry geometry, unsigned targetToVisualize);
+
+            /// <summary>Replaces the material parameter layout, without recompiling the shader</summary>
+        void UpdateParameters(System::String^ cbLayout);
     };
 
     public interface class IManager
@@ -9,6 +9,7 @@
 #include "ShaderFragmentArchive.h"
 #include "../GUILayer/MarshalString.h"
 #include "../../ShaderParser/InterfaceSignature.h"
+#include "../../ShaderParser/SignatureCache.h"
 #include "../../ShaderParser/ParameterSignature.h"
 #include "../../ShaderParser/Exceptions.h"
 #include "../../Utility/Streams/FileSystemMonitor.h"
@@ -17,7 +18,7 @@
 namespace ShaderFragmentArchive
 {
 
-    Function::Function(ShaderSourceParser::FunctionSignature& function)
+    Function::Function(const ShaderSourceParser::FunctionSignature& function)
     {
         InputParameters = gcnew List<Parameter^>();
         Outputs = gcnew List<Parameter^>();
@@ -68,7 +69,7 @@ namespace ShaderFragmentArchive
         return stringBuilder.ToString();
     }
 
-    ParameterStruct::ParameterStruct(ShaderSourceParser::ParameterStructSignature& parameterStruct)
+    ParameterStruct::ParameterStruct(const ShaderSourceParser::ParameterStructSignature& parameterStruct)
     {
         Parameters = gcnew List<Parameter^>();
 
@@ -183,19 +184,19 @@ namespace ShaderFragmentArchive
         if (!nativeString.empty()) {
 
             try {
-                auto nativeSignature = ShaderSourceParser::BuildShaderFragmentSignature(
-                    nativeString.c_str(), nativeString.size());
+                auto nativeSignature = ShaderSourceParser::GetShaderFragmentSignature(
+                    MakeStringSection(nativeString));
 
                     //
                     //      \todo -- support compilation errors in the shader code!
                     //
 
-                for (auto i=nativeSignature._functions.begin(); i!=nativeSignature._functions.end(); ++i) {
+                for (auto i=nativeSignature->_functions.begin(); i!=nativeSignature->_functions.end(); ++i) {
                     Function^ function = gcnew Function(*i);
                     Functions->Add(function);
                 }
 
-                for (auto i=nativeSignature._parameterStructs.begin(); i!=nativeSignature._parameterStructs.end(); ++i) {
+                for (auto i=nativeSignature->_parameterStructs.begin(); i!=nativeSignature->_parameterStructs.end(); ++i) {
                     ParameterStruct^ pstruct = gcnew ParameterStruct(*i);
                     ParameterStructs->Add(pstruct);
                 }
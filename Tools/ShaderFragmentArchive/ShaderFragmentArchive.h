@@ -37,7 +37,7 @@ namespace ShaderFragmentArchive
         property List<Parameter^>^      InputParameters;
         property List<Parameter^>^      Outputs;
 
-        Function(ShaderSourceParser::FunctionSignature& function);
+        Function(const ShaderSourceParser::FunctionSignature& function);
         ~Function();
         String^ BuildParametersString();
     };
@@ -75,7 +75,7 @@ namespace ShaderFragmentArchive
         property String^                Name;
         property List<Parameter^>^      Parameters;
 
-        ParameterStruct(ShaderSourceParser::ParameterStructSignature& parameterStruct);
+        ParameterStruct(const ShaderSourceParser::ParameterStructSignature& parameterStruct);
         ~ParameterStruct();
         String^ BuildBodyString();
     };
@@ -131,22 +131,35 @@ namespace ShaderPatcherLayer
         }
     }
     
-    static std::string GenerateCBLayoutInt(ShaderPatcher::MainFunctionInterface& interf)
+        //  Previews are regenerated often (and for many nodes in the same graph), so we
+        //  reuse the code generated for nodes between calls. Previews are generated on
+        //  the UI thread, so the cache doesn't need to be thread safe.
+    static ShaderPatcher::GeneratorCache& GetPreviewGeneratorCache()
     {
-        std::stringstream str;
-            // Input parameters that can be stored in a cbuffer become
-            // part of our cblayout
-        auto globalParams = interf.GetGlobalParameters();
-        for (unsigned c=0; c<globalParams.size(); ++c) {
-            if (interf.IsCBufferGlobal(c)) {
-                const auto& p = globalParams[c];
-                str << p._type << " " << p._name;
-                if (!p._default.empty())
-                    str << " = " << p._default;
-                str << ";" << std::endl;
-            }
-        }
-        return str.str();
+        static ShaderPatcher::GeneratorCache cache;
+        return cache;
+    }
+
+    static ShaderPatcher::PreviewOptions MakePreviewOptions(
+        PreviewSettings^ settings, IEnumerable<KeyValuePair<String^, String^>>^ variableRestrictions)
+    {
+        ShaderPatcher::PreviewOptions options = 
+			{
+				(settings->Geometry == PreviewGeometry::Chart)
+					? ShaderPatcher::PreviewOptions::Type::Chart
+					: ShaderPatcher::PreviewOptions::Type::Object,
+				String::IsNullOrEmpty(settings->OutputToVisualize) 
+					? std::string() 
+					: marshalString<E_UTF8>(settings->OutputToVisualize),
+				ShaderPatcher::PreviewOptions::VariableRestrictions()
+			};
+		if (variableRestrictions)
+			for each(auto v in variableRestrictions)
+				options._variableRestrictions.push_back(
+					std::make_pair(
+						clix::marshalString<clix::E_UTF8>(v.Key),
+						clix::marshalString<clix::E_UTF8>(v.Value)));
+        return options;
     }
 
     Tuple<String^,String^>^ NodeGraph::GeneratePreviewShader(
@@ -155,31 +168,40 @@ namespace ShaderPatcherLayer
     {
         try
         {
-            auto nativeGraph = graph->ConvertToNativePreview(previewNodeId);
-            ShaderPatcher::MainFunctionInterface interf(nativeGraph);
-            ShaderPatcher::PreviewOptions options = 
-				{
-					(settings->Geometry == PreviewGeometry::Chart)
-						? ShaderPatcher::PreviewOptions::Type::Chart
-						: ShaderPatcher::PreviewOptions::Type::Object,
-					String::IsNullOrEmpty(settings->OutputToVisualize) 
-						? std::string() 
-						: marshalString<E_UTF8>(settings->OutputToVisualize),
-					ShaderPatcher::PreviewOptions::VariableRestrictions()
-				};
-			if (variableRestrictions)
-				for each(auto v in variableRestrictions)
-					options._variableRestrictions.push_back(
-						std::make_pair(
-							clix::marshalString<clix::E_UTF8>(v.Key),
-							clix::marshalString<clix::E_UTF8>(v.Value)));
-                
+                // (one-off generation; see PreviewShaderGenerator for updating a preview after edits)
+            ShaderPatcher::PreviewShaderGenerator generator(&GetPreviewGeneratorCache());
+            auto result = generator.Generate(
+                graph->ConvertToNativePreview(previewNodeId),
+                MakePreviewOptions(settings, variableRestrictions));
+            return gcnew Tuple<String^,String^>(
+                marshalString<E_UTF8>(result._shaderText),
+                marshalString<E_UTF8>(result._cbLayout));
+        } catch (const std::exception& e) {
+            return gcnew Tuple<String^,String^>(
+                "Exception while generating shader: " + clix::marshalString<clix::E_UTF8>(e.what()),
+                String::Empty);
+        } catch (...) {
+            return gcnew Tuple<String^,String^>(
+                "Unknown exception while generating shader",
+                String::Empty);
+        }
+    }
+
+    Tuple<String^,String^>^ PreviewShaderGenerator::Generate(
+		NodeGraph^ graph, UInt32 previewNodeId, 
+		PreviewSettings^ settings, IEnumerable<KeyValuePair<String^, String^>>^ variableRestrictions,
+        [Out] bool% parametersOnly)
+    {
+        parametersOnly = false;
+        try
+        {
+            auto result = _native->Generate(
+                graph->ConvertToNativePreview(previewNodeId),
+                MakePreviewOptions(settings, variableRestrictions));
+            parametersOnly = result._edit != ShaderPatcher::GraphEdit::Recompile;
             return gcnew Tuple<String^,String^>(
-                marshalString<E_UTF8>(
-                        ShaderPatcher::GenerateShaderHeader(nativeGraph) 
-                    +   ShaderPatcher::GenerateShaderBody(nativeGraph, interf) 
-                    +   ShaderPatcher::GenerateStructureForPreview(nativeGraph, interf, options)),
-                marshalString<E_UTF8>(GenerateCBLayoutInt(interf)));
+                marshalString<E_UTF8>(result._shaderText),
+                marshalString<E_UTF8>(result._cbLayout));
         } catch (const std::exception& e) {
             return gcnew Tuple<String^,String^>(
                 "Exception while generating shader: " + clix::marshalString<clix::E_UTF8>(e.what()),
@@ -191,13 +213,28 @@ namespace ShaderPatcherLayer
         }
     }
 
+    PreviewShaderGenerator::PreviewShaderGenerator()
+    {
+        _native = new ShaderPatcher::PreviewShaderGenerator(&GetPreviewGeneratorCache());
+    }
+
+    PreviewShaderGenerator::~PreviewShaderGenerator()
+    {
+        delete _native; _native = nullptr;
+    }
+
+    PreviewShaderGenerator::!PreviewShaderGenerator()
+    {
+        delete _native; _native = nullptr;
+    }
+
     String^      NodeGraph::GenerateCBLayout(NodeGraph^ graph)
     {
         try
         {
             auto nativeGraph = graph->ConvertToNative("temp");
             ShaderPatcher::MainFunctionInterface interf(nativeGraph);
-            return clix::marshalString<clix::E_UTF8>(GenerateCBLayoutInt(interf));
+            return clix::marshalString<clix::E_UTF8>(ShaderPatcher::GenerateMaterialCBLayout(interf));
         } catch (const std::exception& e) {
             return "Exception while generating shader: " + clix::marshalString<clix::E_UTF8>(e.what());
         } catch (...) {
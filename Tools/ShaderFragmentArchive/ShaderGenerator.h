@@ -14,7 +14,7 @@ using namespace System::Drawing;
 using namespace System::Runtime::Serialization;
 using System::Runtime::InteropServices::OutAttribute;
 
-namespace ShaderPatcher { class NodeGraph; }
+namespace ShaderPatcher { class NodeGraph; class PreviewShaderGenerator; }
 
 namespace ShaderPatcherLayer 
 {
@@ -183,6 +183,26 @@ namespace ShaderPatcherLayer
         List<PreviewSettings^>^             _previewSettings;
     };
 
+        ///////////////////////////////////////////////////////////////
+    public ref class PreviewShaderGenerator
+    {
+    public:
+            /// <summary>Generates the preview shader for a node, following edits to the graph</summary>
+            /// "parametersOnly" is set when the shader text is unchanged since the previous call,
+            /// and only the cbuffer layout (ie, material parameter values) needs to be updated.
+        Tuple<String^, String^>^ Generate(
+            NodeGraph^ graph, UInt32 previewNodeId, 
+            PreviewSettings^ settings,
+            IEnumerable<KeyValuePair<String^, String^>>^ variableRestrictions,
+            [Out] bool% parametersOnly);
+
+        PreviewShaderGenerator();
+        ~PreviewShaderGenerator();
+        !PreviewShaderGenerator();
+    private:
+        ShaderPatcher::PreviewShaderGenerator* _native;
+    };
+
 }
 
 
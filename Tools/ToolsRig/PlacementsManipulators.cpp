@@ -964,6 +964,79 @@ namespace ToolsRig
         return true;
     }
 
+        //  2D lookup grid for the blue noise points. The cell size matches the 
+        //  rejection distance, so the rejection test only needs to look at the 
+        //  3x3 block of cells around the test point. Points outside of the grid 
+        //  are clamped into the edge cells (so queries are still correct, since 
+        //  queries are always within the circle).
+    class BlueNoiseGrid
+    {
+    public:
+        bool IsGoodPoint(const Float2& testPt, float dRSq) const
+        {
+            auto centre = GetCell(testPt);
+            for (int y=std::max(centre[1]-1, 0); y<=std::min(centre[1]+1, _dims-1); ++y)
+                for (int x=std::max(centre[0]-1, 0); x<=std::min(centre[0]+1, _dims-1); ++x)
+                    for (const auto& p:_cells[y*_dims+x])
+                        if (MagnitudeSquared(testPt - p) < dRSq)
+                            return false;
+            return true;
+        }
+
+        template<typename Fn>
+            void ForEachNeighbour(const Float2& pt, int cellRadius, Fn&& fn) const
+            {
+                auto centre = GetCell(pt);
+                for (int y=std::max(centre[1]-cellRadius, 0); y<=std::min(centre[1]+cellRadius, _dims-1); ++y)
+                    for (int x=std::max(centre[0]-cellRadius, 0); x<=std::min(centre[0]+cellRadius, _dims-1); ++x)
+                        for (const auto& p:_cells[y*_dims+x])
+                            fn(p);
+            }
+
+        void Add(const Float2& pt)
+        {
+            auto cell = GetCell(pt);
+            _cells[cell[1]*_dims+cell[0]].push_back(pt);
+        }
+
+        void Remove(const Float2& pt)
+        {
+            auto cell = GetCell(pt);
+            auto& c = _cells[cell[1]*_dims+cell[0]];
+            for (auto i=c.begin(); i!=c.end(); ++i)
+                if ((*i)[0] == pt[0] && (*i)[1] == pt[1]) {
+                    *i = c[c.size()-1];
+                    c.pop_back();
+                    break;
+                }
+        }
+
+        BlueNoiseGrid(float radius, float cellSize)
+        {
+                //  (round down, so cells are never smaller than "cellSize")
+            const int maxDims = 256;
+            float dims = std::floor(2.f * radius / cellSize);
+            _dims = (dims >= 1.f) ? std::min(int(dims), maxDims) : 1;
+            _mins = Float2(-radius, -radius);
+            _invCellSize = float(_dims) / (2.f * radius);
+            _cells.resize(_dims*_dims);
+        }
+
+    private:
+        std::vector<std::vector<Float2>> _cells;
+        Float2  _mins;
+        float   _invCellSize;
+        int     _dims;
+
+        Int2 GetCell(const Float2& pt) const
+        {
+            auto x = (pt[0] - _mins[0]) * _invCellSize, y = (pt[1] - _mins[1]) * _invCellSize;
+            return Int2(
+                Clamp(int(XlFloor(x)), 0, _dims-1), 
+                Clamp(int(XlFloor(y)), 0, _dims-1));
+        }
+    };
+
 	static void EraseRandomPoints(std::vector<Float2>& workingSet, size_t idealSize, std::mt19937& generator)
 	{
 		// Randomly erase items in the list until we are at the ideal size.
@@ -1000,7 +1073,9 @@ namespace ToolsRig
 			workingSet.erase(workingSet.begin() + *i);
 	}
 
-    static void GenerateBlueNoisePlacements(std::vector<Float2>& workingSet, float radius, unsigned count, std::mt19937& generator)
+    static void GenerateBlueNoisePlacements(
+        std::vector<Float2>& workingSet, float radius, unsigned count, 
+        std::mt19937& generator, BlueNoiseMethod::Enum method)
     {
             //  Create new placements arranged in a equally spaced pattern
             //  around the circle.
@@ -1037,6 +1112,13 @@ namespace ToolsRig
             // erase random objects to reduce the number
 		EraseRandomPoints(workingSet, count, generator);
 
+            //  The lookup grid is only as fine as the rejection distance (and never
+            //  finer than required to contain the circle)
+        const bool useGrid = method == BlueNoiseMethod::Accelerated;
+        BlueNoiseGrid grid(radius, std::sqrt(dRSq));
+        if (useGrid)
+            for (const auto& p:workingSet) grid.Add(p);
+
         const unsigned iterationCount = count; // 2 * count - 1;
         for (unsigned c=0; c<iterationCount && workingSet.size() < count; ++c) {
             assert(!workingSet.empty());
@@ -1055,17 +1137,18 @@ namespace ToolsRig
                     continue;   // bad pt; outside of large radius. We need the centre to be within the large radius
                 }
 
-                    // note -- we can accelerate this test with 
-                    //         a 2d lookup grid 
-                if (IsBlueNoiseGoodPoint(workingSet, pt, dRSq)) {
+                bool goodPt = useGrid ? grid.IsGoodPoint(pt, dRSq) : IsBlueNoiseGoodPoint(workingSet, pt, dRSq);
+                if (goodPt) {
                     gotGoodPt = true;
                     workingSet.push_back(pt);
+                    if (useGrid) grid.Add(pt);
                     break;
                 }
             }
 
                 // if we couldn't find a good connector, we have to erase the original pt 
             if (!gotGoodPt) {
+                if (useGrid) grid.Remove(workingSet[index]);
                 workingSet.erase(workingSet.begin() + index);
 
                     //  Note; there can be weird cases where the original point is remove
@@ -1076,6 +1159,7 @@ namespace ToolsRig
                         Radial2Cart2D(
 							std::uniform_real_distribution<float>(0.f, 2.f * gPI)(generator),
 							(std::uniform_real_distribution<float>(.125f * radius, .25f * radius)(generator))));
+                    if (useGrid) grid.Add(workingSet[0]);
                 }
             }
         }
@@ -1089,6 +1173,11 @@ namespace ToolsRig
             // -- a very strong relax would eventually result in evenly spaced objects
         static float relaxStrength = 0.002f;
         
+            //  When using the grid, we only consider neighbours within a few cells.
+            //  Distant points mostly cancel each other out, so this is only a small
+            //  change to the result (but it's no longer quadratic)
+        const int relaxCellRadius = 3;
+        
         std::vector<Float2> adjustment;
         adjustment.resize(workingSet.size(), Zero<Float2>());
         for (auto bi=workingSet.begin(); bi!=workingSet.end(); ++bi) {
@@ -1096,11 +1185,24 @@ namespace ToolsRig
             float A = (Magnitude(*bi) / radius);
             s *= 1.f - A * A * A;    // (objects near the edges should relax less, otherwise they get moved out of the circle
 
-            for (auto oi=workingSet.begin(); oi!=workingSet.end(); ++oi) {
-                if (bi == oi) continue;
+            auto& adj = adjustment[bi-workingSet.begin()];
+            if (useGrid) {
+                const auto b = *bi;
+                grid.ForEachNeighbour(b, relaxCellRadius,
+                    [b, s, &adj](const Float2& o)
+                    {
+                        Float2 diff = b - o;
+                        auto magSq = MagnitudeSquared(diff);
+                        if (magSq == 0.f) return;   // (this is "b" itself)
+                        adj += diff * (s * relaxStrength * std::log(magSq));
+                    });
+            } else {
+                for (auto oi=workingSet.begin(); oi!=workingSet.end(); ++oi) {
+                    if (bi == oi) continue;
 
-                Float2 diff = (*bi) - (*oi);
-                adjustment[bi-workingSet.begin()] += diff * (s * relaxStrength * std::log(MagnitudeSquared(diff)));
+                    Float2 diff = (*bi) - (*oi);
+                    adj += diff * (s * relaxStrength * std::log(MagnitudeSquared(diff)));
+                }
             }
         }
 
@@ -1108,13 +1210,22 @@ namespace ToolsRig
             *bi += adjustment[bi-workingSet.begin()];
     }
 
+    void GenerateBlueNoisePlacements(
+        std::vector<Float2>& workingSet, float radius, unsigned count, uint32 seed,
+        BlueNoiseMethod::Enum method)
+    {
+        std::mt19937 generator(seed);
+        GenerateBlueNoisePlacements(workingSet, radius, count, generator, method);
+    }
+
     void CalculateScatterOperation(
         std::vector<SceneEngine::PlacementGUID>& _toBeDeleted,
         std::vector<Float3>& _spawnPositions,
         SceneEngine::PlacementsEditor& editor,
         const SceneEngine::IntersectionTestScene& hitTestScene,
         const char* const* modelName, unsigned modelCount,
-        const Float3& centre, float radius, float density)
+        const Float3& centre, float radius, float density,
+        uint32 seed)
     {
         if (!modelCount) return;
 
@@ -1174,7 +1285,9 @@ namespace ToolsRig
               (modelBoundingBox.second[0] - modelBoundingBox.first[0]) 
             * (modelBoundingBox.second[1] - modelBoundingBox.first[1]);
 
-		static std::mt19937 generator(std::random_device().operator()());
+		static std::mt19937 sharedGenerator(std::random_device().operator()());
+        std::mt19937 seededGenerator(seed);
+        auto& generator = seed ? seededGenerator : sharedGenerator;
 
             // randomly remove one existing object
         if (!noisyPts.empty()) {
@@ -1194,22 +1307,27 @@ namespace ToolsRig
 		}
 
         float bigCircleArea = gPI * radius * radius;
-        GenerateBlueNoisePlacements(noisyPts, radius, unsigned(bigCircleArea*density/crossSectionArea), generator);
+        GenerateBlueNoisePlacements(
+            noisyPts, radius, unsigned(bigCircleArea*density/crossSectionArea), 
+            generator, BlueNoiseMethod::Accelerated);
 
             //  Now add new placements for all of these pts.
             //  We need to clamp them to the terrain surface as we do this
-
-        for (auto p=noisyPts.begin(); p!=noisyPts.end(); ++p) {
-            Float2 pt = *p + Truncate(centre);
-            float height = 0.f;
-            auto terrain = hitTestScene.GetTerrain().get();
-            if (terrain) {
-                height = SceneEngine::GetTerrainHeight(
-                    *terrain->GetFormat().get(), terrain->GetConfig(), terrain->GetCoords(), pt);
-            }
-
-            _spawnPositions.push_back(Expand(pt, height));
+            //  (all heights are queried together, so each terrain node is only looked up once)
+
+        for (auto& p:noisyPts) p += Truncate(centre);
+        std::vector<float> heights(noisyPts.size(), 0.f);
+        auto terrain = hitTestScene.GetTerrain().get();
+        if (terrain && !noisyPts.empty()) {
+            SceneEngine::GetTerrainHeights(
+                AsPointer(heights.begin()),
+                *terrain->GetFormat().get(), terrain->GetConfig(), terrain->GetCoords(), 
+                AsPointer(noisyPts.cbegin()), noisyPts.size());
         }
+
+        _spawnPositions.reserve(_spawnPositions.size() + noisyPts.size());
+        for (size_t c=0; c<noisyPts.size(); ++c)
+            _spawnPositions.push_back(Expand(noisyPts[c], heights[c]));
     }
 
     void ScatterPlacements::PerformScatter(
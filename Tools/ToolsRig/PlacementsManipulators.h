@@ -11,6 +11,7 @@
 #include "../../Math/Matrix.h"
 #include "../../Core/Types.h"
 #include <memory>
+#include <vector>
 
 namespace RenderOverlays { namespace DebuggingDisplay { class IInputListener; } }
 namespace RenderCore { namespace Techniques { class ProjectionDesc; class ParsingContext; } }
@@ -79,12 +80,31 @@ namespace ToolsRig
         std::shared_ptr<SceneEngine::PlacementsEditor> editor,
         std::shared_ptr<SceneEngine::PlacementsRenderer> renderer);
 
+    /// <summary>Calculates the objects to delete and create for a scatter brush operation</summary>
+    /// The scatter is random. Pass a non-zero "seed" to get the same result every time
+    /// for the same inputs (otherwise a non-deterministic sequence is used).
     void CalculateScatterOperation(
         std::vector<SceneEngine::PlacementGUID>& _toBeDeleted,
         std::vector<Float3>& _spawnPositions,
         SceneEngine::PlacementsEditor& editor,
         const SceneEngine::IntersectionTestScene& hitTestScene,
         const char* const* modelNames, unsigned modelCount,
-        const Float3& centre, float radius, float density);
+        const Float3& centre, float radius, float density,
+        uint32 seed = 0);
+
+    struct BlueNoiseMethod { enum Enum { Accelerated, Reference }; };
+
+    /// <summary>Adds points to a blue noise distribution within a circle</summary>
+    /// Points in "workingSet" are relative to the centre of the circle. Existing points
+    /// are kept (though some may be randomly removed if there are more than "count"),
+    /// and new points are added, up to "count" (but often fewer will be added).
+    ///
+    /// BlueNoiseMethod::Accelerated uses a 2D lookup grid for the rejection test, and
+    /// limits the relax step to nearby points. BlueNoiseMethod::Reference tests every
+    /// pair of points (it's slow, but useful for comparisons). Both methods make the same
+    /// accept/reject decisions for the same seed.
+    void GenerateBlueNoisePlacements(
+        std::vector<Float2>& workingSet, float radius, unsigned count, uint32 seed,
+        BlueNoiseMethod::Enum method = BlueNoiseMethod::Accelerated);
 }
 
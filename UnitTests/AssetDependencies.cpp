@@ -0,0 +1,133 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Assets/Assets.h"
+#include "../ConsoleRig/Log.h"
+#include <CppUnitTest.h>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    class CountingValidation : public ::Assets::DependencyValidation
+    {
+    public:
+        unsigned _changeCount;
+
+        void OnChange()
+        {
+            ++_changeCount;
+            DependencyValidation::OnChange();
+        }
+
+        CountingValidation() : _changeCount(0) {}
+    };
+
+    TEST_CLASS(AssetDependencies)
+    {
+    public:
+        TEST_METHOD(InvalidateOnce)
+        {
+                //  root -> many intermediate objects -> a single shared sink
+                //  A change to the root must reach everything, and the sink must
+                //  only be invalidated once
+            auto root = std::make_shared<CountingValidation>();
+            auto sink = std::make_shared<CountingValidation>();
+            std::vector<std::shared_ptr<CountingValidation>> middle;
+            for (unsigned c=0; c<100; ++c) {
+                auto m = std::make_shared<CountingValidation>();
+                ::Assets::RegisterAssetDependency(m, root);
+                ::Assets::RegisterAssetDependency(sink, m);
+                middle.push_back(m);
+            }
+
+                // (cycles must not cause infinite propagation)
+            ::Assets::RegisterAssetDependency(root, sink);
+
+            root->OnChange();
+            Assert::AreEqual(1u, root->_changeCount, L"Root invalidated more than once");
+            Assert::AreEqual(1u, sink->_changeCount, L"Shared dependent invalidated more than once");
+            for (const auto& m:middle)
+                Assert::AreEqual(1u, m->_changeCount, L"Dependent not invalidated exactly once");
+
+                //  destroyed dependents are skipped (and removed). The root only holds weak
+                //  links to the objects that depend on it, so these leaves are destroyed as
+                //  soon as we release them
+            std::vector<std::weak_ptr<CountingValidation>> leaves;
+            {
+                std::vector<std::shared_ptr<CountingValidation>> strongLeaves;
+                for (unsigned c=0; c<50; ++c) {
+                    auto l = std::make_shared<CountingValidation>();
+                    ::Assets::RegisterAssetDependency(l, root);
+                    strongLeaves.push_back(l);
+                    leaves.push_back(l);
+                }
+                Assert::AreEqual(150u, root->GetDependentCount());
+            }
+            for (const auto& l:leaves)
+                Assert::IsTrue(l.expired(), L"Leaf kept alive by the dependency graph");
+            Assert::AreEqual(150u, root->GetDependentCount(), L"Expired dependents removed before the next change");
+
+            root->OnChange();
+            Assert::AreEqual(100u, root->GetDependentCount(), L"Expired dependents not removed by change propagation");
+            Assert::AreEqual(2u, sink->_changeCount, L"Shared dependent invalidated more than once");
+            for (const auto& m:middle)
+                Assert::AreEqual(2u, m->_changeCount, L"Dependent not invalidated exactly once");
+
+                //  a change to an intermediate object only reaches downstream objects
+            middle[0]->OnChange();
+            Assert::AreEqual(3u, sink->_changeCount, L"Downstream object not invalidated");
+            Assert::AreEqual(2u, middle[1]->_changeCount, L"Sibling object invalidated");
+        }
+
+        TEST_METHOD(DependencyGraphPerformance)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Simulate loading a large level -- many assets, each depending on a few
+                //  shared objects (eg, shared include files and material libraries)
+            unsigned dependencyCounts[] = { 100000, 1000000 };
+            for (auto dependencyCount:dependencyCounts) {
+                const unsigned sharedCount = 256, depsPerAsset = 4;
+                std::vector<std::shared_ptr<::Assets::DependencyValidation>> shared, assets;
+                for (unsigned c=0; c<sharedCount; ++c)
+                    shared.push_back(std::make_shared<::Assets::DependencyValidation>());
+
+                auto assetCount = dependencyCount / depsPerAsset;
+                assets.reserve(assetCount);
+                for (unsigned c=0; c<assetCount; ++c)
+                    assets.push_back(std::make_shared<::Assets::DependencyValidation>());
+
+                std::mt19937 rng(1824);
+                auto t0 = __rdtsc();
+                for (unsigned c=0; c<assetCount; ++c)
+                    for (unsigned d=0; d<depsPerAsset; ++d)
+                        ::Assets::RegisterAssetDependency(assets[c], shared[rng() % sharedCount]);
+                auto t1 = __rdtsc();
+
+                    //  Fan-out invalidation -- a single root that everything depends on
+                    //  (through the shared objects)
+                auto root = std::make_shared<::Assets::DependencyValidation>();
+                for (const auto& s:shared)
+                    ::Assets::RegisterAssetDependency(s, root);
+
+                auto t2 = __rdtsc();
+                root->OnChange();
+                auto t3 = __rdtsc();
+
+                for (const auto& a:assets)
+                    Assert::AreEqual(1u, a->GetValidationIndex(), L"Asset not invalidated exactly once");
+
+                LogAlwaysWarning
+                    << "Asset dependencies (" << dependencyCount << "). Cycles per registration: " << (t1-t0) / dependencyCount
+                    << ". Fan-out invalidation of " << assetCount << " assets: " << (t3-t2) << " cycles";
+            }
+        }
+    };
+}
+
@@ -0,0 +1,154 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../SceneEngine/CloudsForm.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/StringFormat.h"
+#include <CppUnitTest.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace SceneEngine;
+    using Field = CloudsForm2D::Field;
+    using UpdateMethod = CloudsForm2D::UpdateMethod;
+
+        //  Largest difference between the fields, relative to the range of values in the reference field
+    static float RelativeDifference(const float reference[], const float test[], unsigned count)
+    {
+        float minValue = reference[0], maxValue = reference[0], maxDifference = 0.f;
+        for (unsigned c=0; c<count; ++c) {
+            minValue = std::min(minValue, reference[c]);
+            maxValue = std::max(maxValue, reference[c]);
+            maxDifference = std::max(maxDifference, std::abs(reference[c] - test[c]));
+        }
+        return maxDifference / std::max(maxValue - minValue, 1e-12f);
+    }
+
+    static CloudsForm2D::Settings MakeTestSettings(UpdateMethod::Enum method)
+    {
+            //  Start supersaturated, so the condensation & latent heat parts of the
+            //  simulation have something to do from the first tick
+        CloudsForm2D::Settings settings;
+        settings._relativeHumidity = 1.05f;
+        settings._updateMethod = method;
+        return settings;
+    }
+
+    TEST_CLASS(CloudsSimulation)
+    {
+    public:
+        TEST_METHOD(UpdateMethodsMatchReference)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const UInt2 dims(64, 48);
+            const float deltaTime = 1.f / 30.f;
+            Field::Enum fields[] = { Field::VelocityU, Field::VelocityV, Field::Vapor, Field::Condensed, Field::PotentialTemperature };
+            const wchar_t* fieldNames[] = { L"VelocityU", L"VelocityV", L"Vapor", L"Condensed", L"PotentialTemperature" };
+
+            UpdateMethod::Enum methods[] = { UpdateMethod::Tables, UpdateMethod::ParallelTables };
+            for (auto method:methods) {
+                CloudsForm2D reference(dims), test(dims);
+                auto referenceSettings = MakeTestSettings(UpdateMethod::Reference);
+                auto testSettings = MakeTestSettings(method);
+
+                    //  Small differences (from the saturation pressure table & the order of
+                    //  floating point operations) can grow over time, so the tolerance is
+                    //  larger after a few ticks
+                const unsigned tickCount = 8;
+                for (unsigned t=0; t<tickCount; ++t) {
+                    reference.Tick(deltaTime, referenceSettings);
+                    test.Tick(deltaTime, testSettings);
+
+                    const auto tolerance = (t==0) ? 1e-3f : 1e-2f;
+                    auto fieldDims = reference.GetDimensions();
+                    for (unsigned f=0; f<dimof(fields); ++f) {
+                        auto diff = RelativeDifference(reference.GetField(fields[f]), test.GetField(fields[f]), fieldDims[0]*fieldDims[1]);
+                        Assert::IsTrue(diff <= tolerance, fieldNames[f]);
+                    }
+                }
+
+                    //  Make sure the test actually exercised condensation
+                auto condensed = reference.GetField(Field::Condensed);
+                auto fieldDims = reference.GetDimensions();
+                Assert::IsTrue(*std::max_element(condensed, condensed + fieldDims[0]*fieldDims[1]) > 0.f, L"No condensation occurred");
+            }
+        }
+
+        TEST_METHOD(CloudsForm3DTick)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            CloudsForm3D sim(UInt3(24, 24, 16));
+            auto settings = MakeTestSettings(UpdateMethod::ParallelTables);
+            for (unsigned t=0; t<4; ++t)
+                sim.Tick(1.f / 30.f, settings);
+
+            auto dims = sim.GetDimensions();
+            auto count = dims[0]*dims[1]*dims[2];
+            Field::Enum fields[] = { Field::VelocityU, Field::VelocityV, Field::VelocityW, Field::Vapor, Field::Condensed, Field::PotentialTemperature };
+            for (auto f:fields) {
+                auto data = sim.GetField(f);
+                for (unsigned c=0; c<count; ++c)
+                    Assert::IsTrue(std::isfinite(data[c]), L"Non-finite value in 3D clouds simulation");
+            }
+
+            auto condensed = sim.GetField(Field::Condensed);
+            Assert::IsTrue(*std::max_element(condensed, condensed + count) > 0.f, L"No condensation occurred");
+        }
+
+        TEST_METHOD(CloudsSimulationPerformance)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned warmUpTicks = 2, tickCount = 20;
+            const float deltaTime = 1.f / 30.f;
+            const auto frequency = GetPerformanceCounterFrequency();
+
+            UpdateMethod::Enum methods[] = { UpdateMethod::Reference, UpdateMethod::Tables, UpdateMethod::ParallelTables };
+            const char* methodNames[] = { "reference", "tables", "parallel tables" };
+
+            unsigned sizes2D[] = { 64, 128, 256 };
+            for (auto size:sizes2D) {
+                StringMeld<256> results;
+                for (unsigned m=0; m<dimof(methods); ++m) {
+                    CloudsForm2D sim(UInt2(size, size));
+                    auto settings = MakeTestSettings(methods[m]);
+                    for (unsigned t=0; t<warmUpTicks; ++t) sim.Tick(deltaTime, settings);
+
+                    auto t0 = GetPerformanceCounter();
+                    for (unsigned t=0; t<tickCount; ++t) sim.Tick(deltaTime, settings);
+                    auto t1 = GetPerformanceCounter();
+                    results << methodNames[m] << ": " << float(tickCount) * float(frequency) / float(t1-t0) << " ";
+                }
+                LogAlwaysWarning << "Clouds 2D (" << size << "x" << size << "). Steps per second -- " << results.get();
+            }
+
+            unsigned sizes3D[] = { 16, 32, 48 };
+            for (auto size:sizes3D) {
+                StringMeld<256> results;
+                for (unsigned m=1; m<dimof(methods); ++m) {
+                    CloudsForm3D sim(UInt3(size, size, size/2));
+                    auto settings = MakeTestSettings(methods[m]);
+                    for (unsigned t=0; t<warmUpTicks; ++t) sim.Tick(deltaTime, settings);
+
+                    auto t0 = GetPerformanceCounter();
+                    for (unsigned t=0; t<tickCount; ++t) sim.Tick(deltaTime, settings);
+                    auto t1 = GetPerformanceCounter();
+                    results << methodNames[m] << ": " << float(tickCount) * float(frequency) / float(t1-t0) << " ";
+                }
+                LogAlwaysWarning << "Clouds 3D (" << size << "x" << size << "x" << size/2 << "). Steps per second -- " << results.get();
+            }
+        }
+    };
+}
+
@@ -0,0 +1,180 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/Material.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/ConfigFileContainer.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/StringFormat.h"
+#include <CppUnitTest.h>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace RenderCore::Assets;
+
+        //  Build a material library, something like what the exporter writes for a large
+        //  level (every material in a single file, referenced section by section)
+    static std::string BuildMaterialLibrary(unsigned sectionCount)
+    {
+        std::stringstream str;
+        str << "~~!Format=1; Tab=4" << std::endl;
+        for (unsigned c=0; c<sectionCount; ++c) {
+            char name[16];
+            _snprintf_s(name, _TRUNCATE, "Mat%04i", c);
+            str << "~" << name << std::endl;
+            if (c) str << "\t~Inherit; library:Mat" << (c/2) << std::endl;
+            str << "\t~Constants; MetalMin=" << float(c%10) / 10.f << "f; RoughnessMin=0.1f; Layer=" << c << "u" << std::endl;
+            str << "\t~ResourceBindings; DiffuseTexture=" << name << "_df.dds; NormalsTexture=" << name << "_ddn.dds" << std::endl;
+            if (c%3==0) str << "\t~States; DoubleSided=1u" << std::endl;
+            if (c%5==0) str << "\t~ShaderParams; MAT_ALPHA_TEST=1" << std::endl;
+            if (c%7==0) str << "~~ comment between sections" << std::endl;
+        }
+            // last section has no trailing new line
+        str << "~Last" << std::endl << "\t~Constants; Layer=1u";
+        return str.str();
+    }
+
+    static void WriteTestFile(const char filename[], const std::string& contents)
+    {
+        BasicFile file(filename, "wb");
+        file.Write(contents.c_str(), 1, contents.size());
+    }
+
+        //  This is the way ConfigFileListContainer used to find a section -- load the
+        //  entire file and scan through it, skipping every other element
+    static RawMaterial LoadSectionReference(const char filename[], const char sectionName[])
+    {
+        size_t fileSize = 0;
+        auto sourceFile = LoadFileAsMemoryBlock(filename, &fileSize);
+        auto searchRules = ::Assets::DefaultDirectorySearchRules(filename);
+        InputStreamFormatter<utf8> formatter(
+            MemoryMappedInputStream(sourceFile.get(), PtrAdd(sourceFile.get(), fileSize)));
+
+        using Blob = InputStreamFormatter<utf8>::Blob;
+        for (;;) {
+            auto next = formatter.PeekNext();
+            if (next == Blob::BeginElement) {
+                InputStreamFormatter<utf8>::InteriorSection eleName;
+                formatter.TryBeginElement(eleName);
+                if (XlEqStringI(StringSection<char>((const char*)eleName.begin(), (const char*)eleName.end()), sectionName)) {
+                    RawMaterial result(formatter, searchRules);
+                    formatter.TryEndElement();
+                    return std::move(result);
+                }
+                formatter.SkipElement();
+                formatter.TryEndElement();
+            } else if (next == Blob::AttributeName) {
+                InputStreamFormatter<utf8>::InteriorSection name, value;
+                formatter.TryAttribute(name, value);
+            } else
+                break;
+        }
+        return RawMaterial();
+    }
+
+    static bool Equivalent(const RawMaterial& lhs, const RawMaterial& rhs)
+    {
+        return  lhs._techniqueConfig == rhs._techniqueConfig
+            &&  lhs._inherit == rhs._inherit
+            &&  lhs._resourceBindings.GetHash() == rhs._resourceBindings.GetHash()
+            &&  lhs._resourceBindings.GetParameterNamesHash() == rhs._resourceBindings.GetParameterNamesHash()
+            &&  lhs._matParamBox.GetHash() == rhs._matParamBox.GetHash()
+            &&  lhs._matParamBox.GetParameterNamesHash() == rhs._matParamBox.GetParameterNamesHash()
+            &&  lhs._constants.GetHash() == rhs._constants.GetHash()
+            &&  lhs._constants.GetParameterNamesHash() == rhs._constants.GetParameterNamesHash()
+            &&  lhs._stateSet.GetHash() == rhs._stateSet.GetHash();
+    }
+
+    static const char TestLibraryFile[] = "int/configsectionstest.material";
+
+    TEST_CLASS(ConfigFileSections)
+    {
+    public:
+        TEST_METHOD(SectionsMatchReference)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+            const unsigned sectionCount = 64;
+            WriteTestFile(TestLibraryFile, BuildMaterialLibrary(sectionCount));
+            ::Assets::Internal::ConfigFileSections_Clear();
+
+            using Meld = StringMeld<MaxPath, ::Assets::ResChar>;
+            auto checkSection = [](const char sectionName[], const char lookupName[])
+            {
+                auto reference = LoadSectionReference(TestLibraryFile, sectionName);
+                RawMaterial::Container container((const ::Assets::ResChar*)(Meld() << TestLibraryFile << ":" << lookupName));
+                Assert::IsTrue(Equivalent(reference, container._asset), L"Section loaded from cache doesn't match reference");
+            };
+
+            for (unsigned c=0; c<sectionCount; ++c) {
+                char name[16];
+                _snprintf_s(name, _TRUNCATE, "Mat%04i", c);
+                checkSection(name, name);
+            }
+            checkSection("Last", "Last");           // (no trailing new line)
+            checkSection("Mat0007", "mAT0007");     // (section names are case insensitive)
+            checkSection("Missing", "Missing");     // (missing sections give default values)
+
+                //  The file is loaded & indexed only once
+            auto sections = ::Assets::Internal::GetConfigFileSections(TestLibraryFile);
+            Assert::AreEqual(size_t(sectionCount+1), sections->GetSectionCount(), L"Wrong number of sections in index");
+            Assert::IsTrue(sections == ::Assets::Internal::GetConfigFileSections(TestLibraryFile), L"File was not cached");
+
+                //  Changes to the file invalidate the cache entry and the containers
+            RawMaterial::Container container((const ::Assets::ResChar*)(Meld() << TestLibraryFile << ":Mat0001"));
+            sections->GetDependencyValidation()->OnChange();
+            Assert::AreNotEqual(0u, container.GetDependencyValidation()->GetValidationIndex(), L"Container not invalidated by file change");
+            Assert::IsFalse(sections == ::Assets::Internal::GetConfigFileSections(TestLibraryFile), L"Invalidated file not reloaded");
+
+            ::Assets::Internal::ConfigFileSections_Clear();
+        }
+
+        TEST_METHOD(ConfigFileSectionsPerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+            unsigned sectionCounts[] = { 100, 500, 2000 };
+            for (auto sectionCount:sectionCounts) {
+                auto library = BuildMaterialLibrary(sectionCount);
+                WriteTestFile(TestLibraryFile, library);
+                ::Assets::Internal::ConfigFileSections_Clear();
+
+                    //  Load every section from the file, once the old way, and once
+                    //  through the section cache (including the initial load & index)
+                std::vector<std::string> names;
+                for (unsigned c=0; c<sectionCount; ++c) {
+                    char name[16];
+                    _snprintf_s(name, _TRUNCATE, "Mat%04i", c);
+                    names.push_back(name);
+                }
+
+                auto t0 = __rdtsc();
+                for (const auto& n:names)
+                    LoadSectionReference(TestLibraryFile, n.c_str());
+                auto t1 = __rdtsc();
+                for (const auto& n:names)
+                    RawMaterial::Container container((const ::Assets::ResChar*)(StringMeld<MaxPath, ::Assets::ResChar>() << TestLibraryFile << ":" << n.c_str()));
+                auto t2 = __rdtsc();
+
+                LogAlwaysWarning
+                    << "Config file sections (" << sectionCount << " sections, " << library.size() / 1024 << "KB). Cycles per section -- full scan: "
+                    << (t1-t0) / sectionCount << ", section cache: " << (t2-t1) / sectionCount;
+            }
+
+            ::Assets::Internal::ConfigFileSections_Clear();
+        }
+    };
+}
+
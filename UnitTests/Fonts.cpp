@@ -0,0 +1,74 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderOverlays/Font.h"
+#include "../RenderOverlays/FT_Font.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    TEST_CLASS(Fonts)
+    {
+    public:
+        TEST_METHOD(GlyphMissThroughput)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Without a device or buffer uploads manager, the font system doesn't
+                //  create textures. But glyphs are still rasterised and packed into the
+                //  atlas pages, so we can measure the cost of glyph misses headlessly.
+            Assert::IsTrue(RenderOverlays::InitFontSystem(nullptr, nullptr), L"Font system initialisation failed");
+
+            {
+                std::vector<intrusive_ptr<RenderOverlays::Font>> fonts;
+                for (int size=8; size<=40; size+=2)
+                    fonts.push_back(RenderOverlays::GetX2Font("Vera", size));
+
+                auto start = __rdtsc();
+                unsigned lookups = 0;
+                for (const auto& f:fonts)
+                    for (ucs4 ch=32; ch<256; ++ch) {
+                        auto c = f->GetChar(ch);
+                        Assert::IsNotNull(c.first, L"Missing glyph");
+                        ++lookups;
+                    }
+                auto middle = __rdtsc();
+
+                    //  Wait for the background rasterisation to complete
+                for (unsigned c=0; c<1000; ++c) {
+                    RenderOverlays::UpdateFontSystem();
+                    if (!RenderOverlays::GetFTFontTextureMetrics()._pendingGlyphs) break;
+                    Threading::Sleep(1);
+                }
+                auto middle2 = __rdtsc();
+
+                for (const auto& f:fonts)
+                    for (ucs4 ch=32; ch<256; ++ch)
+                        f->GetChar(ch);
+                auto end = __rdtsc();
+
+                auto metrics = RenderOverlays::GetFTFontTextureMetrics();
+                Assert::AreEqual(0u, metrics._pendingGlyphs, L"Background rasterisation did not complete");
+
+                LogAlwaysWarning << "Glyph lookups: " << lookups << " (" << metrics._glyphMisses << " misses)";
+                LogAlwaysWarning << "Misses: " << (middle-start) / lookups << " cycles per lookup";
+                LogAlwaysWarning << "Background rasterisation completed after " << (middle2-middle) << " cycles";
+                LogAlwaysWarning << "Hits: " << (end-middle2) / lookups << " cycles per lookup";
+                LogAlwaysWarning << "Atlas: " << metrics._pageCount << " pages, " << metrics._pageUpdates << " page updates (" << metrics._pageUpdateBytes << " bytes), "
+                    << metrics._shelfEvictions << " shelf evictions, " << metrics._allocationFailures << " allocation failures";
+            }
+
+            RenderOverlays::CleanupFontSystem();
+        }
+    };
+}
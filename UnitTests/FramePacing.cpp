@@ -0,0 +1,110 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../PlatformRig/FramePacing.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/TimeUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    TEST_CLASS(FramePacing)
+    {
+    public:
+        TEST_METHOD(FrameTimeHistogramPercentiles)
+        {
+            PlatformRig::FrameTimeHistogram histogram;
+            auto ticksPerMillisecond = GetPerformanceCounterFrequency() / 1000;
+
+                //  100 frames of 10ms, 4 frames of 50ms
+            for (unsigned c=0; c<100; ++c)
+                histogram.PushFrameDuration(10 * ticksPerMillisecond);
+            for (unsigned c=0; c<4; ++c)
+                histogram.PushFrameDuration(50 * ticksPerMillisecond);
+
+            auto p = histogram.GetPercentiles();
+            Assert::AreEqual(10.f, p._p50, 0.01f, L"Incorrect 50th percentile");
+            Assert::AreEqual(10.f, p._p95, 0.01f, L"Incorrect 95th percentile");
+            Assert::AreEqual(50.f, p._p99, 0.01f, L"Incorrect 99th percentile");
+            Assert::AreEqual(4u, p._hitches, L"Incorrect hitch count in window");
+            Assert::AreEqual(4u, histogram.GetTotalHitches(), L"Incorrect total hitch count");
+
+            auto stats = histogram.GetPerformanceStats();
+            Assert::AreEqual(10.f, std::get<1>(stats), 0.01f, L"Incorrect min frame time");
+            Assert::AreEqual(50.f, std::get<2>(stats), 0.01f, L"Incorrect max frame time");
+
+                //  Old frames should fall out of the window
+            for (unsigned c=0; c<PlatformRig::FrameTimeHistogram::WindowSize; ++c)
+                histogram.PushFrameDuration(10 * ticksPerMillisecond);
+            Assert::AreEqual(0u, histogram.GetPercentiles()._hitches, L"Hitches did not leave the window");
+        }
+
+        TEST_METHOD(FramePacerSimulatedWorkload)
+        {
+            const auto frequency = GetPerformanceCounterFrequency();
+            const unsigned targetFPS = 100;
+            const unsigned frameCount = 200;
+            const auto interval = frequency / targetFPS;
+
+            PlatformRig::FramePacer pacer;
+            pacer.SetTargetInterval(interval);
+
+                //  Simulate a frame with a variable amount of work (between 2 and 6ms),
+                //  using a busy loop so that the workload doesn't itself sleep
+            uint32 seed = 0x5eed;
+            uint64 workTime = 0;
+            std::vector<uint64> frameStarts;
+            frameStarts.reserve(frameCount);
+
+            auto testStart = GetPerformanceCounter();
+            for (unsigned c=0; c<frameCount; ++c) {
+                frameStarts.push_back(pacer.WaitForFrameStart());
+
+                seed = seed * 1664525u + 1013904223u;
+                auto workDuration = (frequency / 1000) * (2 + ((seed >> 16) % 5));
+                auto workStart = GetPerformanceCounter();
+                while (GetPerformanceCounter() < workStart + workDuration) {}
+                workTime += GetPerformanceCounter() - workStart;
+            }
+            auto testEnd = GetPerformanceCounter();
+
+            double toMilliseconds = 1000.0 / double(frequency);
+            double sumError = 0.0, sumSqError = 0.0, maxError = 0.0;
+            for (unsigned c=1; c<frameCount; ++c) {
+                double error = double(frameStarts[c] - frameStarts[c-1]) * toMilliseconds - double(interval) * toMilliseconds;
+                sumError += error;
+                sumSqError += error * error;
+                maxError = std::max(maxError, std::abs(error));
+            }
+            double meanError = sumError / double(frameCount-1);
+            double jitter = std::sqrt(sumSqError / double(frameCount-1) - meanError * meanError);
+
+                //  The pacer only keeps us busy while spinning. Everything else is
+                //  either the simulated workload or sleeping
+            auto metrics = pacer.GetMetrics();
+            double wallTime = double(testEnd - testStart);
+            double pacerBusyFraction = double(metrics._spinTime) / wallTime;
+            double busyFraction = double(workTime + metrics._spinTime) / wallTime;
+
+            LogAlwaysWarning << "Frame pacing at " << targetFPS << "Hz: mean error " << meanError << "ms, jitter (std dev) " << jitter << "ms, max error " << maxError << "ms";
+            LogAlwaysWarning << "CPU use: " << 100.0 * busyFraction << "% (workload + spin), " << 100.0 * pacerBusyFraction << "% spinning in pacer";
+            LogAlwaysWarning << "Slept for " << double(metrics._sleepTime) * toMilliseconds << "ms, spun for " << double(metrics._spinTime) * toMilliseconds << "ms, "
+                << metrics._oversleeps << " oversleeps, " << metrics._reanchors << " reanchors, estimated sleep overshoot " << double(metrics._sleepOvershootEstimate) * toMilliseconds << "ms";
+
+                //  Because deadlines are on an absolute timeline, the average frame interval
+                //  should match the target closely, even if individual frames are late
+            double averageInterval = double(frameStarts[frameCount-1] - frameStarts[0]) * toMilliseconds / double(frameCount-1);
+            Assert::AreEqual(1000.0 / double(targetFPS), averageInterval, 0.5, L"Frame pacing drifted away from the target rate");
+            Assert::IsTrue(pacerBusyFraction < 0.5, L"Frame pacer spent most of its time spinning");
+        }
+    };
+}
+
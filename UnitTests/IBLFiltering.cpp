@@ -0,0 +1,361 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Samples/TextureTransform/IBLPrecalc.h"
+#include "../ConsoleRig/Log.h"
+#include "../Math/Math.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/TimeUtils.h"
+#include <CppUnitTest.h>
+#include <functional>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace TextureTransform;
+    using EnvironmentFn = std::function<Float3(Float3)>;     // world space direction -> radiance
+
+        //  Builds a cubemap (with a full mip chain) from an analytic environment
+    static FloatCubeMap BuildCubeMap(unsigned faceDim, const EnvironmentFn& environment)
+    {
+        unsigned mipCount = 1;
+        while ((faceDim >> mipCount) != 0) ++mipCount;
+        FloatCubeMap result(faceDim, mipCount);
+        for (unsigned f=0; f<6; ++f) {
+            auto* texels = result.GetFace(f);
+            for (unsigned y=0; y<faceDim; ++y)
+                for (unsigned x=0; x<faceDim; ++x) {
+                    Float2 tc((float(x)+.5f)/float(faceDim), (float(y)+.5f)/float(faceDim));
+                    auto radiance = environment(CubeMapToWorld(CubeMapDirection(f, tc)));
+                    texels[y*faceDim+x] = Float4(radiance[0], radiance[1], radiance[2], 1.f);
+                }
+        }
+        GenerateCubeMapMipmaps(result);
+        return std::move(result);
+    }
+
+    static float RelativeError(Float3 expected, Float4 actual)
+    {
+        float result = 0.f;
+        for (unsigned c=0; c<3; ++c)
+            result = std::max(result, std::abs(actual[c] - expected[c]) / std::max(std::abs(expected[c]), 1e-3f));
+        return result;
+    }
+
+    static Float2 TexelCenter(unsigned x, unsigned y, unsigned dim)
+    {
+        return Float2((float(x)+.5f)/float(dim), (float(y)+.5f)/float(dim));
+    }
+
+    TEST_CLASS(IBLFiltering)
+    {
+    public:
+        TEST_METHOD(IBLCubeMapMapping)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  CubeMapFace must be the inverse of CubeMapDirection
+            std::mt19937 rng(2345);
+            std::uniform_real_distribution<float> dist(-1.f, 1.f);
+            for (unsigned c=0; c<10000; ++c) {
+                Float3 direction(dist(rng), dist(rng), dist(rng));
+                if (MagnitudeSquared(direction) < 1e-4f) continue;
+                direction = Normalize(direction);
+
+                Float2 texCoord;
+                auto face = CubeMapFace(direction, texCoord);
+                Assert::IsTrue(face < 6 && texCoord[0] >= 0.f && texCoord[0] <= 1.f && texCoord[1] >= 0.f && texCoord[1] <= 1.f, L"Bad cubemap texture coordinate");
+                auto roundTrip = CubeMapDirection(face, texCoord);
+                Assert::IsTrue(MagnitudeSquared(roundTrip - direction) < 1e-8f, L"CubeMapFace is not the inverse of CubeMapDirection");
+            }
+
+                //  Face centers (D3D face order)
+            const Float3 centers[] = { Float3(1,0,0), Float3(-1,0,0), Float3(0,1,0), Float3(0,-1,0), Float3(0,0,1), Float3(0,0,-1) };
+            for (unsigned f=0; f<6; ++f)
+                Assert::IsTrue(MagnitudeSquared(CubeMapDirection(f, Float2(.5f, .5f)) - centers[f]) < 1e-10f, L"Wrong face order");
+
+                //  CubeMapToWorld undoes AdjSkyCubeMapCoords (which is float3(x, z, -y))
+            Float3 world(.2f, -.4f, .7f);
+            auto adj = Float3(world[0], world[2], -world[1]);
+            Assert::IsTrue(MagnitudeSquared(CubeMapToWorld(adj) - world) < 1e-10f, L"CubeMapToWorld doesn't match AdjSkyCubeMapCoords");
+        }
+
+        TEST_METHOD(IBLEquirectangularMapping)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Encode the (cubemap space) direction of every texel in an equirectangular
+                //  image. This is the inverse of the mapping used by EquiRectFilterGlossySpecular.
+                //  After conversion into a cubemap, every texel should contain its own direction.
+            const UInt2 dims(1024, 512);
+            std::vector<Float4> equirect(dims[0]*dims[1]);
+            for (unsigned y=0; y<dims[1]; ++y)
+                for (unsigned x=0; x<dims[0]; ++x) {
+                    float u = (float(x)+.5f)/float(dims[0]), v = (float(y)+.5f)/float(dims[1]);
+                    float inc = (.5f - v) * gPI;
+                    float theta = (-u - .5f) * 2.f * gPI;
+                    equirect[y*dims[0]+x] = Float4(
+                        -std::cos(inc) * std::cos(theta), std::sin(inc), std::cos(inc) * std::sin(theta), 1.f);
+                }
+
+            auto cubeMap = CubeMapFromEquirectangular(AsPointer(equirect.begin()), dims, 64, 7);
+            Assert::AreEqual(7u, cubeMap.GetMipCount());
+            for (unsigned f=0; f<6; ++f) {
+                auto* texels = cubeMap.GetFace(f);
+                for (unsigned y=0; y<64; ++y)
+                    for (unsigned x=0; x<64; ++x) {
+                        auto expected = CubeMapDirection(f, TexelCenter(x, y, 64));
+                        const auto& t = texels[y*64+x];
+                        auto error = MagnitudeSquared(Float3(t[0], t[1], t[2]) - expected);
+                        Assert::IsTrue(error < 1e-4f, L"Equirectangular direction mapping doesn't match");
+                    }
+            }
+        }
+
+        TEST_METHOD(IBLConstantEnvironment)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  With a constant environment, every mipmap of the specular texture should be
+                //  the same constant (the weights are normalized), and the irradiance should be
+                //  pi times the radiance
+            const Float3 radiance(.5f, 1.f, 2.f);
+            auto source = BuildCubeMap(32, [&](Float3) { return radiance; });
+
+            FloatCubeMap specular(32, 6);
+            FilterGlossySpecular(specular, source, 128);
+            for (unsigned m=0; m<specular.GetMipCount(); ++m)
+                for (unsigned f=0; f<6; ++f) {
+                    auto dim = specular.GetFaceDim(m);
+                    auto* texels = specular.GetFace(f, m);
+                    for (unsigned c=0; c<dim*dim; ++c)
+                        Assert::IsTrue(RelativeError(radiance, texels[c]) < 1e-4f, L"Specular filtering doesn't preserve a constant environment");
+                }
+
+            FloatCubeMap diffuse(16, 5);
+            BuildIrradianceCubeMap(diffuse, ProjectToSH(source));
+            for (unsigned m=0; m<diffuse.GetMipCount(); ++m)
+                for (unsigned f=0; f<6; ++f) {
+                    auto dim = diffuse.GetFaceDim(m);
+                    auto* texels = diffuse.GetFace(f, m);
+                    for (unsigned c=0; c<dim*dim; ++c)
+                        Assert::IsTrue(RelativeError(gPI * radiance, texels[c]) < 1e-3f, L"Irradiance of a constant environment should be pi * radiance");
+                }
+        }
+
+        TEST_METHOD(IBLIrradianceAnalytic)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  For L(w) = a + dot(b, w), the irradiance is pi * a + 2 * pi / 3 * dot(b, n)
+            const float a = 2.f;
+            const Float3 b(.5f, -.3f, .8f);
+            auto linearSH = ProjectToSH(BuildCubeMap(64, [&](Float3 w) { float l = a + Dot(b, w); return Float3(l, l, l); }));
+
+                //  For L(w) = w.z^2, the irradiance is pi/2 for n = +/-Z, and pi/4 for any n in the XY plane
+                //  (this only has a band 0 and a band 2 component)
+            auto quadraticSH = ProjectToSH(BuildCubeMap(64, [](Float3 w) { float l = w[2]*w[2]; return Float3(l, l, l); }));
+
+            std::mt19937 rng(6789);
+            std::uniform_real_distribution<float> dist(-1.f, 1.f);
+            for (unsigned c=0; c<256; ++c) {
+                auto normal = Normalize(Float3(dist(rng), dist(rng), dist(rng)));
+                float expected = gPI * a + (2.f * gPI / 3.f) * Dot(b, normal);
+                auto irradiance = CalculateIrradiance(linearSH, normal);
+                Assert::IsTrue(RelativeError(Float3(expected, expected, expected), Float4(irradiance[0], irradiance[1], irradiance[2], 1.f)) < 2e-3f, L"Wrong irradiance for linear environment");
+
+                    //  E(n) = pi/3 + pi/6 * P2(n.z) (where P2 is the Legendre polynomial)
+                float p2 = .5f * (3.f * normal[2] * normal[2] - 1.f);
+                expected = gPI / 3.f + gPI / 6.f * p2;
+                irradiance = CalculateIrradiance(quadraticSH, normal);
+                Assert::IsTrue(RelativeError(Float3(expected, expected, expected), Float4(irradiance[0], irradiance[1], irradiance[2], 1.f)) < 2e-3f, L"Wrong irradiance for quadratic environment");
+            }
+
+            auto up = CalculateIrradiance(quadraticSH, Float3(0.f, 0.f, 1.f));
+            auto side = CalculateIrradiance(quadraticSH, Float3(1.f, 0.f, 0.f));
+            Assert::IsTrue(std::abs(up[0] - .5f * gPI) < 2e-3f && std::abs(side[0] - .25f * gPI) < 2e-3f, L"Wrong irradiance for quadratic environment");
+        }
+
+        TEST_METHOD(IBLSpecularAnalytic)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const float a = 1.f;
+            const Float3 b(.3f, .5f, -.2f);
+            auto smooth = [&](Float3 w) { float l = a + Dot(b, w) + .25f * w[2] * w[2]; return Float3(l, .5f*l, 2.f*l); };
+            auto source = BuildCubeMap(128, smooth);
+
+            FloatCubeMap specular(32, 9);
+            FilterGlossySpecular(specular, source, 256);
+
+                //  At the lowest roughness, the result should be very close to the environment itself
+            for (unsigned f=0; f<6; ++f) {
+                auto* texels = specular.GetFace(f, 0);
+                for (unsigned y=0; y<32; ++y)
+                    for (unsigned x=0; x<32; ++x) {
+                        auto expected = smooth(CubeMapToWorld(CubeMapDirection(f, TexelCenter(x, y, 32))));
+                        Assert::IsTrue(RelativeError(expected, texels[y*32+x]) < 1e-2f, L"Low roughness specular should match the environment");
+                    }
+            }
+
+                //  For a linear environment, the lobe is symmetrical around the normal, so the
+                //  result is a + k * dot(b, n) (for some k between 0 and 1 that depends on the
+                //  roughness). So the average of opposite directions should be "a".
+            auto linear = BuildCubeMap(128, [&](Float3 w) { float l = a + Dot(b, w); return Float3(l, l, l); });
+            FloatCubeMap linearSpecular(16, 5);
+            FilterGlossySpecular(linearSpecular, linear, 512);
+            for (unsigned m=0; m<linearSpecular.GetMipCount(); ++m) {
+                auto dim = linearSpecular.GetFaceDim(m);
+                for (unsigned f=0; f<6; ++f)
+                    for (unsigned y=0; y<dim; ++y)
+                        for (unsigned x=0; x<dim; ++x) {
+                            auto direction = CubeMapDirection(f, TexelCenter(x, y, dim));
+                            Float2 oppositeTC;
+                            auto oppositeFace = CubeMapFace(-direction, oppositeTC);
+                            unsigned ox = std::min(unsigned(oppositeTC[0] * float(dim)), dim-1);
+                            unsigned oy = std::min(unsigned(oppositeTC[1] * float(dim)), dim-1);
+
+                            float value = linearSpecular.GetFace(f, m)[y*dim+x][0];
+                            float opposite = linearSpecular.GetFace(oppositeFace, m)[oy*dim+ox][0];
+                            Assert::IsTrue(std::abs(.5f * (value + opposite) - a) < 1e-2f, L"Specular lobe isn't symmetrical");
+
+                            float bDotN = Dot(b, CubeMapToWorld(direction));
+                            if (std::abs(bDotN) > .2f) {
+                                float k = (value - a) / bDotN;
+                                Assert::IsTrue(k > 0.f && k < 1.05f, L"Specular lobe scale out of range");
+                            }
+                        }
+            }
+        }
+
+        TEST_METHOD(IBLSpecularMatchesReference)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Compare against a brute force integration over every texel of the source.
+                //  With "normal == view direction", and each sample weighted by the full
+                //  specular equation over the sampling pdf, the filter lobe for a direction L is:
+                //      G(NdotL) * D(NdotH) / NdotH      (where H = normalize(N + L))
+                //  The environment has a soft "sun" lobe, so the shape of the filter matters.
+            const Float3 sunDirection = Normalize(Float3(.3f, .4f, .8f));
+            auto environment = [&](Float3 w) { float l = 1.f + 5.f * std::pow(std::max(0.f, Dot(w, sunDirection)), 8.f); return Float3(l, l, l); };
+            const unsigned sourceDim = 64;
+            auto source = BuildCubeMap(sourceDim, environment);
+
+            FloatCubeMap specular(16, 9);
+            FilterGlossySpecular(specular, source, 1024);
+
+            for (unsigned m=3; m<specular.GetMipCount(); ++m) {
+                float roughness = MipmapToRoughness(m);
+                float alphag = (roughness * .5f + .5f) * (roughness * .5f + .5f);
+                float alphad = roughness * roughness;
+                auto smithG = [](float NdotV, float alpha) { float a = alpha*alpha, b = NdotV*NdotV; return 2.f * NdotV / (NdotV + std::sqrt(b + (1.f-b)*a)); };
+                auto D = [](float NdotH, float alpha) { float a2 = alpha*alpha, d = 1.f + (a2-1.f)*NdotH*NdotH; return a2 / (gPI*d*d); };
+
+                auto dim = specular.GetFaceDim(m);
+                for (unsigned f=0; f<6; ++f)
+                    for (unsigned y=0; y<dim; ++y)
+                        for (unsigned x=0; x<dim; ++x) {
+                            auto N = CubeMapToWorld(CubeMapDirection(f, TexelCenter(x, y, dim)));
+                            float total = 0.f, totalWeight = 0.f;
+                            for (unsigned sf=0; sf<6; ++sf)
+                                for (unsigned sy=0; sy<sourceDim; ++sy)
+                                    for (unsigned sx=0; sx<sourceDim; ++sx) {
+                                        auto L = CubeMapToWorld(CubeMapDirection(sf, TexelCenter(sx, sy, sourceDim)));
+                                        float NdotL = Dot(N, L);
+                                        if (NdotL <= 0.f) continue;
+                                        auto H = Normalize(N + L);
+                                        float NdotH = Dot(N, H);
+                                            //  (approximate solid angle of the texel)
+                                        Float3 c = CubeMapDirection(sf, TexelCenter(sx, sy, sourceDim));
+                                        float maxComponent = std::max(std::abs(c[0]), std::max(std::abs(c[1]), std::abs(c[2])));
+                                        float solidAngle = maxComponent * maxComponent * maxComponent;
+                                        float weight = smithG(NdotL, alphag) * D(NdotH, alphad) / NdotH * solidAngle;
+                                        total += source.GetFace(sf)[sy*sourceDim+sx][0] * weight;
+                                        totalWeight += weight;
+                                    }
+
+                            float expected = total / totalWeight;
+                            float actual = specular.GetFace(f, m)[y*dim+x][0];
+                            Assert::IsTrue(std::abs(actual - expected) / expected < 3e-2f, L"Specular filtering doesn't match brute force reference");
+                        }
+            }
+        }
+
+        TEST_METHOD(IBLParallelMatchesSerial)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(1234);
+            std::uniform_real_distribution<float> dist(0.f, 4.f);
+            FloatCubeMap source(64, 7);
+            for (unsigned f=0; f<6; ++f) {
+                auto* texels = source.GetFace(f);
+                for (unsigned c=0; c<64*64; ++c)
+                    texels[c] = Float4(dist(rng), dist(rng), dist(rng), 1.f);
+            }
+            GenerateCubeMapMipmaps(source);
+
+            FloatCubeMap serial(32, 6), parallel(32, 6);
+            FilterGlossySpecular(serial, source, 64, false);
+            FilterGlossySpecular(parallel, source, 64, true);
+            for (unsigned m=0; m<6; ++m)
+                for (unsigned f=0; f<6; ++f) {
+                    auto dim = serial.GetFaceDim(m);
+                    Assert::IsTrue(XlCompareMemory(serial.GetFace(f, m), parallel.GetFace(f, m), dim*dim*sizeof(Float4)) == 0, L"Parallel specular filtering doesn't match serial");
+                }
+
+            auto shSerial = ProjectToSH(source, 64, false);
+            auto shParallel = ProjectToSH(source, 64, true);
+            for (unsigned c=0; c<9; ++c)
+                Assert::IsTrue(MagnitudeSquared(shSerial._coefficients[c] - shParallel._coefficients[c]) == 0.f, L"Parallel SH projection doesn't match serial");
+        }
+
+        TEST_METHOD(IBLFilteringPerformance)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const auto frequency = GetPerformanceCounterFrequency();
+            auto toMS = [frequency](uint64 ticks) { return float(ticks) * 1000.f / float(frequency); };
+
+            std::mt19937 rng(5678);
+            std::uniform_real_distribution<float> dist(0.f, 4.f);
+            const UInt2 dims(2048, 1024);
+            std::vector<Float4> equirect(dims[0]*dims[1]);
+            for (auto& t:equirect) t = Float4(dist(rng), dist(rng), dist(rng), 1.f);
+
+            const unsigned faceDims[] = { 128, 256 };
+            for (auto faceDim:faceDims) {
+                unsigned mipCount = 0;
+                while ((faceDim >> mipCount) > 1) ++mipCount;
+
+                auto t0 = GetPerformanceCounter();
+                auto source = CubeMapFromEquirectangular(AsPointer(equirect.begin()), dims, 512, 10);
+                auto t1 = GetPerformanceCounter();
+                FloatCubeMap specularSerial(faceDim, mipCount), specularParallel(faceDim, mipCount);
+                FilterGlossySpecular(specularSerial, source, 256, false);
+                auto t2 = GetPerformanceCounter();
+                FilterGlossySpecular(specularParallel, source, 256, true);
+                auto t3 = GetPerformanceCounter();
+                FloatCubeMap diffuse(32, 6);
+                BuildIrradianceCubeMap(diffuse, ProjectToSH(source));
+                auto t4 = GetPerformanceCounter();
+
+                LogAlwaysWarning
+                    << "IBL filtering (" << faceDim << "x" << faceDim << " specular, " << mipCount << " mips, 256 samples). ms -- equirect to cube: " << toMS(t1-t0)
+                    << ", specular serial: " << toMS(t2-t1) << ", specular parallel: " << toMS(t3-t2)
+                    << ", SH diffuse: " << toMS(t4-t3);
+            }
+        }
+    };
+}
+
@@ -0,0 +1,137 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/Material.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/AssetUtils.h"
+#include "../Assets/BlockSerializer.h"
+#include "../Assets/ConfigFileContainer.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/StringFormat.h"
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace RenderCore::Assets;
+
+    static const ::Assets::ResChar InheritanceTestMaterial[] = "game/model/inheritancetest/inheritancetest.material";
+    static const unsigned InheritanceTestConfigCount = 32;
+
+        //  Resolve the same layers as the material compiler would for a model with
+        //  configurations "c00" to "c31" (material:* followed by material:configuration)
+    template<typename ResolveFn>
+        static void ResolveTestConfiguration(ResolvedMaterial& result, unsigned config, ResolveFn&& fn)
+        {
+            using Meld = StringMeld<MaxPath, ::Assets::ResChar>;
+            TRY {
+                fn(result, (const ::Assets::ResChar*)(Meld() << InheritanceTestMaterial << ":*"));
+            } CATCH (const ::Assets::Exceptions::InvalidAsset&) {
+            } CATCH_END
+            TRY {
+                char configName[8];
+                _snprintf_s(configName, _TRUNCATE, "c%02i", config);
+                fn(result, (const ::Assets::ResChar*)(Meld() << InheritanceTestMaterial << ":" << configName));
+            } CATCH (const ::Assets::Exceptions::InvalidAsset&) {
+            } CATCH_END
+        }
+
+    static std::vector<uint8> SerializeResolved(const ResolvedMaterial& mat)
+    {
+        Serialization::NascentBlockSerializer serializer;
+        ::Serialize(serializer, mat);
+        auto block = serializer.AsMemoryBlock();
+        auto* start = (const uint8*)block.get();
+        return std::vector<uint8>(start, start + serializer.Size());
+    }
+
+    TEST_CLASS(MaterialInheritance)
+    {
+    public:
+        TEST_METHOD(CachedResolveMatchesReference)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+            auto searchRules = ::Assets::DefaultDirectorySearchRules(InheritanceTestMaterial);
+            RawMaterialResolveCache cache;
+
+            for (unsigned pass=0; pass<2; ++pass) {     // (second pass is resolved entirely from the cache)
+                for (unsigned c=0; c<InheritanceTestConfigCount; ++c) {
+                    ResolvedMaterial reference, cached;
+                    std::vector<::Assets::DependentFileState> referenceDeps, cachedDeps;
+
+                    ResolveTestConfiguration(reference, c,
+                        [&](ResolvedMaterial& dst, const ::Assets::ResChar name[])
+                        { RawMaterial::GetAsset(name)._asset.Resolve(dst, searchRules, &referenceDeps); });
+                    ResolveTestConfiguration(cached, c,
+                        [&](ResolvedMaterial& dst, const ::Assets::ResChar name[])
+                        { cache.Resolve(dst, name, searchRules, &cachedDeps); });
+
+                    auto referenceBytes = SerializeResolved(reference);
+                    auto cachedBytes = SerializeResolved(cached);
+                    Assert::IsTrue(referenceBytes == cachedBytes, L"Cached resolve doesn't match RawMaterial::Resolve");
+
+                    Assert::AreEqual(referenceDeps.size(), cachedDeps.size(), L"Cached resolve has different dependencies");
+                    for (size_t d=0; d<referenceDeps.size(); ++d)
+                        Assert::AreEqual(referenceDeps[d]._filename, cachedDeps[d]._filename, L"Cached resolve has different dependencies");
+                }
+            }
+        }
+
+        TEST_METHOD(CachedResolvePerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+            auto searchRules = ::Assets::DefaultDirectorySearchRules(InheritanceTestMaterial);
+
+                //  Simulate compiling many models that share the same material library.
+                //  Warm up the asset sets first, so we're only measuring the resolve
+            const unsigned compileCount = 20;
+            {
+                ResolvedMaterial warmup;
+                for (unsigned c=0; c<InheritanceTestConfigCount; ++c)
+                    ResolveTestConfiguration(warmup, c,
+                        [&](ResolvedMaterial& dst, const ::Assets::ResChar name[])
+                        { RawMaterial::GetAsset(name)._asset.Resolve(dst, searchRules); });
+            }
+
+            auto t0 = __rdtsc();
+            for (unsigned i=0; i<compileCount; ++i) {
+                std::vector<::Assets::DependentFileState> deps;
+                for (unsigned c=0; c<InheritanceTestConfigCount; ++c) {
+                    ResolvedMaterial result;
+                    ResolveTestConfiguration(result, c,
+                        [&](ResolvedMaterial& dst, const ::Assets::ResChar name[])
+                        { RawMaterial::GetAsset(name)._asset.Resolve(dst, searchRules, &deps); });
+                }
+            }
+            auto t1 = __rdtsc();
+
+            RawMaterialResolveCache cache;
+            for (unsigned i=0; i<compileCount; ++i) {
+                std::vector<::Assets::DependentFileState> deps;
+                for (unsigned c=0; c<InheritanceTestConfigCount; ++c) {
+                    ResolvedMaterial result;
+                    ResolveTestConfiguration(result, c,
+                        [&](ResolvedMaterial& dst, const ::Assets::ResChar name[])
+                        { cache.Resolve(dst, name, searchRules, &deps); });
+                }
+            }
+            auto t2 = __rdtsc();
+
+            LogAlwaysWarning
+                << "Material resolve (" << InheritanceTestConfigCount << " configurations). Cycles per compile -- RawMaterial::Resolve: "
+                << (t1-t0) / compileCount << ", RawMaterialResolveCache: " << (t2-t1) / compileCount;
+        }
+    };
+}
+
@@ -0,0 +1,235 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/ModelRendererInternal.h"
+#include "../ConsoleRig/Log.h"
+#include <CppUnitTest.h>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace RenderCore::Assets;
+
+        //  The state that is bound at the time of a draw call. Both the packet executor
+        //  and the reference executor must produce the same sequence of these
+    class DrawSnapshot
+    {
+    public:
+        unsigned _drawCallIndex;
+        unsigned _meshIndex, _transformMarker, _renderStateSet;
+        unsigned _shaderName, _techniqueInterface, _geoParamBox, _materialParamBox;
+        unsigned _uniforms;         // (index into the sink's uniforms table, so snapshots from different sinks compare)
+        unsigned _textureSet, _constantBuffer, _topology;
+        unsigned _indexCount, _firstIndex, _firstVertex;
+
+        friend bool operator==(const DrawSnapshot& lhs, const DrawSnapshot& rhs)
+        {
+            return  lhs._drawCallIndex == rhs._drawCallIndex
+                &&  lhs._meshIndex == rhs._meshIndex && lhs._transformMarker == rhs._transformMarker && lhs._renderStateSet == rhs._renderStateSet
+                &&  lhs._shaderName == rhs._shaderName && lhs._techniqueInterface == rhs._techniqueInterface
+                &&  lhs._geoParamBox == rhs._geoParamBox && lhs._materialParamBox == rhs._materialParamBox
+                &&  lhs._uniforms == rhs._uniforms && lhs._textureSet == rhs._textureSet && lhs._constantBuffer == rhs._constantBuffer
+                &&  lhs._topology == rhs._topology
+                &&  lhs._indexCount == rhs._indexCount && lhs._firstIndex == rhs._firstIndex && lhs._firstVertex == rhs._firstVertex;
+        }
+    };
+
+        //  Sink that emulates the device context and SharedStateSet, and records
+        //  the state at each draw call
+    class RecordingSink
+    {
+    public:
+        class FakeUniforms { public: unsigned _dummy; };
+        FakeUniforms _uniforms[256];
+
+        DrawSnapshot _current;
+        std::vector<DrawSnapshot> _draws;
+        unsigned _commandCount;
+        unsigned _pendingTextureSetMask;    // texture sets (mod 32) that emulate pending textures
+
+        SharedTechniqueInterface BindMesh(const ModelDrawPacket& packet)
+        {
+            _current._meshIndex = packet._meshIndex;
+            ++_commandCount;
+            return SharedTechniqueInterface(packet._meshIndex % 3);   // meshes share technique interfaces
+        }
+
+        void SetTransform(const ModelDrawPacket& packet)
+        {
+            _current._transformMarker = packet._transformMarker;
+            ++_commandCount;
+        }
+
+        void BeginRenderState(const ModelDrawPacket& packet)
+        {
+            _current._renderStateSet = packet._renderStateSet.Value();
+            ++_commandCount;
+        }
+
+        FakeUniforms* BeginVariation(const ModelDrawPacket& packet, SharedTechniqueInterface techniqueInterface)
+        {
+            _current._shaderName = packet._shaderName.Value();
+            _current._techniqueInterface = techniqueInterface.Value();
+            _current._geoParamBox = packet._geoParamBox.Value();
+            _current._materialParamBox = packet._materialParamBox.Value();
+            ++_commandCount;
+            auto hash = (_current._shaderName * 31) ^ (_current._techniqueInterface * 17) ^ (_current._geoParamBox * 7) ^ _current._materialParamBox;
+            return &_uniforms[hash % dimof(_uniforms)];
+        }
+
+        bool ApplyUniforms(const ModelDrawPacket& packet, FakeUniforms& uniforms)
+        {
+            ++_commandCount;
+            if (_pendingTextureSetMask & (1u << (packet._textureSet % 32))) return false;
+            _current._uniforms = unsigned(&uniforms - _uniforms);
+            _current._textureSet = packet._textureSet;
+            _current._constantBuffer = packet._constantBuffer;
+            return true;
+        }
+
+        void BindTopology(const ModelDrawPacket& packet)
+        {
+            _current._topology = packet._topology;
+            ++_commandCount;
+        }
+
+        void Draw(const ModelDrawPacket& packet, unsigned drawCallIndex)
+        {
+            _current._drawCallIndex = drawCallIndex;
+            _current._indexCount = packet._indexCount;
+            _current._firstIndex = packet._firstIndex;
+            _current._firstVertex = packet._firstVertex;
+            _draws.push_back(_current);
+            ++_commandCount;
+        }
+
+        RecordingSink() : _commandCount(0), _pendingTextureSetMask(0) { XlZeroMemory(_current); }
+    };
+
+        //  Executes every packet without any redundancy checks (this is the behaviour
+        //  of the old ModelRenderer::Render loop, before SharedStateSet filtering)
+    static void ExecuteReference(RecordingSink& sink, const ModelDrawPacket* begin, const ModelDrawPacket* end, unsigned firstDrawCallIndex)
+    {
+        unsigned drawCallIndex = firstDrawCallIndex;
+        for (auto p=begin; p!=end; ++p, ++drawCallIndex) {
+            auto techniqueInterface = sink.BindMesh(*p);
+            sink.SetTransform(*p);
+            sink.BeginRenderState(*p);
+            auto* uniforms = sink.BeginVariation(*p, techniqueInterface);
+            bool ready = sink.ApplyUniforms(*p, *uniforms);
+            sink.BindTopology(*p);
+            if (ready) sink.Draw(*p, drawCallIndex);
+        }
+    }
+
+        //  Build packets in the same order the ModelRenderer constructor would -- geo calls
+        //  in order, with the draw calls for each geo call adjacent. Some geo calls share
+        //  the same mesh (with different transforms)
+    static std::vector<ModelDrawPacket> BuildTestPackets(unsigned geoCallCount, uint32 seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<ModelDrawPacket> result;
+        for (unsigned g=0; g<geoCallCount; ++g) {
+            auto meshIndex = (rng() % 4) ? g : (g/2);
+            auto drawCallCount = 1 + rng() % 4;
+            for (unsigned d=0; d<drawCallCount; ++d) {
+                ModelDrawPacket packet;
+                packet._meshIndex = meshIndex;
+                packet._transformMarker = g;
+                auto material = rng() % 12;
+                packet._shaderName = SharedTechniqueConfig(material % 3);
+                packet._geoParamBox = SharedParameterBox(meshIndex % 5);
+                packet._materialParamBox = SharedParameterBox(material);
+                packet._renderStateSet = SharedRenderStateSet(material % 2);
+                packet._textureSet = material;
+                packet._constantBuffer = material;
+                packet._topology = (rng() % 8) ? 4 : 5;
+                packet._indexCount = 3 * (1 + rng() % 1000);
+                packet._firstIndex = rng() % 10000;
+                packet._firstVertex = 0;
+                result.push_back(packet);
+            }
+        }
+        return std::move(result);
+    }
+
+    TEST_CLASS(ModelDrawPackets)
+    {
+    public:
+        TEST_METHOD(PacketsMatchReference)
+        {
+            for (uint32 seed=1; seed<20; ++seed) {
+                auto packets = BuildTestPackets(64, seed);
+                auto* begin = AsPointer(packets.cbegin());
+                auto* end = AsPointer(packets.cend());
+                auto split = unsigned(packets.size() / 2);  // (emulate separate unskinned & skinned passes)
+
+                RecordingSink reference, executed;
+                ExecuteReference(reference, begin, begin + split, 0);
+                ExecuteReference(reference, begin + split, end, split);
+                ExecuteDrawPackets(executed, begin, begin + split, 0, true);
+                ExecuteDrawPackets(executed, begin + split, end, split, true);
+
+                Assert::AreEqual(reference._draws.size(), executed._draws.size(), L"Different number of draw calls");
+                for (size_t c=0; c<reference._draws.size(); ++c)
+                    Assert::IsTrue(reference._draws[c] == executed._draws[c], L"Draw packet state doesn't match reference");
+                Assert::IsTrue(executed._commandCount < reference._commandCount, L"Draw packets didn't filter redundant state changes");
+            }
+        }
+
+        TEST_METHOD(PacketsSkipPendingTextures)
+        {
+                //  Draw calls whose textures are pending are skipped, but must not
+                //  leave stale uniforms bound for the draw calls that follow them
+            for (uint32 seed=1; seed<20; ++seed) {
+                auto packets = BuildTestPackets(64, seed);
+                auto* begin = AsPointer(packets.cbegin());
+                auto* end = AsPointer(packets.cend());
+
+                RecordingSink reference, executed;
+                reference._pendingTextureSetMask = executed._pendingTextureSetMask = (1u<<3) | (1u<<7);
+                ExecuteReference(reference, begin, end, 0);
+                ExecuteDrawPackets(executed, begin, end, 0, true);
+
+                Assert::IsTrue(reference._draws.size() < packets.size(), L"No draw calls were skipped");
+                Assert::AreEqual(reference._draws.size(), executed._draws.size(), L"Different number of draw calls");
+                for (size_t c=0; c<reference._draws.size(); ++c)
+                    Assert::IsTrue(reference._draws[c] == executed._draws[c], L"Draw packet state doesn't match reference");
+            }
+        }
+
+        TEST_METHOD(PacketPerformance)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            auto packets = BuildTestPackets(256, 7);
+            auto* begin = AsPointer(packets.cbegin());
+            auto* end = AsPointer(packets.cend());
+            const unsigned iterations = 1000;
+
+            RecordingSink reference, executed;
+            reference._draws.reserve(packets.size() * iterations);
+            executed._draws.reserve(packets.size() * iterations);
+
+            auto t0 = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                ExecuteReference(reference, begin, end, 0);
+            auto t1 = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                ExecuteDrawPackets(executed, begin, end, 0, true);
+            auto t2 = __rdtsc();
+
+            LogAlwaysWarning
+                << "Model draw packets (" << packets.size() << " draw calls). Commands per render -- reference: "
+                << reference._commandCount / iterations << ", packets: " << executed._commandCount / iterations
+                << ". Cycles per render -- reference: " << (t1-t0) / iterations << ", packets: " << (t2-t1) / iterations;
+        }
+    };
+}
+
@@ -0,0 +1,202 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../SceneEngine/PreparedScene.h"
+#include "../SceneEngine/SceneParser.h"
+#include "../SceneEngine/LightDesc.h"
+#include "../SceneEngine/Tonemap.h"
+#include "../RenderCore/Techniques/TechniqueUtils.h"
+#include "../ConsoleRig/Log.h"
+#include "../Math/Transformations.h"
+#include "../Math/ProjectionMath.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <thread>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static Interlocked::Value s_destroyedObjects = 0;
+
+    class TrackedObject
+    {
+    public:
+        unsigned _thread, _index;
+        TrackedObject(unsigned thread, unsigned index) : _thread(thread), _index(index) {}
+        ~TrackedObject() { Interlocked::Increment(&s_destroyedObjects); }
+    };
+
+    class VisibleObjects
+    {
+    public:
+        std::vector<unsigned> _objects;
+    };
+
+        //  A scene parser without any device dependencies. Preparing a view
+        //  just culls a large set of bounding boxes (similar to culling placements)
+    class SyntheticSceneParser : public SceneEngine::ISceneParser
+    {
+    public:
+        using SceneParseSettings = SceneEngine::SceneParseSettings;
+        std::vector<std::pair<Float3, Float3>> _boundingBoxes;
+
+        static SceneEngine::PreparedScene::Id ViewId(const SceneParseSettings& parseSettings)
+        {
+            return (parseSettings._batchFilter == SceneParseSettings::BatchFilter::General)
+                ? 0 : (1 + parseSettings._projectionIndex);
+        }
+
+        void PrepareView(
+            const SceneParseSettings& parseSettings,
+            const Float4x4& worldToProjection,
+            SceneEngine::PreparedScene& preparedPackets) const
+        {
+            auto* visible = preparedPackets.Allocate<VisibleObjects>(ViewId(parseSettings));
+            for (unsigned c=0; c<(unsigned)_boundingBoxes.size(); ++c)
+                if (!CullAABB_Aligned(worldToProjection, _boundingBoxes[c].first, _boundingBoxes[c].second))
+                    visible->_objects.push_back(c);
+        }
+
+        auto GetCameraDesc() const -> RenderCore::Techniques::CameraDesc { return RenderCore::Techniques::CameraDesc(); }
+        void ExecuteScene(
+            RenderCore::IThreadContext&, SceneEngine::LightingParserContext&,
+            const SceneParseSettings&, SceneEngine::PreparedScene&, unsigned) const {}
+        void PrepareScene(
+            RenderCore::IThreadContext&, SceneEngine::LightingParserContext&,
+            SceneEngine::PreparedScene&) const {}
+        bool HasContent(const SceneParseSettings&) const { return true; }
+
+        ShadowProjIndex GetShadowProjectionCount() const { return 0; }
+        auto GetShadowProjectionDesc(ShadowProjIndex, const ProjectionDesc&) const -> SceneEngine::ShadowProjectionDesc
+            { return SceneEngine::ShadowProjectionDesc(); }
+        LightIndex GetLightCount() const { return 0; }
+        auto GetLightDesc(LightIndex) const -> const SceneEngine::LightDesc& { return _light; }
+        auto GetGlobalLightingDesc() const -> SceneEngine::GlobalLightingDesc { return SceneEngine::GlobalLightingDesc(); }
+        auto GetToneMapSettings() const -> SceneEngine::ToneMapSettings { return SceneEngine::ToneMapSettings(); }
+        float GetTimeValue() const { return 0.f; }
+
+        SyntheticSceneParser(unsigned objectCount)
+        {
+            std::mt19937 rng(7193);
+            std::uniform_real_distribution<float> pos(-2000.f, 2000.f), size(1.f, 20.f);
+            _boundingBoxes.reserve(objectCount);
+            for (unsigned c=0; c<objectCount; ++c) {
+                Float3 mins(pos(rng), pos(rng), 0.f);
+                _boundingBoxes.push_back(std::make_pair(mins, mins + Float3(size(rng), size(rng), size(rng))));
+            }
+        }
+
+    private:
+        SceneEngine::LightDesc _light;
+    };
+
+    static Float4x4 MakeWorldToProjection(Float3 position, Float3 forward, float farClip)
+    {
+        auto cameraToWorld = MakeCameraToWorld(Normalize(forward), Float3(0.f, 0.f, 1.f), position);
+        auto cameraToProjection = PerspectiveProjection(
+            Deg2Rad(50.f), 16.f / 9.f, 0.1f, farClip,
+            GeometricCoordinateSpace::RightHanded, RenderCore::Techniques::GetDefaultClipSpaceType());
+        return Combine(InvertOrthonormalTransform(cameraToWorld), cameraToProjection);
+    }
+
+    TEST_CLASS(PreparedScenes)
+    {
+    public:
+        TEST_METHOD(ConcurrentAllocateAndGet)
+        {
+            const unsigned threadCount = 8;
+            const unsigned objectsPerThread = 4096;
+            s_destroyedObjects = 0;
+            Interlocked::Value lookupFailures = 0;
+
+            {
+                SceneEngine::PreparedScene preparedScene;
+
+                std::vector<std::thread> threads;
+                for (unsigned t=0; t<threadCount; ++t)
+                    threads.emplace_back(
+                        [&preparedScene, &lookupFailures, t]()
+                        {
+                            for (unsigned c=0; c<objectsPerThread; ++c) {
+                                auto id = (SceneEngine::PreparedScene::Id(t) << 32ull) | c;
+                                preparedScene.Allocate<TrackedObject>(id, t, c);
+
+                                    //  look up objects allocated by this thread, while other
+                                    //  threads are still allocating
+                                auto* previous = preparedScene.Get<TrackedObject>(id & ~1ull);
+                                if (!previous || previous->_thread != t || previous->_index != (c & ~1u))
+                                    Interlocked::Increment(&lookupFailures);
+                            }
+                        });
+                for (auto& t:threads) t.join();
+                Assert::AreEqual(0l, Interlocked::Load(&lookupFailures), L"Lookups failed while other threads were allocating");
+
+                for (unsigned t=0; t<threadCount; ++t)
+                    for (unsigned c=0; c<objectsPerThread; ++c) {
+                        auto* obj = preparedScene.Get<TrackedObject>((SceneEngine::PreparedScene::Id(t) << 32ull) | c);
+                        Assert::IsNotNull(obj, L"Missing object");
+                        Assert::AreEqual(t, obj->_thread, L"Object has wrong thread");
+                        Assert::AreEqual(c, obj->_index, L"Object has wrong index");
+                    }
+
+                Assert::IsNull(preparedScene.Get<TrackedObject>(SceneEngine::PreparedScene::Id(threadCount) << 32ull), L"Found object that was never allocated");
+                Assert::IsNull(preparedScene.Get<VisibleObjects>(0), L"Found object with the wrong type");
+                Assert::AreEqual(0l, Interlocked::Load(&s_destroyedObjects), L"Objects destroyed early");
+            }
+
+            Assert::AreEqual(Interlocked::Value(threadCount * objectsPerThread), Interlocked::Load(&s_destroyedObjects), L"Objects not destroyed with prepared scene");
+        }
+
+        TEST_METHOD(ParallelPrepareViews)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  One main view, and a few wide "shadow" views (as we would have
+                //  with cascaded shadows).
+            SyntheticSceneParser scene(200000);
+            using SPS = SceneEngine::SceneParseSettings;
+            std::vector<SceneEngine::ScenePrepareView> views;
+            views.push_back(SceneEngine::ScenePrepareView(
+                SPS(SPS::BatchFilter::General),
+                MakeWorldToProjection(Float3(0.f, 0.f, 50.f), Float3(1.f, 0.5f, -0.2f), 2000.f)));
+            for (unsigned c=0; c<5; ++c)
+                views.push_back(SceneEngine::ScenePrepareView(
+                    SPS(SPS::BatchFilter::DMShadows, ~SPS::Toggles::BitField(0), c),
+                    MakeWorldToProjection(Float3(0.f, 0.f, 200.f + 200.f * c), Float3(0.3f, 0.2f, -1.f), 4000.f)));
+
+            SceneEngine::PreparedScene reference;
+            for (const auto& v:views)
+                scene.PrepareView(v._parseSettings, v._worldToProjection, reference);
+
+            unsigned threadCounts[] = { 1, 2, 4, std::max(1u, std::thread::hardware_concurrency()) };
+            for (auto threadCount:threadCounts) {
+                Utility::CompletionThreadPool threadPool(threadCount);
+                SceneEngine::PreparedScene preparedScene;
+
+                auto start = __rdtsc();
+                auto exceptions = SceneEngine::PrepareSceneViews(scene, MakeIteratorRange(views), preparedScene, threadPool);
+                auto end = __rdtsc();
+                Assert::IsTrue(exceptions.empty(), L"Unexpected exceptions from PrepareView");
+
+                for (const auto& v:views) {
+                    auto id = SyntheticSceneParser::ViewId(v._parseSettings);
+                    auto* expected = reference.Get<VisibleObjects>(id);
+                    auto* result = preparedScene.Get<VisibleObjects>(id);
+                    Assert::IsNotNull(result, L"View was not prepared");
+                    Assert::IsTrue(expected->_objects == result->_objects, L"Parallel prepare gave different results");
+                }
+
+                LogAlwaysWarning << "Prepared " << views.size() << " views with " << threadCount << " pool threads in " << (end-start) << " cycles";
+            }
+        }
+    };
+}
+
@@ -0,0 +1,166 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Tools/EntityInterface/RetainedEntities.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/ParameterBox.h"
+#include <CppUnitTest.h>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace EntityInterface;
+
+    static PropertyInitializer MakeInitializer(PropertyId prop, const unsigned& value)
+    {
+        PropertyInitializer result;
+        result._prop = prop;
+        result._src = &value;
+        result._elementType = unsigned(ImpliedTyping::TypeCat::UInt32);
+        result._arrayCount = 1;
+        return result;
+    }
+
+    TEST_CLASS(RetainedEntityStore)
+    {
+    public:
+        TEST_METHOD(CreateDeleteAndLookup)
+        {
+            auto entities = std::make_shared<RetainedEntities>();
+            RetainedEntityInterface interf(entities);
+
+            auto typeA = interf.GetTypeId("TypeA");
+            auto typeB = interf.GetTypeId("TypeB");
+            auto valueProp = interf.GetPropertyId(typeA, "Value");
+            const DocumentId doc = 1;
+
+            const unsigned objectCount = 1000;
+            std::vector<Identifier> ids;
+            for (unsigned c=0; c<objectCount; ++c) {
+                auto type = (c%3) ? typeA : typeB;
+                Identifier id(doc, interf.AssignObjectId(doc, type), type);
+                auto init = MakeInitializer(valueProp, c);
+                Assert::IsTrue(interf.CreateObject(id, &init, (type == typeA) ? 1 : 0), L"Create failed");
+                ids.push_back(id);
+            }
+            Assert::IsFalse(interf.CreateObject(ids[5], nullptr, 0), L"Created duplicate object");
+
+                //  delete every 4th object; the rest must still be found, with their
+                //  properties intact
+            static const auto valueHash = ParameterBox::MakeParameterNameHash("Value");
+            for (unsigned c=0; c<objectCount; c+=4)
+                Assert::IsTrue(interf.DeleteObject(ids[c]), L"Delete failed");
+            Assert::IsFalse(interf.DeleteObject(ids[0]), L"Deleted object twice");
+
+            unsigned expectedA = 0, expectedB = 0;
+            for (unsigned c=0; c<objectCount; ++c) {
+                auto* obj = entities->GetEntity(ids[c]);
+                if ((c%4) == 0) { Assert::IsNull(obj, L"Found deleted object"); continue; }
+                Assert::IsNotNull(obj, L"Missing object");
+                Assert::IsTrue(obj->_id == ids[c].Object(), L"Wrong object");
+                if (ids[c].ObjectType() == typeA) {
+                    Assert::AreEqual(c, obj->_properties.GetParameter(valueHash, ~0u), L"Wrong property value");
+                    ++expectedA;
+                } else
+                    ++expectedB;
+            }
+
+            auto allA = entities->FindEntitiesOfType(typeA);
+            Assert::AreEqual(expectedA, (unsigned)allA.size(), L"Wrong number of objects of type A");
+            for (auto* a:allA) Assert::AreEqual(typeA, a->_type, L"Wrong type in FindEntitiesOfType");
+            Assert::AreEqual(expectedB, entities->GetEntityCount(typeB), L"Wrong number of objects of type B");
+        }
+
+        TEST_METHOD(ChangeVersions)
+        {
+            auto entities = std::make_shared<RetainedEntities>();
+            RetainedEntityInterface interf(entities);
+
+            auto parentType = interf.GetTypeId("Parent");
+            auto childType = interf.GetTypeId("Child");
+            auto otherType = interf.GetTypeId("Other");
+            auto valueProp = interf.GetPropertyId(childType, "Value");
+            const DocumentId doc = 1;
+
+            Identifier parent(doc, interf.AssignObjectId(doc, parentType), parentType);
+            Identifier child(doc, interf.AssignObjectId(doc, childType), childType);
+            Identifier other(doc, interf.AssignObjectId(doc, otherType), otherType);
+            interf.CreateObject(parent, nullptr, 0);
+            interf.CreateObject(child, nullptr, 0);
+            interf.CreateObject(other, nullptr, 0);
+            interf.SetParent(child, parent, -1);
+
+            auto parentVersion = entities->GetChangeVersion(parentType);
+            auto otherVersion = entities->GetChangeVersion(otherType);
+
+                //  changes to the child are visible in the parent's type version,
+                //  but unrelated types are unchanged
+            unsigned value = 5;
+            auto init = MakeInitializer(valueProp, value);
+            interf.SetProperty(child, &init, 1);
+            Assert::IsTrue(entities->GetChangeVersion(parentType) > parentVersion, L"Parent version not changed by child property change");
+            Assert::IsTrue(entities->GetChangeVersion(otherType) == otherVersion, L"Unrelated type version changed");
+
+            parentVersion = entities->GetChangeVersion(parentType);
+            interf.DeleteObject(child);
+            Assert::IsTrue(entities->GetChangeVersion(parentType) > parentVersion, L"Parent version not changed by child deletion");
+        }
+
+        TEST_METHOD(EditThroughput)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Simulate editing a large level -- many entities, with property
+                //  changes scattered randomly throughout
+            unsigned entityCounts[] = { 1000, 10000, 50000 };
+            for (auto entityCount:entityCounts) {
+                auto entities = std::make_shared<RetainedEntities>();
+                RetainedEntityInterface interf(entities);
+                auto type = interf.GetTypeId("Object");
+                auto folderType = interf.GetTypeId("Folder");
+                auto valueProp = interf.GetPropertyId(type, "Value");
+                const DocumentId doc = 1;
+
+                Identifier folder(doc, interf.AssignObjectId(doc, folderType), folderType);
+                interf.CreateObject(folder, nullptr, 0);
+
+                std::vector<Identifier> ids;
+                ids.reserve(entityCount);
+                auto t0 = __rdtsc();
+                for (unsigned c=0; c<entityCount; ++c) {
+                    Identifier id(doc, interf.AssignObjectId(doc, type), type);
+                    auto init = MakeInitializer(valueProp, c);
+                    interf.CreateObject(id, &init, 1);
+                    interf.SetParent(id, folder, -1);
+                    ids.push_back(id);
+                }
+                auto t1 = __rdtsc();
+
+                const unsigned editCount = 20000;
+                std::mt19937 rng(6271);
+                for (unsigned c=0; c<editCount; ++c) {
+                    auto init = MakeInitializer(valueProp, c);
+                    interf.SetProperty(ids[rng() % entityCount], &init, 1);
+                }
+                auto t2 = __rdtsc();
+
+                unsigned found = 0;
+                for (unsigned c=0; c<editCount; ++c)
+                    found += entities->GetEntity(ids[rng() % entityCount]) != nullptr;
+                auto t3 = __rdtsc();
+                Assert::AreEqual(editCount, found, L"Lookups failed");
+
+                LogAlwaysWarning
+                    << "Retained entities (" << entityCount << "). Cycles per create: " << (t1-t0) / entityCount
+                    << ", per edit: " << (t2-t1) / editCount << ", per lookup: " << (t3-t2) / editCount;
+            }
+        }
+    };
+}
+
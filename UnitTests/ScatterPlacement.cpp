@@ -0,0 +1,67 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Tools/ToolsRig/PlacementsManipulators.h"
+#include "../ConsoleRig/Log.h"
+#include "../Math/Vector.h"
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    TEST_CLASS(ScatterPlacement)
+    {
+    public:
+        TEST_METHOD(BlueNoiseDeterminism)
+        {
+            const float radius = 20.f;
+            unsigned counts[] = { 20, 200, 1000 };
+            for (auto count:counts) {
+                for (uint32 seed=1; seed<10; ++seed) {
+                    std::vector<Float2> a, b, reference;
+                    ToolsRig::GenerateBlueNoisePlacements(a, radius, count, seed);
+                    ToolsRig::GenerateBlueNoisePlacements(b, radius, count, seed);
+                    ToolsRig::GenerateBlueNoisePlacements(reference, radius, count, seed, ToolsRig::BlueNoiseMethod::Reference);
+
+                    Assert::AreEqual(a.size(), b.size(), L"Same seed gave different point counts");
+                    for (size_t c=0; c<a.size(); ++c)
+                        Assert::IsTrue(a[c][0] == b[c][0] && a[c][1] == b[c][1], L"Same seed gave different points");
+
+                        //  The accelerated method should make exactly the same decisions as
+                        //  the reference method. Only the relax step is different (and it
+                        //  is very subtle)
+                    Assert::AreEqual(reference.size(), a.size(), L"Accelerated method gave different point count");
+                    for (size_t c=0; c<a.size(); ++c)
+                        Assert::IsTrue(Magnitude(a[c] - reference[c]) < 0.05f * radius, L"Accelerated method point too far from reference");
+                }
+            }
+        }
+
+        TEST_METHOD(BlueNoisePerformance)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Simulate holding down the scatter brush -- it's applied many times in
+                //  a row, and the number of points quickly climbs towards the target count
+            const unsigned passes = 20;
+            ToolsRig::BlueNoiseMethod::Enum methods[] = { ToolsRig::BlueNoiseMethod::Reference, ToolsRig::BlueNoiseMethod::Accelerated };
+            for (auto method:methods) {
+                std::vector<Float2> pts;
+                auto start = __rdtsc();
+                for (unsigned c=0; c<passes; ++c)
+                    ToolsRig::GenerateBlueNoisePlacements(pts, 20.f, 1000, 7+c, method);
+                auto end = __rdtsc();
+
+                LogAlwaysWarning
+                    << "Blue noise scatter (" << ((method == ToolsRig::BlueNoiseMethod::Reference) ? "reference" : "accelerated")
+                    << "): " << pts.size() << " points, " << (end-start) / passes << " cycles per pass";
+            }
+        }
+    };
+}
+
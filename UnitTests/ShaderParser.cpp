@@ -6,11 +6,64 @@
 
 #include "UnitTestHelper.h"
 #include "../ShaderParser/InterfaceSignature.h"
+#include "../ShaderParser/SignatureCache.h"
+#include "../ShaderParser/ShaderPatcher.h"
+#include "../ShaderParser/Exceptions.h"
+#include "../RenderCore/Assets/ShaderPreprocessor.h"
+#include "../RenderCore/Assets/LocalCompiledShaderSource.h"
+#include "../RenderCore/Assets/ShaderIncludeGraph.h"
+#include "../RenderCore/ShaderService.h"
 #include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../ConsoleRig/Log.h"
+#include "../Assets/AssetServices.h"
+#include "../Utility/Conversion.h"
+#include "../Core/Exceptions.h"
 #include <CppUnitTest.h>
+#include <map>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace UnitTests
 {
+        //  Stand-in for the real shader compiler. The "byte code" is just a copy of
+        //  the source code; but we count how many times we're asked to compile.
+    class StandInShaderCompiler : public RenderCore::ShaderService::ILowLevelCompiler
+    {
+    public:
+        using ResId = RenderCore::ShaderService::ResId;
+        using ShaderHeader = RenderCore::ShaderService::ShaderHeader;
+
+        void AdaptShaderModel(::Assets::ResChar destination[], const size_t destinationCount, const ::Assets::ResChar source[]) const
+        {
+            if (destination != source) XlCopyString(destination, destinationCount, source);
+        }
+
+        bool DoLowLevelCompile(
+            Payload& payload, Payload& errors,
+            std::vector<::Assets::DependentFileState>& dependencies,
+            const void* sourceCode, size_t sourceCodeLength,
+            const ResId& shaderPath, const ::Assets::ResChar definesTable[]) const
+        {
+            Interlocked::Increment(&_compileCount);
+            payload = std::make_shared<std::vector<uint8>>(sizeof(ShaderHeader) + sourceCodeLength);
+            *(ShaderHeader*)AsPointer(payload->begin()) = ShaderHeader { ShaderHeader::Version, 0 };
+            XlCopyMemory(PtrAdd(AsPointer(payload->begin()), sizeof(ShaderHeader)), sourceCode, sourceCodeLength);
+            return true;
+        }
+
+        std::string MakeShaderMetricsString(const void*, size_t) const { return std::string(); }
+        std::string MakeImplicitDefines(const ResId&) const { return "STAND_IN=1"; }
+
+        unsigned GetCompileCount() const { return (unsigned)Interlocked::Load(&_compileCount); }
+
+        StandInShaderCompiler() { Interlocked::Exchange(&_compileCount, 0); }
+    private:
+        mutable Interlocked::Value _compileCount;
+    };
+
     TEST_CLASS(ShaderParser)
 	{
 	public:
@@ -39,12 +92,507 @@ namespace UnitTests
                     XlEqString(MakeStringSection((const char*)memBlock.get(), (const char*)&memBlock[XlStringLen(flgId)]), flgId))
                     continue;
 
-                auto signature = ShaderSourceParser::BuildShaderFragmentSignature(
+                auto signature = ShaderSourceParser::ParseShaderFragmentSignature(
                     (const char*)memBlock.get(), blockSize);
 
                 (void)signature;
             }
         }
+
+        static std::vector<std::pair<std::string, std::string>> LoadAllShaderSources()
+        {
+            auto inputFiles = FindFilesHierarchical("game/xleres", "*.h", FindFilesFilter::File);
+            auto inputFiles1 = FindFilesHierarchical("game/xleres", "*.sh", FindFilesFilter::File);
+            auto inputFiles2 = FindFilesHierarchical("game/xleres", "*.?sh", FindFilesFilter::File);
+            inputFiles.insert(inputFiles.end(), inputFiles1.begin(), inputFiles1.end());
+            inputFiles.insert(inputFiles.end(), inputFiles2.begin(), inputFiles2.end());
+
+            std::vector<std::pair<std::string, std::string>> result;
+            for (auto& i:inputFiles) {
+                size_t blockSize = 0;
+                auto memBlock = LoadFileAsMemoryBlock(i.c_str(), &blockSize);
+                if (!blockSize) continue;
+                result.push_back(std::make_pair(i, std::string((const char*)memBlock.get(), (const char*)PtrAdd(memBlock.get(), blockSize))));
+            }
+            return result;
+        }
+
+        static bool SignaturesMatch(
+            const ShaderSourceParser::ShaderFragmentSignature& lhs,
+            const ShaderSourceParser::ShaderFragmentSignature& rhs)
+        {
+            if (lhs._functions.size() != rhs._functions.size()) return false;
+            for (size_t f=0; f<lhs._functions.size(); ++f) {
+                const auto& l = lhs._functions[f]; const auto& r = rhs._functions[f];
+                if (l._name != r._name || l._returnType != r._returnType || l._returnSemantic != r._returnSemantic) return false;
+                if (l._parameters.size() != r._parameters.size()) return false;
+                for (size_t p=0; p<l._parameters.size(); ++p)
+                    if (    l._parameters[p]._name != r._parameters[p]._name || l._parameters[p]._type != r._parameters[p]._type
+                        ||  l._parameters[p]._semantic != r._parameters[p]._semantic || l._parameters[p]._direction != r._parameters[p]._direction)
+                        return false;
+            }
+
+            if (lhs._parameterStructs.size() != rhs._parameterStructs.size()) return false;
+            for (size_t s=0; s<lhs._parameterStructs.size(); ++s) {
+                const auto& l = lhs._parameterStructs[s]; const auto& r = rhs._parameterStructs[s];
+                if (l._name != r._name || l._parameters.size() != r._parameters.size()) return false;
+                for (size_t p=0; p<l._parameters.size(); ++p)
+                    if (    l._parameters[p]._name != r._parameters[p]._name || l._parameters[p]._type != r._parameters[p]._type
+                        ||  l._parameters[p]._semantic != r._parameters[p]._semantic)
+                        return false;
+            }
+            return true;
+        }
+
+        TEST_METHOD(FastSignatureScanner)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                // Wherever both the antlr parser and the fast scanner accept a file,
+                // they must produce the same signature
+            auto sources = LoadAllShaderSources();
+            unsigned scanned = 0, compared = 0;
+            for (const auto& s:sources) {
+                ShaderSourceParser::ShaderFragmentSignature scannedSig;
+                if (!ShaderSourceParser::TryScanShaderFragmentSignature(scannedSig, s.second.c_str(), s.second.size()))
+                    continue;
+                ++scanned;
+
+                TRY {
+                    auto parsedSig = ShaderSourceParser::ParseShaderFragmentSignature(s.second.c_str(), s.second.size());
+                    Assert::IsTrue(SignaturesMatch(scannedSig, parsedSig), (L"Fast scanner signature mismatch in " + Conversion::Convert<std::wstring>(s.first)).c_str());
+                    ++compared;
+                } CATCH (const ShaderSourceParser::Exceptions::ParsingFailure&) {
+                } CATCH_END
+            }
+
+            LogAlwaysWarning << "Fast scanner handled " << scanned << " of " << sources.size() << " shader sources (" << compared << " compared against full parser)";
+            Assert::IsTrue(compared > 0, L"Expecting some shader sources to be comparable");
+
+                // the cache should return the same object for the same content
+            const char testSource[] = "struct S { float4 a : A; }; float4 fn(in S s, inout float b) : SV_Target { return 0; }";
+            auto sig0 = ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(testSource));
+            auto sig1 = ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(std::string(testSource)));
+            Assert::IsTrue(sig0 == sig1, L"Expecting cached signature to be reused for identical source");
+            Assert::AreEqual(size_t(1), sig0->_functions.size());
+            Assert::AreEqual(size_t(2), sig0->_functions[0]._parameters.size());
+            Assert::AreEqual(unsigned(ShaderSourceParser::FunctionSignature::Parameter::In | ShaderSourceParser::FunctionSignature::Parameter::Out), sig0->_functions[0]._parameters[1]._direction);
+            Assert::AreEqual(std::string("SV_Target"), sig0->_functions[0]._returnSemantic);
+
+                // the cache is bounded; once full, the least recently used signature is dropped
+            ShaderSourceParser::ClearSignatureCache();
+            auto makeSource = [](unsigned index) { return std::string((StringMeld<64>() << "float4 fn" << index << "() { return 0; }").get()); };
+            const unsigned overflow = 16;
+            for (unsigned c=0; c<ShaderSourceParser::SignatureCacheCapacity + overflow; ++c) {
+                ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(makeSource(c)));
+                    // keep the first source recently used, so it survives
+                ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(makeSource(0)));
+            }
+            auto metrics = ShaderSourceParser::GetSignatureCacheMetrics();
+            Assert::AreEqual(overflow, metrics._evictions, L"Expecting the cache to stay within its capacity");
+
+            auto builtBefore = metrics._scans + metrics._fullParses;
+            ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(makeSource(0)));
+            ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(makeSource(ShaderSourceParser::SignatureCacheCapacity + overflow - 1)));
+            metrics = ShaderSourceParser::GetSignatureCacheMetrics();
+            Assert::AreEqual(builtBefore, metrics._scans + metrics._fullParses, L"Recently used signatures should not have been evicted");
+            ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(makeSource(1)));
+            metrics = ShaderSourceParser::GetSignatureCacheMetrics();
+            Assert::AreEqual(builtBefore + 1, metrics._scans + metrics._fullParses, L"Least recently used signature should have been evicted");
+        }
+
+        TEST_METHOD(SignatureExtractionPerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            auto sources = LoadAllShaderSources();
+            size_t totalBytes = 0;
+            for (const auto& s:sources) totalBytes += s.second.size();
+
+            const unsigned iterationCount = 10;
+            auto start = __rdtsc();
+            for (unsigned c=0; c<iterationCount; ++c)
+                for (const auto& s:sources) {
+                    TRY {
+                        auto sig = ShaderSourceParser::ParseShaderFragmentSignature(s.second.c_str(), s.second.size());
+                    } CATCH (const ShaderSourceParser::Exceptions::ParsingFailure&) {
+                    } CATCH_END
+                }
+            auto middle = __rdtsc();
+            for (unsigned c=0; c<iterationCount; ++c)
+                for (const auto& s:sources) {
+                    TRY {
+                        auto sig = ShaderSourceParser::BuildShaderFragmentSignature(s.second.c_str(), s.second.size());
+                    } CATCH (const ShaderSourceParser::Exceptions::ParsingFailure&) {
+                    } CATCH_END
+                }
+            auto middle2 = __rdtsc();
+            ShaderSourceParser::ClearSignatureCache();
+            for (unsigned c=0; c<iterationCount; ++c)
+                for (const auto& s:sources) {
+                    TRY {
+                        auto sig = ShaderSourceParser::GetShaderFragmentSignature(MakeStringSection(s.second));
+                    } CATCH (const ShaderSourceParser::Exceptions::ParsingFailure&) {
+                    } CATCH_END
+                }
+            auto end = __rdtsc();
+
+            auto metrics = ShaderSourceParser::GetSignatureCacheMetrics();
+            LogAlwaysWarning << "Signature extraction over " << sources.size() << " files (" << totalBytes << " bytes), " << iterationCount << " iterations";
+            LogAlwaysWarning << "Full parser: " << (middle-start) / (uint64(totalBytes)*iterationCount) << " cycles per byte";
+            LogAlwaysWarning << "Fast scanner (with fallback): " << (middle2-middle) / (uint64(totalBytes)*iterationCount) << " cycles per byte";
+            LogAlwaysWarning << "Cached: " << (end-middle2) / (uint64(totalBytes)*iterationCount) << " cycles per byte";
+            LogAlwaysWarning << "Cache metrics: " << metrics._memoryHits << " memory hits, " << metrics._scans << " scans, " << metrics._fullParses << " full parses";
+        }
+
+        TEST_METHOD(PreprocessedSourceHashing)
+        {
+            std::map<std::string, std::string> includes;
+            includes["common.h"] = 
+                "#if !defined(COMMON_H)\n"
+                "#define COMMON_H\n"
+                "    #if SKIN_TYPE == 1\n"
+                "        float4 Skin();\n"
+                "    #endif\n"
+                "    float4 Common() { return VALUE; }\n"
+                "#endif\n";
+            RenderCore::Assets::ShaderIncludeLoader loader = 
+                [&includes](std::string& contents, ::Assets::DependentFileState& resolvedFile, StringSection<::Assets::ResChar> requestedName, StringSection<::Assets::ResChar>)
+                {
+                    auto i = includes.find(requestedName.AsString());
+                    if (i == includes.end()) return false;
+                    contents = i->second;
+                    resolvedFile._filename = i->first;
+                    return true;
+                };
+
+            const char shader[] = 
+                "#include \"common.h\"\n"
+                "#include \"common.h\"\n"
+                "#if defined(USE_A) && (A_LEVEL > 2)  // comment\n"
+                "    float a; /* block\n comment */\n"
+                "#else\n"
+                "    float b;\n"
+                "#endif\n"
+                "float4 main() : SV_Target { return Common(); }\n";
+
+            auto hash = [&](const char definesTable[])
+            {
+                auto result = RenderCore::Assets::PreprocessShaderSource(
+                    MakeStringSection(shader), "main.psh", definesTable, loader);
+                Assert::IsTrue(result._isReliable, L"Preprocessing should be reliable for simple source");
+                Assert::AreEqual(size_t(1), result._includeFiles.size(), L"Include files should be recorded once");
+                return result._hash;
+            };
+
+            auto baseHash = hash("");
+            Assert::AreEqual(baseHash, hash("UNUSED=1"), L"Unreferenced defines shouldn't change the hash");
+            Assert::AreEqual(baseHash, hash("USE_A=1"), L"Defines that don't change the output shouldn't change the hash");
+            Assert::AreEqual(baseHash, hash("SKIN_TYPE=0;UNUSED=2"), L"Defines that don't change the output shouldn't change the hash");
+            Assert::AreNotEqual(baseHash, hash("USE_A=1;A_LEVEL=3"), L"Conditional output should change the hash");
+            Assert::AreNotEqual(baseHash, hash("SKIN_TYPE=1"), L"Conditional output in include should change the hash");
+            Assert::AreNotEqual(hash("VALUE=2"), hash("VALUE=3"), L"Defines substituted into the output should change the hash");
+
+            auto functionLike = RenderCore::Assets::PreprocessShaderSource(
+                "#define F(x) x\n#if F(1)\n#endif\n", "test.psh", "", loader);
+            Assert::IsFalse(functionLike._isReliable, L"Function like macros in conditionals aren't supported");
+
+            auto missingInclude = RenderCore::Assets::PreprocessShaderSource(
+                "#include \"missing.h\"\n", "test.psh", "", loader);
+            Assert::IsFalse(missingInclude._isReliable, L"Missing includes should prevent sharing");
+        }
+
+        static RenderCore::Assets::ShaderIncludeLoader MakeInMemoryLoader(
+            const std::map<std::string, std::string>& files, unsigned* loadCount = nullptr)
+        {
+            return [&files, loadCount](
+                std::string& contents, ::Assets::DependentFileState& resolvedFile, 
+                StringSection<::Assets::ResChar> requestedName, StringSection<::Assets::ResChar>)
+                {
+                    auto i = files.find(requestedName.AsString());
+                    if (i == files.end()) return false;
+                    contents = i->second;
+                    resolvedFile._filename = i->first;
+                    if (loadCount) ++(*loadCount);
+                    return true;
+                };
+        }
+
+        TEST_METHOD(IncludeGraphQueries)
+        {
+            using RenderCore::ShaderService;
+            std::map<std::string, std::string> files;
+            files["common.h"] = "#if !defined(COMMON_H)\n#define COMMON_H\n#include \"lighting.h\"\n#endif\n";
+            files["lighting.h"] = "#include \"common.h\"\n// #include \"commented.h\"\n/* #include \"commented.h\" */\n";
+            files["transform.h"] = "float4x4 WorldToClip;\n";
+            files["surface.h"] = "  #  include \"common.h\"\n#include <transform.h>\n";
+            files["forward.psh"] = "#include \"lighting.h\"\n#include \"surface.h\"\n";
+            files["deferred.psh"] = "#include \"surface.h\"\n";
+            files["shadow.vsh"] = "#include \"transform.h\"\n";
+
+            RenderCore::Assets::ShaderIncludeGraph graph(MakeInMemoryLoader(files));
+
+            auto closure = graph.GetIncludeClosure("forward.psh");
+            Assert::AreEqual(size_t(5), closure.size(), L"Include closure should contain every file reached (and ignore commented includes)");
+            Assert::IsTrue(std::find(closure.begin(), closure.end(), "transform.h") != closure.end(), L"Include closure missing file");
+
+            auto forwardDepVal = graph.GetDependencyValidation("forward.psh");
+            auto shadowDepVal = graph.GetDependencyValidation("shadow.vsh");
+                // (the variants are only weakly referenced by the graph; these stand in for the assets that own them)
+            std::shared_ptr<::Assets::DependencyValidation> owners[4];
+            for (auto& o:owners) o = std::make_shared<::Assets::DependencyValidation>();
+            graph.RegisterVariant("forward.psh:main:ps_5_0", ShaderService::ResId("forward.psh", "main", "ps_5_0"), "", owners[0]);
+            graph.RegisterVariant("forward.psh:main:ps_5_0", ShaderService::ResId("forward.psh", "main", "ps_5_0"), "SKIN=1", owners[1]);
+            graph.RegisterVariant("deferred.psh:main:ps_5_0", ShaderService::ResId("deferred.psh", "main", "ps_5_0"), "", owners[2]);
+            graph.RegisterVariant("shadow.vsh:main:vs_5_0", ShaderService::ResId("shadow.vsh", "main", "vs_5_0"), "", owners[3]);
+
+            Assert::AreEqual(size_t(4), graph.FindDependentVariants("transform.h").size(), L"Wrong number of dependent variants");
+            Assert::AreEqual(size_t(3), graph.FindDependentVariants("common.h").size(), L"Wrong number of dependent variants");
+            Assert::AreEqual(size_t(1), graph.FindDependentVariants("shadow.vsh").size(), L"Wrong number of dependent variants");
+
+            auto scansBefore = graph.GetMetrics()._fileScans;
+            Assert::AreEqual(7u, scansBefore, L"Each file should be scanned once");
+            graph.GetIncludeClosure("deferred.psh");
+            graph.FindDependentVariants("common.h");
+            Assert::AreEqual(scansBefore, graph.GetMetrics()._fileScans, L"Files should not be scanned again without a change");
+
+                // once the owner of a variant is gone, a change should drop it rather than recompile it
+            owners[1].reset();
+            graph.OnFileChange("common.h");
+            Assert::IsTrue(forwardDepVal->GetValidationIndex() != 0, L"Change to an included file should invalidate the root file");
+            Assert::IsTrue(shadowDepVal->GetValidationIndex() == 0, L"Change to an unrelated file should not invalidate the root file");
+            Assert::AreEqual(2u, graph.GetPendingRecompileCount(), L"Dependent variants that are still alive should be queued for recompile");
+            Assert::AreEqual(1u, graph.GetMetrics()._droppedVariants, L"Expired dependent variant should be removed");
+            Assert::AreEqual(size_t(2), graph.FindDependentVariants("common.h").size(), L"Expired variant should no longer be recorded");
+
+            graph.GetIncludeClosure("forward.psh");
+            Assert::AreEqual(scansBefore+1, graph.GetMetrics()._fileScans, L"Only the changed file should be scanned again");
+
+                // variants that expire while queued are skipped
+            owners[2].reset();
+            auto batch = graph.TakeRecompileBatch();
+            Assert::AreEqual(size_t(1), batch.size(), L"Recompile batch should contain every queued variant that is still alive");
+            Assert::AreEqual(0u, graph.GetPendingRecompileCount(), L"Recompile batch should empty the queue");
+            Assert::AreEqual(2u, graph.GetMetrics()._droppedVariants, L"Variant expiring in the queue should be removed");
+        }
+
+        TEST_METHOD(IncludeGraphRecompilePriority)
+        {
+                //  Synthetic tree: many root files sharing a single header, each with a number of
+                //  variants. Only a few variants are in use (ie, needed to draw the current frame).
+                //  After an edit to the shared header, we measure how many compiles must complete
+                //  before every in-use variant is up to date (time to first correct frame).
+            using RenderCore::ShaderService;
+            const unsigned rootFileCount = 64, variantsPerFile = 8, inUseStride = 37;
+            const unsigned simulatedCompileMilliseconds = 40;
+
+            std::map<std::string, std::string> files;
+            files["shared.h"] = "#include \"constants.h\"\n";
+            files["constants.h"] = "cbuffer Constants { float4 A; }\n";
+            for (unsigned c=0; c<rootFileCount; ++c)
+                files[(StringMeld<64>() << "root" << c << ".psh").get()] = "#include \"shared.h\"\n";
+
+            RenderCore::Assets::ShaderIncludeGraph graph(MakeInMemoryLoader(files));
+
+            std::vector<std::shared_ptr<::Assets::DependencyValidation>> inUse;
+            std::vector<bool> fifoInUse;
+            for (unsigned c=0; c<rootFileCount*variantsPerFile; ++c) {
+                std::string filename = (StringMeld<64>() << "root" << (c/variantsPerFile) << ".psh").get();
+                std::string defines = (StringMeld<64>() << "VARIANT=" << (c%variantsPerFile)).get();
+                std::shared_ptr<::Assets::DependencyValidation> depVal;
+                if ((c%inUseStride) == 0) {
+                    depVal = std::make_shared<::Assets::DependencyValidation>();
+                    inUse.push_back(depVal);
+                }
+                fifoInUse.push_back(!!depVal);
+                graph.RegisterVariant(
+                    MakeStringSection(filename), ShaderService::ResId(filename.c_str(), "main", "ps_5_0"),
+                    MakeStringSection(defines), depVal);
+            }
+
+            auto start = __rdtsc();
+            graph.OnFileChange("constants.h");
+            auto batch = graph.TakeRecompileBatch();
+            auto end = __rdtsc();
+
+            Assert::AreEqual(inUse.size(), batch.size(), L"Every variant in use should be queued after a change to the shared header");
+            Assert::AreEqual(unsigned(rootFileCount*variantsPerFile - inUse.size()), graph.GetMetrics()._droppedVariants, L"Variants that are no longer in use should be dropped");
+
+            auto compilesUntilCorrect = [&inUse](const std::vector<bool>& order) -> unsigned
+            {
+                unsigned remaining = (unsigned)inUse.size();
+                for (unsigned c=0; c<(unsigned)order.size(); ++c)
+                    if (order[c] && --remaining == 0) return c+1;
+                return (unsigned)order.size();
+            };
+
+            std::vector<bool> prioritisedInUse;
+            for (const auto& v:batch) prioritisedInUse.push_back(v._inUse);
+            auto prioritised = compilesUntilCorrect(prioritisedInUse);
+            auto fifo = compilesUntilCorrect(fifoInUse);
+
+            Assert::AreEqual(unsigned(inUse.size()), prioritised, L"In use variants should be recompiled first");
+
+            LogAlwaysWarning << "Include graph change processing: " << (end-start) << " cycles for " << batch.size() << " variants";
+            LogAlwaysWarning << "Time to first correct frame (" << simulatedCompileMilliseconds << "ms per compile): "
+                << prioritised * simulatedCompileMilliseconds << "ms prioritised, " 
+                << fifo * simulatedCompileMilliseconds << "ms in request order";
+        }
+
+        TEST_METHOD(SharedByteCodeForEquivalentVariations)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            auto compiler = std::make_shared<StandInShaderCompiler>();
+            auto shaderSource = std::make_shared<RenderCore::Assets::LocalCompiledShaderSource>(compiler);
+
+            const char shader[] = 
+                "#if SELECT_A\n"
+                "    float4 main() : SV_Target { return 1; }\n"
+                "#else\n"
+                "    float4 main() : SV_Target { return VALUE; }\n"
+                "#endif\n";
+            const char* definesTables[] = { "", "UNUSED=1", "SELECT_A=1", "SELECT_A=1;UNUSED=2", "VALUE=3", "VALUE=3;SELECT_A=0" };
+
+                // compile each variation in turn, keeping the results alive
+            std::vector<std::shared_ptr<RenderCore::ShaderService::IPendingMarker>> markers;
+            for (auto d:definesTables) {
+                auto marker = shaderSource->CompileFromMemory(shader, "main", "ps_5_0", d);
+                Assert::IsTrue(marker->StallWhilePending() == ::Assets::AssetState::Ready);
+                markers.push_back(marker);
+            }
+
+            Assert::AreEqual(3u, compiler->GetCompileCount(), L"Equivalent variations should share compiled byte code");
+            
+            RenderCore::ShaderService::IPendingMarker::Payload a, b;
+            markers[0]->TryResolve(a, nullptr);
+            markers[1]->TryResolve(b, nullptr);
+            Assert::IsTrue(a == b, L"Shared variations should return the same payload");
+
+            shaderSource->StallOnPendingOperations(true);
+        }
+
+        static ShaderPatcher::NodeGraph MakeChainGraph(unsigned nodeCount, const char constantValue[], unsigned changedNode = ~0u)
+        {
+                // a long chain of "Add1" nodes, each adding a constant to the result of the previous node
+            ShaderPatcher::NodeGraph graph("ChainGraph");
+            for (unsigned c=0; c<nodeCount; ++c) {
+                graph.Add(ShaderPatcher::Node("game/xleres/Nodes/Basic.sh:Add1", c+1, ShaderPatcher::Node::Type::Procedure));
+                if (c != 0) {
+                    graph.Add(ShaderPatcher::NodeConnection(c+1, c, "lhs", "result", ShaderPatcher::Type("float")));
+                } else
+                    graph.Add(ShaderPatcher::ConstantConnection(c+1, "lhs", "0"));
+                graph.Add(ShaderPatcher::ConstantConnection(c+1, "rhs", (c == changedNode) ? constantValue : "0.5"));
+            }
+            graph.AddDefaultOutputs();
+            return graph;
+        }
+
+        TEST_METHOD(ShaderPatcherGenerationPerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+            const unsigned nodeCount = 1000;
+            auto original = MakeChainGraph(nodeCount, "0.5");
+            auto constantEdit = MakeChainGraph(nodeCount, "0.25", nodeCount/2);
+            auto structuralEdit = MakeChainGraph(nodeCount, "0.5");
+            structuralEdit.Add(ShaderPatcher::Node("game/xleres/Nodes/Basic.sh:Add1", nodeCount+1, ShaderPatcher::Node::Type::Procedure));
+
+                // changing a constant is only a parameter update when constants become parameters
+            Assert::IsTrue(ShaderPatcher::ClassifyGraphEdit(original, original, true) == ShaderPatcher::GraphEdit::None);
+            Assert::IsTrue(ShaderPatcher::ClassifyGraphEdit(original, constantEdit, true) == ShaderPatcher::GraphEdit::ParameterUpdate);
+            Assert::IsTrue(ShaderPatcher::ClassifyGraphEdit(original, constantEdit, false) == ShaderPatcher::GraphEdit::Recompile);
+            Assert::IsTrue(ShaderPatcher::ClassifyGraphEdit(original, structuralEdit, true) == ShaderPatcher::GraphEdit::Recompile);
+
+                // uncached generation (the original behaviour)
+            auto start = __rdtsc();
+            std::string uncachedBody;
+            {
+                ShaderPatcher::MainFunctionInterface interf(constantEdit);
+                uncachedBody = ShaderPatcher::GenerateShaderBody(constantEdit, interf);
+            }
+            auto middle = __rdtsc();
+
+                // cached generation; first with a cold cache, and then after an edit
+            ShaderPatcher::GeneratorCache cache;
+            std::string cachedBody0, cachedBody1;
+            {
+                ShaderPatcher::MainFunctionInterface interf(original, true);
+                cachedBody0 = ShaderPatcher::GenerateShaderBody(original, interf, &cache);
+            }
+            auto middle2 = __rdtsc();
+            {
+                ShaderPatcher::MainFunctionInterface interf(constantEdit, true);
+                cachedBody1 = ShaderPatcher::GenerateShaderBody(constantEdit, interf, &cache);
+            }
+            auto end = __rdtsc();
+
+            Assert::IsTrue(cachedBody0 == cachedBody1, L"Changing a parameterised constant should not change the generated code");
+            Assert::IsTrue(uncachedBody != cachedBody1, L"Constants should be replaced with parameters");
+            auto metrics = cache.GetMetrics();
+            Assert::AreEqual(nodeCount, metrics._nodeMisses, L"Every node should be generated once");
+            Assert::AreEqual(nodeCount, metrics._nodeHits, L"Every node should be reused after a constant change");
+
+            {
+                    // without constants as parameters, only the changed node should be regenerated
+                ShaderPatcher::GeneratorCache literalCache;
+                ShaderPatcher::MainFunctionInterface interf0(original);
+                ShaderPatcher::GenerateShaderBody(original, interf0, &literalCache);
+                ShaderPatcher::MainFunctionInterface interf1(constantEdit);
+                auto body = ShaderPatcher::GenerateShaderBody(constantEdit, interf1, &literalCache);
+                Assert::IsTrue(body == uncachedBody, L"Cached generation should match uncached generation");
+                Assert::AreEqual(nodeCount+1, literalCache.GetMetrics()._nodeMisses);
+            }
+
+            LogAlwaysWarning << "Shader patcher generation for " << nodeCount << " nodes";
+            LogAlwaysWarning << "Uncached: " << (middle-start) / nodeCount << " cycles per node";
+            LogAlwaysWarning << "Cold cache: " << (middle2-middle) / nodeCount << " cycles per node";
+            LogAlwaysWarning << "After constant edit: " << (end-middle2) / nodeCount << " cycles per node";
+        }
+
+        TEST_METHOD(PreviewShaderParameterUpdates)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+                // drive the preview path through a sequence of edits, as the editor does
+            const unsigned nodeCount = 16;
+            ShaderPatcher::GeneratorCache cache;
+            ShaderPatcher::PreviewShaderGenerator generator(&cache);
+            ShaderPatcher::PreviewOptions options = { ShaderPatcher::PreviewOptions::Type::Object, std::string(), ShaderPatcher::PreviewOptions::VariableRestrictions() };
+
+            auto first = generator.Generate(MakeChainGraph(nodeCount, "0.5"), options);
+            Assert::IsTrue(first._edit == ShaderPatcher::GraphEdit::Recompile);
+            auto metrics = cache.GetMetrics();
+
+                // changing a constant should only update the material parameters
+            auto constantEdit = generator.Generate(MakeChainGraph(nodeCount, "0.25", nodeCount/2), options);
+            Assert::IsTrue(constantEdit._edit == ShaderPatcher::GraphEdit::ParameterUpdate);
+            Assert::IsTrue(constantEdit._shaderText == first._shaderText, L"Shader should not change after a constant edit");
+            Assert::IsTrue(constantEdit._cbLayout != first._cbLayout, L"Material parameters should pick up the new constant");
+            Assert::IsTrue(constantEdit._cbLayout.find("0.25") != std::string::npos);
+            Assert::AreEqual(metrics._nodeMisses, cache.GetMetrics()._nodeMisses, L"No code should be generated for a parameter update");
+            Assert::AreEqual(metrics._nodeHits, cache.GetMetrics()._nodeHits, L"No code should be generated for a parameter update");
+
+            auto noEdit = generator.Generate(MakeChainGraph(nodeCount, "0.25", nodeCount/2), options);
+            Assert::IsTrue(noEdit._edit == ShaderPatcher::GraphEdit::None);
+            Assert::IsTrue(noEdit._shaderText == first._shaderText && noEdit._cbLayout == constantEdit._cbLayout);
+
+                // structural changes and changes to the preview options require new code
+            auto structuralEdit = generator.Generate(MakeChainGraph(nodeCount+1, "0.25", nodeCount/2), options);
+            Assert::IsTrue(structuralEdit._edit == ShaderPatcher::GraphEdit::Recompile);
+            Assert::IsTrue(structuralEdit._shaderText != first._shaderText);
+
+            auto restrictedOptions = options;
+            restrictedOptions._variableRestrictions.push_back(std::make_pair("UnusedVariable", "0:1:2"));
+            auto optionsEdit = generator.Generate(MakeChainGraph(nodeCount+1, "0.25", nodeCount/2), restrictedOptions);
+            Assert::IsTrue(optionsEdit._edit == ShaderPatcher::GraphEdit::Recompile);
+        }
     };
 }
-
@@ -0,0 +1,262 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../PlatformRig/PlatformRigUtil.h"
+#include "../SceneEngine/LightDesc.h"
+#include "../RenderCore/Techniques/TechniqueUtils.h"
+#include "../Math/Transformations.h"
+#include "../Math/ProjectionMath.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <random>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using AABB = PlatformRig::ShadowCascadeSceneBounds::AABB;
+
+        //  A synthetic scene: a grid of flat "terrain" cells, with some tall
+        //  towers scattered across it
+    class SyntheticScene
+    {
+    public:
+        std::vector<AABB> _receivers;
+        std::vector<AABB> _casters;
+
+        SyntheticScene(Float2 mins, Float2 maxs, float cellSize, unsigned towerCount)
+        {
+            for (float y=mins[1]; y<maxs[1]; y+=cellSize)
+                for (float x=mins[0]; x<maxs[0]; x+=cellSize)
+                    _receivers.push_back(AABB(Float3(x, y, 0.f), Float3(x+cellSize, y+cellSize, 2.f)));
+
+            std::mt19937 rng(2981);
+            std::uniform_real_distribution<float> px(mins[0], maxs[0]), py(mins[1], maxs[1]), height(10.f, 60.f);
+            for (unsigned c=0; c<towerCount; ++c) {
+                Float3 base(px(rng), py(rng), 0.f);
+                _casters.push_back(AABB(base - Float3(3.f, 3.f, 0.f), base + Float3(3.f, 3.f, height(rng))));
+            }
+
+            _casters.insert(_casters.end(), _receivers.begin(), _receivers.end());
+            _receivers.insert(_receivers.end(), _casters.begin(), _casters.begin() + towerCount);
+        }
+
+        PlatformRig::ShadowCascadeSceneBounds AsBounds() const
+        {
+            PlatformRig::ShadowCascadeSceneBounds result;
+            result._receivers = MakeIteratorRange(_receivers);
+            result._casters = MakeIteratorRange(_casters);
+            return result;
+        }
+    };
+
+    static RenderCore::Techniques::ProjectionDesc MakeCamera(Float3 position, Float3 forward)
+    {
+        RenderCore::Techniques::ProjectionDesc result;
+        result._verticalFov = Deg2Rad(50.f);
+        result._aspectRatio = 16.f / 9.f;
+        result._nearClip = 0.1f;
+        result._farClip = 1000.f;
+        result._cameraToWorld = MakeCameraToWorld(Normalize(forward), Float3(0.f, 0.f, 1.f), position);
+        result._cameraToProjection = PerspectiveProjection(
+            result._verticalFov, result._aspectRatio, result._nearClip, result._farClip,
+            GeometricCoordinateSpace::RightHanded, RenderCore::Techniques::GetDefaultClipSpaceType());
+        result._worldToProjection = Combine(InvertOrthonormalTransform(result._cameraToWorld), result._cameraToProjection);
+        return result;
+    }
+
+    static SceneEngine::LightDesc MakeSun()
+    {
+        SceneEngine::LightDesc result;
+        result._position = Normalize(Float3(0.4f, 0.3f, 1.f));
+        return result;
+    }
+
+    static PlatformRig::DefaultShadowFrustumSettings MakeFittedSettings()
+    {
+        PlatformRig::DefaultShadowFrustumSettings result;
+        result._flags |= PlatformRig::DefaultShadowFrustumSettings::Flags::FitToSceneBounds;
+        result._frustumCount = 4;
+        result._maxDistanceFromCamera = 400.f;
+        return result;
+    }
+
+        //  Transform into the ortho definition space of the projection (with +z away from the light)
+    static Float3 ToDefinitionSpace(const SceneEngine::ShadowProjectionDesc& desc, Float3 worldPosition)
+    {
+        auto result = TransformPoint(desc._projections._definitionViewMatrix, worldPosition);
+        result[2] = -result[2];
+        return result;
+    }
+
+    TEST_CLASS(ShadowCascades)
+    {
+    public:
+        TEST_METHOD(FittedCascadesContainReceivers)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            SyntheticScene scene(Float2(-512.f, -512.f), Float2(512.f, 512.f), 32.f, 64);
+            auto camera = MakeCamera(Float3(10.f, -60.f, 25.f), Float3(0.2f, 1.f, -0.25f));
+            auto settings = MakeFittedSettings();
+
+            PlatformRig::ShadowCascadeFittingMetrics metrics;
+            auto desc = PlatformRig::CalculateDefaultShadowCascades(MakeSun(), 0, camera, settings, scene.AsBounds(), &metrics);
+            Assert::AreEqual(settings._frustumCount, (unsigned)metrics._cascades.size(), L"Fitting metrics missing");
+            Assert::IsTrue(metrics._depthRange < metrics._unfittedDepthRange, L"Depth range not clamped to scene bounds");
+
+                //  Sample points on the receivers that are visible from the camera. Each one must
+                //  be within the cascade for its split.
+            auto cameraPos = ExtractTranslation(camera._cameraToWorld);
+            auto cameraForward = ExtractForward_Cam(camera._cameraToWorld);
+            float tanHalfFov = std::tan(.5f * camera._verticalFov);
+            float cornerCos = 1.f / std::sqrt(1.f + tanHalfFov * tanHalfFov * (1.f + camera._aspectRatio * camera._aspectRatio));
+
+            std::mt19937 rng(7717);
+            std::uniform_real_distribution<float> u(0.f, 1.f);
+            unsigned tested = 0;
+            for (unsigned c=0; c<20000; ++c) {
+                const auto& r = scene._receivers[rng() % scene._receivers.size()];
+                Float3 p(LinearInterpolate(r.first[0], r.second[0], u(rng)), LinearInterpolate(r.first[1], r.second[1], u(rng)), LinearInterpolate(r.first[2], r.second[2], u(rng)));
+                if (CullAABB(camera._worldToProjection, p, p)) continue;
+
+                float depth = Dot(p - cameraPos, cameraForward);
+                for (unsigned f=0; f<metrics._cascades.size(); ++f) {
+                    if (depth < metrics._cascades[f]._nearDistance * cornerCos || depth > metrics._cascades[f]._farDistance * cornerCos) continue;
+                    auto d = ToDefinitionSpace(desc, p);
+                    const auto& sub = desc._projections._orthoSub[f];
+                    Assert::IsTrue(
+                            d[0] >= sub._projMins[0] && d[0] <= sub._projMaxs[0]
+                        &&  d[1] >= sub._projMins[1] && d[1] <= sub._projMaxs[1]
+                        &&  d[2] >= sub._projMins[2] && d[2] <= sub._projMaxs[2],
+                        L"Visible receiver outside of its shadow cascade");
+                    ++tested;
+                }
+            }
+            Assert::IsTrue(tested > 1000, L"Too few receiver samples within the camera frustum");
+
+                //  Any caster that overlaps a cascade and is in front of its receivers must be
+                //  within the depth range (otherwise its shadow would be lost)
+            for (const auto& c:scene._casters) {
+                for (unsigned f=0; f<metrics._cascades.size(); ++f) {
+                    const auto& sub = desc._projections._orthoSub[f];
+                    Float3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                    for (unsigned q=0; q<8; ++q) {
+                        auto d = ToDefinitionSpace(desc, Float3((q&1)?c.second[0]:c.first[0], (q&2)?c.second[1]:c.first[1], (q&4)?c.second[2]:c.first[2]));
+                        for (unsigned i=0; i<3; ++i) { mins[i] = std::min(mins[i], d[i]); maxs[i] = std::max(maxs[i], d[i]); }
+                    }
+                    if (mins[0] > sub._projMaxs[0] || maxs[0] < sub._projMins[0] || mins[1] > sub._projMaxs[1] || maxs[1] < sub._projMins[1]) continue;
+                    if (mins[2] > sub._projMaxs[2]) continue;
+                    Assert::IsTrue(mins[2] >= sub._projMins[2], L"Shadow caster clipped by the near plane");
+                }
+            }
+        }
+
+        TEST_METHOD(FittedCascadesAreTighter)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  A small island of geometry in front of the camera. The splits should stop at the
+                //  far edge of the island, and the cascades should be much smaller than the camera frustum.
+            SyntheticScene scene(Float2(-40.f, 20.f), Float2(40.f, 100.f), 8.f, 8);
+            auto camera = MakeCamera(Float3(0.f, 0.f, 10.f), Float3(0.f, 1.f, -0.1f));
+            auto settings = MakeFittedSettings();
+
+            PlatformRig::ShadowCascadeFittingMetrics metrics;
+            PlatformRig::CalculateDefaultShadowCascades(MakeSun(), 0, camera, settings, scene.AsBounds(), &metrics);
+            Assert::AreEqual(settings._frustumCount, (unsigned)metrics._cascades.size(), L"Fitting metrics missing");
+            Assert::IsTrue(metrics._cascades[0]._nearDistance > 10.f, L"First split should start near the island");
+            Assert::IsTrue(metrics._cascades.back()._farDistance < 200.f, L"Last split should finish near the island");
+            Assert::IsTrue(metrics._casterCount > 0, L"No casters found");
+
+            float fittedCoverage = 0.f, unfittedCoverage = 0.f;
+            for (const auto& c:metrics._cascades) {
+                    // (cascade sizes are rounded up to the next step in the size ladder, so can be a little larger)
+                Assert::IsTrue(c._areaRatio <= 1.25f, L"Fitted cascade much larger than the unfitted cascade");
+                fittedCoverage += c._coverage;
+                unfittedCoverage += c._unfittedCoverage;
+            }
+            Assert::IsTrue(fittedCoverage > unfittedCoverage, L"Fitting didn't improve coverage");
+            Assert::IsTrue(metrics._cascades.back()._areaRatio < 0.75f, L"Far cascade not clamped to the receivers");
+            Assert::IsTrue(metrics._wastedArea <= metrics._geometricWastedArea, L"Split distances waste more area than the default splits");
+
+                //  Without the flag (or without receivers), we should get exactly the unfitted result
+            auto unfittedSettings = settings;
+            unfittedSettings._flags &= ~PlatformRig::DefaultShadowFrustumSettings::Flags::FitToSceneBounds;
+            auto a = PlatformRig::CalculateDefaultShadowCascades(MakeSun(), 0, camera, unfittedSettings, scene.AsBounds());
+            auto b = PlatformRig::CalculateDefaultShadowCascades(MakeSun(), 0, camera, settings, PlatformRig::ShadowCascadeSceneBounds());
+            auto reference = PlatformRig::CalculateDefaultShadowCascades(MakeSun(), 0, camera, settings);
+            for (unsigned f=0; f<settings._frustumCount; ++f)
+                for (unsigned q=0; q<3; ++q) {
+                    Assert::AreEqual(reference._projections._orthoSub[f]._projMins[q], a._projections._orthoSub[f]._projMins[q], L"Unfitted result changed");
+                    Assert::AreEqual(reference._projections._orthoSub[f]._projMins[q], b._projections._orthoSub[f]._projMins[q], L"Unfitted result changed");
+                }
+        }
+
+        TEST_METHOD(SplitsMinimiseWastedArea)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Two separate patches of geometry, one behind the other. The default geometric
+                //  splits put parts of both patches (and the gap between them) into the same
+                //  cascade; other split distances can avoid that.
+            SyntheticScene scene(Float2(-30.f, 35.f), Float2(-10.f, 55.f), 4.f, 0);
+            SyntheticScene farPatch(Float2(0.f, 60.f), Float2(40.f, 100.f), 8.f, 0);
+            scene._receivers.insert(scene._receivers.end(), farPatch._receivers.begin(), farPatch._receivers.end());
+            scene._casters.insert(scene._casters.end(), farPatch._casters.begin(), farPatch._casters.end());
+            auto camera = MakeCamera(Float3(0.f, 0.f, 10.f), Float3(0.f, 1.f, -0.1f));
+            auto settings = MakeFittedSettings();
+
+            PlatformRig::ShadowCascadeFittingMetrics metrics;
+            PlatformRig::CalculateDefaultShadowCascades(MakeSun(), 0, camera, settings, scene.AsBounds(), &metrics);
+            Assert::AreEqual(settings._frustumCount, (unsigned)metrics._cascades.size(), L"Fitting metrics missing");
+            Assert::IsTrue(metrics._wastedArea < metrics._geometricWastedArea, L"Split distances weren't adjusted to reduce wasted area");
+            for (unsigned f=1; f<metrics._cascades.size(); ++f)
+                Assert::AreEqual(metrics._cascades[f-1]._farDistance, metrics._cascades[f]._nearDistance, L"Gap between split distances");
+        }
+
+        TEST_METHOD(FittedCascadesAreStable)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  As the camera moves a little, cascades should stay aligned to the shadow
+                //  texel grid; so any change in the position of a cascade is a whole number of
+                //  texels (and the shadow texels don't shimmer)
+            SyntheticScene scene(Float2(-512.f, -512.f), Float2(512.f, 512.f), 32.f, 64);
+            auto settings = MakeFittedSettings();
+
+            SceneEngine::ShadowProjectionDesc previous;
+            unsigned comparisons = 0;
+            for (unsigned frame=0; frame<32; ++frame) {
+                auto camera = MakeCamera(Float3(10.f + 0.37f * float(frame), -60.f + 0.21f * float(frame), 25.f), Float3(0.2f, 1.f, -0.25f));
+                auto desc = PlatformRig::CalculateDefaultShadowCascades(MakeSun(), 0, camera, settings, scene.AsBounds());
+
+                for (unsigned f=0; f<settings._frustumCount; ++f) {
+                    const auto& sub = desc._projections._orthoSub[f];
+                    for (unsigned q=0; q<2; ++q) {
+                        float texel = (sub._projMaxs[q] - sub._projMins[q]) / float(settings._textureSize);
+                        float texelPosition = sub._projMins[q] / texel;
+                            // (allowing for floating point precision when cascades are small and far from the origin)
+                        float tolerance = 0.01f + 1e-6f * std::abs(texelPosition);
+                        Assert::IsTrue(std::abs(texelPosition - std::round(texelPosition)) < tolerance, L"Cascade not aligned to shadow texels");
+
+                        if (frame == 0) continue;
+                        const auto& prev = previous._projections._orthoSub[f];
+                        if (std::abs((prev._projMaxs[q] - prev._projMins[q]) - (sub._projMaxs[q] - sub._projMins[q])) > 1e-3f * texel) continue;
+                        float shift = (sub._projMins[q] - prev._projMins[q]) / texel;
+                        Assert::IsTrue(std::abs(shift - std::round(shift)) < 2.f * tolerance, L"Cascade moved by a fraction of a texel");
+                        ++comparisons;
+                    }
+                }
+                previous = desc;
+            }
+            Assert::IsTrue(comparisons > 32, L"Cascade sizes changed too frequently");
+        }
+    };
+}
+
@@ -0,0 +1,387 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Utility/HeapUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../ConsoleRig/Log.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  This is the way SpanningHeap used to work -- a single array of markers, with
+        //  a linear best fit search for allocations, and vector inserts & erases for
+        //  every change. The new implementation should give exactly the same results.
+    template<typename Marker>
+        class ReferenceSpanningHeap : public MarkerHeap<Marker>
+    {
+    public:
+        using MarkerHeap<Marker>::ToInternalSize;
+        using MarkerHeap<Marker>::ToExternalSize;
+        using MarkerHeap<Marker>::AlignSize;
+
+        std::vector<Marker> _markers;
+
+        unsigned Allocate(unsigned size)
+        {
+            Marker internalSize = ToInternalSize(AlignSize(size));
+            if (_markers.empty()) return ~unsigned(0x0);
+
+            const Marker sentinel = Marker(~0x0);
+            Marker bestSize = sentinel;
+            auto best = _markers.end();
+            for (auto i=_markers.begin(); i<(_markers.end()-1); i+=2) {
+                Marker blockSize = *(i+1) - *i;
+                if (blockSize >= internalSize && blockSize < bestSize) {
+                    bestSize = blockSize;
+                    best = i;
+                }
+            }
+            if (bestSize == sentinel) return ~unsigned(0x0);
+
+            unsigned result = ToExternalSize(*best);
+            if (bestSize == internalSize) {
+                if (best == _markers.begin()) {
+                    if (_markers.size()==2) { _markers.insert(_markers.begin(), 0); }
+                    else { *(best+1) = 0; }
+                } else if (best+2 >= _markers.end()) {
+                    _markers.erase(best);
+                } else {
+                    _markers.erase(best, best+2);
+                }
+            } else {
+                if (best == _markers.begin()) {
+                    Marker insertion[] = {0, internalSize};
+                    _markers.insert(_markers.begin()+1, insertion, &insertion[dimof(insertion)]);
+                } else {
+                    *best += internalSize;
+                }
+            }
+            return result;
+        }
+
+        bool BlockAdjust(unsigned ptr, unsigned size, bool allocateOperation)
+        {
+            Marker internalOffset = ToInternalSize(ptr);
+            Marker internalSize = ToInternalSize(AlignSize(size));
+            auto i = _markers.begin()+(allocateOperation?0:1);
+            for (; (i+1)<_markers.end(); i+=2) {
+                Marker start = *i, end = *(i+1);
+                if (internalOffset >= start && internalOffset < end) {
+                    if (start == internalOffset) {
+                        if (end == (internalOffset+internalSize)) {
+                            if (i == _markers.begin() && allocateOperation) { *(i+1) = 0; }
+                            else if (i+2 >= _markers.end()) { _markers.erase(i); }
+                            else { _markers.erase(i, i+2); }
+                            return true;
+                        }
+                        if (i == _markers.begin() && allocateOperation) {
+                            Marker insertion[] = {internalOffset, Marker(internalOffset+internalSize)};
+                            _markers.insert(i+1, insertion, &insertion[dimof(insertion)]);
+                        } else {
+                            *i = internalOffset+internalSize;
+                        }
+                        return true;
+                    } else if (end == (internalOffset+internalSize)) {
+                        if (i+2 >= _markers.end()) { _markers.insert(i+1, internalOffset); }
+                        else { *(i+1) = internalOffset; }
+                        return true;
+                    } else {
+                        Marker insertion[] = {internalOffset, Marker(internalOffset+internalSize)};
+                        _markers.insert(i+1, insertion, &insertion[dimof(insertion)]);
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        unsigned AppendNewBlock(unsigned size)
+        {
+            if (_markers.empty()) {
+                _markers.push_back(0); _markers.push_back(0);
+                _markers.push_back(ToInternalSize(AlignSize(size)));
+                return 0;
+            }
+            auto finalMarker = _markers[_markers.size()-1];
+            auto newEnd = Marker(finalMarker + ToInternalSize(AlignSize(size)));
+            if (_markers.size()&1) { _markers[_markers.size()-1] = newEnd; }
+            else { _markers.push_back(newEnd); }
+            return ToExternalSize(finalMarker);
+        }
+
+        void PerformDefrag(const std::vector<DefragStep>& defrag)
+        {
+            Marker heapEnd = _markers[_markers.size()-1];
+            _markers.clear();
+            _markers.push_back(0);
+            if (!defrag.empty()) {
+                std::vector<DefragStep> byDestination(defrag);
+                std::sort(byDestination.begin(), byDestination.end(),
+                    [](const DefragStep& lhs, const DefragStep& rhs) { return lhs._destination < rhs._destination; });
+
+                Marker blockBegin = ToInternalSize(byDestination[0]._destination);
+                Marker blockEnd = ToInternalSize(byDestination[0]._destination + AlignSize(byDestination[0]._sourceEnd-byDestination[0]._sourceStart));
+                for (auto i=byDestination.cbegin()+1; i!=byDestination.cend(); ++i) {
+                    Marker b = ToInternalSize(i->_destination);
+                    Marker e = ToInternalSize(i->_destination+AlignSize(i->_sourceEnd-i->_sourceStart));
+                    if (b == blockEnd) { blockEnd = e; }
+                    else {
+                        _markers.push_back(blockBegin); _markers.push_back(blockEnd);
+                        blockBegin = b; blockEnd = e;
+                    }
+                }
+                _markers.push_back(blockBegin); _markers.push_back(blockEnd);
+            }
+            _markers.push_back(heapEnd);
+        }
+
+        unsigned CalculateLargestFreeBlock() const
+        {
+            Marker result = 0;
+            for (auto i=_markers.cbegin(); (i+1)<_markers.cend(); i+=2)
+                result = std::max(result, Marker(*(i+1) - *i));
+            return ToExternalSize(result);
+        }
+
+        unsigned CalculateAvailableSpace() const
+        {
+            unsigned result = 0;
+            for (auto i=_markers.cbegin(); (i+1)<_markers.cend(); i+=2)
+                result += *(i+1) - *i;
+            return ToExternalSize(Marker(result));
+        }
+
+        ReferenceSpanningHeap(unsigned size)
+        {
+            _markers.push_back(0);
+            _markers.push_back(ToInternalSize(AlignSize(size)));
+        }
+        ReferenceSpanningHeap() {}
+    };
+
+    template<typename Marker>
+        static void CheckEquivalent(const SpanningHeap<Marker>& heap, const ReferenceSpanningHeap<Marker>& reference)
+    {
+        auto metrics = heap.CalculateMetrics();
+        Assert::AreEqual(reference._markers.size(), metrics.size(), L"Marker count doesn't match reference");
+        for (size_t c=0; c<metrics.size(); ++c)
+            Assert::AreEqual(MarkerHeap<Marker>::ToExternalSize(reference._markers[c]), metrics[c], L"Marker doesn't match reference");
+
+        Assert::AreEqual(reference.CalculateAvailableSpace(), heap.CalculateAvailableSpace(), L"Available space doesn't match reference");
+        Assert::AreEqual(reference.CalculateLargestFreeBlock(), heap.CalculateLargestFreeBlock(), L"Largest free block doesn't match reference");
+        Assert::AreEqual(
+            reference._markers.empty() ? 0u : MarkerHeap<Marker>::ToExternalSize(reference._markers[reference._markers.size()-1]) - reference.CalculateAvailableSpace(),
+            heap.CalculateAllocatedSpace(), L"Allocated space doesn't match reference");
+        Assert::AreEqual(reference._markers.size() <= 2, heap.IsEmpty(), L"IsEmpty() doesn't match reference");
+        Assert::AreEqual(
+            Hash64(AsPointer(reference._markers.cbegin()), AsPointer(reference._markers.cend())),
+            heap.CalculateHash(), L"Hash doesn't match reference");
+    }
+
+    struct LiveAllocation { unsigned _ptr, _size; };
+
+        //  Random sequence of operations, applied to both heaps, with the heaps compared
+        //  after every operation
+    template<typename Marker>
+        static void RunEquivalenceTest(unsigned heapSize, unsigned maxAllocationSize, unsigned operationCount, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        SpanningHeap<Marker> heap(heapSize);
+        ReferenceSpanningHeap<Marker> reference(heapSize);
+        std::vector<LiveAllocation> live;
+
+        for (unsigned c=0; c<operationCount; ++c) {
+            auto op = std::uniform_int_distribution<unsigned>(0, 99)(rng);
+            if (op < 50) {
+                    //  Allocate (with some allocations of exactly the size of a free span)
+                auto size = std::uniform_int_distribution<unsigned>(1, maxAllocationSize)(rng);
+                auto ptr = heap.Allocate(size);
+                Assert::AreEqual(reference.Allocate(size), ptr, L"Allocate() doesn't match reference");
+                if (ptr != ~unsigned(0x0)) live.push_back(LiveAllocation{ptr, size});
+            } else if (op < 88) {
+                if (live.empty()) continue;
+                auto i = live.begin() + std::uniform_int_distribution<size_t>(0, live.size()-1)(rng);
+                    //  sometimes release only the start or end of the allocation
+                auto partial = std::uniform_int_distribution<unsigned>(0, 9)(rng);
+                auto alignedSize = MarkerHeap<Marker>::AlignSize(i->_size);
+                if (partial == 0 && alignedSize > 16) {
+                    Assert::IsTrue(heap.Deallocate(i->_ptr, 16));
+                    Assert::IsTrue(reference.BlockAdjust(i->_ptr, 16, false));
+                    i->_ptr += 16; i->_size = alignedSize - 16;
+                } else if (partial == 1 && alignedSize > 16) {
+                    Assert::IsTrue(heap.Deallocate(i->_ptr + alignedSize - 16, 16));
+                    Assert::IsTrue(reference.BlockAdjust(i->_ptr + alignedSize - 16, 16, false));
+                    i->_size = alignedSize - 16;
+                } else {
+                    Assert::IsTrue(heap.Deallocate(i->_ptr, i->_size));
+                    Assert::IsTrue(reference.BlockAdjust(i->_ptr, i->_size, false));
+                    live.erase(i);
+                }
+            } else if (op < 96) {
+                    //  Allocate at a specific position within a random free span
+                auto& m = reference._markers;
+                if (m.size() < 2) continue;
+                auto span = std::uniform_int_distribution<size_t>(0, (m.size()/2)-1)(rng) * 2;
+                unsigned spanStart = MarkerHeap<Marker>::ToExternalSize(m[span]);
+                unsigned spanEnd = MarkerHeap<Marker>::ToExternalSize(m[span+1]);
+                if (spanStart == spanEnd) continue;
+                auto ptr = spanStart + 16 * std::uniform_int_distribution<unsigned>(0, (spanEnd-spanStart)/16-1)(rng);
+                auto size = 16 * std::uniform_int_distribution<unsigned>(1, (spanEnd-ptr)/16)(rng);
+                Assert::IsTrue(heap.Allocate(ptr, size));
+                Assert::IsTrue(reference.BlockAdjust(ptr, size, true));
+                live.push_back(LiveAllocation{ptr, size});
+            } else if (op < 98) {
+                auto size = 16 * std::uniform_int_distribution<unsigned>(1, 8)(rng);
+                if ((reference._markers[reference._markers.size()-1] + (size>>4)) > std::numeric_limits<Marker>::max()) continue;
+                auto ptr = heap.AppendNewBlock(size);
+                Assert::AreEqual(reference.AppendNewBlock(size), ptr, L"AppendNewBlock() doesn't match reference");
+                live.push_back(LiveAllocation{ptr, size});
+            } else {
+                    //  Defrag, and move the live allocations to match
+                auto steps = heap.CalculateDefragSteps();
+                heap.PerformDefrag(steps);
+                reference.PerformDefrag(steps);
+                for (auto& l:live) {
+                    auto s = std::find_if(steps.cbegin(), steps.cend(),
+                        [&l](const DefragStep& s) { return l._ptr >= s._sourceStart && l._ptr < s._sourceEnd; });
+                    Assert::IsTrue(s != steps.cend(), L"Live allocation not moved by defrag");
+                    l._ptr = l._ptr - s->_sourceStart + s->_destination;
+                }
+            }
+
+            CheckEquivalent(heap, reference);
+        }
+
+            //  Release everything, which should leave just a single free span
+        for (const auto& l:live) {
+            Assert::IsTrue(heap.Deallocate(l._ptr, l._size));
+            Assert::IsTrue(reference.BlockAdjust(l._ptr, l._size, false));
+        }
+        CheckEquivalent(heap, reference);
+        Assert::IsTrue(heap.IsEmpty());
+    }
+
+    TEST_CLASS(SpanningHeapTests)
+    {
+    public:
+        TEST_METHOD(SpanningHeapMatchesReference)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            for (unsigned seed=0; seed<8; ++seed) {
+                RunEquivalenceTest<uint16>(0x8000, 0x800, 5000, seed);
+                RunEquivalenceTest<uint16>(0x8000, 0x80, 5000, seed);          // (many small blocks, mostly in the linear size classes)
+                RunEquivalenceTest<uint32>(512*1024, 0x2000, 5000, seed);
+            }
+        }
+
+        TEST_METHOD(SpanningHeapFlattenAndCopy)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(7351);
+            SpanningHeap<uint32> heap(1024*1024);
+            ReferenceSpanningHeap<uint32> reference(1024*1024);
+            for (unsigned c=0; c<500; ++c) {
+                auto size = std::uniform_int_distribution<unsigned>(1, 0x1000)(rng);
+                auto ptr = heap.Allocate(size);
+                Assert::AreEqual(reference.Allocate(size), ptr);
+                if ((c%3)==0 && ptr != ~unsigned(0x0)) {
+                    heap.Deallocate(ptr, size);
+                    reference.BlockAdjust(ptr, size, false);
+                }
+            }
+
+                //  Flattened form is just the marker array
+            auto flattened = heap.Flatten();
+            Assert::AreEqual(reference._markers.size() * sizeof(uint32), flattened.second);
+            Assert::IsTrue(XlCompareMemory(flattened.first.get(), AsPointer(reference._markers.cbegin()), flattened.second) == 0);
+
+                //  Heaps restored from the flattened form, or copied or moved, should all behave the same
+            SpanningHeap<uint32> restored(flattened.first.get(), flattened.second);
+            SpanningHeap<uint32> copied = heap;
+            SpanningHeap<uint32> moved = SpanningHeap<uint32>(heap);
+            CheckEquivalent(restored, reference);
+            CheckEquivalent(copied, reference);
+            CheckEquivalent(moved, reference);
+            for (unsigned c=0; c<100; ++c) {
+                auto size = std::uniform_int_distribution<unsigned>(1, 0x1000)(rng);
+                auto expected = reference.Allocate(size);
+                Assert::AreEqual(expected, restored.Allocate(size));
+                Assert::AreEqual(expected, copied.Allocate(size));
+                Assert::AreEqual(expected, moved.Allocate(size));
+            }
+            CheckEquivalent(restored, reference);
+
+                //  Defrag of a full heap leaves an empty free span at the end of the marker array
+            SpanningHeap<uint16> full(0x100);
+            ReferenceSpanningHeap<uint16> fullReference(0x100);
+            Assert::AreEqual(0u, full.Allocate(0x80)); fullReference.Allocate(0x80);
+            Assert::AreEqual(0x80u, full.Allocate(0x80)); fullReference.Allocate(0x80);
+            Assert::IsTrue(full.Deallocate(0, 0x80)); fullReference.BlockAdjust(0, 0x80, false);
+            Assert::IsTrue(full.Allocate(0, 0x80)); fullReference.BlockAdjust(0, 0x80, true);
+            auto steps = full.CalculateDefragSteps();
+            full.PerformDefrag(steps); fullReference.PerformDefrag(steps);
+            CheckEquivalent(full, fullReference);
+            Assert::IsTrue(full.Deallocate(0x80, 0x80)); fullReference.BlockAdjust(0x80, 0x80, false);
+            CheckEquivalent(full, fullReference);
+        }
+
+        TEST_METHOD(SpanningHeapPerformance)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Fill the heap with many small blocks, and release every other one
+                //  (so there are many small free spans). Then measure a stream of
+                //  allocations and deallocations in this fragmented state
+            unsigned blockCounts[] = { 1000, 10000, 50000 };
+            const unsigned churnCount = 20000;
+            for (auto blockCount:blockCounts) {
+                std::mt19937 rng(blockCount);
+                std::vector<unsigned> sizes(blockCount), churnSizes(churnCount);
+                for (auto& s:sizes) s = std::uniform_int_distribution<unsigned>(1, 4096)(rng);
+                for (auto& s:churnSizes) s = std::uniform_int_distribution<unsigned>(1, 8192)(rng);
+
+                uint64 cycles[2];
+                for (unsigned t=0; t<2; ++t) {
+                    SpanningHeap<uint32> heap(blockCount*4096);
+                    ReferenceSpanningHeap<uint32> reference(blockCount*4096);
+                    auto allocate = [&](unsigned size) { return t ? heap.Allocate(size) : reference.Allocate(size); };
+                    auto deallocate = [&](unsigned ptr, unsigned size) { if (t) heap.Deallocate(ptr, size); else reference.BlockAdjust(ptr, size, false); };
+
+                    std::vector<LiveAllocation> live;
+                    for (auto s:sizes) live.push_back(LiveAllocation{allocate(s), s});
+                    for (size_t c=0; c<live.size(); c+=2) deallocate(live[c]._ptr, live[c]._size);
+                    for (size_t c=1; c<live.size(); c+=2) live[c/2] = live[c];
+                    live.resize(live.size()/2);
+
+                    auto t0 = __rdtsc();
+                    for (unsigned c=0; c<churnCount; ++c) {
+                        if (live.empty()) break;
+                        auto ptr = allocate(churnSizes[c]);
+                        if (ptr != ~unsigned(0x0)) live.push_back(LiveAllocation{ptr, churnSizes[c]});
+                        auto& victim = live[(c*7919) % live.size()];
+                        deallocate(victim._ptr, victim._size);
+                        victim = live[live.size()-1];
+                        live.pop_back();
+                    }
+                    cycles[t] = __rdtsc() - t0;
+                }
+
+                LogAlwaysWarning
+                    << "Spanning heap (" << blockCount << " blocks, fragmented). Cycles per allocate & deallocate -- linear markers: "
+                    << cycles[0] / churnCount << ", segregated fit: " << cycles[1] / churnCount;
+            }
+        }
+    };
+}
+
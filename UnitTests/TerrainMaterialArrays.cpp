@@ -0,0 +1,147 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../SceneEngine/TerrainMaterialCompiler.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/StringFormat.h"
+#include "../Utility/Conversion.h"
+#include <CppUnitTest.h>
+#include <vector>
+
+#include "../Core/WinAPI/IncludeWindows.h"
+#include "../Foreign/DirectXTex/DirectXTex/DirectXTex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace SceneEngine;
+
+        //  Write a set of uncompressed source textures (with some noisy content, so
+        //  the compressor has some work to do). Sizes vary from layer to layer, so
+        //  that some layers must be resampled up, and some down.
+    static std::vector<::Assets::rstring> WriteSourceTextures(unsigned layerCount)
+    {
+        CreateDirectoryRecursive("int/terrainarraytest");
+        unsigned sizes[] = { 1024, 512, 256 };
+        std::vector<::Assets::rstring> result;
+        for (unsigned l=0; l<layerCount; ++l) {
+            auto size = sizes[l%dimof(sizes)];
+            DirectX::ScratchImage image;
+            image.Initialize2D(DXGI_FORMAT_R8G8B8A8_UNORM, size, size, 1, 1);
+            auto& i = *image.GetImage(0,0,0);
+            for (unsigned y=0; y<size; ++y)
+                for (unsigned x=0; x<size; ++x) {
+                    auto* p = PtrAdd(i.pixels, y*i.rowPitch + x*4);
+                    auto h = IntegerHash64(uint64(l) << 40 | uint64(y) << 20 | x);
+                    p[0] = uint8(x+l*40); p[1] = uint8(y+l*17); p[2] = uint8(h); p[3] = 0xff;
+                }
+
+            ::Assets::rstring filename = StringMeld<MaxPath>() << "int/terrainarraytest/layer" << l << ".dds";
+            DirectX::SaveToDDSFile(i, DirectX::DDS_FLAGS_NONE, Conversion::Convert<std::wstring>(filename).c_str());
+            result.push_back(filename);
+        }
+        return std::move(result);
+    }
+
+    static DirectX::TexMetadata LoadArray(const char filename[], DirectX::ScratchImage& image)
+    {
+        DirectX::TexMetadata metadata;
+        auto hresult = DirectX::LoadFromDDSFile(
+            Conversion::Convert<std::wstring>(std::string(filename)).c_str(),
+            DirectX::DDS_FLAGS_NONE, &metadata, image);
+        Assert::IsTrue(SUCCEEDED(hresult), L"Could not load compiled terrain texture array");
+        return metadata;
+    }
+
+    TEST_CLASS(TerrainMaterialArrays)
+    {
+    public:
+        TEST_METHOD(CompileTerrainTextureArrays)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+            auto sourceFiles = WriteSourceTextures(4);
+            sourceFiles.push_back(std::string());                                   // (empty layer)
+            sourceFiles.push_back("int/terrainarraytest/missing.dds");              // (missing file)
+
+            const char destination[] = "int/terrainarraytest/compiled.dds";
+            TerrainTextureArrayType::Enum types[] = { TerrainTextureArrayType::Diffuse, TerrainTextureArrayType::Normal, TerrainTextureArrayType::Roughness };
+            DXGI_FORMAT formats[] = { DXGI_FORMAT_BC1_UNORM_SRGB, DXGI_FORMAT_BC5_UNORM, DXGI_FORMAT_R8_UNORM };
+            for (unsigned t=0; t<dimof(types); ++t) {
+                CompileTerrainTextureArray(destination, types[t], UInt2(512, 512), MakeIteratorRange(sourceFiles));
+
+                DirectX::ScratchImage image;
+                auto metadata = LoadArray(destination, image);
+                Assert::AreEqual(size_t(512), metadata.width, L"Wrong array width");
+                Assert::AreEqual(size_t(512), metadata.height, L"Wrong array height");
+                Assert::AreEqual(sourceFiles.size(), metadata.arraySize, L"Wrong array layer count");
+                Assert::AreEqual(size_t(8), metadata.mipLevels, L"Wrong mip count (expecting a chain down to 4x4)");
+                Assert::IsTrue(metadata.format == formats[t], L"Wrong array format");
+            }
+
+                //  Layers without a source get the default value (here, flat roughness of 0)
+            DirectX::ScratchImage image;
+            LoadArray(destination, image);
+            for (unsigned l=4; l<6; ++l) {
+                auto& i = *image.GetImage(0, l, 0);
+                for (size_t c=0; c<i.slicePitch; ++c)
+                    Assert::AreEqual(uint8(0), i.pixels[c], L"Default layer not filled in");
+            }
+
+                //  Dimensions must be square and a power of two (like the runtime arrays)
+            Assert::ExpectException<::Exceptions::BasicLabel>(
+                [&]() { CompileTerrainTextureArray(destination, TerrainTextureArrayType::Diffuse, UInt2(384, 384), MakeIteratorRange(sourceFiles)); });
+        }
+
+        TEST_METHOD(TerrainTextureArrayPerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+                //  Compare building the array serially and in parallel, and then compare
+                //  reading the compiled array with reading all of the separate source files
+                //  (which is only the first step of what the runtime path used to do)
+            const auto frequency = GetPerformanceCounterFrequency();
+            auto toMS = [frequency](uint64 ticks) { return float(ticks) * 1000.f / float(frequency); };
+
+            unsigned layerCounts[] = { 8, 32 };
+            for (auto layerCount:layerCounts) {
+                auto sourceFiles = WriteSourceTextures(layerCount);
+                const char destination[] = "int/terrainarraytest/compiled.dds";
+
+                auto t0 = GetPerformanceCounter();
+                CompileTerrainTextureArray(destination, TerrainTextureArrayType::Diffuse, UInt2(512, 512), MakeIteratorRange(sourceFiles), false);
+                auto t1 = GetPerformanceCounter();
+                CompileTerrainTextureArray(destination, TerrainTextureArrayType::Diffuse, UInt2(512, 512), MakeIteratorRange(sourceFiles), true);
+                auto t2 = GetPerformanceCounter();
+
+                {
+                    DirectX::ScratchImage image;
+                    LoadArray(destination, image);
+                }
+                auto t3 = GetPerformanceCounter();
+                for (const auto& s:sourceFiles) {
+                    DirectX::ScratchImage image;
+                    DirectX::LoadFromDDSFile(Conversion::Convert<std::wstring>(s).c_str(), DirectX::DDS_FLAGS_NONE, nullptr, image);
+                }
+                auto t4 = GetPerformanceCounter();
+
+                LogAlwaysWarning
+                    << "Terrain texture array (" << layerCount << " layers, 512x512 BC1). Compile ms -- serial: " << toMS(t1-t0)
+                    << ", parallel: " << toMS(t2-t1) << ". Load ms -- compiled array: " << toMS(t3-t2)
+                    << ", source files: " << toMS(t4-t3);
+            }
+        }
+    };
+}
+
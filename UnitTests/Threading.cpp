@@ -6,8 +6,19 @@
 
 #include "UnitTestHelper.h"
 #include "../Assets/AsyncLoadOperation.h"
+#include "../Assets/AssetUtils.h"
+#include "../ConsoleRig/Log.h"
 #include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/SystemUtils.h"
+#include "../Core/Exceptions.h"
 #include <CppUnitTest.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace UnitTests
 {
@@ -22,6 +33,54 @@ namespace UnitTests
         }
     };
 
+        //  Busy work that can't be optimised away. Roughly "iterations" multiply-adds
+    static float SpinWork(unsigned iterations)
+    {
+        volatile float result = 1.f;
+        float a = result;
+        for (unsigned c=0; c<iterations; ++c)
+            a = a * 0.9999f + 0.0001f;
+        result = a;
+        return result;
+    }
+
+    class FrameTimes
+    {
+    public:
+        uint64 _mean, _worst, _percentile99;    // microseconds
+    };
+
+    static FrameTimes SimulateFrames(unsigned frameCount, CompletionThreadPool* backgroundPool)
+    {
+        const unsigned frameWork = 2000000, backgroundWork = 4000000;
+        auto freq = GetPerformanceCounterFrequency();
+
+        std::vector<uint64> times;
+        times.reserve(frameCount);
+        for (unsigned f=0; f<frameCount; ++f) {
+                //  keep the background pool saturated
+            if (backgroundPool) {
+                auto metrics = backgroundPool->GetMetrics();
+                for (unsigned c=metrics._pendingTasks; c<2*metrics._threadCount; ++c)
+                    backgroundPool->Enqueue([backgroundWork]() { SpinWork(backgroundWork); });
+            }
+
+            auto t0 = GetPerformanceCounter();
+            SpinWork(frameWork);
+            auto t1 = GetPerformanceCounter();
+            times.push_back((t1-t0) * 1000000ull / freq);
+        }
+
+        FrameTimes result;
+        uint64 total = 0;
+        for (auto t:times) total += t;
+        result._mean = total / frameCount;
+        std::sort(times.begin(), times.end());
+        result._worst = times[frameCount-1];
+        result._percentile99 = times[std::min(frameCount * 99 / 100, frameCount-1)];
+        return result;
+    }
+
     TEST_CLASS(Threading)
 	{
 	public:
@@ -51,6 +110,201 @@ namespace UnitTests
                 }
             }
         }
+
+        TEST_METHOD(ThreadPoolReconfigure)
+        {
+            CompletionThreadPool pool(CompletionThreadPool::Desc(2, ThreadPriority::Low));
+            const unsigned taskCount = 200;
+            for (unsigned c=0; c<taskCount; ++c) {
+                pool.Enqueue([]() { SpinWork(10000); });
+
+                    //  grow and shrink the pool while tasks are in flight
+                if (c == 50) pool.Reconfigure(CompletionThreadPool::Desc(6, ThreadPriority::Normal));
+                if (c == 100) pool.Reconfigure(CompletionThreadPool::Desc(1, ThreadPriority::Background));
+                if (c == 150) pool.Reconfigure(CompletionThreadPool::Desc(3, ThreadPriority::Low));
+            }
+
+                //  Wait on the pool's own completion count (which is only incremented after
+                //  the task's bookkeeping is finished), rather than a counter inside the task
+            auto timeout = GetPerformanceCounter() + 30 * GetPerformanceCounterFrequency();
+            auto metrics = pool.GetMetrics();
+            while (metrics._tasksCompleted < taskCount && GetPerformanceCounter() < timeout) {
+                Threading::Sleep(1);
+                metrics = pool.GetMetrics();
+            }
+
+            Assert::AreEqual(3u, metrics._threadCount, L"Thread count not changed by reconfigure");
+            Assert::AreEqual(3u, pool.GetDesc()._threadCount, L"Thread count not changed by reconfigure");
+            Assert::AreEqual(uint64(taskCount), metrics._tasksCompleted, L"Tasks lost while reconfiguring");
+            Assert::AreEqual(0u, metrics._pendingTasks, L"Tasks still pending after completion");
+            Assert::IsTrue(metrics._busyTime > 0 && metrics._maxQueueWait <= metrics._queueWaitTime, L"Bad thread pool metrics");
+        }
+
+        TEST_METHOD(ParallelForExceptions)
+        {
+                //  An exception from any task (on a pool thread or on this thread) should
+                //  come back out of ParallelFor -- after every worker has finished
+            CompletionThreadPool pool(4);
+            for (unsigned throwingTask=0; throwingTask<64; throwingTask+=21) {
+                Interlocked::Value started = 0, finished = 0;
+                Assert::ExpectException<::Exceptions::BasicLabel>(
+                    [&]()
+                    {
+                        ParallelFor(pool, 64,
+                            [&](unsigned t)
+                            {
+                                Interlocked::Increment(&started);
+                                SpinWork(10000);
+                                if (t == throwingTask)
+                                    Throw(::Exceptions::BasicLabel("Task %u failed", t));
+                                Interlocked::Increment(&finished);
+                            });
+                    });
+                Assert::AreEqual(Interlocked::Load(&started), Interlocked::Load(&finished) + 1, L"ParallelFor returned before its workers finished");
+            }
+        }
+
+        TEST_METHOD(ThreadPoolFrameIsolation)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Simulate a frame on this thread, while background tasks saturate a
+                //  thread pool. Compare frame times with no background work, with a pool
+                //  that uses every hardware thread at normal priority, and with a pool
+                //  configured the way GlobalServices configures the long task pool (low
+                //  priority, and avoiding the core reserved for the main thread)
+            auto topology = XlGetCPUTopology();
+            uint64 allCores = 0;
+            for (auto c:topology._physicalCores) allCores |= c;
+            auto reservedCore = topology._physicalCores[0];
+            unsigned reservedLogical = 0;
+            for (auto m=reservedCore; m; m &= m-1) ++reservedLogical;
+
+                //  Pin this thread to the reserved core, so the results are repeatable
+            XlSetCurrentThreadAffinity(reservedCore);
+
+            const unsigned frameCount = 200;
+            auto baseline = SimulateFrames(frameCount, nullptr);
+
+            CompletionThreadPool::Metrics unmanagedMetrics, managedMetrics;
+            FrameTimes unmanaged, managed;
+            {
+                CompletionThreadPool pool(CompletionThreadPool::Desc(topology._logicalProcessorCount, ThreadPriority::Normal));
+                unmanaged = SimulateFrames(frameCount, &pool);
+                unmanagedMetrics = pool.GetMetrics();
+            }
+            {
+                auto threadCount = std::max(topology._logicalProcessorCount - reservedLogical, 1u);
+                auto mask = (topology._physicalCores.size() > 1) ? (allCores & ~reservedCore) : 0;
+                CompletionThreadPool pool(CompletionThreadPool::Desc(threadCount, ThreadPriority::Low, mask));
+                managed = SimulateFrames(frameCount, &pool);
+                managedMetrics = pool.GetMetrics();
+            }
+
+            XlSetCurrentThreadAffinity(0);
+
+            LogAlwaysWarning 
+                << "Thread pool frame isolation (" << topology._physicalCores.size() << " cores, " << topology._logicalProcessorCount << " hardware threads). "
+                << "Frame time in microseconds (mean/99%/worst) -- no background tasks: " << baseline._mean << "/" << baseline._percentile99 << "/" << baseline._worst
+                << ", all threads at normal priority: " << unmanaged._mean << "/" << unmanaged._percentile99 << "/" << unmanaged._worst
+                << ", low priority with reserved core: " << managed._mean << "/" << managed._percentile99 << "/" << managed._worst;
+            LogAlwaysWarning
+                << "Background pool utilisation -- all threads at normal priority: " << unmanagedMetrics.Utilisation() << " (" << unmanagedMetrics._tasksCompleted << " tasks)"
+                << ", low priority with reserved core: " << managedMetrics.Utilisation() << " (" << managedMetrics._tasksCompleted << " tasks, average queue wait " << managedMetrics.AverageQueueWait() << "us)";
+        }
+
+        TEST_METHOD(PendingMarkerWaitAndContinuations)
+        {
+            const unsigned markerCount = 1024;
+            std::vector<std::shared_ptr<::Assets::PendingOperationMarker>> markers;
+            for (unsigned c=0; c<markerCount; ++c)
+                markers.push_back(std::make_shared<::Assets::PendingOperationMarker>());
+
+            Interlocked::Value readyCount = 0, invalidCount = 0;
+            auto continuation = 
+                [&readyCount, &invalidCount](::Assets::AssetState state)
+                {
+                    if (state == ::Assets::AssetState::Ready) Interlocked::Increment(&readyCount);
+                    else if (state == ::Assets::AssetState::Invalid) Interlocked::Increment(&invalidCount);
+                };
+            for (auto& m:markers) m->AddContinuation(continuation);
+
+                //  Some threads stall on the markers, while another thread 
+                //  completes them (odd markers become invalid)
+            Interlocked::Value wrongStates = 0;
+            std::vector<std::thread> waiters;
+            for (unsigned t=0; t<4; ++t)
+                waiters.emplace_back(
+                    [&markers, &wrongStates, t]()
+                    {
+                        for (unsigned c=t; c<markerCount; c+=4) {
+                            auto expected = (c&1) ? ::Assets::AssetState::Invalid : ::Assets::AssetState::Ready;
+                            if (markers[c]->StallWhilePending() != expected)
+                                Interlocked::Increment(&wrongStates);
+                        }
+                    });
+
+            std::thread completer(
+                [&markers]()
+                {
+                    for (unsigned c=0; c<markerCount; ++c)
+                        markers[c]->SetState((c&1) ? ::Assets::AssetState::Invalid : ::Assets::AssetState::Ready);
+                });
+
+            completer.join();
+            for (auto& t:waiters) t.join();
+
+            Assert::AreEqual(0l, Interlocked::Load(&wrongStates), L"Stalled marker returned wrong state");
+            Assert::AreEqual(Interlocked::Value(markerCount/2), Interlocked::Load(&readyCount), L"Wrong number of ready continuations");
+            Assert::AreEqual(Interlocked::Value(markerCount/2), Interlocked::Load(&invalidCount), L"Wrong number of invalid continuations");
+
+                //  Continuations on completed markers run immediately
+            markers[0]->AddContinuation(continuation);
+            Assert::AreEqual(Interlocked::Value(markerCount/2+1), Interlocked::Load(&readyCount), L"Continuation not called for completed marker");
+
+                //  Markers destroyed while pending invalidate their continuations
+            {
+                auto abandoned = std::make_shared<::Assets::PendingOperationMarker>();
+                abandoned->AddContinuation(continuation);
+            }
+            Assert::AreEqual(Interlocked::Value(markerCount/2+1), Interlocked::Load(&invalidCount), L"Continuation not called for abandoned marker");
+        }
+
+        TEST_METHOD(PendingAssetExceptionCost)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Compare the cost of reporting a pending state with an exception
+                //  (as the throwing GetXXX() methods do), with returning it (as
+                //  the non-throwing TryGetXXX() methods do). This is roughly the
+                //  situation while a large level is streaming in, and most of the
+                //  objects in view are waiting on a marker.
+            const unsigned lookups = 20000;
+            auto marker = std::make_shared<::Assets::PendingOperationMarker>();
+            auto exceptionCountBefore = ::Assets::Exceptions::PendingAsset::GetCreationCount();
+
+            unsigned pendingCount = 0;
+            auto t0 = __rdtsc();
+            for (unsigned c=0; c<lookups; ++c) {
+                TRY {
+                    if (marker->GetAssetState() == ::Assets::AssetState::Pending)
+                        Throw(::Assets::Exceptions::PendingAsset("marker", "Still pending"));
+                } CATCH (const ::Assets::Exceptions::PendingAsset&) {
+                    ++pendingCount;
+                } CATCH_END
+            }
+            auto t1 = __rdtsc();
+            for (unsigned c=0; c<lookups; ++c)
+                pendingCount += marker->GetAssetState() == ::Assets::AssetState::Pending;
+            auto t2 = __rdtsc();
+
+            auto exceptionCount = ::Assets::Exceptions::PendingAsset::GetCreationCount() - exceptionCountBefore;
+            Assert::AreEqual(2*lookups, pendingCount, L"Marker not pending");
+            Assert::AreEqual(lookups, exceptionCount, L"PendingAsset exceptions not counted");
+
+            LogAlwaysWarning << "Pending lookup (cycles per lookup). Throwing: " << (t1-t0) / lookups << ", non-throwing: " << (t2-t1) / lookups;
+            marker->SetState(::Assets::AssetState::Invalid);
+        }
     };
 }
 
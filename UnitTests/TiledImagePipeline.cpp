@@ -0,0 +1,221 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../PlatformRig/TiledImagePipeline.h"
+#include "../Math/HalfFloat.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/TimeUtils.h"
+#include "../Foreign/LibTiff/tiffio.h"
+#include "../Foreign/half-1.9.2/include/half.hpp"
+#include <CppUnitTest.h>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static const char* TestOutputFile = "unittest_tiledimage.tiff";
+
+        //  Smooth gradients with a few very bright spots, so that we exercise
+        //  the whole range of the tone map curve
+    static float SyntheticSample(unsigned x, unsigned y, unsigned channel)
+    {
+        float base = 0.05f + 0.002f * float(x) + 0.003f * float(y) + 0.1f * float(channel);
+        if (((x / 7) + (y / 5)) % 23 == 0) base *= 40.f;
+        return base;
+    }
+
+    static uint16 AsFloat16(float input) { return half_float::detail::float2half<std::round_to_nearest>(input); }
+    static float Quantized(float input) { return half_float::detail::half2float(AsFloat16(input)); }
+
+    static float ReferenceToneMap(float v, PlatformRig::TiledImagePipeline::ToneMapOperator::Enum op, float whitepoint)
+    {
+        using Op = PlatformRig::TiledImagePipeline::ToneMapOperator;
+        auto uncharted2 = [](float x) {
+            const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+            return ((x*(A*x+C*B)+D*E)/(x*(A*x+B)+D*F))-E/F;
+        };
+        if (op == Op::Reinhard) v = (v * (1.f + v/4.f)) / (1.f + v);
+        else if (op == Op::Uncharted2) v = uncharted2(v) / uncharted2(whitepoint);
+        v = std::max(0.f, std::min(1.f, v));
+        v = (v <= 0.0031308f) ? (12.92f * v) : (1.055f * std::pow(v, 1.f/2.4f) - 0.055f);
+        return v * 255.f;
+    }
+
+    static std::vector<uint8> ReadBackTiff(const char filename[], unsigned& width, unsigned& height)
+    {
+        std::vector<uint8> result;
+        auto* tiff = TIFFOpen(filename, "r");
+        if (!tiff) return result;
+        uint32 w = 0, h = 0;
+        TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &w);
+        TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &h);
+        width = w; height = h;
+        result.resize(size_t(w) * h * 3);
+        for (uint32 y=0; y<h; ++y)
+            TIFFReadScanline(tiff, &result[size_t(y)*w*3], y, 0);
+        TIFFClose(tiff);
+        return result;
+    }
+
+    TEST_CLASS(TiledImages)
+    {
+    public:
+        TEST_METHOD(HalfToFloatConversion)
+        {
+                //  Every possible 16 bit value should match the scalar conversion exactly
+            std::vector<uint16> halfs(1<<16);
+            for (unsigned c=0; c<(1<<16); ++c) halfs[c] = uint16(c);
+            std::vector<float> floats(1<<16);
+            XLEMath::ConvertHalfToFloat(floats.data(), halfs.data(), halfs.size());
+
+            for (unsigned c=0; c<(1<<16); ++c) {
+                float expected = half_float::detail::half2float(uint16(c));
+                if (expected != expected) {
+                    Assert::IsTrue(floats[c] != floats[c], L"NaN not preserved in half to float conversion");
+                } else {
+                    Assert::IsTrue(!std::memcmp(&expected, &floats[c], sizeof(float)), L"Half to float conversion mismatch");
+                }
+            }
+        }
+
+        TEST_METHOD(RegularTilesMatchReference)
+        {
+            using namespace PlatformRig;
+            const UInt2 outputDims(203, 157), downsample(3, 2), tileDims(96, 64);
+            const UInt2 sampleDims(outputDims[0] * downsample[0], outputDims[1] * downsample[1]);
+
+            for (unsigned op=0; op<2; ++op) {
+                TiledImagePipeline::Desc desc(outputDims, downsample, false);
+                desc._toneMapOperator = (TiledImagePipeline::ToneMapOperator::Enum)op;
+                desc._exposure = 0.7f;
+                desc._maxTilesInFlight = 2;
+
+                CompletionThreadPool threadPool(4);
+                {
+                    TiledImagePipeline pipeline(TestOutputFile, desc, threadPool);
+
+                        //  Push rows of tiles from top to bottom, but tiles within each row
+                        //  in reverse order. Tiles on the right and bottom edges are clipped.
+                    std::vector<uint16> tileData;
+                    for (unsigned ty=0; ty<sampleDims[1]; ty+=tileDims[1]) {
+                        for (int tx=int((sampleDims[0]-1)/tileDims[0])*tileDims[0]; tx>=0; tx-=tileDims[0]) {
+                            UInt2 dims(std::min(tileDims[0], sampleDims[0]-tx), std::min(tileDims[1], sampleDims[1]-ty));
+                            const unsigned pitch = tileDims[0] * 4 * sizeof(uint16);        // (deliberately wider than the tile)
+                            tileData.resize(tileDims[0] * 4 * dims[1]);
+                            for (unsigned y=0; y<dims[1]; ++y)
+                                for (unsigned x=0; x<dims[0]; ++x)
+                                    for (unsigned c=0; c<4; ++c)
+                                        tileData[(y*tileDims[0]+x)*4+c] = AsFloat16(SyntheticSample(tx+x, ty+y, c));
+                            pipeline.PushTile(UInt2(tx, ty), dims, tileData.data(), pitch);
+                        }
+                    }
+                    pipeline.Finish();
+
+                    auto metrics = pipeline.GetMetrics();
+                    Assert::AreEqual(outputDims[1], metrics._rowsWritten, L"Not all rows written");
+                    auto fullImageBytes = size_t(sampleDims[0]) * sampleDims[1] * 4 * sizeof(uint16);
+                    Assert::IsTrue(metrics._peakBufferedBytes < fullImageBytes / 2, L"Pipeline buffered too much of the image");
+                }
+
+                unsigned width = 0, height = 0;
+                auto result = ReadBackTiff(TestOutputFile, width, height);
+                Assert::AreEqual(outputDims[0], width, L"Wrong output width");
+                Assert::AreEqual(outputDims[1], height, L"Wrong output height");
+
+                float maxError = 0.f;
+                for (unsigned y=0; y<height; ++y)
+                    for (unsigned x=0; x<width; ++x)
+                        for (unsigned c=0; c<3; ++c) {
+                            float sum = 0.f;
+                            for (unsigned sy=0; sy<downsample[1]; ++sy)
+                                for (unsigned sx=0; sx<downsample[0]; ++sx)
+                                    sum += Quantized(SyntheticSample(x*downsample[0]+sx, y*downsample[1]+sy, c));
+                            float expected = ReferenceToneMap(desc._exposure * sum / float(downsample[0]*downsample[1]), desc._toneMapOperator, desc._whitepoint);
+                            maxError = std::max(maxError, std::abs(expected - float(result[(y*width+x)*3+c])));
+                        }
+                Assert::IsTrue(maxError <= 1.5f, L"Tiled image doesn't match reference");
+            }
+            std::remove(TestOutputFile);
+        }
+
+        TEST_METHOD(InterleavedTilesMatchReference)
+        {
+            using namespace PlatformRig;
+            const UInt2 outputDims(150, 97), downsample(2, 2);
+
+            TiledImagePipeline::Desc desc(outputDims, downsample, true);
+            desc._toneMapOperator = TiledImagePipeline::ToneMapOperator::Reinhard;
+
+            CompletionThreadPool threadPool(4);
+            {
+                TiledImagePipeline pipeline(TestOutputFile, desc, threadPool);
+                std::vector<uint16> tileData(outputDims[0] * outputDims[1] * 4);
+                for (unsigned t=0; t<downsample[0]*downsample[1]; ++t) {
+                    for (unsigned y=0; y<outputDims[1]; ++y)
+                        for (unsigned x=0; x<outputDims[0]; ++x)
+                            for (unsigned c=0; c<4; ++c)
+                                tileData[(y*outputDims[0]+x)*4+c] = AsFloat16(SyntheticSample(x*2+(t%2), y*2+(t/2), c));
+                    pipeline.PushTile(UInt2(t%2, t/2), outputDims, tileData.data(), outputDims[0] * 4 * sizeof(uint16));
+                }
+                pipeline.Finish();
+            }
+
+            unsigned width = 0, height = 0;
+            auto result = ReadBackTiff(TestOutputFile, width, height);
+            Assert::AreEqual(outputDims[0], width, L"Wrong output width");
+            Assert::AreEqual(outputDims[1], height, L"Wrong output height");
+
+            float maxError = 0.f;
+            for (unsigned y=0; y<height; ++y)
+                for (unsigned x=0; x<width; ++x)
+                    for (unsigned c=0; c<3; ++c) {
+                        float sum = 0.f;
+                        for (unsigned t=0; t<4; ++t)
+                            sum += Quantized(SyntheticSample(x*2+(t%2), y*2+(t/2), c));
+                        float expected = ReferenceToneMap(sum / 4.f, desc._toneMapOperator, desc._whitepoint);
+                        maxError = std::max(maxError, std::abs(expected - float(result[(y*width+x)*3+c])));
+                    }
+            Assert::IsTrue(maxError <= 1.5f, L"Interleaved tiled image doesn't match reference");
+            std::remove(TestOutputFile);
+        }
+
+        TEST_METHOD(TiledImageThroughput)
+        {
+            using namespace PlatformRig;
+            const UInt2 outputDims(2048, 1024), downsample(2, 2), tileDims(1024, 512);
+
+            std::vector<uint16> tileData(tileDims[0] * tileDims[1] * 4);
+            for (unsigned y=0; y<tileDims[1]; ++y)
+                for (unsigned x=0; x<tileDims[0]; ++x)
+                    for (unsigned c=0; c<4; ++c)
+                        tileData[(y*tileDims[0]+x)*4+c] = AsFloat16(SyntheticSample(x, y, c));
+
+            CompletionThreadPool threadPool(4);
+            auto start = GetPerformanceCounter();
+            {
+                TiledImagePipeline pipeline(TestOutputFile, TiledImagePipeline::Desc(outputDims, downsample, false), threadPool);
+                for (unsigned ty=0; ty<outputDims[1]*downsample[1]; ty+=tileDims[1])
+                    for (unsigned tx=0; tx<outputDims[0]*downsample[0]; tx+=tileDims[0])
+                        pipeline.PushTile(UInt2(tx, ty), tileDims, tileData.data(), tileDims[0] * 4 * sizeof(uint16));
+                pipeline.Finish();
+
+                auto metrics = pipeline.GetMetrics();
+                auto elapsed = GetPerformanceCounter() - start;
+                LogAlwaysWarning << "Tiled image pipeline: " << metrics._tilesProcessed << " tiles (" << outputDims[0]*downsample[0] << "x" << outputDims[1]*downsample[1]
+                    << " samples) in " << double(elapsed) * 1000.0 / double(GetPerformanceCounterFrequency()) << "ms, peak buffered " << metrics._peakBufferedBytes / 1024 << "KB";
+            }
+            std::remove(TestOutputFile);
+        }
+    };
+}
+
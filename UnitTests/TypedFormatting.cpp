@@ -0,0 +1,137 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Utility/TypedFormat.h"
+#include "../Utility/StringFormat.h"
+#include "../Utility/Streams/StreamTypes.h"
+#include "../ConsoleRig/Log.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <stdio.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    template<typename... Args>
+        static void CompareWithCRT(const char format[], const Args&... args)
+        {
+            char typed[256], crt[256];
+            FormatInto(typed, format, args...);
+            _snprintf_s(crt, _TRUNCATE, format, args...);
+            Assert::AreEqual(std::string(crt), std::string(typed), L"Typed formatting doesn't match the CRT");
+        }
+
+    TEST_CLASS(TypedFormatting)
+    {
+    public:
+        TEST_METHOD(MatchesPrintf)
+        {
+            CompareWithCRT("%d %i %u", 5, -17, 42u);
+            CompareWithCRT("[%5d][%-5d][%05d][%+d][% d]", 42, 42, 42, 42, 42);
+            CompareWithCRT("[%.3d][%8.3d][%-8.3d][%.0d]", 7, -7, 7, 0);
+            CompareWithCRT("%x %X %#x %#X %o %#o %x", 255u, 255u, 255u, 255u, 8u, 8u, -1);
+            CompareWithCRT("[%#o][%#.0o][%.0o][%#5o][%#o]", 0u, 0u, 0u, 0u, 8u);
+            CompareWithCRT("%#+x %#x %+o %#X", 3, -3, -8, -1);
+            CompareWithCRT("%lld %llu", MIN_INT64, MAX_UINT64);
+            CompareWithCRT("%s|%10s|%-10s|%.3s", "hello", "hi", "hi", "abcdef");
+            CompareWithCRT("%c%c %%", 'a', 'b');
+            CompareWithCRT("%f %.2f %.0f %#.0f %10.3f %-10.3f| %+f % f %010.3f", 3.14159, 2.675, 2.26, 3.0, -1.5, 1.25, 1.0, 1.0, -3.25);
+            CompareWithCRT("%.3f %.1f %f %.9f", -0.0001, 0.05, 1e9, 0.123456789123);
+            CompareWithCRT("%*d|%-*d|%.*f", 6, 42, 6, 42, 2, 3.14159);
+            CompareWithCRT("(%4ix%4i) mips:(%i) %6.2f ms", 1024, 768, 11, 12.3456f);
+
+                //  Random values through the fast "%f" path (values too large for the fast
+                //  path go through xl_snprintf, so aren't compared here). Exact ties are very 
+                //  unlikely with random values, so the CRT's tie breaking rule doesn't matter.
+            std::mt19937 rng(5183);
+            std::uniform_real_distribution<double> mantissa(-1e6, 1e6);
+            std::uniform_int_distribution<int> exponent(-30, 3), precision(0, 9);
+            for (unsigned c=0; c<100000; ++c) {
+                auto value = mantissa(rng) * std::pow(10.0, exponent(rng));
+                char format[16];
+                _snprintf_s(format, _TRUNCATE, "%%.%if", precision(rng));
+                CompareWithCRT(format, value);
+            }
+        }
+
+        TEST_METHOD(TypeSafety)
+        {
+            char buffer[64];
+            FormatInto(buffer, "%d", 3.7f);
+            Assert::AreEqual(std::string("3"), std::string(buffer), L"Float written with integer conversion");
+            FormatInto(buffer, "%#+x", 3.f);
+            Assert::AreEqual(std::string("0x3"), std::string(buffer), L"Float written with signed hex conversion");
+            FormatInto(buffer, "%#x", -3.f);
+            Assert::AreEqual(std::string("0xfffffffd"), std::string(buffer), L"Negative float written with hex conversion");
+            FormatInto(buffer, "%.1f", 3);
+            Assert::AreEqual(std::string("3.0"), std::string(buffer), L"Integer written with float conversion");
+            FormatInto(buffer, "%s %s %s", 5, 2.5, true);
+            Assert::AreEqual(std::string("5 2.5 true"), std::string(buffer), L"Numbers written with string conversion");
+
+            std::string str("abc");
+            const char* section = "defghijk";
+            FormatInto(buffer, "[%s][%s]", str, MakeStringSection(section, section+5));
+            Assert::AreEqual(std::string("[abc][defgh]"), std::string(buffer), L"String types");
+
+            char small[8];
+            auto length = FormatInto(small, "%d-%s", 12345, "abcdef");
+            Assert::AreEqual(std::string("12345-a"), std::string(small), L"Truncation");
+            Assert::AreEqual(7u, length, L"Truncated length");
+
+            static const CompiledFormat compiled("x=%d y=%.2f %s%%");
+            FormatInto(buffer, compiled, 4, 1.5, "z");
+            Assert::AreEqual(std::string("x=4 y=1.50 z%"), std::string(buffer), L"Compiled format");
+
+            MemoryOutputStream<utf8> stream;
+            for (unsigned c=0; c<100; ++c)
+                FormatInto(stream, "%i:%s;", c, "abcdefghijabcdefghij");
+            Assert::AreEqual(size_t(2390), stream.AsString().size(), L"Output stream");
+
+            Assert::AreEqual(std::string("a  2.5|ffb"), std::string(StringMeld<64>() << "a" << Formatted("%5.1f|%x", 2.5, 255u) << "b"), L"StringMeld");
+        }
+
+        TEST_METHOD(FormattingPerformance)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned iterations = 200000;
+            char buffer[256];
+            unsigned sink = 0;
+            static const CompiledFormat compiled("(%4ix%4i) mips:(%i) %6.2f ms");
+
+            auto t0 = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                sink += _snprintf_s(buffer, _TRUNCATE, "(%4ix%4i) mips:(%i) %6.2f ms", c, c*3, c&7, c*0.001f);
+            auto t1 = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                sink += xl_snprintf(buffer, dimof(buffer), "(%4ix%4i) mips:(%i) %6.2f ms", c, c*3, c&7, c*0.001f);
+            auto t2 = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                sink += XlFormatString(buffer, dimof(buffer), "(%4ix%4i) mips:(%i) %6.2f ms", c, c*3, c&7, c*0.001f);
+            auto t3 = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                sink += (unsigned)XlDynFormatString("(%4ix%4i) mips:(%i) %6.2f ms", c, c*3, c&7, c*0.001f).size();
+            auto t4 = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                sink += FormatInto(buffer, "(%4ix%4i) mips:(%i) %6.2f ms", c, c*3, c&7, c*0.001f);
+            auto t5 = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                sink += FormatInto(buffer, compiled, c, c*3, c&7, c*0.001f);
+            auto t6 = __rdtsc();
+
+            LogAlwaysWarning << "Formatting (cycles per call) -- sink: " << sink;
+            LogAlwaysWarning << "  _snprintf_s:        " << (t1-t0) / iterations;
+            LogAlwaysWarning << "  xl_snprintf:        " << (t2-t1) / iterations;
+            LogAlwaysWarning << "  XlFormatString:     " << (t3-t2) / iterations;
+            LogAlwaysWarning << "  XlDynFormatString:  " << (t4-t3) / iterations;
+            LogAlwaysWarning << "  FormatInto:         " << (t5-t4) / iterations;
+            LogAlwaysWarning << "  FormatInto (compiled format): " << (t6-t5) / iterations;
+        }
+    };
+}
+
@@ -0,0 +1,267 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/VertexConversion.h"
+#include "../Math/HalfFloat.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Foreign/half-1.9.2/include/half.hpp"
+#include <CppUnitTest.h>
+#include <vector>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace RenderCore::Assets::GeoProc;
+    using Encoding = VertexElementFormat::Encoding;
+
+    static uint16 AsFloat16(float input) { return half_float::detail::float2half<std::round_to_nearest>(input); }
+
+        //  This is the per-vertex loop CopyVertexData used before the bulk conversion
+        //  functions. It's here for comparison in the throughput test.
+    static void ReferenceCopyF32ToF16(
+        void* dst, size_t dstStride, unsigned dstComponents,
+        const void* src, size_t srcStride, unsigned srcComponents,
+        size_t count, const std::vector<unsigned>& mapping)
+    {
+        for (size_t v = 0; v<count; ++v, dst = PtrAdd(dst, dstStride)) {
+            auto srcIndex = (v < mapping.size()) ? mapping[v] : v;
+            auto* s = (const float*)PtrAdd(src, srcIndex * srcStride);
+            float input[4];
+            input[0] = (srcComponents > 0) ? s[0] : 0.f;
+            input[1] = (srcComponents > 1) ? s[1] : 0.f;
+            input[2] = (srcComponents > 2) ? s[2] : 0.f;
+            input[3] = (srcComponents > 3) ? s[3] : 1.f;
+            for (unsigned c=0; c<dstComponents; ++c)
+                ((uint16*)dst)[c] = AsFloat16(input[c]);
+        }
+    }
+
+    TEST_CLASS(VertexConversions)
+    {
+    public:
+        TEST_METHOD(Float16Conversion)
+        {
+                //  Bulk float -> half conversion must match the scalar "half" library exactly.
+                //  Test a spread of random bit patterns, plus values around the edges of
+                //  the half range (denormals, overflow, rounding boundaries, infs and nans)
+            std::vector<float> floats;
+            std::mt19937 rng(6712);
+            for (unsigned c=0; c<1<<20; ++c) {
+                uint32 bits = rng();
+                float f; std::memcpy(&f, &bits, sizeof(f));
+                floats.push_back(f);
+            }
+            for (unsigned h=0; h<(1<<16); ++h) {
+                    // every half value, and the midpoints between adjacent halfs
+                float f = half_float::detail::half2float(uint16(h));
+                floats.push_back(f);
+                floats.push_back(std::nextafter(f, 0.f));
+                float next = half_float::detail::half2float(uint16(h+1));
+                floats.push_back((f + next) * .5f);
+            }
+            const float specials[] = { 0.f, -0.f, 65504.f, 65519.f, 65520.f, 1e10f, -1e10f, 5.9604645e-8f, 2.9802322e-8f, 2.9802326e-8f, 1e-30f };
+            floats.insert(floats.end(), specials, &specials[dimof(specials)]);
+            floats.push_back(std::numeric_limits<float>::infinity());
+            floats.push_back(-std::numeric_limits<float>::infinity());
+
+            std::vector<uint16> halfs(floats.size());
+            ConvertFloat32ToFloat16(halfs.data(), floats.data(), floats.size());
+            for (size_t c=0; c<floats.size(); ++c)
+                Assert::AreEqual(unsigned(AsFloat16(floats[c])), unsigned(halfs[c]), L"Float to half conversion mismatch");
+
+                //  And every half back to float
+            std::vector<uint16> allHalfs(1<<16);
+            for (unsigned c=0; c<(1<<16); ++c) allHalfs[c] = uint16(c);
+            std::vector<float> roundTrip(1<<16);
+            XLEMath::ConvertHalfToFloat(roundTrip.data(), allHalfs.data(), allHalfs.size());
+            for (unsigned c=0; c<(1<<16); ++c) {
+                float expected = half_float::detail::half2float(uint16(c));
+                if (expected != expected) {
+                    Assert::IsTrue(roundTrip[c] != roundTrip[c], L"NaN not preserved in half to float conversion");
+                } else {
+                    Assert::IsTrue(!std::memcmp(&expected, &roundTrip[c], sizeof(float)), L"Half to float conversion mismatch");
+                }
+            }
+        }
+
+        TEST_METHOD(NormalizedRoundTrip)
+        {
+                //  Every representable value of the normalized formats must survive
+                //  a round trip through float
+            struct Case { Encoding::Enum _encoding; int _min, _max; unsigned _bytes; };
+            const Case cases[] = {
+                { Encoding::UNorm8, 0, 255, 1 }, { Encoding::SNorm8, -127, 127, 1 },
+                { Encoding::UNorm16, 0, 65535, 2 }, { Encoding::SNorm16, -32767, 32767, 2 }
+            };
+            for (const auto& cs:cases) {
+                std::vector<uint8> packed;
+                for (int v=cs._min; v<=cs._max; ++v)
+                    packed.insert(packed.end(), (const uint8*)&v, ((const uint8*)&v) + cs._bytes);     // (little endian)
+                size_t count = packed.size() / cs._bytes;
+
+                std::vector<float> floats(count);
+                ConvertVertexStream(
+                    floats.data(), VertexElementFormat(Encoding::Float32, 1), sizeof(float), floats.size() * sizeof(float),
+                    packed.data(), VertexElementFormat(cs._encoding, 1), cs._bytes, packed.size(),
+                    count);
+                Assert::AreEqual(cs._min < 0 ? -1.f : 0.f, floats[0], L"Normalized format minimum not mapped to range minimum");
+                Assert::AreEqual(1.f, floats[count-1], L"Normalized format maximum not mapped to 1");
+
+                std::vector<uint8> result(packed.size());
+                ConvertVertexStream(
+                    result.data(), VertexElementFormat(cs._encoding, 1), cs._bytes, result.size(),
+                    floats.data(), VertexElementFormat(Encoding::Float32, 1), sizeof(float), floats.size() * sizeof(float),
+                    count);
+                Assert::IsTrue(packed == result, L"Normalized format round trip failed");
+            }
+
+                //  Clamping and rounding to nearest
+            const float inputs[] = { -2.f, -0.5f, 0.f, 0.3f/255.f, 0.6f/255.f, 0.5f, 1.f, 7.f, std::numeric_limits<float>::quiet_NaN() };
+            const uint8 expectedUNorm[] = { 0, 0, 0, 0, 1, 128, 255, 255, 0 };
+            const int8 expectedSNorm[] = { -127, -64, 0, 0, 0, 64, 127, 127, 0 };
+            uint8 unorm[dimof(inputs)]; int8 snorm[dimof(inputs)];
+            ConvertVertexStream(unorm, VertexElementFormat(Encoding::UNorm8, 1), 1, sizeof(unorm), inputs, VertexElementFormat(Encoding::Float32, 1), sizeof(float), sizeof(inputs), dimof(inputs));
+            ConvertVertexStream(snorm, VertexElementFormat(Encoding::SNorm8, 1), 1, sizeof(snorm), inputs, VertexElementFormat(Encoding::Float32, 1), sizeof(float), sizeof(inputs), dimof(inputs));
+            Assert::IsTrue(!std::memcmp(unorm, expectedUNorm, sizeof(unorm)), L"UNorm8 clamping or rounding incorrect");
+            Assert::IsTrue(!std::memcmp(snorm, expectedSNorm, sizeof(snorm)), L"SNorm8 clamping or rounding incorrect");
+
+                //  10:10:10:2 packing, and the BGRA swizzle
+            const float colour[] = { 1.f, 0.5f, 0.f, 1.f };
+            uint32 packed1010102 = 0;
+            ConvertVertexStream(&packed1010102, VertexElementFormat(Encoding::UNorm10_10_10_2, 4), 4, 4, colour, VertexElementFormat(Encoding::Float32, 4), 16, 16, 1);
+            Assert::AreEqual(1023u | (512u << 10) | (3u << 30), packed1010102, L"10:10:10:2 packing incorrect");
+            uint8 bgra[4];
+            ConvertVertexStream(bgra, AsVertexElementFormat(RenderCore::Metal::NativeFormat::B8G8R8A8_UNORM), 4, 4, colour, VertexElementFormat(Encoding::Float32, 4), 16, 16, 1);
+            Assert::IsTrue(bgra[0] == 0 && bgra[1] == 128 && bgra[2] == 255 && bgra[3] == 255, L"BGRA swizzle incorrect");
+
+                //  BGRX has a padding byte in place of alpha -- it's written as 255, and ignored on read
+            auto bgrx = AsVertexElementFormat(RenderCore::Metal::NativeFormat::B8G8R8X8_UNORM);
+            Assert::AreEqual(4u, bgrx.GetElementSize(), L"BGRX element size incorrect");
+            const float translucent[] = { 1.f, 0.5f, 0.f, .25f };
+            uint8 bgrxBytes[4];
+            ConvertVertexStream(bgrxBytes, bgrx, 4, 4, translucent, VertexElementFormat(Encoding::Float32, 4), 16, 16, 1);
+            Assert::IsTrue(bgrxBytes[0] == 0 && bgrxBytes[1] == 128 && bgrxBytes[2] == 255 && bgrxBytes[3] == 255, L"BGRX padding incorrect");
+            bgrxBytes[3] = 7;
+            Float4 bgrxExpanded[1];
+            ExpandVertexStream(bgrxExpanded, 1, bgrxBytes, bgrx, 4, 4);
+            Assert::IsTrue(bgrxExpanded[0][0] == 1.f && bgrxExpanded[0][2] == 0.f && bgrxExpanded[0][3] == 1.f, L"BGRX padding not ignored on read");
+
+            Float4 expanded[1];
+            ExpandVertexStream(expanded, 1, &packed1010102, VertexElementFormat(Encoding::UNorm10_10_10_2, 4), 4, 4);
+            Assert::IsTrue(expanded[0][0] == 1.f && std::abs(expanded[0][1] - 512.f/1023.f) < 1e-6f && expanded[0][2] == 0.f && expanded[0][3] == 1.f, L"10:10:10:2 expansion incorrect");
+        }
+
+        TEST_METHOD(MappedAndStridedConversion)
+        {
+                //  Gather through a mapping from an interleaved source into an interleaved
+                //  destination, with fewer source components (so defaults are filled in)
+            const unsigned vertexCount = 1000, srcStride = 20, dstStride = 12;
+            std::vector<uint8> src(vertexCount * srcStride);
+            std::mt19937 rng(1337);
+            std::uniform_real_distribution<float> dist(-4.f, 4.f);
+            for (unsigned v=0; v<vertexCount; ++v)
+                for (unsigned c=0; c<3; ++c)
+                    ((float*)PtrAdd(src.data(), v*srcStride + 4))[c] = dist(rng);
+
+            std::vector<unsigned> mapping(vertexCount - 10);        // (the last few vertices aren't mapped)
+            for (unsigned v=0; v<mapping.size(); ++v) mapping[v] = (v * 7919) % vertexCount;
+
+            std::vector<uint8> dst(vertexCount * dstStride, 0xcd);
+            ConvertVertexStream(
+                PtrAdd(dst.data(), 2), VertexElementFormat(Encoding::Float16, 4), dstStride, dst.size() - 2,
+                PtrAdd(src.data(), 4), VertexElementFormat(Encoding::Float32, 3), srcStride, src.size() - 4,
+                vertexCount, MakeIteratorRange(mapping));
+
+            std::vector<uint8> expected(vertexCount * dstStride, 0xcd);
+            ReferenceCopyF32ToF16(
+                PtrAdd(expected.data(), 2), dstStride, 4,
+                PtrAdd(src.data(), 4), srcStride, 3, vertexCount, mapping);
+            Assert::IsTrue(dst == expected, L"Mapped conversion doesn't match reference");
+
+                //  Processing flags
+            const float normal[] = { 3.f, 0.f, 4.f, 1.f, 0.f, 0.f, 0.f, 1.f };
+            float processed[8];
+            ConvertVertexStream(
+                processed, VertexElementFormat(Encoding::Float32, 4), 16, sizeof(processed),
+                normal, VertexElementFormat(Encoding::Float32, 4), 16, sizeof(normal), 2,
+                IteratorRange<const unsigned*>(), ProcessingFlags::Renormalize | ProcessingFlags::TangentHandinessFlip);
+            Assert::IsTrue(std::abs(processed[0] - .6f) < 1e-6f && std::abs(processed[2] - .8f) < 1e-6f && processed[3] == -1.f, L"Renormalize or tangent flip incorrect");
+            Assert::IsTrue(processed[4] == 0.f && processed[6] == 0.f && processed[7] == -1.f, L"Zero length vector should not be renormalized");
+
+                //  In-place conversion (destination stride smaller than the source stride)
+            std::vector<float> inPlace(vertexCount * 4);
+            for (auto& f:inPlace) f = dist(rng);
+            std::vector<uint16> inPlaceExpected(vertexCount * 3);
+            for (unsigned v=0; v<vertexCount; ++v)
+                for (unsigned c=0; c<3; ++c)
+                    inPlaceExpected[v*3+c] = AsFloat16(inPlace[v*4+c]);
+            ConvertVertexStream(
+                inPlace.data(), VertexElementFormat(Encoding::Float16, 3), 6, inPlace.size() * sizeof(float),
+                inPlace.data(), VertexElementFormat(Encoding::Float32, 4), 16, inPlace.size() * sizeof(float),
+                vertexCount);
+            Assert::IsTrue(!std::memcmp(inPlace.data(), inPlaceExpected.data(), inPlaceExpected.size() * sizeof(uint16)), L"In-place conversion failed");
+
+                //  Overruns should be caught up-front
+            bool caught = false;
+            mapping[3] = vertexCount;
+            try {
+                ConvertVertexStream(
+                    dst.data(), VertexElementFormat(Encoding::Float16, 4), dstStride, dst.size(),
+                    src.data(), VertexElementFormat(Encoding::Float32, 3), srcStride, src.size(),
+                    vertexCount, MakeIteratorRange(mapping));
+            } catch (const std::exception&) { caught = true; }
+            Assert::IsTrue(caught, L"Mapping past the end of the source data not detected");
+        }
+
+        TEST_METHOD(VertexConversionThroughput)
+        {
+            const unsigned vertexCount = 1<<20, srcStride = 12, dstStride = 8;
+            std::vector<float> src(vertexCount * 3);
+            std::mt19937 rng(4231);
+            std::uniform_real_distribution<float> dist(-100.f, 100.f);
+            for (auto& f:src) f = dist(rng);
+            std::vector<unsigned> mapping(vertexCount);
+            for (unsigned v=0; v<vertexCount; ++v) mapping[v] = (v * 7919) % vertexCount;
+
+            std::vector<uint8> dst(vertexCount * dstStride), reference(vertexCount * dstStride);
+            auto freq = double(GetPerformanceCounterFrequency());
+
+            auto start = GetPerformanceCounter();
+            ReferenceCopyF32ToF16(reference.data(), dstStride, 4, src.data(), srcStride, 3, vertexCount, mapping);
+            auto referenceTime = GetPerformanceCounter() - start;
+
+            start = GetPerformanceCounter();
+            ConvertVertexStream(
+                dst.data(), VertexElementFormat(Encoding::Float16, 4), dstStride, dst.size(),
+                src.data(), VertexElementFormat(Encoding::Float32, 3), srcStride, src.size() * sizeof(float),
+                vertexCount, MakeIteratorRange(mapping));
+            auto bulkTime = GetPerformanceCounter() - start;
+            Assert::IsTrue(dst == reference, L"Bulk conversion doesn't match reference");
+
+            std::vector<uint8> unorm(vertexCount * 4);
+            start = GetPerformanceCounter();
+            ConvertVertexStream(
+                unorm.data(), VertexElementFormat(Encoding::UNorm8, 4), 4, unorm.size(),
+                src.data(), VertexElementFormat(Encoding::Float32, 3), srcStride, src.size() * sizeof(float),
+                vertexCount);
+            auto unormTime = GetPerformanceCounter() - start;
+
+            LogAlwaysWarning << "Vertex conversion (" << vertexCount << " vertices, R32G32B32 -> R16G16B16A16_FLOAT, mapped): per-vertex loop "
+                << double(referenceTime) * 1000.0 / freq << "ms, bulk " << double(bulkTime) * 1000.0 / freq << "ms; R32G32B32 -> R8G8B8A8_UNORM "
+                << double(unormTime) * 1000.0 / freq << "ms";
+        }
+    };
+}
+
@@ -7,6 +7,7 @@
 #include "HeapUtils.h"
 #include "PtrUtils.h"
 #include "MemoryUtils.h"
+#include "BitUtils.h"
 #include <assert.h>
 
 namespace Utility
@@ -131,259 +132,327 @@ namespace Utility
     template <typename Marker>
         unsigned    SpanningHeap<Marker>::Allocate(unsigned size)
     {
-        const Marker sentinel = Marker(~0x0);
-        Marker bestSize = sentinel;
         Marker internalSize = ToInternalSize(AlignSize(size));
         assert(ToExternalSize(internalSize)>=size);
 
-        if ((_largestFreeBlockValid && _largestFreeBlock<internalSize) || !_markers.size()) {
-            return ~unsigned(0x0);  // threading can cause false return here -- but that shouldn't be a major issue
+        ScopedLock(_lock);
+        SizeAndStart best;
+        if (_freeSpans.empty() || !FindFreeSpan_Internal(internalSize, best)) {
+            return ~unsigned(0x0);
+        }
+
+            //  We'll allocate from the start of the span space. 
+        if (internalSize) {
+            AllocateFromSpan_Internal(_freeSpans.find(best.second), best.second, internalSize);
         }
+        return ToExternalSize(best.second);
+    }
 
+    template <typename Marker>
+        bool        SpanningHeap<Marker>::Allocate(unsigned ptr, unsigned size)
+    {
         ScopedLock(_lock);
+        Marker internalOffset = ToInternalSize(ptr);
+        Marker internalSize = ToInternalSize(AlignSize(size));
+        if (_freeSpans.empty()) {
+            return false;
+        }
 
-            //  Marker array is simple -- just a list of positions. It will alternate between
-            //  allocated and unallocated
-        Marker largestFreeBlock[2] = {0,0};
-        Marker largestFreeBlockPosition = 0;
-
-        std::vector<Marker>::iterator best = _markers.end();
-        for (std::vector<Marker>::iterator i=_markers.begin(); i<(_markers.end()-1);i+=2) {
-            Marker blockSize = *(i+1) - *i;
-            if (blockSize >= internalSize && blockSize < bestSize) {
-                bestSize = blockSize;
-                best = i;
-            }
-            if (blockSize >= largestFreeBlock[0]) {
-                largestFreeBlock[1] = largestFreeBlock[0];
-                largestFreeBlock[0] = blockSize;
-                largestFreeBlockPosition = *i;
-            } else if (blockSize > largestFreeBlock[1]) {
-                largestFreeBlock[1] = blockSize;
-            }
+            // find the free span in which this belongs (the span at 0 is always there)
+        auto span = _freeSpans.upper_bound(internalOffset);
+        assert(span != _freeSpans.begin());
+        --span;
+        if (internalOffset >= span->second || (unsigned(internalOffset) + unsigned(internalSize)) > unsigned(span->second)) {
+            assert(0);      // space isn't free
+            return false;
         }
 
-        if (bestSize == sentinel) {
-            _largestFreeBlock = largestFreeBlock[0];
-            _largestFreeBlockValid = true;
-            assert(largestFreeBlock[0] < size);
-            return ~unsigned(0x0);
-        } 
+        if (internalSize) {
+            AllocateFromSpan_Internal(span, internalOffset, internalSize);
+        }
+        return true;
+    }
+    
+    template <typename Marker>
+        bool        SpanningHeap<Marker>::Deallocate(unsigned ptr, unsigned size)
+    {
+        ScopedLock(_lock);
+        Marker internalOffset = ToInternalSize(ptr);
+        Marker internalSize = ToInternalSize(AlignSize(size));
+        if (_freeSpans.empty()) {
+            return false;
+        }
 
-        {
-            if (largestFreeBlockPosition==*best) {
-                _largestFreeBlock = std::max(Marker(largestFreeBlock[0]-internalSize), largestFreeBlock[1]);
-            } else {
-                _largestFreeBlock = largestFreeBlock[0];
-            }
-            _largestFreeBlockValid = true;
+            //  The space must be entirely allocated -- so it must fall between the
+            //  end of one free span and the start of the next
+        unsigned internalEnd = unsigned(internalOffset) + unsigned(internalSize);
+        auto next = _freeSpans.upper_bound(internalOffset);
+        assert(next != _freeSpans.begin());
+        auto prev = next;
+        --prev;
+        if (    prev->second > internalOffset || internalEnd > unsigned(_heapEnd)
+            ||  (next != _freeSpans.end() && unsigned(next->first) < internalEnd)) {
+            assert(0);      // couldn't find it within our heap
+            return false;
         }
-        
-        if (bestSize == internalSize) {
-                //  Got an exact match. In this case we remove 2 markers, because the entire span has become 
-                //  allocated, and should just merge into the spans around it.
-            unsigned result = ToExternalSize(*best);
-            if (best == _markers.begin()) {
-                if (_markers.size()==2) {   // special case for unallocated heap to fully allocated heap (0,0) -> (0,0,size)
-                    _markers.insert(_markers.begin(), 0);
-                } else {
-                    *(best+1) = 0;
-                }
-            } else {
-                if (best+2 >= _markers.end()) {
-                    _markers.erase(best);
-                } else {
-                    _markers.erase(best, best+2);
-                }
-            }
-            assert(_markers[0]==0);
-            assert(_largestFreeBlock==CalculateLargestFreeBlock_Internal());
-            if (_markers.size()==2) {assert(_markers[0]==0 && _markers[1]!=0);}
-            return result;
+
+        if (!internalSize) {
+            return true;
+        }
+
+            //  merge with the free spans on either side
+        Marker newEnd = Marker(internalEnd);
+        if (next != _freeSpans.end() && next->first == newEnd) {
+            newEnd = next->second;
+            auto toRemove = next;
+            ++next;
+            RemoveFreeSpan_Internal(toRemove);
+        }
+
+        if (prev->second == internalOffset) {
+            SetFreeSpanEnd_Internal(prev, newEnd);
         } else {
-                //  We'll allocate from the start of the span space. 
-            unsigned result = ToExternalSize(*best);
-            if (best == _markers.begin()) {
-                    //      We're allocating from the start of the heap. But we can't move the marker
-                    //      at the start of the heap, so we have to insert 2 more...
-                Marker insertion[] = {0, internalSize};
-                _markers.insert(_markers.begin()+1, insertion, &insertion[dimof(insertion)]);
-            } else {
-                *best += internalSize;
+            InsertFreeSpan_Internal(next, internalOffset, newEnd);
+        }
+        return true;
+    }
+
+    template <typename Marker>
+        void        SpanningHeap<Marker>::AllocateFromSpan_Internal(FreeSpanIterator span, Marker offset, Marker size)
+    {
+        Marker start = span->first, end = span->second;
+        Marker allocationEnd = Marker(offset + size);
+        assert(start <= offset && allocationEnd <= end && size > 0);
+
+        auto next = span;
+        ++next;
+        if (offset != start || start == 0) {
+                //  Keep the space before the allocation. Note that the span at the start of
+                //  the heap is never removed (the marker array must begin with 0), but it
+                //  can become empty
+            SetFreeSpanEnd_Internal(span, offset);
+        } else {
+            RemoveFreeSpan_Internal(span);
+        }
+
+        if (allocationEnd != end) {
+            InsertFreeSpan_Internal(next, allocationEnd, end);
+        }
+    }
+
+    template <typename Marker>
+        unsigned    SpanningHeap<Marker>::SizeClass(Marker size)
+    {
+            //  Small sizes get a class each. Above that, the first level comes from the
+            //  highest set bit, and the second level from the bits just below it
+        if (size < SubdivisionCount) {
+            return unsigned(size);
+        }
+        auto firstLevel = IntegerLog2(uint32(size));
+        auto secondLevel = (uint32(size) >> (firstLevel - SubdivisionBits)) - SubdivisionCount;
+        return (firstLevel - SubdivisionBits + 1) * SubdivisionCount + secondLevel;
+    }
+
+    template <typename Marker>
+        bool        SpanningHeap<Marker>::FindFreeSpan_Internal(Marker minSize, SizeAndStart& result) const
+    {
+            //  Not every span in the class for "minSize" is large enough. So search
+            //  within that class first...
+        auto sizeClass = SizeClass(minSize);
+        const auto& spans = _sizeClasses[sizeClass];
+        auto i = spans.lower_bound(SizeAndStart(minSize, 0));
+        if (i != spans.cend()) {
+            result = *i;
+            return true;
+        }
+
+            //  ... but every span in a larger class is large enough. The first span in the
+            //  next non-empty class is the smallest (and lowest in the heap)
+        auto firstLevel = sizeClass / SubdivisionCount;
+        uint32 secondLevelMap = _secondLevelBitmaps[firstLevel] & (~uint32(0) << (sizeClass % SubdivisionCount + 1));
+        if (!secondLevelMap) {
+            uint32 firstLevelMap = _firstLevelBitmap & (~uint32(0) << (firstLevel + 1));
+            if (!firstLevelMap) {
+                return false;
             }
-            if (_markers.size()==2) {assert(_markers[0]==0 && _markers[1]!=0);}
-            assert(_largestFreeBlock==CalculateLargestFreeBlock_Internal());
-            return result;
+            firstLevel = xl_ctz4(firstLevelMap);
+            secondLevelMap = _secondLevelBitmaps[firstLevel];
         }
+
+        const auto& largerSpans = _sizeClasses[firstLevel * SubdivisionCount + xl_ctz4(secondLevelMap)];
+        assert(!largerSpans.empty());
+        result = *largerSpans.cbegin();
+        return true;
     }
 
     template <typename Marker>
-        bool        SpanningHeap<Marker>::Allocate(unsigned ptr, unsigned size)
+        auto SpanningHeap<Marker>::CalculateLargestFreeBlock_Internal() const -> Marker
+    {
+        if (!_firstLevelBitmap) {
+            return 0;
+        }
+        auto firstLevel = IntegerLog2(_firstLevelBitmap);
+        auto secondLevel = IntegerLog2(_secondLevelBitmaps[firstLevel]);
+        return _sizeClasses[firstLevel * SubdivisionCount + secondLevel].crbegin()->first;
+    }
+
+    template <typename Marker>
+        void        SpanningHeap<Marker>::AddToIndex_Internal(Marker start, Marker end)
     {
-        return BlockAdjust_Internal(ptr, size, true);
+        assert(start <= end);
+        SizeAndStart entry(Marker(end-start), start);
+        auto sizeClass = SizeClass(entry.first);
+        auto& spans = _sizeClasses[sizeClass];
+        spans.insert(entry);
+        _secondLevelBitmaps[sizeClass / SubdivisionCount] |= 1u << (sizeClass % SubdivisionCount);
+        _firstLevelBitmap |= 1u << (sizeClass / SubdivisionCount);
+        _availableSpace += entry.first;
     }
-    
+
     template <typename Marker>
-        bool        SpanningHeap<Marker>::Deallocate(unsigned ptr, unsigned size)
+        void        SpanningHeap<Marker>::RemoveFromIndex_Internal(Marker start, Marker end)
+    {
+        SizeAndStart entry(Marker(end-start), start);
+        auto sizeClass = SizeClass(entry.first);
+        auto& spans = _sizeClasses[sizeClass];
+        auto i = spans.find(entry);
+        assert(i != spans.end());
+        spans.erase(i);
+        if (spans.empty()) {
+            auto firstLevel = sizeClass / SubdivisionCount;
+            _secondLevelBitmaps[firstLevel] &= ~(1u << (sizeClass % SubdivisionCount));
+            if (!_secondLevelBitmaps[firstLevel]) {
+                _firstLevelBitmap &= ~(1u << firstLevel);
+            }
+        }
+        _availableSpace -= entry.first;
+    }
+
+    template <typename Marker>
+        auto SpanningHeap<Marker>::InsertFreeSpan_Internal(FreeSpanIterator hint, Marker start, Marker end) -> FreeSpanIterator
     {
-        return BlockAdjust_Internal(ptr, size, false);
+        AddToIndex_Internal(start, end);
+        return _freeSpans.insert(hint, std::make_pair(start, end));
     }
 
     template <typename Marker>
-        bool        SpanningHeap<Marker>::BlockAdjust_Internal(unsigned ptr, unsigned size, bool allocateOperation)
+        void        SpanningHeap<Marker>::RemoveFreeSpan_Internal(FreeSpanIterator span)
     {
-        ScopedLock(_lock);
-        Marker internalOffset = ToInternalSize(ptr);
-        Marker internalSize = ToInternalSize(AlignSize(size));
-        if (_markers.size()==2) {assert(_markers[0]==0 && _markers[1]!=0);}
+        RemoveFromIndex_Internal(span->first, span->second);
+        _freeSpans.erase(span);
+    }
 
-        _largestFreeBlockValid = false; // have to recalculate largest free after deallocate. We could update based on local changes, but...
+    template <typename Marker>
+        void        SpanningHeap<Marker>::SetFreeSpanEnd_Internal(FreeSpanIterator span, Marker newEnd)
+    {
+            // (the start is the key in _freeSpans, but the end can be changed in place)
+        RemoveFromIndex_Internal(span->first, span->second);
+        AddToIndex_Internal(span->first, newEnd);
+        span->second = newEnd;
+    }
 
-            // find the span in which this belongs, and mark the space deallocated
-        std::vector<Marker>::iterator i = _markers.begin()+(allocateOperation?0:1);
-        for (; (i+1)<_markers.end();i+=2) {
-            Marker start = *i;
-            Marker end = *(i+1);
-            if (internalOffset >= start && internalOffset < end) {
-                assert((internalOffset+internalSize) <= end);
-                if (start == internalOffset) {
-                    if (end == (internalOffset+internalSize)) {
-                            // the entire span is begin destroyed.
-                        if (i == _markers.begin() && allocateOperation) {
-                            *(i+1) = 0;
-                        } else if (i+2 >= _markers.end()) {
-                            _markers.erase(i);
-                        } else {
-                            _markers.erase(i, i+2);
-                        }
-                        assert(_markers[0]==0);
-                        if (_markers.size()==2) {assert(_markers[0]==0 && _markers[1]!=0);}
-                        return true;
-                    }
-
-                        // we can just move the start marker up to cover the unallocated space
-                    if (i == _markers.begin() && allocateOperation) {
-                        Marker insertion[] = {internalOffset, Marker(internalOffset+internalSize)};
-                        _markers.insert(i+1, insertion, &insertion[dimof(insertion)]);
-                    } else {
-                        *i = internalOffset+internalSize;
-                    }
-                    assert(_markers[0]==0);
-                    if (_markers.size()==2) {assert(_markers[0]==0 && _markers[1]!=0);}
-                    return true;
-                } else if (end == (internalOffset+internalSize)) {
-                        // move the end marker back to cover the space (but not if it's the end sentinel)
-                    if (i+2 >= _markers.end()) {
-                        _markers.insert(i+1, internalOffset);
-                    } else {
-                        *(i+1) = internalOffset;
-                    }
-                    assert(_markers[0]==0);
-                    if (_markers.size()==2) {assert(_markers[0]==0 && _markers[1]!=0);}
-                    return true;
-                } else {
-                        // create new markers to match the deallocated space
-                    Marker insertion[] = {internalOffset, Marker(internalOffset+internalSize)};
-                    _markers.insert(i+1, insertion, &insertion[dimof(insertion)]);
-                    if (_markers.size()==2) {assert(_markers[0]==0 && _markers[1]!=0);}
-                    return true;
-                }
-            }
+    template <typename Marker>
+        auto SpanningHeap<Marker>::BuildMarkers_Internal() const -> std::vector<Marker>
+    {
+            //  Marker array is simple -- just a list of positions. It will alternate between
+            //  unallocated and allocated, beginning with an unallocated span at 0. The 
+            //  final marker is the end of the heap.
+        std::vector<Marker> result;
+        if (_freeSpans.empty()) {
+            return result;
         }
 
-        assert(0);      // couldn't find it within our heap
-        return false;
+        result.reserve(_freeSpans.size()*2+1);
+        for (auto i=_freeSpans.cbegin(); i!=_freeSpans.cend(); ++i) {
+            result.push_back(i->first);
+            result.push_back(i->second);
+        }
+        if (result[result.size()-1] != _heapEnd) {
+            result.push_back(_heapEnd);     // ends in an allocated span
+        }
+        return std::move(result);
     }
 
     template <typename Marker>
-        auto SpanningHeap<Marker>::CalculateLargestFreeBlock_Internal() const -> Marker
+        void        SpanningHeap<Marker>::BuildFromMarkers_Internal(const Marker* begin, const Marker* end)
     {
-        Marker largestBlock = 0;
-        assert(!_markers.empty());
-        std::vector<Marker>::const_iterator i = _markers.begin();
-        for (; i<(_markers.end()-1);i+=2) {
-            Marker start = *i;
-            Marker end = *(i+1);
-            largestBlock = std::max(largestBlock, Marker(end-start));
+        _freeSpans.clear();
+        for (unsigned c=0; c<dimof(_sizeClasses); ++c) {
+            _sizeClasses[c].clear();
+        }
+        _firstLevelBitmap = 0;
+        std::fill(_secondLevelBitmaps, &_secondLevelBitmaps[dimof(_secondLevelBitmaps)], 0u);
+        _availableSpace = 0;
+        _heapEnd = 0;
+        if (begin == end) {
+            return;
+        }
+
+        auto markerCount = size_t(end - begin);
+        for (size_t c=0; (c+1)<markerCount; c+=2) {
+            InsertFreeSpan_Internal(_freeSpans.end(), begin[c], begin[c+1]);
         }
-        return largestBlock;
+        _heapEnd = begin[markerCount-1];
+    }
+
+    template <typename Marker>
+        void        SpanningHeap<Marker>::CopyIndex_Internal(const SpanningHeap& copyFrom)
+    {
+        _freeSpans = copyFrom._freeSpans;
+        _heapEnd = copyFrom._heapEnd;
+        _availableSpace = copyFrom._availableSpace;
+        std::copy(copyFrom._sizeClasses, &copyFrom._sizeClasses[dimof(_sizeClasses)], _sizeClasses);
+        _firstLevelBitmap = copyFrom._firstLevelBitmap;
+        std::copy(copyFrom._secondLevelBitmaps, &copyFrom._secondLevelBitmaps[dimof(_secondLevelBitmaps)], _secondLevelBitmaps);
     }
 
     template <typename Marker>
         unsigned    SpanningHeap<Marker>::CalculateAvailableSpace() const
     {
         ScopedLock(_lock);
-        unsigned result = 0;
-        std::vector<Marker>::const_iterator i = _markers.begin();
-        for (; (i+1)<_markers.end();i+=2) {
-            Marker start = *i;
-            Marker end = *(i+1);
-            result += end-start;
-        }
-        return ToExternalSize(Marker(result));
+        return ToExternalSize(Marker(_availableSpace));
     }
 
     template <typename Marker>
         unsigned    SpanningHeap<Marker>::CalculateLargestFreeBlock() const
     {
         ScopedLock(_lock);
-        if (!_largestFreeBlockValid) {
-            _largestFreeBlock = CalculateLargestFreeBlock_Internal();
-            _largestFreeBlockValid = true;
-        }
-        return ToExternalSize(_largestFreeBlock);
+        return ToExternalSize(CalculateLargestFreeBlock_Internal());
     }
 
     template <typename Marker>
         unsigned    SpanningHeap<Marker>::CalculateAllocatedSpace() const
     {
         ScopedLock(_lock);
-        if (_markers.empty()) return 0;
-
-        unsigned result = 0;
-        std::vector<Marker>::const_iterator i = _markers.begin()+1;
-        for (; i<(_markers.end()-1);i+=2) {
-            Marker start = *i;
-            Marker end = *(i+1);
-            result += end-start;
-        }
-        return ToExternalSize(Marker(result));
+        if (_freeSpans.empty()) return 0;
+        return ToExternalSize(Marker(unsigned(_heapEnd) - _availableSpace));
     }
 
     template <typename Marker>
         unsigned    SpanningHeap<Marker>::CalculateHeapSize() const
     {
         ScopedLock(_lock);
-        if (_markers.empty()) {
+        if (_freeSpans.empty()) {
             return 0;
         }
-        return ToExternalSize(_markers[_markers.size()-1]);
+        return ToExternalSize(_heapEnd);
     }
 
     template <typename Marker>
         unsigned        SpanningHeap<Marker>::AppendNewBlock(unsigned size)
     {
         ScopedLock(_lock);
-        if (!_markers.size()) {
-            _markers.push_back(0);
-            _markers.push_back(0);
-            _markers.push_back(ToInternalSize(AlignSize(size)));
+        if (_freeSpans.empty()) {
+            InsertFreeSpan_Internal(_freeSpans.end(), 0, 0);
+            _heapEnd = ToInternalSize(AlignSize(size));
             return 0;
         }
 
             // append a new block in an allocated status
-
-        const bool endsInAllocatedBlock = _markers.size()&1;  // odd markers == ends in allocated block
-        auto finalMarker = _markers[_markers.size()-1];
+        auto finalMarker = _heapEnd;
         auto newBlockInternalSize = ToInternalSize(AlignSize(size));
         assert((unsigned(finalMarker) + unsigned(newBlockInternalSize)) <= std::numeric_limits<Marker>::max());
-        auto newEnd = Marker(finalMarker + newBlockInternalSize);
-        if (endsInAllocatedBlock) {
-            _markers[_markers.size()-1] = newEnd;     // just shift the end marker back
-        } else {
-            _markers.push_back(newEnd);               // add a final allocated block
-        }
-
+        _heapEnd = Marker(finalMarker + newBlockInternalSize);
         return ToExternalSize(finalMarker);
     }
     
@@ -391,29 +460,27 @@ namespace Utility
         uint64      SpanningHeap<Marker>::CalculateHash() const
     {
         ScopedLock(_lock);
-        return Hash64(AsPointer(_markers.begin()), AsPointer(_markers.end()));
+        auto markers = BuildMarkers_Internal();
+        return Hash64(AsPointer(markers.cbegin()), AsPointer(markers.cend()));
     }
 
     template <typename Marker>
         bool        SpanningHeap<Marker>::IsEmpty() const
     {
         ScopedLock(_lock);
-        return _markers.size() <= 2;
+        return _freeSpans.empty() || (_freeSpans.size() == 1 && _freeSpans.begin()->second == _heapEnd);
     }
 
     template <typename Marker>
         std::vector<unsigned> SpanningHeap<Marker>::CalculateMetrics() const
     {
         ScopedLock(_lock);
+        auto markers = BuildMarkers_Internal();
         std::vector<unsigned> result;
-        result.reserve(_markers.size());
-        std::vector<Marker>::const_iterator i = _markers.begin();
-        for (; i!=_markers.end();++i) {
+        result.reserve(markers.size());
+        for (auto i=markers.cbegin(); i!=markers.cend(); ++i) {
             result.push_back(ToExternalSize(*i));
         }
-        #if defined(XL_DEBUG)
-            assert(!_largestFreeBlockValid || _largestFreeBlock==CalculateLargestFreeBlock_Internal());
-        #endif
         return result;
     }
 
@@ -445,10 +512,11 @@ namespace Utility
     {
         ScopedLock(_lock);
 
+        auto markers = BuildMarkers_Internal();
         std::vector<std::pair<Marker, Marker> > allocatedBlocks;
-        allocatedBlocks.reserve(_markers.size()/2);
-        std::vector<Marker>::const_iterator i = _markers.begin()+1;
-        for (; (i+1)<_markers.end();i+=2) {
+        allocatedBlocks.reserve(markers.size()/2);
+        auto i = markers.cbegin()+1;
+        for (; (i+1)<markers.end();i+=2) {
             Marker start = *i;
             Marker end   = *(i+1);
             assert(start < end);
@@ -479,7 +547,7 @@ namespace Utility
             step._sourceEnd      = ToExternalSize(i->second);
             step._destination    = ToExternalSize(compressedPosition);
             assert(step._destination < 512*1024);
-            assert((step._destination + step._sourceEnd - step._sourceStart) <= ToExternalSize(_markers[_markers.size()-1]));
+            assert((step._destination + step._sourceEnd - step._sourceStart) <= ToExternalSize(_heapEnd));
             assert(step._sourceStart < step._sourceEnd);
             compressedPosition += i->second - i->first;
             result.push_back(step);
@@ -506,12 +574,12 @@ namespace Utility
             //      All of the spans in the heap have moved about we have to recalculate the
             //      allocated spans from scratch, based on the positions of the new blocks
             //
-        unsigned startingAvailableSize = CalculateAvailableSpace(); (void)startingAvailableSize;
-        unsigned startingLargestBlock = CalculateLargestFreeBlock(); (void)startingLargestBlock;
+        unsigned startingAvailableSize = _availableSpace; (void)startingAvailableSize;
+        Marker startingLargestBlock = CalculateLargestFreeBlock_Internal(); (void)startingLargestBlock;
 
-        Marker heapEnd = _markers[_markers.size()-1];
-        _markers.erase(_markers.begin(), _markers.end());
-        _markers.push_back(0);
+        std::vector<Marker> markers;
+        markers.reserve(defrag.size()*2+2);
+        markers.push_back(0);
         if (!defrag.empty()) {
             std::vector<DefragStep> defragByDestination(defrag);
             std::sort(defragByDestination.begin(), defragByDestination.end(), SortDefragStep_Destination);
@@ -526,23 +594,21 @@ namespace Utility
                 if (blockBegin == currentAllocatedBlockEnd) {
                     currentAllocatedBlockEnd = blockEnd;
                 } else {
-                    _markers.push_back(currentAllocatedBlockBegin);
-                    _markers.push_back(currentAllocatedBlockEnd);
+                    markers.push_back(currentAllocatedBlockBegin);
+                    markers.push_back(currentAllocatedBlockEnd);
                     currentAllocatedBlockBegin = blockBegin;
                     currentAllocatedBlockEnd = blockEnd;
                 }
             }
 
-            _markers.push_back(currentAllocatedBlockBegin);
-            _markers.push_back(currentAllocatedBlockEnd);
+            markers.push_back(currentAllocatedBlockBegin);
+            markers.push_back(currentAllocatedBlockEnd);
         }
-        _markers.push_back(heapEnd);
-        _largestFreeBlockValid = false;
+        markers.push_back(_heapEnd);
+        BuildFromMarkers_Internal(AsPointer(markers.cbegin()), AsPointer(markers.cend()));
 
-        unsigned newAvailableSpace = CalculateAvailableSpace(); (void)newAvailableSpace;
-        unsigned newLargestBlock = CalculateLargestFreeBlock(); (void)newLargestBlock;
-        assert(newAvailableSpace == startingAvailableSize);
-        assert(newLargestBlock >= startingLargestBlock);        // sometimes the tests will run a defrag that doesn't reduce the largest block
+        assert(_availableSpace == startingAvailableSize);
+        assert(CalculateLargestFreeBlock_Internal() >= startingLargestBlock);        // sometimes the tests will run a defrag that doesn't reduce the largest block
     }
 
     template <typename Marker>
@@ -552,83 +618,89 @@ namespace Utility
         //  -- useful to write it out to disk, or store in a compact form
         ScopedLock(_lock);
 
-        if (_markers.size() >= 2) {
-            for (auto i=_markers.cbegin()+1; i!=_markers.cend(); ++i) {
+        auto markers = BuildMarkers_Internal();
+        if (markers.size() >= 2) {
+            for (auto i=markers.cbegin()+1; i!=markers.cend(); ++i) {
                 assert(*(i-1) <= *i);
             }
         }
 
-        size_t resultSize = sizeof(Marker) * _markers.size();
+        size_t resultSize = sizeof(Marker) * markers.size();
         auto result = std::make_unique<uint8[]>(resultSize);
-        XlCopyMemory(result.get(), AsPointer(_markers.begin()), resultSize);
+        XlCopyMemory(result.get(), AsPointer(markers.begin()), resultSize);
         return std::make_pair(std::move(result), resultSize);
     }
 
     template <typename Marker>
         SpanningHeap<Marker>::SpanningHeap(unsigned size)
     {
-        _markers.reserve(64);
-        _markers.push_back(0);
-        _markers.push_back(ToInternalSize(AlignSize(size)));
-        _largestFreeBlockValid = false;
-        _largestFreeBlock = 0;
+        BuildFromMarkers_Internal(nullptr, nullptr);
+        _heapEnd = ToInternalSize(AlignSize(size));
+        InsertFreeSpan_Internal(_freeSpans.end(), 0, _heapEnd);
     }
 
     template <typename Marker>
         SpanningHeap<Marker>::SpanningHeap(const uint8 flattened[], size_t flattenedSize)
     {
-        _largestFreeBlockValid = false;
-        _largestFreeBlock = 0;
-            // flattened rep is just a copy of the markers array... we can copy it straight in...
+            // flattened rep is just a copy of the markers array... 
         auto markerCount = flattenedSize / sizeof(Marker);
-        _markers.resize(markerCount);
-        std::copy(
-            (const Marker*)flattened, (const Marker*)PtrAdd(flattened, markerCount * sizeof(Marker)), 
-            _markers.begin());
+        auto markers = (const Marker*)flattened;
 
             // make sure things are in the right order
-        if (_markers.size() >= 2) {
-            for (auto i=_markers.cbegin()+1; i!=_markers.cend(); ++i) {
-                assert(*(i-1) <= *i);
-            }
+        for (size_t c=1; c<markerCount; ++c) {
+            assert(markers[c-1] <= markers[c]);
         }
+
+        BuildFromMarkers_Internal(markers, markers + markerCount);
     }
 
     template <typename Marker>
         SpanningHeap<Marker>::SpanningHeap(SpanningHeap&& moveFrom) never_throws
-    : _markers(std::move(moveFrom._markers))
-    , _largestFreeBlock(moveFrom._largestFreeBlock)
-    , _largestFreeBlockValid(moveFrom._largestFreeBlockValid) 
+    : _freeSpans(std::move(moveFrom._freeSpans))
+    , _heapEnd(moveFrom._heapEnd)
+    , _availableSpace(moveFrom._availableSpace)
+    , _firstLevelBitmap(moveFrom._firstLevelBitmap)
     {
+        std::move(moveFrom._sizeClasses, &moveFrom._sizeClasses[dimof(_sizeClasses)], _sizeClasses);
+        std::copy(moveFrom._secondLevelBitmaps, &moveFrom._secondLevelBitmaps[dimof(_secondLevelBitmaps)], _secondLevelBitmaps);
+        moveFrom.BuildFromMarkers_Internal(nullptr, nullptr);
     }
 
     template <typename Marker>
         auto SpanningHeap<Marker>::operator=(SpanningHeap&& moveFrom) never_throws -> const SpanningHeap&
     {
-        _markers = std::move(moveFrom._markers);
-        _largestFreeBlock = moveFrom._largestFreeBlock;
-        _largestFreeBlockValid = moveFrom._largestFreeBlockValid;
+        _freeSpans = std::move(moveFrom._freeSpans);
+        _heapEnd = moveFrom._heapEnd;
+        _availableSpace = moveFrom._availableSpace;
+        std::move(moveFrom._sizeClasses, &moveFrom._sizeClasses[dimof(_sizeClasses)], _sizeClasses);
+        _firstLevelBitmap = moveFrom._firstLevelBitmap;
+        std::copy(moveFrom._secondLevelBitmaps, &moveFrom._secondLevelBitmaps[dimof(_secondLevelBitmaps)], _secondLevelBitmaps);
+        moveFrom.BuildFromMarkers_Internal(nullptr, nullptr);
         return *this;
     }
 
     template <typename Marker>
         SpanningHeap<Marker>::SpanningHeap(const SpanningHeap<Marker>& cloneFrom) 
-    : _markers(cloneFrom._markers)
-    , _largestFreeBlock(cloneFrom._largestFreeBlock)
-    , _largestFreeBlockValid(cloneFrom._largestFreeBlockValid) 
-    {}
+    {
+        ScopedLock(cloneFrom._lock);
+        CopyIndex_Internal(cloneFrom);
+    }
 
     template <typename Marker>
         const SpanningHeap<Marker>& SpanningHeap<Marker>::operator=(const SpanningHeap<Marker>& cloneFrom)
     {
-        _markers = cloneFrom._markers;
-        _largestFreeBlock = cloneFrom._largestFreeBlock;
-        _largestFreeBlockValid = cloneFrom._largestFreeBlockValid;
+        if (&cloneFrom != this) {
+            ScopedLock(cloneFrom._lock);
+            CopyIndex_Internal(cloneFrom);
+        }
         return *this;
     }
 
     template <typename Marker>
-        SpanningHeap<Marker>::SpanningHeap() : _largestFreeBlock(0), _largestFreeBlockValid(false) {}
+        SpanningHeap<Marker>::SpanningHeap()
+    {
+        BuildFromMarkers_Internal(nullptr, nullptr);
+    }
 
     template <typename Marker>
         SpanningHeap<Marker>::~SpanningHeap()
@@ -9,6 +9,8 @@
 #include "../Core/Types.h"
 #include "Threading/Mutex.h"
 #include <vector>
+#include <map>
+#include <set>
 #include <algorithm>
 #include <memory>
 #include <limits>
@@ -181,13 +183,54 @@ namespace Utility
         SpanningHeap(const SpanningHeap& cloneFrom);
         const SpanningHeap& operator=(const SpanningHeap& cloneFrom);
     protected:
-        std::vector<Marker>         _markers;
+            //
+            //      The free spans are stored in address order (start -> end). The first
+            //      span always starts at 0, but it can be empty. The flattened "marker"
+            //      representation (alternating free & allocated spans) is built from
+            //      this when required (see CalculateMetrics() and Flatten()).
+            //
+            //      Free spans are also indexed by size with a two-level segregated fit
+            //      scheme (like TLSF). The first level is the highest bit of the size,
+            //      and the second level evenly subdivides that power-of-two range.
+            //      Bitmaps record which size classes are non-empty, so finding the
+            //      smallest suitable class is just a few bit scans. Each class is an
+            //      ordered set keyed by size, then address -- so adding and removing a
+            //      span is logarithmic in the size of the class, and allocations are
+            //      still best fit (with ties going to the lowest address).
+            //
+        static const unsigned SubdivisionBits = 3;
+        static const unsigned SubdivisionCount = 1<<SubdivisionBits;
+        static const unsigned FirstLevelCount = sizeof(Marker)*8 - SubdivisionBits + 1;
+        static const unsigned ClassCount = FirstLevelCount * SubdivisionCount;
+
+        typedef std::map<Marker, Marker> FreeSpans;
+        typedef typename FreeSpans::iterator FreeSpanIterator;
+        typedef std::pair<Marker, Marker> SizeAndStart;
+
+        FreeSpans                   _freeSpans;
+        Marker                      _heapEnd;
+        unsigned                    _availableSpace;
+
+        std::set<SizeAndStart>      _sizeClasses[ClassCount];
+        uint32                      _firstLevelBitmap;
+        uint32                      _secondLevelBitmaps[FirstLevelCount];
+
         mutable Threading::Mutex    _lock;
-        mutable bool                _largestFreeBlockValid;
-        mutable Marker              _largestFreeBlock;
 
-        Marker      CalculateLargestFreeBlock_Internal() const;
-        bool        BlockAdjust_Internal(unsigned ptr, unsigned size, bool allocateOperation);
+        static unsigned     SizeClass(Marker size);
+        bool                FindFreeSpan_Internal(Marker minSize, SizeAndStart& result) const;
+        Marker              CalculateLargestFreeBlock_Internal() const;
+
+        void                AddToIndex_Internal(Marker start, Marker end);
+        void                RemoveFromIndex_Internal(Marker start, Marker end);
+        FreeSpanIterator    InsertFreeSpan_Internal(FreeSpanIterator hint, Marker start, Marker end);
+        void                RemoveFreeSpan_Internal(FreeSpanIterator span);
+        void                SetFreeSpanEnd_Internal(FreeSpanIterator span, Marker newEnd);
+        void                AllocateFromSpan_Internal(FreeSpanIterator span, Marker offset, Marker size);
+
+        std::vector<Marker> BuildMarkers_Internal() const;
+        void                BuildFromMarkers_Internal(const Marker* begin, const Marker* end);
+        void                CopyIndex_Internal(const SpanningHeap& copyFrom);
     };
 
     typedef SpanningHeap<uint16> SimpleSpanningHeap;
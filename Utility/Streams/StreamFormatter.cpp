@@ -613,6 +613,15 @@ namespace Utility
         _pendingHeader = true;
     }
 
+    template<typename CharType>
+        InputStreamFormatter<CharType>::InputStreamFormatter(const MemoryMappedInputStream& stream, unsigned tabWidth, unsigned lineIndex)
+        : InputStreamFormatter(stream)
+    {
+        _lineIndex = lineIndex;
+        _tabWidth = tabWidth;
+        _pendingHeader = false;
+    }
+
     template<typename CharType>
         InputStreamFormatter<CharType>::~InputStreamFormatter()
     {}
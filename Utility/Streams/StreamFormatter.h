@@ -129,9 +129,20 @@ namespace Utility
 
         StreamLocation GetLocation() const;
 
+            //  Used to record the position of an element, so that it can be parsed
+            //  again later (with the section constructor below)
+        const void* GetReadPointer() const { return _stream.ReadPointer(); }
+        const void* GetLineStart() const { return _lineStart; }
+        unsigned GetTabWidth() const { return _tabWidth; }
+
         using value_type = CharType;
 
         InputStreamFormatter(const MemoryMappedInputStream& stream);
+
+            //  Construct for a section of a larger stream, starting at the beginning of a line.
+            //  The header of the larger stream has already been read, so the tab width
+            //  is passed in. The line index is only used for error messages
+        InputStreamFormatter(const MemoryMappedInputStream& stream, unsigned tabWidth, unsigned lineIndex);
         ~InputStreamFormatter();
     protected:
         MemoryMappedInputStream _stream;
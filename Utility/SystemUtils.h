@@ -9,6 +9,7 @@
 #include "UTFUtils.h"
 #include "../Core/Prefix.h"
 #include "../Core/Types.h"
+#include <vector>
 
 namespace Utility
 {
@@ -30,6 +31,18 @@ namespace Utility
 
     const char* XlGetCommandLine();
 
+    class CPUTopology
+    {
+    public:
+        unsigned _logicalProcessorCount;
+        std::vector<uint64> _physicalCores;     // mask of the logical processors in each physical core
+    };
+    CPUTopology XlGetCPUTopology();
+
+    struct ThreadPriority { enum Enum { Background, Low, Normal, High }; };
+    void XlSetCurrentThreadPriority(ThreadPriority::Enum priority);
+    bool XlSetCurrentThreadAffinity(uint64 processorMask);      // 0 restores the process default
+
     typedef size_t ModuleId;
     ModuleId GetCurrentModuleId();
 }
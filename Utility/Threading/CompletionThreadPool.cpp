@@ -7,81 +7,231 @@
 #include "CompletionThreadPool.h"
 #include "../../ConsoleRig/Log.h"
 #include "../../Utility/SystemUtils.h"
+#include "../../Utility/TimeUtils.h"
 #include "../../Core/Exceptions.h"
+#include <algorithm>
+#include <exception>
 
 namespace Utility
 {
-    void CompletionThreadPool::EnqueueInternal(PendingTask&& task)
+    static void AtomicAdd64(Interlocked::Value64 volatile* target, Interlocked::Value64 addition)
     {
-        _pendingTasks.push_overflow(std::forward<PendingTask>(task));
+        Interlocked::Value64 old;
+        do {
+            old = Interlocked::Load64(target);
+        } while (Interlocked::CompareExchange64(target, old + addition, old) != old);
+    }
+
+    static void AtomicMax64(Interlocked::Value64 volatile* target, Interlocked::Value64 value)
+    {
+        Interlocked::Value64 old;
+        do {
+            old = Interlocked::Load64(target);
+            if (old >= value) return;
+        } while (Interlocked::CompareExchange64(target, value, old) != old);
+    }
+
+    static uint64 TicksToMicroseconds(uint64 ticks, uint64 frequency)
+    {
+        return (ticks / frequency) * 1000000ull + ((ticks % frequency) * 1000000ull) / frequency;
+    }
+
+    void CompletionThreadPool::EnqueueInternal(std::function<void()>&& task)
+    {
+        PendingTask pendingTask;
+        pendingTask._fn = std::move(task);
+        pendingTask._enqueueTime = GetPerformanceCounter();
+        Interlocked::Increment(&_tasksEnqueued);
+        _pendingTasks.push_overflow(std::move(pendingTask));
 
             // set event should wake one thread -- and that thread should
             // then take over and execute the task
         XlSetEvent(_events[0]);
     }
 
+    void CompletionThreadPool::WorkerThread(unsigned threadIndex)
+    {
+        unsigned appliedConfigId = ~0u;
+
+            //  Threads with an index higher than the active thread count
+            //  should exit (this happens when the pool is reconfigured with
+            //  fewer threads)
+        while (!this->_workerQuit && threadIndex < this->_activeThreadCount) {
+            if (appliedConfigId != this->_configId) {
+                    //  The priority & affinity can only be applied by the thread itself,
+                    //  so every thread checks for changes here
+                Desc desc;
+                {
+                    ScopedLock(this->_configLock);
+                    desc = this->_desc;
+                    appliedConfigId = this->_configId;
+                }
+                XlSetCurrentThreadPriority(desc._priority);
+                XlSetCurrentThreadAffinity(desc._affinityMask);
+            }
+
+            bool gotTask = false;
+            PendingTask task;
+
+            {
+                    // note that _pendingTasks is safe for multiple pushing threads,
+                    // but not safe for multiple popping threads. So we have to
+                    // lock to prevent more than one thread from attempt to pop
+                    // from it at the same time.
+                ScopedLock(this->_pendingsTaskLock);
+
+                PendingTask* t = nullptr;
+                if (_pendingTasks.try_front(t)) {
+                    task = std::move(*t);
+                    _pendingTasks.pop();
+                    gotTask = true;
+                }
+            }
+
+            if (gotTask) {
+                auto startTime = GetPerformanceCounter();
+                auto queueWait = Interlocked::Value64(startTime - task._enqueueTime);
+                Interlocked::Increment(&_tasksStarted);
+                AtomicAdd64(&_queueWaitTime, queueWait);
+                AtomicMax64(&_maxQueueWait, queueWait);
+
+                    // if we got this far, we can execute the task....
+                TRY
+                {
+                    task._fn();
+                } CATCH(const std::exception& e) {
+                    LogAlwaysError << "Suppressing exception in thread pool thread: " << e.what();
+                } CATCH(...) {
+                    LogAlwaysError << "Suppressing unknown exception in thread pool thread.";
+                } CATCH_END
+
+                AtomicAdd64(&_busyTime, Interlocked::Value64(GetPerformanceCounter() - startTime));
+                AtomicAdd64(&_tasksCompleted, 1);
+
+                    // That that when using completion routines, we want to attempt to
+                    // distribute the tasks evenly between threads (so that the completion
+                    // routines will also be distributed evenly between threads.). To achieve
+                    // this, let's not attempt to search for another task immediately... Instead
+                    // when after we complete a task, let's encourage this thread to go back into
+                    // a stall (unless all of our threads are saturated)
+                Threading::YieldTimeSlice();
+                continue;
+            }
+
+                // Wait for the event with the "alertable" flag set true
+                // note -- this is why we can't use std::condition_variable
+                //      (because threads waiting on a condition variable won't
+                //      be woken to execute completion routines)
+            XlWaitForMultipleSyncObjects(
+                2, this->_events,
+                false, XL_INFINITE, true);
+        }
+    }
+
+    void CompletionThreadPool::StartWorkerThreads(unsigned threadCount)
+    {
+        for (unsigned i = unsigned(_workerThreads.size()); i<threadCount; ++i)
+            _workerThreads.emplace_back([this, i] { this->WorkerThread(i); });
+    }
+
+    void CompletionThreadPool::Reconfigure(const Desc& desc)
+    {
+        auto threadCount = std::max(desc._threadCount, 1u);
+        {
+            ScopedLock(_configLock);
+            _desc = desc;
+            _desc._threadCount = threadCount;
+            ++_configId;
+        }
+
+        if (threadCount < _workerThreads.size()) {
+                //  Wake every thread with the manual reset event; the threads that are
+                //  no longer required will exit. The remaining threads will spin briefly
+                //  until we reset the event again.
+            _activeThreadCount = threadCount;
+            XlSetEvent(_events[1]);
+            for (auto i=_workerThreads.begin()+threadCount; i!=_workerThreads.end(); ++i)
+                i->join();
+            _workerThreads.erase(_workerThreads.begin()+threadCount, _workerThreads.end());
+            XlResetEvent(_events[1]);
+
+                //  One of the exiting threads may have consumed the wake up for a task
+                //  that is still in the queue, so wake another thread to be safe
+            XlSetEvent(_events[0]);
+        } else {
+            _activeThreadCount = threadCount;
+            StartWorkerThreads(threadCount);
+        }
+    }
+
+    auto CompletionThreadPool::GetDesc() const -> Desc
+    {
+        ScopedLock(_configLock);
+        return _desc;
+    }
+
+    float CompletionThreadPool::Metrics::Utilisation() const
+    {
+        if (!_elapsedTime || !_threadCount) return 0.f;
+        return float(double(_busyTime) / (double(_elapsedTime) * double(_threadCount)));
+    }
+
+    float CompletionThreadPool::Metrics::AverageQueueWait() const
+    {
+        if (!_tasksCompleted) return 0.f;
+        return float(double(_queueWaitTime) / double(_tasksCompleted));
+    }
+
+    auto CompletionThreadPool::GetMetrics() const -> Metrics
+    {
+            //  The counters are read individually, so the results can be slightly
+            //  inconsistant while tasks are completing
+        auto freq = GetPerformanceCounterFrequency();
+        Metrics result;
+        result._threadCount = _activeThreadCount;
+        auto pending = _tasksEnqueued - _tasksStarted;
+        result._pendingTasks = (pending > 0) ? unsigned(pending) : 0u;
+        result._tasksCompleted = uint64(Interlocked::Load64(&_tasksCompleted));
+        result._busyTime = TicksToMicroseconds(uint64(Interlocked::Load64(&_busyTime)), freq);
+        result._queueWaitTime = TicksToMicroseconds(uint64(Interlocked::Load64(&_queueWaitTime)), freq);
+        result._maxQueueWait = TicksToMicroseconds(uint64(Interlocked::Load64(&_maxQueueWait)), freq);
+        result._elapsedTime = TicksToMicroseconds(GetPerformanceCounter() - uint64(Interlocked::Load64(&_metricsStartTime)), freq);
+        return result;
+    }
+
+    void CompletionThreadPool::ResetMetrics()
+    {
+            //  (the enqueued & started counts are not reset, because we use them
+            //  to calculate the number of pending tasks)
+        Interlocked::Exchange64(&_tasksCompleted, 0);
+        Interlocked::Exchange64(&_busyTime, 0);
+        Interlocked::Exchange64(&_queueWaitTime, 0);
+        Interlocked::Exchange64(&_maxQueueWait, 0);
+        Interlocked::Exchange64(&_metricsStartTime, Interlocked::Value64(GetPerformanceCounter()));
+    }
+
     CompletionThreadPool::CompletionThreadPool(unsigned threadCount)
+    : CompletionThreadPool(Desc(threadCount))
+    {}
+
+    CompletionThreadPool::CompletionThreadPool(const Desc& desc)
+    : _desc(desc)
     {
             // once event is an "auto-reset" event, which should wake a single thread
-            // another event is a "manual-reset" event. This should 
+            // another event is a "manual-reset" event. This should
         _events[0] = XlCreateEvent(false);
         _events[1] = XlCreateEvent(true);
         _workerQuit = false;
 
-        for (unsigned i = 0; i<threadCount; ++i)
-            _workerThreads.emplace_back(
-                [this]
-                {
-                    while (!this->_workerQuit) {
-                        bool gotTask = false;
-                        std::function<void()> task;
-
-                        {
-                                // note that _pendingTasks is safe for multiple pushing threads,
-                                // but not safe for multiple popping threads. So we have to
-                                // lock to prevent more than one thread from attempt to pop
-                                // from it at the same time.
-                            ScopedLock(this->_pendingsTaskLock);
-
-                            std::function<void()>*t = nullptr;
-                            if (_pendingTasks.try_front(t)) {
-                                task = std::move(*t);
-                                _pendingTasks.pop();
-                                gotTask = true;
-                            }
-                        }
-
-                        if (gotTask) {
-                                // if we got this far, we can execute the task....
-                            TRY
-                            {
-                                task();
-                            } CATCH(const std::exception& e) {
-                                LogAlwaysError << "Suppressing exception in thread pool thread: " << e.what();
-                            } CATCH(...) {
-                                LogAlwaysError << "Suppressing unknown exception in thread pool thread.";
-                            } CATCH_END
-
-                                // That that when using completion routines, we want to attempt to
-                                // distribute the tasks evenly between threads (so that the completion
-                                // routines will also be distributed evenly between threads.). To achieve
-                                // this, let's not attempt to search for another task immediately... Instead
-                                // when after we complete a task, let's encourage this thread to go back into
-                                // a stall (unless all of our threads are saturated)
-                            Threading::YieldTimeSlice();
-                            continue;
-                        }
-
-                            // Wait for the event with the "alertable" flag set true
-                            // note -- this is why we can't use std::condition_variable
-                            //      (because threads waiting on a condition variable won't
-                            //      be woken to execute completion routines)
-                        XlWaitForMultipleSyncObjects(
-                            2, this->_events,
-                            false, XL_INFINITE, true);
-                    }
-                }
-            );
+        _desc._threadCount = std::max(desc._threadCount, 1u);
+        _configId = 0;
+        _activeThreadCount = _desc._threadCount;
+
+        _tasksEnqueued = _tasksStarted = 0;
+        _tasksCompleted = _busyTime = _queueWaitTime = _maxQueueWait = 0;
+        _metricsStartTime = Interlocked::Value64(GetPerformanceCounter());
+
+        StartWorkerThreads(_desc._threadCount);
     }
 
     CompletionThreadPool::~CompletionThreadPool()
@@ -93,5 +243,51 @@ namespace Utility
         XlCloseSyncObject(_events[0]);
         XlCloseSyncObject(_events[1]);
     }
-}
 
+    void ParallelFor(
+        CompletionThreadPool& pool, unsigned taskCount, 
+        const std::function<void(unsigned)>& fn, unsigned maxWorkers)
+    {
+        Interlocked::Value nextTask = 0;
+        Threading::Mutex exceptionLock;
+        std::exception_ptr firstException;
+        auto processTasks = [&]()
+        {
+            TRY {
+                for (;;) {
+                    auto t = (unsigned)Interlocked::Increment(&nextTask);
+                    if (t >= taskCount) break;
+                    fn(t);
+                }
+            } CATCH (...) {
+                    //  Keep the first exception to rethrow on the calling thread, and
+                    //  stop the other threads from starting any more tasks
+                ScopedLock(exceptionLock);
+                if (!firstException)
+                    firstException = std::current_exception();
+                Interlocked::Exchange(&nextTask, Interlocked::Value(taskCount));
+            } CATCH_END
+        };
+
+        auto workerCount = (taskCount > 1) ? std::min(std::min(pool.GetDesc()._threadCount, taskCount-1), maxWorkers) : 0u;
+        Interlocked::Value pendingWorkers = 0;
+        for (unsigned c=0; c<workerCount; ++c) {
+            Interlocked::Increment(&pendingWorkers);
+            pool.Enqueue(
+                [&processTasks, &pendingWorkers]()
+                {
+                    processTasks();
+                    Interlocked::Decrement(&pendingWorkers);
+                });
+        }
+        processTasks();
+
+            //  The workers reference our stack, so we must wait for all of them to
+            //  finish (even if there was an exception)
+        while (Interlocked::Load(&pendingWorkers) != 0)
+            Threading::YieldTimeSlice();
+
+        if (firstException)
+            std::rethrow_exception(firstException);
+    }
+}
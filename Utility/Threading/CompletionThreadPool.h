@@ -8,18 +8,59 @@
 
 #include "Mutex.h"
 #include "LockFree.h"
+#include "../SystemUtils.h"
 #include <vector>
 #include <thread>
+#include <functional>
 
 namespace Utility
 {
     class CompletionThreadPool
     {
     public:
+        class Desc
+        {
+        public:
+            unsigned                _threadCount;
+            ThreadPriority::Enum    _priority;
+            uint64                  _affinityMask;      // 0 means any processor available to the process
+
+            Desc(unsigned threadCount = 1, ThreadPriority::Enum priority = ThreadPriority::Normal, uint64 affinityMask = 0)
+            : _threadCount(threadCount), _priority(priority), _affinityMask(affinityMask) {}
+        };
+
+            //  All times are in microseconds, and all values are accumulated
+            //  since construction (or the last call to ResetMetrics())
+        class Metrics
+        {
+        public:
+            unsigned    _threadCount;
+            unsigned    _pendingTasks;
+            uint64      _tasksCompleted;
+            uint64      _busyTime;          // time spent executing tasks (summed over all threads)
+            uint64      _queueWaitTime;     // time tasks spent in the queue before execution started
+            uint64      _maxQueueWait;
+            uint64      _elapsedTime;
+
+            float       Utilisation() const;
+            float       AverageQueueWait() const;
+        };
+
         template<class Fn, class... Args>
             void Enqueue(Fn&& fn, Args&&... args);
 
+            //  Change the thread count, priority or affinity while the pool is running.
+            //  Tasks already in the queue are not lost (but threads that are removed
+            //  will finish their current task first). Don't call from more than one
+            //  thread at the same time.
+        void        Reconfigure(const Desc& desc);
+        Desc        GetDesc() const;
+
+        Metrics     GetMetrics() const;
+        void        ResetMetrics();
+
         CompletionThreadPool(unsigned threadCount);
+        CompletionThreadPool(const Desc& desc);
         ~CompletionThreadPool();
 
         CompletionThreadPool(const CompletionThreadPool&) = delete;
@@ -28,15 +69,35 @@ namespace Utility
         CompletionThreadPool& operator=(CompletionThreadPool&&) = delete;
     private:
         std::vector<std::thread> _workerThreads;
-        
+
         Threading::Mutex _pendingsTaskLock;
-        typedef std::function<void()> PendingTask;
+        class PendingTask
+        {
+        public:
+            std::function<void()>   _fn;
+            uint64                  _enqueueTime;
+        };
         LockFree::FixedSizeQueue<PendingTask, 256> _pendingTasks;
 
         XlHandle _events[2];
         volatile bool _workerQuit;
 
-        void EnqueueInternal(PendingTask&& task);
+        mutable Threading::Mutex _configLock;
+        Desc                _desc;
+        volatile unsigned   _configId;
+        volatile unsigned   _activeThreadCount;
+
+        Interlocked::Value      _tasksEnqueued;
+        Interlocked::Value      _tasksStarted;
+        Interlocked::Value64    _tasksCompleted;
+        Interlocked::Value64    _busyTime;
+        Interlocked::Value64    _queueWaitTime;
+        Interlocked::Value64    _maxQueueWait;
+        Interlocked::Value64    _metricsStartTime;
+
+        void EnqueueInternal(std::function<void()>&& task);
+        void WorkerThread(unsigned threadIndex);
+        void StartWorkerThreads(unsigned threadCount);
     };
 
     template<class Fn, class... Args>
@@ -44,6 +105,15 @@ namespace Utility
         {
             EnqueueInternal(std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...));
         }
+
+    /// <summary>Runs fn(0) ... fn(taskCount-1) across a thread pool</summary>
+    /// Each thread claims the next unprocessed task until they are all finished, so tasks
+    /// that take very different amounts of time are still balanced well. The calling thread
+    /// also processes tasks, and this function returns after every task has completed.
+    /// At most "maxWorkers" pool threads are used (0 runs every task on the calling thread).
+    void ParallelFor(
+        CompletionThreadPool& pool, unsigned taskCount, 
+        const std::function<void(unsigned)>& fn, unsigned maxWorkers = ~0u);
 }
 
 using namespace Utility;
@@ -25,6 +25,7 @@
         typedef tthread::fast_mutex Mutex;
         typedef tthread::recursive_mutex RecursiveMutex;    // \todo -- haven't checked if this mutex is properly recursive
         typedef tthread::fast_mutex ReadWriteMutex;         // read/write mutex not provided by tinythread. Maybe implement with AcquireSRWLockShared? Possibly part of C++14?
+        typedef tthread::condition_variable Conditional;
     }}
     using namespace Utility;
 
@@ -47,12 +48,14 @@
         //  If we drop VS2010 support, this would be the best option
 
     #include <mutex>
+    #include <condition_variable>
 
     namespace Utility { namespace Threading
     {
         using Mutex = std::mutex;
         using RecursiveMutex = std::recursive_mutex;
         using ReadWriteMutex = std::mutex;      // C++11 doesn't have a read/write lock (coming in C++14, apparently)
+        using Conditional = std::condition_variable;
     }}
     using namespace Utility;
 
@@ -77,6 +80,7 @@
     #include <tbb/critical_section.h>
     #include <tbb/queuing_rw_mutex.h>
     #include <tbb/recursive_mutex.h>
+    #include <condition_variable>
     #if defined(DEBUG_NEW)
         #define new DEBUG_NEW
     #endif
@@ -86,6 +90,7 @@
         typedef tbb::critical_section Mutex;
         typedef tbb::recursive_mutex RecursiveMutex;
         typedef tbb::queuing_rw_mutex ReadWriteMutex;
+        typedef std::condition_variable_any Conditional;
     }}
     using namespace Utility;
 
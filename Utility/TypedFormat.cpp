@@ -0,0 +1,620 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TypedFormat.h"
+#include "StringFormat.h"
+#include "Streams/Stream.h"
+#include "MemoryUtils.h"
+#include <cmath>
+#include <climits>
+#include <assert.h>
+
+namespace Utility
+{
+    using Spec = CompiledFormat::Spec;
+    using SpecFlags = CompiledFormat::Spec::Flags;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  Output goes into a fixed size block of memory. When we're writing to a stream,
+        //  the block is just a staging area, and gets flushed to the stream as it fills.
+        //  Otherwise, output is truncated when the block is full.
+    class FormatWriter
+    {
+    public:
+        char*           _begin;
+        char*           _ptr;
+        char*           _end;
+        unsigned        _written;
+        OutputStream*   _outputStream;
+        std::ostream*   _ostream;
+
+        void Write(const char* begin, const char* end)
+        {
+            while (begin < end) {
+                if (_ptr == _end && !Drain()) return;
+                auto count = std::min(end - begin, _end - _ptr);
+                XlCopyMemory(_ptr, begin, count);
+                _ptr += count; begin += count;
+                _written += unsigned(count);
+            }
+        }
+
+        void Fill(char chr, int count)
+        {
+            while (count > 0) {
+                if (_ptr == _end && !Drain()) return;
+                auto c = std::min(ptrdiff_t(count), _end - _ptr);
+                XlSetMemory(_ptr, chr, c);
+                _ptr += c; count -= int(c);
+                _written += unsigned(c);
+            }
+        }
+
+        bool Drain()
+        {
+            if (_outputStream) {
+                _outputStream->Write(StringSection<utf8>((const utf8*)_begin, (const utf8*)_ptr));
+            } else if (_ostream) {
+                _ostream->write(_begin, _ptr - _begin);
+            } else
+                return false;
+            _ptr = _begin;
+            return true;
+        }
+
+        FormatWriter(char* begin, char* end)
+        : _begin(begin), _ptr(begin), _end(end), _written(0)
+        , _outputStream(nullptr), _ostream(nullptr) {}
+    };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static const char s_digitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+        //  Writes digits backwards from "end", and returns the first digit
+    static char* WriteDecimal(char* end, uint64 value)
+    {
+            //  Most values fit in 32 bits, and 32 bit division is much cheaper
+        while (value > 0xffffffffull) {
+            auto r = unsigned(value % 100); value /= 100;
+            end -= 2; end[0] = s_digitPairs[r*2]; end[1] = s_digitPairs[r*2+1];
+        }
+        auto v = unsigned(value);
+        while (v >= 100) {
+            auto r = v % 100; v /= 100;
+            end -= 2; end[0] = s_digitPairs[r*2]; end[1] = s_digitPairs[r*2+1];
+        }
+        if (v >= 10) {
+            end -= 2; end[0] = s_digitPairs[v*2]; end[1] = s_digitPairs[v*2+1];
+        } else {
+            *--end = char('0' + v);
+        }
+        return end;
+    }
+
+    static char* WritePowerOf2Base(char* end, uint64 value, unsigned bitsPerDigit, bool upperCase)
+    {
+        const char* digits = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+        auto mask = (1u << bitsPerDigit) - 1;
+        do {
+            *--end = digits[unsigned(value) & mask];
+            value >>= bitsPerDigit;
+        } while (value);
+        return end;
+    }
+
+    static void WritePadded(
+        FormatWriter& writer, const Spec& spec,
+        const char* prefixBegin, const char* prefixEnd,
+        int zeroCount,
+        const char* bodyBegin, const char* bodyEnd)
+    {
+        auto length = int(prefixEnd - prefixBegin) + zeroCount + int(bodyEnd - bodyBegin);
+        auto padding = std::max(spec._width - length, 0);
+        if (!(spec._flags & SpecFlags::LeftAlign)) {
+            if (spec._flags & SpecFlags::ZeroPad) {
+                zeroCount += padding;
+            } else
+                writer.Fill(' ', padding);
+        }
+        writer.Write(prefixBegin, prefixEnd);
+        writer.Fill('0', zeroCount);
+        writer.Write(bodyBegin, bodyEnd);
+        if (spec._flags & SpecFlags::LeftAlign)
+            writer.Fill(' ', padding);
+    }
+
+    static char SignChar(const Spec& spec, bool negative)
+    {
+        if (negative) return '-';
+        if (spec._flags & SpecFlags::ForceSign) return '+';
+        if (spec._flags & SpecFlags::SpacePositive) return ' ';
+        return 0;
+    }
+
+    static void WriteInteger(FormatWriter& writer, Spec spec, uint64 magnitude, bool negative, bool isSigned)
+    {
+        char buffer[24];
+        char* end = &buffer[dimof(buffer)];
+        char* begin = end;
+
+        char prefix[2]; unsigned prefixLength = 0;
+        if (isSigned) {
+            auto sign = SignChar(spec, negative);
+            if (sign) prefix[prefixLength++] = sign;
+        }
+
+            //  (as per printf, a zero precision with a zero value writes no digits)
+        if (magnitude || spec._precision != 0) {
+            switch (spec._conversion) {
+            case 'x':
+            case 'X':
+                begin = WritePowerOf2Base(end, magnitude, 4, spec._conversion == 'X');
+                if ((spec._flags & SpecFlags::Alternate) && magnitude) {
+                    prefix[prefixLength++] = '0';
+                    prefix[prefixLength++] = spec._conversion;
+                }
+                break;
+
+            case 'o':
+                begin = WritePowerOf2Base(end, magnitude, 3, false);
+                break;
+
+            default:
+                begin = WriteDecimal(end, magnitude);
+                break;
+            }
+        }
+
+            //  (the alternate form of octal always starts with a zero digit -- even for
+            //  zero values with zero precision)
+        if (spec._conversion == 'o' && (spec._flags & SpecFlags::Alternate) && (begin == end || *begin != '0'))
+            *--begin = '0';
+
+        int zeroCount = std::max(spec._precision - int(end - begin), 0);
+        if (spec._precision >= 0)
+            spec._flags &= ~SpecFlags::ZeroPad;     // (precision overrides zero padding)
+        WritePadded(writer, spec, prefix, &prefix[prefixLength], zeroCount, begin, end);
+    }
+
+        //  Signed values written as hex or octal are written as their bit pattern, without
+        //  a sign (32 bit for values that fit in an int, as printf would)
+    static void WriteSignedInteger(FormatWriter& writer, const Spec& spec, int64 value)
+    {
+        if (spec._conversion == 'x' || spec._conversion == 'X' || spec._conversion == 'o') {
+            auto bits = (value >= INT_MIN && value <= INT_MAX) ? uint64(uint32(int32(value))) : uint64(value);
+            return WriteInteger(writer, spec, bits, false, false);
+        }
+        bool negative = value < 0;
+        WriteInteger(writer, spec, negative ? (0ull - uint64(value)) : uint64(value), negative, true);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static const uint64 s_powersOf10[] =
+    {
+        1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+        10000000ull, 100000000ull, 1000000000ull
+    };
+    static const unsigned MaxFastPrecision = unsigned(dimof(s_powersOf10) - 1);
+
+    static void Multiply64(uint64 a, uint64 b, uint64& high, uint64& low)
+    {
+        uint64 a0 = a & 0xffffffffull, a1 = a >> 32ull;
+        uint64 b0 = b & 0xffffffffull, b1 = b >> 32ull;
+        uint64 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+        uint64 middle = (p00 >> 32ull) + (p01 & 0xffffffffull) + (p10 & 0xffffffffull);
+        low = (middle << 32ull) | (p00 & 0xffffffffull);
+        high = p11 + (p01 >> 32ull) + (p10 >> 32ull) + (middle >> 32ull);
+    }
+
+        //  Calculates round(value * 10^precision) exactly (with ties to even), using
+        //  only integer math. We can't rely on floating point tricks here, because
+        //  we're often compiled with relaxed floating point rules.
+    static uint64 ScaleAndRound(double value, unsigned precision)
+    {
+        uint64 bits;
+        XlCopyMemory(&bits, &value, sizeof(bits));
+        auto biasedExponent = int((bits >> 52ull) & 0x7ff);
+        auto mantissa = bits & ((1ull << 52ull) - 1ull);
+        int exponent;
+        if (biasedExponent) {
+            mantissa |= 1ull << 52ull;
+            exponent = biasedExponent - 1075;
+        } else
+            exponent = -1074;
+
+        uint64 high, low;
+        Multiply64(mantissa, s_powersOf10[precision], high, low);
+        if (exponent >= 0)      // (caller ensures the result fits in 64 bits)
+            return low << uint64(exponent);
+
+        auto shift = unsigned(-exponent);
+        if (shift > 100) return 0;      // (product is less than 2^83, so this is below 0.5)
+
+        uint64 result;
+        if (shift < 64) {
+            result = (low >> uint64(shift)) | (shift ? (high << uint64(64 - shift)) : 0);
+        } else
+            result = high >> uint64(shift - 64);
+
+        auto roundBitIndex = shift - 1;
+        bool roundBit, sticky;
+        if (roundBitIndex < 64) {
+            roundBit = !!((low >> uint64(roundBitIndex)) & 1ull);
+            sticky = !!(low & ((1ull << uint64(roundBitIndex)) - 1ull));
+        } else {
+            roundBit = !!((high >> uint64(roundBitIndex - 64)) & 1ull);
+            sticky = low || (high & ((1ull << uint64(roundBitIndex - 64)) - 1ull));
+        }
+        if (roundBit && (sticky || (result & 1ull)))
+            ++result;
+        return result;
+    }
+
+    static void WriteFloatFallback(FormatWriter& writer, const Spec& spec, double value)
+    {
+            //  Rebuild the conversion specification, and let xl_snprintf handle
+            //  just this value
+        char fmt[32], *f = fmt;
+        *f++ = '%';
+        if (spec._flags & SpecFlags::LeftAlign)     *f++ = '-';
+        if (spec._flags & SpecFlags::ForceSign)     *f++ = '+';
+        if (spec._flags & SpecFlags::ZeroPad)       *f++ = '0';
+        if (spec._flags & SpecFlags::SpacePositive) *f++ = ' ';
+        if (spec._flags & SpecFlags::Alternate)     *f++ = '#';
+        char temp[12];
+        if (spec._width > 0)
+            f = std::copy(WriteDecimal(&temp[dimof(temp)], spec._width), &temp[dimof(temp)], f);
+        if (spec._precision >= 0) {
+            *f++ = '.';
+            f = std::copy(WriteDecimal(&temp[dimof(temp)], spec._precision), &temp[dimof(temp)], f);
+        }
+        *f++ = spec._conversion;
+        *f = '\0';
+
+        char buffer[512];
+        auto length = xl_snprintf(buffer, int(dimof(buffer)), fmt, value);
+        writer.Write(buffer, &buffer[std::max(0, std::min(length, int(dimof(buffer))-1))]);
+    }
+
+    static void WriteFloat(FormatWriter& writer, Spec spec, double value)
+    {
+        if (spec._conversion != 'f' && spec._conversion != 'F')
+            return WriteFloatFallback(writer, spec, value);
+
+        auto precision = (spec._precision >= 0) ? unsigned(spec._precision) : 6u;
+        bool negative = std::signbit(value);
+        auto magnitude = std::abs(value);
+        if (precision > MaxFastPrecision || !(magnitude * double(s_powersOf10[precision]) < 9e18))
+            return WriteFloatFallback(writer, spec, value);     // (also catches nan & infinity)
+
+        auto scaled = ScaleAndRound(magnitude, precision);
+        auto integerPart = scaled / s_powersOf10[precision];
+        auto fractionalPart = scaled % s_powersOf10[precision];
+
+        char buffer[48];
+        char* end = &buffer[dimof(buffer)];
+        char* begin = end;
+        if (precision) {
+            begin = WriteDecimal(end, fractionalPart);
+            while (begin > end - precision) *--begin = '0';
+        }
+        if (precision || (spec._flags & SpecFlags::Alternate))
+            *--begin = '.';
+        begin = WriteDecimal(begin, integerPart);
+
+        char sign = SignChar(spec, negative);
+        WritePadded(writer, spec, &sign, &sign + (sign?1:0), 0, begin, end);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static void WriteString(FormatWriter& writer, const Spec& spec, const char* begin, const char* end)
+    {
+        if (!begin) {
+            static const char nullString[] = "<null>";
+            begin = nullString; end = &nullString[dimof(nullString)-1];
+        } else if (!end) {
+                //  (don't read beyond the precision, the string might not be terminated)
+            end = begin;
+            if (spec._precision >= 0) {
+                while (end < begin + spec._precision && *end) ++end;
+            } else
+                end += XlStringLen(begin);
+        }
+        if (spec._precision >= 0)
+            end = std::min(end, begin + spec._precision);
+
+        Spec s = spec;
+        s._flags &= ~SpecFlags::ZeroPad;
+        WritePadded(writer, s, nullptr, nullptr, 0, begin, end);
+    }
+
+    static void WriteArgument(FormatWriter& writer, Spec spec, const FormatArg& arg)
+    {
+            //  The type of the argument takes priority over the conversion. The
+            //  conversion just selects between compatible options (eg, hex or decimal)
+        auto conversion = spec._conversion;
+        bool isIntegerConversion =
+                conversion == 'd' || conversion == 'i' || conversion == 'u'
+            ||  conversion == 'x' || conversion == 'X' || conversion == 'o';
+        bool isFloatConversion =
+                conversion == 'f' || conversion == 'F' || conversion == 'e' || conversion == 'E'
+            ||  conversion == 'g' || conversion == 'G' || conversion == 'a' || conversion == 'A';
+
+        switch (arg._type) {
+        case FormatArg::Type::Signed:
+        case FormatArg::Type::Unsigned:
+            {
+                bool isSigned = arg._type == FormatArg::Type::Signed;
+                if (isFloatConversion)
+                    return WriteFloat(writer, spec, isSigned ? double(arg._signed) : double(arg._unsigned));
+                if (conversion == 'c') {
+                    char chr = char(arg._signed);
+                    return WriteString(writer, spec, &chr, &chr+1);
+                }
+                if (!isIntegerConversion) spec._conversion = 'd';
+                if (isSigned)
+                    return WriteSignedInteger(writer, spec, arg._signed);
+                return WriteInteger(writer, spec, arg._unsigned, false, false);
+            }
+
+        case FormatArg::Type::Float:
+            if (isIntegerConversion)
+                return WriteSignedInteger(writer, spec, std::isfinite(arg._float) ? int64(arg._float) : 0ll);
+            if (!isFloatConversion) spec._conversion = 'g';
+            return WriteFloat(writer, spec, arg._float);
+
+        case FormatArg::Type::Char:
+            if (isIntegerConversion)
+                return WriteInteger(writer, spec, uint64(uint8(arg._char)), false, false);
+            return WriteString(writer, spec, &arg._char, &arg._char+1);
+
+        case FormatArg::Type::Bool:
+            if (isIntegerConversion)
+                return WriteInteger(writer, spec, arg._bool ? 1 : 0, false, false);
+            {
+                static const char trueString[] = "true", falseString[] = "false";
+                if (arg._bool) return WriteString(writer, spec, trueString, &trueString[dimof(trueString)-1]);
+                return WriteString(writer, spec, falseString, &falseString[dimof(falseString)-1]);
+            }
+
+        case FormatArg::Type::String:
+            return WriteString(writer, spec, arg._string, arg._stringEnd);
+
+        case FormatArg::Type::Pointer:
+            {
+                    //  (as per MSVC's printf; fixed width upper case hex)
+                spec._conversion = 'X';
+                spec._precision = int(sizeof(void*) * 2);
+                spec._flags &= ~SpecFlags::Alternate;
+                return WriteInteger(writer, spec, uint64(size_t(arg._pointer)), false, false);
+            }
+
+        default:
+            break;
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  Parses the conversion specification after a '%'. Returns the character after the
+        //  specification. Leaves spec._conversion as 0 if the format ended early.
+    static const char* ParseSpec(const char* i, Spec& spec)
+    {
+        for (;;++i) {
+            switch (*i) {
+            case '-': spec._flags |= SpecFlags::LeftAlign; continue;
+            case '+': spec._flags |= SpecFlags::ForceSign; continue;
+            case '0': spec._flags |= SpecFlags::ZeroPad; continue;
+            case ' ': spec._flags |= SpecFlags::SpacePositive; continue;
+            case '#': spec._flags |= SpecFlags::Alternate; continue;
+            }
+            break;
+        }
+
+        if (*i == '*') {
+            spec._flags |= SpecFlags::WidthFromArg; ++i;
+        } else {
+            while (*i >= '0' && *i <= '9') spec._width = spec._width * 10 + (*i++ - '0');
+        }
+
+        if (*i == '.') {
+            ++i;
+            spec._precision = 0;
+            if (*i == '*') {
+                spec._flags |= SpecFlags::PrecisionFromArg; ++i;
+            } else {
+                while (*i >= '0' && *i <= '9') spec._precision = spec._precision * 10 + (*i++ - '0');
+            }
+        }
+
+            //  Length modifiers are ignored, because we know the types of the arguments
+        for (;;) {
+            if (*i == 'h' || *i == 'l' || *i == 'L' || *i == 'q' || *i == 'j' || *i == 'z' || *i == 't' || *i == 'w') { ++i; continue; }
+            if (*i == 'I') {
+                ++i;
+                if ((i[0] == '3' && i[1] == '2') || (i[0] == '6' && i[1] == '4')) i += 2;
+                continue;
+            }
+            break;
+        }
+
+        spec._conversion = *i;
+        return (*i) ? (i+1) : i;
+    }
+
+    static unsigned ArgumentCount(const Spec& spec)
+    {
+        return 1 + !!(spec._flags & SpecFlags::WidthFromArg) + !!(spec._flags & SpecFlags::PrecisionFromArg);
+    }
+
+    static void WriteSpec(FormatWriter& writer, Spec spec, const FormatArg args[], unsigned argCount, unsigned& argIndex)
+    {
+        auto IntegerArg = [&]() -> int
+        {
+            if (argIndex >= argCount) return 0;
+            const auto& a = args[argIndex++];
+            if (a._type == FormatArg::Type::Signed) return int(a._signed);
+            if (a._type == FormatArg::Type::Unsigned) return int(a._unsigned);
+            return 0;
+        };
+
+        if (spec._flags & SpecFlags::WidthFromArg) {
+            spec._width = IntegerArg();
+            if (spec._width < 0) {
+                spec._flags |= SpecFlags::LeftAlign;
+                spec._width = -spec._width;
+            }
+        }
+        if (spec._flags & SpecFlags::PrecisionFromArg)
+            spec._precision = std::max(IntegerArg(), -1);
+
+        assert(argIndex < argCount);    // too few arguments for the format string
+        if (argIndex < argCount)
+            WriteArgument(writer, spec, args[argIndex++]);
+    }
+
+    static void FormatImpl(FormatWriter& writer, const char format[], const FormatArg args[], unsigned argCount, unsigned argIndex = 0)
+    {
+        const char* i = format;
+        for (;;) {
+            auto literalStart = i;
+            while (*i && *i != '%') ++i;
+            writer.Write(literalStart, i);
+            if (!*i) break;
+
+            ++i;
+            if (*i == '%') {
+                writer.Write(i, i+1);
+                ++i;
+                continue;
+            }
+
+            Spec spec;
+            i = ParseSpec(i, spec);
+            if (!spec._conversion) break;
+            WriteSpec(writer, spec, args, argCount, argIndex);
+        }
+        assert(argIndex == argCount);   // too many arguments for the format string
+    }
+
+    static void FormatImpl(FormatWriter& writer, const CompiledFormat& format, const FormatArg args[], unsigned argCount)
+    {
+        assert(format._remainder || format._argumentCount == argCount);
+        unsigned argIndex = 0;
+        for (unsigned c=0; c<format._segmentCount; ++c) {
+            const auto& seg = format._segments[c];
+            writer.Write(seg._literalBegin, seg._literalEnd);
+            if (seg._spec._conversion)
+                WriteSpec(writer, seg._spec, args, argCount, argIndex);
+        }
+        if (format._remainder)
+            FormatImpl(writer, format._remainder, args, argCount, argIndex);
+    }
+
+    CompiledFormat::CompiledFormat(const char format[])
+    : _segmentCount(0), _argumentCount(0), _remainder(nullptr)
+    {
+        const char* i = format;
+        for (;;) {
+            if (_segmentCount == MaxSegments) {
+                _remainder = i;
+                break;
+            }
+
+            auto& seg = _segments[_segmentCount++];
+            seg._literalBegin = i;
+            while (*i && *i != '%') ++i;
+            seg._literalEnd = i;
+            if (!*i) break;
+
+            ++i;
+            if (*i == '%') {
+                    //  literal '%' -- just include it at the end of this segment
+                seg._literalEnd = i;
+                ++i;
+                continue;
+            }
+
+            i = ParseSpec(i, seg._spec);
+            if (!seg._spec._conversion) break;
+            _argumentCount += ArgumentCount(seg._spec);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static void AttachStream(FormatWriter& writer, OutputStream& stream) { writer._outputStream = &stream; }
+    static void AttachStream(FormatWriter& writer, std::ostream& stream) { writer._ostream = &stream; }
+
+    template<typename Format>
+        static unsigned FormatIntoBufferT(char* bufferBegin, char* bufferEnd, const Format& format, const FormatArg args[], unsigned argCount)
+        {
+            if (bufferEnd <= bufferBegin) return 0;
+            FormatWriter writer(bufferBegin, bufferEnd-1);      // (leave space for the terminator)
+            FormatImpl(writer, format, args, argCount);
+            *writer._ptr = '\0';
+            return writer._written;
+        }
+
+    template<typename Stream, typename Format>
+        static unsigned FormatIntoStreamT(Stream& stream, const Format& format, const FormatArg args[], unsigned argCount)
+        {
+            char buffer[256];
+            FormatWriter writer(buffer, &buffer[dimof(buffer)]);
+            AttachStream(writer, stream);
+            FormatImpl(writer, format, args, argCount);
+            writer.Drain();
+            return writer._written;
+        }
+
+    namespace Internal
+    {
+        unsigned FormatIntoBuffer(char* bufferBegin, char* bufferEnd, const char format[], const FormatArg args[], unsigned argCount) never_throws
+        {
+            return FormatIntoBufferT(bufferBegin, bufferEnd, format, args, argCount);
+        }
+
+        unsigned FormatIntoBuffer(char* bufferBegin, char* bufferEnd, const CompiledFormat& format, const FormatArg args[], unsigned argCount) never_throws
+        {
+            return FormatIntoBufferT(bufferBegin, bufferEnd, format, args, argCount);
+        }
+
+        unsigned FormatIntoStream(OutputStream& stream, const char format[], const FormatArg args[], unsigned argCount)
+        {
+            return FormatIntoStreamT(stream, format, args, argCount);
+        }
+
+        unsigned FormatIntoStream(OutputStream& stream, const CompiledFormat& format, const FormatArg args[], unsigned argCount)
+        {
+            return FormatIntoStreamT(stream, format, args, argCount);
+        }
+
+        unsigned FormatIntoStream(std::ostream& stream, const char format[], const FormatArg args[], unsigned argCount)
+        {
+            return FormatIntoStreamT(stream, format, args, argCount);
+        }
+
+        unsigned FormatIntoStream(std::ostream& stream, const CompiledFormat& format, const FormatArg args[], unsigned argCount)
+        {
+            return FormatIntoStreamT(stream, format, args, argCount);
+        }
+    }
+}
+
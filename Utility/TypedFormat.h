@@ -0,0 +1,229 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Detail/API.h"
+#include "StringUtils.h"        // for StringSection
+#include "../Core/Types.h"
+#include "../Core/Prefix.h"
+#include <string>
+#include <algorithm>
+#include <ostream>
+
+namespace Utility
+{
+    class OutputStream;
+
+    /// <summary>A single argument for the typed formatting functions</summary>
+    /// Arguments are captured by type, rather than through a va_list. So the formatter
+    /// always knows what it has been given, and mismatches between the format string
+    /// and the arguments can't read garbage from the stack. Types without a constructor
+    /// here are a compile error (rather than undefined behaviour at runtime).
+    ///
+    /// Strings are captured by pointer, so a FormatArg must not outlive the expression
+    /// that created it.
+    class FormatArg
+    {
+    public:
+        struct Type { enum Enum { None, Signed, Unsigned, Float, String, Char, Bool, Pointer }; };
+        Type::Enum _type;
+        union
+        {
+            int64           _signed;
+            uint64          _unsigned;
+            double          _float;
+            const char*     _string;
+            const void*     _pointer;
+            char            _char;
+            bool            _bool;
+        };
+        const char* _stringEnd;         // (nullptr for null terminated strings)
+
+        FormatArg()                         : _type(Type::None), _unsigned(0), _stringEnd(nullptr) {}
+        FormatArg(signed char value)        : _type(Type::Signed), _signed(value), _stringEnd(nullptr) {}
+        FormatArg(short value)              : _type(Type::Signed), _signed(value), _stringEnd(nullptr) {}
+        FormatArg(int value)                : _type(Type::Signed), _signed(value), _stringEnd(nullptr) {}
+        FormatArg(long value)               : _type(Type::Signed), _signed(value), _stringEnd(nullptr) {}
+        FormatArg(long long value)          : _type(Type::Signed), _signed(value), _stringEnd(nullptr) {}
+        FormatArg(unsigned char value)      : _type(Type::Unsigned), _unsigned(value), _stringEnd(nullptr) {}
+        FormatArg(unsigned short value)     : _type(Type::Unsigned), _unsigned(value), _stringEnd(nullptr) {}
+        FormatArg(unsigned value)           : _type(Type::Unsigned), _unsigned(value), _stringEnd(nullptr) {}
+        FormatArg(unsigned long value)      : _type(Type::Unsigned), _unsigned(value), _stringEnd(nullptr) {}
+        FormatArg(unsigned long long value) : _type(Type::Unsigned), _unsigned(value), _stringEnd(nullptr) {}
+        FormatArg(float value)              : _type(Type::Float), _float(value), _stringEnd(nullptr) {}
+        FormatArg(double value)             : _type(Type::Float), _float(value), _stringEnd(nullptr) {}
+        FormatArg(char value)               : _type(Type::Char), _char(value), _stringEnd(nullptr) {}
+        FormatArg(bool value)               : _type(Type::Bool), _bool(value), _stringEnd(nullptr) {}
+        FormatArg(const char* value)        : _type(Type::String), _string(value), _stringEnd(nullptr) {}
+        FormatArg(char* value)              : _type(Type::String), _string(value), _stringEnd(nullptr) {}
+        FormatArg(const std::string& value) : _type(Type::String), _string(value.c_str()), _stringEnd(value.c_str() + value.size()) {}
+        FormatArg(StringSection<char> value): _type(Type::String), _string(value._start), _stringEnd(value._end) {}
+        template<typename PointerType>
+            FormatArg(PointerType* value)   : _type(Type::Pointer), _pointer(value), _stringEnd(nullptr) {}
+    };
+
+    /// <summary>A format string that has been parsed ahead of time</summary>
+    /// The typed formatting functions accept either a plain format string (which is
+    /// parsed as it is written) or a CompiledFormat. For formats used on hot paths,
+    /// parse once and keep the result in a static:
+    /// <code>\code
+    ///     static const CompiledFormat s_format("%6.2f ms");
+    ///     FormatInto(buffer, s_format, latency);
+    /// \endcode</code>
+    /// The syntax is printf's: "%[flags][width][.precision][length]conversion", with
+    /// "*" for width or precision taken from an argument. Length modifiers (h, l, ll,
+    /// I64, z, etc) are accepted but ignored, because the argument types are known.
+    /// Positional arguments ("%1$d") are not supported.
+    ///
+    /// The format string is not copied, so it must outlive the CompiledFormat (normally
+    /// it's a string literal).
+    class XL_UTILITY_API CompiledFormat
+    {
+    public:
+        class Spec
+        {
+        public:
+            struct Flags { enum Enum { LeftAlign = 1<<0, ForceSign = 1<<1, ZeroPad = 1<<2, SpacePositive = 1<<3, Alternate = 1<<4, WidthFromArg = 1<<5, PrecisionFromArg = 1<<6 }; };
+            char        _conversion;    // 0 for segments that are just literal text
+            uint8       _flags;
+            int         _width;
+            int         _precision;     // -1 when not given
+
+            Spec() : _conversion(0), _flags(0), _width(0), _precision(-1) {}
+        };
+
+        class Segment
+        {
+        public:
+            const char* _literalBegin;
+            const char* _literalEnd;
+            Spec        _spec;          // (written after the literal)
+        };
+
+        static const unsigned MaxSegments = 32;
+        Segment     _segments[MaxSegments];
+        unsigned    _segmentCount;
+        unsigned    _argumentCount;     // including arguments for "*" width and precision
+
+        const char* _remainder;         // (set when the format has too many segments; parsed as it is written)
+
+        explicit CompiledFormat(const char format[]);
+    };
+
+    namespace Internal
+    {
+        XL_UTILITY_API unsigned FormatIntoBuffer(char* bufferBegin, char* bufferEnd, const char format[], const FormatArg args[], unsigned argCount) never_throws;
+        XL_UTILITY_API unsigned FormatIntoBuffer(char* bufferBegin, char* bufferEnd, const CompiledFormat& format, const FormatArg args[], unsigned argCount) never_throws;
+        XL_UTILITY_API unsigned FormatIntoStream(OutputStream& stream, const char format[], const FormatArg args[], unsigned argCount);
+        XL_UTILITY_API unsigned FormatIntoStream(OutputStream& stream, const CompiledFormat& format, const FormatArg args[], unsigned argCount);
+        XL_UTILITY_API unsigned FormatIntoStream(std::ostream& stream, const char format[], const FormatArg args[], unsigned argCount);
+        XL_UTILITY_API unsigned FormatIntoStream(std::ostream& stream, const CompiledFormat& format, const FormatArg args[], unsigned argCount);
+
+        template<typename Format, typename... Args>
+            class FormattedString
+            {
+            public:
+                const Format&   _format;
+                FormatArg       _args[sizeof...(Args)+1];
+                FormattedString(const Format& format, const Args&... args) : _format(format)
+                {
+                    const FormatArg a[] = { FormatArg(args)..., FormatArg() };
+                    std::copy(a, &a[dimof(a)], _args);
+                }
+            };
+    }
+
+    /// <summary>Type-safe, allocation free string formatting</summary>
+    /// Writes a printf style format into a fixed size buffer. The result is always null
+    /// terminated (and truncated if the buffer is too small). Returns the number of
+    /// characters written (not including the terminator).
+    ///
+    /// Unlike xl_snprintf, the arguments are captured by type, so integer and floating
+    /// point conversions can't be mixed up. The type of the argument wins: "%d" with a
+    /// float argument writes the value truncated to an integer, "%f" with an integer
+    /// converts it to floating point, and "%s" with a number writes the number.
+    /// std::string and StringSection<char> can be used directly with "%s".
+    ///
+    /// Integers and "%f" with a precision of 9 or less have fast paths. Other floating
+    /// point conversions fall back to xl_snprintf for the single value.
+    ///
+    /// <example>
+    ///     <code>\code
+    ///         char buffer[64];
+    ///         FormatInto(buffer, "(%4ix%4i) mips:(%i)", width, height, mipCount);
+    ///     \endcode</code>
+    /// </example>
+    template<int Count, typename... Args>
+        unsigned FormatInto(char (&buffer)[Count], const char format[], const Args&... args) never_throws
+        {
+            const FormatArg a[] = { FormatArg(args)..., FormatArg() };
+            return Internal::FormatIntoBuffer(buffer, &buffer[Count], format, a, unsigned(sizeof...(Args)));
+        }
+
+    template<int Count, typename... Args>
+        unsigned FormatInto(char (&buffer)[Count], const CompiledFormat& format, const Args&... args) never_throws
+        {
+            const FormatArg a[] = { FormatArg(args)..., FormatArg() };
+            return Internal::FormatIntoBuffer(buffer, &buffer[Count], format, a, unsigned(sizeof...(Args)));
+        }
+
+    template<typename... Args>
+        unsigned FormatInto(char* bufferBegin, char* bufferEnd, const char format[], const Args&... args) never_throws
+        {
+            const FormatArg a[] = { FormatArg(args)..., FormatArg() };
+            return Internal::FormatIntoBuffer(bufferBegin, bufferEnd, format, a, unsigned(sizeof...(Args)));
+        }
+
+    template<typename... Args>
+        unsigned FormatInto(char* bufferBegin, char* bufferEnd, const CompiledFormat& format, const Args&... args) never_throws
+        {
+            const FormatArg a[] = { FormatArg(args)..., FormatArg() };
+            return Internal::FormatIntoBuffer(bufferBegin, bufferEnd, format, a, unsigned(sizeof...(Args)));
+        }
+
+    /// <summary>Type-safe formatting into an OutputStream</summary>
+    /// The output is built in a small stack buffer and written to the stream in blocks,
+    /// so there are no allocations (other than whatever the stream does). Returns the
+    /// number of characters written.
+    template<typename... Args>
+        unsigned FormatInto(OutputStream& stream, const char format[], const Args&... args)
+        {
+            const FormatArg a[] = { FormatArg(args)..., FormatArg() };
+            return Internal::FormatIntoStream(stream, format, a, unsigned(sizeof...(Args)));
+        }
+
+    template<typename... Args>
+        unsigned FormatInto(OutputStream& stream, const CompiledFormat& format, const Args&... args)
+        {
+            const FormatArg a[] = { FormatArg(args)..., FormatArg() };
+            return Internal::FormatIntoStream(stream, format, a, unsigned(sizeof...(Args)));
+        }
+
+    /// <summary>Type-safe formatting for StringMeld and std::ostream</summary>
+    /// <example>
+    ///     <code>\code
+    ///         window.SetTitle(StringMeld<128>() << "Frame: " << Formatted("%6.2f ms", frameTime));
+    ///     \endcode</code>
+    /// </example>
+    template<typename Format, typename... Args>
+        Internal::FormattedString<Format, Args...> Formatted(const Format& format, const Args&... args)
+        {
+            return Internal::FormattedString<Format, Args...>(format, args...);
+        }
+
+    namespace Internal
+    {
+        template<typename Format, typename... Args>
+            std::ostream& operator<<(std::ostream& stream, const FormattedString<Format, Args...>& str)
+            {
+                FormatIntoStream(stream, str._format, str._args, unsigned(sizeof...(Args)));
+                return stream;
+            }
+    }
+}
+
+using namespace Utility;
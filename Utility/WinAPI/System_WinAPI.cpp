@@ -15,6 +15,7 @@
 #include <process.h>
 #include <share.h>
 #include <time.h>
+#include <algorithm>
 
 #include <Psapi.h>
 #include <Shellapi.h>
@@ -256,6 +257,67 @@ const char* XlGetCommandLine()
     return GetCommandLine();
 }
 
+static unsigned CountBits(uint64 mask)
+{
+    unsigned result = 0;
+    for (; mask; mask &= mask-1) ++result;
+    return result;
+}
+
+CPUTopology XlGetCPUTopology()
+{
+    CPUTopology result;
+    result._logicalProcessorCount = 0;
+
+        //  Note that we only look at the processor group for the current process 
+        //  (so, at most 64 logical processors)
+    DWORD bufferSize = 0;
+    GetLogicalProcessorInformation(nullptr, &bufferSize);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(bufferSize / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!info.empty() && GetLogicalProcessorInformation(AsPointer(info.begin()), &bufferSize)) {
+        for (const auto& i:info)
+            if (i.Relationship == RelationProcessorCore) {
+                result._physicalCores.push_back(uint64(i.ProcessorMask));
+                result._logicalProcessorCount += CountBits(uint64(i.ProcessorMask));
+            }
+    }
+
+    if (result._physicalCores.empty()) {
+            // fallback -- assume every logical processor is a separate core
+        SYSTEM_INFO sysInfo;
+        GetSystemInfo(&sysInfo);
+        result._logicalProcessorCount = std::max(unsigned(sysInfo.dwNumberOfProcessors), 1u);
+        for (unsigned c=0; c<std::min(result._logicalProcessorCount, 64u); ++c)
+            result._physicalCores.push_back(1ull << uint64(c));
+    }
+
+    return std::move(result);
+}
+
+void XlSetCurrentThreadPriority(ThreadPriority::Enum priority)
+{
+    int winPriority = THREAD_PRIORITY_NORMAL;
+    switch (priority) {
+    case ThreadPriority::Background:    winPriority = THREAD_PRIORITY_LOWEST; break;
+    case ThreadPriority::Low:           winPriority = THREAD_PRIORITY_BELOW_NORMAL; break;
+    case ThreadPriority::High:          winPriority = THREAD_PRIORITY_ABOVE_NORMAL; break;
+    default: break;
+    }
+    SetThreadPriority(GetCurrentThread(), winPriority);
+}
+
+bool XlSetCurrentThreadAffinity(uint64 processorMask)
+{
+        //  The thread mask must be a subset of the process mask
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        return false;
+
+    auto mask = processorMask ? (DWORD_PTR(processorMask) & processMask) : processMask;
+    if (!mask) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
 #if 0
 
 void XlStartSelfProcess(const char* commandLine, int delaySec, bool terminateSelf)